@@ -34,6 +34,11 @@ namespace aly{
 	void AnisotropicDiffusion(const Image2f& imageIn,Image2f& out,int iterations=4,const AnisotropicKernel& kernel=AnisotropicKernel::Gaussian,float K=0.02f,float dt=1.0f);
 	void AnisotropicDiffusion(const Image3f& imageIn,Image3f& out,int iterations=4,const AnisotropicKernel& kernel=AnisotropicKernel::Gaussian,float K=0.02f,float dt=1.0f);
 	void AnisotropicDiffusion(const Image4f& imageIn,Image4f& out,int iterations=4,const AnisotropicKernel& kernel=AnisotropicKernel::Gaussian,float K=0.02f,float dt=1.0f);
+	void AnisotropicDiffusion(ResultCache& cache,const Image1us& imageIn,Image1us& out,int iterations=4,const AnisotropicKernel& kernel=AnisotropicKernel::Gaussian,float K=0.02f,float dt=1.0f);
+	void AnisotropicDiffusion(ResultCache& cache,const Image1f& imageIn,Image1f& out,int iterations=4,const AnisotropicKernel& kernel=AnisotropicKernel::Gaussian,float K=0.02f,float dt=1.0f);
+	void AnisotropicDiffusion(ResultCache& cache,const Image2f& imageIn,Image2f& out,int iterations=4,const AnisotropicKernel& kernel=AnisotropicKernel::Gaussian,float K=0.02f,float dt=1.0f);
+	void AnisotropicDiffusion(ResultCache& cache,const Image3f& imageIn,Image3f& out,int iterations=4,const AnisotropicKernel& kernel=AnisotropicKernel::Gaussian,float K=0.02f,float dt=1.0f);
+	void AnisotropicDiffusion(ResultCache& cache,const Image4f& imageIn,Image4f& out,int iterations=4,const AnisotropicKernel& kernel=AnisotropicKernel::Gaussian,float K=0.02f,float dt=1.0f);
 
 }
 
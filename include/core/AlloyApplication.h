@@ -83,6 +83,11 @@ public:
 			context->clearEvents(region);
 		}
 	}
+	static inline void removeRegion(Region* region) {
+		if (context.get() != nullptr) {
+			context->removeRegion(region);
+		}
+	}
 	static inline void addListener(EventHandler* region) {
 		if (context.get() != nullptr) {
 			context->addListener(region);
@@ -0,0 +1,59 @@
+/*
+* Copyright(C) 2015, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#ifndef INCLUDE_CORE_ALLOYCONNECTEDCOMPONENTS_H_
+#define INCLUDE_CORE_ALLOYCONNECTEDCOMPONENTS_H_
+#include "AlloyMath.h"
+#include "AlloyImage.h"
+#include "AlloyVolume.h"
+#include <vector>
+namespace aly {
+	bool SANITY_CHECK_CONNECTED_COMPONENTS();
+	enum class Connectivity {
+		Four = 4, Eight = 8, Six = 6, TwentySix = 26
+	};
+	template<int M> struct ConnectedComponent {
+		int label;//Value of the input label covered by this component.
+		int count;
+		box<int, M> bounds;
+		ConnectedComponent(int label = -1) :label(label), count(0) {
+		}
+	};
+	typedef ConnectedComponent<2> ConnectedComponent2D;
+	typedef ConnectedComponent<3> ConnectedComponent3D;
+	/*
+	 * Block based parallel union-find labeling. Blocks are labeled independently, then merged
+	 * across block borders with lock-free unions. Component ids are assigned in scan order and
+	 * sizes and bounding boxes are gathered in the same pass. If ignoreNegative is set,
+	 * pixels with negative labels are treated as background and receive label -1.
+	 */
+	int LabelConnectedComponents(const Image1i& labels, Image1i& outLabels, std::vector<ConnectedComponent2D>& components, Connectivity connectivity = Connectivity::Four, bool ignoreNegative = false);
+	int LabelConnectedComponents(const Image1i& labels, Image1i& outLabels, std::vector<int>& compCounts, Connectivity connectivity = Connectivity::Four, bool ignoreNegative = false);
+	int LabelConnectedComponents(const Volume1i& labels, Volume1i& outLabels, std::vector<ConnectedComponent3D>& components, Connectivity connectivity = Connectivity::Six, bool ignoreNegative = false);
+	int LabelConnectedComponents(const Volume1i& labels, Volume1i& outLabels, std::vector<int>& compCounts, Connectivity connectivity = Connectivity::Six, bool ignoreNegative = false);
+	//Labels components and sets those smaller than minSize to -1. Returns number of components removed.
+	int RemoveSmallConnectedComponents(const Image1i& labels, Image1i& outLabels, int minSize, Connectivity connectivity = Connectivity::Four, bool ignoreNegative = false);
+	int RemoveSmallConnectedComponents(const Volume1i& labels, Volume1i& outLabels, int minSize, Connectivity connectivity = Connectivity::Six, bool ignoreNegative = false);
+	//Connected components of a vertex graph given by triangle indexes.
+	int LabelTriangleComponents(const std::vector<uint3>& faces, int N, std::vector<int>& compCounts, std::vector<int>& labels);
+	int LabelTriangleComponents(const std::vector<size_t>& indexes, int N, std::vector<int>& compCounts, std::vector<int>& labels);
+	int LabelTriangleComponents(const std::vector<int>& indexes, int N, std::vector<int>& compCounts, std::vector<int>& labels);
+}
+#endif /* INCLUDE_CORE_ALLOYCONNECTEDCOMPONENTS_H_ */
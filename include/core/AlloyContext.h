@@ -149,6 +149,7 @@ namespace aly {
 	private:
 		std::thread::id threadId;
 		std::mutex taskLock;
+		std::mutex dirtyLock;
 		std::list<std::string> assetDirectories;
 		std::vector<std::shared_ptr<Font>> fonts;
 		std::list<GLFWwindow*> windowHistory;
@@ -178,6 +179,7 @@ namespace aly {
 		std::map<EventHandler*, std::string> listeners;
 		std::shared_ptr<Composite> glassPane;
 		std::list<std::function<void()>> deferredTasks;
+		std::vector<Region*> dirtyRegions;
 		static std::shared_ptr<AlloyContext> defaultContext;
 		int2 viewSize;
 		int2 screenSize;
@@ -185,6 +187,11 @@ namespace aly {
 		void addListener(EventHandler* region);
 		void removeListener(const EventHandler* region);
 		bool hasListener(EventHandler* region) const;
+		void packDirtyRegions(Composite& rootNode);
+		void clearDirtyRegions() {
+			std::lock_guard<std::mutex> guard(dirtyLock);
+			dirtyRegions.clear();
+		}
 	public:
 		friend class Application;
 		NVGcontext* nvgContext;
@@ -297,6 +304,23 @@ namespace aly {
 		void requestPack() {
 			dirtyLayout = true;
 		}
+		/*
+		 * Packs only this region and its descendants at the next update. Its
+		 * ancestors are packed as well if its bounds change. Use after changing
+		 * the children or layout of a region; the whole tree is packed when the
+		 * window or anything above the region changes.
+		 */
+		void requestPack(Region* region) {
+			if (region == nullptr) {
+				dirtyLayout = true;
+			} else {
+				//Scrolling can be driven from timer threads.
+				std::lock_guard<std::mutex> guard(dirtyLock);
+				dirtyRegions.push_back(region);
+			}
+		}
+		//Drops all references to a region that is being destroyed.
+		void removeRegion(Region* region);
 		Region* locate(const pixel2& cursor) const;
 		void requestUpdateCursor() {
 			dirtyCursor = true;
@@ -24,23 +24,73 @@
 
 #include "AlloyMath.h"
 #include "AlloyUnits.h"
-#include <list>
+#include <map>
+#include <unordered_map>
+#include <vector>
 #include <mutex>
 namespace aly {
 class Region;
+/*
+ * Spatial index of regions for hit testing. Regions are keyed by their
+ * position in the region tree, so a cell lists candidates in draw order and
+ * the topmost is tested first. A subtree can be removed and added again after
+ * it is packed without rebuilding the index for the whole tree. The grid
+ * resolution adapts to the number of regions.
+ */
 class CursorLocator {
-	static const int ROWS = 32;
-	static const int COLS = 18;
-	std::list<Region*> grid[ROWS][COLS];
-	const int2 lowerBounds = int2(0, 0);
-	const int2 upperBounds = int2(ROWS - 1, COLS - 1);
-	pixel2 cellSize;
+	typedef std::vector<uint32_t> Key;
+	struct Entry {
+		Region* region;
+		bool indexed;
+		box2px bounds;
+		int2 start, end;
+	};
+	typedef std::map<Key, Entry>::value_type Node;
+	static const int MIN_ROWS = 32;
+	static const int MIN_COLS = 18;
+	static const int MAX_CELLS = 256 * 256;
+	std::map<Key, Entry> entries;
+	std::unordered_map<Region*, const Node*> lookup;
+	//Cells list nodes in increasing key order, so the last one is on top.
+	std::vector<std::vector<const Node*>> grid;
+	int2 gridDims = int2(MIN_ROWS, MIN_COLS);
+	int2 viewport = int2(0, 0);
+	pixel2 cellSize = pixel2(1.0f, 1.0f);
+	size_t indexedCount = 0;
+	size_t sizedFor = 0;
+	Key current;
+	std::vector<uint32_t> counters;
+	const Node* last = nullptr;
+	std::vector<const Node*>& cell(int i, int j) {
+		return grid[i + j * gridDims.x];
+	}
+	const std::vector<const Node*>& cell(int i, int j) const {
+		return grid[i + j * gridDims.x];
+	}
+	void resizeGrid(size_t count);
+	void insert(Node* node);
+	void discard(const Node* node);
 	//std::mutex lock;
 public:
 	CursorLocator() {
+		reset(int2(0, 0));
 	}
 	void reset(int2 viewportDims);
-	void add(Region* region);
+	//Adds the next region in draw order. Regions added between push() and pop() are its children.
+	void add(Region* region, bool hitTest = true);
+	void push();
+	void pop();
+	/*
+	 * Replaces the entries of a region and its descendants after the subtree
+	 * has been packed. Returns false if the region's position in the tree is
+	 * unknown, in which case the whole index must be rebuilt.
+	 */
+	bool update(Region* region);
+	//Drops a region that is being destroyed or detached.
+	void remove(Region* region);
+	size_t size() const {
+		return indexedCount;
+	}
 	Region* locate(const pixel2& cursor) const;
 };
 }
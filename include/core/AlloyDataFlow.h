@@ -37,6 +37,7 @@ class Compute;
 class View;
 class DataFlow;
 class Connection;
+class Executor;
 struct BoxForce;
 class ForceSimulator;
 struct ForceItem;
@@ -127,28 +128,68 @@ template<class C, class R> std::basic_ostream<C, R> & operator <<(std::basic_ost
 	return ss;
 }
 
+/*
+ * Packets are what flows along connections when a graph is executed. The
+ * payload is held in a shared buffer so handing a packet from an output port
+ * to any number of input ports never copies it. Packets are immutable once
+ * published, so ports only hand out const packets. A node that wants to modify
+ * its input forwards the buffer into a new packet with MakeSharedPacket and
+ * calls edit(), which copies the payload only if it is still shared.
+ */
 struct Packet: public AnyInterface {
+	virtual const std::type_info& type() const = 0;
+	virtual ~Packet() {
+	}
 protected:
 	virtual void setValueImpl(Any const & value) = 0;
 	virtual Any getValueImpl() const = 0;
 };
 template<class T> class PacketImpl: public Packet {
 protected:
-	T value;
+	std::shared_ptr<T> value;
 	std::string name;
 	virtual void setValueImpl(Any const & val) override {
-		value = AnyCast<T>(val);
+		value = std::make_shared<T>(AnyCast<T>(val));
 	}
 	virtual Any getValueImpl() const override {
-		return value;
+		return (value.get() != nullptr) ? *value : T();
 	}
 public:
 	PacketImpl(const std::string& name, const T& value) :
-			value(value), name(name) {
+			value(std::make_shared<T>(value)), name(name) {
+	}
+	PacketImpl(const std::string& name, T&& value) :
+			value(std::make_shared<T>(std::move(value))), name(name) {
+	}
+	PacketImpl(const std::string& name, const std::shared_ptr<const T>& value) :
+			value(std::const_pointer_cast<T>(value)), name(name) {
 	}
 	PacketImpl(const std::string& name = "") :
 			name(name) {
 	}
+	virtual const std::type_info& type() const override {
+		return typeid(T);
+	}
+	bool isEmpty() const {
+		return (value.get() == nullptr);
+	}
+	const T& get() const {
+		if (value.get() == nullptr) {
+			throw std::runtime_error(MakeString() << "Packet " << name << " is empty.");
+		}
+		return *value;
+	}
+	std::shared_ptr<const T> share() const {
+		return value;
+	}
+	T& edit() {
+		if (value.get() == nullptr) {
+			value = std::make_shared<T>();
+		} else if (value.use_count() > 1) {
+			value = std::make_shared<T>(*value);
+		}
+		return *value;
+	}
 	std::string getName() const {
 		return name;
 	}
@@ -156,6 +197,13 @@ public:
 		this->name = name;
 	}
 };
+template<class T> std::shared_ptr<PacketImpl<typename std::decay<T>::type>> MakePacket(const std::string& name, T&& value) {
+	return std::shared_ptr<PacketImpl<typename std::decay<T>::type>>(
+			new PacketImpl<typename std::decay<T>::type>(name, std::forward<T>(value)));
+}
+template<class T> std::shared_ptr<PacketImpl<T>> MakeSharedPacket(const std::string& name, const std::shared_ptr<const T>& value) {
+	return std::shared_ptr<PacketImpl<T>>(new PacketImpl<T>(name, value));
+}
 class ConnectionBundle: public std::vector<std::shared_ptr<Connection>> {
 public:
 	ConnectionBundle() :
@@ -313,6 +361,7 @@ protected:
 	virtual void setup() override;
 public:
 	friend class Node;
+	friend class Executor;
 	static const pixel2 DIMENSIONS;
 	InputPort(const std::string& name) :
 			Port(name) {
@@ -331,6 +380,25 @@ public:
 	virtual void setValue(const std::shared_ptr<Packet>& packet) override {
 		this->value = packet;
 	}
+	std::shared_ptr<const Packet> getValue() const {
+		return value;
+	}
+	bool hasValue() const {
+		return (value.get() != nullptr);
+	}
+	void clearValue() {
+		value.reset();
+	}
+	template<class T> std::shared_ptr<const PacketImpl<T>> getPacket() const {
+		return std::dynamic_pointer_cast<const PacketImpl<T>>(value);
+	}
+	template<class T> const T& get() const {
+		PacketImpl<T>* packet = dynamic_cast<PacketImpl<T>*>(value.get());
+		if (packet == nullptr) {
+			throw std::runtime_error(MakeString() << "Port " << getName() << " has no " << typeid(T).name() << " packet.");
+		}
+		return packet->get();
+	}
 
 	virtual ~InputPort() {
 	}
@@ -343,6 +411,7 @@ protected:
 	virtual void setup() override;
 public:
 	friend class Node;
+	friend class Executor;
 	static const pixel2 DIMENSIONS;
 	OutputPort(const std::string& name) :
 			Port(name) {
@@ -361,6 +430,25 @@ public:
 	virtual void setValue(const std::shared_ptr<Packet>& packet) override {
 		this->value = packet;
 	}
+	std::shared_ptr<const Packet> getValue() const {
+		return value;
+	}
+	bool hasValue() const {
+		return (value.get() != nullptr);
+	}
+	void clearValue() {
+		value.reset();
+	}
+	template<class T> std::shared_ptr<const PacketImpl<T>> getPacket() const {
+		return std::dynamic_pointer_cast<const PacketImpl<T>>(value);
+	}
+	template<class T> const T& get() const {
+		PacketImpl<T>* packet = dynamic_cast<PacketImpl<T>*>(value.get());
+		if (packet == nullptr) {
+			throw std::runtime_error(MakeString() << "Port " << getName() << " has no " << typeid(T).name() << " packet.");
+		}
+		return packet->get();
+	}
 	virtual ~OutputPort() {
 	}
 	virtual void draw(AlloyContext* context) override;
@@ -582,7 +670,13 @@ protected:
 	virtual void pack(const pixel2& pos, const pixel2& dims, const double2& dpmm, double pixelRatio, bool clamp = false) override;
 	std::function<void(float scale)> resizeFunc;
 public:
-	
+	/*
+	 * Work done by this node when the graph is executed. Input packets have
+	 * already been delivered to the input ports, and results are published with
+	 * OutputPort::setValue. Nodes without it are skipped.
+	 */
+	std::function<void(Node* node)> onExecute;
+
 	static std::string MakeID(int len=8);
 	bool isSelected() const {
 		return nodeIcon->selected;
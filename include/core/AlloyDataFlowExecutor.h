@@ -0,0 +1,104 @@
+/*
+ * Copyright(C) 2018, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef INCLUDE_CORE_ALLOYDATAFLOWEXECUTOR_H_
+#define INCLUDE_CORE_ALLOYDATAFLOWEXECUTOR_H_
+#include "AlloyDataFlow.h"
+#include "AlloyScheduler.h"
+#include <atomic>
+#include <map>
+#include <mutex>
+namespace aly {
+bool SANITY_CHECK_DATAFLOW_EXECUTOR();
+namespace dataflow {
+struct NodeTiming {
+	double lastMilliseconds = 0.0;
+	double totalMilliseconds = 0.0;
+	int executions = 0;
+};
+/*
+ * Runs the onExecute work of DataFlow nodes in dependency order. Nodes whose
+ * inputs are ready are submitted to the shared TaskScheduler, so independent
+ * branches of the graph run concurrently. Packets are handed from output to
+ * input ports by pointer, so payloads are never copied between nodes.
+ *
+ * Only dirty nodes execute. Changing a packet with setValue() or calling
+ * setDirty() marks the node and everything downstream of it, and a node that
+ * throws stays dirty together with its downstream nodes so the next execute()
+ * retries them. Grouped nodes are executed in place of their groups and
+ * connections to group ports are followed through to the grouped node.
+ */
+class Executor {
+protected:
+	struct Task {
+		Node* node = nullptr;
+		std::vector<int> upstream;
+		std::vector<int> downstream;
+		std::vector<std::pair<InputPort*, OutputPort*>> inputs;
+		std::atomic<int> pending;
+		std::atomic<bool> failed;
+		bool dirty = true;
+		NodeTiming timing;
+		Task() :
+				pending(0), failed(false) {
+		}
+	};
+	std::vector<std::shared_ptr<Node>> nodes;
+	std::vector<std::unique_ptr<Task>> tasks;
+	std::map<const Node*, int> taskIndex;
+	std::mutex lock;
+	std::mutex errorLock;
+	std::string error;
+	TaskPriority priority;
+	TaskGroup* group = nullptr;
+	static void buildTasks(std::vector<std::unique_ptr<Task>>& tasks, const std::map<const Node*, int>& taskIndex);
+	static std::vector<int> sortTasks(const std::vector<std::unique_ptr<Task>>& tasks);
+	void markDirty(int index);
+	void executeTask(int index);
+public:
+	std::function<void(Node* node, const NodeTiming& timing)> onNodeExecuted;
+	Executor(TaskPriority priority = TaskPriority::Normal);
+	Executor(const std::shared_ptr<Group>& graph, TaskPriority priority = TaskPriority::Normal);
+	/*
+	 * Rebuilds the schedule after the graph is edited. Nodes that were already
+	 * known keep their dirty state and timing, new nodes start dirty. Throws if
+	 * the connections form a cycle, in which case the previous graph is kept.
+	 */
+	void setGraph(const std::shared_ptr<Group>& graph);
+	void setGraph(const std::vector<std::shared_ptr<Node>>& nodes);
+	void setValue(const std::shared_ptr<OutputPort>& port, const std::shared_ptr<Packet>& packet);
+	void setDirty(const Node* node);
+	void setDirty();
+	bool isDirty(const Node* node) const;
+	/*
+	 * Executes all dirty nodes and blocks until they finish. Returns the
+	 * number of nodes executed, and rethrows the first error once the nodes
+	 * that do not depend on the failed one have finished.
+	 */
+	int execute();
+	NodeTiming getTiming(const Node* node) const;
+	std::vector<Node*> getExecutionOrder() const;
+	int getThreadCount() const {
+		return AlloyDefaultScheduler().getThreadCount();
+	}
+};
+}
+}
+#endif /* INCLUDE_CORE_ALLOYDATAFLOWEXECUTOR_H_ */
@@ -22,6 +22,7 @@
 #define ALLOYDENSESOLVER_H_
 #include "AlloyMath.h"
 #include "AlloyImage.h"
+#include "AlloyPyramid.h"
 #include "AlloyDenseMatrix.h"
 #include "AlloyEnum.h"
 namespace aly {
@@ -39,6 +40,13 @@ namespace aly {
 	void LaplaceFill(const Image4f& sourceImg, Image4f& targetImg, int iterations,float lambda = 0.99f , const std::function<bool(int)>& iterationMonitor=nullptr);
 	void LaplaceFill(const Image2f& sourceImg, Image2f& targetImg, int iterations,float lambda = 0.99f, const std::function<bool(int)>& iterationMonitor = nullptr);
 	void LaplaceFill(const Image2f& sourceImg, Image2f& targetImg, int iterations,int levels, float lambda = 0.99f, const std::function<bool(int, int)>& iterationMonitor = nullptr);
+	//Coarse-to-fine solvers that reuse a source pyramid built by the caller, the number of levels is taken from the pyramid.
+	void PoissonBlend(const ImagePyramid4f& in, Image4f& out, int iterations,float lambda = 0.99f, const std::function<bool(int,int)>& iterationMonitor = nullptr);
+	void PoissonBlend(const ImagePyramid2f& in, Image2f& out, int iterations,float lambda = 0.99f, const std::function<bool(int,int)>& iterationMonitor = nullptr);
+	void PoissonInpaint(const ImagePyramid4f& source, const ImagePyramid4f& target, Image4f& out,int iterations, float lambda = 0.99f , const std::function<bool(int, int)>& iterationMonitor = nullptr);
+	void PoissonInpaint(const ImagePyramid2f& source, const ImagePyramid2f& target, Image2f& out,int iterations, float lambda = 0.99f , const std::function<bool(int, int)>& iterationMonitor = nullptr);
+	void LaplaceFill(const ImagePyramid4f& sourceImg, Image4f& targetImg, int iterations, float lambda = 0.99f, const std::function<bool(int, int)>& iterationMonitor=nullptr);
+	void LaplaceFill(const ImagePyramid2f& sourceImg, Image2f& targetImg, int iterations, float lambda = 0.99f, const std::function<bool(int, int)>& iterationMonitor=nullptr);
 	void ColorPropagation(Image4f& image,int maxDistance,float threshold=0.5f);
 	void ColorPropagation(Image1f& image,int maxDistance,float threshold=0.0f);
 	/******************************************************************************
@@ -25,6 +25,7 @@
 #include "AlloyVolume.h"
 #include "grid/EndlessGrid.h"
 namespace aly {
+	class ResultCache;
 	bool SANITY_CHECK_DISTANCE_FIELD();
 	class DistanceField3f {
 		typedef Indexable<float, 3> VoxelIndex;
@@ -41,6 +42,7 @@ namespace aly {
 		DistanceField3f()  {}
 		void solve(const Volume1f& vol, Volume1f& out,float maxDistance=2.5f);
 		void solve(EndlessGridFloat& vol,float maxDistance=2.5f);
+		void solve(ResultCache& cache, const Volume1f& vol, Volume1f& out, float maxDistance = 2.5f);
 	};
 	class DistanceField2f {
 		typedef Indexable<float, 2> PixelIndex;
@@ -56,6 +58,7 @@ namespace aly {
 		static const float DISTANCE_UNDEFINED;
 		DistanceField2f() {}
 		void solve(const Image1f& vol, Image1f& out, float maxDistance = 2.5f);
+		void solve(ResultCache& cache, const Image1f& vol, Image1f& out, float maxDistance = 2.5f);
 	};
 } /* namespace imagesci */
 
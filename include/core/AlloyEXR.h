@@ -0,0 +1,108 @@
+/*
+ * Copyright(C) 2018, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef INCLUDE_CORE_ALLOYEXR_H_
+#define INCLUDE_CORE_ALLOYEXR_H_
+#include "AlloyImage.h"
+#include <string>
+#include <vector>
+namespace aly {
+bool SANITY_CHECK_EXR();
+enum class EXRCompression {
+	Uncompressed = 0, RLE = 1, ZIPS = 2, ZIP = 3, PIZ = 4
+};
+enum class EXRPixelType {
+	UInt = 0, Half = 1, Float = 2
+};
+struct EXRChannel {
+	std::string name;
+	EXRPixelType type = EXRPixelType::Half;
+	int2 sampling = int2(1, 1);
+};
+/*
+ * Single part OpenEXR header. Windows are stored as position and dimensions
+ * rather than the inclusive min/max pair used in the file.
+ */
+struct EXRHeader {
+	box2i dataWindow;
+	box2i displayWindow;
+	std::vector<EXRChannel> channels;
+	EXRCompression compression = EXRCompression::Uncompressed;
+	int lineOrder = 0;
+	bool tiled = false;
+	int2 tileSize = int2(0, 0);
+	int levelMode = 0;
+	int getChannelIndex(const std::string& name) const;
+};
+bool ReadEXRHeader(const std::string& file, EXRHeader& header);
+/*
+ * Scanline blocks or tiles are decoded in parallel straight from a memory
+ * mapped view of the file, and only the blocks that overlap region are
+ * touched. region is given in pixels relative to the data window and the
+ * returned image is positioned at region.position; an empty region reads the
+ * whole data window. channels names the file channel that feeds each image
+ * channel. If it is empty, R, G, B and A (or Y for gray images) are used and
+ * missing channels are filled with zero, or one for alpha. Tiled files are
+ * read at their full resolution level. Multi-part, deep and sub-sampled files
+ * are not supported.
+ */
+void ReadEXRImage(const std::string& file, Image1f& img,
+		const std::vector<std::string>& channels = std::vector<std::string>(),
+		const box2i& region = box2i());
+void ReadEXRImage(const std::string& file, ImageRGBf& img,
+		const std::vector<std::string>& channels = std::vector<std::string>(),
+		const box2i& region = box2i());
+void ReadEXRImage(const std::string& file, ImageRGBAf& img,
+		const std::vector<std::string>& channels = std::vector<std::string>(),
+		const box2i& region = box2i());
+void ReadEXRImage(const std::string& file, Image1h& img,
+		const std::vector<std::string>& channels = std::vector<std::string>(),
+		const box2i& region = box2i());
+void ReadEXRImage(const std::string& file, Image3h& img,
+		const std::vector<std::string>& channels = std::vector<std::string>(),
+		const box2i& region = box2i());
+void ReadEXRImage(const std::string& file, Image4h& img,
+		const std::vector<std::string>& channels = std::vector<std::string>(),
+		const box2i& region = box2i());
+/*
+ * Samples are stored as float or half to match the image. Blocks are
+ * compressed in parallel. A positive tileSize writes a single level tiled
+ * file instead of scanlines. PIZ is only available for reading.
+ */
+void WriteEXRImage(const std::string& file, const Image1f& img,
+		EXRCompression compression = EXRCompression::ZIP, int tileSize = 0,
+		const std::vector<std::string>& channels = std::vector<std::string>());
+void WriteEXRImage(const std::string& file, const ImageRGBf& img,
+		EXRCompression compression = EXRCompression::ZIP, int tileSize = 0,
+		const std::vector<std::string>& channels = std::vector<std::string>());
+void WriteEXRImage(const std::string& file, const ImageRGBAf& img,
+		EXRCompression compression = EXRCompression::ZIP, int tileSize = 0,
+		const std::vector<std::string>& channels = std::vector<std::string>());
+void WriteEXRImage(const std::string& file, const Image1h& img,
+		EXRCompression compression = EXRCompression::ZIP, int tileSize = 0,
+		const std::vector<std::string>& channels = std::vector<std::string>());
+void WriteEXRImage(const std::string& file, const Image3h& img,
+		EXRCompression compression = EXRCompression::ZIP, int tileSize = 0,
+		const std::vector<std::string>& channels = std::vector<std::string>());
+void WriteEXRImage(const std::string& file, const Image4h& img,
+		EXRCompression compression = EXRCompression::ZIP, int tileSize = 0,
+		const std::vector<std::string>& channels = std::vector<std::string>());
+}
+#endif /* INCLUDE_CORE_ALLOYEXR_H_ */
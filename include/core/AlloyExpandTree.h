@@ -97,9 +97,14 @@ namespace aly {
 		TreeItem root;
 		DrawPtr drawRegion;
 		TreeItem* selectedItem;
+		box2px viewport;
 		bool overArrow;
 		bool dirty;
 	public:
+		//Visible part of the tree in item coordinates. Items outside of it are not drawn.
+		box2px getViewport() const {
+			return viewport;
+		}
 		TreeItem* getSelectedItem() const {
 			return selectedItem;
 		}
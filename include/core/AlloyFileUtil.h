@@ -32,8 +32,7 @@
 #include <cstring>
 #include <iostream>
 #include <sstream>
-#include "sha1.h"
-#include "sha2.h"
+#include "AlloyHash.h"
 #ifndef _CRT_SECURE_NO_WARNINGS
 #define _CRT_SECURE_NO_WARNINGS // suppress warnings about fopen()
 #endif
@@ -54,9 +53,6 @@ namespace aly {
 	enum class FileAttribute {
 		Compressed, Hidden
 	};
-	enum class HashMethod {
-		SHA1 = 1, SHA224 = 224, SHA256 = 256, SHA384 = 384, SHA512 = 512
-	};
 	std::wstring ToWString(const std::string& str);
 	std::string ToString(const std::wstring& str);
 	struct FileDescription {
@@ -188,38 +184,6 @@ namespace aly {
 		}
 		return bufferOut.str();
 	}
-	template<class T> std::string HashCode(std::vector<T> data, HashMethod method =
-		HashMethod::SHA256) {
-		std::string str = EncodeBase64(data);
-		std::vector<unsigned char> hashOut;
-		std::string hashCode = "";
-		switch (method) {
-		case HashMethod::SHA1:
-			hashCode = sha1(str);
-			break;
-		case HashMethod::SHA224:
-			hashOut.resize(SHA224_DIGEST_SIZE);
-			sha224((unsigned char *)str.c_str(), str.size(), hashOut.data());
-			hashCode = EncodeBase64(hashOut, false);
-			break;
-		case HashMethod::SHA256:
-			hashOut.resize(SHA256_DIGEST_SIZE);
-			sha256((unsigned char *)str.c_str(), str.size(), hashOut.data());
-			hashCode = EncodeBase64(hashOut, false);
-			break;
-		case HashMethod::SHA384:
-			hashOut.resize(SHA384_DIGEST_SIZE);
-			sha384((unsigned char *)str.c_str(), str.size(), hashOut.data());
-			hashCode = EncodeBase64(hashOut, false);
-			break;
-		case HashMethod::SHA512:
-			hashOut.resize(SHA512_DIGEST_SIZE);
-			sha512((unsigned char *)str.c_str(), str.size(), hashOut.data());
-			hashCode = EncodeBase64(hashOut, false);
-			break;
-		}
-		return hashCode;
-	}
 	template<class T> void DecodeBase64(const std::string& encoded_string,
 		std::vector<T>& out) {
 		static const std::string base64_chars =
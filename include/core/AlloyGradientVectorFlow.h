@@ -25,18 +25,26 @@
 #include <AlloyVolume.h>
 #include <AlloyMath.h>
 namespace aly {
+	class ResultCache;
 	void SolveEdgeFilter(const ImageRGB& img,Image1f& out,int K=1);
 	void SolveEdgeFilter(const ImageRGBf& img,Image1f& out,int K=1);
 	void SolveEdgeFilter(const Image1f& img,Image1f& out,int K=1);
 	void SolveEdgeFilter(const Volume1f& img,Volume1f& out,int K=1);
 
-	void SolveGradientVectorFlow(const Image1f& src, Image2f& vectorField, int iterations, bool normalize);
-	void SolveGradientVectorFlow(const Image1f& src, Image2f& vectorField,float mu, int iterations, bool normalize);
-	void SolveGradientVectorFlow(const Image1f& src, Image2f& vectorField,const Image1f& weights,float mu,int iterations,  bool normalize);
+	/*
+	 * Iterations bound the conjugate gradient solve, which stops early once the
+	 * residual drops below tolerance relative to the right hand side.
+	 */
+	void SolveGradientVectorFlow(const Image1f& src, Image2f& vectorField, int iterations, bool normalize, float tolerance = 1E-6f);
+	void SolveGradientVectorFlow(const Image1f& src, Image2f& vectorField,float mu, int iterations, bool normalize, float tolerance = 1E-6f);
+	void SolveGradientVectorFlow(const Image1f& src, Image2f& vectorField,const Image1f& weights,float mu,int iterations,  bool normalize, float tolerance = 1E-6f);
 
-	void SolveGradientVectorFlow(const Volume1f& src, Volume3f& vectorField, int iterations, bool normalize);
-	void SolveGradientVectorFlow(const Volume1f& src, Volume3f& vectorField,float mu, int iterations, bool normalize);
-	void SolveGradientVectorFlow(const Volume1f& src, Volume3f& vectorField,const Volume1f& weights,float mu,int iterations,  bool normalize);
+	void SolveGradientVectorFlow(const Volume1f& src, Volume3f& vectorField, int iterations, bool normalize, float tolerance = 1E-6f);
+	void SolveGradientVectorFlow(const Volume1f& src, Volume3f& vectorField,float mu, int iterations, bool normalize, float tolerance = 1E-6f);
+	void SolveGradientVectorFlow(const Volume1f& src, Volume3f& vectorField,const Volume1f& weights,float mu,int iterations,  bool normalize, float tolerance = 1E-6f);
+
+	void SolveGradientVectorFlow(ResultCache& cache, const Image1f& src, Image2f& vectorField,float mu, int iterations, bool normalize, float tolerance = 1E-6f);
+	void SolveGradientVectorFlow(ResultCache& cache, const Volume1f& src, Volume3f& vectorField,float mu, int iterations, bool normalize, float tolerance = 1E-6f);
 
 }
 #endif
@@ -0,0 +1,116 @@
+/*
+ * Copyright(C) 2018, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef INCLUDE_CORE_ALLOYHALF_H_
+#define INCLUDE_CORE_ALLOYHALF_H_
+#include <cstdint>
+#include <cstring>
+#include "cereal/cereal.hpp"
+namespace aly {
+/*
+ * IEEE half precision conversion with round to nearest even. Denormals are
+ * handled with a floating point add instead of a shift loop, which keeps both
+ * directions almost branch free.
+ */
+inline uint16_t FloatToHalf(float val) {
+	const uint32_t f32infty = 255u << 23;
+	const uint32_t f16max = (127u + 16u) << 23;
+	const uint32_t denormMagic = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+	uint32_t f;
+	std::memcpy(&f, &val, sizeof(f));
+	uint32_t sign = f & 0x80000000u;
+	f ^= sign;
+	uint32_t out;
+	if (f >= f16max) { // Overflow, Inf or NaN
+		out = (f > f32infty) ? 0x7E00 : 0x7C00;
+	} else if (f < (113u << 23)) { // Subnormal or zero
+		float magic, tmp;
+		std::memcpy(&magic, &denormMagic, sizeof(magic));
+		std::memcpy(&tmp, &f, sizeof(tmp));
+		tmp += magic;
+		std::memcpy(&out, &tmp, sizeof(out));
+		out -= denormMagic;
+	} else {
+		uint32_t odd = (f >> 13) & 1;
+		f += ((uint32_t) (15 - 127) << 23) + 0xFFF;
+		f += odd;
+		out = f >> 13;
+	}
+	return (uint16_t) (out | (sign >> 16));
+}
+inline float HalfToFloat(uint16_t val) {
+	const uint32_t shiftedExp = 0x7C00u << 13;
+	const uint32_t magicBits = 113u << 23;
+	uint32_t out = (uint32_t) (val & 0x7FFF) << 13;
+	uint32_t exponent = shiftedExp & out;
+	out += (127u - 15u) << 23;
+	if (exponent == shiftedExp) { // Inf or NaN
+		out += (128u - 16u) << 23;
+	} else if (exponent == 0) { // Subnormal or zero
+		float magic, tmp;
+		out += 1u << 23;
+		std::memcpy(&magic, &magicBits, sizeof(magic));
+		std::memcpy(&tmp, &out, sizeof(tmp));
+		tmp -= magic;
+		std::memcpy(&out, &tmp, sizeof(out));
+	}
+	out |= (uint32_t) (val & 0x8000) << 16;
+	float result;
+	std::memcpy(&result, &out, sizeof(result));
+	return result;
+}
+/*
+ * 16 bit IEEE floating point storage type. Arithmetic is done in single
+ * precision through the implicit conversions, so half is meant for storing
+ * pixels (Image4h, Image1h) and not for computing with them.
+ */
+struct half {
+	uint16_t bits = 0;
+	half() {
+	}
+	half(float val) :
+			bits(FloatToHalf(val)) {
+	}
+	operator float() const {
+		return HalfToFloat(bits);
+	}
+	static half FromBits(uint16_t bits) {
+		half h;
+		h.bits = bits;
+		return h;
+	}
+	bool operator ==(const half& r) const {
+		return (bits == r.bits);
+	}
+	bool operator !=(const half& r) const {
+		return (bits != r.bits);
+	}
+	bool operator <(const half& r) const {
+		return (HalfToFloat(bits) < HalfToFloat(r.bits));
+	}
+	bool operator >(const half& r) const {
+		return (HalfToFloat(bits) > HalfToFloat(r.bits));
+	}
+	template<class Archive> void serialize(Archive & archive) {
+		archive(CEREAL_NVP(bits));
+	}
+};
+}
+#endif /* INCLUDE_CORE_ALLOYHALF_H_ */
@@ -0,0 +1,93 @@
+/*
+ * Copyright(C) 2018, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef INCLUDE_CORE_ALLOYHASH_H_
+#define INCLUDE_CORE_ALLOYHASH_H_
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "sha1.h"
+#include "sha2.h"
+namespace aly {
+	bool SANITY_CHECK_HASH();
+	/*
+	 * FAST64 is XXH64. FAST128 runs two independently seeded XXH64 lanes over
+	 * the same bytes; neither is suitable where an adversary picks the input.
+	 */
+	enum class HashMethod {
+		SHA1 = 1, FAST64 = 64, FAST128 = 128, SHA224 = 224, SHA256 = 256, SHA384 = 384, SHA512 = 512
+	};
+	//Buffers larger than this are split into chunks that are hashed in parallel.
+	static const size_t HASH_TREE_CHUNK_SIZE = (size_t) 1 << 22;
+	struct XXH64State {
+		uint64_t acc[4];
+		uint64_t seed;
+		uint64_t total;
+		uint8_t mem[32];
+		uint32_t memSize;
+		void reset(uint64_t seed = 0);
+		void update(const uint8_t* data, size_t len);
+		uint64_t digest() const;
+	};
+	uint64_t XXH64(const void* data, size_t len, uint64_t seed = 0);
+	/*
+	 * Incremental hash over raw bytes. Nothing is copied except the partial
+	 * block carried between calls to update().
+	 */
+	class HashStream {
+	protected:
+		HashMethod method;
+		SHA1 sha1Ctx;
+		sha256_ctx sha256Ctx;
+		sha512_ctx sha512Ctx;
+		XXH64State fastCtx[2];
+	public:
+		HashStream(HashMethod method = HashMethod::SHA256);
+		void reset();
+		void update(const void* data, size_t bytes);
+		template<class T> void update(const std::vector<T>& data) {
+			update(data.data(), data.size() * sizeof(T));
+		}
+		HashMethod getMethod() const {
+			return method;
+		}
+		size_t getDigestSize() const;
+		//Finalizes the digest and resets the stream.
+		std::vector<uint8_t> digest();
+		//Hex for SHA1/FAST64/FAST128, unpadded Base64 for SHA-2.
+		std::string finish();
+	};
+	std::string EncodeHashDigest(const std::vector<uint8_t>& digest, HashMethod method);
+	/*
+	 * Buffers longer than treeChunkSize are hashed as a two level tree: each
+	 * chunk is digested in parallel and the root hashes the buffer length
+	 * followed by the chunk digests. Chunking depends only on the size, so
+	 * the result is the same for any thread count. Pass treeChunkSize=0 to
+	 * always hash sequentially.
+	 */
+	std::string HashCode(const void* data, size_t bytes, HashMethod method = HashMethod::SHA256,
+			size_t treeChunkSize = HASH_TREE_CHUNK_SIZE);
+	template<class T> std::string HashCode(const std::vector<T>& data, HashMethod method =
+			HashMethod::SHA256, size_t treeChunkSize = HASH_TREE_CHUNK_SIZE) {
+		return HashCode(data.data(), data.size() * sizeof(T), method, treeChunkSize);
+	}
+}
+#endif /* INCLUDE_CORE_ALLOYHASH_H_ */
@@ -22,6 +22,7 @@
 #define ALLOYIMAGE2D_H_INCLUDE_GUARD
 #include "AlloyCommon.h"
 #include "AlloyMath.h"
+#include "AlloyHalf.h"
 #include "sha2.h"
 #include "AlloyFileUtil.h"
 #include "AlloyVector.h"
@@ -45,7 +46,8 @@ enum class ImageType {
 	INT = 4,
 	UINT = 5,
 	FLOAT = 6,
-	DOUBLE = 7
+	DOUBLE = 7,
+	HALF = 8
 };
 template<class L, class R> std::basic_ostream<L, R>& operator <<(
 		std::basic_ostream<L, R> & ss, const ImageType& type) {
@@ -68,6 +70,8 @@ template<class L, class R> std::basic_ostream<L, R>& operator <<(
 		return ss << "float";
 	case ImageType::DOUBLE:
 		return ss << "double";
+	case ImageType::HALF:
+		return ss << "half";
 	}
 	return ss;
 }
@@ -979,6 +983,9 @@ template<class T, int C, ImageType I> void WriteImageToRawFile(
 	case ImageType::DOUBLE:
 		typeName = "Double";
 		break;
+	case ImageType::HALF:
+		typeName = "Half";
+		break;
 	case ImageType::UNKNOWN:
 		typeName = "Unknown";
 		break;
@@ -1069,6 +1076,9 @@ template<class T, int C, ImageType I> bool ReadImageFromRawFile(
 	case ImageType::DOUBLE:
 		typeName = "double";
 		break;
+	case ImageType::HALF:
+		typeName = "half";
+		break;
 	case ImageType::UNKNOWN:
 		typeName = "unknown";
 		break;
@@ -1146,6 +1156,11 @@ typedef Image<double, 2, ImageType::DOUBLE> Image2d;
 typedef Image<double, 3, ImageType::DOUBLE> Image3d;
 typedef Image<double, 4, ImageType::DOUBLE> Image4d;
 
+typedef Image<half, 1, ImageType::HALF> Image1h;
+typedef Image<half, 2, ImageType::HALF> Image2h;
+typedef Image<half, 3, ImageType::HALF> Image3h;
+typedef Image<half, 4, ImageType::HALF> Image4h;
+
 void WriteImageToFile(const std::string& file, const ImageRGBA& img);
 void WriteImageToFile(const std::string& file, const ImageRGB& img);
 void WriteImageToFile(const std::string& file, const ImageRGB& img,int quality);
@@ -1177,6 +1192,14 @@ void ReadImageFromFile(const std::string& file, ImageRGB& img);
 void ReadImageFromFile(const std::string& file, ImageRGBAf& img);
 void ReadImageFromFile(const std::string& file, ImageRGBf& img);
 
+void WriteImageToFile(const std::string& file, const Image1h& img);
+void WriteImageToFile(const std::string& file, const Image3h& img);
+void WriteImageToFile(const std::string& file, const Image4h& img);
+
+void ReadImageFromFile(const std::string& file, Image1h& img);
+void ReadImageFromFile(const std::string& file, Image3h& img);
+void ReadImageFromFile(const std::string& file, Image4h& img);
+
 void ConvertImage(const ImageRGBAf& in, ImageRGBA& out);
 void ConvertImage(const ImageRGBf& in, ImageRGB& out);
 
@@ -1203,6 +1226,13 @@ void ConvertImage(const Image4ub& in, Image4us& out);
 void ConvertImage(const Image1us& in, Image1f& out);
 void ConvertImage(const Image1f& in, Image1us& out);
 
+void ConvertImage(const Image1h& in, Image1f& out);
+void ConvertImage(const Image3h& in, ImageRGBf& out);
+void ConvertImage(const Image4h& in, ImageRGBAf& out);
+void ConvertImage(const Image1f& in, Image1h& out);
+void ConvertImage(const ImageRGBf& in, Image3h& out);
+void ConvertImage(const ImageRGBAf& in, Image4h& out);
+
 inline void ConvertImage(const Image1f& in, Image1f& out){out=in;}
 inline void ConvertImage(const ImageRGB& in, ImageRGB& out){out=in;}
 inline void ConvertImage(const ImageRGBA& in, ImageRGBA& out){out=in;}
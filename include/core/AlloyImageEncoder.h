@@ -73,12 +73,33 @@ public:
 	YUVConverter(YUVMatrix mat,YUVFormat format,YUVScale scale,bool orderSwap);
 	YUVConverter(YUVType type,YUVMatrix mat=YUVMatrix::UNSPECIFIED);
 	void evaluate(const ImageRGB& image,std::vector<uint8_t>& out);
+	/* Writes into a caller-provided buffer of getBufferSize() bytes. */
+	void evaluate(const ImageRGB& image,uint8_t* out);
+	/* Converts a buffer produced by evaluate() back to RGB. Chroma is replicated, not interpolated. */
+	void decode(const std::vector<uint8_t>& in,int width,int height,ImageRGB& image);
+	void decode(const uint8_t* in,int width,int height,ImageRGB& image);
+	size_t getBufferSize(int width,int height) const;
 protected:
+	/* Byte offset of the first sample, stride between rows and stride between samples in a row */
+	struct Channel{
+		size_t offset;
+		size_t rowStride;
+		int pixelStride;
+	};
+	struct Layout{
+		Channel y,u,v;
+		int chromaWidth,chromaHeight;
+		int xShift,yShift;
+		bool packed;
+		size_t size;
+	};
 	bool uvOrderSwap;				/*Swap UV order*/
 	YUVFormat yuvFormat;			/* YUV output mode. Default: h2v2 */
 	YUVScale uvScale;			/* Defines how UV components are scaled in planar mode */
 	YUVMatrix uvMatrix;  		/*matrix type*/
 	std::vector<float>yuvMatrix;
+	std::vector<float>rgbMatrix;	/*inverse of yuvMatrix*/
+	Layout getLayout(int width,int height) const;
 	void setJPEGMatrix();
 	void setSDTVMatrix();
 	void setHDTVMatrix();
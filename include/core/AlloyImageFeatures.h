@@ -3,6 +3,7 @@
 #include <AlloyImage.h>
 #include <array>
 #include <vector>
+#include <cstdint>
 namespace aly {
 enum class DaisyNormalization {UnNormalized = -1, Partial = 0, Full = 1, Sift = 2};
 inline void cartesian2polar(const float2& pt, float &r, float &th) {
@@ -132,93 +133,173 @@ void Convolve(const ImageLayer& image, ImageLayer& out,
 		const std::vector<float>& filter, int M, int N);
 void ConvolveHorizontal(const ImageLayer& input, ImageLayer& output,const std::vector<float>& filter);
 void ConvolveVertical(const ImageLayer& input, ImageLayer& output,const std::vector<float>& filter);
+/*
+ * Element type of a dense descriptor field. Half and Byte trade precision
+ * for memory; descriptor values are expected to lie in [0,1], which holds for
+ * all DaisyNormalization types.
+ */
+enum class DaisyStorage {Float = 4, Half = 2, Byte = 1};
+/*
+ * Dense descriptor field stored as one contiguous array with a fixed
+ * descriptor length per pixel.
+ */
 class DaisyDescriptorField {
 protected:
-	std::vector<DaisyDescriptor> data;
+	std::vector<float> floatData;
+	std::vector<uint16_t> halfData;
+	std::vector<uint8_t> byteData;
+	DaisyStorage storage;
+	int length;
+	size_t index(int i, int j) const {
+		return (clamp(i, 0, width - 1) + clamp(j, 0, height - 1) * (size_t) width) * length;
+	}
+	void read(size_t offset, float* out) const {
+		switch (storage) {
+		case DaisyStorage::Float:
+			std::copy(floatData.begin() + offset, floatData.begin() + offset + length, out);
+			break;
+		case DaisyStorage::Half:
+			for (int n = 0; n < length; n++) {
+				out[n] = HalfToFloat(halfData[offset + n]);
+			}
+			break;
+		case DaisyStorage::Byte:
+			for (int n = 0; n < length; n++) {
+				out[n] = byteData[offset + n] * (1.0f / 255.0f);
+			}
+			break;
+		}
+	}
+	float value(size_t offset) const {
+		switch (storage) {
+		case DaisyStorage::Half:
+			return HalfToFloat(halfData[offset]);
+		case DaisyStorage::Byte:
+			return byteData[offset] * (1.0f / 255.0f);
+		default:
+			return floatData[offset];
+		}
+	}
 public:
 	int width, height;
-	DaisyDescriptorField(int w = 0, int h = 0) :
-			data(w * h), width(w), height(h) {
-
+	DaisyDescriptorField(int w = 0, int h = 0, int length = 0, DaisyStorage storage = DaisyStorage::Float) :
+			storage(storage), length(0), width(0), height(0) {
+		resize(w, h, length);
 	}
+	//Number of pixels.
 	size_t size() const {
-		return data.size();
+		return (size_t) width * height;
 	}
-	void resize(int w, int h) {
-		data.resize(w * h);
-		data.shrink_to_fit();
+	int getLength() const {
+		return length;
+	}
+	DaisyStorage getStorage() const {
+		return storage;
+	}
+	size_t getByteSize() const {
+		return size() * length * (size_t) storage;
+	}
+	void setStorage(DaisyStorage s) {
+		if (s != storage) {
+			storage = s;
+			resize(width, height, length);
+		}
+	}
+	void resize(int w, int h, int len) {
 		width = w;
 		height = h;
+		length = len;
+		size_t N = (size_t) w * h * len;
+		floatData.resize((storage == DaisyStorage::Float) ? N : 0);
+		halfData.resize((storage == DaisyStorage::Half) ? N : 0);
+		byteData.resize((storage == DaisyStorage::Byte) ? N : 0);
+		floatData.shrink_to_fit();
+		halfData.shrink_to_fit();
+		byteData.shrink_to_fit();
 	}
 	inline void clear() {
-		data.clear();
-		data.shrink_to_fit();
-		width = 0;
-		height = 0;
+		resize(0, 0, 0);
 	}
-	DaisyDescriptor* ptr() {
-		if (data.size() == 0)
+	//Raw descriptor data, only available for Float storage.
+	float* ptr(int i, int j) {
+		if (storage != DaisyStorage::Float || floatData.size() == 0)
 			return nullptr;
-		return data.data();
+		return &floatData[index(i, j)];
 	}
-	const DaisyDescriptor* ptr() const {
-		if (data.size() == 0)
+	const float* ptr(int i, int j) const {
+		if (storage != DaisyStorage::Float || floatData.size() == 0)
 			return nullptr;
-		return data.data();
-	}
-	const DaisyDescriptor& operator[](const size_t i) const {
-		return data[i];
-	}
-	DaisyDescriptor& operator[](const size_t i) {
-		return data[i];
+		return &floatData[index(i, j)];
+	}
+	void set(int i, int j, const float* desc) {
+		size_t offset = index(i, j);
+		switch (storage) {
+		case DaisyStorage::Float:
+			std::copy(desc, desc + length, floatData.begin() + offset);
+			break;
+		case DaisyStorage::Half:
+			for (int n = 0; n < length; n++) {
+				halfData[offset + n] = FloatToHalf(desc[n]);
+			}
+			break;
+		case DaisyStorage::Byte:
+			for (int n = 0; n < length; n++) {
+				byteData[offset + n] = (uint8_t) clamp((int) (desc[n] * 255.0f + 0.5f), 0, 255);
+			}
+			break;
+		}
 	}
-	DaisyDescriptor& operator()(int i, int j) {
-		return data[clamp(i, 0, width - 1) + clamp(j, 0, height - 1) * width];
+	void get(int i, int j, DaisyDescriptor& out) const {
+		out.resize(length);
+		read(index(i, j), out.data());
 	}
-	DaisyDescriptor& operator()(const int2 ij) {
-		return data[clamp(ij.x, 0, width - 1)
-				+ clamp(ij.y, 0, height - 1) * width];
+	DaisyDescriptor operator()(int i, int j) const {
+		DaisyDescriptor out;
+		get(i, j, out);
+		return out;
 	}
-	const DaisyDescriptor& operator()(int i, int j) const {
-		return data[clamp(i, 0, width - 1) + clamp(j, 0, height - 1) * width];
-	}
-	const DaisyDescriptor& operator()(const int2 ij) const {
-		return data[clamp(ij.x, 0, width - 1)
-				+ clamp(ij.y, 0, height - 1) * width];
+	DaisyDescriptor operator()(const int2 ij) const {
+		return operator()(ij.x, ij.y);
 	}
 	void get(float x, float y, DaisyDescriptor& out) const {
 		int i = static_cast<int>(std::floor(x));
 		int j = static_cast<int>(std::floor(y));
-		const DaisyDescriptor& rgb00 = operator()(i, j);
-		const DaisyDescriptor& rgb10 = operator()(i + 1, j);
-		const DaisyDescriptor& rgb11 = operator()(i + 1, j + 1);
-		const DaisyDescriptor& rgb01 = operator()(i, j + 1);
+		size_t o00 = index(i, j);
+		size_t o10 = index(i + 1, j);
+		size_t o11 = index(i + 1, j + 1);
+		size_t o01 = index(i, j + 1);
 		float dx = x - i;
 		float dy = y - j;
-		int N = (int) rgb00.size();
-		out.resize(N);
-		for (int i = 0; i < N; i++) {
-			out[i] = ((rgb00[i] * (1.0f - dx) + rgb10[i] * dx) * (1.0f - dy)
-					+ (rgb01[i] * (1.0f - dx) + rgb11[i] * dx) * dy);
+		out.resize(length);
+		for (int n = 0; n < length; n++) {
+			out[n] = ((value(o00 + n) * (1.0f - dx) + value(o10 + n) * dx) * (1.0f - dy)
+					+ (value(o01 + n) * (1.0f - dx) + value(o11 + n) * dx) * dy);
 		}
 	}
 	DaisyDescriptor operator()(float x, float y) const {
-		int i = static_cast<int>(std::floor(x));
-		int j = static_cast<int>(std::floor(y));
-		const DaisyDescriptor& rgb00 = operator()(i, j);
-		const DaisyDescriptor& rgb10 = operator()(i + 1, j);
-		const DaisyDescriptor& rgb11 = operator()(i + 1, j + 1);
-		const DaisyDescriptor& rgb01 = operator()(i, j + 1);
-		float dx = x - i;
-		float dy = y - j;
-		int N = (int) rgb00.size();
-		DaisyDescriptor out(N);
-		for (int i = 0; i < N; i++) {
-			out[i] = ((rgb00[i] * (1.0f - dx) + rgb10[i] * dx) * (1.0f - dy)
-					+ (rgb01[i] * (1.0f - dx) + rgb11[i] * dx) * dy);
-		}
+		DaisyDescriptor out;
+		get(x, y, out);
 		return out;
 	}
+	//Dot product between the descriptor at (i,j) and the descriptor at (ii,jj) in another field, without copies.
+	double dot(int i, int j, const DaisyDescriptorField& other, int ii, int jj) const {
+		size_t a = index(i, j);
+		size_t b = other.index(ii, jj);
+		int N = std::min(length, other.length);
+		double ret = 0.0;
+		if (storage == DaisyStorage::Float && other.storage == DaisyStorage::Float) {
+			const float* pa = &floatData[a];
+			const float* pb = &other.floatData[b];
+			for (int n = 0; n < N; n++) {
+				ret += pa[n] * pb[n];
+			}
+		} else {
+			for (int n = 0; n < N; n++) {
+				ret += value(a + n) * other.value(b + n);
+			}
+		}
+		return ret;
+	}
 };
 template<class L, class R> std::basic_ostream<L, R> & operator <<(
 		std::basic_ostream<L, R> & ss, const DaisyDescriptor& A) {
@@ -300,7 +381,12 @@ public:
 		getDescriptor(pix.x, pix.y, out, normalizationType,
 				disableInterpolation);
 	}
-	void getDescriptors(DaisyDescriptorField& field,DaisyNormalization normalizationType);
+	/*
+	 * Dense descriptors for every pixel, extracted in parallel rows. Half and
+	 * Byte storage cut the field to one half or one quarter of its Float size.
+	 */
+	void getDescriptors(DaisyDescriptorField& field,DaisyNormalization normalizationType,
+			DaisyStorage storage = DaisyStorage::Float);
 };
 }
 #endif
@@ -23,6 +23,7 @@
 #include "AlloyImage.h"
 #include "AlloyCamera.h"
 namespace aly {
+class ResultCache;
 bool SANITY_CHECK_IMAGE_PROCESSING();
 enum BayerFilter {
 	BGGR = 0, RGGB = 1, GBRG = 2, GRBG = 3
@@ -524,6 +525,13 @@ template<class T, int C, ImageType I> void Smooth(const Image<T, C, I>& image,
 		Smooth<25, 25>(image, B, sigmaX, sigmaY);
 	}
 }
+void Smooth(ResultCache& cache, const Image1f& image, Image1f& B, double sigmaX, double sigmaY);
+void Smooth(ResultCache& cache, const Image2f& image, Image2f& B, double sigmaX, double sigmaY);
+void Smooth(ResultCache& cache, const Image3f& image, Image3f& B, double sigmaX, double sigmaY);
+void Smooth(ResultCache& cache, const Image4f& image, Image4f& B, double sigmaX, double sigmaY);
+void Smooth(ResultCache& cache, const Image1ub& image, Image1ub& B, double sigmaX, double sigmaY);
+void Smooth(ResultCache& cache, const ImageRGB& image, ImageRGB& B, double sigmaX, double sigmaY);
+void Smooth(ResultCache& cache, const ImageRGBA& image, ImageRGBA& B, double sigmaX, double sigmaY);
 template<class T, int C, ImageType I> void Gradient(const Image<T, C, I>& image,
 		Image<T, C, I>& gX, Image<T, C, I>& gY, double sigmaX, double sigmaY) {
 	double sigma = std::max(sigmaX, sigmaY);
@@ -18,10 +18,13 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
+#include <functional>
 #include <math.h>
 #include <stdint.h>
 #include <grid/EndlessGrid.h>
 namespace aly {
+bool SANITY_CHECK_ISOSURFACE();
+bool SANITY_CHECK_ISOSURFACE_GRID();
 struct EdgeInfo {
 	float3 point;
 	bool winding = false;
@@ -167,6 +170,7 @@ public:
 };
 
 
+struct IsoSlab;
 class IsoSurface {
 private:
 	float backgroundValue;
@@ -205,6 +209,16 @@ private:
 
 	static std::vector<int> buildFaceNeighborTable(int vertexCount,
 			const int* indexes, const int indexCount);
+	/* Compact (CSR) table of unique vertex neighbors. Neighbors of vertex i are neighbors[offsets[i]..offsets[i+1]). */
+	static void buildVertexNeighborTable(const Mesh& mesh,
+			std::vector<uint32_t>& offsets, std::vector<uint32_t>& neighbors);
+	bool isActiveEdge(const IsoSlab& slab, int x, int y, int z, int axis) const;
+	bool isActiveCell(const IsoSlab& slab, int x, int y, int z) const;
+	size_t rankEdges(const IsoSlab& slab, int z, uint32_t* keys, uint32_t* rowStarts,
+			float3* points, float3* normals, uint8_t* activeRows) const;
+	void triangulateSlab(const IsoSlab& slab, int zBegin, int zEnd, Mesh& mesh);
+	void solveTri(const float* data, const int& rows, const int& cols,
+			const int& slices, Mesh& mesh, const float& isoLevel = 0);
 	void findActiveVoxels(const float* vol, const std::vector<int3>& indexList,
 			std::unordered_set<int3>& activeVoxels,
 			std::unordered_map<int4, EdgeInfo>& activeEdges);
@@ -218,33 +232,27 @@ private:
 			const std::unordered_map<int3, uint32_t>& vertexIndices, Mesh& buffer);
 	void solveQuad(const float* data, const int& rows, const int& cols,
 			const int& slices, const std::vector<int3>& indexList, Mesh& mesh, const float& isoLevel = 0.0f);
-	void solveQuad(const EndlessGridFloat& grid,Mesh& mesh,const float& isoLevel);
-	void generateVertexData(
-			const EndlessGridFloat& grid,
-			const std::unordered_set<int3>& voxels,
-			const std::unordered_map<int4, EdgeInfo>& edges,
-			std::unordered_map<int3, uint32_t>& vertexIndices,
-			Mesh& buffer);
+	void solveQuad(const EndlessGridFloat& grid,Mesh& mesh,const float& isoLevel,bool sharpFeatures);
 	void solveTri(const float* data, const int& rows, const int& cols,
 			const int& slices, const std::vector<int3>& indexList,
 			Mesh& mesh, const float& isoLevel = 0);
 	void solveTri(const EndlessGridFloat& grid,
 			Mesh& mesh,
 			const float& isoLevel = 0);
-	void findActiveVoxels(
-			const EndlessGridFloat& grid,
-			const std::list<EndlessNodeFloat*>& leafs,
-			std::unordered_set<int3>& activeVoxels,
-			std::unordered_map<int4, EdgeInfo>& activeEdges);
 public:
 	IsoSurface();
 	~IsoSurface();
+	/*
+	 * With sharpFeatures, quad vertices are placed by dual contouring (see contourLeaves) so edges and corners
+	 * of the level set are kept. Regularization smooths them away again, so it is usually turned off with it.
+	 */
 	void solve(
 			const EndlessGridFloat& grid,
 			Mesh& mesh,
 			const MeshType& type,
 			bool regularizeTest,
-			const float& isoLevel);
+			const float& isoLevel,
+			bool sharpFeatures = false);
 	void solve(const Volume1f& data, const std::vector<int3>& indexList,
 			Mesh& mesh, const MeshType& type = MeshType::Triangle,
 			bool regularize = true, const float& isoLevel = 0);
@@ -256,6 +264,29 @@ public:
 			const int& slices, const std::vector<int3>& indexList, Mesh& mesh,
 			const MeshType& type = MeshType::Triangle, bool regularize = true,
 			const float& isoLevel = 0);
+	/*
+	 * Marching cubes over a volume that is read one z-slice at a time, so only slabSize+3 slices are resident.
+	 * getSlice(z,slice) fills the rows*cols values of slice z. Slices are requested once each, in increasing order.
+	 * The triangle mesh matches solve(Volume1f) without regularization, since that needs the whole volume.
+	 */
+	void solve(const std::function<void(int z, float* slice)>& getSlice,
+			const int& rows, const int& cols, const int& slices, Mesh& mesh,
+			const float& isoLevel = 0, int slabSize = 64);
+	/*
+	 * Quad mesh extraction over the leaves of a sparse grid, one leaf per task. Every active edge gives a quad and
+	 * every cell touching one gives a vertex. Edges and cells belong to the leaf that holds their lower corner, so
+	 * leaf borders are stitched without locks and the mesh does not depend on the thread count.
+	 * fillLeaf(n,block) writes leaf n and its +1 border into a (dim+1)^3 block, x fastest. sample(i,j,k) and
+	 * normal(x,y,z) read the grid directly; sample is only used for cells outside every leaf.
+	 * Vertices sit at the mean of their edge crossings, or with sharpFeatures at the minimizer of the quadratic
+	 * error to the crossing tangent planes, clamped to the cell. Results are written into mesh, which is resized once.
+	 */
+	static void contourLeaves(const std::vector<int3>& leafLocations, int dim,
+			const std::function<void(size_t leaf, float* block)>& fillLeaf,
+			const std::function<float(int i, int j, int k)>& sample,
+			const std::function<float3(float x, float y, float z)>& normal,
+			Mesh& mesh, float isoLevel, float backgroundValue, Winding winding,
+			bool sharpFeatures = false);
 	void project(aly::float3* points, const int& numPoints,
 			aly::float3* normals, float* levelset, const aly::box3f& bbox,
 			const int& rows, const int& cols, const int& slices, int maxIters,
@@ -226,7 +226,7 @@ struct PlyProperty
 struct PlyElement
 { /* description of an element */
         std::string name; /* element name */
-        int num; /* number of elements in this object */
+        size_t num; /* number of elements in this object */
         int size; /* size of element (bytes) or -1 if variable */
         std::vector<std::shared_ptr<PlyProperty>> props; /* list of properties in the file */
         std::vector<char> store_prop; /* flags: property wanted by user? */
@@ -348,7 +348,7 @@ class PLYReaderWriter
                             const std::vector<std::string>& elem_names,
                             const FileFormat& file_type);
         void openForReading(const std::string& fileName);
-        void elementCount(const std::string&, int);
+        void elementCount(const std::string&, size_t);
         void describeElement(const std::string&);
         void describeProperty(const std::string&, const PlyProperty *);
         void appendComment(const std::string&);
@@ -369,6 +369,8 @@ class PLYReaderWriter
         std::vector<std::shared_ptr<PlyProperty>> getElementDescription(const std::string& elem_name,
                                                                         int *nelems,
                                                                         int *nprops);
+        //Number of elements of the given type, not limited to the range of int.
+        size_t getElementCount(const std::string& elem_name);
         void describeProperty(PlyProperty *);
         std::vector<std::string> getComments();
         std::vector<std::string> getObjInfo();
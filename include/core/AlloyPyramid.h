@@ -0,0 +1,418 @@
+/*
+ * Copyright(C) 2018, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef INCLUDE_CORE_ALLOYPYRAMID_H_
+#define INCLUDE_CORE_ALLOYPYRAMID_H_
+#include "AlloyResample.h"
+#include <atomic>
+#include <mutex>
+namespace aly {
+bool SANITY_CHECK_IMAGE_PYRAMID();
+namespace detail {
+static const int PYRAMID_BAND = 16;
+//Binomial weights {1,4,6,4,1}/16, applied once along each axis they give the 5x5 kernel of Image::downSample().
+static const float PyramidWeights[5] = { 1.0f / 16.0f, 4.0f / 16.0f, 6.0f / 16.0f, 4.0f / 16.0f, 1.0f / 16.0f };
+/*
+ * Blurs and decimates rows [y0,y1) x columns [x0,x1) of the output. Each band of
+ * output rows filters the input rows it needs horizontally into a local buffer
+ * and then filters vertically, so no full resolution intermediate is stored.
+ * Bands are processed in parallel unless parallel is false.
+ */
+template<class T, int C> void PyramidReduce(const vec<T, C>* in, int2 inDims, vec<T, C>* out, int2 outDims, int x0, int y0, int x1,
+		int y1, bool parallel = true) {
+	if (x0 >= x1 || y0 >= y1) {
+		return;
+	}
+	auto reduceRows = [=](size_t b, size_t e) {
+		for (int band = (int) b; band < (int) e; band += PYRAMID_BAND) {
+			int bandEnd = std::min((int) e, band + PYRAMID_BAND);
+			int rowStart = 2 * band - 2;
+			int rows = 2 * (bandEnd - band) + 3;
+			int cols = x1 - x0;
+			std::vector<vec<float, C>> buffer(rows * (size_t) cols);
+			for (int r = 0; r < rows; r++) {
+				const vec<T, C>* src = in + clamp(rowStart + r, 0, inDims.y - 1) * (size_t) inDims.x;
+				vec<float, C>* dst = &buffer[r * (size_t) cols];
+				for (int i = x0; i < x1; i++) {
+					int c = 2 * i - 2;
+					vec<float, C> sum(0.0f);
+					if (c >= 0 && c + 4 < inDims.x) {
+						for (int k = 0; k < 5; k++) {
+							sum += PyramidWeights[k] * vec<float, C>(src[c + k]);
+						}
+					} else {
+						for (int k = 0; k < 5; k++) {
+							sum += PyramidWeights[k] * vec<float, C>(src[clamp(c + k, 0, inDims.x - 1)]);
+						}
+					}
+					dst[i - x0] = sum;
+				}
+			}
+			for (int j = band; j < bandEnd; j++) {
+				const vec<float, C>* rowPtr = &buffer[2 * (j - band) * (size_t) cols];
+				vec<T, C>* dst = out + j * (size_t) outDims.x + x0;
+				for (int i = 0; i < cols; i++) {
+					vec<float, C> sum(0.0f);
+					for (int k = 0; k < 5; k++) {
+						sum += PyramidWeights[k] * rowPtr[i + k * cols];
+					}
+					StoreSample(dst[i], sum);
+				}
+			}
+		}
+	};
+	if (parallel) {
+		ParallelForRange(y0, y1, reduceRows, PYRAMID_BAND);
+	} else {
+		reduceRows(y0, y1);
+	}
+}
+/*
+ * Inverse of PyramidReduce() with the kernel of Image::upSample(). Even output
+ * samples take {1,6,1}/8 of their parent and its neighbors, odd samples
+ * average the two parents on either side.
+ */
+template<class T, int C, class O> void PyramidExpand(const vec<T, C>* in, int2 inDims, vec<O, C>* out, int2 outDims) {
+	ParallelForRange(0, outDims.y, [=](size_t b, size_t e) {
+		for (int band = (int) b; band < (int) e; band += PYRAMID_BAND) {
+			int bandEnd = std::min((int) e, band + PYRAMID_BAND);
+			int rowStart = band / 2 - 1;
+			int rows = (bandEnd - 1) / 2 + 2 - rowStart;
+			std::vector<vec<float, C>> buffer(rows * (size_t) outDims.x);
+			for (int r = 0; r < rows; r++) {
+				const vec<T, C>* src = in + clamp(rowStart + r, 0, inDims.y - 1) * (size_t) inDims.x;
+				vec<float, C>* dst = &buffer[r * (size_t) outDims.x];
+				for (int i = 0; i < outDims.x; i++) {
+					int p = i / 2;
+					if (i % 2 == 0) {
+						dst[i] = 0.125f * vec<float, C>(src[clamp(p - 1, 0, inDims.x - 1)]) + 0.75f * vec<float, C>(src[clamp(p, 0, inDims.x - 1)])
+								+ 0.125f * vec<float, C>(src[clamp(p + 1, 0, inDims.x - 1)]);
+					} else {
+						dst[i] = 0.5f * (vec<float, C>(src[clamp(p, 0, inDims.x - 1)]) + vec<float, C>(src[clamp(p + 1, 0, inDims.x - 1)]));
+					}
+				}
+			}
+			for (int j = band; j < bandEnd; j++) {
+				int p = j / 2 - rowStart;
+				const vec<float, C>* r0 = &buffer[(p - 1) * (size_t) outDims.x];
+				const vec<float, C>* r1 = r0 + outDims.x;
+				const vec<float, C>* r2 = r1 + outDims.x;
+				vec<O, C>* dst = out + j * (size_t) outDims.x;
+				if (j % 2 == 0) {
+					for (int i = 0; i < outDims.x; i++) {
+						StoreSample(dst[i], 0.125f * r0[i] + 0.75f * r1[i] + 0.125f * r2[i]);
+					}
+				} else {
+					for (int i = 0; i < outDims.x; i++) {
+						StoreSample(dst[i], 0.5f * (r1[i] + r2[i]));
+					}
+				}
+			}
+		}
+	}, PYRAMID_BAND);
+}
+}
+/*
+ * Upsamples in to the dimensions of out with the same kernel as
+ * Image::upSample(). out keeps its dimensions unless it is empty, in which
+ * case it becomes twice the size of in.
+ */
+template<class T, int C, ImageType I> void PyramidUpSample(const Image<T, C, I>& in, Image<T, C, I>& out) {
+	if (out.size() == 0) {
+		out.resize(in.width * 2, in.height * 2);
+	}
+	detail::PyramidExpand(in.data.data(), in.dimensions(), out.data.data(), out.dimensions());
+}
+/*
+ * Gaussian pyramid with the 5x5 binomial kernel of Image::downSample(). Level l
+ * is half the size of level l-1, rounded down, and all levels live in one
+ * allocation. Levels are computed the first time they are read unless the
+ * pyramid is built eagerly. After the base image changes, update() recomputes
+ * only the part of each level that the changed region touches.
+ *
+ * Reading a level from several threads is safe, concurrent updates are not.
+ * Levels computed on first read are reduced serially while the pyramid is
+ * locked, so a read from inside a parallel loop never waits on work that the
+ * scheduler could hand back to the waiting thread. Build eagerly to reduce
+ * all levels in parallel.
+ */
+template<class T, int C, ImageType I> class ImagePyramid {
+protected:
+	mutable std::vector<vec<T, C>> storage;
+	std::vector<int2> dims;
+	std::vector<size_t> offsets;
+	mutable std::vector<box2i> dirty;
+	//Levels computed at least once, and the leading levels that are also up to date.
+	mutable int valid = 0;
+	mutable std::atomic<int> ready;
+	mutable std::mutex lock;
+	void reduceLevels(int level, bool parallel) const {
+		for (int l = 1; l <= level; l++) {
+			if (l >= valid) {
+				detail::PyramidReduce(&storage[offsets[l - 1]], dims[l - 1], &storage[offsets[l]], dims[l], 0, 0, dims[l].x, dims[l].y, parallel);
+				valid = l + 1;
+			} else if (dirty[l].dimensions.x > 0 && dirty[l].dimensions.y > 0) {
+				int2 mn = dirty[l].min(), mx = dirty[l].max();
+				detail::PyramidReduce(&storage[offsets[l - 1]], dims[l - 1], &storage[offsets[l]], dims[l], mn.x, mn.y, mx.x, mx.y, parallel);
+			}
+			dirty[l] = box2i();
+		}
+		ready.store(std::max(level + 1, ready.load()), std::memory_order_release);
+	}
+	void materialize(int level) const {
+		if (level < ready.load(std::memory_order_acquire)) {
+			return;
+		}
+		std::lock_guard<std::mutex> lockMe(lock);
+		reduceLevels(level, false);
+	}
+public:
+	ImagePyramid() :
+			ready(0) {
+	}
+	explicit ImagePyramid(const Image<T, C, I>& image, int levels = 0, bool lazy = true) :
+			ready(0) {
+		build(image, levels, lazy);
+	}
+	ImagePyramid(const ImagePyramid& other) :
+			ready(0) {
+		*this = other;
+	}
+	ImagePyramid& operator=(const ImagePyramid& other) {
+		if (this != &other) {
+			std::lock_guard<std::mutex> lockOther(other.lock);
+			storage = other.storage;
+			dims = other.dims;
+			offsets = other.offsets;
+			dirty = other.dirty;
+			valid = other.valid;
+			ready = other.ready.load();
+		}
+		return *this;
+	}
+	//levels=0 keeps halving until a side would drop below 2 pixels.
+	void build(const Image<T, C, I>& image, int levels = 0, bool lazy = true) {
+		if (image.size() == 0) {
+			throw std::runtime_error("Cannot build pyramid from empty image.");
+		}
+		dims.clear();
+		offsets.clear();
+		int2 d = image.dimensions();
+		size_t total = 0;
+		while (levels <= 0 || (int) dims.size() < levels) {
+			dims.push_back(d);
+			offsets.push_back(total);
+			total += d.x * (size_t) d.y;
+			d /= 2;
+			if (d.x < 1 || d.y < 1 || (levels <= 0 && (d.x < 2 || d.y < 2))) {
+				break;
+			}
+		}
+		if (levels > 0 && (int) dims.size() < levels) {
+			throw std::runtime_error(MakeString() << "Cannot build " << levels << " pyramid levels from image of size " << image.dimensions());
+		}
+		storage.resize(total);
+		std::copy(image.data.begin(), image.data.end(), storage.begin());
+		dirty.assign(dims.size(), box2i());
+		valid = 1;
+		ready = 1;
+		if (!lazy) {
+			//Nobody else may read the pyramid while it is built, so the lock is not needed.
+			reduceLevels(getLevelCount() - 1, true);
+		}
+	}
+	/*
+	 * Copies the region of the image into the base level and marks what it
+	 * affects in the coarser levels for recomputation.
+	 */
+	void update(const Image<T, C, I>& image, const box2i& region) {
+		if (image.dimensions() != dims[0]) {
+			throw std::runtime_error(MakeString() << "Cannot update pyramid of size " << dims[0] << " from image of size " << image.dimensions());
+		}
+		box2i r = region;
+		r.intersect(box2i(int2(0, 0), dims[0]));
+		if (r.dimensions.x <= 0 || r.dimensions.y <= 0) {
+			return;
+		}
+		std::lock_guard<std::mutex> lockMe(lock);
+		ready = 1;
+		for (int j = r.position.y; j < r.position.y + r.dimensions.y; j++) {
+			size_t off = r.position.x + j * (size_t) dims[0].x;
+			std::copy(image.data.begin() + off, image.data.begin() + off + r.dimensions.x, storage.begin() + off);
+		}
+		for (int l = 1; l < valid; l++) {
+			//The 5 tap kernel reaches 2 samples past the region, which halves on the way down.
+			int2 mn = (r.min() - int2(1, 1)) / 2;
+			int2 mx = (r.max() + int2(3, 3)) / 2;
+			r = box2i(mn, mx - mn);
+			r.intersect(box2i(int2(0, 0), dims[l]));
+			if (r.dimensions.x <= 0 || r.dimensions.y <= 0) {
+				break;
+			}
+			if (dirty[l].dimensions.x > 0 && dirty[l].dimensions.y > 0) {
+				dirty[l].merge(r);
+			} else {
+				dirty[l] = r;
+			}
+		}
+	}
+	void update(const Image<T, C, I>& image) {
+		update(image, box2i(int2(0, 0), dims[0]));
+	}
+	//Recomputes every level that is missing or out of date in parallel. Must not overlap with reads from other threads.
+	void refresh() {
+		std::lock_guard<std::mutex> lockMe(lock);
+		reduceLevels(getLevelCount() - 1, true);
+	}
+	int getLevelCount() const {
+		return (int) dims.size();
+	}
+	int2 dimensions(int level) const {
+		return dims[level];
+	}
+	//Pointer to the first pixel of a level, computing it if needed.
+	const vec<T, C>* getData(int level) const {
+		materialize(level);
+		return &storage[offsets[level]];
+	}
+	void getLevel(int level, Image<T, C, I>& out) const {
+		const vec<T, C>* ptr = getData(level);
+		out.resize(dims[level].x, dims[level].y);
+		std::copy(ptr, ptr + out.size(), out.data.begin());
+	}
+	Image<T, C, I> getLevel(int level) const {
+		Image<T, C, I> out;
+		getLevel(level, out);
+		return out;
+	}
+	//Upsamples a level to the dimensions of the level above it.
+	void expand(int level, Image<T, C, I>& out) const {
+		const vec<T, C>* ptr = getData(level);
+		out.resize(dims[level - 1].x, dims[level - 1].y);
+		detail::PyramidExpand(ptr, dims[level], out.data.data(), out.dimensions());
+	}
+	const vec<T, C>& operator()(int level, int i, int j) const {
+		const vec<T, C>* ptr = getData(level);
+		return ptr[clamp(i, 0, dims[level].x - 1) + clamp(j, 0, dims[level].y - 1) * (size_t) dims[level].x];
+	}
+	/*
+	 * Bilinear sample of a level. Coordinates are in the pixels of that level.
+	 */
+	vec<float, C> operator()(int level, float x, float y) const {
+		const vec<T, C>* ptr = getData(level);
+		const int w = dims[level].x, h = dims[level].y;
+		int i = static_cast<int>(std::floor(x));
+		int j = static_cast<int>(std::floor(y));
+		vec<float, C> rgb00 = vec<float, C>(ptr[clamp(i, 0, w - 1) + clamp(j, 0, h - 1) * (size_t) w]);
+		vec<float, C> rgb10 = vec<float, C>(ptr[clamp(i + 1, 0, w - 1) + clamp(j, 0, h - 1) * (size_t) w]);
+		vec<float, C> rgb11 = vec<float, C>(ptr[clamp(i + 1, 0, w - 1) + clamp(j + 1, 0, h - 1) * (size_t) w]);
+		vec<float, C> rgb01 = vec<float, C>(ptr[clamp(i, 0, w - 1) + clamp(j + 1, 0, h - 1) * (size_t) w]);
+		float dx = x - i;
+		float dy = y - j;
+		return ((rgb00 * (1.0f - dx) + rgb10 * dx) * (1.0f - dy) + (rgb01 * (1.0f - dx) + rgb11 * dx) * dy);
+	}
+};
+/*
+ * Band-pass levels of a Gaussian pyramid, level l is G(l)-expand(G(l+1)) and
+ * the last level is the coarsest Gaussian level. Stored in float so negative
+ * differences of integer images survive.
+ */
+template<class T, int C, ImageType I> class LaplacianPyramid {
+protected:
+	std::vector<vec<float, C>> storage;
+	std::vector<int2> dims;
+	std::vector<size_t> offsets;
+public:
+	LaplacianPyramid() {
+	}
+	explicit LaplacianPyramid(const ImagePyramid<T, C, I>& gaussian) {
+		build(gaussian);
+	}
+	void build(const ImagePyramid<T, C, I>& gaussian) {
+		int L = gaussian.getLevelCount();
+		dims.resize(L);
+		offsets.resize(L);
+		size_t total = 0;
+		for (int l = 0; l < L; l++) {
+			dims[l] = gaussian.dimensions(l);
+			offsets[l] = total;
+			total += dims[l].x * (size_t) dims[l].y;
+		}
+		storage.resize(total);
+		for (int l = 0; l < L; l++) {
+			const vec<T, C>* ptr = gaussian.getData(l);
+			vec<float, C>* dst = &storage[offsets[l]];
+			size_t N = dims[l].x * (size_t) dims[l].y;
+			if (l < L - 1) {
+				detail::PyramidExpand(gaussian.getData(l + 1), dims[l + 1], dst, dims[l]);
+				ParallelFor(0, N, [=](size_t n) {
+					dst[n] = vec<float, C>(ptr[n]) - dst[n];
+				}, 4096);
+			} else {
+				for (size_t n = 0; n < N; n++) {
+					dst[n] = vec<float, C>(ptr[n]);
+				}
+			}
+		}
+	}
+	//Reconstructs the base level by expanding and adding levels from coarse to fine.
+	void collapse(Image<T, C, I>& out) const {
+		int L = getLevelCount();
+		std::vector<vec<float, C>> current(storage.begin() + offsets[L - 1], storage.end());
+		std::vector<vec<float, C>> next;
+		for (int l = L - 2; l >= 0; l--) {
+			size_t N = dims[l].x * (size_t) dims[l].y;
+			next.resize(N);
+			detail::PyramidExpand(current.data(), dims[l + 1], next.data(), dims[l]);
+			const vec<float, C>* band = &storage[offsets[l]];
+			vec<float, C>* dst = next.data();
+			ParallelFor(0, N, [=](size_t n) {
+				dst[n] += band[n];
+			}, 4096);
+			current.swap(next);
+		}
+		out.resize(dims[0].x, dims[0].y);
+		for (size_t n = 0; n < out.size(); n++) {
+			StoreSample(out.data[n], current[n]);
+		}
+	}
+	int getLevelCount() const {
+		return (int) dims.size();
+	}
+	int2 dimensions(int level) const {
+		return dims[level];
+	}
+	const vec<float, C>* getData(int level) const {
+		return &storage[offsets[level]];
+	}
+	void getLevel(int level, Image<float, C, ImageType::FLOAT>& out) const {
+		out.resize(dims[level].x, dims[level].y);
+		std::copy(getData(level), getData(level) + out.size(), out.data.begin());
+	}
+};
+typedef ImagePyramid<float, 1, ImageType::FLOAT> ImagePyramid1f;
+typedef ImagePyramid<float, 2, ImageType::FLOAT> ImagePyramid2f;
+typedef ImagePyramid<float, 4, ImageType::FLOAT> ImagePyramid4f;
+typedef ImagePyramid<float, 3, ImageType::FLOAT> ImagePyramidRGBf;
+typedef ImagePyramid<float, 4, ImageType::FLOAT> ImagePyramidRGBAf;
+typedef ImagePyramid<uint8_t, 3, ImageType::UBYTE> ImagePyramidRGB;
+typedef ImagePyramid<uint8_t, 4, ImageType::UBYTE> ImagePyramidRGBA;
+}
+#endif /* INCLUDE_CORE_ALLOYPYRAMID_H_ */
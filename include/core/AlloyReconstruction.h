@@ -28,6 +28,14 @@
 #include <poisson/Geometry.h>
 #include <poisson/PointStream.h>
 #include <string>
+#include <memory>
+#include <cstdio>
+namespace aly {
+	namespace ply {
+		class PLYReaderWriter;
+	}
+	bool SANITY_CHECK_RECONSTRUCTION();
+}
 class AlloyPointStream : public OrientedPointStreamWithData<float, Point3D< float> >
 {
 protected:
@@ -42,6 +50,51 @@ public:
 	}
 	virtual bool nextPoint(OrientedPoint3D< float >& p, Point3D< float >& d) override;
 };
+/*
+ * Reads oriented points from the vertex element of a PLY file one element at a time, so the point set never has to fit in memory.
+ * Colors are reported in [0,255] like AlloyPointStream. The vertex element must precede any other element in the file.
+ */
+class PlyPointStream : public OrientedPointStreamWithData<float, Point3D< float> >
+{
+protected:
+	std::string file;
+	std::unique_ptr<aly::ply::PLYReaderWriter> ply;
+	aly::float4x4 M;
+	size_t counter;
+	size_t count;
+	bool hasNormals;
+	bool hasColors;
+	void open();
+public:
+	PlyPointStream(const std::string& file, const aly::float4x4& M = aly::float4x4::identity());
+	~PlyPointStream();
+	size_t size() const {
+		return count;
+	}
+	void reset(void) override;
+	virtual bool nextPoint(OrientedPoint3D< float >& p, Point3D< float >& d) override;
+};
+/*
+ * Reads oriented points from a raw binary file of records {x,y,z,nx,ny,nz,r,g,b} stored as 32-bit floats,
+ * the same layout used by BinaryOrientedPointStreamWithData<float,Point3D<float>>. Points are read in chunks.
+ * Colors are stored in [0,1] like Mesh::vertexColors and reported in [0,255] like the other point streams.
+ */
+class BinaryPointStream : public OrientedPointStreamWithData<float, Point3D< float> >
+{
+protected:
+	static const int POINT_BUFFER_SIZE = 4096;
+	std::string file;
+	FILE* fp;
+	aly::float4x4 M;
+	std::vector<float> buffer;
+	size_t index;
+	size_t loaded;
+public:
+	BinaryPointStream(const std::string& file, const aly::float4x4& M = aly::float4x4::identity());
+	~BinaryPointStream();
+	void reset(void) override;
+	virtual bool nextPoint(OrientedPoint3D< float >& p, Point3D< float >& d) override;
+};
 
 struct ReconstructionParameters {
 	ArgumentReadable
@@ -75,7 +128,13 @@ struct ReconstructionParameters {
 		LowResIterMultiplier,
 		PointWeight,
 		Trim,
-		IslandAreaRatio;
+		IslandAreaRatio,
+		BlockPadding;
+	/*
+	 * MemoryBudget is in megabytes and only applies to the streaming SurfaceReconstruct overloads.
+	 * When zero, or when the estimated octree fits in the budget, the point stream is reconstructed in one piece.
+	 */
+	ArgumentInt MemoryBudget;
 
 	ReconstructionParameters() :
 		Complete("complete"),
@@ -106,12 +165,24 @@ struct ReconstructionParameters {
 		LowResIterMultiplier("iterMultiplier", 1.f),
 		PointWeight("pointWeight", 4.f),
 		Trim("trim", 0.05f),
-		IslandAreaRatio("aRatio", 0.001f)
+		IslandAreaRatio("aRatio", 0.001f),
+		BlockPadding("blockPadding", 0.125f),
+		MemoryBudget("memory", 0)
 		{
 
 	}
 };
 void SurfaceReconstruct(const ReconstructionParameters& params, const aly::Mesh& input, aly::Mesh& output,
 	const std::function<bool(const std::string& status, float progress)>& monitor=nullptr);
+/*
+ * Out-of-core reconstruction. Points are consumed from the stream and the surface is written to a PLY file incrementally.
+ * If the estimated octree exceeds params.MemoryBudget, the bounding cube is split into blocks that are bucketed to temporary
+ * files next to outputFile, padded by params.BlockPadding (fraction of block width) and reconstructed one at a time with the
+ * depth reduced so the voxel size matches a single solve at params.Depth. Only triangles centered inside a block's core are kept.
+ */
+void SurfaceReconstruct(const ReconstructionParameters& params, OrientedPointStreamWithData<float, Point3D< float> >& input, const std::string& outputFile,
+	const std::function<bool(const std::string& status, float progress)>& monitor = nullptr);
+void SurfaceReconstruct(const ReconstructionParameters& params, const std::string& inputFile, const std::string& outputFile,
+	const std::function<bool(const std::string& status, float progress)>& monitor = nullptr);
 
 #endif /* POISSONRECONAPI_H_ */
@@ -0,0 +1,574 @@
+/*
+ * Copyright(C) 2018, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef INCLUDE_CORE_ALLOYRESAMPLE_H_
+#define INCLUDE_CORE_ALLOYRESAMPLE_H_
+#include "AlloyImage.h"
+#include "AlloyVolume.h"
+#include "AlloyScheduler.h"
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include <vector>
+namespace aly {
+bool SANITY_CHECK_RESAMPLE();
+/*
+ * Reconstruction filter for resampling. Pixel centers are at integer
+ * coordinates and samples outside the image are clamped to the edge, the same
+ * as Image::operator()(float x, float y).
+ */
+enum class SampleFilter {
+	Nearest = 0, Bilinear = 1, Bicubic = 2, Lanczos = 3
+};
+/*
+ * Brown-Conrady lens model in pixels. Maps a pixel of the undistorted image to
+ * the location it is sampled from in the distorted image. The principal point
+ * (cx,cy) is an offset from the image center.
+ */
+struct LensDistortion {
+	double fx, fy, cx, cy;
+	double k1, k2, k3, p1, p2;
+	double2 center;
+	LensDistortion(int width, int height, double fx, double fy, double cx, double cy, double k1, double k2, double k3, double p1,
+			double p2) :
+			fx(fx), fy(fy), cx(cx), cy(cy), k1(k1), k2(k2), k3(k3), p1(p1), p2(p2), center(0.5 * width + cx, 0.5 * height + cy) {
+	}
+	float2 operator()(int i, int j) const {
+		double x = (i - center.x) / fx;
+		double y = (j - center.y) / fy;
+		double rs = x * x + y * y;
+		double radial = 1 + k1 * rs + k2 * rs * rs + k3 * rs * rs * rs;
+		double xp = x * radial + 2 * p1 * x * y + p2 * (rs + 2 * x * x);
+		double yp = y * radial + 2 * p2 * x * y + p1 * (rs + 2 * y * y);
+		return float2((float) (xp * fx + center.x), (float) (yp * fy + center.y));
+	}
+};
+//Source location of every output pixel, so a lens model can be evaluated once and reused for every frame.
+void MakeRemap(const LensDistortion& lens, int width, int height, Image2f& coords);
+//Coordinates are clamped to this range on the border path, far outside any image but still exact in float and int.
+static const float SAMPLE_LIMIT = 4194304.0f;
+//std::floor() is a library call without SSE4.1, samplers only pass values well inside the range of int.
+inline int FloorToInt(float x) {
+	int i = (int) x;
+	return i - (x < (float) i);
+}
+inline float CubicWeight(float t) {
+	//Catmull-Rom, a=-0.5
+	t = std::abs(t);
+	if (t < 1.0f) {
+		return (1.5f * t - 2.5f) * t * t + 1.0f;
+	} else if (t < 2.0f) {
+		return ((-0.5f * t + 2.5f) * t - 4.0f) * t + 2.0f;
+	}
+	return 0.0f;
+}
+inline float LanczosWeight(float t) {
+	if (t == 0.0f) {
+		return 1.0f;
+	}
+	t = std::abs(t);
+	if (t >= 3.0f) {
+		return 0.0f;
+	}
+	const float pt = (float) ALY_PI * t;
+	return 3.0f * std::sin(pt) * std::sin(pt / 3.0f) / (pt * pt);
+}
+template<class T> inline typename std::enable_if<std::is_integral<T>::value, T>::type ToSample(float v) {
+	if (!(v >= (float) std::numeric_limits<T>::min())) {
+		return std::numeric_limits<T>::min();
+	}
+	if (!(v <= (float) std::numeric_limits<T>::max())) {
+		return std::numeric_limits<T>::max();
+	}
+	return (T) FloorToInt(v + 0.5f);
+}
+template<class T> inline typename std::enable_if<!std::is_integral<T>::value, T>::type ToSample(float v) {
+	return T(v);
+}
+template<class T, int C> inline void StoreSample(vec<T, C>& out, const vec<float, C>& v) {
+	for (int c = 0; c < C; c++) {
+		out[c] = ToSample<T>(v[c]);
+	}
+}
+template<int C> inline void StoreSample(vec<float, C>& out, const vec<float, C>& v) {
+	out = v;
+}
+inline int GetSampleTaps(SampleFilter filter) {
+	return (filter == SampleFilter::Nearest) ? 1 : (filter == SampleFilter::Bicubic) ? 4 : (filter == SampleFilter::Lanczos) ? 6 : 2;
+}
+/*
+ * Separable filter weights along one axis for the bicubic and Lanczos filters.
+ * start is the first tap.
+ */
+template<SampleFilter F> struct SampleWeights {
+	static const int TAPS = (F == SampleFilter::Lanczos) ? 6 : 4;
+	int start;
+	float w[TAPS];
+	SampleWeights(float x) {
+		int i = FloorToInt(x);
+		float d = x - i;
+		start = i - TAPS / 2 + 1;
+		if (F == SampleFilter::Lanczos) {
+			//Taps are a whole pixel apart, so the sines of every tap follow from the sines at the first one.
+			static const float cosTap[6] = { -0.5f, 0.5f, 1.0f, 0.5f, -0.5f, -1.0f };
+			static const float sinTap[6] = { 0.866025404f, 0.866025404f, 0.0f, -0.866025404f, -0.866025404f, 0.0f };
+			const float pd = (float) ALY_PI * d;
+			const float s1 = std::sin(pd), s3 = std::sin(pd / 3.0f), c3 = std::cos(pd / 3.0f);
+			float sum = 0.0f;
+			for (int k = 0; k < TAPS; k++) {
+				float t = (float) ALY_PI * (d + TAPS / 2 - 1 - k);
+				w[k] = (t == 0.0f) ? 1.0f : 3.0f * ((k % 2 == 0) ? s1 : -s1) * (s3 * cosTap[k] + c3 * sinTap[k]) / (t * t);
+				sum += w[k];
+			}
+			for (int k = 0; k < TAPS; k++) {
+				w[k] /= sum;
+			}
+		} else {
+			for (int k = 0; k < TAPS; k++) {
+				w[k] = CubicWeight(d + TAPS / 2 - 1 - k);
+			}
+		}
+	}
+};
+/*
+ * SSE2 bilinear kernels for spans whose footprint is inside the image. They
+ * return false for pixel types without a vector kernel.
+ */
+bool SampleBilinearInterior(const ubyte3* data, int width, const float2* coords, int count, ubyte3* out);
+bool SampleBilinearInterior(const ubyte4* data, int width, const float2* coords, int count, ubyte4* out);
+bool SampleBilinearInterior(const float3* data, int width, const float2* coords, int count, float3* out);
+bool SampleBilinearInterior(const float4* data, int width, const float2* coords, int count, float4* out);
+template<class T, class O> inline bool SampleBilinearInterior(const T*, int, const float2*, int, O*) {
+	return false;
+}
+/*
+ * Evaluates an image at fractional locations. Spans of samples whose filter
+ * footprint lies inside the image read pixels without clamping. Only spans that
+ * touch the border take the clamped path.
+ */
+template<class T, int C, ImageType I> class ImageSampler {
+protected:
+	const vec<T, C>* data;
+	int width;
+	int height;
+	SampleFilter filter;
+	float2 lower, upper;
+	template<bool Clamped> inline const vec<T, C>& fetch(int i, int j) const {
+		if (Clamped) {
+			i = clamp(i, 0, width - 1);
+			j = clamp(j, 0, height - 1);
+		}
+		return data[i + j * (size_t) width];
+	}
+	template<bool Clamped> inline vec<float, C> get(int i, int j) const {
+		return vec<float, C>(fetch<Clamped>(i, j));
+	}
+	template<SampleFilter F, bool Clamped> inline vec<float, C> evaluate(float x, float y) const {
+		if (Clamped) {
+			//Keeps NaN and far away samples from overflowing the integer conversion, the clamped index is the same.
+			x = (x >= -SAMPLE_LIMIT) ? ((x <= SAMPLE_LIMIT) ? x : SAMPLE_LIMIT) : -SAMPLE_LIMIT;
+			y = (y >= -SAMPLE_LIMIT) ? ((y <= SAMPLE_LIMIT) ? y : SAMPLE_LIMIT) : -SAMPLE_LIMIT;
+		}
+		if (F == SampleFilter::Nearest) {
+			return get<Clamped>(FloorToInt(x + 0.5f), FloorToInt(y + 0.5f));
+		} else if (F == SampleFilter::Bilinear) {
+			int i = FloorToInt(x);
+			int j = FloorToInt(y);
+			vec<float, C> rgb00 = get<Clamped>(i, j);
+			vec<float, C> rgb10 = get<Clamped>(i + 1, j);
+			vec<float, C> rgb11 = get<Clamped>(i + 1, j + 1);
+			vec<float, C> rgb01 = get<Clamped>(i, j + 1);
+			float dx = x - i;
+			float dy = y - j;
+			return ((rgb00 * (1.0f - dx) + rgb10 * dx) * (1.0f - dy) + (rgb01 * (1.0f - dx) + rgb11 * dx) * dy);
+		} else {
+			SampleWeights<F> wx(x), wy(y);
+			vec<float, C> sum(0.0f);
+			for (int b = 0; b < SampleWeights<F>::TAPS; b++) {
+				vec<float, C> row(0.0f);
+				for (int a = 0; a < SampleWeights<F>::TAPS; a++) {
+					row += wx.w[a] * get<Clamped>(wx.start + a, wy.start + b);
+				}
+				sum += wy.w[b] * row;
+			}
+			return sum;
+		}
+	}
+	template<SampleFilter F> inline vec<float, C> evaluate(float x, float y) const {
+		if (x >= lower.x && x < upper.x && y >= lower.y && y < upper.y) {
+			return evaluate<F, false>(x, y);
+		}
+		return evaluate<F, true>(x, y);
+	}
+	template<SampleFilter F, class O> void sample(const float2* coords, int count, O* out) const {
+		bool interior = true;
+		for (int n = 0; n < count; n++) {
+			const float2& pt = coords[n];
+			interior &= (pt.x >= lower.x && pt.x < upper.x && pt.y >= lower.y && pt.y < upper.y);
+		}
+		if (F == SampleFilter::Nearest) {
+			//Copies pixels without a round trip through float.
+			for (int n = 0; n < count; n++) {
+				float x = coords[n].x + 0.5f, y = coords[n].y + 0.5f;
+				if (interior) {
+					out[n] = O(fetch<false>((int) x, (int) y));
+				} else {
+					x = (x >= -SAMPLE_LIMIT) ? ((x <= SAMPLE_LIMIT) ? x : SAMPLE_LIMIT) : -SAMPLE_LIMIT;
+					y = (y >= -SAMPLE_LIMIT) ? ((y <= SAMPLE_LIMIT) ? y : SAMPLE_LIMIT) : -SAMPLE_LIMIT;
+					out[n] = O(fetch<true>(FloorToInt(x), FloorToInt(y)));
+				}
+			}
+		} else if (interior) {
+			if (F == SampleFilter::Bilinear && SampleBilinearInterior(data, width, coords, count, out)) {
+				return;
+			}
+			for (int n = 0; n < count; n++) {
+				StoreSample(out[n], evaluate<F, false>(coords[n].x, coords[n].y));
+			}
+		} else {
+			for (int n = 0; n < count; n++) {
+				StoreSample(out[n], evaluate<F>(coords[n].x, coords[n].y));
+			}
+		}
+	}
+public:
+	ImageSampler(const Image<T, C, I>& image, SampleFilter filter) :
+			data(image.data.data()), width(image.width), height(image.height), filter(filter) {
+		//Range of locations whose whole footprint is inside the image.
+		int taps = GetSampleTaps(filter);
+		float before = (filter == SampleFilter::Nearest) ? -0.5f : (float) (taps / 2 - 1);
+		float after = (filter == SampleFilter::Nearest) ? 0.5f : (float) (taps / 2);
+		lower = float2(before, before);
+		upper = float2(width - after, height - after);
+	}
+	inline vec<float, C> operator()(float x, float y) const {
+		switch (filter) {
+		case SampleFilter::Nearest:
+			return evaluate<SampleFilter::Nearest>(x, y);
+		case SampleFilter::Bicubic:
+			return evaluate<SampleFilter::Bicubic>(x, y);
+		case SampleFilter::Lanczos:
+			return evaluate<SampleFilter::Lanczos>(x, y);
+		default:
+			return evaluate<SampleFilter::Bilinear>(x, y);
+		}
+	}
+	template<class O> void sample(const float2* coords, int count, O* out) const {
+		switch (filter) {
+		case SampleFilter::Nearest:
+			sample<SampleFilter::Nearest>(coords, count, out);
+			break;
+		case SampleFilter::Bicubic:
+			sample<SampleFilter::Bicubic>(coords, count, out);
+			break;
+		case SampleFilter::Lanczos:
+			sample<SampleFilter::Lanczos>(coords, count, out);
+			break;
+		default:
+			sample<SampleFilter::Bilinear>(coords, count, out);
+			break;
+		}
+	}
+};
+template<class T, int C, ImageType I> class VolumeSampler {
+protected:
+	const vec<T, C>* data;
+	int rows, cols, slices;
+	SampleFilter filter;
+	float3 lower, upper;
+	template<bool Clamped> inline const vec<T, C>& fetch(int i, int j, int k) const {
+		if (Clamped) {
+			i = clamp(i, 0, rows - 1);
+			j = clamp(j, 0, cols - 1);
+			k = clamp(k, 0, slices - 1);
+		}
+		return data[i + (j + k * (size_t) cols) * (size_t) rows];
+	}
+	template<bool Clamped> inline vec<float, C> get(int i, int j, int k) const {
+		return vec<float, C>(fetch<Clamped>(i, j, k));
+	}
+	template<SampleFilter F, bool Clamped> inline vec<float, C> evaluate(float x, float y, float z) const {
+		if (Clamped) {
+			x = (x >= -SAMPLE_LIMIT) ? ((x <= SAMPLE_LIMIT) ? x : SAMPLE_LIMIT) : -SAMPLE_LIMIT;
+			y = (y >= -SAMPLE_LIMIT) ? ((y <= SAMPLE_LIMIT) ? y : SAMPLE_LIMIT) : -SAMPLE_LIMIT;
+			z = (z >= -SAMPLE_LIMIT) ? ((z <= SAMPLE_LIMIT) ? z : SAMPLE_LIMIT) : -SAMPLE_LIMIT;
+		}
+		if (F == SampleFilter::Nearest) {
+			return get<Clamped>(FloorToInt(x + 0.5f), FloorToInt(y + 0.5f), FloorToInt(z + 0.5f));
+		} else if (F == SampleFilter::Bilinear) {
+			int i = FloorToInt(x);
+			int j = FloorToInt(y);
+			int k = FloorToInt(z);
+			vec<float, C> rgb000 = get<Clamped>(i, j, k);
+			vec<float, C> rgb100 = get<Clamped>(i + 1, j, k);
+			vec<float, C> rgb110 = get<Clamped>(i + 1, j + 1, k);
+			vec<float, C> rgb010 = get<Clamped>(i, j + 1, k);
+			vec<float, C> rgb001 = get<Clamped>(i, j, k + 1);
+			vec<float, C> rgb101 = get<Clamped>(i + 1, j, k + 1);
+			vec<float, C> rgb111 = get<Clamped>(i + 1, j + 1, k + 1);
+			vec<float, C> rgb011 = get<Clamped>(i, j + 1, k + 1);
+			float dx = x - i;
+			float dy = y - j;
+			float dz = z - k;
+			vec<float, C> front = ((rgb000 * (1.0f - dx) + rgb100 * dx) * (1.0f - dy) + (rgb010 * (1.0f - dx) + rgb110 * dx) * dy);
+			vec<float, C> back = ((rgb001 * (1.0f - dx) + rgb101 * dx) * (1.0f - dy) + (rgb011 * (1.0f - dx) + rgb111 * dx) * dy);
+			return (1.0f - dz) * front + dz * back;
+		} else {
+			SampleWeights<F> wx(x), wy(y), wz(z);
+			vec<float, C> sum(0.0f);
+			for (int c = 0; c < SampleWeights<F>::TAPS; c++) {
+				vec<float, C> slice(0.0f);
+				for (int b = 0; b < SampleWeights<F>::TAPS; b++) {
+					vec<float, C> row(0.0f);
+					for (int a = 0; a < SampleWeights<F>::TAPS; a++) {
+						row += wx.w[a] * get<Clamped>(wx.start + a, wy.start + b, wz.start + c);
+					}
+					slice += wy.w[b] * row;
+				}
+				sum += wz.w[c] * slice;
+			}
+			return sum;
+		}
+	}
+	template<SampleFilter F> inline vec<float, C> evaluate(float x, float y, float z) const {
+		if (x >= lower.x && x < upper.x && y >= lower.y && y < upper.y && z >= lower.z && z < upper.z) {
+			return evaluate<F, false>(x, y, z);
+		}
+		return evaluate<F, true>(x, y, z);
+	}
+	template<SampleFilter F, class O> void sample(const float3* coords, int count, O* out) const {
+		bool interior = true;
+		for (int n = 0; n < count; n++) {
+			const float3& pt = coords[n];
+			interior &= (pt.x >= lower.x && pt.x < upper.x && pt.y >= lower.y && pt.y < upper.y && pt.z >= lower.z && pt.z < upper.z);
+		}
+		if (F == SampleFilter::Nearest) {
+			for (int n = 0; n < count; n++) {
+				float x = coords[n].x + 0.5f, y = coords[n].y + 0.5f, z = coords[n].z + 0.5f;
+				if (interior) {
+					out[n] = O(fetch<false>((int) x, (int) y, (int) z));
+				} else {
+					x = (x >= -SAMPLE_LIMIT) ? ((x <= SAMPLE_LIMIT) ? x : SAMPLE_LIMIT) : -SAMPLE_LIMIT;
+					y = (y >= -SAMPLE_LIMIT) ? ((y <= SAMPLE_LIMIT) ? y : SAMPLE_LIMIT) : -SAMPLE_LIMIT;
+					z = (z >= -SAMPLE_LIMIT) ? ((z <= SAMPLE_LIMIT) ? z : SAMPLE_LIMIT) : -SAMPLE_LIMIT;
+					out[n] = O(fetch<true>(FloorToInt(x), FloorToInt(y), FloorToInt(z)));
+				}
+			}
+		} else if (interior) {
+			for (int n = 0; n < count; n++) {
+				StoreSample(out[n], evaluate<F, false>(coords[n].x, coords[n].y, coords[n].z));
+			}
+		} else {
+			for (int n = 0; n < count; n++) {
+				StoreSample(out[n], evaluate<F>(coords[n].x, coords[n].y, coords[n].z));
+			}
+		}
+	}
+public:
+	VolumeSampler(const Volume<T, C, I>& volume, SampleFilter filter) :
+			data(volume.data.data()), rows(volume.rows), cols(volume.cols), slices(volume.slices), filter(filter) {
+		int taps = GetSampleTaps(filter);
+		float before = (filter == SampleFilter::Nearest) ? -0.5f : (float) (taps / 2 - 1);
+		float after = (filter == SampleFilter::Nearest) ? 0.5f : (float) (taps / 2);
+		lower = float3(before, before, before);
+		upper = float3(rows - after, cols - after, slices - after);
+	}
+	inline vec<float, C> operator()(float x, float y, float z) const {
+		switch (filter) {
+		case SampleFilter::Nearest:
+			return evaluate<SampleFilter::Nearest>(x, y, z);
+		case SampleFilter::Bicubic:
+			return evaluate<SampleFilter::Bicubic>(x, y, z);
+		case SampleFilter::Lanczos:
+			return evaluate<SampleFilter::Lanczos>(x, y, z);
+		default:
+			return evaluate<SampleFilter::Bilinear>(x, y, z);
+		}
+	}
+	template<class O> void sample(const float3* coords, int count, O* out) const {
+		switch (filter) {
+		case SampleFilter::Nearest:
+			sample<SampleFilter::Nearest>(coords, count, out);
+			break;
+		case SampleFilter::Bicubic:
+			sample<SampleFilter::Bicubic>(coords, count, out);
+			break;
+		case SampleFilter::Lanczos:
+			sample<SampleFilter::Lanczos>(coords, count, out);
+			break;
+		default:
+			sample<SampleFilter::Bilinear>(coords, count, out);
+			break;
+		}
+	}
+};
+static const int RESAMPLE_SPAN = 64;
+/*
+ * Fills out by sampling in at the location map(i,j) of every output pixel.
+ * Rows are processed in parallel, coordinates are generated a span at a time
+ * with map.fill(j,i0,count,coords).
+ */
+template<class T, int C, ImageType I, class M> void Resample(const Image<T, C, I>& in, Image<T, C, I>& out, const M& map,
+		SampleFilter filter) {
+	if (in.size() == 0) {
+		throw std::runtime_error("Cannot resample an empty image.");
+	}
+	ImageSampler<T, C, I> sampler(in, filter);
+	const int width = out.width;
+	ParallelFor(0, (size_t) out.height, [&](size_t j) {
+		float2 coords[RESAMPLE_SPAN];
+		vec<T, C>* row = &out.data[j * (size_t) width];
+		for (int i = 0; i < width; i += RESAMPLE_SPAN) {
+			int count = std::min(RESAMPLE_SPAN, width - i);
+			map.fill((int) j, i, count, coords);
+			sampler.sample(coords, count, row + i);
+		}
+	}, 4);
+}
+template<class T, int C, ImageType I, class M> void Resample(const Volume<T, C, I>& in, Volume<T, C, I>& out, const M& map,
+		SampleFilter filter) {
+	if (in.size() == 0) {
+		throw std::runtime_error("Cannot resample an empty volume.");
+	}
+	VolumeSampler<T, C, I> sampler(in, filter);
+	const int rows = out.rows;
+	ParallelFor(0, (size_t) out.cols * (size_t) out.slices, [&](size_t jk) {
+		float3 coords[RESAMPLE_SPAN];
+		vec<T, C>* row = &out.data[jk * (size_t) rows];
+		int j = (int) (jk % out.cols);
+		int k = (int) (jk / out.cols);
+		for (int i = 0; i < rows; i += RESAMPLE_SPAN) {
+			int count = std::min(RESAMPLE_SPAN, rows - i);
+			map.fill(j, k, i, count, coords);
+			sampler.sample(coords, count, row + i);
+		}
+	}, 4);
+}
+struct CoordinateMap {
+	const Image2f& coords;
+	CoordinateMap(const Image2f& coords) :
+			coords(coords) {
+	}
+	void fill(int j, int i, int count, float2* out) const {
+		const float2* src = &coords.data[i + j * (size_t) coords.width];
+		std::copy(src, src + count, out);
+	}
+};
+struct VolumeCoordinateMap {
+	const Volume3f& coords;
+	VolumeCoordinateMap(const Volume3f& coords) :
+			coords(coords) {
+	}
+	void fill(int j, int k, int i, int count, float3* out) const {
+		const float3* src = &coords.data[i + (j + k * (size_t) coords.cols) * (size_t) coords.rows];
+		std::copy(src, src + count, out);
+	}
+};
+//H maps homogeneous output pixel coordinates to input pixel coordinates. Affine maps skip the divide.
+struct HomographyMap {
+	float3x3 H;
+	bool affine;
+	HomographyMap(const float3x3& H) :
+			H(H), affine(H.x.z == 0.0f && H.y.z == 0.0f && H.z.z == 1.0f) {
+	}
+	void fill(int j, int i, int count, float2* out) const {
+		float3 base = H.y * (float) j + H.z;
+		for (int n = 0; n < count; n++) {
+			float3 p = H.x * (float) (i + n) + base;
+			out[n] = (affine) ? p.xy() : p.xy() / p.z;
+		}
+	}
+};
+struct AffineVolumeMap {
+	float4x4 M;
+	AffineVolumeMap(const float4x4& M) :
+			M(M) {
+	}
+	void fill(int j, int k, int i, int count, float3* out) const {
+		float4 base = M.y * (float) j + M.z * (float) k + M.w;
+		for (int n = 0; n < count; n++) {
+			float4 p = M.x * (float) (i + n) + base;
+			out[n] = p.xyz();
+		}
+	}
+};
+struct LensMap {
+	const LensDistortion& lens;
+	LensMap(const LensDistortion& lens) :
+			lens(lens) {
+	}
+	void fill(int j, int i, int count, float2* out) const {
+		for (int n = 0; n < count; n++) {
+			out[n] = lens(i + n, j);
+		}
+	}
+};
+//Resamples in at the locations stored in coords, out has the dimensions of coords.
+template<class T, int C, ImageType I> void Remap(const Image<T, C, I>& in, Image<T, C, I>& out, const Image2f& coords,
+		SampleFilter filter = SampleFilter::Bilinear) {
+	out.resize(coords.width, coords.height);
+	Resample(in, out, CoordinateMap(coords), filter);
+}
+template<class T, int C, ImageType I> void Remap(const Volume<T, C, I>& in, Volume<T, C, I>& out, const Volume3f& coords,
+		SampleFilter filter = SampleFilter::Bilinear) {
+	out.resize(coords.rows, coords.cols, coords.slices);
+	Resample(in, out, VolumeCoordinateMap(coords), filter);
+}
+//Projective warp, H maps output pixels to input pixels.
+template<class T, int C, ImageType I> void Warp(const Image<T, C, I>& in, Image<T, C, I>& out, const float3x3& H, int width, int height,
+		SampleFilter filter = SampleFilter::Bilinear) {
+	out.resize(width, height);
+	Resample(in, out, HomographyMap(H), filter);
+}
+//Affine warp, M maps output voxels to input voxels.
+template<class T, int C, ImageType I> void Warp(const Volume<T, C, I>& in, Volume<T, C, I>& out, const float4x4& M, int rows, int cols,
+		int slices, SampleFilter filter = SampleFilter::Bilinear) {
+	out.resize(rows, cols, slices);
+	Resample(in, out, AffineVolumeMap(M), filter);
+}
+//Removes lens distortion, out has the dimensions of in.
+template<class T, int C, ImageType I> void Warp(const Image<T, C, I>& in, Image<T, C, I>& out, const LensDistortion& lens,
+		SampleFilter filter = SampleFilter::Bilinear) {
+	out.resize(in.width, in.height);
+	Resample(in, out, LensMap(lens), filter);
+}
+//Evaluates in at a list of points, for example particles being advected through a field.
+template<class T, int C, ImageType I> void Sample(const Image<T, C, I>& in, const std::vector<float2>& points,
+		std::vector<vec<float, C>>& values, SampleFilter filter = SampleFilter::Bilinear) {
+	ImageSampler<T, C, I> sampler(in, filter);
+	values.resize(points.size());
+	ParallelForRange(0, points.size(), [&](size_t b, size_t e) {
+		for (size_t n = b; n < e; n += RESAMPLE_SPAN) {
+			sampler.sample(&points[n], (int) std::min((size_t) RESAMPLE_SPAN, e - n), &values[n]);
+		}
+	}, 16 * RESAMPLE_SPAN);
+}
+template<class T, int C, ImageType I> void Sample(const Volume<T, C, I>& in, const std::vector<float3>& points,
+		std::vector<vec<float, C>>& values, SampleFilter filter = SampleFilter::Bilinear) {
+	VolumeSampler<T, C, I> sampler(in, filter);
+	values.resize(points.size());
+	ParallelForRange(0, points.size(), [&](size_t b, size_t e) {
+		for (size_t n = b; n < e; n += RESAMPLE_SPAN) {
+			sampler.sample(&points[n], (int) std::min((size_t) RESAMPLE_SPAN, e - n), &values[n]);
+		}
+	}, 16 * RESAMPLE_SPAN);
+}
+}
+#endif /* INCLUDE_CORE_ALLOYRESAMPLE_H_ */
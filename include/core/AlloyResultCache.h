@@ -0,0 +1,190 @@
+/*
+ * Copyright(C) 2018, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef INCLUDE_CORE_ALLOYRESULTCACHE_H_
+#define INCLUDE_CORE_ALLOYRESULTCACHE_H_
+#include "AlloyImage.h"
+#include "AlloyVolume.h"
+#include "AlloyHash.h"
+#include "cereal/archives/binary.hpp"
+#include "cereal/types/string.hpp"
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <typeinfo>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+namespace aly {
+	bool SANITY_CHECK_RESULT_CACHE();
+	template<class T> size_t CacheByteSize(const T& value) {
+		return sizeof(T) + value.data.size() * sizeof(value.data[0]);
+	}
+	/*
+	 * Identifies image/volume content independent of its id and hashCode
+	 * members, which are not required to be up to date.
+	 */
+	template<class T, int C, ImageType I> std::string ContentKey(const Image<T, C, I>& img) {
+		return MakeString() << img.width << "x" << img.height << "x" << C << ":"
+				<< (int) I << ":" << HashCode(img.data, HashMethod::FAST128);
+	}
+	template<class T, int C, ImageType I> std::string ContentKey(const Volume<T, C, I>& vol) {
+		return MakeString() << vol.rows << "x" << vol.cols << "x" << vol.slices << "x" << C << ":"
+				<< (int) I << ":" << HashCode(vol.data, HashMethod::FAST128);
+	}
+	/*
+	 * Cache key for an operator applied to content with a list of parameters.
+	 * Parameters are written with enough precision to round-trip floats.
+	 */
+	template<class... Params> std::string MakeCacheKey(const std::string& op,
+			const std::string& content, const Params&... params) {
+		std::stringstream ss;
+		ss << std::setprecision(17) << content;
+		int expand[] = { 0, ((ss << ";" << params), 0)... };
+		(void) expand;
+		std::string str = ss.str();
+		return op + "_" + HashCode(str.data(), str.size(), HashMethod::FAST128);
+	}
+	/*
+	 * Operator result cache with an in-memory LRU tier bounded by a byte budget
+	 * and an optional write-through disk tier of cereal binary archives. Values
+	 * are copied in and out, so cached results are never aliased by callers.
+	 */
+	class ResultCache {
+	protected:
+		struct Entry {
+			std::string key;
+			std::string type;
+			std::shared_ptr<void> value;
+			size_t bytes;
+		};
+		std::list<Entry> entries; //Most recently used first.
+		std::map<std::string, std::list<Entry>::iterator> index;
+		size_t byteBudget;
+		size_t bytesUsed;
+		std::string diskDirectory;
+		uint64_t memoryHits;
+		uint64_t diskHits;
+		uint64_t misses;
+		std::mutex lock;
+		//find() and insert() expect the caller to hold the lock.
+		std::shared_ptr<void> find(const std::string& key, const std::string& type);
+		void insert(const std::string& key, const std::string& type,
+				const std::shared_ptr<void>& value, size_t bytes);
+		void evict();
+		std::string getDiskFile(const std::string& key) const;
+	public:
+		ResultCache(size_t byteBudget = ((size_t) 512 << 20), const std::string& diskDirectory = "");
+		void setByteBudget(size_t bytes);
+		//Empty string disables the disk tier.
+		void setDiskDirectory(const std::string& dir);
+		size_t getByteBudget() const {
+			return byteBudget;
+		}
+		size_t getBytesUsed() const {
+			return bytesUsed;
+		}
+		const std::string& getDiskDirectory() const {
+			return diskDirectory;
+		}
+		uint64_t getMemoryHits() const {
+			return memoryHits;
+		}
+		uint64_t getDiskHits() const {
+			return diskHits;
+		}
+		uint64_t getMisses() const {
+			return misses;
+		}
+		size_t size() const {
+			return entries.size();
+		}
+		//Clears the memory tier. Files on disk are left in place.
+		void clear();
+		/*
+		 * The cache lock is held for disk reads and writes too, so concurrent callers never see a
+		 * partially written archive. Archives start with the type name and only load as that type.
+		 */
+		template<class T> bool get(const std::string& key, T& out) {
+			std::string type = typeid(T).name();
+			std::lock_guard<std::mutex> guard(lock);
+			std::shared_ptr<void> value = find(key, type);
+			if (value.get() != nullptr) {
+				out = *std::static_pointer_cast<T>(value);
+				return true;
+			}
+			std::string file = getDiskFile(key);
+			if (file.size() > 0 && FileExists(file)) {
+				try {
+					std::shared_ptr<T> loaded(new T());
+					std::string fileType;
+					{
+						std::ifstream is(file, std::ios::binary);
+						cereal::BinaryInputArchive archive(is);
+						archive(fileType);
+						if (fileType == type) {
+							archive(*loaded);
+						}
+					}
+					if (fileType == type) {
+						out = *loaded;
+						insert(key, type, loaded, CacheByteSize(*loaded));
+						diskHits++;
+						return true;
+					}
+				} catch (std::exception& e) {
+					std::cerr << "Could not read cached result " << file << ": " << e.what() << std::endl;
+				}
+			}
+			misses++;
+			return false;
+		}
+		template<class T> void put(const std::string& key, const T& value) {
+			std::string type = typeid(T).name();
+			std::shared_ptr<T> copy(new T(value));
+			std::lock_guard<std::mutex> guard(lock);
+			insert(key, type, copy, CacheByteSize(value));
+			std::string file = getDiskFile(key);
+			if (file.size() > 0) {
+				std::ofstream os(file, std::ios::binary);
+				if (os.is_open()) {
+					cereal::BinaryOutputArchive archive(os);
+					archive(type);
+					archive(*copy);
+				}
+			}
+		}
+		/*
+		 * Fills out from the cache, or calls func(out) and stores the result.
+		 * Returns true on a cache hit.
+		 */
+		template<class T, class F> bool compute(const std::string& key, T& out, const F& func) {
+			if (get(key, out)) {
+				return true;
+			}
+			func(out);
+			put(key, out);
+			return false;
+		}
+	};
+}
+#endif /* INCLUDE_CORE_ALLOYRESULTCACHE_H_ */
@@ -0,0 +1,323 @@
+/*
+ * Copyright(C) 2018, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef INCLUDE_CORE_ALLOYSCHEDULER_H_
+#define INCLUDE_CORE_ALLOYSCHEDULER_H_
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+namespace aly {
+bool SANITY_CHECK_SCHEDULER();
+enum class TaskPriority {
+	Low = 0, Normal = 1, High = 2
+};
+/*
+ * Shared flag for cooperative cancellation. Copies refer to the same flag, so
+ * a task can poll the token it was given while any other thread cancels it.
+ */
+class CancelToken {
+protected:
+	std::shared_ptr<std::atomic<bool>> flag;
+public:
+	CancelToken() :
+			flag(std::make_shared<std::atomic<bool>>(false)) {
+	}
+	void cancel() {
+		*flag = true;
+	}
+	void reset() {
+		*flag = false;
+	}
+	bool isCanceled() const {
+		return *flag;
+	}
+};
+/*
+ * Process-wide pool of worker threads. Every worker owns a deque per priority.
+ * Jobs submitted from a worker go to its own deque and are popped newest
+ * first, idle workers steal the oldest job from other workers, and jobs
+ * submitted from other threads go to a shared queue. Higher priorities are
+ * always drained first. Delayed jobs are held by a single timer thread until
+ * they are due, so sleeping tasks do not occupy a worker.
+ */
+class TaskScheduler {
+public:
+	typedef std::function<void()> Job;
+	static const int PRIORITIES = 3;
+protected:
+	struct Worker {
+		std::mutex lock;
+		std::deque<Job> queue[PRIORITIES];
+	};
+	typedef std::chrono::steady_clock Clock;
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::vector<std::thread> threads;
+	Worker shared;
+	std::mutex waitLock;
+	std::condition_variable workAvailable;
+	std::atomic<int> queued;
+	std::atomic<bool> running;
+	std::thread timerThread;
+	std::mutex timerLock;
+	std::condition_variable timerChanged;
+	std::map<std::pair<Clock::time_point, uint64_t>, std::pair<Job, TaskPriority>> timers;
+	std::map<uint64_t, Clock::time_point> timerTimes;
+	uint64_t timerCounter = 0;
+	int getWorkerIndex() const;
+	bool pop(int worker, Job& job);
+	void run(int worker);
+	void runTimers();
+public:
+	/*
+	 * Uses at least four workers even on small machines so that a few long
+	 * blocking jobs cannot starve the rest of the queue.
+	 */
+	TaskScheduler(int threadCount = 0);
+	~TaskScheduler();
+	int getThreadCount() const {
+		return (int) threads.size();
+	}
+	bool isWorkerThread() const {
+		return (getWorkerIndex() >= 0);
+	}
+	void submit(const Job& job, TaskPriority priority = TaskPriority::Normal);
+	//Queues job after the delay. Returns an id that can be passed to unschedule().
+	uint64_t schedule(const Job& job, long milliseconds, TaskPriority priority = TaskPriority::Normal);
+	//Removes a delayed job, returns false if it was already handed to the workers.
+	bool unschedule(uint64_t id);
+	//Runs one queued job on the calling worker thread. Waiting workers call this so nested waits keep the pool busy.
+	bool runPending();
+};
+TaskScheduler& AlloyDefaultScheduler();
+/*
+ * Set of jobs that can be waited on and canceled together. Jobs that have not
+ * started when the group is canceled are skipped. The first exception thrown
+ * by a job is rethrown by wait().
+ */
+class TaskGroup {
+protected:
+	struct State {
+		std::mutex lock;
+		std::condition_variable finished;
+		int pending = 0;
+		std::exception_ptr error;
+	};
+	TaskScheduler& scheduler;
+	TaskPriority priority;
+	CancelToken token;
+	std::shared_ptr<State> state;
+public:
+	TaskGroup(TaskPriority priority = TaskPriority::Normal, TaskScheduler& scheduler = AlloyDefaultScheduler());
+	TaskGroup(const CancelToken& token, TaskPriority priority = TaskPriority::Normal, TaskScheduler& scheduler =
+			AlloyDefaultScheduler());
+	void run(const std::function<void()>& func);
+	void wait();
+	void cancel() {
+		token.cancel();
+	}
+	bool isCanceled() const {
+		return token.isCanceled();
+	}
+	const CancelToken& getCancelToken() const {
+		return token;
+	}
+	~TaskGroup();
+};
+class TaskCanceledException: public std::runtime_error {
+public:
+	TaskCanceledException() :
+			std::runtime_error("Task was canceled before it started.") {
+	}
+};
+//Blocks until ready() holds, lock guards the predicate. Worker threads run queued jobs while they wait.
+void WaitForCondition(const std::function<bool()>& ready, std::mutex& lock, std::condition_variable& changed, TaskScheduler& scheduler =
+		AlloyDefaultScheduler());
+template<class T> struct FutureState {
+	std::mutex lock;
+	std::condition_variable changed;
+	bool ready = false;
+	std::exception_ptr error;
+	std::vector<std::function<void()>> continuations;
+	T value;
+	T& result() {
+		return value;
+	}
+	template<class F> void invoke(F& func) {
+		value = func();
+	}
+};
+template<> struct FutureState<void> {
+	std::mutex lock;
+	std::condition_variable changed;
+	bool ready = false;
+	std::exception_ptr error;
+	std::vector<std::function<void()>> continuations;
+	void result() {
+	}
+	template<class F> void invoke(F& func) {
+		func();
+	}
+};
+//Marks the state ready, wakes waiting threads and launches continuations.
+template<class T> void CompleteFuture(const std::shared_ptr<FutureState<T>>& state) {
+	std::vector<std::function<void()>> continuations;
+	{
+		std::lock_guard<std::mutex> lockGuard(state->lock);
+		state->ready = true;
+		continuations.swap(state->continuations);
+		state->changed.notify_all();
+	}
+	for (std::function<void()>& continuation : continuations) {
+		continuation();
+	}
+}
+/*
+ * Result of a job run by Async(). get() blocks until the job has finished and
+ * rethrows its exception. then() runs a continuation on the scheduler with
+ * the finished future once this one is ready.
+ */
+template<class T> class Future {
+protected:
+	std::shared_ptr<FutureState<T>> state;
+public:
+	Future() {
+	}
+	Future(const std::shared_ptr<FutureState<T>>& state) :
+			state(state) {
+	}
+	bool isValid() const {
+		return (state.get() != nullptr);
+	}
+	bool isReady() const {
+		std::lock_guard<std::mutex> lockGuard(state->lock);
+		return state->ready;
+	}
+	void wait() const {
+		std::shared_ptr<FutureState<T>> s = state;
+		WaitForCondition([s] {return s->ready;}, s->lock, s->changed);
+	}
+	auto get() const -> decltype(state->result()) {
+		wait();
+		if (state->error) {
+			std::rethrow_exception(state->error);
+		}
+		return state->result();
+	}
+	template<class F> auto then(F func, TaskPriority priority = TaskPriority::Normal) const -> Future<decltype(func(std::declval<Future<T>>()))>;
+};
+template<class F> auto Async(F func, TaskPriority priority = TaskPriority::Normal, const CancelToken& token = CancelToken()) -> Future<decltype(func())> {
+	typedef decltype(func()) R;
+	std::shared_ptr<FutureState<R>> state = std::make_shared<FutureState<R>>();
+	AlloyDefaultScheduler().submit([state, func, token]() mutable {
+		try {
+			if (token.isCanceled()) {
+				throw TaskCanceledException();
+			}
+			state->invoke(func);
+		} catch (...) {
+			state->error = std::current_exception();
+		}
+		CompleteFuture(state);
+	}, priority);
+	return Future<R>(state);
+}
+template<class T> template<class F> auto Future<T>::then(F func, TaskPriority priority) const -> Future<decltype(func(std::declval<Future<T>>()))> {
+	typedef decltype(func(std::declval<Future<T>>())) R;
+	std::shared_ptr<FutureState<R>> next = std::make_shared<FutureState<R>>();
+	Future<T> self = *this;
+	std::function<void()> continuation = [next, self, func, priority]() {
+		AlloyDefaultScheduler().submit([next, self, func]() mutable {
+			try {
+				auto call = [&func, &self]() {return func(self);};
+				next->invoke(call);
+			} catch (...) {
+				next->error = std::current_exception();
+			}
+			CompleteFuture(next);
+		}, priority);
+	};
+	bool ready;
+	{
+		std::lock_guard<std::mutex> lockGuard(state->lock);
+		ready = state->ready;
+		if (!ready) {
+			state->continuations.push_back(continuation);
+		}
+	}
+	if (ready) {
+		continuation();
+	}
+	return Future<R>(next);
+}
+/*
+ * Splits [begin,end) into chunks of grainSize indexes and calls
+ * func(chunkBegin,chunkEnd) for each chunk on the scheduler. The calling
+ * thread works on chunks too and returns once all of them are done. A grain
+ * size of zero picks about eight chunks per worker.
+ */
+void ParallelForRange(size_t begin, size_t end, const std::function<void(size_t begin, size_t end)>& func, size_t grainSize = 0,
+		TaskPriority priority = TaskPriority::Normal);
+template<class F> void ParallelFor(size_t begin, size_t end, F func, size_t grainSize = 0, TaskPriority priority = TaskPriority::Normal) {
+	ParallelForRange(begin, end, [&func](size_t b, size_t e) {
+		for (size_t i = b; i < e; i++) {
+			func(i);
+		}
+	}, grainSize, priority);
+}
+/*
+ * Reduces [begin,end) with func(chunkBegin,chunkEnd,identity) per chunk and
+ * merges the partial results with combine in chunk order, so the result does
+ * not depend on how chunks were scheduled.
+ */
+template<class T, class F, class C> T ParallelReduce(size_t begin, size_t end, const T& identity, F func, C combine, size_t grainSize = 0,
+		TaskPriority priority = TaskPriority::Normal) {
+	if (end <= begin) {
+		return identity;
+	}
+	if (grainSize == 0) {
+		grainSize = std::max((size_t) 1, (end - begin) / (8 * (size_t) AlloyDefaultScheduler().getThreadCount()));
+	}
+	size_t chunks = (end - begin + grainSize - 1) / grainSize;
+	std::vector<T> partial(chunks, identity);
+	ParallelForRange(0, chunks, [&](size_t b, size_t e) {
+		for (size_t c = b; c < e; c++) {
+			size_t first = begin + c * grainSize;
+			partial[c] = func(first, std::min(end, first + grainSize), identity);
+		}
+	}, 1, priority);
+	T result = partial[0];
+	for (size_t c = 1; c < chunks; c++) {
+		result = combine(result, partial[c]);
+	}
+	return result;
+}
+}
+#endif /* INCLUDE_CORE_ALLOYSCHEDULER_H_ */
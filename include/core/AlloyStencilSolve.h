@@ -0,0 +1,376 @@
+/*
+ * Copyright(C) 2018, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef INCLUDE_CORE_ALLOYSTENCILSOLVE_H_
+#define INCLUDE_CORE_ALLOYSTENCILSOLVE_H_
+#include "AlloyMath.h"
+#include "AlloyVector.h"
+#include <vector>
+#include <functional>
+namespace aly {
+bool SANITY_CHECK_STENCIL_SOLVE();
+/*
+ * Matrix-free linear system on a regular image or volume grid with a 5 point
+ * (2D) or 7 point (3D) stencil. Cells are stored x fastest, then y, then z,
+ * matching the layout of Image and Volume, and dimensions.z is 1 for images.
+ * Neighbors outside the grid are omitted from the stencil.
+ *
+ * Off-diagonal coefficients are either a uniform weight, optionally scaled by
+ * a per-cell coupling, or given explicitly per cell in offDiagonal with 4 (2D)
+ * or 6 (3D) entries ordered by column: -z, -y, -x, +x, +y, +z.
+ */
+template<class T, int C> struct StencilSystem {
+	int3 dimensions;
+	std::vector<vec<T, C>> diagonal;
+	vec<T, C> weight;
+	std::vector<T> coupling;
+	std::vector<vec<T, C>> offDiagonal;
+	StencilSystem() :
+			dimensions(0, 0, 0), weight(T(0)) {
+	}
+	void resize(int width, int height, int depth = 1) {
+		dimensions = int3(width, height, depth);
+		diagonal.resize(size());
+	}
+	size_t size() const {
+		return (size_t) dimensions.x * (size_t) dimensions.y
+				* (size_t) dimensions.z;
+	}
+	int stencilSize() const {
+		return (dimensions.z > 1) ? 6 : 4;
+	}
+	int rows() const {
+		return dimensions.y * dimensions.z;
+	}
+	//Grid rows per tile, fixed by the grid so reductions do not depend on the thread count.
+	int tileRows() const {
+		return std::max(1, std::min(rows(), 16384 / std::max(1, dimensions.x)));
+	}
+	int tiles() const {
+		int R = tileRows();
+		return (rows() + R - 1) / R;
+	}
+	/*
+	 * Row idx of A*v for the cell at (i,j,k). Values of v are fetched through
+	 * value(index), so callers can derive v on the fly from other buffers.
+	 */
+	template<class F> vec<T, C> multiply(size_t idx, int i, int j, int k,
+			const F& value) const {
+		const int W = dimensions.x;
+		const size_t slice = (size_t) W * dimensions.y;
+		const bool explicitWeights = offDiagonal.size() > 0;
+		const int S = stencilSize();
+		vec<T, C> w = weight;
+		if (!explicitWeights && coupling.size() > 0) {
+			w = weight * coupling[idx];
+		}
+		const vec<T, C>* coeff =
+				explicitWeights ? &offDiagonal[idx * S] : nullptr;
+		int d = 0;
+		vec<double, C> sum(0.0);
+		if (S == 6) {
+			if (k > 0)
+				sum += vec<double, C>(value(idx - slice))
+						* vec<double, C>(explicitWeights ? coeff[d] : w);
+			d++;
+		}
+		if (j > 0)
+			sum += vec<double, C>(value(idx - W))
+					* vec<double, C>(explicitWeights ? coeff[d] : w);
+		d++;
+		if (i > 0)
+			sum += vec<double, C>(value(idx - 1))
+					* vec<double, C>(explicitWeights ? coeff[d] : w);
+		d++;
+		sum += vec<double, C>(value(idx)) * vec<double, C>(diagonal[idx]);
+		if (i < W - 1)
+			sum += vec<double, C>(value(idx + 1))
+					* vec<double, C>(explicitWeights ? coeff[d] : w);
+		d++;
+		if (j < dimensions.y - 1)
+			sum += vec<double, C>(value(idx + W))
+					* vec<double, C>(explicitWeights ? coeff[d] : w);
+		d++;
+		if (S == 6 && k < dimensions.z - 1)
+			sum += vec<double, C>(value(idx + slice))
+					* vec<double, C>(explicitWeights ? coeff[d] : w);
+		return vec<T, C>(sum);
+	}
+	/*
+	 * Runs f(idx,i,j,k) over all cells of a tile, a contiguous block of grid
+	 * rows that stays in cache while its neighbors are read.
+	 */
+	template<class F> void forEach(int tile, const F& f) const {
+		const int R = tileRows();
+		const int W = dimensions.x;
+		int rowEnd = std::min(rows(), (tile + 1) * R);
+		for (int row = tile * R; row < rowEnd; row++) {
+			int j = row % dimensions.y;
+			int k = row / dimensions.y;
+			size_t idx = (size_t) row * W;
+			for (int i = 0; i < W; i++, idx++) {
+				f(idx, i, j, k);
+			}
+		}
+	}
+	void multiply(std::vector<vec<T, C>>& out,
+			const std::vector<vec<T, C>>& v) const {
+		out.resize(size());
+		const int TN = tiles();
+#pragma omp parallel for schedule(dynamic)
+		for (int t = 0; t < TN; t++) {
+			forEach(t, [&](size_t idx, int i, int j, int k) {
+				out[idx] = multiply(idx, i, j, k, [&](size_t n) {
+							return v[n];
+						});
+			});
+		}
+	}
+};
+namespace detail {
+template<int C> double SumTiles(const std::vector<vec<double, C>>& partial,
+		vec<double, C>& total) {
+	total = vec<double, C>(0.0);
+	for (const vec<double, C>& val : partial) {
+		total += val;
+	}
+	return lengthL1(total);
+}
+}
+/*
+ * Conjugate gradient on a stencil system. Each iteration makes two passes over
+ * the grid: the first updates the search direction and applies the stencil to
+ * it in the same tile, recomputing the one cell halo of updated directions
+ * from the residual instead of waiting for a separate pass, and the second
+ * updates the solution and residual. Reductions are summed per tile in a
+ * fixed order, so results do not depend on the thread count.
+ *
+ * Stops once the residual norm drops below tolerance times the norm of b, or
+ * when the monitor returns false. The monitor receives the mean squared
+ * residual like SolveVecCG. Returns the number of iterations performed.
+ */
+template<class T, int C> int SolveStencilCG(const StencilSystem<T, C>& A,
+		const std::vector<vec<T, C>>& b, std::vector<vec<T, C>>& x,
+		int iters = 100, T tolerance = 1E-6f,
+		const std::function<bool(int, double)>& iterationMonitor = nullptr) {
+	const double ZERO_TOLERANCE = 1E-16;
+	const size_t N = A.size();
+	const int TN = A.tiles();
+	if (b.size() != N)
+		throw std::runtime_error(
+				MakeString() << "Stencil dimensions do not match. " << N
+						<< "!=" << b.size());
+	x.resize(N);
+	std::vector<vec<T, C>> r(N), Ap(N), p(N), pnext(N);
+	std::vector<vec<double, C>> partial1(TN), partial2(TN);
+#pragma omp parallel for schedule(dynamic)
+	for (int t = 0; t < TN; t++) {
+		vec<double, C> rsum(0.0), bsum(0.0);
+		A.forEach(t, [&](size_t idx, int i, int j, int k) {
+			vec<T, C> res = b[idx] - A.multiply(idx, i, j, k, [&](size_t n) {
+						return x[n];
+					});
+			r[idx] = res;
+			rsum += vec<double, C>(res) * vec<double, C>(res);
+			bsum += vec<double, C>(b[idx]) * vec<double, C>(b[idx]);
+		});
+		partial1[t] = rsum;
+		partial2[t] = bsum;
+	}
+	vec<double, C> rr, bb;
+	double e = detail::SumTiles(partial1, rr) / N;
+	const double stopErr = (double) tolerance * (double) tolerance
+			* detail::SumTiles(partial2, bb);
+	if (iterationMonitor) {
+		if (!iterationMonitor(0, e))
+			return 0;
+	}
+	if (lengthL1(rr) <= stopErr)
+		return 0;
+	vec<T, C> beta(T(0));
+	bool update = false;
+	int iter = 0;
+	for (; iter < iters; iter++) {
+		//Search direction update fused with the stencil product.
+#pragma omp parallel for schedule(dynamic)
+		for (int t = 0; t < TN; t++) {
+			vec<double, C> sum(0.0);
+			auto direction = [&](size_t n) {
+				return update ? vec<T, C>(r[n] + beta * p[n]) : r[n];
+			};
+			A.forEach(t, [&](size_t idx, int i, int j, int k) {
+				vec<T, C> pval = direction(idx);
+				vec<T, C> val = A.multiply(idx, i, j, k, direction);
+				pnext[idx] = pval;
+				Ap[idx] = val;
+				sum += vec<double, C>(pval) * vec<double, C>(val);
+			});
+			partial1[t] = sum;
+		}
+		p.swap(pnext);
+		vec<double, C> denom;
+		detail::SumTiles(partial1, denom);
+		for (int c = 0; c < C; c++) {
+			if (std::abs(denom[c]) < ZERO_TOLERANCE) {
+				denom[c] = (denom[c] < 0) ? -ZERO_TOLERANCE : ZERO_TOLERANCE;
+			}
+		}
+		vec<T, C> alpha = vec<T, C>(rr / denom);
+#pragma omp parallel for schedule(dynamic)
+		for (int t = 0; t < TN; t++) {
+			vec<double, C> sum(0.0);
+			A.forEach(t, [&](size_t idx, int, int, int) {
+				x[idx] += alpha * p[idx];
+				vec<T, C> res = r[idx] - alpha * Ap[idx];
+				r[idx] = res;
+				sum += vec<double, C>(res) * vec<double, C>(res);
+			});
+			partial1[t] = sum;
+		}
+		vec<double, C> err;
+		e = detail::SumTiles(partial1, err) / N;
+		if (iterationMonitor) {
+			if (!iterationMonitor(iter + 1, e))
+				return iter + 1;
+		}
+		if (lengthL1(err) <= stopErr)
+			return iter + 1;
+		for (int c = 0; c < C; c++) {
+			if (std::abs(rr[c]) < ZERO_TOLERANCE) {
+				rr[c] = (rr[c] < 0) ? -ZERO_TOLERANCE : ZERO_TOLERANCE;
+			}
+		}
+		beta = vec<T, C>(err / rr);
+		rr = err;
+		update = true;
+	}
+	return iter;
+}
+/*
+ * BiCGStab on a stencil system for coefficients that are not symmetric. Same
+ * stopping rule and monitor as SolveStencilCG.
+ */
+template<class T, int C> int SolveStencilBICGStab(const StencilSystem<T, C>& A,
+		const std::vector<vec<T, C>>& b, std::vector<vec<T, C>>& x,
+		int iters = 100, T tolerance = 1E-6f,
+		const std::function<bool(int, double)>& iterationMonitor = nullptr) {
+	const double ZERO_TOLERANCE = 1E-16;
+	const size_t N = A.size();
+	const int TN = A.tiles();
+	if (b.size() != N)
+		throw std::runtime_error(
+				MakeString() << "Stencil dimensions do not match. " << N
+						<< "!=" << b.size());
+	x.resize(N);
+	std::vector<vec<T, C>> r(N), rinit, p(N, vec<T, C>(T(0))), v(N,
+			vec<T, C>(T(0))), s(N), t(N);
+	std::vector<vec<double, C>> partial1(TN), partial2(TN);
+	//Tile-ordered dot products of two buffers.
+	auto dot = [&](const std::vector<vec<T, C>>& a,
+			const std::vector<vec<T, C>>& c) {
+#pragma omp parallel for schedule(dynamic)
+		for (int tile = 0; tile < TN; tile++) {
+			vec<double, C> sum(0.0);
+			A.forEach(tile, [&](size_t idx, int, int, int) {
+				sum += vec<double, C>(a[idx]) * vec<double, C>(c[idx]);
+			});
+			partial1[tile] = sum;
+		}
+		vec<double, C> total;
+		detail::SumTiles(partial1, total);
+		return total;
+	};
+	A.multiply(t, x);
+#pragma omp parallel for
+	for (int n = 0; n < (int) N; n++) {
+		r[n] = b[n] - t[n];
+	}
+	rinit = r;
+	vec<double, C> rr = dot(r, r);
+	double e = lengthL1(rr) / N;
+	const double stopErr = (double) tolerance * (double) tolerance
+			* lengthL1(dot(b, b));
+	if (iterationMonitor) {
+		if (!iterationMonitor(0, e))
+			return 0;
+	}
+	if (lengthL1(rr) <= stopErr)
+		return 0;
+	vec<double, C> rhoNext;
+	vec<double, C> rho(1);
+	vec<T, C> alpha(1), beta;
+	vec<T, C> omega(1);
+	int iter = 0;
+	for (; iter < iters; iter++) {
+		rhoNext = dot(rinit, r);
+		beta = vec<T, C>((rhoNext / rho)) * (alpha / omega);
+#pragma omp parallel for
+		for (int n = 0; n < (int) N; n++) {
+			p[n] = r[n] + beta * p[n] - beta * omega * v[n];
+		}
+		A.multiply(v, p);
+		vec<double, C> denom = dot(rinit, v);
+		for (int c = 0; c < C; c++) {
+			if (std::abs(denom[c]) < ZERO_TOLERANCE) {
+				denom[c] = (denom[c] < 0) ? -ZERO_TOLERANCE : ZERO_TOLERANCE;
+			}
+		}
+		alpha = vec<T, C>(rhoNext / denom);
+#pragma omp parallel for
+		for (int n = 0; n < (int) N; n++) {
+			s[n] = r[n] - alpha * v[n];
+		}
+		vec<double, C> ss = dot(s, s);
+		if (lengthL1(ss) <= stopErr) {
+#pragma omp parallel for
+			for (int n = 0; n < (int) N; n++) {
+				x[n] += alpha * p[n];
+			}
+			if (iterationMonitor)
+				iterationMonitor(iter + 1, lengthL1(ss) / N);
+			return iter + 1;
+		}
+		A.multiply(t, s);
+		denom = dot(t, t);
+		for (int c = 0; c < C; c++) {
+			if (std::abs(denom[c]) < ZERO_TOLERANCE) {
+				denom[c] = ZERO_TOLERANCE;
+			}
+		}
+		omega = vec<T, C>(dot(t, s) / denom);
+#pragma omp parallel for
+		for (int n = 0; n < (int) N; n++) {
+			x[n] += alpha * p[n] + omega * s[n];
+			r[n] = s[n] - omega * t[n];
+		}
+		rho = rhoNext;
+		vec<double, C> err = dot(r, r);
+		e = lengthL1(err) / N;
+		if (iterationMonitor) {
+			if (!iterationMonitor(iter + 1, e))
+				return iter + 1;
+		}
+		if (lengthL1(err) <= stopErr)
+			return iter + 1;
+	}
+	return iter;
+}
+}
+#endif /* INCLUDE_CORE_ALLOYSTENCILSOLVE_H_ */
@@ -172,9 +172,14 @@ namespace aly {
 	class TableRow: public Composite{
 	protected:
 		bool selected;
+		int64_t index;
 		TablePane* tablePane;
 		std::map<int, std::shared_ptr<TableEntry>> columns;
 	public:
+		//Row the region is currently bound to in virtual mode, otherwise -1.
+		int64_t getIndex() const {
+			return index;
+		}
 		int compare(const std::shared_ptr<TableRow>& row,int column);
 		friend class TablePane;
 		void setSelected(bool selected);
@@ -185,11 +190,45 @@ namespace aly {
 		virtual void pack(const pixel2& pos, const pixel2& dims, const double2& dpmm,
 			double pixelRatio, bool clamp) override;
 	};
+	/*
+	 * Vertical list of fixed height entries that only packs the entries
+	 * intersecting the scroll window. In virtual mode the entries are not
+	 * stored at all. A pool of regions just large enough to cover the window is
+	 * created with onCreateEntry, and each region is bound to a row index with
+	 * onBindEntry when it scrolls into view, so layout, drawing and memory do
+	 * not grow with the number of rows.
+	 */
 	class LazyTableComposite: public Composite{
 	protected:
 		float entryHeight;
+		bool virtualized;
+		bool rebind;
+		size_t virtualCount;
+		std::vector<size_t> boundIndices;
+		size_t getEntryCount() const {
+			return (virtualized) ? virtualCount : children.size();
+		}
 	public:
+		std::function<std::shared_ptr<Region>()> onCreateEntry;
+		std::function<void(Region* region, size_t index)> onBindEntry;
 		LazyTableComposite(const std::string& name, const AUnit2D& pos,const AUnit2D& dims,float entryHeight);
+		void setVirtualCount(size_t count);
+		size_t getVirtualCount() const {
+			return virtualCount;
+		}
+		bool isVirtual() const {
+			return virtualized;
+		}
+		//Rebind every visible entry on the next pack, i.e. after the underlying data changed.
+		void invalidate() {
+			rebind = true;
+		}
+		float getEntryHeight() const {
+			return entryHeight;
+		}
+		//Index of the row under the cursor, or -1 if there is none. With clamp, the nearest row is returned instead.
+		int64_t getEntryIndex(const pixel2& cursor, bool clamp = false) const;
+		virtual void clear() override;
 		virtual void pack(const pixel2& pos, const pixel2& dims, const double2& dpmm,
 			double pixelRatio, bool clamp) override;
 	};
@@ -218,7 +257,11 @@ namespace aly {
 		std::vector<pixel> columnWidthPixels;
 		std::vector<int> sortDirections;
 		std::vector<bool> sortMask;
+		std::function<void(TableRow* row, size_t index)> rowProvider;
+		IndexSelection selectedRows;
+		int64_t lastSelectedRow;
 		void sortColumn(int c);
+		void syncSelection();
 	public:
 		friend class TableRow;
 		box2px getDragBox() const {
@@ -266,7 +309,32 @@ namespace aly {
 			enableMultiSelection = enable;
 		}
 		bool onMouseDown(TableRow* entry, AlloyContext* context,const InputEvent& e);
+		/*
+		 * Switches the table to virtual mode for large data sets. Rows are no
+		 * longer added to the table; instead the provider is called to fill in a
+		 * recycled row whenever it is bound to a new index. The provider should
+		 * create the row's columns on first use and only update their values
+		 * afterwards. Selection is tracked by index, and sorting is delegated to
+		 * onSortRows since the table does not own the data.
+		 */
+		void setRowProvider(size_t rowCount, const std::function<void(TableRow* row, size_t index)>& provider);
+		void setRowCount(size_t rowCount);
+		size_t getRowCount() const;
+		bool isVirtual() const {
+			return (bool) rowProvider;
+		}
+		//Re-runs the row provider for all visible rows.
+		void refreshRows();
+		const IndexSelection& getSelectedRows() const {
+			return selectedRows;
+		}
+		void setRowSelected(size_t index, bool selected);
+		//Most recently selected row in virtual mode, or -1.
+		int64_t getLastSelectedRow() const {
+			return lastSelectedRow;
+		}
 		std::function<void(TableRow*, const InputEvent&)> onSelect;
+		std::function<void(int column, int direction)> onSortRows;
 	};
 
 	typedef std::shared_ptr<TablePane> TablePanePtr;
@@ -567,6 +567,9 @@ template<class T, ImageType I> struct Tensor2 {
 			case ImageType::DOUBLE:
 				typeName = "double";
 				break;
+			case ImageType::HALF:
+				typeName = "half";
+				break;
 			case ImageType::UNKNOWN:
 				typeName = "unknown";
 				break;
@@ -641,6 +644,9 @@ template<class T, ImageType I> struct Tensor2 {
 			case ImageType::DOUBLE:
 				typeName = "Double";
 				break;
+			case ImageType::HALF:
+				typeName = "Half";
+				break;
 			case ImageType::UNKNOWN:
 				typeName = "Unknown";
 				break;
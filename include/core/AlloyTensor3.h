@@ -611,6 +611,9 @@ template<class T, ImageType I> struct Tensor3 {
 			case ImageType::DOUBLE:
 				typeName = "double";
 				break;
+			case ImageType::HALF:
+				typeName = "half";
+				break;
 			case ImageType::UNKNOWN:
 				typeName = "unknown";
 				break;
@@ -685,6 +688,9 @@ template<class T, ImageType I> struct Tensor3 {
 			case ImageType::DOUBLE:
 				typeName = "Double";
 				break;
+			case ImageType::HALF:
+				typeName = "Half";
+				break;
 			case ImageType::UNKNOWN:
 				typeName = "Unknown";
 				break;
@@ -59,6 +59,13 @@ protected:
 	bool roundCorners = false;
 	bool detached = false;
 	bool clampToParentBounds = false;
+	//Arguments of the last pack, so the region can be packed again on its own.
+	pixel2 packPosition = pixel2(0, 0);
+	pixel2 packDimensions = pixel2(0, 0);
+	double2 packDpmm = double2(0, 0);
+	double packPixelRatio = 1.0;
+	bool packClamp = false;
+	bool packed = false;
 public:
 	AUnit2D position = CoordPercent(0.0f, 0.0f);
 	AUnit2D dimensions = CoordPercent(1.0f, 1.0f);
@@ -199,6 +206,12 @@ public:
 			const double2& dpmm, double pixelRatio, bool clamp = false);
 	virtual void pack(AlloyContext* context);
 	virtual void pack();
+	/*
+	 * Packs the region and its children again with the arguments its parent
+	 * used last. Returns true if the bounds or extents changed, or the region
+	 * was never packed, in which case the parent must be packed as well.
+	 */
+	bool repack();
 	virtual void draw(AlloyContext* context);
 	virtual void updateCursor(CursorLocator* cursorLocator);
 	virtual void drawDebug(AlloyContext* context);
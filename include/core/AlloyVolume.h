@@ -862,6 +862,9 @@ template<class T, int C, ImageType I> bool ReadImageFromRawFile(const std::strin
 		case ImageType::DOUBLE:
 			typeName = "double";
 			break;
+		case ImageType::HALF:
+			typeName = "half";
+			break;
 		case ImageType::UNKNOWN:
 			typeName = "unknown";
 			break;
@@ -939,6 +942,9 @@ template<class T, int C, ImageType I> bool ReadImageFromRawFile(const std::strin
 		case ImageType::DOUBLE:
 			typeName = "Double";
 			break;
+		case ImageType::HALF:
+			typeName = "Half";
+			break;
 		case ImageType::UNKNOWN:
 			typeName = "Unknown";
 			break;
@@ -23,6 +23,7 @@
 #define ALLOYWIDGET_H_
 
 #include "AlloyUI.h"
+#include <map>
 
 namespace aly {
 enum class SliderHandleShape {Whole,Hat, HalfLeft, HalfRight};
@@ -446,18 +447,65 @@ public:
 
 
 
+/*
+ * Set of row indices stored as disjoint, non-adjacent half-open intervals, so
+ * selecting a range of rows costs the same no matter how many rows it spans.
+ */
+class IndexSelection {
+protected:
+	std::map<size_t, size_t> intervals;
+	size_t count;
+public:
+	IndexSelection() :
+			count(0) {
+	}
+	//Adds the indices in [begin, end).
+	void insert(size_t begin, size_t end);
+	void insert(size_t index) {
+		insert(index, index + 1);
+	}
+	//Removes the indices in [begin, end).
+	void erase(size_t begin, size_t end);
+	void erase(size_t index) {
+		erase(index, index + 1);
+	}
+	//Removes every index at or after end.
+	void truncate(size_t end);
+	bool contains(size_t index) const;
+	void clear() {
+		intervals.clear();
+		count = 0;
+	}
+	bool empty() const {
+		return (count == 0);
+	}
+	//Number of selected indices.
+	size_t size() const {
+		return count;
+	}
+	//Selected ranges in increasing order, mapping the first index to one past the last.
+	const std::map<size_t, size_t>& getIntervals() const {
+		return intervals;
+	}
+};
 class FileDialog;
 class ListBox;
+class LazyTableComposite;
 class ListEntry: public Composite {
 protected:
 	std::string iconCodeString;
 	std::string label;
 	bool selected;
+	int64_t index;
 	ListBox* dialog;
 	float entryHeight;
 	AUnit1D fontSize;
 public:
 	friend class ListBox;
+	//Entry the region is currently bound to in virtual mode, otherwise -1.
+	int64_t getIndex() const {
+		return index;
+	}
 	void setSelected(bool selected);
 	bool isSelected();
 	virtual void setLabel(const std::string& label);
@@ -522,6 +570,12 @@ protected:
 	bool dirty;
 	std::vector<std::shared_ptr<ListEntry>> listEntries;
 	std::list<ListEntry*> lastSelected;
+	std::shared_ptr<LazyTableComposite> virtualRegion;
+	std::function<void(ListEntry* entry, size_t index)> entryProvider;
+	IndexSelection selectedIndices;
+	int64_t lastSelectedIndex;
+	bool onVirtualMouseDown(ListEntry* entry, const InputEvent& e);
+	void syncSelection();
 
 	void addToActiveList(ListEntry* entry) {
 		lastSelected.push_back(entry);
@@ -566,6 +620,26 @@ public:
 	}
 	bool onMouseDown(ListEntry* entry, AlloyContext* context,
 			const InputEvent& e);
+	/*
+	 * Switches the list to virtual mode for large data sets. Entries are no
+	 * longer added to the list; a small pool of entries is recycled as the list
+	 * scrolls, and the provider is called to set the label and icon of an entry
+	 * whenever it is bound to a new index. Selection is tracked by index and
+	 * entries cannot be deleted from the list.
+	 */
+	void setEntryProvider(size_t count,
+			const std::function<void(ListEntry* entry, size_t index)>& provider,
+			float entryHeight = 30.0f);
+	void setEntryCount(size_t count);
+	size_t getEntryCount() const;
+	bool isVirtual() const {
+		return (bool) entryProvider;
+	}
+	//Re-runs the entry provider for all visible entries.
+	void refreshEntries();
+	const IndexSelection& getSelectedIndices() const {
+		return selectedIndices;
+	}
 	std::function<void(ListEntry*, const InputEvent&)> onSelect;
 	std::function<void(const std::vector<std::shared_ptr<ListEntry>>& deleteList)> onDeleteEntry;
 };
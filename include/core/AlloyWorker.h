@@ -21,30 +21,52 @@
 
 #ifndef ALLOYWORKER_H_
 #define ALLOYWORKER_H_
+#include "AlloyScheduler.h"
 #include <thread>
 #include <functional>
 #include <chrono>
 #include <mutex>
 namespace aly {
+/*
+ * Background job that runs on the shared TaskScheduler instead of its own
+ * thread. The job polls isCanceled() or a copy of getCancelToken() to stop
+ * early. Recurrent and timer tasks wait on the scheduler's timer between
+ * steps, so they do not hold a worker while idle.
+ */
 class WorkerTask {
 protected:
-	std::thread workerThread;
 	std::mutex stateChange;
+	std::condition_variable stateChanged;
 	const std::function<void()> executionTask;
 	const std::function<void()> endTask;
-	bool running = false;
-	bool complete = false;
-	bool requestCancel = false;
+	std::atomic<bool> running;
+	std::atomic<bool> complete;
+	CancelToken cancelToken;
+	TaskPriority priority = TaskPriority::Normal;
+	uint64_t timerId = 0;
+	std::thread::id runner;
+	//Runs the whole task on the calling thread.
 	virtual void task();
+	//Starts the task on the scheduler. Must call finish() when it is done.
+	virtual void start();
+	//Called when cancel() removed a pending timer, so the task will not run again.
+	virtual void interrupted();
+	void finish();
+	void wait();
 	void done();
 public:
 	bool isRunning() const;
 	bool isCanceled() const;
-	inline bool* isCanceledPtr() {
-		return &requestCancel;
+	CancelToken getCancelToken() const {
+		return cancelToken;
 	}
 	bool isComplete() const;
-
+	void setPriority(TaskPriority p) {
+		priority = p;
+	}
+	TaskPriority getPriority() const {
+		return priority;
+	}
 	WorkerTask(const std::function<void()>& func);
 	WorkerTask(const std::function<void()>& func, const std::function<void()>& end);
 	bool execute(bool block=false);
@@ -55,7 +77,11 @@ class RecurrentTask: public WorkerTask {
 protected:
 	const std::function<bool(uint64_t iteration)> recurrentTask;
 	long timeout;
+	uint64_t iteration = 0;
 	void step();
+	void iterate();
+	virtual void start() override;
+	virtual void interrupted() override;
 public:
 	void setTimeout(long milliseconds) {
 		timeout = milliseconds;
@@ -64,19 +90,25 @@ public:
 			long milliseconds);
 	RecurrentTask(const std::function<bool(uint64_t iteration)>& func,
 			const std::function<void()>& end, long milliseconds);
+	virtual ~RecurrentTask();
 };
 class TimerTask: public WorkerTask {
 protected:
 	long timeout;
 	long samplingTime;
 	virtual void task() override;
+	virtual void start() override;
+	virtual void interrupted() override;
+	void fire();
 public:
 	void setTimeout(long milliseconds) {
 		timeout = milliseconds;
 	}
+	//Sampling time only applies to blocking execution, asynchronous timers are canceled immediately.
 	TimerTask(const std::function<void()>& successFunc,
 			const std::function<void()>& failureFunc, long milliseconds,
 			long samplingTime);
+	virtual ~TimerTask();
 };
 typedef std::shared_ptr<WorkerTask> WorkerTaskPtr;
 typedef std::shared_ptr<RecurrentTask> RecurrentTaskPtr;
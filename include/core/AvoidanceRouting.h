@@ -32,11 +32,26 @@
 #include <vector>
 #include <memory>
 #include <queue>
+#include <deque>
+#include <unordered_set>
+#include <unordered_map>
 namespace aly {
+	bool SANITY_CHECK_AVOIDANCE_ROUTING();
 	namespace dataflow {
 		enum class Direction { Unkown, North, South, East, West };
 		struct AvoidanceConnection {
 			std::vector<float2> path;
+			//Route cache. A connection is only re-routed when its end points change or an obstacle moves inside the region its last search explored.
+			bool routed = false;
+			uint64_t routedVersion = 0;
+			float routedBorder = 0.0f;
+			Direction routedDirection = Direction::Unkown;
+			float2 routedFrom;
+			float2 routedTo;
+			box2f routedBounds;
+			void invalidateRoute() {
+				routed = false;
+			}
 			virtual Direction getDirection() const = 0;
 			virtual float2 getSourceLocation() const = 0;
 			virtual float2 getDestinationLocation() const = 0;
@@ -63,26 +78,64 @@ namespace aly {
 			}
 			return ss;
 		}
+		//Uniform grid over obstacle bounds. Cells store obstacle indices in CSR order so queries return candidates in the same order as the obstacle list.
+		class ObstacleGrid {
+		protected:
+			const std::vector<box2px>* boxes = nullptr;
+			float2 origin;
+			float2 cellSize;
+			int2 dims;
+			std::vector<int> cellStart;
+			std::vector<int> cellItems;
+			int2 getCell(const float2& pt) const;
+		public:
+			static const int MAX_CELLS = 256;
+			void build(const std::vector<box2px>& boxes);
+			//Sorted, unique indices of obstacles that may overlap region. Conservative, callers still perform the exact test.
+			void query(const box2f& region, std::vector<int>& indices) const;
+			const box2px& operator[](const size_t i) const {
+				return (*boxes)[i];
+			}
+			size_t size() const {
+				return (boxes != nullptr) ? boxes->size() : 0;
+			}
+		};
+		struct AvoidancePath;
+		//Per-thread scratch space for one search. Path nodes are recycled between searches instead of being reallocated.
+		struct AvoidanceSearch {
+			const ObstacleGrid* grid = nullptr;
+			box2f explored;
+			bool hasExplored = false;
+			std::vector<int> candidates;
+			std::vector<std::unique_ptr<AvoidancePath>> pool;
+			size_t used = 0;
+			AvoidancePath* allocate();
+			void reset(const ObstacleGrid* g);
+			void explore(const box2f& region);
+			bool intersects(const lineseg2f& path, const box2f& region);
+		};
 		struct AvoidancePath {
 			float borderSpace=10.0f;
 			Direction direction = Direction::Unkown;
 			float distToDest;
 			float pathLength;
 			int depth;
-			std::vector<box2px>& obstacles;
-			std::vector<std::shared_ptr<AvoidancePath>> children;
+			AvoidanceSearch* search;
+			std::vector<AvoidancePath*> children;
 			AvoidancePath* parent;
 			lineseg2f path;
 			box2f obstacle;
-			AvoidancePath(std::vector<box2px>& obstacles, const float2& from, const float2& to, Direction direction, AvoidancePath* parent = nullptr);
-			void addChild(const std::shared_ptr<AvoidancePath>& child);
+			AvoidancePath() :distToDest(0.0f), pathLength(0.0f), depth(0), search(nullptr), parent(nullptr) {
+			}
+			void set(AvoidanceSearch* search, const float2& from, const float2& to, Direction direction, AvoidancePath* parent = nullptr);
+			void addChild(AvoidancePath* child);
 			float2 backTrack(std::vector<float2>& pointList);
 			std::vector<float2> backTrack();
 			float updatePathLength();
 			bool createChildren(const float2& to);
-			void createDescendants(std::vector<std::shared_ptr<AvoidancePath>>& ret, const float2& to, int depth);
+			void createDescendants(std::vector<AvoidancePath*>& ret, const float2& to, int depth);
 			float2 findNextBoundary(const float2 &point);
-			void getDescendants(std::vector<std::shared_ptr<AvoidancePath>>& ret, int depth);
+			void getDescendants(std::vector<AvoidancePath*>& ret, int depth);
 			float getDistanceToDestination() const;
 			float getPathLength() const;
 			float lineLength();
@@ -101,16 +154,35 @@ namespace aly {
 			}
 		}
 		struct ComparePaths{
-			bool operator()(const std::shared_ptr<AvoidancePath>& a, const std::shared_ptr<AvoidancePath>& b);
+			bool operator()(const AvoidancePath* a, const AvoidancePath* b) const;
+		};
+		struct HashPathCode {
+			size_t operator()(const int4& code) const {
+				size_t h = 0;
+				for (int i = 0; i < 4; i++) {
+					h ^= std::hash<int>()(code[i]) + 0x9e3779b9 + (h << 6) + (h >> 2);
+				}
+				return h;
+			}
 		};
 		class AvoidanceRouting {
 		protected:
 			float borderSpace=10.0f;
 			static const int DEPTH_LIMIT = 4;
 			static const int MAX_PATHS = 128;
+			static const int MAX_DIRTY_REGIONS = 1024;
 			std::vector<box2px> obstacles;
+			ObstacleGrid grid;
+			//Obstacle bounds from the previous update, used to find which nodes moved.
+			std::unordered_map<const AvoidanceNode*, std::pair<int, box2px>> lastObstacles;
+			std::deque<std::pair<uint64_t, box2f>> dirtyRegions;
+			uint64_t version = 1;
+			uint64_t invalidVersion = 1;
 			box2px getPathBounds(float2 from, float2 to) const;
-			void simplifyPath(std::vector<float2>& path,int parity);
+			void simplifyPath(AvoidanceSearch& search,std::vector<float2>& path,int parity);
+			void evaluate(AvoidanceSearch& search, std::vector<float2>& path, float2 from, float2 to, Direction direction);
+			void invalidate();
+			bool isRouteValid(const AvoidanceConnection& edge, const float2& from, const float2& to, Direction direction) const;
 		public:
 			std::vector<std::shared_ptr<AvoidanceNode>> nodes;
 			void update();
@@ -118,9 +190,19 @@ namespace aly {
 				return obstacles;
 			}
 			void setBorderSpacing(float b){
-				borderSpace=b;
+				if (b != borderSpace) {
+					borderSpace = b;
+					invalidate();
+				}
 			}
+			//Re-routes edge only if it was affected by obstacles that moved since the last time it was routed.
 			void evaluate( const std::shared_ptr<AvoidanceConnection>& edge);
+			template<class T> void evaluate(const std::vector<std::shared_ptr<T>>& edges) {
+#pragma omp parallel for schedule(dynamic)
+				for (int i = 0; i < (int)edges.size(); i++) {
+					evaluate(std::static_pointer_cast<AvoidanceConnection>(edges[i]));
+				}
+			}
 			void evaluate(std::vector<float2>& path, float2 from, float2 to, Direction direction);
 			void add(const std::shared_ptr<AvoidanceNode>& node) {
 				nodes.push_back(node);
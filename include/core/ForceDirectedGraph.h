@@ -497,25 +497,69 @@ struct BuoyancyForce: public Force {
 typedef std::shared_ptr<BuoyancyForce> BuoyancyForcePtr;
 
 struct QuadTreeNode {
-	static const int MAX_LEAFS = 8;
-	static const int MAX_DEPTH = 12;
 	float mass;
 	float2 com;
-	bool hasChildren;
-	int depth;
+	//Second moment of mass about the center of mass (xx, xy, yy).
+	float3 quadrupole;
 	box2f bounds;
-	std::vector<ForceItemPtr> values;
-	std::array<std::shared_ptr<QuadTreeNode>, 4> children;
-	void update();
-	QuadTreeNode(float mass = 0.0f, float2 com = float2(0.0f),int depth=-1) :
-			mass(mass), com(com), hasChildren(false),depth(depth),bounds(box2f()) {
-	}
-	void insert(const ForceItemPtr& item);
-	void draw(AlloyContext* context, const pixel2& offset, float scale);
-	void reset();
+	int depth;
+	int begin;
+	int end;
+	int children[4];
+	QuadTreeNode(const box2f& bounds = box2f(), int depth = 0, int begin = 0,
+			int end = 0) :
+			mass(0.0f), com(0.0f), quadrupole(0.0f), bounds(bounds), depth(
+					depth), begin(begin), end(end) {
+		children[0] = children[1] = children[2] = children[3] = -1;
+	}
+	bool hasChildren() const {
+		return (children[0] >= 0 || children[1] >= 0 || children[2] >= 0
+				|| children[3] >= 0);
+	}
+};
+/*
+ * Linearized quadtree built from Morton sorted force items. Nodes live in a single
+ * array that is reused between simulation steps so rebuilding does not allocate
+ * once the simulation reaches a steady size. Each node references a contiguous
+ * range of the sorted item arrays.
+ */
+class QuadTree {
+protected:
+	std::vector<QuadTreeNode> nodes;
+	std::vector<uint32_t> codes;
+	std::vector<uint32_t> sortedCodes;
+	std::vector<int> order;
+	std::vector<float2> locations;
+	std::vector<float> masses;
+	std::vector<const ForceItem*> items;
+	int build(const box2f& bounds, int depth, int begin, int end);
+	void update(int index);
+public:
+	static const int MAX_LEAFS = 8;
+	static const int MAX_DEPTH = 12;
+	static const int MORTON_BITS = 16;
+	void clear();
+	void build(const std::vector<ForceItemPtr>& forceItems, const box2f& bounds);
+	bool empty() const {
+		return nodes.empty();
+	}
+	size_t size() const {
+		return nodes.size();
+	}
+	const QuadTreeNode& operator[](size_t i) const {
+		return nodes[i];
+	}
+	const float2& getLocation(int i) const {
+		return locations[i];
+	}
+	float getMass(int i) const {
+		return masses[i];
+	}
+	const ForceItem* getItem(int i) const {
+		return items[i];
+	}
+	void draw(AlloyContext* context, const pixel2& offset, float scale) const;
 };
-typedef std::shared_ptr<QuadTreeNode> QuadTreeNodePtr;
-
 struct NBodyForce: public Force {
 	static const std::string pnames[3];
 	static const float DEFAULT_GRAV_CONSTANT;
@@ -530,7 +574,9 @@ struct NBodyForce: public Force {
 	static const int GRAVITATIONAL_CONST = 0;
 	static const int MIN_DISTANCE = 1;
 	static const int BARNES_HUT_THETA = 2;
-	QuadTreeNodePtr root;
+protected:
+	QuadTree tree;
+	bool multipole = false;
 public:
 	NBodyForce(float gravConstant, float minDistance, float theta){
 		params = {gravConstant, minDistance, theta};
@@ -553,6 +599,16 @@ public:
 	virtual std::string getName() const override {
 		return "N-Body Force";
 	}
+	//Adds quadrupole correction to far field approximation so theta can be raised for large graphs.
+	void setMultipole(bool b) {
+		multipole = b;
+	}
+	bool isMultipole() const {
+		return multipole;
+	}
+	const QuadTree& getQuadTree() const {
+		return tree;
+	}
 	void clear();
 	virtual void init(ForceSimulator& fsim) override;
 	void getForce(const ForceItemPtr& item) override;
@@ -112,6 +112,25 @@ public:
 								<< textureImage.getTypeName());
 			}
 			break;
+		case ImageType::HALF:
+			if (textureImage.channels == 4) {
+				internalFormat = GL_RGBA16F;
+				externalFormat = GL_RGBA;
+				dataType = GL_HALF_FLOAT;
+			} else if (textureImage.channels == 3) {
+				internalFormat = GL_RGB16F;
+				externalFormat = GL_RGB;
+				dataType = GL_HALF_FLOAT;
+			} else if (textureImage.channels == 1) {
+				internalFormat = GL_R16F;
+				externalFormat = GL_R;
+				dataType = GL_HALF_FLOAT;
+			} else {
+				throw std::runtime_error(
+						MakeString() << "Texture format not supported "
+								<< textureImage.getTypeName());
+			}
+			break;
 		case ImageType::UBYTE:
 			if (textureImage.channels == 4) {
 				internalFormat = GL_RGBA;
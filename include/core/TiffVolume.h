@@ -0,0 +1,93 @@
+/*
+ * Copyright(C) 2018, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef INCLUDE_CORE_TIFFVOLUME_H_
+#define INCLUDE_CORE_TIFFVOLUME_H_
+#include "AlloyVolume.h"
+#include <string>
+namespace aly {
+bool SANITY_CHECK_TIFF_VOLUME();
+/*
+ * Multi-page TIFF stacks are read into and written from volumes directly, one
+ * page per slice. All IFDs are indexed once from a memory mapped view of the
+ * file and every strip of every page is then decoded in parallel into the
+ * preallocated volume. Uncompressed, PackBits, LZW and Deflate strips with
+ * horizontal or floating point predictors are supported in either byte order,
+ * in classic and BigTIFF files, with chunky or planar samples. Tiled pages and
+ * sub-byte samples are not supported.
+ *
+ * Like ReadTiffImage, reading returns false if the file cannot be opened or if
+ * the channel count or sample type of the stack does not match the volume.
+ * Malformed files and pages that differ in size or format throw.
+ */
+struct TiffVolumeHeader {
+	int width = 0;
+	int height = 0;
+	int slices = 0;
+	int channels = 0;
+	int bitsPerSample = 0;
+	int compression = 1;
+	ImageType type = ImageType::UNKNOWN;
+	bool bigTiff = false;
+};
+bool ReadTiffVolumeHeader(const std::string& file, TiffVolumeHeader& header);
+
+bool ReadTiffVolume(const std::string& file, Volume1ub& vol);
+bool ReadTiffVolume(const std::string& file, Volume2ub& vol);
+bool ReadTiffVolume(const std::string& file, Volume3ub& vol);
+bool ReadTiffVolume(const std::string& file, Volume4ub& vol);
+bool ReadTiffVolume(const std::string& file, Volume1b& vol);
+bool ReadTiffVolume(const std::string& file, Volume1us& vol);
+bool ReadTiffVolume(const std::string& file, Volume2us& vol);
+bool ReadTiffVolume(const std::string& file, Volume3us& vol);
+bool ReadTiffVolume(const std::string& file, Volume4us& vol);
+bool ReadTiffVolume(const std::string& file, Volume1s& vol);
+bool ReadTiffVolume(const std::string& file, Volume1i& vol);
+bool ReadTiffVolume(const std::string& file, Volume1ui& vol);
+bool ReadTiffVolume(const std::string& file, Volume1f& vol);
+bool ReadTiffVolume(const std::string& file, Volume2f& vol);
+bool ReadTiffVolume(const std::string& file, Volume3f& vol);
+bool ReadTiffVolume(const std::string& file, Volume4f& vol);
+bool ReadTiffVolume(const std::string& file, Volume1d& vol);
+
+/*
+ * compressionLevel follows WriteTiffImage: negative for LZW, zero for no
+ * compression and 1 to 9 for Deflate. Pages are compressed in parallel and
+ * the file switches to BigTIFF when it could exceed 4GB.
+ */
+bool WriteTiffVolume(const std::string& file, const Volume1ub& vol, int compressionLevel = -1);
+bool WriteTiffVolume(const std::string& file, const Volume2ub& vol, int compressionLevel = -1);
+bool WriteTiffVolume(const std::string& file, const Volume3ub& vol, int compressionLevel = -1);
+bool WriteTiffVolume(const std::string& file, const Volume4ub& vol, int compressionLevel = -1);
+bool WriteTiffVolume(const std::string& file, const Volume1b& vol, int compressionLevel = -1);
+bool WriteTiffVolume(const std::string& file, const Volume1us& vol, int compressionLevel = -1);
+bool WriteTiffVolume(const std::string& file, const Volume2us& vol, int compressionLevel = -1);
+bool WriteTiffVolume(const std::string& file, const Volume3us& vol, int compressionLevel = -1);
+bool WriteTiffVolume(const std::string& file, const Volume4us& vol, int compressionLevel = -1);
+bool WriteTiffVolume(const std::string& file, const Volume1s& vol, int compressionLevel = -1);
+bool WriteTiffVolume(const std::string& file, const Volume1i& vol, int compressionLevel = -1);
+bool WriteTiffVolume(const std::string& file, const Volume1ui& vol, int compressionLevel = -1);
+bool WriteTiffVolume(const std::string& file, const Volume1f& vol, int compressionLevel = -1);
+bool WriteTiffVolume(const std::string& file, const Volume2f& vol, int compressionLevel = -1);
+bool WriteTiffVolume(const std::string& file, const Volume3f& vol, int compressionLevel = -1);
+bool WriteTiffVolume(const std::string& file, const Volume4f& vol, int compressionLevel = -1);
+bool WriteTiffVolume(const std::string& file, const Volume1d& vol, int compressionLevel = -1);
+}
+#endif /* INCLUDE_CORE_TIFFVOLUME_H_ */
@@ -24,10 +24,13 @@
 
 class SHA1 {
 public:
+	static const unsigned int DIGEST_BYTES = 20;
 	SHA1();
 	void update(const std::string &s);
 	void update(std::istream &is);
+	void update(const unsigned char* data, size_t len);
 	std::string final();
+	void final(unsigned char out[DIGEST_BYTES]);
 	static std::string from_file(const std::string &filename);
 
 private:
@@ -41,10 +44,13 @@ private:
 	uint64_t transforms;
 
 	void reset();
+	void pad();
 	void transform(uint32_t block[BLOCK_BYTES]);
 
 	static void buffer_to_block(const std::string &buffer,
 			uint32_t block[BLOCK_BYTES]);
+	static void bytes_to_block(const unsigned char* bytes,
+			uint32_t block[BLOCK_BYTES]);
 	static void read(std::istream &is, std::string &s, int max);
 };
 
@@ -184,6 +184,17 @@ extern int ParseEXRHeaderFromMemory(int *width, int *height,
 extern int LoadEXRFromMemory(float *out_rgba, const unsigned char *memory,
 		const char **err);
 
+// Codecs for a single scanline block or tile, where data is laid out line by
+// line with the samples of each channel contiguous within a line. Compression
+// is the EXR compression attribute: 0 none, 1 RLE, 2 ZIPS, 3 ZIP or 4 PIZ
+// (decode only). DecompressEXRBlock returns 0 on success. CompressEXRBlock
+// returns the compressed size, or 0 if the block should be stored as is.
+extern int DecompressEXRBlock(unsigned char *dst, size_t dst_size,
+		const unsigned char *src, size_t src_size, int compression,
+		const int *pixel_types, int num_channels, int width, int num_lines);
+extern size_t CompressEXRBlock(unsigned char *dst, size_t dst_size,
+		const unsigned char *src, size_t src_size, int compression);
+
 #ifdef __cplusplus
 }
 #endif
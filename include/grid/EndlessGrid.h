@@ -226,6 +226,11 @@ public:
 		}
 		return result;
 	}
+	//Deletes a leaf so reads at its location return the background value again. Internal nodes are kept.
+	bool removeLeaf(EndlessNode<T>* leaf) {
+		return (leaf != nullptr && leaf->parent != nullptr
+				&& leaf->parent->removeChild(leaf));
+	}
 	inline std::list<EndlessNode<T>*> getNodesAtDepth(int d) const {
 		std::list<EndlessNode<T>*> result;
 		for (auto node : nodes) {
@@ -220,6 +220,26 @@ public:
 		}
 		return children[idx].get();
 	}
+	//Deletes a child node. The last child moves into the freed slot so children stays dense.
+	bool removeChild(EndlessNode<T>* node) {
+		int slot = getIndex(node);
+		if (slot < 0)
+			return false;
+		int idx = indexes[slot];
+		int last = (int) children.size() - 1;
+		if (idx != last) {
+			for (int& index : indexes) {
+				if (index == last) {
+					index = idx;
+					break;
+				}
+			}
+			children[idx] = std::move(children[last]);
+		}
+		children.pop_back();
+		indexes[slot] = -1;
+		return true;
+	}
 	inline EndlessNode<T>* getChild(int i, int j, int k) const {
 		if(		i<0||i>=dim||
 				j<0||j>=dim||
@@ -75,6 +75,9 @@ namespace aly {
 			case ImageType::FLOAT:
 				format.image_channel_data_type = CL_FLOAT;
 				break;
+			case ImageType::HALF:
+				format.image_channel_data_type = CL_HALF_FLOAT;
+				break;
 			case ImageType::USHORT:
 				format.image_channel_data_type = CL_UNSIGNED_INT16;
 				break;
@@ -71,6 +71,9 @@ public:
 		case ImageType::FLOAT:
 			format.image_channel_data_type = CL_FLOAT;
 			break;
+		case ImageType::HALF:
+			format.image_channel_data_type = CL_HALF_FLOAT;
+			break;
 		case ImageType::USHORT:
 			format.image_channel_data_type = CL_UNSIGNED_INT16;
 			break;
@@ -30,6 +30,7 @@
 #include <tuple>
 #include <mutex>
 #include "Simulation.h"
+#include "NarrowBand.h"
 namespace aly {
 class ActiveManifold2D: public Simulation {
 protected:
@@ -54,6 +55,7 @@ protected:
 	Image2f vecFieldImage;
 	std::vector<float> deltaLevelSet;
 	std::vector<int2> activeList;
+	std::vector<size_t> compactOffsets;
 	std::mutex contourLock;
 	bool getBitValue(int i);
 	void rescale(aly::Image1f& pressureForce);
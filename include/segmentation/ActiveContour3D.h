@@ -31,6 +31,7 @@
 #include "Simulation.h"
 #include "Manifold3D.h"
 #include "ManifoldCache3D.h"
+#include "NarrowBand.h"
 namespace aly {
 class ActiveContour3D: public Simulation {
 protected:
@@ -53,15 +54,28 @@ protected:
 	Volume1f swapLevelSet;
 	Volume1f pressureImage;
 	Volume3f vecFieldImage;
+	//Indexed by frontList, not activeList.
 	std::vector<float> deltaLevelSet;
 	std::vector<int3> activeList;
+	//Indexes into activeList for voxels within half a voxel of the zero crossing. Only these move.
+	std::vector<int> frontList;
+	//SoA stencil for frontList, STENCIL_SIZE consecutive arrays of frontList.size() values.
+	std::vector<float> frontStencil;
+	std::vector<int3> swapActiveList;
+	std::vector<size_t> compactOffsets;
+	std::vector<char> compactFlags;
+	static const int STENCIL_SIZE = 19;
 	std::mutex contourLock;
 	aly::HorizontalSliderPtr pressureSlider,curavtureSlider,advectionSlider;
 	bool getBitValue(int i);
 	void rescale(aly::Volume1f& pressureForce);
-	void pressureMotion(int i, int j, int k, size_t index);
-	void pressureAndAdvectionMotion(int i, int j, int k, size_t index);
-	void advectionMotion(int i, int j, int k, size_t index);
+	void pressureMotion(size_t index);
+	void pressureAndAdvectionMotion(size_t index);
+	void advectionMotion(size_t index);
+	void updateFront();
+	inline float getStencilValue(int s, size_t index) const {
+		return frontStencil[s * frontList.size() + index];
+	}
 	void applyForces(int i, int j, int k, size_t index, float timeStep);
 	void plugLevelSet(int i, int j, int k, size_t index);
 	void updateDistanceField(int i, int j, int k, int band);
@@ -32,6 +32,7 @@
 #include "segmentation/Manifold3D.h"
 #include "segmentation/ManifoldCache3D.h"
 #include "segmentation/MultiIsoSurface.h"
+#include "segmentation/NarrowBand.h"
 namespace aly {
 class MultiActiveContour3D: public Simulation {
 protected:
@@ -48,7 +49,24 @@ protected:
 
 	const float MAX_DISTANCE = 3.5f;
 	const int maxLayers = 3;
+	static const int SPARSE_LEAF_SIZE = 8;
 	bool requestUpdateSurface;
+	//Sparse backend stores (distance,label) pairs in narrow band leaves instead of dense volumes.
+	bool sparse;
+	int3 dimensions;
+	FloatInt sparseBackground;
+	EndlessGridFloatInt sparseLevelSet;
+	EndlessGridFloatInt swapSparseLevelSet;
+	//Leaf lookup tables indexed by voxel position / SPARSE_LEAF_SIZE, nullptr where no leaf is allocated.
+	int3 leafDimensions;
+	std::vector<EndlessNodeFloatInt*> sparseLeafs;
+	std::vector<EndlessNodeFloatInt*> swapSparseLeafs;
+	//Label of every voxel in a leaf that is not allocated, indexed like sparseLeafs.
+	std::vector<int> sparseLeafLabels;
+	//Initial state from setInitialLabels() in sparse mode, stored the same way so no dense volumes are kept.
+	int3 initialDimensions;
+	EndlessGridFloatInt initialSparseLevelSet;
+	std::vector<int> initialLeafLabels;
 	std::vector<int> labelList;
 	std::map<int, aly::Color> objectColors;
 	Volume1f initialLevelSet;
@@ -63,6 +81,9 @@ protected:
 	std::vector<int3> activeList;
 	std::vector<int> objectIds;
 	std::vector<int> forceIndexes;
+	std::vector<int3> swapActiveList;
+	std::vector<size_t> compactOffsets;
+	std::vector<char> compactFlags;
 	std::mutex contourLock;
 	aly::HorizontalSliderPtr pressureSlider,curavtureSlider,advectionSlider;
 	bool getBitValue(int i);
@@ -85,6 +106,58 @@ protected:
 	float getLevelSetValue(float i, float j,float k, int l) const;
 	float getUnionLevelSetValue(float i, float j,float k, int l) const;
 	float getSwapLevelSetValue(int i, int j,int k, int l) const;
+	void seedSparseLevelSet(const Volume1i& labels);
+	void initSparseLevelSet();
+	void allocateSparseLeaves();
+	void allocateSparseLeaf(const int3& leafId);
+	void freeSparseLeaves();
+	void solveSparseSurface(Mesh& mesh, std::map<int, std::pair<size_t, size_t>>& regions);
+	inline size_t getLeafIndex(const int3& leafId) const {
+		return leafId.x + (leafId.y + leafId.z * (size_t) leafDimensions.y) * leafDimensions.x;
+	}
+	FloatInt* getSparseValuePtr(const std::vector<EndlessNodeFloatInt*>& leafs, int i, int j, int k) const;
+	FloatInt getSparseValue(const std::vector<EndlessNodeFloatInt*>& leafs, int i, int j, int k) const;
+	inline float getDistance(int i, int j, int k) const {
+		return (sparse) ? getSparseValue(sparseLeafs, i, j, k).first : levelSet(i, j, k).x;
+	}
+	inline float getSwapDistance(int i, int j, int k) const {
+		return (sparse) ? getSparseValue(swapSparseLeafs, i, j, k).first : swapLevelSet(i, j, k).x;
+	}
+	inline int getLabel(int i, int j, int k) const {
+		return (sparse) ? getSparseValue(sparseLeafs, i, j, k).second : labelImage(i, j, k).x;
+	}
+	inline int getSwapLabel(int i, int j, int k) const {
+		return (sparse) ? getSparseValue(swapSparseLeafs, i, j, k).second : swapLabelImage(i, j, k).x;
+	}
+	//Sparse writes must land in leaves created by allocateSparseLeaves() because leaves cannot be allocated concurrently.
+	inline void setDistance(int i, int j, int k, float val) {
+		if (sparse) {
+			getSparseValuePtr(sparseLeafs, i, j, k)->first = val;
+		} else {
+			levelSet(i, j, k).x = val;
+		}
+	}
+	inline void setSwapDistance(int i, int j, int k, float val) {
+		if (sparse) {
+			getSparseValuePtr(swapSparseLeafs, i, j, k)->first = val;
+		} else {
+			swapLevelSet(i, j, k).x = val;
+		}
+	}
+	inline void setLabel(int i, int j, int k, int l) {
+		if (sparse) {
+			getSparseValuePtr(sparseLeafs, i, j, k)->second = l;
+		} else {
+			labelImage(i, j, k).x = l;
+		}
+	}
+	inline void setSwapLabel(int i, int j, int k, int l) {
+		if (sparse) {
+			getSparseValuePtr(swapSparseLeafs, i, j, k)->second = l;
+		} else {
+			swapLabelImage(i, j, k).x = l;
+		}
+	}
 
 public:
 	MultiActiveContour3D(const std::shared_ptr<ManifoldCache3D>& cache = nullptr);
@@ -127,8 +200,23 @@ public:
 		advectionParam.setValue(c);
 	}
 	Manifold3D* getSurface();
+	//Empty when the sparse backend is enabled, use getSparseLevelSet() instead.
 	Volume1f& getLevelSet();
 	const Volume1f& getLevelSet() const;
+	EndlessGridFloatInt& getSparseLevelSet() {
+		return sparseLevelSet;
+	}
+	const EndlessGridFloatInt& getSparseLevelSet() const {
+		return sparseLevelSet;
+	}
+	//Store the evolving level set and labels in EndlessGrid leaves so memory scales with object size. Takes effect on init().
+	//Call before setInitialLabels() so the initial state is also built without dense volumes.
+	void setSparse(bool b) {
+		sparse = b;
+	}
+	bool isSparse() const {
+		return sparse;
+	}
 	virtual bool init() override;
 	virtual void cleanup() override;
 	std::shared_ptr<ManifoldCache3D> getCache() const {
@@ -139,6 +227,8 @@ public:
 	void setInitialDistanceField(const Volume1f& img,const Volume1i& lab) {
 		initialLevelSet = img;
 		initialLabels=lab;
+		initialSparseLevelSet.clear();
+		initialLeafLabels.clear();
 	}
 };
 }
@@ -101,26 +101,13 @@ private:
 			const int& slices,
 			const std::vector<int3>& indexList, Mesh& mesh,
 			int label);
-	void solveQuad(const EndlessGridFloatInt& grid,Mesh& mesh,int label);
-	void generateVertexData(
-			const EndlessGridFloatInt& grid,
-			const std::unordered_set<int3>& voxels,
-			const std::unordered_map<int4, EdgeInfo>& edges,
-			std::unordered_map<int3, uint32_t>& vertexIndices,
-			Mesh& buffer,
-			int label);
+	void solveQuad(const EndlessGridFloatInt& grid,Mesh& mesh,int label,bool sharpFeatures);
 	void solveTri(const float* data,const int* labels,
 			const int& rows, const int& cols,
 			const int& slices, const std::vector<int3>& indexList,
 			Mesh& mesh,int label);
 	void solveTri(const EndlessGridFloatInt& grid,
 			Mesh& mesh,int label);
-	void findActiveVoxels(
-			const EndlessGridFloatInt& grid,
-			const std::list<EndlessNodeFloatInt*>& leafs,
-			std::unordered_set<int3>& activeVoxels,
-			std::unordered_map<int4, EdgeInfo>& activeEdges,
-			int label);
 public:
 	MultiIsoSurface();
 	~MultiIsoSurface();
@@ -129,7 +116,8 @@ public:
 			Mesh& mesh,
 			const MeshType& type,
 			bool regularizeTest,
-			int label);
+			int label,
+			bool sharpFeatures = false);
 	void solve(const Volume1f& data,
 			const Volume1i& labels, const std::vector<int3>& indexList,
 			Mesh& mesh, const MeshType& type,
@@ -0,0 +1,86 @@
+/*
+ * Copyright(C) 2018, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef INCLUDE_NARROWBAND_H_
+#define INCLUDE_NARROWBAND_H_
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+namespace aly {
+/*
+ * Order-preserving parallel stream compaction. Items [0,N) are split into blocks,
+ * count(i) returns how many elements item i produces and emit(i,dst) writes them
+ * starting at dst and returns the number written. Results are appended to out
+ * after the first "start" elements in the same order a serial loop would produce.
+ * offsets is scratch storage that callers keep around to avoid reallocation.
+ */
+template<class T, class CountFunc, class EmitFunc> void ParallelCompact(
+		std::vector<T>& out, int N, const CountFunc& count,
+		const EmitFunc& emit, std::vector<size_t>& offsets, size_t start = 0) {
+	const int BLOCK_SIZE = 4096;
+	int blocks = (N + BLOCK_SIZE - 1) / BLOCK_SIZE;
+	offsets.resize(blocks + 1);
+#pragma omp parallel for
+	for (int b = 0; b < blocks; b++) {
+		int end = std::min(N, (b + 1) * BLOCK_SIZE);
+		size_t total = 0;
+		for (int i = b * BLOCK_SIZE; i < end; i++) {
+			total += count(i);
+		}
+		offsets[b + 1] = total;
+	}
+	offsets[0] = start;
+	for (int b = 0; b < blocks; b++) {
+		offsets[b + 1] += offsets[b];
+	}
+	out.resize(offsets[blocks]);
+#pragma omp parallel for
+	for (int b = 0; b < blocks; b++) {
+		int end = std::min(N, (b + 1) * BLOCK_SIZE);
+		T* dst = out.data() + offsets[b];
+		for (int i = b * BLOCK_SIZE; i < end; i++) {
+			dst += emit(i, dst);
+		}
+	}
+}
+//Parallel max of |values[i]|, used to pick the CFL time step.
+inline float ParallelMaxAbs(const float* values, int N) {
+	float maxValue = 0.0f;
+#pragma omp parallel
+	{
+		float localMax = 0.0f;
+#pragma omp for nowait
+		for (int i = 0; i < N; i++) {
+			localMax = std::max(std::abs(values[i]), localMax);
+		}
+#pragma omp critical
+		{
+			maxValue = std::max(localMax, maxValue);
+		}
+	}
+	return maxValue;
+}
+inline float ParallelMaxAbs(const std::vector<float>& values) {
+	return ParallelMaxAbs(values.data(), (int) values.size());
+}
+}
+#endif
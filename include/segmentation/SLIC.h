@@ -30,6 +30,7 @@
 #include <AlloyVector.h>
 #include <AlloyImage.h>
 #include <AlloyUnits.h>
+#include <AlignedAllocator.h>
 #include <array>
 using namespace std;
 namespace aly {
@@ -44,6 +45,8 @@ namespace aly {
 	{
 	private:
 		ImageRGBf labImage;
+		//Lab planes stored as SoA so assignment can evaluate 4 pixels per SSE instruction.
+		std::vector<float, aligned_allocator<float, 64>> planeL, planeA, planeB;
 		Image1i labelImage;
 		Vector3f colorCenters;
 		Vector2f pixelCenters;
@@ -62,6 +65,8 @@ namespace aly {
 		void refineSeeds(const Image1f& magImage);
 		void gradientMagnitude(Image1f& magImage);
 		void optimize(int NUMITR=10);
+		void updateColorPlanes();
+		void assignLabels(Image1f& scoreImage, float offset, float invxywt);
 		
 	public:
 		void solve(const ImageRGBAf& image,int K,int iterations=128);
@@ -114,6 +119,7 @@ namespace aly {
 		int getNumLabels() const {
 			return numLabels;
 		}
+		static const int TILE_SIZE = 64;
 		SuperPixels();
 	};
 }
@@ -0,0 +1,181 @@
+/*
+ * Copyright(C) 2018, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef INCLUDE_VISION_DESCRIPTORMATCHER_H_
+#define INCLUDE_VISION_DESCRIPTORMATCHER_H_
+#include <AlloyImageFeatures.h>
+#include <AlignedAllocator.h>
+#include "vision/Sift.h"
+#include <vector>
+#include <list>
+#include <limits>
+#include <memory>
+#include <mutex>
+namespace aly {
+	bool SANITY_CHECK_DESCRIPTOR_MATCHER();
+	namespace detail {
+		struct DescriptorForest;
+	}
+	/*
+	 * Descriptors stored row-major in one aligned block. Rows are zero padded to
+	 * a multiple of 4 floats so SIMD kernels never need a scalar tail.
+	 */
+	class DescriptorMatrix {
+	protected:
+		std::vector<float, aligned_allocator<float, 64>> data;
+		std::vector<float> norms;
+		int rows;
+		int cols;
+		int stride;
+		uint64_t version;
+	public:
+		DescriptorMatrix(int rows = 0, int cols = 0) :rows(0), cols(0), stride(0), version(0) {
+			resize(rows, cols);
+		}
+		DescriptorMatrix(const std::vector<SiftDescriptor>& descriptors) :rows(0), cols(0), stride(0), version(0) {
+			set(descriptors);
+		}
+		DescriptorMatrix(const std::vector<DaisyDescriptor>& descriptors) :rows(0), cols(0), stride(0), version(0) {
+			set(descriptors);
+		}
+		void resize(int rows, int cols);
+		void set(const std::vector<SiftDescriptor>& descriptors);
+		void set(const std::vector<DaisyDescriptor>& descriptors);
+		//Must be called after rows are written through ptr().
+		void updateNorms();
+		int getRows() const {
+			return rows;
+		}
+		int getCols() const {
+			return cols;
+		}
+		int getStride() const {
+			return stride;
+		}
+		//Unique for every resize() and updateNorms(), copies share it. Used to reuse search structures.
+		uint64_t getVersion() const {
+			return version;
+		}
+		size_t size() const {
+			return rows;
+		}
+		float norm(int r) const {
+			return norms[r];
+		}
+		float* ptr(int r) {
+			return &data[(size_t) r * stride];
+		}
+		const float* ptr(int r) const {
+			return &data[(size_t) r * stride];
+		}
+		float* operator[](int r) {
+			return ptr(r);
+		}
+		const float* operator[](int r) const {
+			return ptr(r);
+		}
+	};
+	enum class DescriptorMetric {
+		L2, Cosine
+	};
+	struct DescriptorMatch {
+		int query;
+		int train;
+		//Euclidean distance for L2, 1-cos(angle) for Cosine.
+		float distance;
+		DescriptorMatch(int query = -1, int train = -1, float distance =
+				std::numeric_limits<float>::max()) :
+				query(query), train(train), distance(distance) {
+		}
+		bool operator<(const DescriptorMatch& other) const {
+			return (distance < other.distance);
+		}
+	};
+	/*
+	 * Nearest neighbor matching between two descriptor sets. Brute force search
+	 * is exact; the approximate mode searches a forest of randomized kd-trees
+	 * with a bounded number of descriptor comparisons per query.
+	 */
+	class DescriptorMatcher {
+	protected:
+		DescriptorMetric metric;
+		float ratio;
+		bool crossCheck;
+		bool approximate;
+		int trees;
+		int checks;
+		//Forests of the most recently searched train sets, keyed by DescriptorMatrix version.
+		mutable std::mutex forestLock;
+		mutable std::list<std::pair<uint64_t, std::shared_ptr<detail::DescriptorForest>>> forests;
+		std::shared_ptr<detail::DescriptorForest> getForest(const DescriptorMatrix& train) const;
+		void bruteForce(const DescriptorMatrix& query, const DescriptorMatrix& train, int k,
+				std::vector<DescriptorMatch>& out) const;
+		void forest(const DescriptorMatrix& query, const DescriptorMatrix& train, int k,
+				std::vector<DescriptorMatch>& out) const;
+	public:
+		DescriptorMatcher(DescriptorMetric metric = DescriptorMetric::L2, float ratio = 0.8f,
+				bool crossCheck = true) :
+				metric(metric), ratio(ratio), crossCheck(crossCheck), approximate(false), trees(4), checks(
+						256) {
+		}
+		void setMetric(DescriptorMetric m) {
+			metric = m;
+		}
+		//Lowe ratio between best and second best distance. 1 or more disables the test.
+		void setRatio(float r) {
+			ratio = r;
+		}
+		void setCrossCheck(bool c) {
+			crossCheck = c;
+		}
+		//Number of randomized trees and the number of descriptors compared per query in approximate search.
+		void setApproximate(bool a, int numTrees = 4, int maxChecks = 256) {
+			std::lock_guard<std::mutex> guard(forestLock);
+			approximate = a;
+			if (trees != numTrees)
+				forests.clear();
+			trees = numTrees;
+			checks = maxChecks;
+		}
+		/*
+		 * k nearest train rows for every query row, sorted by distance. The result has
+		 * query.getRows()*k entries; missing neighbors have train=-1.
+		 */
+		void knn(const DescriptorMatrix& query, const DescriptorMatrix& train, int k,
+				std::vector<DescriptorMatch>& out) const;
+		/*
+		 * Best match per query that passes the ratio test and optional cross check. The cross
+		 * check only searches back from train rows that were picked as a best match.
+		 */
+		void match(const DescriptorMatrix& query, const DescriptorMatrix& train,
+				std::vector<DescriptorMatch>& matches) const;
+		//Converts on every call, keep a DescriptorMatrix to reuse the train set's forest.
+		void match(const std::vector<SiftDescriptor>& query, const std::vector<SiftDescriptor>& train,
+				std::vector<DescriptorMatch>& matches) const {
+			match(DescriptorMatrix(query), DescriptorMatrix(train), matches);
+		}
+		void match(const std::vector<DaisyDescriptor>& query, const std::vector<DaisyDescriptor>& train,
+				std::vector<DescriptorMatch>& matches) const {
+			match(DescriptorMatrix(query), DescriptorMatrix(train), matches);
+		}
+	};
+}
+#endif /* INCLUDE_VISION_DESCRIPTORMATCHER_H_ */
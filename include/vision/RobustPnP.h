@@ -0,0 +1,117 @@
+/*
+ * Copyright(C) 2018, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef INCLUDE_VISION_ROBUSTPNP_H_
+#define INCLUDE_VISION_ROBUSTPNP_H_
+#include <AlloyVector.h>
+#include <AlloyCamera.h>
+#include <AlignedAllocator.h>
+#include <vector>
+#include <cstdint>
+namespace aly {
+	bool SANITY_CHECK_ROBUST_PNP();
+	/*
+	 * Robust camera pose from 2D-3D correspondences. Minimal sets are drawn in
+	 * batches and solved with EPnP in parallel, every hypothesis is scored
+	 * against all correspondences with a truncated (MSAC) reprojection cost, and
+	 * the best pose is refined with EPnP on its inliers. When the
+	 * correspondences are sorted from best to worst match, PROSAC sampling
+	 * draws from the most promising subset first.
+	 */
+	class RobustPnP {
+	protected:
+		float threshold;
+		float confidence;
+		int maxIterations;
+		int sampleSize;
+		int batchSize;
+		int refineIterations;
+		bool prosac;
+		uint32_t seed;
+		float4x4 pose;
+		std::vector<int> inliers;
+		int iterations;
+		float cost;
+		// Structure of arrays, padded to a multiple of 4 for the scoring kernel.
+		std::vector<float, aligned_allocator<float, 16>> X, Y, Z, U, V;
+		float fu, fv, uc, vc;
+		int count;
+		float score(const float R[3][3], const float t[3], int* inlierCount) const;
+		void findInliers(const float R[3][3], const float t[3], std::vector<int>& result) const;
+	public:
+		RobustPnP(float threshold = 2.0f, float confidence = 0.99f, int maxIterations = 1000) :
+				threshold(threshold), confidence(confidence), maxIterations(maxIterations), sampleSize(5), batchSize(
+						64), refineIterations(3), prosac(false), seed(0), pose(float4x4::identity()), iterations(0), cost(
+						0.0f), fu(1.0f), fv(1.0f), uc(0.0f), vc(0.0f), count(0) {
+		}
+		//Maximum reprojection error in pixels for a correspondence to count as an inlier.
+		void setThreshold(float t) {
+			threshold = t;
+		}
+		//Probability that at least one drawn sample is outlier free. Controls early termination.
+		void setConfidence(float c) {
+			confidence = c;
+		}
+		void setMaxIterations(int n) {
+			maxIterations = n;
+		}
+		//Correspondences per hypothesis, at least 4.
+		void setSampleSize(int n) {
+			sampleSize = n;
+		}
+		//Hypotheses that are solved and scored in parallel before checking for termination.
+		void setBatchSize(int n) {
+			batchSize = n;
+		}
+		void setRefineIterations(int n) {
+			refineIterations = n;
+		}
+		//Enable when correspondences are sorted by decreasing match quality.
+		void setProgressiveSampling(bool p) {
+			prosac = p;
+		}
+		void setSeed(uint32_t s) {
+			seed = s;
+		}
+		/*
+		 * Estimates the world to camera pose. Returns false if there are fewer
+		 * correspondences than the sample size or no hypothesis has any inliers.
+		 */
+		bool solve(const Vector3f& pts, const Vector2f& pxs, const CameraProjector& view);
+		const float4x4& getPose() const {
+			return pose;
+		}
+		const std::vector<int>& getInliers() const {
+			return inliers;
+		}
+		//Number of hypotheses evaluated by the last call to solve().
+		int getIterations() const {
+			return iterations;
+		}
+		//Mean truncated squared reprojection error of the final pose.
+		float getCost() const {
+			return cost;
+		}
+	};
+	float4x4 SolvePnPRansac(const Vector3f& pts, const Vector2f& pxs, const CameraProjector& view,
+			std::vector<int>& inliers, float threshold = 2.0f, bool prosac = false);
+}
+#endif /* INCLUDE_VISION_ROBUSTPNP_H_ */
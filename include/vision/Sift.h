@@ -92,10 +92,35 @@ struct SiftOptions {
 	 */
 	float inherentBlurSigma;
 
+	/**
+	 * Keeps the gray, DoG, gradient and orientation images of every octave
+	 * after solving so they can be queried with getOctaves(). Defaults to
+	 * false, in which case each scale level is released as soon as the
+	 * pipeline no longer needs it and peak memory is bounded by a single
+	 * octave.
+	 */
+	bool retainOctaves;
+
+	/**
+	 * Enables tiled processing for images wider or taller than this many
+	 * pixels. Each tile is processed independently with an overlapping
+	 * apron and only keeps the features whose centers fall inside its core
+	 * region. Defaults to 0, which disables tiling. Octaves are never
+	 * retained in tiled mode.
+	 */
+	int tileSize;
+
+	/**
+	 * Apron width in input pixels around each tile. The default is computed
+	 * if the given value is negative, and covers the blur support and the
+	 * descriptor window of the coarsest octave.
+	 */
+	int tileOverlap;
+
 	SiftOptions(void) :
 			samplesPerOctave(3), minOctave(0), maxOctave(4), contrastThreshold(
 					-1.0f), edgeRatioThreshold(10.0f), baseBlurSigma(1.6f), inherentBlurSigma(
-					0.5f) {
+					0.5f), retainOctaves(false), tileSize(0), tileOverlap(-1) {
 	}
 };
 
@@ -231,18 +256,28 @@ public:
 
 
 protected:
-	void create(void);
-	void add(const aly::Image1f& image, float has_sigma, float target_sigma);
-	void extremaDetection(void);
-	std::size_t extremaDetection(const aly::Image1f* s[3], int oi, int si);
-	void keypointLocalization(void);
+	void solveTiled(bool generateDescriptors);
+	void processImage(const aly::Image1f& image, const aly::int2& offset,
+			const aly::int2& coreMin, const aly::int2& coreMax,
+			bool generateDescriptors, bool retain);
+	void processOctave(const aly::Image1f& image, float has_sigma, int oi,
+			const aly::int2& offset, const aly::int2& coreMin,
+			const aly::int2& coreMax, bool generateDescriptors, bool retain,
+			aly::Image1f& next);
+	void extremaDetection(const aly::Image1f* s[3], int oi, int si,
+			Keypoints& result);
+	void keypointLocalization(const aly::Image1f* dogs[3], Keypoints& kps);
 
-	void descriptorGeneration(void);
-	void generateFeatureImages(Octave* octave);
-	void orientationAssignment(SiftKeypoint const& kp, Octave const* octave,
+	void descriptorGeneration(const Keypoints& kps,
+			const aly::Image1f& grad, const aly::Image1f& ori,
+			const aly::int2& offset, SiftDescriptors& result);
+	void generateFeatureImages(const aly::Image1f& img, aly::Image1f& grad,
+			aly::Image1f& ori);
+	void orientationAssignment(SiftKeypoint const& kp,
+			const aly::Image1f& grad, const aly::Image1f& ori,
 			std::vector<float>& orientations);
 	bool descriptorAssignment(SiftKeypoint const& kp, SiftDescriptor& desc,
-			Octave const* octave);
+			const aly::Image1f& grad, const aly::Image1f& ori);
 
 	float keypointRelativeScale(SiftKeypoint const& kp);
 	float keypointAbsoluteScale(SiftKeypoint const& kp);
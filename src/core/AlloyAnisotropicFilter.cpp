@@ -20,8 +20,8 @@
  */
 #include <AlloyAnisotropicFilter.h>
 #include <AlloyImage.h>
-#include <AlloySparseMatrix.h>
-#include <AlloySparseSolve.h>
+#include <AlloyStencilSolve.h>
+#include <AlloyResultCache.h>
 namespace aly {
 template<int C> void AnisotropicDiffusionT(
 		const Image<float, C, ImageType::FLOAT>& imageIn,
@@ -34,42 +34,32 @@ template<int C> void AnisotropicDiffusionT(
 	const float sigma = 1.2f;
 	float kernelGX[M][N];
 	float kernelGY[M][N];
-	float kernelL[M][N];
 
 	GaussianKernelDerivative(kernelGX, kernelGY, sigma, sigma);
-	GaussianKernelLaplacian(kernelL, sigma, sigma);
-	aly::Image<float, C, ImageType::FLOAT> imageGx(imageIn.width,
-			imageIn.height);
-	aly::Image<float, C, ImageType::FLOAT> imageGy(imageIn.width,
-			imageIn.height);
-	aly::Image<float, C, ImageType::FLOAT> imageL(imageIn.width,
-			imageIn.height);
 	aly::Image<float, C, ImageType::FLOAT> imageC(imageIn.width,
 			imageIn.height);
 	out = imageIn;
 	const float ZERO_TOLERANCE = 1E-6f;
-	int R = (int) (imageIn.width * imageIn.height);
-	aly::SparseMatrix<float,C> A(R, R);
-	Vector<float,C> b;
+	//Relative residual at which the implicit step is considered solved.
+	const float SOLVER_TOLERANCE = 1E-6f;
+	StencilSystem<float, C> A;
+	A.resize(imageIn.width, imageIn.height);
+	A.offDiagonal.resize(A.size() * 4);
+	std::vector<vec<float, C>> b;
 	for (int iter = 0; iter < iterations; iter++) {
 #pragma omp parallel for
 		for (int j = 0; j < imageIn.height; j++) {
 			for (int i = 0; i < imageIn.width; i++) {
 				vec<float, C> gX(0.0f);
 				vec<float, C> gY(0.0f);
-				vec<float, C> L(0.0f);
 				for (int ii = 0; ii < M; ii++) {
 					for (int jj = 0; jj < N; jj++) {
 						vec<float, C> val = out((int) (i + ii - M / 2),
 								(int) (j + jj - N / 2));
 						gX += kernelGX[ii][jj] * val;
 						gY += kernelGY[ii][jj] * val;
-						L += kernelL[ii][jj] * val;
 					}
 				}
-				imageGx(i, j) = gX;
-				imageGy(i, j) = gY;
-				imageL(i, j) = L;
 				vec<float, C> score(0.0f);
 				if (kernel == AnisotropicKernel::Gaussian) {
 					vec<float, C> mag = gX * gX + gY * gY;
@@ -98,40 +88,37 @@ template<int C> void AnisotropicDiffusionT(
 				imageC(i, j) = score;
 			}
 		}
+		//Stencil coefficients ordered -y, -x, +x, +y to match StencilSystem.
+#pragma omp parallel for
 		for (int j = 0; j < imageIn.height ; j++) {
 			for (int i = 0; i < imageIn.width ; i++) {
 				int n11 = i + j * imageIn.width;
-				int n01 = (i - 1) + j * imageIn.width;
-				int n21 = (i + 1) + j * imageIn.width;
-				int n10 = i + (j - 1) * imageIn.width;
-				int n12 = i + (j + 1) * imageIn.width;
 				vec<float, C> score=imageC(i, j);
-				//vec<float, C> cX=0.5f*(imageC(i+1,j)-imageC(i-1,j));
-				//vec<float, C> cY=0.5f*(imageC(i,j+1)-imageC(i,j-1));
 				if(C>1)out(i, j) = clamp(out(i, j), vec<float, C>(0.0f), vec<float, C>(1.0f));
-				vec<float, C> cX(0.0f);
-				vec<float, C> cY(0.0f);
-				for (int ii = 0; ii < M; ii++) {
-					for (int jj = 0; jj < N; jj++) {
-						vec<float, C> val = imageC((int) (i + ii - M / 2),(int) (j + jj - N / 2));
-						cX += kernelGX[ii][jj] * val;
-						cY += kernelGY[ii][jj] * val;
-					}
-				}
-
+				vec<float, C>* coeff = &A.offDiagonal[n11 * 4];
 				if(i>0&&j>0&&i<imageIn.width-1&&j<imageIn.height-1){
-					A.set(n11, n11,   score*dt+1.0f);
-					A.set(n11, n01,  -(-0.5f*cX+0.25f*score)*dt);
-					A.set(n11, n21,  -( 0.5f*cX+0.25f*score)*dt);
-					A.set(n11, n10,  -(-0.5f*cY+0.25f*score)*dt);
-					A.set(n11, n12,  -( 0.5f*cY+0.25f*score)*dt);
+					vec<float, C> cX(0.0f);
+					vec<float, C> cY(0.0f);
+					for (int ii = 0; ii < M; ii++) {
+						for (int jj = 0; jj < N; jj++) {
+							vec<float, C> val = imageC((int) (i + ii - M / 2),(int) (j + jj - N / 2));
+							cX += kernelGX[ii][jj] * val;
+							cY += kernelGY[ii][jj] * val;
+						}
+					}
+					A.diagonal[n11] = score*dt+1.0f;
+					coeff[0] = -(-0.5f*cY+0.25f*score)*dt;
+					coeff[1] = -(-0.5f*cX+0.25f*score)*dt;
+					coeff[2] = -( 0.5f*cX+0.25f*score)*dt;
+					coeff[3] = -( 0.5f*cY+0.25f*score)*dt;
 				} else {
-					A.set(n11, n11, 1.0f);
+					A.diagonal[n11] = vec<float, C>(1.0f);
+					coeff[0] = coeff[1] = coeff[2] = coeff[3] = vec<float, C>(0.0f);
 				}
 			}
 		}
-		b=out.vector;
-		SolveVecCG(b,A,out.vector,32, 1E-16f);
+		b=out.data;
+		SolveStencilCG(A, b, out.data, 32, SOLVER_TOLERANCE);
 	}
 	if(C>1){
 		for (int j = 0; j < imageIn.height ; j++) {
@@ -165,6 +152,34 @@ void AnisotropicDiffusion(const Image4f& imageIn, Image4f& out, int iterations,
 	const AnisotropicKernel& kernel, float K, float dt) {
 AnisotropicDiffusionT(imageIn, out, iterations, kernel, K, dt);
 }
+template<class T, int C, ImageType I> void AnisotropicDiffusionCached(ResultCache& cache,
+	const Image<T, C, I>& imageIn, Image<T, C, I>& out, int iterations,
+	const AnisotropicKernel& kernel, float K, float dt) {
+	cache.compute(MakeCacheKey("AnisotropicDiffusion", ContentKey(imageIn), iterations, (int) kernel, K, dt), out,
+		[&](Image<T, C, I>& result) {
+		AnisotropicDiffusion(imageIn, result, iterations, kernel, K, dt);
+	});
+}
+void AnisotropicDiffusion(ResultCache& cache, const Image1us& imageIn, Image1us& out, int iterations,
+	const AnisotropicKernel& kernel, float K, float dt) {
+AnisotropicDiffusionCached(cache, imageIn, out, iterations, kernel, K, dt);
+}
+void AnisotropicDiffusion(ResultCache& cache, const Image1f& imageIn, Image1f& out, int iterations,
+	const AnisotropicKernel& kernel, float K, float dt) {
+AnisotropicDiffusionCached(cache, imageIn, out, iterations, kernel, K, dt);
+}
+void AnisotropicDiffusion(ResultCache& cache, const Image2f& imageIn, Image2f& out, int iterations,
+	const AnisotropicKernel& kernel, float K, float dt) {
+AnisotropicDiffusionCached(cache, imageIn, out, iterations, kernel, K, dt);
+}
+void AnisotropicDiffusion(ResultCache& cache, const Image3f& imageIn, Image3f& out, int iterations,
+	const AnisotropicKernel& kernel, float K, float dt) {
+AnisotropicDiffusionCached(cache, imageIn, out, iterations, kernel, K, dt);
+}
+void AnisotropicDiffusion(ResultCache& cache, const Image4f& imageIn, Image4f& out, int iterations,
+	const AnisotropicKernel& kernel, float K, float dt) {
+AnisotropicDiffusionCached(cache, imageIn, out, iterations, kernel, K, dt);
+}
 
 }
 
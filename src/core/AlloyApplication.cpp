@@ -686,7 +686,10 @@ void Application::run(int swapInterval) {
 		if (context->dirtyLayout) {
 			context->dirtyLayout = false;
 			context->dirtyCursorLocator = true;
+			context->clearDirtyRegions();
 			rootRegion.pack();
+		} else {
+			context->packDirtyRegions(rootRegion);
 		}
 		draw();
 		context->update(rootRegion);
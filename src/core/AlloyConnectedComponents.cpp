@@ -0,0 +1,344 @@
+/*
+* Copyright(C) 2015, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#include "AlloyConnectedComponents.h"
+#include <atomic>
+namespace aly {
+	namespace detail {
+		/*
+		 Lock-free union-find in the style of Anderson and Woll. A root is always linked
+		 to a smaller root, so parents never increase and the root of every set is the
+		 first element of the set in scan order.
+		 */
+		inline int FindRoot(std::atomic<int>* parents, int x) {
+			int p = parents[x].load(std::memory_order_relaxed);
+			while (p != x) {
+				int gp = parents[p].load(std::memory_order_relaxed);
+				if (gp != p) {
+					//Path halving, failure only means another thread already compressed it.
+					parents[x].compare_exchange_weak(p, gp, std::memory_order_relaxed);
+				}
+				x = gp;
+				p = parents[x].load(std::memory_order_relaxed);
+			}
+			return x;
+		}
+		inline void UnionRoots(std::atomic<int>* parents, int a, int b) {
+			while (true) {
+				a = FindRoot(parents, a);
+				b = FindRoot(parents, b);
+				if (a == b)
+					return;
+				if (a > b)
+					std::swap(a, b);
+				int expected = b;
+				if (parents[b].compare_exchange_strong(expected, a)) {
+					return;
+				}
+			}
+		}
+		//Offsets to neighbors that precede a voxel in scan order.
+		std::vector<int3> GetBackwardOffsets(Connectivity connectivity) {
+			std::vector<int3> offsets;
+			switch (connectivity) {
+			case Connectivity::Four:
+				offsets = { int3(-1, 0, 0), int3(0, -1, 0) };
+				break;
+			case Connectivity::Eight:
+				offsets = { int3(-1, 0, 0), int3(-1, -1, 0), int3(0, -1, 0), int3(1, -1, 0) };
+				break;
+			case Connectivity::Six:
+				offsets = { int3(-1, 0, 0), int3(0, -1, 0), int3(0, 0, -1) };
+				break;
+			case Connectivity::TwentySix:
+				for (int k = -1; k <= 0; k++) {
+					for (int j = -1; j <= 1; j++) {
+						for (int i = -1; i <= 1; i++) {
+							if (k < 0 || j < 0 || (j == 0 && i < 0)) {
+								offsets.push_back(int3(i, j, k));
+							}
+						}
+					}
+				}
+				break;
+			}
+			return offsets;
+		}
+		int LabelComponents(const int* labels, int* outLabels, const int3& dims, const int3& blockSize, Connectivity connectivity, bool ignoreNegative, std::vector<ConnectedComponent3D>& components) {
+			const std::vector<int3> offsets = GetBackwardOffsets(connectivity);
+			const size_t N = (size_t)dims.x*(size_t)dims.y*(size_t)dims.z;
+			const size_t sliceSize = (size_t)dims.x*(size_t)dims.y;
+			const int3 blocks = (dims + blockSize - 1) / blockSize;
+			const int blockCount = blocks.x*blocks.y*blocks.z;
+			components.clear();
+			if (N == 0)
+				return 0;
+			std::vector<std::atomic<int>> parentStore(N);
+			std::atomic<int>* parents = parentStore.data();
+			std::vector<int64_t> linearOffsets;
+			bool useZ = false;
+			for (const int3& off : offsets) {
+				linearOffsets.push_back(off.x + off.y * (int64_t)dims.x + off.z * (int64_t)sliceSize);
+				useZ |= (off.z != 0);
+			}
+			auto unionNeighbors = [&](int i, int j, int k, const int3& b0, const int3& b1, bool inside) {
+				size_t idx = i + j * (size_t)dims.x + k * sliceSize;
+				int l = labels[idx];
+				if (ignoreNegative && l < 0)
+					return;
+				for (const int3& off : offsets) {
+					int3 nbr(i + off.x, j + off.y, k + off.z);
+					if (nbr.x < 0 || nbr.y < 0 || nbr.z < 0 || nbr.x >= dims.x || nbr.y >= dims.y)
+						continue;
+					bool inBlock = (nbr.x >= b0.x && nbr.y >= b0.y && nbr.z >= b0.z && nbr.x < b1.x && nbr.y < b1.y && nbr.z < b1.z);
+					if (inBlock != inside)
+						continue;
+					size_t nidx = nbr.x + nbr.y * (size_t)dims.x + nbr.z * sliceSize;
+					if (labels[nidx] == l) {
+						UnionRoots(parents, (int)nidx, (int)idx);
+					}
+				}
+			};
+#pragma omp parallel
+			{
+				//Label each block independently. Neighbors behind a voxel in scan order are initialized before use.
+#pragma omp for schedule(dynamic)
+				for (int b = 0; b < blockCount; b++) {
+					int3 b0 = int3(b % blocks.x, (b / blocks.x) % blocks.y, b / (blocks.x*blocks.y)) * blockSize;
+					int3 b1 = aly::min(b0 + blockSize, dims);
+					for (int k = b0.z; k < b1.z; k++) {
+						for (int j = b0.y; j < b1.y; j++) {
+							const bool interiorRow = (j > b0.y && (!useZ || (k > b0.z && j + 1 < b1.y)));
+							for (int i = b0.x; i < b1.x; i++) {
+								size_t idx = i + j * (size_t)dims.x + k * sliceSize;
+								parents[idx].store((int)idx, std::memory_order_relaxed);
+								if (interiorRow && i > b0.x && i + 1 < b1.x) {
+									//All neighbors are inside the block, skip bounds tests.
+									int l = labels[idx];
+									if (ignoreNegative && l < 0)
+										continue;
+									for (int64_t off : linearOffsets) {
+										if (labels[idx + off] == l) {
+											UnionRoots(parents, (int)(idx + off), (int)idx);
+										}
+									}
+								}
+								else {
+									unionNeighbors(i, j, k, b0, b1, true);
+								}
+							}
+						}
+					}
+				}
+				//Merge across block borders. Only the first slice, the first and last rows and the left and right columns have outside neighbors.
+#pragma omp for schedule(dynamic)
+				for (int b = 0; b < blockCount; b++) {
+					int3 b0 = int3(b % blocks.x, (b / blocks.x) % blocks.y, b / (blocks.x*blocks.y)) * blockSize;
+					int3 b1 = aly::min(b0 + blockSize, dims);
+					for (int k = b0.z; k < b1.z; k++) {
+						for (int j = b0.y; j < b1.y; j++) {
+							if (k == b0.z || j == b0.y || (useZ && j + 1 == b1.y)) {
+								for (int i = b0.x; i < b1.x; i++) {
+									unionNeighbors(i, j, k, b0, b1, false);
+								}
+							}
+							else {
+								unionNeighbors(b0.x, j, k, b0, b1, false);
+								if (b1.x - 1 > b0.x) {
+									unionNeighbors(b1.x - 1, j, k, b0, b1, false);
+								}
+							}
+						}
+					}
+				}
+				//Flatten so every element points directly to its root.
+#pragma omp for
+				for (int64_t idx = 0; idx < (int64_t)N; idx++) {
+					parents[idx].store(FindRoot(parents, (int)idx), std::memory_order_relaxed);
+				}
+			}
+			//Roots precede their members, so a single scan assigns ids and gathers size and bounds.
+			for (int k = 0; k < dims.z; k++) {
+				for (int j = 0; j < dims.y; j++) {
+					size_t idx = j * (size_t)dims.x + k * sliceSize;
+					for (int i = 0; i < dims.x; i++, idx++) {
+						int l = labels[idx];
+						if (ignoreNegative && l < 0) {
+							outLabels[idx] = -1;
+							continue;
+						}
+						int root = parents[idx].load(std::memory_order_relaxed);
+						int cc;
+						if (root == (int)idx) {
+							cc = (int)components.size();
+							ConnectedComponent3D comp(l);
+							comp.bounds.position = int3(i, j, k);
+							components.push_back(comp);
+						}
+						else {
+							cc = outLabels[root];
+						}
+						outLabels[idx] = cc;
+						ConnectedComponent3D& comp = components[cc];
+						comp.count++;
+						comp.bounds.position = aly::min(comp.bounds.position, int3(i, j, k));
+						comp.bounds.dimensions = aly::max(comp.bounds.dimensions, int3(i, j, k));
+					}
+				}
+			}
+			//Dimensions held the max corner during the scan.
+			for (ConnectedComponent3D& comp : components) {
+				comp.bounds.dimensions = comp.bounds.dimensions - comp.bounds.position + int3(1);
+			}
+			return (int)components.size();
+		}
+		template<class T> int LabelTriangleComponents(const T* indexes, size_t indexCount, int N, std::vector<int>& compCounts, std::vector<int>& labels) {
+			compCounts.clear();
+			labels.resize(N);
+			if (N == 0)
+				return 0;
+			std::vector<std::atomic<int>> parentStore(N);
+			std::atomic<int>* parents = parentStore.data();
+			const int64_t faceCount = (int64_t)(indexCount / 3);
+#pragma omp parallel
+			{
+#pragma omp for
+				for (int i = 0; i < N; i++) {
+					parents[i].store(i, std::memory_order_relaxed);
+				}
+#pragma omp for
+				for (int64_t f = 0; f < faceCount; f++) {
+					int v1 = (int)indexes[3 * f];
+					int v2 = (int)indexes[3 * f + 1];
+					int v3 = (int)indexes[3 * f + 2];
+					UnionRoots(parents, v1, v2);
+					UnionRoots(parents, v1, v3);
+				}
+#pragma omp for
+				for (int i = 0; i < N; i++) {
+					parents[i].store(FindRoot(parents, i), std::memory_order_relaxed);
+				}
+			}
+			for (int i = 0; i < N; i++) {
+				int root = parents[i].load(std::memory_order_relaxed);
+				int cc;
+				if (root == i) {
+					cc = (int)compCounts.size();
+					compCounts.push_back(0);
+				}
+				else {
+					cc = labels[root];
+				}
+				labels[i] = cc;
+				compCounts[cc]++;
+			}
+			return (int)compCounts.size();
+		}
+	}
+	int LabelConnectedComponents(const Image1i& labels, Image1i& outLabels, std::vector<ConnectedComponent2D>& components, Connectivity connectivity, bool ignoreNegative) {
+		if (connectivity != Connectivity::Four && connectivity != Connectivity::Eight) {
+			throw std::runtime_error("Image connectivity must be four or eight.");
+		}
+		std::vector<ConnectedComponent3D> comps;
+		outLabels.resize(labels.width, labels.height);
+		detail::LabelComponents(labels.ptr(), outLabels.ptr(), int3(labels.width, labels.height, 1), int3(64, 64, 1), connectivity, ignoreNegative, comps);
+		components.resize(comps.size());
+		for (size_t n = 0; n < comps.size(); n++) {
+			const ConnectedComponent3D& comp = comps[n];
+			ConnectedComponent2D& out = components[n];
+			out.label = comp.label;
+			out.count = comp.count;
+			out.bounds = box2i(comp.bounds.position.xy(), comp.bounds.dimensions.xy());
+		}
+		return (int)components.size();
+	}
+	int LabelConnectedComponents(const Image1i& labels, Image1i& outLabels, std::vector<int>& compCounts, Connectivity connectivity, bool ignoreNegative) {
+		std::vector<ConnectedComponent2D> comps;
+		LabelConnectedComponents(labels, outLabels, comps, connectivity, ignoreNegative);
+		compCounts.resize(comps.size());
+		for (size_t n = 0; n < comps.size(); n++) {
+			compCounts[n] = comps[n].count;
+		}
+		return (int)compCounts.size();
+	}
+	int LabelConnectedComponents(const Volume1i& labels, Volume1i& outLabels, std::vector<ConnectedComponent3D>& components, Connectivity connectivity, bool ignoreNegative) {
+		if (connectivity != Connectivity::Six && connectivity != Connectivity::TwentySix) {
+			throw std::runtime_error("Volume connectivity must be six or twenty-six.");
+		}
+		outLabels.resize(labels.rows, labels.cols, labels.slices);
+		return detail::LabelComponents(labels.ptr(), outLabels.ptr(), int3(labels.rows, labels.cols, labels.slices), int3(32, 32, 32), connectivity, ignoreNegative, components);
+	}
+	int LabelConnectedComponents(const Volume1i& labels, Volume1i& outLabels, std::vector<int>& compCounts, Connectivity connectivity, bool ignoreNegative) {
+		std::vector<ConnectedComponent3D> comps;
+		LabelConnectedComponents(labels, outLabels, comps, connectivity, ignoreNegative);
+		compCounts.resize(comps.size());
+		for (size_t n = 0; n < comps.size(); n++) {
+			compCounts[n] = comps[n].count;
+		}
+		return (int)compCounts.size();
+	}
+	int RemoveSmallConnectedComponents(const Image1i& labels, Image1i& outLabels, int minSize, Connectivity connectivity, bool ignoreNegative) {
+		std::vector<int> compCounts;
+		LabelConnectedComponents(labels, outLabels, compCounts, connectivity, ignoreNegative);
+		int removeCount = 0;
+		for (int& count : compCounts) {
+			if (count < minSize) {
+				count = -1;
+				removeCount++;
+			}
+		}
+#pragma omp parallel for
+		for (int i = 0; i < (int)outLabels.size(); i++) {
+			int l = outLabels[i].x;
+			if (l >= 0 && compCounts[l] < 0) {
+				outLabels[i].x = -1;
+			}
+		}
+		return removeCount;
+	}
+	int RemoveSmallConnectedComponents(const Volume1i& labels, Volume1i& outLabels, int minSize, Connectivity connectivity, bool ignoreNegative) {
+		std::vector<int> compCounts;
+		LabelConnectedComponents(labels, outLabels, compCounts, connectivity, ignoreNegative);
+		int removeCount = 0;
+		for (int& count : compCounts) {
+			if (count < minSize) {
+				count = -1;
+				removeCount++;
+			}
+		}
+#pragma omp parallel for
+		for (int64_t i = 0; i < (int64_t)outLabels.size(); i++) {
+			int l = outLabels[i].x;
+			if (l >= 0 && compCounts[l] < 0) {
+				outLabels[i].x = -1;
+			}
+		}
+		return removeCount;
+	}
+	int LabelTriangleComponents(const std::vector<uint3>& faces, int N, std::vector<int>& compCounts, std::vector<int>& labels) {
+		return detail::LabelTriangleComponents((faces.size() > 0) ? &faces[0][0] : nullptr, 3 * faces.size(), N, compCounts, labels);
+	}
+	int LabelTriangleComponents(const std::vector<size_t>& indexes, int N, std::vector<int>& compCounts, std::vector<int>& labels) {
+		return detail::LabelTriangleComponents(indexes.data(), indexes.size(), N, compCounts, labels);
+	}
+	int LabelTriangleComponents(const std::vector<int>& indexes, int N, std::vector<int>& compCounts, std::vector<int>& labels) {
+		return detail::LabelTriangleComponents(indexes.data(), indexes.size(), N, compCounts, labels);
+	}
+}
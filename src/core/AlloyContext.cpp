@@ -31,6 +31,7 @@
 
 #include <iostream>
 #include <chrono>
+#include <algorithm>
 
 int printOglError(const char *file, int line) {
 
@@ -673,6 +674,50 @@ void AlloyContext::clearEvents(Region* region) {
 			&& (region == onTopRegion || onTopRegion->hasParent(region)))
 		onTopRegion = nullptr;
 }
+void AlloyContext::removeRegion(Region* region) {
+	cursorLocator.remove(region);
+	std::lock_guard<std::mutex> guard(dirtyLock);
+	dirtyRegions.erase(
+			std::remove(dirtyRegions.begin(), dirtyRegions.end(), region),
+			dirtyRegions.end());
+}
+void AlloyContext::packDirtyRegions(Composite& rootNode) {
+	std::vector<Region*> regions;
+	{
+		std::lock_guard<std::mutex> guard(dirtyLock);
+		if (dirtyRegions.size() == 0)
+			return;
+		regions.swap(dirtyRegions);
+	}
+	std::sort(regions.begin(), regions.end());
+	regions.erase(std::unique(regions.begin(), regions.end()), regions.end());
+	std::vector<Region*> packed;
+	for (Region* region : regions) {
+		//Skip regions that are detached or covered by a dirty ancestor.
+		Region* top = region;
+		bool covered = false;
+		while (top->parent != nullptr) {
+			top = top->parent;
+			covered |= std::binary_search(regions.begin(), regions.end(), top);
+		}
+		if (covered || top != &rootNode)
+			continue;
+		Region* target = region;
+		while (target->repack() && target->parent != nullptr) {
+			target = target->parent;
+		}
+		packed.push_back(target);
+	}
+	animator.firePostEvents();
+	for (Region* region : packed) {
+		if (dirtyCursorLocator)
+			break;
+		if (!cursorLocator.update(region)) {
+			dirtyCursorLocator = true;
+		}
+	}
+	dirtyCursor = true;
+}
 Region* AlloyContext::locate(const pixel2& cursor) const {
 	if (onTopRegion != nullptr) {
 		if (onTopRegion->isVisible()) {
@@ -776,6 +821,9 @@ void AlloyContext::update(Composite& rootNode) {
 		animator.firePostEvents();
 		dirtyCursorLocator = true;
 		dirtyLayout = false;
+		clearDirtyRegions();
+	} else {
+		packDirtyRegions(rootNode);
 	}
 
 }
@@ -20,37 +20,177 @@
  */
 #include "AlloyCursorLocator.h"
 #include "AlloyUI.h"
+#include <algorithm>
 namespace aly {
+const int CursorLocator::MIN_ROWS;
+const int CursorLocator::MIN_COLS;
+const int CursorLocator::MAX_CELLS;
 void CursorLocator::reset(int2 viewportDims) {
 	//std::lock_guard<std::mutex> lockMe(lock);
-	cellSize.x = std::max((pixel) 1, viewportDims.x / (pixel) ROWS);
-	cellSize.y = std::max((pixel) 1, viewportDims.y / (pixel) COLS);
-	for (int j = 0; j < COLS; j++) {
-		for (int i = 0; i < ROWS; i++) {
-			grid[i][j].clear();
+	size_t count = indexedCount;
+	entries.clear();
+	lookup.clear();
+	indexedCount = 0;
+	viewport = viewportDims;
+	current.clear();
+	counters.assign(1, 0);
+	last = nullptr;
+	resizeGrid(count);
+}
+void CursorLocator::resizeGrid(size_t count) {
+	sizedFor = std::max(count, (size_t) (MIN_ROWS * MIN_COLS));
+	pixel2 dims = aly::max(pixel2(viewport), pixel2(1.0f));
+	//Roughly one region per cell, with square cells.
+	float side = std::sqrt(
+			dims.x * dims.y / (float) std::min(sizedFor, (size_t) MAX_CELLS));
+	gridDims.x = clamp((int) std::ceil(dims.x / side), MIN_ROWS, 256);
+	gridDims.y = clamp((int) std::ceil(dims.y / side), MIN_COLS, 256);
+	cellSize = aly::max(pixel2(1.0f), dims / pixel2(gridDims));
+	grid.assign(gridDims.x * gridDims.y, std::vector<const Node*>());
+	for (Node& node : entries) {
+		if (node.second.indexed) {
+			insert(&node);
 		}
 	}
 }
-void CursorLocator::add(Region* region) {
-	box2px bounds = region->getCursorBounds();
-	if (bounds.dimensions.x * bounds.dimensions.y == 0)
-		return;
-	int2 start = clamp(int2(bounds.position / cellSize), lowerBounds,
+void CursorLocator::insert(Node* node) {
+	Entry& entry = node->second;
+	const int2 lowerBounds(0, 0);
+	const int2 upperBounds = gridDims - int2(1, 1);
+	entry.start = clamp(int2(entry.bounds.position / cellSize), lowerBounds,
 			upperBounds);
-	int2 end = clamp(int2((bounds.position + bounds.dimensions) / cellSize),
+	entry.end = clamp(
+			int2((entry.bounds.position + entry.bounds.dimensions) / cellSize),
 			lowerBounds, upperBounds);
-	for (int j = (int) start.y; j <= (int) end.y; j++) {
-		for (int i = (int) start.x; i <= (int) end.x; i++) {
-			grid[i][j].push_front(region);
+	for (int j = entry.start.y; j <= entry.end.y; j++) {
+		for (int i = entry.start.x; i <= entry.end.x; i++) {
+			std::vector<const Node*>& list = cell(i, j);
+			//Full rebuilds visit regions in key order and append.
+			if (list.empty() || list.back()->first < node->first) {
+				list.push_back(node);
+			} else {
+				list.insert(
+						std::lower_bound(list.begin(), list.end(), node,
+								[](const Node* a, const Node* b) {
+									return a->first < b->first;
+								}), node);
+			}
 		}
 	}
 }
+void CursorLocator::discard(const Node* node) {
+	const Entry& entry = node->second;
+	if (entry.indexed) {
+		for (int j = entry.start.y; j <= entry.end.y; j++) {
+			for (int i = entry.start.x; i <= entry.end.x; i++) {
+				std::vector<const Node*>& list = cell(i, j);
+				auto pos = std::lower_bound(list.begin(), list.end(), node,
+						[](const Node* a, const Node* b) {
+							return a->first < b->first;
+						});
+				if (pos != list.end() && *pos == node) {
+					list.erase(pos);
+				}
+			}
+		}
+		indexedCount--;
+	}
+	auto found = lookup.find(entry.region);
+	if (found != lookup.end() && found->second == node) {
+		lookup.erase(found);
+	}
+	if (last == node) {
+		last = nullptr;
+	}
+}
+void CursorLocator::add(Region* region, bool hitTest) {
+	Key key = current;
+	key.push_back(counters.back()++);
+	auto result = entries.emplace(key, Entry());
+	if (!result.second) {
+		discard(&(*result.first));
+	}
+	Node* node = &(*result.first);
+	Entry& entry = node->second;
+	entry.region = region;
+	entry.indexed = false;
+	lookup[region] = node;
+	last = node;
+	if (!hitTest)
+		return;
+	entry.bounds = region->getCursorBounds();
+	if (entry.bounds.dimensions.x * entry.bounds.dimensions.y == 0)
+		return;
+	entry.indexed = true;
+	indexedCount++;
+	if (indexedCount > 4 * sizedFor) {
+		resizeGrid(indexedCount);
+	} else {
+		insert(node);
+	}
+}
+void CursorLocator::push() {
+	if (last != nullptr) {
+		current = last->first;
+	} else {
+		current.push_back(counters.back()++);
+	}
+	counters.push_back(0);
+}
+void CursorLocator::pop() {
+	current.pop_back();
+	counters.pop_back();
+}
+bool CursorLocator::update(Region* region) {
+	auto found = lookup.find(region);
+	if (found == lookup.end())
+		return false;
+	const Key key = found->second->first;
+	//The ancestors must still hold the prefixes of the key, otherwise the region has moved.
+	Region* parent = region->parent;
+	for (size_t d = key.size() - 1; d > 0; d--, parent = parent->parent) {
+		if (parent == nullptr)
+			return false;
+		auto pf = lookup.find(parent);
+		if (pf == lookup.end() || pf->second->first.size() != d
+				|| !std::equal(key.begin(), key.begin() + d,
+						pf->second->first.begin()))
+			return false;
+	}
+	if (parent != nullptr)
+		return false;
+	Key end = key;
+	end.back()++;
+	auto first = entries.lower_bound(key);
+	auto stop = entries.lower_bound(end);
+	for (auto iter = first; iter != stop; iter++) {
+		discard(&(*iter));
+	}
+	entries.erase(first, stop);
+	current.assign(key.begin(), key.end() - 1);
+	counters.assign(key.size(), 0);
+	counters.back() = key.back();
+	last = nullptr;
+	region->updateCursor(this);
+	return true;
+}
+void CursorLocator::remove(Region* region) {
+	auto found = lookup.find(region);
+	if (found == lookup.end())
+		return;
+	const Node* node = found->second;
+	auto iter = entries.find(node->first);
+	discard(node);
+	entries.erase(iter);
+}
 Region* CursorLocator::locate(const pixel2& cursor) const {
 	if (cursor.x < 0 || cursor.y < 0)
 		return nullptr;
-	int2 query = clamp(int2(cursor / cellSize), lowerBounds, upperBounds);
-	for (Region* region : grid[(int) query.x][(int) query.y]) {
-		Region* over = region->locate(cursor);
+	int2 query = clamp(int2(cursor / cellSize), int2(0, 0),
+			gridDims - int2(1, 1));
+	const std::vector<const Node*>& list = cell(query.x, query.y);
+	for (auto iter = list.rbegin(); iter != list.rend(); iter++) {
+		Region* over = (*iter)->second.region->locate(cursor);
 		if (over != nullptr)
 			return over;
 	}
@@ -58,4 +198,3 @@ Region* CursorLocator::locate(const pixel2& cursor) const {
 }
 
 }
-
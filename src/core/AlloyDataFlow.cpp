@@ -3280,9 +3280,7 @@ namespace aly {
 			}
 			routingLock.lock();
 			router.update();
-			for (ConnectionPtr& connect : data->connections) {
-				router.evaluate(connect);
-			}
+			router.evaluate(data->connections);
 			Connection* c = closestConnection((AlloyApplicationContext()->getCursorPosition() - getDrawOffset()), std::max(4.0f * scale, 1.0f));
 			selectedConnection = c;
 			routingLock.unlock();
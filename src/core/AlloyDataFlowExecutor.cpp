@@ -0,0 +1,274 @@
+/*
+ * Copyright(C) 2018, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "AlloyDataFlowExecutor.h"
+#include <chrono>
+#include <deque>
+#include <set>
+namespace aly {
+namespace dataflow {
+Executor::Executor(TaskPriority priority) :
+		priority(priority) {
+}
+Executor::Executor(const std::shared_ptr<Group>& graph, TaskPriority priority) :
+		Executor(priority) {
+	setGraph(graph);
+}
+void Executor::setGraph(const std::shared_ptr<Group>& graph) {
+	setGraph(graph->getNodes());
+}
+void Executor::setGraph(const std::vector<std::shared_ptr<Node>>& graphNodes) {
+	std::lock_guard<std::mutex> lockGuard(lock);
+	std::vector<std::shared_ptr<Node>> flat;
+	for (const std::shared_ptr<Node>& node : graphNodes) {
+		if (node->getType() == NodeType::Group) {
+			for (const std::shared_ptr<Node>& child : std::dynamic_pointer_cast<Group>(node)->getAllChildrenNodes()) {
+				if (child->getType() != NodeType::Group) {
+					flat.push_back(child);
+				}
+			}
+		} else {
+			flat.push_back(node);
+		}
+	}
+	//Build the new schedule on the side so a rejected graph leaves the current one intact.
+	std::vector<std::unique_ptr<Task>> newTasks;
+	std::map<const Node*, int> newIndex;
+	for (const std::shared_ptr<Node>& node : flat) {
+		if (newIndex.find(node.get()) != newIndex.end()) {
+			continue;
+		}
+		newIndex[node.get()] = (int) newTasks.size();
+		std::unique_ptr<Task> task(new Task());
+		task->node = node.get();
+		//Keep state of nodes that survive the edit. The old node list is still held, so pointers cannot be reused yet.
+		auto iter = taskIndex.find(node.get());
+		if (iter != taskIndex.end()) {
+			task->dirty = tasks[iter->second]->dirty;
+			task->timing = tasks[iter->second]->timing;
+		}
+		newTasks.push_back(std::move(task));
+	}
+	buildTasks(newTasks, newIndex);
+	std::vector<int> order = sortTasks(newTasks);
+	if (order.size() != newTasks.size()) {
+		throw std::runtime_error("DataFlow graph cannot be executed because its connections form a cycle.");
+	}
+	//New nodes start dirty, so restore the invariant that everything downstream of a dirty node is dirty.
+	for (int i : order) {
+		if (newTasks[i]->dirty) {
+			for (int d : newTasks[i]->downstream) {
+				newTasks[d]->dirty = true;
+			}
+		}
+	}
+	tasks.swap(newTasks);
+	taskIndex.swap(newIndex);
+	nodes = flat;
+}
+void Executor::buildTasks(std::vector<std::unique_ptr<Task>>& tasks, const std::map<const Node*, int>& taskIndex) {
+	for (std::unique_ptr<Task>& task : tasks) {
+		Node* node = task->node;
+		std::vector<std::shared_ptr<InputPort>> ports = node->getInputPorts();
+		if (node->getInputPort().get() != nullptr) {
+			ports.push_back(node->getInputPort());
+		}
+		std::set<int> upstream;
+		for (const std::shared_ptr<InputPort>& input : ports) {
+			//Connections from outside a group attach to the group's port, which is the proxy of this one.
+			for (Port* port = input.get(); port != nullptr; port = port->getProxyIn().get()) {
+				for (const std::shared_ptr<Connection>& connection : port->getConnections()) {
+					if (connection->destination.get() != port) {
+						continue;
+					}
+					Port* source = connection->source.get();
+					while (source->getNode() != nullptr && source->getNode()->getType() == NodeType::Group && source->hasProxyOut()) {
+						source = source->getProxyOut().get();
+					}
+					OutputPort* output = dynamic_cast<OutputPort*>(source);
+					auto iter = taskIndex.find(source->getNode());
+					if (output == nullptr || iter == taskIndex.end()) {
+						continue;
+					}
+					task->inputs.push_back(std::pair<InputPort*, OutputPort*>(input.get(), output));
+					upstream.insert(iter->second);
+				}
+			}
+		}
+		task->upstream.assign(upstream.begin(), upstream.end());
+		task->downstream.clear();
+	}
+	for (int i = 0; i < (int) tasks.size(); i++) {
+		for (int u : tasks[i]->upstream) {
+			tasks[u]->downstream.push_back(i);
+		}
+	}
+}
+std::vector<int> Executor::sortTasks(const std::vector<std::unique_ptr<Task>>& tasks) {
+	std::vector<int> degree(tasks.size());
+	std::deque<int> ready;
+	for (int i = 0; i < (int) tasks.size(); i++) {
+		degree[i] = (int) tasks[i]->upstream.size();
+		if (degree[i] == 0) {
+			ready.push_back(i);
+		}
+	}
+	std::vector<int> order;
+	while (ready.size() > 0) {
+		int i = ready.front();
+		ready.pop_front();
+		order.push_back(i);
+		for (int d : tasks[i]->downstream) {
+			if (--degree[d] == 0) {
+				ready.push_back(d);
+			}
+		}
+	}
+	return order;
+}
+std::vector<Node*> Executor::getExecutionOrder() const {
+	std::vector<Node*> order;
+	for (int i : sortTasks(tasks)) {
+		order.push_back(tasks[i]->node);
+	}
+	return order;
+}
+void Executor::markDirty(int index) {
+	//Dirty nodes are closed under downstream, so the walk stops at the first dirty node it meets.
+	std::vector<int> stack = { index };
+	while (stack.size() > 0) {
+		int i = stack.back();
+		stack.pop_back();
+		tasks[i]->dirty = true;
+		for (int d : tasks[i]->downstream) {
+			if (!tasks[d]->dirty) {
+				stack.push_back(d);
+			}
+		}
+	}
+}
+void Executor::setValue(const std::shared_ptr<OutputPort>& port, const std::shared_ptr<Packet>& packet) {
+	std::lock_guard<std::mutex> lockGuard(lock);
+	port->setValue(packet);
+	auto iter = taskIndex.find(port->getNode());
+	if (iter != taskIndex.end()) {
+		for (int d : tasks[iter->second]->downstream) {
+			markDirty(d);
+		}
+	}
+}
+void Executor::setDirty(const Node* node) {
+	std::lock_guard<std::mutex> lockGuard(lock);
+	auto iter = taskIndex.find(node);
+	if (iter != taskIndex.end()) {
+		markDirty(iter->second);
+	}
+}
+void Executor::setDirty() {
+	std::lock_guard<std::mutex> lockGuard(lock);
+	for (std::unique_ptr<Task>& task : tasks) {
+		task->dirty = true;
+	}
+}
+bool Executor::isDirty(const Node* node) const {
+	auto iter = taskIndex.find(node);
+	return (iter != taskIndex.end() && tasks[iter->second]->dirty);
+}
+NodeTiming Executor::getTiming(const Node* node) const {
+	auto iter = taskIndex.find(node);
+	return (iter != taskIndex.end()) ? tasks[iter->second]->timing : NodeTiming();
+}
+void Executor::executeTask(int index) {
+	Task& task = *tasks[index];
+	if (!task.failed) {
+		try {
+			for (const std::pair<InputPort*, OutputPort*>& input : task.inputs) {
+				input.first->value = input.second->value;
+			}
+			if (task.node->onExecute) {
+				auto start = std::chrono::high_resolution_clock::now();
+				task.node->onExecute(task.node);
+				auto end = std::chrono::high_resolution_clock::now();
+				task.timing.lastMilliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+				task.timing.totalMilliseconds += task.timing.lastMilliseconds;
+				task.timing.executions++;
+				if (onNodeExecuted) {
+					onNodeExecuted(task.node, task.timing);
+				}
+			}
+			task.dirty = false;
+		} catch (std::exception& e) {
+			task.failed = true;
+			std::lock_guard<std::mutex> lockGuard(errorLock);
+			if (error.size() == 0) {
+				error = MakeString() << "Node " << task.node->getLabel() << " failed: " << e.what();
+			}
+		}
+	}
+	for (int d : task.downstream) {
+		Task& next = *tasks[d];
+		if (task.failed) {
+			next.failed = true;
+		}
+		if (--next.pending == 0) {
+			group->run([this, d] {executeTask(d);});
+		}
+	}
+}
+int Executor::execute() {
+	std::lock_guard<std::mutex> lockGuard(lock);
+	std::vector<int> ready;
+	int count = 0;
+	for (int i = 0; i < (int) tasks.size(); i++) {
+		Task& task = *tasks[i];
+		task.failed = false;
+		if (!task.dirty) {
+			continue;
+		}
+		int pending = 0;
+		for (int u : task.upstream) {
+			if (tasks[u]->dirty) {
+				pending++;
+			}
+		}
+		task.pending = pending;
+		if (pending == 0) {
+			ready.push_back(i);
+		}
+		count++;
+	}
+	if (count == 0) {
+		return 0;
+	}
+	error.clear();
+	TaskGroup nodeGroup(priority);
+	group = &nodeGroup;
+	for (int i : ready) {
+		nodeGroup.run([this, i] {executeTask(i);});
+	}
+	nodeGroup.wait();
+	group = nullptr;
+	if (error.size() > 0) {
+		throw std::runtime_error(error);
+	}
+	return count;
+}
+}
+}
@@ -21,8 +21,42 @@
 #include "AlloyDenseSolve.h"
 #include "AlloyFileUtil.h"
 #include "AlloyDistanceField.h"
+#include "AlloyPyramid.h"
 #include <queue>
 namespace aly {
+namespace detail {
+static std::function<bool(int)> MonitorLevel(const std::function<bool(int, int)>& iterationMonitor, int level) {
+	return [=](int iter) {
+		if (iterationMonitor) {
+			return iterationMonitor(level, iter);
+		}
+		else {
+			return true;
+		}
+	};
+}
+/*
+ * Runs solve() from the coarsest level of the pyramid up to level 1. Each
+ * result is upsampled as the initial guess for the next finer level, so img
+ * holds a level 0 sized guess when this returns true.
+ */
+template<class T, int C, ImageType I, class F> bool SolveCoarseToFine(const ImagePyramid<T, C, I>& pyramid, Image<T, C, I>& img,
+		const F& solve, const std::function<bool(int, int)>& iterationMonitor) {
+	Image<T, C, I> next;
+	for (int l = pyramid.getLevelCount() - 1; l >= 1; l--) {
+		if (iterationMonitor) {
+			if (!iterationMonitor(l, 0))
+				return false;
+		}
+		solve(l, img);
+		int2 dims = pyramid.dimensions(l - 1);
+		next.resize(dims.x, dims.y);
+		PyramidUpSample(img, next);
+		img = next;
+	}
+	return true;
+}
+}
 void LaplaceFill(const Image4f& sourceImg, Image4f& targetImg, int iterations,
 		int levels, float lambda,
 		const std::function<bool(int, int)>& iterationMonitor) {
@@ -32,49 +66,30 @@ void LaplaceFill(const Image4f& sourceImg, Image4f& targetImg, int iterations,
 						<< sourceImg.dimensions() << " "
 						<< targetImg.dimensions());
 	if (levels <= 1) {
-		LaplaceFill(sourceImg, targetImg, iterations, lambda, [=](int iter) {
-			if (iterationMonitor) {
-				return iterationMonitor(0, iter);
-			}
-			else {
-				return true;
-			}
-		});
+		LaplaceFill(sourceImg, targetImg, iterations, lambda, detail::MonitorLevel(iterationMonitor, 0));
 	} else {
-		std::vector<Image4f> srcPyramid(levels);
-		std::vector<Image4f> tarPyramid(levels);
-		srcPyramid[0] = sourceImg;
-		tarPyramid[0] = targetImg;
-		for (int l = 1; l < levels; l++) {
-			srcPyramid[l - 1].downSample(srcPyramid[l]);
-			tarPyramid[l - 1].downSample(tarPyramid[l]);
-		}
-		for (int l = levels - 1; l >= 1; l--) {
-			if (iterationMonitor) {
-				if (!iterationMonitor(l, 0))
-					return;
-			}
-			LaplaceFill(srcPyramid[l], tarPyramid[l], iterations, lambda,
-					[=](int iter) {
-						if (iterationMonitor) {
-							return iterationMonitor(l, iter);
-						}
-						else {
-							return true;
-						}
-					});
-			tarPyramid[l].upSample(tarPyramid[l - 1]);
-		}
-		targetImg = tarPyramid[0];
-		LaplaceFill(sourceImg, targetImg, iterations, lambda, [=](int iter) {
-			if (iterationMonitor) {
-				return iterationMonitor(0, iter);
-			}
-			else {
-				return true;
-			}
-		});
+		LaplaceFill(ImagePyramid4f(sourceImg, levels), targetImg, iterations, lambda, iterationMonitor);
+	}
+}
+void LaplaceFill(const ImagePyramid4f& srcPyramid, Image4f& targetImg, int iterations,
+		float lambda, const std::function<bool(int, int)>& iterationMonitor) {
+	if (srcPyramid.dimensions(0) != targetImg.dimensions())
+		throw std::runtime_error(
+				MakeString() << "Cannot solve. Image dimensions do not match "
+						<< srcPyramid.dimensions(0) << " "
+						<< targetImg.dimensions());
+	int levels = srcPyramid.getLevelCount();
+	Image4f src;
+	Image4f tar = ImagePyramid4f(targetImg, levels).getLevel(levels - 1);
+	if (!detail::SolveCoarseToFine(srcPyramid, tar, [&](int l, Image4f& img) {
+		srcPyramid.getLevel(l, src);
+		LaplaceFill(src, img, iterations, lambda, detail::MonitorLevel(iterationMonitor, l));
+	}, iterationMonitor)) {
+		return;
 	}
+	targetImg = tar;
+	srcPyramid.getLevel(0, src);
+	LaplaceFill(src, targetImg, iterations, lambda, detail::MonitorLevel(iterationMonitor, 0));
 }
 namespace detail {
 struct ColorLocation: aly::int2 {
@@ -196,44 +211,30 @@ void LaplaceFill(const Image2f& sourceImg, Image2f& targetImg, int iterations,
 						<< sourceImg.dimensions() << " "
 						<< targetImg.dimensions());
 	if (levels <= 1) {
-		LaplaceFill(sourceImg, targetImg, iterations, lambda, [=](int iter) {
-			return iterationMonitor(0, iter);
-		});
+		LaplaceFill(sourceImg, targetImg, iterations, lambda, detail::MonitorLevel(iterationMonitor, 0));
 	} else {
-		std::vector<Image2f> srcPyramid(levels);
-		std::vector<Image2f> tarPyramid(levels);
-		srcPyramid[0] = sourceImg;
-		tarPyramid[0] = targetImg;
-		for (int l = 1; l < levels; l++) {
-			srcPyramid[l - 1].downSample(srcPyramid[l]);
-			tarPyramid[l - 1].downSample(tarPyramid[l]);
-		}
-		for (int l = levels - 1; l >= 1; l--) {
-			if (iterationMonitor) {
-				if (!iterationMonitor(l, 0))
-					return;
-			}
-			LaplaceFill(srcPyramid[l], tarPyramid[l], iterations, lambda,
-					[=](int iter) {
-						if (iterationMonitor) {
-							return iterationMonitor(l, iter);
-						}
-						else {
-							return true;
-						}
-					});
-			tarPyramid[l].upSample(tarPyramid[l - 1]);
-		}
-		targetImg = tarPyramid[0];
-		LaplaceFill(sourceImg, targetImg, iterations, lambda, [=](int iter) {
-			if (iterationMonitor) {
-				return iterationMonitor(0, iter);
-			}
-			else {
-				return true;
-			}
-		});
+		LaplaceFill(ImagePyramid2f(sourceImg, levels), targetImg, iterations, lambda, iterationMonitor);
+	}
+}
+void LaplaceFill(const ImagePyramid2f& srcPyramid, Image2f& targetImg, int iterations,
+		float lambda, const std::function<bool(int, int)>& iterationMonitor) {
+	if (srcPyramid.dimensions(0) != targetImg.dimensions())
+		throw std::runtime_error(
+				MakeString() << "Cannot solve. Image dimensions do not match "
+						<< srcPyramid.dimensions(0) << " "
+						<< targetImg.dimensions());
+	int levels = srcPyramid.getLevelCount();
+	Image2f src;
+	Image2f tar = ImagePyramid2f(targetImg, levels).getLevel(levels - 1);
+	if (!detail::SolveCoarseToFine(srcPyramid, tar, [&](int l, Image2f& img) {
+		srcPyramid.getLevel(l, src);
+		LaplaceFill(src, img, iterations, lambda, detail::MonitorLevel(iterationMonitor, l));
+	}, iterationMonitor)) {
+		return;
 	}
+	targetImg = tar;
+	srcPyramid.getLevel(0, src);
+	LaplaceFill(src, targetImg, iterations, lambda, detail::MonitorLevel(iterationMonitor, 0));
 }
 void LaplaceFill(const Image2f& sourceImg, Image2f& targetImg, int iterations,
 		float lambda, const std::function<bool(int)>& iterationMonitor) {
@@ -357,54 +358,37 @@ void PoissonInpaint(const Image4f& sourceImg, const Image4f& targetImg,
 						<< targetImg.dimensions());
 	if (levels <= 1) {
 		PoissonInpaint(sourceImg, targetImg, outImg, iterations, lambda,
-				[=](int iter) {
-					if (iterationMonitor) {
-						return iterationMonitor(0, iter);
-					}
-					else {
-						return true;
-					}
-				});
+				detail::MonitorLevel(iterationMonitor, 0));
 	} else {
-		std::vector<Image4f> srcPyramid(levels);
-		std::vector<Image4f> tarPyramid(levels);
-		std::vector<Image4f> outPyramid(levels);
-		srcPyramid[0] = sourceImg;
-		tarPyramid[0] = targetImg;
-		outPyramid[0] = outImg;
-		for (int l = 1; l < levels; l++) {
-			srcPyramid[l - 1].downSample(srcPyramid[l]);
-			tarPyramid[l - 1].downSample(tarPyramid[l]);
-			outPyramid[l - 1].downSample(outPyramid[l]);
-		}
-		for (int l = levels - 1; l >= 1; l--) {
-			if (iterationMonitor) {
-				if (!iterationMonitor(l, 0))
-					return;
-			}
-			PoissonInpaint(srcPyramid[l], tarPyramid[l], outPyramid[l],
-					iterations, lambda, [=](int iter) {
-						if (iterationMonitor) {
-							return iterationMonitor(l, iter);
-						}
-						else {
-							return true;
-						}
-					});
-			outPyramid[l].upSample(outPyramid[l - 1]);
-		}
-		outImg = outPyramid[0];
-		PoissonInpaint(sourceImg, targetImg, outImg, iterations, lambda,
-				[=](int iter) {
-					if (iterationMonitor) {
-						return iterationMonitor(0, iter);
-					}
-					else {
-						return true;
-					}
-				});
+		PoissonInpaint(ImagePyramid4f(sourceImg, levels), ImagePyramid4f(targetImg, levels), outImg,
+				iterations, lambda, iterationMonitor);
 	}
 }
+void PoissonInpaint(const ImagePyramid4f& srcPyramid, const ImagePyramid4f& tarPyramid,
+		Image4f& outImg, int iterations, float lambda,
+		const std::function<bool(int, int)>& iterationMonitor) {
+	if (srcPyramid.dimensions(0) != tarPyramid.dimensions(0)
+			|| srcPyramid.dimensions(0) != outImg.dimensions()
+			|| srcPyramid.getLevelCount() != tarPyramid.getLevelCount())
+		throw std::runtime_error(
+				MakeString() << "Cannot solve. Image dimensions do not match "
+						<< srcPyramid.dimensions(0) << " "
+						<< tarPyramid.dimensions(0));
+	int levels = srcPyramid.getLevelCount();
+	Image4f src, tar;
+	Image4f out = ImagePyramid4f(outImg, levels).getLevel(levels - 1);
+	if (!detail::SolveCoarseToFine(srcPyramid, out, [&](int l, Image4f& img) {
+		srcPyramid.getLevel(l, src);
+		tarPyramid.getLevel(l, tar);
+		PoissonInpaint(src, tar, img, iterations, lambda, detail::MonitorLevel(iterationMonitor, l));
+	}, iterationMonitor)) {
+		return;
+	}
+	outImg = out;
+	srcPyramid.getLevel(0, src);
+	tarPyramid.getLevel(0, tar);
+	PoissonInpaint(src, tar, outImg, iterations, lambda, detail::MonitorLevel(iterationMonitor, 0));
+}
 void PoissonInpaint(const Image4f& sourceImg, const Image4f& targetImg,
 		Image4f& outImg, int iterations, float lambda,
 		const std::function<bool(int)>& iterationMonitor) {
@@ -485,53 +469,36 @@ void PoissonInpaint(const Image2f& sourceImg, const Image2f& targetImg,
 						<< targetImg.dimensions());
 	if (levels <= 1) {
 		PoissonInpaint(sourceImg, targetImg, outImg, iterations, lambda,
-				[=](int iter) {
-					if (iterationMonitor) {
-						return iterationMonitor(0, iter);
-					}
-					else {
-						return true;
-					}
-				});
+				detail::MonitorLevel(iterationMonitor, 0));
 	} else {
-		std::vector<Image2f> srcPyramid(levels);
-		std::vector<Image2f> tarPyramid(levels);
-		std::vector<Image2f> outPyramid(levels);
-		srcPyramid[0] = sourceImg;
-		tarPyramid[0] = targetImg;
-		outPyramid[0] = outImg;
-		for (int l = 1; l < levels; l++) {
-			srcPyramid[l - 1].downSample(srcPyramid[l]);
-			tarPyramid[l - 1].downSample(tarPyramid[l]);
-			outPyramid[l - 1].downSample(outPyramid[l]);
-		}
-		for (int l = levels - 1; l >= 1; l--) {
-			if (iterationMonitor) {
-				if (!iterationMonitor(l, 0))
-					return;
-			}
-			PoissonInpaint(srcPyramid[l], tarPyramid[l], outPyramid[l],
-					iterations, lambda, [=](int iter) {
-						if (iterationMonitor) {
-							return iterationMonitor(l, iter);
-						}
-						else {
-							return true;
-						}
-					});
-			outPyramid[l].upSample(outPyramid[l - 1]);
-		}
-		outImg = outPyramid[0];
-		PoissonInpaint(sourceImg, targetImg, outImg, iterations, lambda,
-				[=](int iter) {
-					if (iterationMonitor) {
-						return iterationMonitor(0, iter);
-					}
-					else {
-						return true;
-					}
-				});
+		PoissonInpaint(ImagePyramid2f(sourceImg, levels), ImagePyramid2f(targetImg, levels), outImg,
+				iterations, lambda, iterationMonitor);
+	}
+}
+void PoissonInpaint(const ImagePyramid2f& srcPyramid, const ImagePyramid2f& tarPyramid,
+		Image2f& outImg, int iterations, float lambda,
+		const std::function<bool(int, int)>& iterationMonitor) {
+	if (srcPyramid.dimensions(0) != tarPyramid.dimensions(0)
+			|| srcPyramid.dimensions(0) != outImg.dimensions()
+			|| srcPyramid.getLevelCount() != tarPyramid.getLevelCount())
+		throw std::runtime_error(
+				MakeString() << "Cannot solve. Image dimensions do not match "
+						<< srcPyramid.dimensions(0) << " "
+						<< tarPyramid.dimensions(0));
+	int levels = srcPyramid.getLevelCount();
+	Image2f src, tar;
+	Image2f out = ImagePyramid2f(outImg, levels).getLevel(levels - 1);
+	if (!detail::SolveCoarseToFine(srcPyramid, out, [&](int l, Image2f& img) {
+		srcPyramid.getLevel(l, src);
+		tarPyramid.getLevel(l, tar);
+		PoissonInpaint(src, tar, img, iterations, lambda, detail::MonitorLevel(iterationMonitor, l));
+	}, iterationMonitor)) {
+		return;
 	}
+	outImg = out;
+	srcPyramid.getLevel(0, src);
+	tarPyramid.getLevel(0, tar);
+	PoissonInpaint(src, tar, outImg, iterations, lambda, detail::MonitorLevel(iterationMonitor, 0));
 }
 void PoissonInpaint(const Image2f& sourceImg, const Image2f& targetImg,
 		Image2f& outImg, int iterations, float lambda,
@@ -610,49 +577,30 @@ void PoissonBlend(const Image4f& sourceImg, Image4f& targetImg, int iterations,
 						<< sourceImg.dimensions() << " "
 						<< targetImg.dimensions());
 	if (levels <= 1) {
-		PoissonBlend(sourceImg, targetImg, iterations, lambda, [=](int iter) {
-			if (iterationMonitor) {
-				return iterationMonitor(0, iter);
-			}
-			else {
-				return true;
-			}
-		});
+		PoissonBlend(sourceImg, targetImg, iterations, lambda, detail::MonitorLevel(iterationMonitor, 0));
 	} else {
-		std::vector<Image4f> srcPyramid(levels);
-		std::vector<Image4f> tarPyramid(levels);
-		srcPyramid[0] = sourceImg;
-		tarPyramid[0] = targetImg;
-		for (int l = 1; l < levels; l++) {
-			srcPyramid[l - 1].downSample(srcPyramid[l]);
-			tarPyramid[l - 1].downSample(tarPyramid[l]);
-		}
-		for (int l = levels - 1; l >= 1; l--) {
-			if (iterationMonitor) {
-				if (!iterationMonitor(l, 0))
-					return;
-			}
-			PoissonBlend(srcPyramid[l], tarPyramid[l], iterations, lambda,
-					[=](int iter) {
-						if (iterationMonitor) {
-							return iterationMonitor(l, iter);
-						}
-						else {
-							return true;
-						}
-					});
-			tarPyramid[l].upSample(tarPyramid[l - 1]);
-		}
-		targetImg = tarPyramid[0];
-		PoissonBlend(sourceImg, targetImg, iterations, lambda, [=](int iter) {
-			if (iterationMonitor) {
-				return iterationMonitor(0, iter);
-			}
-			else {
-				return true;
-			}
-		});
+		PoissonBlend(ImagePyramid4f(sourceImg, levels), targetImg, iterations, lambda, iterationMonitor);
+	}
+}
+void PoissonBlend(const ImagePyramid4f& srcPyramid, Image4f& targetImg, int iterations,
+		float lambda, const std::function<bool(int, int)>& iterationMonitor) {
+	if (srcPyramid.dimensions(0) != targetImg.dimensions())
+		throw std::runtime_error(
+				MakeString() << "Cannot solve. Image dimensions do not match "
+						<< srcPyramid.dimensions(0) << " "
+						<< targetImg.dimensions());
+	int levels = srcPyramid.getLevelCount();
+	Image4f src;
+	Image4f tar = ImagePyramid4f(targetImg, levels).getLevel(levels - 1);
+	if (!detail::SolveCoarseToFine(srcPyramid, tar, [&](int l, Image4f& img) {
+		srcPyramid.getLevel(l, src);
+		PoissonBlend(src, img, iterations, lambda, detail::MonitorLevel(iterationMonitor, l));
+	}, iterationMonitor)) {
+		return;
 	}
+	targetImg = tar;
+	srcPyramid.getLevel(0, src);
+	PoissonBlend(src, targetImg, iterations, lambda, detail::MonitorLevel(iterationMonitor, 0));
 }
 void PoissonBlend(const Image2f& sourceImg, Image2f& targetImg, int iterations,
 		int levels, float lambda,
@@ -663,49 +611,30 @@ void PoissonBlend(const Image2f& sourceImg, Image2f& targetImg, int iterations,
 						<< sourceImg.dimensions() << " "
 						<< targetImg.dimensions());
 	if (levels <= 1) {
-		PoissonBlend(sourceImg, targetImg, iterations, lambda, [=](int iter) {
-			if (iterationMonitor) {
-				return iterationMonitor(0, iter);
-			}
-			else {
-				return true;
-			}
-		});
+		PoissonBlend(sourceImg, targetImg, iterations, lambda, detail::MonitorLevel(iterationMonitor, 0));
 	} else {
-		std::vector<Image2f> srcPyramid(levels);
-		std::vector<Image2f> tarPyramid(levels);
-		srcPyramid[0] = sourceImg;
-		tarPyramid[0] = targetImg;
-		for (int l = 1; l < levels; l++) {
-			srcPyramid[l - 1].downSample(srcPyramid[l]);
-			tarPyramid[l - 1].downSample(tarPyramid[l]);
-		}
-		for (int l = levels - 1; l >= 1; l--) {
-			if (iterationMonitor) {
-				if (!iterationMonitor(l, 0))
-					return;
-			}
-			PoissonBlend(srcPyramid[l], tarPyramid[l], iterations, lambda,
-					[=](int iter) {
-						if (iterationMonitor) {
-							return iterationMonitor(l, iter);
-						}
-						else {
-							return true;
-						}
-					});
-			tarPyramid[l].upSample(tarPyramid[l - 1]);
-		}
-		targetImg = tarPyramid[0];
-		PoissonBlend(sourceImg, targetImg, iterations, lambda, [=](int iter) {
-			if (iterationMonitor) {
-				return iterationMonitor(0, iter);
-			}
-			else {
-				return true;
-			}
-		});
+		PoissonBlend(ImagePyramid2f(sourceImg, levels), targetImg, iterations, lambda, iterationMonitor);
+	}
+}
+void PoissonBlend(const ImagePyramid2f& srcPyramid, Image2f& targetImg, int iterations,
+		float lambda, const std::function<bool(int, int)>& iterationMonitor) {
+	if (srcPyramid.dimensions(0) != targetImg.dimensions())
+		throw std::runtime_error(
+				MakeString() << "Cannot solve. Image dimensions do not match "
+						<< srcPyramid.dimensions(0) << " "
+						<< targetImg.dimensions());
+	int levels = srcPyramid.getLevelCount();
+	Image2f src;
+	Image2f tar = ImagePyramid2f(targetImg, levels).getLevel(levels - 1);
+	if (!detail::SolveCoarseToFine(srcPyramid, tar, [&](int l, Image2f& img) {
+		srcPyramid.getLevel(l, src);
+		PoissonBlend(src, img, iterations, lambda, detail::MonitorLevel(iterationMonitor, l));
+	}, iterationMonitor)) {
+		return;
 	}
+	targetImg = tar;
+	srcPyramid.getLevel(0, src);
+	PoissonBlend(src, targetImg, iterations, lambda, detail::MonitorLevel(iterationMonitor, 0));
 }
 void PoissonBlend(const Image4f& sourceImg, Image4f& targetImg, int iterations,
 		float lambda, const std::function<bool(int)>& iterationMonitor) {
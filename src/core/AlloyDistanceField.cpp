@@ -20,6 +20,7 @@
  */
 
 #include "AlloyDistanceField.h"
+#include "AlloyResultCache.h"
 #include "BinaryMinHeap.h"
 #include <list>
 using namespace std;
@@ -104,6 +105,14 @@ float DistanceField3f::march(float IMv, float IPv, float JMv, float JPv,
 	tmp = (s + std::sqrt(std::max(0.0, s * s - count * (s2 - 1.0f)))) / count;
 	return (float) tmp;
 }
+void DistanceField3f::solve(ResultCache& cache, const Volume1f& vol,
+		Volume1f& distVol, float maxDistance) {
+	cache.compute(
+			MakeCacheKey("DistanceField3f", ContentKey(vol), maxDistance),
+			distVol, [&](Volume1f& out) {
+				solve(vol, out, maxDistance);
+			});
+}
 void DistanceField3f::solve(const Volume1f& vol, Volume1f& distVol,
 		float maxDistance) {
 	const int rows = vol.rows;
@@ -754,6 +763,14 @@ float DistanceField2f::march(float IMv, float IPv, float JMv, float JPv,
 	return (float) tmp;
 }
 
+void DistanceField2f::solve(ResultCache& cache, const Image1f& vol,
+		Image1f& distVol, float maxDistance) {
+	cache.compute(
+			MakeCacheKey("DistanceField2f", ContentKey(vol), maxDistance),
+			distVol, [&](Image1f& out) {
+				solve(vol, out, maxDistance);
+			});
+}
 void DistanceField2f::solve(const Image1f& vol, Image1f& distVol,
 		float maxDistance) {
 	const int width = vol.width;
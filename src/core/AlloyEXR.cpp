@@ -0,0 +1,647 @@
+/*
+ * Copyright(C) 2018, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "AlloyEXR.h"
+#include "AlloyCommon.h"
+#include "AlloyMemMappedFile.h"
+#include "tinyexr.h"
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+namespace aly {
+namespace detail {
+enum EXRConstants {
+	EXR_MAGIC = 20000630,
+	EXR_VERSION = 2,
+	EXR_FLAG_TILED = 0x200,
+	EXR_FLAG_LONG_NAMES = 0x400,
+	EXR_FLAG_DEEP = 0x800,
+	EXR_FLAG_MULTIPART = 0x1000
+};
+/*
+ * Read-only view of a memory mapped EXR. EXR is always little endian, which
+ * is also what the block codecs in tinyexr assume for the host.
+ */
+struct EXRFileView {
+	const uint8_t* data = nullptr;
+	size_t size = 0;
+	void check(size_t offset, size_t length) const {
+		if (offset > size || length > size - offset) {
+			throw std::runtime_error("Unexpected end of EXR file.");
+		}
+	}
+	template<class T> T read(size_t offset) const {
+		check(offset, sizeof(T));
+		T val;
+		std::memcpy(&val, data + offset, sizeof(T));
+		return val;
+	}
+	std::string readString(size_t& offset) const {
+		check(offset, 1);
+		const uint8_t* start = data + offset;
+		const uint8_t* end = (const uint8_t*) std::memchr(start, 0, size - offset);
+		if (end == nullptr) {
+			throw std::runtime_error("Unterminated string in EXR header.");
+		}
+		offset += (end - start) + 1;
+		return std::string((const char*) start, end - start);
+	}
+};
+static box2i ReadEXRWindow(const EXRFileView& view, size_t offset) {
+	int2 mn(view.read<int32_t>(offset), view.read<int32_t>(offset + 4));
+	int2 mx(view.read<int32_t>(offset + 8), view.read<int32_t>(offset + 12));
+	return box2i(mn, mx - mn + int2(1, 1));
+}
+static int GetEXRSampleSize(EXRPixelType type) {
+	return (type == EXRPixelType::Half) ? 2 : 4;
+}
+static int GetEXRLinesPerBlock(EXRCompression compression) {
+	switch (compression) {
+	case EXRCompression::ZIP:
+		return 16;
+	case EXRCompression::PIZ:
+		return 32;
+	default:
+		return 1;
+	}
+}
+/*
+ * Parses the header and returns the offset of the chunk offset table.
+ */
+static size_t ParseEXRHeader(const EXRFileView& view, EXRHeader& header) {
+	if (view.read<uint32_t>(0) != EXR_MAGIC) {
+		throw std::runtime_error("Not an OpenEXR file.");
+	}
+	uint32_t version = view.read<uint32_t>(4);
+	if ((version & 0xFF) != EXR_VERSION) {
+		throw std::runtime_error(MakeString() << "OpenEXR version " << (version & 0xFF) << " unsupported.");
+	}
+	if ((version & (EXR_FLAG_DEEP | EXR_FLAG_MULTIPART)) != 0) {
+		throw std::runtime_error("Multi-part and deep OpenEXR files are not supported.");
+	}
+	header = EXRHeader();
+	header.tiled = (version & EXR_FLAG_TILED) != 0;
+	bool hasChannels = false, hasCompression = false, hasDataWindow = false, hasTiles = false;
+	size_t offset = 8;
+	while (true) {
+		std::string name = view.readString(offset);
+		if (name.size() == 0) {
+			break;
+		}
+		std::string type = view.readString(offset);
+		int32_t length = view.read<int32_t>(offset);
+		offset += 4;
+		if (length < 0) {
+			throw std::runtime_error(MakeString() << "Invalid size for EXR attribute " << name);
+		}
+		view.check(offset, length);
+		if (name == "channels" && type == "chlist") {
+			size_t pos = offset;
+			while (true) {
+				std::string cname = view.readString(pos);
+				if (cname.size() == 0) {
+					break;
+				}
+				EXRChannel channel;
+				channel.name = cname;
+				int32_t ptype = view.read<int32_t>(pos);
+				if (ptype < 0 || ptype > 2) {
+					throw std::runtime_error(MakeString() << "Invalid pixel type for EXR channel " << cname);
+				}
+				channel.type = (EXRPixelType) ptype;
+				channel.sampling = int2(view.read<int32_t>(pos + 8), view.read<int32_t>(pos + 12));
+				pos += 16;
+				header.channels.push_back(channel);
+			}
+			hasChannels = true;
+		} else if (name == "compression" && type == "compression") {
+			uint8_t compression = view.read<uint8_t>(offset);
+			if (compression > (uint8_t) EXRCompression::PIZ) {
+				throw std::runtime_error(MakeString() << "EXR compression " << (int) compression << " unsupported.");
+			}
+			header.compression = (EXRCompression) compression;
+			hasCompression = true;
+		} else if (name == "dataWindow" && type == "box2i") {
+			header.dataWindow = ReadEXRWindow(view, offset);
+			hasDataWindow = true;
+		} else if (name == "displayWindow" && type == "box2i") {
+			header.displayWindow = ReadEXRWindow(view, offset);
+		} else if (name == "lineOrder" && type == "lineOrder") {
+			header.lineOrder = view.read<uint8_t>(offset);
+		} else if (name == "tiles" && type == "tiledesc") {
+			header.tileSize = int2((int) view.read<uint32_t>(offset), (int) view.read<uint32_t>(offset + 4));
+			header.levelMode = view.read<uint8_t>(offset + 8) & 0x0F;
+			hasTiles = true;
+		}
+		offset += length;
+	}
+	if (!hasChannels || !hasCompression || !hasDataWindow || header.channels.size() == 0) {
+		throw std::runtime_error("EXR header is missing required attributes.");
+	}
+	if (header.dataWindow.dimensions.x <= 0 || header.dataWindow.dimensions.y <= 0) {
+		throw std::runtime_error("EXR data window is empty.");
+	}
+	if (header.tiled && (!hasTiles || header.tileSize.x <= 0 || header.tileSize.y <= 0)) {
+		throw std::runtime_error("EXR tile description is invalid.");
+	}
+	return offset;
+}
+/*
+ * Bounds of every chunk relative to the data window, in offset table order.
+ * Mip and rip mapped files list the full resolution level first, so the same
+ * indexing applies to them.
+ */
+static std::vector<box2i> GetEXRChunks(const EXRHeader& header) {
+	int2 dims = header.dataWindow.dimensions;
+	std::vector<box2i> chunks;
+	if (header.tiled) {
+		int2 tile = header.tileSize;
+		int nx = (dims.x + tile.x - 1) / tile.x;
+		int ny = (dims.y + tile.y - 1) / tile.y;
+		chunks.reserve((size_t) nx * ny);
+		for (int j = 0; j < ny; j++) {
+			for (int i = 0; i < nx; i++) {
+				int2 pos(i * tile.x, j * tile.y);
+				chunks.push_back(box2i(pos, aly::min(tile, dims - pos)));
+			}
+		}
+	} else {
+		int lines = GetEXRLinesPerBlock(header.compression);
+		int n = (dims.y + lines - 1) / lines;
+		chunks.reserve(n);
+		for (int j = 0; j < n; j++) {
+			chunks.push_back(box2i(int2(0, j * lines), int2(dims.x, std::min(lines, dims.y - j * lines))));
+		}
+	}
+	return chunks;
+}
+static const std::vector<std::string>& GetEXRChannelAliases(int c) {
+	static const std::vector<std::vector<std::string>> aliases = { { "R", "r", "red", "RED" }, { "G", "g", "green",
+			"GREEN" }, { "B", "b", "blue", "BLUE" }, { "A", "a", "alpha", "ALPHA" }, { "Y", "y" } };
+	return aliases[c];
+}
+static int FindEXRChannel(const EXRHeader& header, const std::vector<std::string>& names) {
+	for (const std::string& name : names) {
+		int index = header.getChannelIndex(name);
+		if (index >= 0) {
+			return index;
+		}
+	}
+	return -1;
+}
+/*
+ * File channel feeding each image channel, or -1 if it has to be filled.
+ */
+static std::vector<int> SelectEXRChannels(const EXRHeader& header, int C, const std::vector<std::string>& names) {
+	std::vector<int> sources(C, -1);
+	if (names.size() > 0) {
+		if ((int) names.size() != C) {
+			throw std::runtime_error(MakeString() << "Expected " << C << " EXR channel names, found " << names.size());
+		}
+		for (int c = 0; c < C; c++) {
+			sources[c] = header.getChannelIndex(names[c]);
+			if (sources[c] < 0) {
+				throw std::runtime_error(MakeString() << "EXR channel " << names[c] << " not found.");
+			}
+		}
+		return sources;
+	}
+	int gray = FindEXRChannel(header, GetEXRChannelAliases(4));
+	if (C == 1) {
+		sources[0] = gray;
+		if (sources[0] < 0)
+			sources[0] = FindEXRChannel(header, GetEXRChannelAliases(0));
+		if (sources[0] < 0)
+			sources[0] = 0;
+		return sources;
+	}
+	bool color = false;
+	for (int c = 0; c < C; c++) {
+		sources[c] = FindEXRChannel(header, GetEXRChannelAliases(c));
+		color |= (c < 3 && sources[c] >= 0);
+	}
+	if (!color && gray >= 0) {
+		for (int c = 0; c < std::min(C, 3); c++) {
+			sources[c] = gray;
+		}
+	}
+	return sources;
+}
+static inline float ReadEXRSample(const uint8_t* ptr, EXRPixelType type) {
+	switch (type) {
+	case EXRPixelType::Half: {
+		uint16_t val;
+		std::memcpy(&val, ptr, sizeof(val));
+		return HalfToFloat(val);
+	}
+	case EXRPixelType::Float: {
+		float val;
+		std::memcpy(&val, ptr, sizeof(val));
+		return val;
+	}
+	default: {
+		uint32_t val;
+		std::memcpy(&val, ptr, sizeof(val));
+		return (float) val;
+	}
+	}
+}
+static inline void ReadEXRSample(const uint8_t* ptr, EXRPixelType type, float& out) {
+	out = ReadEXRSample(ptr, type);
+}
+static inline void ReadEXRSample(const uint8_t* ptr, EXRPixelType type, half& out) {
+	if (type == EXRPixelType::Half) {
+		std::memcpy(&out.bits, ptr, sizeof(uint16_t));
+	} else {
+		out = half(ReadEXRSample(ptr, type));
+	}
+}
+template<class T> EXRPixelType GetEXRPixelType();
+template<> EXRPixelType GetEXRPixelType<float>() {
+	return EXRPixelType::Float;
+}
+template<> EXRPixelType GetEXRPixelType<half>() {
+	return EXRPixelType::Half;
+}
+template<class T, int C, ImageType I> void ReadEXRImageInternal(const std::string& file, Image<T, C, I>& img,
+		const std::vector<std::string>& channels, const box2i& region) {
+	ReadableMemMapFile mmf(file);
+	if (!mmf.isOpen() || mmf.data() == nullptr) {
+		throw std::runtime_error(MakeString() << "Could not open " << file);
+	}
+	EXRFileView view;
+	view.data = (const uint8_t*) mmf.data();
+	view.size = mmf.getFileSize();
+	EXRHeader header;
+	size_t tableOffset;
+	try {
+		tableOffset = ParseEXRHeader(view, header);
+	} catch (std::exception& e) {
+		throw std::runtime_error(MakeString() << "Could not read " << file << ": " << e.what());
+	}
+	for (const EXRChannel& channel : header.channels) {
+		if (channel.sampling != int2(1, 1)) {
+			throw std::runtime_error(MakeString() << "Could not read " << file << ": sub-sampled channels are not supported.");
+		}
+	}
+	box2i roi(int2(0, 0), header.dataWindow.dimensions);
+	if (region.dimensions.x > 0 && region.dimensions.y > 0) {
+		roi.intersect(region);
+		if (roi.dimensions.x <= 0 || roi.dimensions.y <= 0) {
+			throw std::runtime_error(MakeString() << "Region " << region << " is outside the data window of " << file);
+		}
+	}
+	std::vector<int> sources = SelectEXRChannels(header, C, channels);
+	const int nc = (int) header.channels.size();
+	std::vector<int> pixelTypes(nc);
+	std::vector<size_t> sampleSizes(nc);
+	size_t pixelSize = 0;
+	for (int c = 0; c < nc; c++) {
+		pixelTypes[c] = (int) header.channels[c].type;
+		sampleSizes[c] = GetEXRSampleSize(header.channels[c].type);
+		pixelSize += sampleSizes[c];
+	}
+	img.resize(roi.dimensions.x, roi.dimensions.y);
+	img.setPosition(roi.position);
+	for (int c = 0; c < C; c++) {
+		if (sources[c] < 0) {
+			T fill = T((c == 3) ? 1.0f : 0.0f);
+			for (vec<T, C>& val : img.data) {
+				val[c] = fill;
+			}
+		}
+	}
+	std::vector<box2i> chunks = GetEXRChunks(header);
+	std::vector<int> jobs;
+	for (int n = 0; n < (int) chunks.size(); n++) {
+		if (chunks[n].intersects(roi)) {
+			jobs.push_back(n);
+		}
+	}
+	view.check(tableOffset, chunks.size() * sizeof(uint64_t));
+	std::string error;
+#pragma omp parallel
+	{
+		std::vector<uint8_t> buffer;
+		std::vector<size_t> channelOffsets(nc);
+#pragma omp for schedule(dynamic)
+		for (int n = 0; n < (int) jobs.size(); n++) {
+			try {
+				const box2i& chunk = chunks[jobs[n]];
+				uint64_t offset = view.read<uint64_t>(tableOffset + jobs[n] * sizeof(uint64_t));
+				if (offset == 0 || offset >= view.size) {
+					throw std::runtime_error(MakeString() << "Chunk " << jobs[n] << " is missing.");
+				}
+				int32_t dataSize;
+				if (header.tiled) {
+					int2 tile(view.read<int32_t>(offset), view.read<int32_t>(offset + 4));
+					int2 level(view.read<int32_t>(offset + 8), view.read<int32_t>(offset + 12));
+					if (tile * header.tileSize != chunk.position || level != int2(0, 0)) {
+						throw std::runtime_error(MakeString() << "Tile " << jobs[n] << " is out of order.");
+					}
+					dataSize = view.read<int32_t>(offset + 16);
+					offset += 20;
+				} else {
+					if (view.read<int32_t>(offset) != header.dataWindow.position.y + chunk.position.y) {
+						throw std::runtime_error(MakeString() << "Scanline block " << jobs[n] << " is out of order.");
+					}
+					dataSize = view.read<int32_t>(offset + 4);
+					offset += 8;
+				}
+				if (dataSize < 0) {
+					throw std::runtime_error(MakeString() << "Invalid size for chunk " << jobs[n]);
+				}
+				view.check(offset, dataSize);
+				const size_t lineSize = pixelSize * chunk.dimensions.x;
+				buffer.resize(lineSize * chunk.dimensions.y);
+				if (DecompressEXRBlock(buffer.data(), buffer.size(), view.data + offset, dataSize,
+						(int) header.compression, pixelTypes.data(), nc, chunk.dimensions.x, chunk.dimensions.y) != 0) {
+					throw std::runtime_error(MakeString() << "Could not decompress chunk " << jobs[n]);
+				}
+				size_t channelOffset = 0;
+				for (int c = 0; c < nc; c++) {
+					channelOffsets[c] = channelOffset;
+					channelOffset += sampleSizes[c] * chunk.dimensions.x;
+				}
+				box2i overlap = chunk;
+				overlap.intersect(roi);
+				for (int j = overlap.position.y; j < overlap.position.y + overlap.dimensions.y; j++) {
+					const uint8_t* line = buffer.data() + (j - chunk.position.y) * lineSize;
+					vec<T, C>* out = img.data.data() + (size_t) (j - roi.position.y) * img.width;
+					for (int c = 0; c < C; c++) {
+						int s = sources[c];
+						if (s < 0) {
+							continue;
+						}
+						EXRPixelType type = header.channels[s].type;
+						const uint8_t* in = line + channelOffsets[s] + (overlap.position.x - chunk.position.x) * sampleSizes[s];
+						for (int i = overlap.position.x - roi.position.x;
+								i < overlap.position.x - roi.position.x + overlap.dimensions.x; i++) {
+							ReadEXRSample(in, type, out[i][c]);
+							in += sampleSizes[s];
+						}
+					}
+				}
+			} catch (std::exception& e) {
+#pragma omp critical(EXRReadError)
+				{
+					if (error.size() == 0)
+						error = e.what();
+				}
+			}
+		}
+	}
+	if (error.size() > 0) {
+		throw std::runtime_error(MakeString() << "Could not read " << file << ": " << error);
+	}
+}
+template<class T> static void AppendEXR(std::vector<uint8_t>& out, const T& val) {
+	size_t sz = out.size();
+	out.resize(sz + sizeof(T));
+	std::memcpy(out.data() + sz, &val, sizeof(T));
+}
+static void AppendEXR(std::vector<uint8_t>& out, const std::string& str) {
+	out.insert(out.end(), str.begin(), str.end());
+	out.push_back(0);
+}
+static void AppendEXRAttribute(std::vector<uint8_t>& out, const std::string& name, const std::string& type,
+		const std::vector<uint8_t>& value) {
+	AppendEXR(out, name);
+	AppendEXR(out, type);
+	AppendEXR(out, (int32_t) value.size());
+	out.insert(out.end(), value.begin(), value.end());
+}
+template<class T, int C, ImageType I> void WriteEXRImageInternal(const std::string& file, const Image<T, C, I>& img,
+		EXRCompression compression, int tileSize, const std::vector<std::string>& channels) {
+	if (compression == EXRCompression::PIZ) {
+		throw std::runtime_error("PIZ compression is only supported for reading EXR files.");
+	}
+	if (img.width <= 0 || img.height <= 0) {
+		throw std::runtime_error(MakeString() << "Could not write empty image to " << file);
+	}
+	std::vector<std::string> names = channels;
+	if (names.size() == 0) {
+		if (C == 1) {
+			names.push_back("Y");
+		} else {
+			for (int c = 0; c < C; c++) {
+				names.push_back(GetEXRChannelAliases(c)[0]);
+			}
+		}
+	} else if ((int) names.size() != C) {
+		throw std::runtime_error(MakeString() << "Expected " << C << " EXR channel names, found " << names.size());
+	}
+	EXRHeader header;
+	header.dataWindow = box2i(int2(0, 0), int2(img.width, img.height));
+	header.displayWindow = header.dataWindow;
+	header.compression = compression;
+	header.tiled = (tileSize > 0);
+	header.tileSize = int2(tileSize, tileSize);
+	//Channels are stored in alphabetical order
+	std::vector<int> order(C);
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [&names](int a, int b) {
+		return names[a] < names[b];
+	});
+	bool longNames = false;
+	for (int c = 0; c < C; c++) {
+		if (names[order[c]].size() == 0 || (c > 0 && names[order[c]] == names[order[c - 1]])) {
+			throw std::runtime_error("EXR channel names must be unique and non-empty.");
+		}
+		longNames |= (names[order[c]].size() > 31);
+		EXRChannel channel;
+		channel.name = names[order[c]];
+		channel.type = GetEXRPixelType<T>();
+		header.channels.push_back(channel);
+	}
+	std::vector<box2i> chunks = GetEXRChunks(header);
+	std::vector<std::vector<uint8_t>> blocks(chunks.size());
+#pragma omp parallel
+	{
+		std::vector<uint8_t> raw;
+#pragma omp for schedule(dynamic)
+		for (int n = 0; n < (int) chunks.size(); n++) {
+			const box2i& chunk = chunks[n];
+			raw.resize(sizeof(T) * C * chunk.dimensions.x * chunk.dimensions.y);
+			T* ptr = (T*) raw.data();
+			for (int j = chunk.position.y; j < chunk.position.y + chunk.dimensions.y; j++) {
+				for (int c = 0; c < C; c++) {
+					for (int i = chunk.position.x; i < chunk.position.x + chunk.dimensions.x; i++) {
+						*(ptr++) = img(i, j)[order[c]];
+					}
+				}
+			}
+			std::vector<uint8_t>& block = blocks[n];
+			if (header.tiled) {
+				AppendEXR(block, (int32_t) (chunk.position.x / tileSize));
+				AppendEXR(block, (int32_t) (chunk.position.y / tileSize));
+				AppendEXR(block, (int32_t) 0);
+				AppendEXR(block, (int32_t) 0);
+			} else {
+				AppendEXR(block, (int32_t) chunk.position.y);
+			}
+			size_t start = block.size() + sizeof(int32_t);
+			size_t dataSize = 0;
+			if (compression != EXRCompression::Uncompressed) {
+				block.resize(start + raw.size() + raw.size() / 2 + 256);
+				dataSize = CompressEXRBlock(block.data() + start, block.size() - start, raw.data(), raw.size(),
+						(int) compression);
+			}
+			if (dataSize == 0) {
+				dataSize = raw.size();
+				block.resize(start + dataSize);
+				std::memcpy(block.data() + start, raw.data(), dataSize);
+			}
+			block.resize(start + dataSize);
+			int32_t size32 = (int32_t) dataSize;
+			std::memcpy(block.data() + start - sizeof(int32_t), &size32, sizeof(int32_t));
+		}
+	}
+	std::vector<uint8_t> out;
+	AppendEXR(out, (uint32_t) EXR_MAGIC);
+	AppendEXR(out,
+			(uint32_t) (EXR_VERSION | (header.tiled ? EXR_FLAG_TILED : 0) | (longNames ? EXR_FLAG_LONG_NAMES : 0)));
+	std::vector<uint8_t> value;
+	for (const EXRChannel& channel : header.channels) {
+		AppendEXR(value, channel.name);
+		AppendEXR(value, (int32_t) channel.type);
+		AppendEXR(value, (uint32_t) 0); //pLinear and reserved
+		AppendEXR(value, (int32_t) 1);
+		AppendEXR(value, (int32_t) 1);
+	}
+	value.push_back(0);
+	AppendEXRAttribute(out, "channels", "chlist", value);
+	AppendEXRAttribute(out, "compression", "compression", std::vector<uint8_t>(1, (uint8_t) compression));
+	value.clear();
+	AppendEXR(value, int4(0, 0, img.width - 1, img.height - 1));
+	AppendEXRAttribute(out, "dataWindow", "box2i", value);
+	AppendEXRAttribute(out, "displayWindow", "box2i", value);
+	AppendEXRAttribute(out, "lineOrder", "lineOrder", std::vector<uint8_t>(1, 0));
+	value.clear();
+	AppendEXR(value, 1.0f);
+	AppendEXRAttribute(out, "pixelAspectRatio", "float", value);
+	AppendEXRAttribute(out, "screenWindowWidth", "float", value);
+	value.clear();
+	AppendEXR(value, float2(0.0f, 0.0f));
+	AppendEXRAttribute(out, "screenWindowCenter", "v2f", value);
+	if (header.tiled) {
+		value.clear();
+		AppendEXR(value, (uint32_t) tileSize);
+		AppendEXR(value, (uint32_t) tileSize);
+		value.push_back(0); //ONE_LEVEL, ROUND_DOWN
+		AppendEXRAttribute(out, "tiles", "tiledesc", value);
+	}
+	out.push_back(0);
+	uint64_t offset = out.size() + blocks.size() * sizeof(uint64_t);
+	for (const std::vector<uint8_t>& block : blocks) {
+		AppendEXR(out, offset);
+		offset += block.size();
+	}
+	std::ofstream os(file, std::ios::out | std::ios::binary);
+	if (!os.is_open()) {
+		throw std::runtime_error(MakeString() << "Could not open " << file);
+	}
+	os.write((const char*) out.data(), out.size());
+	for (const std::vector<uint8_t>& block : blocks) {
+		os.write((const char*) block.data(), block.size());
+	}
+	if (!os.good()) {
+		throw std::runtime_error(MakeString() << "Could not write " << file);
+	}
+	os.close();
+}
+}
+int EXRHeader::getChannelIndex(const std::string& name) const {
+	for (int c = 0; c < (int) channels.size(); c++) {
+		if (channels[c].name == name) {
+			return c;
+		}
+	}
+	return -1;
+}
+bool ReadEXRHeader(const std::string& file, EXRHeader& header) {
+	ReadableMemMapFile mmf(file);
+	if (!mmf.isOpen() || mmf.data() == nullptr) {
+		return false;
+	}
+	detail::EXRFileView view;
+	view.data = (const uint8_t*) mmf.data();
+	view.size = mmf.getFileSize();
+	try {
+		detail::ParseEXRHeader(view, header);
+	} catch (std::exception& e) {
+		throw std::runtime_error(MakeString() << "Could not read " << file << ": " << e.what());
+	}
+	return true;
+}
+void ReadEXRImage(const std::string& file, Image1f& img, const std::vector<std::string>& channels,
+		const box2i& region) {
+	detail::ReadEXRImageInternal(file, img, channels, region);
+}
+void ReadEXRImage(const std::string& file, ImageRGBf& img, const std::vector<std::string>& channels,
+		const box2i& region) {
+	detail::ReadEXRImageInternal(file, img, channels, region);
+}
+void ReadEXRImage(const std::string& file, ImageRGBAf& img, const std::vector<std::string>& channels,
+		const box2i& region) {
+	detail::ReadEXRImageInternal(file, img, channels, region);
+}
+void ReadEXRImage(const std::string& file, Image1h& img, const std::vector<std::string>& channels,
+		const box2i& region) {
+	detail::ReadEXRImageInternal(file, img, channels, region);
+}
+void ReadEXRImage(const std::string& file, Image3h& img, const std::vector<std::string>& channels,
+		const box2i& region) {
+	detail::ReadEXRImageInternal(file, img, channels, region);
+}
+void ReadEXRImage(const std::string& file, Image4h& img, const std::vector<std::string>& channels,
+		const box2i& region) {
+	detail::ReadEXRImageInternal(file, img, channels, region);
+}
+void WriteEXRImage(const std::string& file, const Image1f& img, EXRCompression compression, int tileSize,
+		const std::vector<std::string>& channels) {
+	detail::WriteEXRImageInternal(file, img, compression, tileSize, channels);
+}
+void WriteEXRImage(const std::string& file, const ImageRGBf& img, EXRCompression compression, int tileSize,
+		const std::vector<std::string>& channels) {
+	detail::WriteEXRImageInternal(file, img, compression, tileSize, channels);
+}
+void WriteEXRImage(const std::string& file, const ImageRGBAf& img, EXRCompression compression, int tileSize,
+		const std::vector<std::string>& channels) {
+	detail::WriteEXRImageInternal(file, img, compression, tileSize, channels);
+}
+void WriteEXRImage(const std::string& file, const Image1h& img, EXRCompression compression, int tileSize,
+		const std::vector<std::string>& channels) {
+	detail::WriteEXRImageInternal(file, img, compression, tileSize, channels);
+}
+void WriteEXRImage(const std::string& file, const Image3h& img, EXRCompression compression, int tileSize,
+		const std::vector<std::string>& channels) {
+	detail::WriteEXRImageInternal(file, img, compression, tileSize, channels);
+}
+void WriteEXRImage(const std::string& file, const Image4h& img, EXRCompression compression, int tileSize,
+		const std::vector<std::string>& channels) {
+	detail::WriteEXRImageInternal(file, img, compression, tileSize, channels);
+}
+}
@@ -25,7 +25,7 @@ namespace aly {
 	void ExpandRegion::setExpanded(bool expanded) {
 		contentRegion->setVisible(expanded);
 		if (this->expanded != expanded) {
-			AlloyApplicationContext()->requestPack();
+			AlloyApplicationContext()->requestPack(parent);
 		}
 		this->expanded = expanded;
 		arrowIcon->setLabel(
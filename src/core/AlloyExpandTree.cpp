@@ -21,6 +21,7 @@
 #include "AlloyExpandTree.h"
 #include "AlloyApplication.h"
 #include "AlloyDrawUtil.h"
+#include <algorithm>
 namespace aly {
 	ExpandTree::ExpandTree(const std::string& name, const AUnit2D& pos,
 		const AUnit2D& dims) :
@@ -31,6 +32,8 @@ namespace aly {
 			new Draw("Tree Region", CoordPX(0.0f, 0.0f),
 				CoordPercent(1.0f, 1.0f)));
 		drawRegion->onDraw = [this](AlloyContext* context, const box2px& bounds) {
+			viewport = getBounds();
+			viewport.position -= bounds.position;
 			root.draw(this, context, bounds.position);
 		};
 		drawRegion->onMouseOver =
@@ -120,11 +123,20 @@ namespace aly {
 		children.push_back(item);
 
 	}
+	//Children are stacked top to bottom, so the first child that could overlap a row is found by bisection.
+	static std::vector<TreeItemPtr>::iterator FirstItemBelow(std::vector<TreeItemPtr>& children, float y) {
+		return std::lower_bound(children.begin(), children.end(), y,
+			[](const TreeItemPtr& item, float y) {
+			box2px box = item->getBounds();
+			return box.position.y + box.dimensions.y < y;
+		});
+	}
 	TreeItem* TreeItem::locate(AlloyContext* context, const pixel2& pt,bool& overArrow) {
 
 		if (isExpanded()) {
-			for (TreeItemPtr& item : children) {
-				TreeItem* selected = item->locate(context, pt,overArrow);
+			for (auto iter = FirstItemBelow(children, pt.y);
+				iter != children.end() && (*iter)->getBounds().position.y <= pt.y; iter++) {
+				TreeItem* selected = (*iter)->locate(context, pt,overArrow);
 				if (selected != nullptr)
 					return selected;
 			}
@@ -258,8 +270,11 @@ namespace aly {
 				name.c_str(), nullptr);
 		}
 		if (expanded) {
-			for (TreeItemPtr& item : children) {
-				item->draw(tree, context, offset);
+			box2px viewport = tree->getViewport();
+			float bottom = viewport.position.y + viewport.dimensions.y;
+			for (auto iter = FirstItemBelow(children, viewport.position.y);
+				iter != children.end() && (*iter)->getBounds().position.y <= bottom; iter++) {
+				(*iter)->draw(tree, context, offset);
 			}
 		}
 	}
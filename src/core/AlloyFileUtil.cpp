@@ -113,9 +113,13 @@ std::string CodePointToUTF8(int cp) {
 bool MakeDirectory(const std::string& dir) {
 	std::string parent = dir;
 	std::list<std::string> createList;
-	while (!aly::FileExists(parent)) {
+	//Relative paths run out of parents before reaching an existing directory.
+	while (parent.size() > 0 && !aly::FileExists(parent)) {
 		createList.push_front(parent);
-		parent = aly::RemoveTrailingSlash(aly::GetParentDirectory(parent));
+		std::string next = aly::RemoveTrailingSlash(aly::GetParentDirectory(parent));
+		if (next == parent)
+			break;
+		parent = next;
 	}
 	for (std::string d : createList) {
 		if (!aly::MakeDirectoryInternal(d)) {
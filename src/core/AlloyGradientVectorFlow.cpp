@@ -19,7 +19,8 @@
  * THE SOFTWARE.
  */
 #include <AlloyGradientVectorFlow.h>
-#include <AlloySparseSolve.h>
+#include <AlloyResultCache.h>
+#include <AlloyStencilSolve.h>
 namespace aly {
 void SolveEdgeFilter(const ImageRGB& in, Image1f& out, int K) {
 	out.resize(in.width, in.height);
@@ -132,60 +133,65 @@ void SolveEdgeFilter(const Volume1f& in, Volume1f& out, int K) {
 		}
 	}
 }
-void SolveGradientVectorFlow(const Image1f& src, Image2f& vectorField, float mu,
-		int iterations, bool normalize) {
-	const int nbrX[] = { 0, 0, -1, 1 };
-	const int nbrY[] = { 1, -1, 0, 0 };
-	vectorField.resize(src.width, src.height);
-	SparseMatrix2f A;
-	Vector2f b;
-	Vector2f x;
-	//size_t N = 0;
-	size_t M = src.width * src.height;
-	A.resize(M, M);
-	b.resize(M, float2(0.0f));
-	x.resize(M, float2(0.0f));
-	for (int i = 0; i < src.width; i++) {
-		for (int j = 0; j < src.height; j++) {
-			int idx = i + j * src.width;
-			float v21 = src(i + 1, j).x;
-			float v12 = src(i, j + 1).x;
-			float v10 = src(i, j - 1).x;
-			float v01 = src(i - 1, j).x;
-			float v11 = src(i, j).x;
-			float2 grad;
-			if (v11 < 0.0f) {
-				grad.x = std::max(v11 - v01, 0.0f) + std::min(v21 - v11, 0.0f);
-				grad.y = std::max(v11 - v10, 0.0f) + std::min(v12 - v11, 0.0f);
-			} else {
-				grad.x = std::min(v11 - v01, 0.0f) + std::max(v21 - v11, 0.0f);
-				grad.y = std::min(v11 - v10, 0.0f) + std::max(v12 - v11, 0.0f);
-			}
-			float len = max(1E-6f, length(grad));
-			grad = -sign(v11) * (grad / std::max(1E-6f, len));
-			x[idx] = grad;
-			b[idx] = grad * len;
-			A(idx, idx) = float2(-len - mu);
-			for (int nn = 0; nn < 4; nn++) {
-				int ii = i + nbrX[nn];
-				int jj = j + nbrY[nn];
-				if (ii >= 0 && ii < src.width && jj >= 0 && jj < src.height) {
-					A(idx, ii + src.width * jj) += float2(mu * 0.25f);
-
-				}
-			}
-		}
+static float2 UpwindGradient(const Image1f& src, int i, int j) {
+	float v21 = src(i + 1, j).x;
+	float v12 = src(i, j + 1).x;
+	float v10 = src(i, j - 1).x;
+	float v01 = src(i - 1, j).x;
+	float v11 = src(i, j).x;
+	float2 grad;
+	if (v11 < 0.0f) {
+		grad.x = std::max(v11 - v01, 0.0f) + std::min(v21 - v11, 0.0f);
+		grad.y = std::max(v11 - v10, 0.0f) + std::min(v12 - v11, 0.0f);
+	} else {
+		grad.x = std::min(v11 - v01, 0.0f) + std::max(v21 - v11, 0.0f);
+		grad.y = std::min(v11 - v10, 0.0f) + std::max(v12 - v11, 0.0f);
+	}
+	return grad;
+}
+static float3 UpwindGradient(const Volume1f& src, int i, int j, int k) {
+	float v211 = src(i + 1, j, k).x;
+	float v121 = src(i, j + 1, k).x;
+	float v101 = src(i, j - 1, k).x;
+	float v011 = src(i - 1, j, k).x;
+	float v110 = src(i, j, k - 1).x;
+	float v112 = src(i, j, k + 1).x;
+	float v111 = src(i, j, k).x;
+	float3 grad;
+	if (v111 < 0.0f) {
+		grad.x = std::max(v111 - v011, 0.0f) + std::min(v211 - v111, 0.0f);
+		grad.y = std::max(v111 - v101, 0.0f) + std::min(v121 - v111, 0.0f);
+		grad.z = std::max(v111 - v110, 0.0f) + std::min(v112 - v111, 0.0f);
+	} else {
+		grad.x = std::min(v111 - v011, 0.0f) + std::max(v211 - v111, 0.0f);
+		grad.y = std::min(v111 - v101, 0.0f) + std::max(v121 - v111, 0.0f);
+		grad.z = std::min(v111 - v110, 0.0f) + std::max(v112 - v111, 0.0f);
 	}
-	SolveVecCG(b, A, x, iterations, 1E-20f);
-	vectorField.set(x.data);
+	return grad;
+}
+static void NormalizeVectorField(const Image1f& src, Image2f& vectorField) {
 	const float minSpeed = 0.1f;
 	const float captureDist = 1.5f;
-	if (normalize) {
 #pragma omp parallel for
+	for (int j = 0; j < src.height; j++) {
 		for (int i = 0; i < src.width; i++) {
-			for (int j = 0; j < src.height; j++) {
-				float d = std::abs(src(i, j).x);
-				vectorField(i, j) = aly::normalize(vectorField(i, j))
+			float d = std::abs(src(i, j).x);
+			vectorField(i, j) = aly::normalize(vectorField(i, j))
+					* (minSpeed
+							+ (1.0f - minSpeed) * clamp(d, 0.0f, captureDist)
+									/ captureDist);
+		}
+	}
+}
+static void NormalizeVectorField(const Volume1f& src, Volume3f& vectorField) {
+	const float minSpeed = 0.1f;
+	const float captureDist = 1.5f;
+#pragma omp parallel for
+	for (int k = 0; k < src.slices; k++) {
+		for (int j = 0; j < src.cols; j++) {
+			for (int i = 0; i < src.rows; i++) {
+				float d = std::abs(src(i, j, k).x);
+				vectorField(i, j, k) = aly::normalize(vectorField(i, j, k))
 						* (minSpeed
 								+ (1.0f - minSpeed)
 										* clamp(d, 0.0f, captureDist)
@@ -194,432 +200,240 @@ void SolveGradientVectorFlow(const Image1f& src, Image2f& vectorField, float mu,
 		}
 	}
 }
+//The diffusion system is applied as a stencil instead of being assembled into a SparseMatrix.
+void SolveGradientVectorFlow(const Image1f& src, Image2f& vectorField, float mu,
+		int iterations, bool normalize, float tolerance) {
+	vectorField.resize(src.width, src.height);
+	StencilSystem<float, 2> A;
+	A.resize(src.width, src.height);
+	A.weight = float2(mu * 0.25f);
+	std::vector<float2> b(A.size());
+#pragma omp parallel for
+	for (int j = 0; j < src.height; j++) {
+		for (int i = 0; i < src.width; i++) {
+			int idx = i + j * src.width;
+			float2 grad = UpwindGradient(src, i, j);
+			float len = max(1E-6f, length(grad));
+			grad = -sign(src(i, j).x) * (grad / std::max(1E-6f, len));
+			vectorField.data[idx] = grad;
+			b[idx] = grad * len;
+			A.diagonal[idx] = float2(-len - mu);
+		}
+	}
+	SolveStencilCG(A, b, vectorField.data, iterations, tolerance);
+	if (normalize) {
+		NormalizeVectorField(src, vectorField);
+	}
+}
 
 void SolveGradientVectorFlow(const Volume1f& src, Volume3f& vectorField,
-		float mu, int iterations, bool normalize) {
-	const int nbrX[] = { -1, 1, 0, 0, 0, 0 };
-	const int nbrY[] = { 0, 0, -1, 1, 0, 0 };
-	const int nbrZ[] = { 0, 0, 0, 0, -1, 1 };
+		float mu, int iterations, bool normalize, float tolerance) {
 	vectorField.resize(src.rows, src.cols, src.slices);
-	SparseMatrix3f A;
-	Vector3f b;
-	Vector3f x;
-	//size_t N = 0;
-	size_t M = src.rows * src.cols * src.slices;
-	A.resize(M, M);
-	b.resize(M, float3(0.0f));
-	x.resize(M, float3(0.0f));
-	for (int i = 0; i < src.rows; i++) {
+	StencilSystem<float, 3> A;
+	A.resize(src.rows, src.cols, src.slices);
+	A.weight = float3(mu * 0.166666f);
+	std::vector<float3> b(A.size());
+#pragma omp parallel for
+	for (int k = 0; k < src.slices; k++) {
 		for (int j = 0; j < src.cols; j++) {
-			for (int k = 0; k < src.slices; k++) {
-				int idx = i + j * src.rows + k * src.rows * src.cols;
-				float v211 = src(i + 1, j, k).x;
-				float v121 = src(i, j + 1, k).x;
-				float v101 = src(i, j - 1, k).x;
-				float v011 = src(i - 1, j, k).x;
-				float v110 = src(i, j, k - 1).x;
-				float v112 = src(i, j, k + 1).x;
-				float v111 = src(i, j, k).x;
-				float3 grad;
-				if (v111 < 0.0f) {
-					grad.x = std::max(v111 - v011, 0.0f)
-							+ std::min(v211 - v111, 0.0f);
-					grad.y = std::max(v111 - v101, 0.0f)
-							+ std::min(v121 - v111, 0.0f);
-					grad.z = std::max(v111 - v110, 0.0f)
-							+ std::min(v112 - v111, 0.0f);
-				} else {
-					grad.x = std::min(v111 - v011, 0.0f)
-							+ std::max(v211 - v111, 0.0f);
-					grad.y = std::min(v111 - v101, 0.0f)
-							+ std::max(v121 - v111, 0.0f);
-					grad.z = std::min(v111 - v110, 0.0f)
-							+ std::max(v112 - v111, 0.0f);
-				}
+			for (int i = 0; i < src.rows; i++) {
+				size_t idx = i + j * (size_t) src.rows
+						+ k * (size_t) src.rows * src.cols;
+				float3 grad = UpwindGradient(src, i, j, k);
 				float len = max(1E-6f, length(grad));
-				grad = -sign(v111) * (grad / std::max(1E-6f, len));
-				x[idx] = grad;
+				grad = -sign(src(i, j, k).x) * (grad / std::max(1E-6f, len));
+				vectorField.data[idx] = grad;
 				b[idx] = grad * len;
-				A(idx, idx) = float3(-len - mu);
-				for (int nn = 0; nn < 6; nn++) {
-					int ii = i + nbrX[nn];
-					int jj = j + nbrY[nn];
-					int kk = k + nbrZ[nn];
-					if (ii >= 0 && ii < src.rows && jj >= 0 && jj < src.cols
-							&& kk >= 0 && kk < src.slices) {
-						A(idx, ii + jj * src.rows + kk * src.rows * src.cols) +=
-								float3(mu * 0.166666f);
-
-					}
-				}
+				A.diagonal[idx] = float3(-len - mu);
 			}
 		}
 	}
-	SolveVecCG(b, A, x, iterations, 1E-20f);
-	vectorField.set(x.data);
-	const float minSpeed = 0.1f;
-	const float captureDist = 1.5f;
+	SolveStencilCG(A, b, vectorField.data, iterations, tolerance);
 	if (normalize) {
-#pragma omp parallel for
-		for (int i = 0; i < src.rows; i++) {
-			for (int j = 0; j < src.cols; j++) {
-				for (int k = 0; k < src.slices; k++) {
-					float d = std::abs(src(i, j, k).x);
-					vectorField(i, j, k) = aly::normalize(vectorField(i, j, k))
-							* (minSpeed
-									+ (1.0f - minSpeed)
-											* clamp(d, 0.0f, captureDist)
-											/ captureDist);
-				}
-			}
-		}
+		NormalizeVectorField(src, vectorField);
 	}
 }
 void SolveGradientVectorFlow(const Image1f& src, Image2f& vectorField,
-		const Image1f& weights, float mu, int iterations, bool normalize) {
-	const int nbrX[] = { 0, 0, -1, 1 };
-	const int nbrY[] = { 1, -1, 0, 0 };
+		const Image1f& weights, float mu, int iterations, bool normalize,
+		float tolerance) {
 	vectorField.resize(src.width, src.height);
-	SparseMatrix2f A;
-	Vector2f b;
-	Vector2f x;
-	//size_t N = 0;
-	size_t M = src.width * src.height;
-	A.resize(M, M);
-	b.resize(M, float2(0.0f));
-	x.resize(M, float2(0.0f));
-	for (int i = 0; i < src.width; i++) {
-		for (int j = 0; j < src.height; j++) {
+	StencilSystem<float, 2> A;
+	A.resize(src.width, src.height);
+	A.weight = float2(mu * 0.25f);
+	std::vector<float2> b(A.size());
+#pragma omp parallel for
+	for (int j = 0; j < src.height; j++) {
+		for (int i = 0; i < src.width; i++) {
 			int idx = i + j * src.width;
-			float v21 = src(i + 1, j).x;
-			float v12 = src(i, j + 1).x;
-			float v10 = src(i, j - 1).x;
-			float v01 = src(i - 1, j).x;
-			float v11 = src(i, j).x;
-			float2 grad;
-			if (v11 < 0.0f) {
-				grad.x = std::max(v11 - v01, 0.0f) + std::min(v21 - v11, 0.0f);
-				grad.y = std::max(v11 - v10, 0.0f) + std::min(v12 - v11, 0.0f);
-			} else {
-				grad.x = std::min(v11 - v01, 0.0f) + std::max(v21 - v11, 0.0f);
-				grad.y = std::min(v11 - v10, 0.0f) + std::max(v12 - v11, 0.0f);
-			}
+			float2 grad = UpwindGradient(src, i, j);
 			float len = max(1E-6f, length(grad));
-			grad = -sign(v11) * (grad / std::max(1E-6f, len));
+			grad = -sign(src(i, j).x) * (grad / std::max(1E-6f, len));
 			float w = weights(i, j).x;
-			x[idx] = grad;
+			vectorField.data[idx] = grad;
 			b[idx] = w * grad;
-			A(idx, idx) = float2(-w - mu);
-			for (int nn = 0; nn < 4; nn++) {
-				int ii = i + nbrX[nn];
-				int jj = j + nbrY[nn];
-				if (ii >= 0 && ii < src.width && jj >= 0 && jj < src.height) {
-					A(idx, ii + src.width * jj) += float2(mu * 0.25f);
-
-				}
-			}
+			A.diagonal[idx] = float2(-w - mu);
 		}
 	}
-	SolveVecCG(b, A, x, iterations, 1E-20f);
-	vectorField.set(x.data);
-	const float minSpeed = 0.1f;
-	const float captureDist = 1.5f;
+	SolveStencilCG(A, b, vectorField.data, iterations, tolerance);
 	if (normalize) {
-#pragma omp parallel for
-		for (int i = 0; i < src.width; i++) {
-			for (int j = 0; j < src.height; j++) {
-				float d = std::abs(src(i, j).x);
-				vectorField(i, j) = aly::normalize(vectorField(i, j))
-						* (minSpeed
-								+ (1.0f - minSpeed)
-										* clamp(d, 0.0f, captureDist)
-										/ captureDist);
-			}
-		}
+		NormalizeVectorField(src, vectorField);
 	}
 }
 
 void SolveGradientVectorFlow(const Volume1f& src, Volume3f& vectorField,
-		const Volume1f& weights, float mu, int iterations, bool normalize) {
-	const int nbrX[] = { -1, 1, 0, 0, 0, 0 };
-	const int nbrY[] = { 0, 0, -1, 1, 0, 0 };
-	const int nbrZ[] = { 0, 0, 0, 0, -1, 1 };
+		const Volume1f& weights, float mu, int iterations, bool normalize,
+		float tolerance) {
 	vectorField.resize(src.rows, src.cols, src.slices);
-	SparseMatrix3f A;
-	Vector3f b;
-	Vector3f x;
-	//size_t N = 0;
-	size_t M = src.rows * src.cols * src.slices;
-	A.resize(M, M);
-	b.resize(M, float3(0.0f));
-	x.resize(M, float3(0.0f));
-	for (int i = 0; i < src.rows; i++) {
+	StencilSystem<float, 3> A;
+	A.resize(src.rows, src.cols, src.slices);
+	A.weight = float3(mu * 0.166666f);
+	std::vector<float3> b(A.size());
+#pragma omp parallel for
+	for (int k = 0; k < src.slices; k++) {
 		for (int j = 0; j < src.cols; j++) {
-			for (int k = 0; k < src.slices; k++) {
-				int idx = i + j * src.rows + k * src.rows * src.cols;
-				float v211 = src(i + 1, j, k).x;
-				float v121 = src(i, j + 1, k).x;
-				float v101 = src(i, j - 1, k).x;
-				float v011 = src(i - 1, j, k).x;
-				float v110 = src(i, j, k - 1).x;
-				float v112 = src(i, j, k + 1).x;
-				float v111 = src(i, j, k).x;
-				float3 grad;
-				if (v111 < 0.0f) {
-					grad.x = std::max(v111 - v011, 0.0f)
-							+ std::min(v211 - v111, 0.0f);
-					grad.y = std::max(v111 - v101, 0.0f)
-							+ std::min(v121 - v111, 0.0f);
-					grad.z = std::max(v111 - v110, 0.0f)
-							+ std::min(v112 - v111, 0.0f);
-				} else {
-					grad.x = std::min(v111 - v011, 0.0f)
-							+ std::max(v211 - v111, 0.0f);
-					grad.y = std::min(v111 - v101, 0.0f)
-							+ std::max(v121 - v111, 0.0f);
-					grad.z = std::min(v111 - v110, 0.0f)
-							+ std::max(v112 - v111, 0.0f);
-				}
+			for (int i = 0; i < src.rows; i++) {
+				size_t idx = i + j * (size_t) src.rows
+						+ k * (size_t) src.rows * src.cols;
+				float3 grad = UpwindGradient(src, i, j, k);
 				float len = max(1E-6f, length(grad));
-				grad = -sign(v111) * (grad / std::max(1E-6f, len));
-
+				grad = -sign(src(i, j, k).x) * (grad / std::max(1E-6f, len));
 				float w = weights(i, j, k).x;
-				x[idx] = grad;
+				vectorField.data[idx] = grad;
 				b[idx] = w * grad;
-				A(idx, idx) = float3(-w - mu);
-				for (int nn = 0; nn < 6; nn++) {
-					int ii = i + nbrX[nn];
-					int jj = j + nbrY[nn];
-					int kk = k + nbrZ[nn];
-					if (ii >= 0 && ii < src.rows && jj >= 0 && jj < src.cols
-							&& kk >= 0 && kk < src.slices) {
-						A(idx, ii + jj * src.rows + kk * src.rows * src.cols) +=
-								float3(mu * 0.166666f);
-
-					}
-				}
+				A.diagonal[idx] = float3(-w - mu);
 			}
 		}
 	}
-	SolveVecCG(b, A, x, iterations, 1E-20f);
-	vectorField.set(x.data);
-	const float minSpeed = 0.1f;
-	const float captureDist = 1.5f;
+	SolveStencilCG(A, b, vectorField.data, iterations, tolerance);
 	if (normalize) {
-		for (int i = 0; i < src.rows; i++) {
-			for (int j = 0; j < src.cols; j++) {
-				for (int k = 0; k < src.slices; k++) {
-					float d = std::abs(src(i, j, k).x);
-					vectorField(i, j, k) = aly::normalize(vectorField(i, j, k))
-							* (minSpeed
-									+ (1.0f - minSpeed)
-											* clamp(d, 0.0f, captureDist)
-											/ captureDist);
-				}
-			}
-		}
+		NormalizeVectorField(src, vectorField);
 	}
 }
-
+//Cells next to the zero crossing keep their gradient direction and the rest are harmonic interpolants.
 void SolveGradientVectorFlow(const Image1f& src, Image2f& vectorField,
-		int iterations, bool normalize) {
+		int iterations, bool normalize, float tolerance) {
 	const int nbrX[] = { 0, 0, -1, 1 };
 	const int nbrY[] = { 1, -1, 0, 0 };
 	vectorField.resize(src.width, src.height);
-	SparseMatrix2f A;
-	Vector2f b;
-	Vector2f x;
-	size_t N = 0;
-	Image1b mask(src.width, src.height);
-	mask.set(bool1(false));
-	for (int i = 0; i < src.width; i++) {
-		for (int j = 0; j < src.height; j++) {
+	StencilSystem<float, 2> A;
+	A.resize(src.width, src.height);
+	A.weight = float2(1.0f);
+	A.coupling.resize(A.size());
+	std::vector<float2> b(A.size());
+#pragma omp parallel for
+	for (int j = 0; j < src.height; j++) {
+		for (int i = 0; i < src.width; i++) {
+			int idx = i + j * src.width;
 			float sVal = src(i, j).x;
 			bool masked = false;
+			int count = 0;
 			for (int nn = 0; nn < 4; nn++) {
 				int ii = i + nbrX[nn];
 				int jj = j + nbrY[nn];
 				if (src(ii, jj).x * sVal < 0.0f) {
-					mask(i, j) = bool1(true);
 					masked = true;
-					break;
 				}
-			}
-			if (!masked) {
-				N++;
-			}
-		}
-	}
-	size_t M = src.width * src.height;
-	A.resize(M, M);
-	b.resize(M, float2(0.0f));
-	x.resize(M, float2(0.0f));
-	for (int i = 0; i < src.width; i++) {
-		for (int j = 0; j < src.height; j++) {
-			int idx = i + j * src.width;
-			if (mask(i, j).x) {
-				float v21 = src(i + 1, j).x;
-				float v12 = src(i, j + 1).x;
-				float v10 = src(i, j - 1).x;
-				float v01 = src(i - 1, j).x;
-				float v11 = src(i, j).x;
-				float2 grad;
-				if (v11 < 0.0f) {
-					grad.x = std::max(v11 - v01, 0.0f)
-							+ std::min(v21 - v11, 0.0f);
-					grad.y = std::max(v11 - v10, 0.0f)
-							+ std::min(v12 - v11, 0.0f);
-				} else {
-					grad.x = std::min(v11 - v01, 0.0f)
-							+ std::max(v21 - v11, 0.0f);
-					grad.y = std::min(v11 - v10, 0.0f)
-							+ std::max(v12 - v11, 0.0f);
+				if (ii >= 0 && ii < src.width && jj >= 0 && jj < src.height) {
+					count++;
 				}
+			}
+			if (masked) {
+				float2 grad = UpwindGradient(src, i, j);
 				float len = max(1E-6f, length(grad));
-				grad = -sign(v11) * (grad / std::max(1E-6f, len));
-				x[idx] = grad;
+				grad = -sign(sVal) * (grad / std::max(1E-6f, len));
+				vectorField.data[idx] = grad;
 				b[idx] = grad;
-				A(idx, idx) = float2(1.0f);
+				A.diagonal[idx] = float2(1.0f);
+				A.coupling[idx] = 0.0f;
 			} else {
-				for (int nn = 0; nn < 4; nn++) {
-					int ii = i + nbrX[nn];
-					int jj = j + nbrY[nn];
-					if (ii >= 0 && ii < src.width && jj >= 0
-							&& jj < src.height) {
-						A(idx, ii + src.width * jj) += float2(1.0f);
-						A(idx, idx) += float2(-1.0f);
-					}
-				}
+				vectorField.data[idx] = float2(0.0f);
+				b[idx] = float2(0.0f);
+				A.diagonal[idx] = float2(-(float) count);
+				A.coupling[idx] = 1.0f;
 			}
 		}
 	}
-	SolveVecBICGStab(b, A, x, iterations, 1E-10f);
-	vectorField.set(x.data);
-	const float minSpeed = 0.1f;
-	const float captureDist = 1.5f;
+	SolveStencilBICGStab(A, b, vectorField.data, iterations, tolerance);
 	if (normalize) {
-		for (int i = 0; i < src.width; i++) {
-			for (int j = 0; j < src.height; j++) {
-				float d = std::abs(src(i, j).x);
-				vectorField(i, j) = aly::normalize(vectorField(i, j))
-						* (minSpeed
-								+ (1.0f - minSpeed)
-										* clamp(d, 0.0f, captureDist)
-										/ captureDist);
-			}
-		}
+		NormalizeVectorField(src, vectorField);
 	}
 }
 
 void SolveGradientVectorFlow(const Volume1f& src, Volume3f& vectorField,
-		int iterations, bool normalize) {
+		int iterations, bool normalize, float tolerance) {
 	const int nbrX[] = { -1, 1, 0, 0, 0, 0 };
 	const int nbrY[] = { 0, 0, -1, 1, 0, 0 };
 	const int nbrZ[] = { 0, 0, 0, 0, -1, 1 };
 	vectorField.resize(src.rows, src.cols, src.slices);
-	SparseMatrix3f A;
-	Vector3f b;
-	Vector3f x;
-	//size_t N = 0;
-	size_t M = src.rows * src.cols * src.slices;
-	A.resize(M, M);
-	b.resize(M, float3(0.0f));
-	x.resize(M, float3(0.0f));
-	size_t N = 0;
-	Volume1b mask(src.rows, src.cols, src.slices);
-	mask.set(bool1(false));
-	for (int i = 0; i < src.rows; i++) {
+	StencilSystem<float, 3> A;
+	A.resize(src.rows, src.cols, src.slices);
+	A.weight = float3(1.0f);
+	A.coupling.resize(A.size());
+	std::vector<float3> b(A.size());
+#pragma omp parallel for
+	for (int k = 0; k < src.slices; k++) {
 		for (int j = 0; j < src.cols; j++) {
-			for (int k = 0; k < src.slices; k++) {
+			for (int i = 0; i < src.rows; i++) {
+				size_t idx = i + j * (size_t) src.rows
+						+ k * (size_t) src.rows * src.cols;
 				float sVal = src(i, j, k).x;
 				bool masked = false;
+				int count = 0;
 				for (int nn = 0; nn < 6; nn++) {
 					int ii = i + nbrX[nn];
 					int jj = j + nbrY[nn];
 					int kk = k + nbrZ[nn];
 					if (src(ii, jj, kk).x * sVal < 0.0f) {
-						mask(i, j, k) = bool1(true);
 						masked = true;
-						break;
 					}
-				}
-				if (!masked) {
-					N++;
-				}
-			}
-		}
-	}
-	for (int i = 0; i < src.rows; i++) {
-		for (int j = 0; j < src.cols; j++) {
-			for (int k = 0; k < src.slices; k++) {
-				int idx = i + j * src.rows + k * src.rows * src.cols;
-				if (mask(i, j, k).x) {
-
-					float v211 = src(i + 1, j, k).x;
-					float v121 = src(i, j + 1, k).x;
-					float v101 = src(i, j - 1, k).x;
-					float v011 = src(i - 1, j, k).x;
-					float v110 = src(i, j, k - 1).x;
-					float v112 = src(i, j, k + 1).x;
-					float v111 = src(i, j, k).x;
-					float3 grad;
-					if (v111 < 0.0f) {
-						grad.x = std::max(v111 - v011, 0.0f)
-								+ std::min(v211 - v111, 0.0f);
-						grad.y = std::max(v111 - v101, 0.0f)
-								+ std::min(v121 - v111, 0.0f);
-						grad.z = std::max(v111 - v110, 0.0f)
-								+ std::min(v112 - v111, 0.0f);
-					} else {
-						grad.x = std::min(v111 - v011, 0.0f)
-								+ std::max(v211 - v111, 0.0f);
-						grad.y = std::min(v111 - v101, 0.0f)
-								+ std::max(v121 - v111, 0.0f);
-						grad.z = std::min(v111 - v110, 0.0f)
-								+ std::max(v112 - v111, 0.0f);
+					if (ii >= 0 && ii < src.rows && jj >= 0 && jj < src.cols
+							&& kk >= 0 && kk < src.slices) {
+						count++;
 					}
-
+				}
+				if (masked) {
+					float3 grad = UpwindGradient(src, i, j, k);
 					float len = max(1E-6f, length(grad));
-					grad = -sign(v111) * (grad / std::max(1E-6f, len));
-					x[idx] = grad;
+					grad = -sign(sVal) * (grad / std::max(1E-6f, len));
+					vectorField.data[idx] = grad;
 					b[idx] = grad;
-					A(idx, idx) = float3(1.0f);
+					A.diagonal[idx] = float3(1.0f);
+					A.coupling[idx] = 0.0f;
 				} else {
-					for (int nn = 0; nn < 6; nn++) {
-						int ii = i + nbrX[nn];
-						int jj = j + nbrY[nn];
-						int kk = k + nbrZ[nn];
-						if (ii >= 0 && ii < src.rows && jj >= 0 && jj < src.cols
-								&& kk >= 0 && kk < src.slices) {
-							A(idx,
-									ii + jj * src.rows
-											+ kk * src.rows * src.cols) +=
-									float3(1.0f);
-							A(idx, idx) += float3(-1.0f);
-						}
-					}
+					vectorField.data[idx] = float3(0.0f);
+					b[idx] = float3(0.0f);
+					A.diagonal[idx] = float3(-(float) count);
+					A.coupling[idx] = 1.0f;
 				}
 			}
 		}
 	}
-	SolveVecCG(b, A, x, iterations, 1E-20f);
-	vectorField.set(x.data);
-	const float minSpeed = 0.1f;
-	const float captureDist = 1.5f;
+	SolveStencilCG(A, b, vectorField.data, iterations, tolerance);
 	if (normalize) {
-		for (int i = 0; i < src.rows; i++) {
-			for (int j = 0; j < src.cols; j++) {
-				for (int k = 0; k < src.slices; k++) {
-					float d = std::abs(src(i, j, k).x);
-					vectorField(i, j, k) = aly::normalize(vectorField(i, j, k))
-							* (minSpeed
-									+ (1.0f - minSpeed)
-											* clamp(d, 0.0f, captureDist)
-											/ captureDist);
-				}
-			}
-		}
+		NormalizeVectorField(src, vectorField);
 	}
 }
 
+void SolveGradientVectorFlow(ResultCache& cache, const Image1f& src,
+		Image2f& vectorField, float mu, int iterations, bool normalize,
+		float tolerance) {
+	cache.compute(
+			MakeCacheKey("SolveGradientVectorFlow", ContentKey(src), mu,
+					iterations, normalize, tolerance), vectorField,
+			[&](Image2f& out) {
+				SolveGradientVectorFlow(src, out, mu, iterations, normalize,
+						tolerance);
+			});
+}
+void SolveGradientVectorFlow(ResultCache& cache, const Volume1f& src,
+		Volume3f& vectorField, float mu, int iterations, bool normalize,
+		float tolerance) {
+	cache.compute(
+			MakeCacheKey("SolveGradientVectorFlow", ContentKey(src), mu,
+					iterations, normalize, tolerance), vectorField,
+			[&](Volume3f& out) {
+				SolveGradientVectorFlow(src, out, mu, iterations, normalize,
+						tolerance);
+			});
+}
 }
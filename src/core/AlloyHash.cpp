@@ -0,0 +1,292 @@
+/*
+ * Copyright(C) 2018, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "AlloyHash.h"
+#include "AlloyFileUtil.h"
+#include <cstring>
+#include <algorithm>
+namespace aly {
+	static const uint64_t XXH_PRIME1 = 11400714785074694791ULL;
+	static const uint64_t XXH_PRIME2 = 14029467366897019727ULL;
+	static const uint64_t XXH_PRIME3 = 1609587929392839161ULL;
+	static const uint64_t XXH_PRIME4 = 9650029242287828579ULL;
+	static const uint64_t XXH_PRIME5 = 2870177450012600261ULL;
+	//Seed of the second FAST128 lane.
+	static const uint64_t XXH_SEED128 = 0x9E3779B97F4A7C15ULL;
+	inline uint64_t XXHRotl(uint64_t x, int r) {
+		return (x << r) | (x >> (64 - r));
+	}
+	//Byte order is little-endian on every platform we build for.
+	inline uint64_t XXHRead64(const uint8_t* ptr) {
+		uint64_t val;
+		std::memcpy(&val, ptr, sizeof(val));
+		return val;
+	}
+	inline uint32_t XXHRead32(const uint8_t* ptr) {
+		uint32_t val;
+		std::memcpy(&val, ptr, sizeof(val));
+		return val;
+	}
+	inline uint64_t XXHRound(uint64_t acc, uint64_t input) {
+		acc += input * XXH_PRIME2;
+		acc = XXHRotl(acc, 31);
+		return acc * XXH_PRIME1;
+	}
+	inline uint64_t XXHMerge(uint64_t acc, uint64_t val) {
+		acc ^= XXHRound(0, val);
+		return acc * XXH_PRIME1 + XXH_PRIME4;
+	}
+	void XXH64State::reset(uint64_t s) {
+		seed = s;
+		acc[0] = seed + XXH_PRIME1 + XXH_PRIME2;
+		acc[1] = seed + XXH_PRIME2;
+		acc[2] = seed;
+		acc[3] = seed - XXH_PRIME1;
+		total = 0;
+		memSize = 0;
+	}
+	void XXH64State::update(const uint8_t* data, size_t len) {
+		total += len;
+		if (memSize + len < 32) {
+			if (len > 0) {
+				std::memcpy(mem + memSize, data, len);
+			}
+			memSize += (uint32_t) len;
+			return;
+		}
+		const uint8_t* end = data + len;
+		if (memSize > 0) {
+			size_t fill = 32 - memSize;
+			std::memcpy(mem + memSize, data, fill);
+			acc[0] = XXHRound(acc[0], XXHRead64(mem));
+			acc[1] = XXHRound(acc[1], XXHRead64(mem + 8));
+			acc[2] = XXHRound(acc[2], XXHRead64(mem + 16));
+			acc[3] = XXHRound(acc[3], XXHRead64(mem + 24));
+			data += fill;
+			memSize = 0;
+		}
+		uint64_t v1 = acc[0], v2 = acc[1], v3 = acc[2], v4 = acc[3];
+		while (end - data >= 32) {
+			v1 = XXHRound(v1, XXHRead64(data));
+			v2 = XXHRound(v2, XXHRead64(data + 8));
+			v3 = XXHRound(v3, XXHRead64(data + 16));
+			v4 = XXHRound(v4, XXHRead64(data + 24));
+			data += 32;
+		}
+		acc[0] = v1;
+		acc[1] = v2;
+		acc[2] = v3;
+		acc[3] = v4;
+		if (data < end) {
+			memSize = (uint32_t) (end - data);
+			std::memcpy(mem, data, memSize);
+		}
+	}
+	uint64_t XXH64State::digest() const {
+		uint64_t h;
+		if (total >= 32) {
+			h = XXHRotl(acc[0], 1) + XXHRotl(acc[1], 7) + XXHRotl(acc[2], 12) + XXHRotl(acc[3], 18);
+			for (int n = 0; n < 4; n++) {
+				h = XXHMerge(h, acc[n]);
+			}
+		} else {
+			h = seed + XXH_PRIME5;
+		}
+		h += total;
+		const uint8_t* p = mem;
+		const uint8_t* end = mem + memSize;
+		while (p + 8 <= end) {
+			h ^= XXHRound(0, XXHRead64(p));
+			h = XXHRotl(h, 27) * XXH_PRIME1 + XXH_PRIME4;
+			p += 8;
+		}
+		if (p + 4 <= end) {
+			h ^= (uint64_t) XXHRead32(p) * XXH_PRIME1;
+			h = XXHRotl(h, 23) * XXH_PRIME2 + XXH_PRIME3;
+			p += 4;
+		}
+		while (p < end) {
+			h ^= (*p) * XXH_PRIME5;
+			h = XXHRotl(h, 11) * XXH_PRIME1;
+			p++;
+		}
+		h ^= h >> 33;
+		h *= XXH_PRIME2;
+		h ^= h >> 29;
+		h *= XXH_PRIME3;
+		h ^= h >> 32;
+		return h;
+	}
+	uint64_t XXH64(const void* data, size_t len, uint64_t seed) {
+		XXH64State state;
+		state.reset(seed);
+		state.update((const uint8_t*) data, len);
+		return state.digest();
+	}
+	HashStream::HashStream(HashMethod method) :
+			method(method) {
+		reset();
+	}
+	void HashStream::reset() {
+		switch (method) {
+		case HashMethod::SHA1:
+			sha1Ctx = SHA1();
+			break;
+		case HashMethod::FAST64:
+		case HashMethod::FAST128:
+			fastCtx[0].reset(0);
+			fastCtx[1].reset(XXH_SEED128);
+			break;
+		case HashMethod::SHA224:
+			sha224_init(&sha256Ctx);
+			break;
+		case HashMethod::SHA256:
+			sha256_init(&sha256Ctx);
+			break;
+		case HashMethod::SHA384:
+			sha384_init(&sha512Ctx);
+			break;
+		case HashMethod::SHA512:
+			sha512_init(&sha512Ctx);
+			break;
+		}
+	}
+	size_t HashStream::getDigestSize() const {
+		switch (method) {
+		case HashMethod::SHA1:
+			return SHA1::DIGEST_BYTES;
+		case HashMethod::FAST64:
+			return 8;
+		case HashMethod::FAST128:
+			return 16;
+		case HashMethod::SHA224:
+			return SHA224_DIGEST_SIZE;
+		case HashMethod::SHA256:
+			return SHA256_DIGEST_SIZE;
+		case HashMethod::SHA384:
+			return SHA384_DIGEST_SIZE;
+		case HashMethod::SHA512:
+			return SHA512_DIGEST_SIZE;
+		}
+		return 0;
+	}
+	void HashStream::update(const void* data, size_t bytes) {
+		const unsigned char* ptr = (const unsigned char*) data;
+		switch (method) {
+		case HashMethod::SHA1:
+			sha1Ctx.update(ptr, bytes);
+			break;
+		case HashMethod::FAST64:
+			fastCtx[0].update(ptr, bytes);
+			break;
+		case HashMethod::FAST128:
+			fastCtx[0].update(ptr, bytes);
+			fastCtx[1].update(ptr, bytes);
+			break;
+		case HashMethod::SHA224:
+			sha224_update(&sha256Ctx, ptr, bytes);
+			break;
+		case HashMethod::SHA256:
+			sha256_update(&sha256Ctx, ptr, bytes);
+			break;
+		case HashMethod::SHA384:
+			sha384_update(&sha512Ctx, ptr, bytes);
+			break;
+		case HashMethod::SHA512:
+			sha512_update(&sha512Ctx, ptr, bytes);
+			break;
+		}
+	}
+	std::vector<uint8_t> HashStream::digest() {
+		std::vector<uint8_t> out(getDigestSize());
+		switch (method) {
+		case HashMethod::SHA1:
+			sha1Ctx.final(out.data());
+			break;
+		case HashMethod::FAST64:
+		case HashMethod::FAST128:
+			//Canonical big-endian byte order, one lane per 8 bytes.
+			for (size_t n = 0; n < out.size() / 8; n++) {
+				uint64_t h = fastCtx[n].digest();
+				for (int b = 0; b < 8; b++) {
+					out[8 * n + b] = (uint8_t) (h >> (56 - 8 * b));
+				}
+			}
+			break;
+		case HashMethod::SHA224:
+			sha224_final(&sha256Ctx, out.data());
+			break;
+		case HashMethod::SHA256:
+			sha256_final(&sha256Ctx, out.data());
+			break;
+		case HashMethod::SHA384:
+			sha384_final(&sha512Ctx, out.data());
+			break;
+		case HashMethod::SHA512:
+			sha512_final(&sha512Ctx, out.data());
+			break;
+		}
+		reset();
+		return out;
+	}
+	std::string HashStream::finish() {
+		return EncodeHashDigest(digest(), method);
+	}
+	std::string EncodeHashDigest(const std::vector<uint8_t>& digest, HashMethod method) {
+		switch (method) {
+		case HashMethod::SHA1:
+		case HashMethod::FAST64:
+		case HashMethod::FAST128: {
+			static const char hex[] = "0123456789abcdef";
+			std::string str(2 * digest.size(), '0');
+			for (size_t n = 0; n < digest.size(); n++) {
+				str[2 * n] = hex[digest[n] >> 4];
+				str[2 * n + 1] = hex[digest[n] & 0x0F];
+			}
+			return str;
+		}
+		default:
+			return EncodeBase64(digest, false);
+		}
+	}
+	std::string HashCode(const void* data, size_t bytes, HashMethod method, size_t treeChunkSize) {
+		HashStream root(method);
+		if (treeChunkSize == 0 || bytes <= treeChunkSize) {
+			root.update(data, bytes);
+			return root.finish();
+		}
+		const uint8_t* ptr = (const uint8_t*) data;
+		const int chunks = (int) ((bytes + treeChunkSize - 1) / treeChunkSize);
+		const size_t digestSize = root.getDigestSize();
+		std::vector<uint8_t> leafDigests(chunks * digestSize);
+#pragma omp parallel for
+		for (int c = 0; c < chunks; c++) {
+			size_t offset = c * treeChunkSize;
+			HashStream leaf(method);
+			leaf.update(ptr + offset, std::min(treeChunkSize, bytes - offset));
+			std::vector<uint8_t> d = leaf.digest();
+			std::memcpy(&leafDigests[c * digestSize], d.data(), digestSize);
+		}
+		uint64_t header[2] = { (uint64_t) bytes, (uint64_t) treeChunkSize };
+		root.update(header, sizeof(header));
+		root.update(leafDigests);
+		return root.finish();
+	}
+}
@@ -29,7 +29,7 @@
 #include "stb_image.h"
 #include "stb_image_write.h"
 
-#include "tinyexr.h"
+#include "AlloyEXR.h"
 
 #include <fstream>
 
@@ -557,46 +557,7 @@ void ReadImageFromFile(const std::string& file, ImageRGB& image) {
 void ReadImageFromFile(const std::string& file, ImageRGBAf& img) {
 	std::string ext = GetFileExtension(file);
 	if (ext == "exr") {
-		const char *message = nullptr;
-		EXRImage exrImage;
-		InitEXRImage(&exrImage);
-		int ret = ParseMultiChannelEXRHeaderFromFile(&exrImage, file.c_str(),
-				&message);
-		if (ret != 0) {
-			throw std::runtime_error(message);
-		}
-		for (int i = 0; i < exrImage.num_channels; i++) {
-			if (exrImage.pixel_types[i] == TINYEXR_PIXELTYPE_HALF) {
-				exrImage.requested_pixel_types[i] = TINYEXR_PIXELTYPE_FLOAT;
-			}
-		}
-		ret = LoadMultiChannelEXRFromFile(&exrImage, file.c_str(), &message);
-		if (ret != 0) {
-			throw std::runtime_error(message);
-		}
-		std::vector<int> channelIndex(4, 0);
-		for (int i = 0; i < exrImage.num_channels; i++) {
-			std::string cname(exrImage.channel_names[i]);
-			if (cname == "R" || cname == "r"||cname=="red"||cname=="RED") {
-				channelIndex[0] = i;
-			} else if (cname == "G" || cname == "g"||cname=="green"||cname=="GREEN") {
-				channelIndex[1] = i;
-			} else if (cname == "B" || cname == "b"||cname=="blue"||cname=="BLUE") {
-				channelIndex[2] = i;
-			} else if (cname == "A" || cname == "a"||cname=="alpha"||cname=="ALPHA") {
-				channelIndex[3] = i;
-			}
-		}
-		img.resize(exrImage.width, exrImage.height);
-		std::vector<float> imageData(img.size() * img.channels);
-		float** ptr = reinterpret_cast<float **>(exrImage.images);
-		for (int c = 0; c < img.channels; c++) {
-			size_t index = 0;
-			for (float4& val : img.data) {
-				val[c] = ptr[channelIndex[c]][index++];
-			}
-		}
-		FreeEXRImage(&exrImage);
+		ReadEXRImage(file, img);
 	} else if (ext == "hdr") {
 		int w, h, n;
 		float *data = stbi_loadf(file.c_str(), &w, &h, &n, 4);
@@ -628,46 +589,7 @@ void ReadImageFromFile(const std::string& file, ImageRGBAf& img) {
 void ReadImageFromFile(const std::string& file, ImageRGBf& img) {
 	std::string ext = GetFileExtension(file);
 	if (ext == "exr") {
-		const char *message = nullptr;
-		EXRImage exrImage;
-		InitEXRImage(&exrImage);
-		int ret = ParseMultiChannelEXRHeaderFromFile(&exrImage, file.c_str(),
-				&message);
-		if (ret != 0) {
-			throw std::runtime_error(message);
-		}
-		for (int i = 0; i < exrImage.num_channels; i++) {
-			if (exrImage.pixel_types[i] == TINYEXR_PIXELTYPE_HALF) {
-				exrImage.requested_pixel_types[i] = TINYEXR_PIXELTYPE_FLOAT;
-			}
-		}
-		ret = LoadMultiChannelEXRFromFile(&exrImage, file.c_str(), &message);
-		if (ret != 0) {
-			throw std::runtime_error(message);
-		}
-		std::vector<int> channelIndex(3, 0);
-		for (int i = 0; i < exrImage.num_channels; i++) {
-			std::string cname(exrImage.channel_names[i]);
-			if (cname == "R" || cname == "r" || cname == "red" || cname == "RED") {
-				channelIndex[0] = i;
-			}
-			else if (cname == "G" || cname == "g" || cname == "green" || cname == "GREEN") {
-				channelIndex[1] = i;
-			}
-			else if (cname == "B" || cname == "b" || cname == "blue" || cname == "BLUE") {
-				channelIndex[2] = i;
-			}
-		}
-		img.resize(exrImage.width, exrImage.height);
-		std::vector<float> imageData(img.size() * img.channels);
-		float** ptr = reinterpret_cast<float **>(exrImage.images);
-		for (int c = 0; c < img.channels; c++) {
-			size_t index = 0;
-			for (float3& val : img.data) {
-				val[c] = ptr[channelIndex[c]][index++];
-			}
-		}
-		FreeEXRImage(&exrImage);
+		ReadEXRImage(file, img);
 	} else if (ext == "hdr") {
 		int w, h, n;
 		float *data = stbi_loadf(file.c_str(), &w, &h, &n, 3);
@@ -696,33 +618,7 @@ void ReadImageFromFile(const std::string& file, ImageRGBf& img) {
 void ReadImageFromFile(const std::string& file, Image1f& img) {
 	std::string ext = GetFileExtension(file);
 	if (ext == "exr") {
-		const char *message = nullptr;
-		EXRImage exrImage;
-		InitEXRImage(&exrImage);
-		int ret = ParseMultiChannelEXRHeaderFromFile(&exrImage, file.c_str(),
-				&message);
-		if (ret != 0) {
-			throw std::runtime_error(message);
-		}
-		for (int i = 0; i < exrImage.num_channels; i++) {
-			if (exrImage.pixel_types[i] == TINYEXR_PIXELTYPE_HALF) {
-				exrImage.requested_pixel_types[i] = TINYEXR_PIXELTYPE_FLOAT;
-			}
-		}
-		ret = LoadMultiChannelEXRFromFile(&exrImage, file.c_str(), &message);
-		if (ret != 0) {
-			throw std::runtime_error(message);
-		}
-		img.resize(exrImage.width, exrImage.height);
-		std::vector<float> imageData(img.size() * img.channels);
-		float** ptr = reinterpret_cast<float **>(exrImage.images);
-		for (int c = 0; c < img.channels; c++) {
-			size_t index = 0;
-			for (float1& val : img.data) {
-				val[c] = ptr[c][index++];
-			}
-		}
-		FreeEXRImage(&exrImage);
+		ReadEXRImage(file, img);
 	} else if (ext == "hdr") {
 		int w, h, n;
 		float *data = stbi_loadf(file.c_str(), &w, &h, &n, 1);
@@ -748,6 +644,44 @@ void ReadImageFromFile(const std::string& file, Image1f& img) {
 		}
 	}
 }
+template<int C, ImageType I, class F> static void ReadHalfImageFromFile(
+		const std::string& file, Image<half, C, I>& img) {
+	if (GetFileExtension(file) == "exr") {
+		ReadEXRImage(file, img);
+	} else {
+		F tmp;
+		ReadImageFromFile(file, tmp);
+		ConvertImage(tmp, img);
+	}
+}
+template<int C, ImageType I, class F> static void WriteHalfImageToFile(
+		const std::string& file, const Image<half, C, I>& img) {
+	if (GetFileExtension(file) == "exr") {
+		WriteEXRImage(file, img);
+	} else {
+		F tmp;
+		ConvertImage(img, tmp);
+		WriteImageToFile(file, tmp);
+	}
+}
+void ReadImageFromFile(const std::string& file, Image1h& img) {
+	ReadHalfImageFromFile<1, ImageType::HALF, Image1f>(file, img);
+}
+void ReadImageFromFile(const std::string& file, Image3h& img) {
+	ReadHalfImageFromFile<3, ImageType::HALF, ImageRGBf>(file, img);
+}
+void ReadImageFromFile(const std::string& file, Image4h& img) {
+	ReadHalfImageFromFile<4, ImageType::HALF, ImageRGBAf>(file, img);
+}
+void WriteImageToFile(const std::string& file, const Image1h& img) {
+	WriteHalfImageToFile<1, ImageType::HALF, Image1f>(file, img);
+}
+void WriteImageToFile(const std::string& file, const Image3h& img) {
+	WriteHalfImageToFile<3, ImageType::HALF, ImageRGBf>(file, img);
+}
+void WriteImageToFile(const std::string& file, const Image4h& img) {
+	WriteHalfImageToFile<4, ImageType::HALF, ImageRGBAf>(file, img);
+}
 void ReadImageFromFile(const std::string& file, Image2f& img) {
 	throw std::runtime_error("Reading two channel float images unsupported");
 }
@@ -765,47 +699,7 @@ void WriteImageToFile(const std::string& file, const ImageRGBAf& img) {
 	if (ext == "xml") {
 		WriteImageToRawFile(file, img);
 	} else if (ext == "exr") {
-		const char* err;
-		EXRImage exrImage;
-		InitEXRImage(&exrImage);
-		exrImage.num_channels = img.channels;
-		exrImage.width = img.width;
-		exrImage.height = img.height;
-		exrImage.pixel_types = (int *) malloc(sizeof(int *) * img.channels);
-		exrImage.requested_pixel_types = (int *) malloc(
-				sizeof(int *) * img.channels);
-		exrImage.channel_names = (const char **) malloc(
-				sizeof(const char *) * img.channels);
-		float** array = (float**) malloc(sizeof(float*) * img.channels);
-		for (int c = 0; c < img.channels; c++) {
-			array[c] = (float*) malloc(sizeof(float) * img.size());
-		}
-		exrImage.images = (unsigned char**) array;
-		for (int c = 0; c < img.channels; c++) {
-			size_t index = 0;
-			for (const float4& val : img.data) {
-				array[img.channels - 1 - c][index++] = val[c];
-			}
-		}
-		for (int c = 0; c < img.channels; c++) {
-			exrImage.pixel_types[c] = TINYEXR_PIXELTYPE_FLOAT;
-			exrImage.requested_pixel_types[c] = TINYEXR_PIXELTYPE_FLOAT;
-		}
-#ifdef _WIN32
-		exrImage.channel_names[0] = _strdup("A");
-		exrImage.channel_names[1] = _strdup("B");
-		exrImage.channel_names[2] = _strdup("G");
-		exrImage.channel_names[3] = _strdup("R");
-#else
-		exrImage.channel_names[0] = strdup("A");
-		exrImage.channel_names[1] = strdup("B");
-		exrImage.channel_names[2] = strdup("G");
-		exrImage.channel_names[3] = strdup("R");
-#endif
-		int ret = SaveMultiChannelEXRToFile(&exrImage, file.c_str(), &err);
-		FreeEXRImage(&exrImage);
-		if (ret != 0)
-			throw std::runtime_error(err);
+		WriteEXRImage(file, img);
 	} else if (ext == "hdr") {
 		if (!stbi_write_hdr(file.c_str(), img.width, img.height, 4,
 				img.ptr())) {
@@ -832,41 +726,7 @@ void WriteImageToFile(const std::string& file, const Image1f& img) {
 	if (ext == "xml") {
 		WriteImageToRawFile(file, img);
 	} else if (ext == "exr") {
-		const char* err;
-		EXRImage exrImage;
-		InitEXRImage(&exrImage);
-		exrImage.num_channels = img.channels;
-		exrImage.width = img.width;
-		exrImage.height = img.height;
-		exrImage.pixel_types = (int *) malloc(sizeof(int *) * img.channels);
-		exrImage.requested_pixel_types = (int *) malloc(
-				sizeof(int *) * img.channels);
-		exrImage.channel_names = (const char **) malloc(
-				sizeof(const char *) * img.channels);
-		float** array = (float**) malloc(sizeof(float*) * img.channels);
-		for (int c = 0; c < img.channels; c++) {
-			array[c] = (float*) malloc(sizeof(float) * img.size());
-		}
-		exrImage.images = (unsigned char**) array;
-		for (int c = 0; c < img.channels; c++) {
-			size_t index = 0;
-			for (const float1& val : img.data) {
-				array[c][index++] = val[c];
-			}
-		}
-		for (int c = 0; c < img.channels; c++) {
-			exrImage.pixel_types[c] = TINYEXR_PIXELTYPE_FLOAT;
-			exrImage.requested_pixel_types[c] = TINYEXR_PIXELTYPE_FLOAT;
-		}
-#ifdef _WIN32
-		exrImage.channel_names[0] = _strdup("R");
-#else
-		exrImage.channel_names[0] = strdup("R");
-#endif
-		int ret = SaveMultiChannelEXRToFile(&exrImage, file.c_str(), &err);
-		FreeEXRImage(&exrImage);
-		if (ret != 0)
-			throw std::runtime_error(err);
+		WriteEXRImage(file, img);
 	} else if (ext == "hdr") {
 		if (!stbi_write_hdr(file.c_str(), img.width, img.height, 1,
 				img.ptr())) {
@@ -957,45 +817,7 @@ void WriteImageToFile(const std::string& file, const ImageRGBf& img) {
 	if (ext == "xml") {
 		WriteImageToRawFile(file, img);
 	} else if (ext == "exr") {
-		const char* err;
-		EXRImage exrImage;
-		InitEXRImage(&exrImage);
-		exrImage.num_channels = img.channels;
-		exrImage.width = img.width;
-		exrImage.height = img.height;
-		exrImage.pixel_types = (int *) malloc(sizeof(int *) * img.channels);
-		exrImage.requested_pixel_types = (int *) malloc(
-				sizeof(int *) * img.channels);
-		exrImage.channel_names = (const char **) malloc(
-				sizeof(const char *) * img.channels);
-		float** array = (float**) malloc(sizeof(float*) * img.channels);
-		for (int c = 0; c < img.channels; c++) {
-			array[c] = (float*) malloc(sizeof(float) * img.size());
-		}
-		exrImage.images = (unsigned char**) array;
-		for (int c = 0; c < img.channels; c++) {
-			size_t index = 0;
-			for (const float3& val : img.data) {
-				array[img.channels - 1 - c][index++] = val[c];
-			}
-		}
-		for (int c = 0; c < img.channels; c++) {
-			exrImage.pixel_types[c] = TINYEXR_PIXELTYPE_FLOAT;
-			exrImage.requested_pixel_types[c] = TINYEXR_PIXELTYPE_FLOAT;
-		}
-#ifdef _WIN32
-		exrImage.channel_names[0] = _strdup("B");
-		exrImage.channel_names[1] = _strdup("G");
-		exrImage.channel_names[2] = _strdup("R");
-#else
-		exrImage.channel_names[0] = strdup("B");
-		exrImage.channel_names[1] = strdup("G");
-		exrImage.channel_names[2] = strdup("R");
-#endif
-		int ret = SaveMultiChannelEXRToFile(&exrImage, file.c_str(), &err);
-		FreeEXRImage(&exrImage);
-		if (ret != 0)
-			throw std::runtime_error(err);
+		WriteEXRImage(file, img);
 	} else if (ext == "hdr") {
 		if (!stbi_write_hdr(file.c_str(), img.width, img.height, 3,
 				img.ptr())) {
@@ -1045,6 +867,37 @@ void ConvertImage(const Image1ub& in, Image1us& out){
 		out[index++].x=((unsigned int)b.x)<<8;
 	}
 }
+template<class S, class T, int C, ImageType IS, ImageType IT> static void ConvertHalfImage(
+		const Image<S, C, IS>& in, Image<T, C, IT>& out) {
+	out.resize(in.width, in.height);
+	out.id = in.id;
+	out.setPosition(in.position());
+	size_t index = 0;
+	for (vec<T, C>& ct : out.data) {
+		const vec<S, C>& cs = in[index++];
+		for (int c = 0; c < C; c++) {
+			ct[c] = T((float) cs[c]);
+		}
+	}
+}
+void ConvertImage(const Image1h& in, Image1f& out) {
+	ConvertHalfImage(in, out);
+}
+void ConvertImage(const Image3h& in, ImageRGBf& out) {
+	ConvertHalfImage(in, out);
+}
+void ConvertImage(const Image4h& in, ImageRGBAf& out) {
+	ConvertHalfImage(in, out);
+}
+void ConvertImage(const Image1f& in, Image1h& out) {
+	ConvertHalfImage(in, out);
+}
+void ConvertImage(const ImageRGBf& in, Image3h& out) {
+	ConvertHalfImage(in, out);
+}
+void ConvertImage(const ImageRGBAf& in, Image4h& out) {
+	ConvertHalfImage(in, out);
+}
 void ConvertImage(const Image1us& in, Image1f& out){
 	out.resize(in.width,in.height);
 	size_t index=0;
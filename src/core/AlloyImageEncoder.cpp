@@ -100,6 +100,7 @@
 
  */
 #include "AlloyImageEncoder.h"
+#include <emmintrin.h>
 namespace aly {
 void SANITY_CHECK_VIDEOENCODER() {
 	ImageRGB img;
@@ -121,6 +122,9 @@ void SANITY_CHECK_VIDEOENCODER() {
 		std::vector<uint8_t> buffer;
 		converter.evaluate(img,buffer);
 		std::cout<<"I420 Image Size= "<<img.size()*img.typeSize()<<" Buffer Size= "<<buffer.size()<<std::endl;
+		ImageRGB decoded;
+		converter.decode(buffer,img.width,img.height,decoded);
+		std::cout<<"I420 Decoded "<<decoded.dimensions()<<std::endl;
 	}
 	{
 		YUVConverter converter(YUVType::YV12);
@@ -162,126 +166,250 @@ void YUVConverter::setMatrix() {
 	default:
 		throw std::runtime_error("No YUV matrix specified.");
 	}
+	const std::vector<float>& M = yuvMatrix;
+	float det = M[0] * (M[4] * M[8] - M[5] * M[7])
+			- M[1] * (M[3] * M[8] - M[5] * M[6])
+			+ M[2] * (M[3] * M[7] - M[4] * M[6]);
+	rgbMatrix = {(M[4] * M[8] - M[5] * M[7]) / det, (M[2] * M[7] - M[1] * M[8]) / det, (M[1] * M[5] - M[2] * M[4]) / det,
+		(M[5] * M[6] - M[3] * M[8]) / det, (M[0] * M[8] - M[2] * M[6]) / det, (M[2] * M[3] - M[0] * M[5]) / det,
+		(M[3] * M[7] - M[4] * M[6]) / det, (M[1] * M[6] - M[0] * M[7]) / det, (M[0] * M[4] - M[1] * M[3]) / det};
 }
-void YUVConverter::evaluate(const ImageRGB& image, std::vector<uint8_t>& out) {
-	uint32_t lumaWidth, lumaHeight;
-	uint32_t chromaWidth, chromaHeight;
-	uint32_t xMask, yMask;
-	int x, y;
-	uint8_t Rc, Gc, Bc;
-	uint8_t *yPtr, *uPtr, *vPtr;
-	bool warned = false;
-	// For performance reasons get matrix values here to put them on stack
-	// instead of accessing them in deep loops from vector
-	float yr = yuvMatrix[0], yg = yuvMatrix[1], yb = yuvMatrix[2];
-	float ur = yuvMatrix[3], ug = yuvMatrix[4], ub = yuvMatrix[5];
-	float vr = yuvMatrix[6], vg = yuvMatrix[7], vb = yuvMatrix[8];
-	lumaWidth = image.width;
-	lumaHeight = image.height;
-	switch (uvScale) {
-	default: /* Default scale h1v1 */
-	case YUVScale::H1V1:
-		chromaWidth = lumaWidth;
-		chromaHeight = lumaHeight;
-		xMask = 0;
-		yMask = 0;
-		break;
-	case YUVScale::H2V2:
-		chromaWidth = lumaWidth / 2;
-		chromaHeight = lumaHeight / 2;
-		yMask = xMask = 1;
-		break;
-	case YUVScale::H1V2:
-		chromaWidth = lumaWidth;
-		chromaHeight = lumaHeight / 2;
-		xMask = 0;
-		yMask = 1;
-		break;
-	case YUVScale::H2V1:
-		chromaWidth = lumaWidth / 2;
-		chromaHeight = lumaHeight;
-		xMask = 1;
-		yMask = 0;
-		break;
-	}
-	// Pointers that are always pointing on buffers
-	std::vector<uint8_t> yPixels(lumaHeight * lumaWidth);
-	std::vector<uint8_t> uPixels(chromaHeight * chromaWidth);
-	std::vector<uint8_t> vPixels(chromaHeight * chromaWidth);
-	// Pointers we are working with
-	yPtr = yPixels.data();
-	uPtr = uPixels.data();
-	vPtr = vPixels.data();
-	out.clear();
-	for (y = 0; y < lumaHeight; y++) {
-		for (x = 0; x < lumaWidth; x++) {
-			aly::RGB c = image(x, y);
-			Rc = c.x;
-			Gc = c.y;
-			Bc = c.z;
-			*yPtr++ = uint8_t(Rc * yr + Gc * yg + Bc * yb);
-			if ((y & yMask) == 0 && (x & xMask) == 0 && (y / 2) < chromaHeight
-					&& (x / 2) < chromaWidth) {
-				*uPtr++ = uint8_t(Rc * ur + Gc * ug + Bc * ub + 128);
-				*vPtr++ = uint8_t(Rc * vr + Gc * vg + Bc * vb + 128);
-			}
+YUVConverter::Layout YUVConverter::getLayout(int width, int height) const {
+	Layout layout;
+	const size_t lumaSize = (size_t) width * height;
+	if (yuvFormat == YUVFormat::YUYV || yuvFormat == YUVFormat::UYVY) {
+		// Packed 4:2:2, each pair of pixels shares the chroma of the left pixel
+		int pairs = (width + 1) / 2;
+		size_t rowStride = 4 * (size_t) pairs;
+		bool uyvy = (yuvFormat == YUVFormat::UYVY);
+		layout.packed = true;
+		layout.xShift = 1;
+		layout.yShift = 0;
+		layout.chromaWidth = pairs;
+		layout.chromaHeight = height;
+		layout.y = {uyvy ? (size_t) 1 : (size_t) 0, rowStride, 2};
+		layout.u = {uyvy ? (size_t) 0 : (size_t) 1, rowStride, 4};
+		layout.v = {uyvy ? (size_t) 2 : (size_t) 3, rowStride, 4};
+		layout.size = rowStride * height;
+	} else {
+		layout.packed = false;
+		switch (uvScale) {
+		case YUVScale::H2V2:
+			layout.xShift = 1;
+			layout.yShift = 1;
+			break;
+		case YUVScale::H1V2:
+			layout.xShift = 0;
+			layout.yShift = 1;
+			break;
+		case YUVScale::H2V1:
+			layout.xShift = 1;
+			layout.yShift = 0;
+			break;
+		default:
+		case YUVScale::H1V1:
+			layout.xShift = 0;
+			layout.yShift = 0;
+			break;
 		}
+		int cw = layout.chromaWidth = width >> layout.xShift;
+		int ch = layout.chromaHeight = height >> layout.yShift;
+		layout.y = {0, (size_t) width, 1};
+		if (yuvFormat == YUVFormat::YUV_INTERLEAVE) {// U and V rows interleaved after each other
+			layout.u = {lumaSize, 2 * (size_t) cw, 1};
+			layout.v = {lumaSize + cw, 2 * (size_t) cw, 1};
+		} else if (yuvFormat == YUVFormat::YYUV) {// U and V columns interleaved
+			layout.u = {lumaSize, 2 * (size_t) cw, 2};
+			layout.v = {lumaSize + 1, 2 * (size_t) cw, 2};
+		} else {
+			layout.u = {lumaSize, (size_t) cw, 1};
+			layout.v = {lumaSize + (size_t) cw * ch, (size_t) cw, 1};
+		}
+		layout.size = lumaSize + 2 * (size_t) cw * ch;
 	}
 	if (uvOrderSwap) {	// UV components should be swapped
-		std::swap(uPixels, vPixels);
+		std::swap(layout.u, layout.v);
 	}
-	yPtr = yPixels.data();
-	uPtr = uPixels.data();
-	vPtr = vPixels.data();
-	if (yuvFormat == YUVFormat::YUV || yuvFormat == YUVFormat::YUV_INTERLEAVE) {// Writing planar image
-		out.reserve(lumaHeight * lumaWidth + 2 * chromaWidth * chromaHeight);
-		out.insert(out.end(), yPixels.begin(), yPixels.end());
-		if (yuvFormat == YUVFormat::YUV_INTERLEAVE) {// U and V rows should be interleaved after each other
-			while (chromaHeight--) {
-				out.insert(out.end(), uPtr, uPtr + chromaWidth);// Write U line
-				out.insert(out.end(), vPtr, vPtr + chromaWidth);// Write V line
-				uPtr += chromaWidth;
-				vPtr += chromaWidth;
+	return layout;
+}
+size_t YUVConverter::getBufferSize(int width, int height) const {
+	return getLayout(width, height).size;
+}
+static inline uint8_t ClampYUV(float val) {
+	int i = (int) val;
+	return (uint8_t) ((i < 0) ? 0 : ((i > 255) ? 255 : i));
+}
+// Loads 4 RGB pixels spaced step bytes apart as floats
+static inline void LoadRGB4(const uint8_t* p, int step, __m128& R, __m128& G,
+		__m128& B) {
+	R = _mm_cvtepi32_ps(
+			_mm_setr_epi32(p[0], p[step], p[2 * step], p[3 * step]));
+	G = _mm_cvtepi32_ps(
+			_mm_setr_epi32(p[1], p[step + 1], p[2 * step + 1],
+					p[3 * step + 1]));
+	B = _mm_cvtepi32_ps(
+			_mm_setr_epi32(p[2], p[step + 2], p[2 * step + 2],
+					p[3 * step + 2]));
+}
+// Same operation order as the scalar path so both produce identical bytes
+static inline __m128i DotRGB4(const __m128& R, const __m128& G,
+		const __m128& B, const __m128* m, const __m128& offset) {
+	return _mm_cvttps_epi32(
+			_mm_add_ps(
+					_mm_add_ps(_mm_add_ps(_mm_mul_ps(R, m[0]), _mm_mul_ps(G, m[1])),
+							_mm_mul_ps(B, m[2])), offset));
+}
+// Converts 8 pixels to 8 saturated bytes in the low half of the result
+static inline __m128i DotRGB8(const uint8_t* p, int step, const __m128* m,
+		const __m128& offset) {
+	__m128 R, G, B;
+	LoadRGB4(p, step, R, G, B);
+	__m128i lo = DotRGB4(R, G, B, m, offset);
+	LoadRGB4(p + 4 * step, step, R, G, B);
+	__m128i hi = DotRGB4(R, G, B, m, offset);
+	return _mm_packus_epi16(_mm_packs_epi32(lo, hi), _mm_setzero_si128());
+}
+static inline void DotUV4(const uint8_t* p, int step, const __m128* mu,
+		const __m128* mv, const __m128& offset, __m128i& U, __m128i& V) {
+	__m128 R, G, B;
+	LoadRGB4(p, step, R, G, B);
+	__m128i zero = _mm_setzero_si128();
+	U = _mm_packus_epi16(_mm_packs_epi32(DotRGB4(R, G, B, mu, offset), zero),
+			zero);
+	V = _mm_packus_epi16(_mm_packs_epi32(DotRGB4(R, G, B, mv, offset), zero),
+			zero);
+}
+void YUVConverter::evaluate(const ImageRGB& image, std::vector<uint8_t>& out) {
+	out.resize(getBufferSize(image.width, image.height));
+	evaluate(image, out.data());
+}
+void YUVConverter::evaluate(const ImageRGB& image, uint8_t* out) {
+	const int width = image.width;
+	const int height = image.height;
+	const Layout layout = getLayout(width, height);
+	// For performance reasons get matrix values here to put them on stack
+	// instead of accessing them in deep loops from vector
+	const float yr = yuvMatrix[0], yg = yuvMatrix[1], yb = yuvMatrix[2];
+	const float ur = yuvMatrix[3], ug = yuvMatrix[4], ub = yuvMatrix[5];
+	const float vr = yuvMatrix[6], vg = yuvMatrix[7], vb = yuvMatrix[8];
+	__m128 m[9];
+	for (int n = 0; n < 9; n++) {
+		m[n] = _mm_set1_ps(yuvMatrix[n]);
+	}
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 half = _mm_set1_ps(128.0f);
+	const uint8_t* rgb = (const uint8_t*) image.ptr();
+	const int chromaStep = 3 << layout.xShift;
+	// Rows are independent, static schedule hands each thread a band of rows
+#pragma omp parallel for
+	for (int y = 0; y < height; y++) {
+		const uint8_t* src = rgb + 3 * (size_t) width * y;
+		uint8_t* yDst = out + layout.y.offset + layout.y.rowStride * y;
+		const bool chromaRow = ((y & layout.yShift) == 0)
+				&& (y >> layout.yShift) < layout.chromaHeight;
+		const int r = y >> layout.yShift;
+		uint8_t* uDst = out + layout.u.offset + layout.u.rowStride * r;
+		uint8_t* vDst = out + layout.v.offset + layout.v.rowStride * r;
+		int x = 0;
+		int k = 0;
+		if (layout.packed) {
+			// 8 pixels and 4 chroma pairs per iteration, 16 output bytes
+			const bool uFirst = (layout.u.offset < layout.v.offset);
+			const bool yFirst = (layout.y.offset == 0);
+			uint8_t* dst = out + layout.y.rowStride * y;
+			for (; x + 8 <= width; x += 8, k += 4) {
+				__m128i Y = DotRGB8(src + 3 * x, 3, m, zero);
+				__m128i U, V;
+				DotUV4(src + 3 * x, 6, m + 3, m + 6, half, U, V);
+				__m128i UV =
+						uFirst ? _mm_unpacklo_epi8(U, V) : _mm_unpacklo_epi8(V,
+											U);
+				__m128i packed =
+						yFirst ? _mm_unpacklo_epi8(Y, UV) : _mm_unpacklo_epi8(
+											UV, Y);
+				_mm_storeu_si128((__m128i *) (dst + 4 * k), packed);
 			}
 		} else {
-			// Simply write U and V planes
-			out.insert(out.end(), uPixels.begin(), uPixels.end());
-			out.insert(out.end(), vPixels.begin(), vPixels.end());
-		}
-	} else if (yuvFormat == YUVFormat::YYUV) {	// Writing planar image
-		out.reserve(lumaHeight * lumaWidth + 2 * chromaWidth * chromaHeight);
-		out.insert(out.end(), yPixels.begin(), yPixels.end());
-		// U and V columns should be interleaved after each other
-		for (uint32_t row = 0; row < chromaHeight; row++) {
-			for (uint32_t col = 0; col < chromaWidth; col++) {// Write in following order Y, U, Y, V
-				out.push_back(*uPtr++);
-				out.push_back(*vPtr++);
+			for (; x + 8 <= width; x += 8) {
+				_mm_storel_epi64((__m128i *) (yDst + x),
+						DotRGB8(src + 3 * x, 3, m, zero));
 			}
-		}
-	} else {
-		out.reserve(lumaHeight * (lumaWidth/2));
-		// Writing packed image
-		if (yuvFormat == YUVFormat::YUYV) {
-			for (uint32_t row = 0; row < lumaHeight; row++) {
-				for (uint32_t col = 0; col < lumaWidth; col += 2) {	// Write in following order Y, U, Y, V
-					out.push_back(*yPtr++);
-					out.push_back(*uPtr++);
-					out.push_back(*yPtr++);
-					out.push_back(*vPtr++);
+			if (chromaRow) {
+				const int pixelStride = layout.u.pixelStride;
+				for (; k + 8 <= layout.chromaWidth; k += 8) {
+					const uint8_t* p = src + chromaStep * k;
+					__m128i U = DotRGB8(p, chromaStep, m + 3, half);
+					__m128i V = DotRGB8(p, chromaStep, m + 6, half);
+					if (pixelStride == 1) {
+						_mm_storel_epi64((__m128i *) (uDst + k), U);
+						_mm_storel_epi64((__m128i *) (vDst + k), V);
+					} else if (uDst < vDst) {
+						_mm_storeu_si128((__m128i *) (uDst + 2 * k),
+								_mm_unpacklo_epi8(U, V));
+					} else {
+						_mm_storeu_si128((__m128i *) (vDst + 2 * k),
+								_mm_unpacklo_epi8(V, U));
+					}
 				}
 			}
-		} else {
-			for (uint32_t row = 0; row < lumaHeight; row++) {
-				for (uint32_t col = 0; col < lumaWidth; col += 2) {	// Write in following order U, Y, V, Y
-					out.push_back(*uPtr++);
-					out.push_back(*yPtr++);
-					out.push_back(*vPtr++);
-					out.push_back(*yPtr++);
-				}
+		}
+		// Remainder of the row
+		for (; x < width; x++) {
+			const uint8_t* c = src + 3 * x;
+			float Rc = c[0], Gc = c[1], Bc = c[2];
+			yDst[x * layout.y.pixelStride] = ClampYUV(Rc * yr + Gc * yg + Bc * yb);
+		}
+		if (layout.packed && (width & 1)) {// Odd width, last pair repeats the last pixel
+			yDst[width * layout.y.pixelStride] = yDst[(width - 1)
+					* layout.y.pixelStride];
+		}
+		if (chromaRow) {
+			for (; k < layout.chromaWidth; k++) {
+				const uint8_t* c = src + chromaStep * k;
+				float Rc = c[0], Gc = c[1], Bc = c[2];
+				uDst[k * layout.u.pixelStride] = ClampYUV(
+						Rc * ur + Gc * ug + Bc * ub + 128);
+				vDst[k * layout.v.pixelStride] = ClampYUV(
+						Rc * vr + Gc * vg + Bc * vb + 128);
 			}
 		}
 	}
 }
+void YUVConverter::decode(const std::vector<uint8_t>& in, int width,
+		int height, ImageRGB& image) {
+	if (in.size() < getBufferSize(width, height)) {
+		throw std::runtime_error(
+				MakeString() << "YUV buffer too small for " << width << "x"
+						<< height << " image.");
+	}
+	decode(in.data(), width, height, image);
+}
+void YUVConverter::decode(const uint8_t* in, int width, int height,
+		ImageRGB& image) {
+	const Layout layout = getLayout(width, height);
+	image.resize(width, height);
+	const float ry = rgbMatrix[0], ru = rgbMatrix[1], rv = rgbMatrix[2];
+	const float gy = rgbMatrix[3], gu = rgbMatrix[4], gv = rgbMatrix[5];
+	const float by = rgbMatrix[6], bu = rgbMatrix[7], bv = rgbMatrix[8];
+	const int cw = std::max(layout.chromaWidth, 1);
+	const int ch = std::max(layout.chromaHeight, 1);
+#pragma omp parallel for
+	for (int y = 0; y < height; y++) {
+		const int r = std::min(y >> layout.yShift, ch - 1);
+		const uint8_t* yRow = in + layout.y.offset + layout.y.rowStride * y;
+		const uint8_t* uRow = in + layout.u.offset + layout.u.rowStride * r;
+		const uint8_t* vRow = in + layout.v.offset + layout.v.rowStride * r;
+		for (int x = 0; x < width; x++) {
+			const int k = std::min(x >> layout.xShift, cw - 1);
+			float Y = yRow[x * layout.y.pixelStride];
+			float U = uRow[k * layout.u.pixelStride] - 128.0f;
+			float V = vRow[k * layout.v.pixelStride] - 128.0f;
+			image(x, y) = RGB(ClampYUV(Y * ry + U * ru + V * rv + 0.5f),
+					ClampYUV(Y * gy + U * gu + V * gv + 0.5f),
+					ClampYUV(Y * by + U * bu + V * bv + 0.5f));
+		}
+	}
+}
 YUVConverter::YUVConverter() {
 	uvOrderSwap = false; /* no UV order swap */
 	yuvFormat = YUVFormat::YUV; /* YUV output mode. Default: h2v2 */
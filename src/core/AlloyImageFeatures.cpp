@@ -1,5 +1,6 @@
 #include "AlloyImageFeatures.h"
 #include <AlloyImageProcessing.h>
+#include <cstring>
 namespace aly {
 const float Daisy::sigma_0 = 1.0f;
 const float Daisy::sigma_1 = std::sqrt(2.0f);
@@ -79,72 +80,73 @@ void WriteOrientationImagesToFile(const std::string& file,
 	myfile << sstr.str();
 	myfile.close();
 }
-void ConvolveHorizontal(const ImageLayer& input, ImageLayer& output,const std::vector<float>& filter) {
-	const int w = input.width;
-	const int h = input.height;
-	const int hlen = filter.size();
-	output.resize(w, h);
-	int c, hL, hR;
-	if (hlen & 1) { // odd kernel size
-		c = hlen / 2;
-		hL = c;
-		hR = c;
-	} else { // even kernel size : center is shifted to the left
-		c = hlen / 2 - 1;
-		hL = c;
-		hR = c + 1;
-	}
-#pragma omp parallel for
-	for (int j = 0; j < h; j++) {
-		for (int i = 0; i < w; i++) {
+/*
+ * Single row of a symmetric-boundary convolution. The boundary is mirrored
+ * about the half pixel, and only the first and last c pixels pay for it.
+ */
+static void ConvolveRow(const float* in, float* out, int w, const std::vector<float>& filter) {
+	const int hlen = (int) filter.size();
+	const int c = (hlen & 1) ? hlen / 2 : hlen / 2 - 1;
+	const float* f = filter.data();
+	for (int i = 0; i < w; i++) {
+		float sum = 0.0f;
+		if (i >= c && i - c + hlen <= w) {
+			const float* px = in + i - c;
+			for (int jx = 0; jx < hlen; jx++)
+				sum += px[jx] * f[jx];
+		} else {
 			int jx1 = c - i;
 			int jx2 = w - 1 - i + c;
-			float sum = 0.0f;
-			// Convolution with boundaries extension
-			for (int jx = 0; jx <= hR + hL; jx++) {
+			for (int jx = 0; jx < hlen; jx++) {
 				int idx_x = i - c + jx;
 				if (jx < jx1)
 					idx_x = jx1 - jx - 1;
 				if (jx > jx2)
 					idx_x = w - (jx - jx2);
-				sum += input[j * w + idx_x] * filter[jx]; //symmetric kernel? Don't flip!
+				sum += in[idx_x] * f[jx];
 			}
-			output[j * w + i] = sum;
 		}
+		out[i] = sum;
+	}
+}
+/*
+ * Single output row of the vertical pass. Whole input rows are accumulated
+ * so memory is read sequentially.
+ */
+static void ConvolveColumn(const float* in, float* out, int w, int h, int j, const std::vector<float>& filter) {
+	const int hlen = (int) filter.size();
+	const int c = (hlen & 1) ? hlen / 2 : hlen / 2 - 1;
+	int jy1 = c - j;
+	int jy2 = h - 1 - j + c;
+	std::fill(out, out + w, 0.0f);
+	for (int jy = 0; jy < hlen; jy++) {
+		int idx_y = j - c + jy;
+		if (jy < jy1)
+			idx_y = jy1 - jy - 1;
+		if (jy > jy2)
+			idx_y = h - (jy - jy2);
+		const float* row = in + (size_t) idx_y * w;
+		const float fy = filter[jy];
+		for (int i = 0; i < w; i++)
+			out[i] += row[i] * fy;
 	}
 }
-void ConvolveVertical(const ImageLayer& input, ImageLayer& output,const std::vector<float>& filter) {
+void ConvolveHorizontal(const ImageLayer& input, ImageLayer& output,const std::vector<float>& filter) {
 	const int w = input.width;
 	const int h = input.height;
-	const int hlen = filter.size();
 	output.resize(w, h);
-	int c, hL, hR;
-	if (hlen & 1) { // odd kernel size
-		c = hlen / 2;
-		hL = c;
-		hR = c;
-	} else { // even kernel size : center is shifted to the left
-		c = hlen / 2 - 1;
-		hL = c;
-		hR = c + 1;
+#pragma omp parallel for
+	for (int j = 0; j < h; j++) {
+		ConvolveRow(input.ptr() + (size_t) j * w, output.ptr() + (size_t) j * w, w, filter);
 	}
+}
+void ConvolveVertical(const ImageLayer& input, ImageLayer& output,const std::vector<float>& filter) {
+	const int w = input.width;
+	const int h = input.height;
+	output.resize(w, h);
 #pragma omp parallel for
 	for (int j = 0; j < h; j++) {
-		for (int i = 0; i < w; i++) {
-			int jy1 = c - j;
-			int jy2 = h - 1 - j + c;
-			float sum = 0.0f;
-			// Convolution with boundaries extension
-			for (int jy = 0; jy <= hR + hL; jy++) {
-				int idx_y = j - c + jy;
-				if (jy < jy1)
-					idx_y = jy1 - jy - 1;
-				if (jy > jy2)
-					idx_y = h - (jy - jy2);
-				sum += input[idx_y * w + i] * filter[jy]; //symmetric kernel? Don't flip!
-			}
-			output[j * w + i] = sum;
-		}
+		ConvolveColumn(input.ptr(), output.ptr() + (size_t) j * w, w, h, j, filter);
 	}
 }
 void Convolve(const ImageLayer& image, ImageLayer& out,
@@ -167,18 +169,55 @@ void Convolve(const ImageLayer& image, ImageLayer& out,
 		}
 	}
 }
-void Smooth(const ImageLayer & image, ImageLayer & out, float sigma) {
+static void SmoothingKernel(std::vector<float>& filter, float sigma) {
 	int fsz = (int) (3 * sigma+1);
 	if (fsz % 2 == 0)
 		fsz++;
 	if (fsz < 3)
 		fsz = 3;
+	GaussianKernel(filter,fsz,sigma);
+}
+void Smooth(const ImageLayer & image, ImageLayer & out, float sigma) {
 	std::vector<float> filter;
 	ImageLayer tmp;
-	GaussianKernel(filter,fsz,sigma);
+	SmoothingKernel(filter, sigma);
 	ConvolveHorizontal(image, tmp, filter);
 	ConvolveVertical(tmp, out, filter);
 }
+/*
+ * Smooths all orientation layers at once. Rows of every layer are distributed
+ * over threads together, which keeps all cores busy regardless of the number
+ * of layers. The input may be the same as the output.
+ */
+static void Smooth(const OrientationImages& in, OrientationImages& out, float sigma) {
+	std::vector<float> filter;
+	SmoothingKernel(filter, sigma);
+	const int L = (int) in.size();
+	if (L == 0)
+		return;
+	const int w = in[0].width;
+	const int h = in[0].height;
+	OrientationImages tmp(L, ImageLayer());
+	for (int l = 0; l < L; l++) {
+		tmp[l].resize(w, h);
+	}
+#pragma omp parallel for
+	for (int n = 0; n < L * h; n++) {
+		int l = n / h;
+		int j = n % h;
+		ConvolveRow(in[l].ptr() + (size_t) j * w, tmp[l].ptr() + (size_t) j * w, w, filter);
+	}
+	out.resize(L);
+	for (int l = 0; l < L; l++) {
+		out[l].resize(w, h);
+	}
+#pragma omp parallel for
+	for (int n = 0; n < L * h; n++) {
+		int l = n / h;
+		int j = n % h;
+		ConvolveColumn(tmp[l].ptr(), out[l].ptr() + (size_t) j * w, w, h, j, filter);
+	}
+}
 
 Daisy::Daisy(int orientResolutions) :
 		width(0), height(0), numberOfGridPoints(0), histogramBins(0), angleBins(
@@ -186,8 +225,10 @@ Daisy::Daisy(int orientResolutions) :
 }
 void Daisy::getHistogram(float* histogram, int x, int y,
 		const std::vector<ImageLayer>& hcube) const {
+	//All layers share dimensions, so clamp once for the whole histogram.
+	size_t offset = clamp(x, 0, width - 1) + clamp(y, 0, height - 1) * (size_t) width;
 	for (int h = 0; h < histogramBins; h++) {
-		histogram[h] = hcube[h](x, y);
+		histogram[h] = hcube[h][offset];
 	}
 
 }
@@ -198,13 +239,19 @@ void Daisy::getHistogram(float* histogram, float x, float y,
 	}
 }
 void Daisy::getDescriptors(DaisyDescriptorField& field,
-		DaisyNormalization normalizationType) {
-	field.resize(width, height);
-#pragma omp parallel for
-	for (int j = 0; j < height; j++) {
-		for (int i = 0; i < width; i++) {
-			getDescriptor(i, j, field(i, j), normalizationType, true);
-			//std::cout<<i<<","<<j<<": Descriptor "<<field(i,j)<<std::endl;
+		DaisyNormalization normalizationType, DaisyStorage storage) {
+	field.setStorage(storage);
+	field.resize(width, height, descriptorSize);
+#pragma omp parallel
+	{
+		DaisyDescriptor desc(descriptorSize);
+#pragma omp for
+		for (int j = 0; j < height; j++) {
+			for (int i = 0; i < width; i++) {
+				getDescriptor(i, j, desc);
+				normalizeDescriptor(desc, normalizationType);
+				field.set(i, j, desc.data());
+			}
 		}
 	}
 }
@@ -295,33 +342,23 @@ int Daisy::quantizeRadius(float rad) {
 
 void Daisy::layeredGradient(const Image1f& image, OrientationImages& layers,
 		int layer_no) const {
-	ImageLayer bdata;
 	layers.resize(layer_no);
-	Image2f dxy(image.width, image.height);
+	std::vector<float2> directions(layer_no);
+	for (int l = 0; l < layer_no; l++) {
+		float angle = 2.0f * l * ALY_PI / layer_no;
+		directions[l] = float2(std::cos(angle), std::sin(angle));
+		layers[l].resize(image.width, image.height);
+	}
+	//Each gradient is computed once and projected onto every orientation.
 #pragma omp parallel for
 	for (int j = 0; j < image.height; j++) {
+		size_t offset = (size_t) j * image.width;
 		for (int i = 0; i < image.width; i++) {
 			float dx = 0.5f * (image(i + 1, j) - image(i - 1, j));
 			float dy = 0.5f * (image(i, j + 1) - image(i, j - 1));
-			dxy(i, j) = float2(dx, dy);
-		}
-	}
-	for (int l = 0; l < layer_no; l++) {
-		ImageLayer & layer_l = layers[l];
-		layer_l.resize(image.width, image.height);
-		float angle = 2.0f * l * ALY_PI / layer_no;
-		float cosa = std::cos(angle);
-		float sina = std::sin(angle);
-#pragma omp parallel for
-		for (int j = 0; j < image.height; j++) {
-			for (int i = 0; i < image.width; i++) {
-				float2 grad = dxy(i, j);
-				float value = cosa * grad.x + sina * grad.y;
-				if (value > 0) {
-					layer_l(i, j) = value;
-				} else {
-					layer_l(i, j) = 0.0f;
-				}
+			for (int l = 0; l < layer_no; l++) {
+				float value = directions[l].x * dx + directions[l].y * dy;
+				layers[l][offset + i] = (value > 0) ? value : 0.0f;
 			}
 		}
 	}
@@ -329,23 +366,13 @@ void Daisy::layeredGradient(const Image1f& image, OrientationImages& layers,
 
 void Daisy::computeSmoothedGradientLayers() {
 	float sigma;
-	for (int r = 1; r < smoothLayers.size(); r++) {
-		smoothLayers[r].resize(histogramBins);
-		for (ImageLayer & img : smoothLayers[r]) {
-			img.resize(width, height);
-		}
-	}
 	for (int r = 0; r < radiusBins; r++) {
-		OrientationImages& prev_cube = smoothLayers[r];
-		OrientationImages& cube = smoothLayers[r + 1];
 		if (r == 0) {
 			sigma = sigmas[0];
 		} else {
 			sigma = std::sqrt(sigmas[r] * sigmas[r] - sigmas[r - 1] * sigmas[r - 1]);
 		}
-		for (int th = 0; th < histogramBins; th++) {
-			Smooth(prev_cube[th], cube[th], sigma);
-		}
+		Smooth(smoothLayers[r], smoothLayers[r + 1], sigma);
 	}
 }
 void Daisy::initialize(const Image1f& image, bool smoothFirstLayer) {
@@ -353,10 +380,7 @@ void Daisy::initialize(const Image1f& image, bool smoothFirstLayer) {
 	layeredGradient(image, smoothLayers[0], histogramBins);
 	float sigma = std::sqrt(sigma_init * sigma_init - 0.25f);
 	if (smoothFirstLayer) {
-		for (int i = 0; i < histogramBins; i++) {
-			ImageLayer tmp = smoothLayers[0][i];
-			Smooth(tmp, smoothLayers[0][i], sigma);
-		}
+		Smooth(smoothLayers[0], smoothLayers[0], sigma);
 	}
 	computeSmoothedGradientLayers();
 	for (int i = 0; i < smoothLayers.size(); i++) {
@@ -405,16 +429,30 @@ void Daisy::normalizePartial(DaisyDescriptor& desc) const {
 		}
 	}
 }
-void Daisy::normalizeFull(DaisyDescriptor& desc) const {
-	float norm = 0.0f;
-	for (int i = 0; i < (int) desc.size(); i++) {
-		float val = desc[i];
-		norm += val * val;
+/*
+ * Squared L2 norm with independent partial sums, so the loop vectorizes
+ * instead of forming one long dependency chain.
+ */
+static float LengthSqr(const float* data, int N) {
+	float acc[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+	int i = 0;
+	for (; i + 8 <= N; i += 8) {
+		for (int k = 0; k < 8; k++) {
+			acc[k] += data[i + k] * data[i + k];
+		}
+	}
+	float norm = ((acc[0] + acc[4]) + (acc[1] + acc[5])) + ((acc[2] + acc[6]) + (acc[3] + acc[7]));
+	for (; i < N; i++) {
+		norm += data[i] * data[i];
 	}
+	return norm;
+}
+void Daisy::normalizeFull(DaisyDescriptor& desc) const {
+	float norm = LengthSqr(desc.data(), (int) desc.size());
 	if (norm != 0.0) {
-		norm = std::sqrt(norm);
+		norm = 1.0f / std::sqrt(norm);
 		for (int i = 0; i < (int) desc.size(); i++) {
-			desc[i] /= norm;
+			desc[i] *= norm;
 		}
 	}
 }
@@ -422,29 +460,25 @@ void Daisy::normalizeSiftWay(DaisyDescriptor& desc) const {
 	bool changed = true;
 	int iter = 0;
 	float norm;
-	int h;
+	const int N = (int) desc.size();
+	float* data = desc.data();
 	const int MAX_NORMALIZATION_ITER = 5;
 	const float m_descriptor_normalization_threshold = 0.154f; // sift magical number
 	while (changed && iter < MAX_NORMALIZATION_ITER) {
 		iter++;
-		changed = false;
-		norm = 0.0f;
-		for (int i = 0; i < (int) desc.size(); i++) {
-			float val = desc[i];
-			norm += val * val;
-		}
-		norm = std::sqrt(norm);
+		norm = std::sqrt(LengthSqr(data, N));
 		if (norm > 1e-5) {
-			for (int i = 0; i < (int) desc.size(); i++) {
-				desc[i] /= norm;
+			norm = 1.0f / norm;
+			for (int i = 0; i < N; i++) {
+				data[i] *= norm;
 			}
 		}
-		for (h = 0; h < (int) desc.size(); h++) {
-			if (desc[h] > m_descriptor_normalization_threshold) {
-				desc[h] = m_descriptor_normalization_threshold;
-				changed = true;
-			}
+		int clipped = 0;
+		for (int h = 0; h < N; h++) {
+			clipped += (data[h] > m_descriptor_normalization_threshold);
+			data[h] = std::min(data[h], m_descriptor_normalization_threshold);
 		}
+		changed = (clipped > 0);
 	}
 }
 void Daisy::getDescriptor(float x, float y, DaisyDescriptor& descriptor,
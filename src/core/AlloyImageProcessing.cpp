@@ -19,7 +19,38 @@
  * THE SOFTWARE.
  */
 #include "AlloyImageProcessing.h"
+#include "AlloyResample.h"
+#include "AlloyResultCache.h"
 namespace aly {
+template<class T, int C, ImageType I> void SmoothCached(ResultCache& cache,
+		const Image<T, C, I>& image, Image<T, C, I>& B, double sigmaX,
+		double sigmaY) {
+	cache.compute(MakeCacheKey("Smooth", ContentKey(image), sigmaX, sigmaY), B,
+			[&](Image<T, C, I>& out) {
+				Smooth(image, out, sigmaX, sigmaY);
+			});
+}
+void Smooth(ResultCache& cache, const Image1f& image, Image1f& B, double sigmaX, double sigmaY) {
+	SmoothCached(cache, image, B, sigmaX, sigmaY);
+}
+void Smooth(ResultCache& cache, const Image2f& image, Image2f& B, double sigmaX, double sigmaY) {
+	SmoothCached(cache, image, B, sigmaX, sigmaY);
+}
+void Smooth(ResultCache& cache, const Image3f& image, Image3f& B, double sigmaX, double sigmaY) {
+	SmoothCached(cache, image, B, sigmaX, sigmaY);
+}
+void Smooth(ResultCache& cache, const Image4f& image, Image4f& B, double sigmaX, double sigmaY) {
+	SmoothCached(cache, image, B, sigmaX, sigmaY);
+}
+void Smooth(ResultCache& cache, const Image1ub& image, Image1ub& B, double sigmaX, double sigmaY) {
+	SmoothCached(cache, image, B, sigmaX, sigmaY);
+}
+void Smooth(ResultCache& cache, const ImageRGB& image, ImageRGB& B, double sigmaX, double sigmaY) {
+	SmoothCached(cache, image, B, sigmaX, sigmaY);
+}
+void Smooth(ResultCache& cache, const ImageRGBA& image, ImageRGBA& B, double sigmaX, double sigmaY) {
+	SmoothCached(cache, image, B, sigmaX, sigmaY);
+}
 void Demosaic(const Image1ub& gray, ImageRGB& colorImage,
 		const BayerFilter& filter) {
 	colorImage.resize(gray.width, gray.height);
@@ -117,45 +148,11 @@ void Demosaic(const Image1ub& gray, ImageRGB& colorImage,
 }
 void Undistort(const ImageRGBf& in, ImageRGBf& out, double fx, double fy,double cx, double cy,
 		double k1, double k2, double k3, double p1, double p2) {
-	int w = in.width;
-	int h = in.height;
-	out.resize(w, h);
-#pragma omp parallel for
-	for (int j = 0; j < h; j++) {
-		for (int i = 0; i < w; i++) {
-			double x = (i - (0.5f*w+cx)) / fx;
-			double y = (j - (0.5f*h+cy)) / fy;
-			double rs = x * x + y * y;
-			double xp = x * (1 + k1 * rs + k2 * rs * rs + k3 * rs * rs * rs)
-					+ 2 * p1 * x * y + p2 * (rs + 2 * x * x);
-			double yp = y * (1 + k1 * rs + k2 * rs * rs + k3 * rs * rs * rs)
-					+ 2 * p2 * x * y + p1 * (rs + 2 * y * y);
-			x = xp * fx + cx+0.5f*w;
-			y = yp * fy + cy+0.5f*h;
-			out(i,j)= in((float)x, (float)y);
-		}
-	}
+	Warp(in, out, LensDistortion(in.width, in.height, fx, fy, cx, cy, k1, k2, k3, p1, p2), SampleFilter::Bilinear);
 }
 void Undistort(const ImageRGB& in, ImageRGB& out, double fx, double fy,double cx,double cy,
 		double k1, double k2, double k3, double p1, double p2) {
-	int w = in.width;
-	int h = in.height;
-	out.resize(w, h);
-#pragma omp parallel for
-	for (int j = 0; j < h; j++) {
-		for (int i = 0; i < w; i++) {
-			double x = (i - (0.5f*w+cx)) / fx;
-			double y = (j - (0.5f*h+cy)) / fy;
-			double rs = x * x + y * y;
-			double xp = x * (1 + k1 * rs + k2 * rs * rs + k3 * rs * rs * rs)
-					+ 2 * p1 * x * y + p2 * (rs + 2 * x * x);
-			double yp = y * (1 + k1 * rs + k2 * rs * rs + k3 * rs * rs * rs)
-					+ 2 * p2 * x * y + p1 * (rs + 2 * y * y);
-			x = xp * fx + cx;
-			y = yp * fy + cy;
-			out(i,j) = aly::ToRGB(in((float)x, (float)y)/255.0f);
-		}
-	}
+	Warp(in, out, LensDistortion(in.width, in.height, fx, fy, cx, cy, k1, k2, k3, p1, p2), SampleFilter::Bilinear);
 }
 void Demosaic(const Image1ub& gray, ImageRGBf& colorImage,
 		const BayerFilter& filter) {
@@ -19,11 +19,13 @@
  * THE SOFTWARE.
  */
 #include <AlloyIsoSurface.h>
+#include <AlloyScheduler.h>
 #include <stdint.h>
 #include <iostream>
 #include <set>
 #include <map>
 #include <algorithm>
+#include <atomic>
 using namespace std;
 namespace aly {
 const int3 IsoSurface::AXIS_OFFSET[3] = { int3(1, 0, 0), int3(0, 1, 0), int3(0,
@@ -363,6 +365,54 @@ const int IsoSurface::triangleConnectionTable[4096] = { -1, -1, -1, -1, -1, -1,
 		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
 		-1 };
 
+/*
+ * Resident z-slices of a volume starting at slice zStart. Lookups clamp to the whole volume like getSafeIndex(),
+ * so a slab with one ghost slice below and two above produces the same values and normals as the full volume.
+ */
+struct IsoSlab {
+	const float* data;
+	int rows, cols, slices;
+	int zStart, zEnd;
+	//False when no resident value equals the background, so cells only need a range check.
+	bool background;
+	IsoSlab(const float* data, int rows, int cols, int slices, int zStart, int zEnd) :
+			data(data), rows(rows), cols(cols), slices(slices), zStart(zStart), zEnd(zEnd), background(true) {
+	}
+	inline const float* slice(int k) const {
+		return data + (k - zStart) * (size_t) rows * (size_t) cols;
+	}
+	inline float operator()(int i, int j, int k) const {
+		return data[(clamp(k, 0, slices - 1) - zStart) * (size_t) rows * (size_t) cols
+				+ clamp(j, 0, cols - 1) * (size_t) rows + (size_t) clamp(i, 0, rows - 1)];
+	}
+	inline float3 gradient(int i, int j, int k) const {
+		return float3(operator()(i + 1, j, k) - operator()(i - 1, j, k),
+				operator()(i, j + 1, k) - operator()(i, j - 1, k),
+				operator()(i, j, k + 1) - operator()(i, j, k - 1));
+	}
+	float3 interpolateNormal(float x, float y, float z) const {
+		int x1 = (int) std::ceil(x);
+		int y1 = (int) std::ceil(y);
+		int z1 = (int) std::ceil(z);
+		int x0 = (int) std::floor(x);
+		int y0 = (int) std::floor(y);
+		int z0 = (int) std::floor(z);
+		float dx = x - x0;
+		float dy = y - y0;
+		float dz = z - z0;
+		float hx = 1.0f - dx;
+		float hy = 1.0f - dy;
+		float hz = 1.0f - dz;
+		return (((gradient(x0, y0, z0) * hx + gradient(x1, y0, z0) * dx) * hy
+				+ (gradient(x0, y1, z0) * hx + gradient(x1, y1, z0) * dx) * dy) * hz
+				+ ((gradient(x0, y0, z1) * hx + gradient(x1, y0, z1) * dx) * hy
+						+ (gradient(x0, y1, z1) * hx + gradient(x1, y1, z1) * dx) * dy) * dz);
+	}
+};
+/* Grid point offset and axis of the edge that owns each of the 12 cube edges. */
+static const int EDGE_OWNER[12][4] = { { 0, 0, 0, 0 }, { 1, 0, 0, 1 }, { 0, 1, 0, 0 },
+		{ 0, 0, 0, 1 }, { 0, 0, 1, 0 }, { 1, 0, 1, 1 }, { 0, 1, 1, 0 }, { 0, 0, 1, 1 },
+		{ 0, 0, 0, 2 }, { 1, 0, 0, 2 }, { 1, 1, 0, 2 }, { 0, 1, 0, 2 } };
 IsoSurface::IsoSurface() :
 		isoLevel(0), rows(0), cols(0), slices(0), winding(Winding::Clockwise), backgroundValue(
 				std::numeric_limits<float>::infinity()), skipHidden(true), triangleCount(
@@ -401,8 +451,16 @@ void IsoSurface::solve(const float* data, const int& rows, const int& cols,
 }
 void IsoSurface::solve(const Volume1f& data, Mesh& mesh, const MeshType& type,
 		bool regularize, const float& isoLevel) {
-	std::vector<int3> narrowBandList;
 	backgroundValue = 1E30f;
+	if (type == MeshType::Triangle) {
+		mesh.clear();
+		solveTri(data.ptr(), data.rows, data.cols, data.slices, mesh, isoLevel);
+		if (regularize) {
+			this->regularize(data.ptr(), mesh);
+		}
+		mesh.updateBoundingBox();
+		return;
+	}
 	static const std::vector<int3> nbrs={
 			int3(0,0,1),
 			int3(0,1,0),
@@ -412,21 +470,64 @@ void IsoSurface::solve(const Volume1f& data, Mesh& mesh, const MeshType& type,
 			int3(1,1,0),
 			int3(1,1,1)
 	};
-	for (int z = 0; z < data.slices-1; z++) {
+	std::vector<std::vector<int3>> sliceBands(std::max(data.slices - 1, 0));
+	ParallelFor(0, sliceBands.size(), [&](size_t zz) {
+		int z = (int) zz;
+		std::vector<int3>& band = sliceBands[z];
 		for (int y = 0; y < data.cols-1; y++) {
 			for (int x = 0; x < data.rows-1; x++) {
 				float c = data(x, y, z);
 				for(int3 n:nbrs){
 					if(data(x+n.x,y+n.y,z+n.z)*c<=0){
-						narrowBandList.push_back(int3(x, y, z));
+						band.push_back(int3(x, y, z));
 						break;
 					}
 				}
 			}
 		}
+	}, 1);
+	std::vector<int3> narrowBandList;
+	for (std::vector<int3>& band : sliceBands) {
+		narrowBandList.insert(narrowBandList.end(), band.begin(), band.end());
 	}
 	solve(data, narrowBandList, mesh, type, regularize, isoLevel);
 }
+void IsoSurface::solve(const std::function<void(int z, float* slice)>& getSlice,
+		const int& rows, const int& cols, const int& slices, Mesh& mesh,
+		const float& isoLevel, int slabSize) {
+	mesh.clear();
+	this->rows = rows;
+	this->cols = cols;
+	this->slices = slices;
+	this->isoLevel = isoLevel;
+	triangleCount = 0;
+	backgroundValue = 1E30f;
+	slabSize = std::max(slabSize, 1);
+	const size_t sliceSize = (size_t) rows * cols;
+	//Cells of slab [zBegin,zEnd) read slices [zBegin-1,zEnd+2) for central difference normals.
+	std::vector<float> buffer(sliceSize * std::min(slabSize + 3, slices));
+	int residentStart = 0, residentEnd = 0;
+	for (int zBegin = 1; zBegin < slices - 1; zBegin += slabSize) {
+		int zEnd = std::min(zBegin + slabSize, slices - 1);
+		int start = std::max(zBegin - 1, 0);
+		int end = std::min(zEnd + 2, slices);
+		if (residentEnd > start) {
+			std::copy(buffer.begin() + (start - residentStart) * sliceSize,
+					buffer.begin() + (residentEnd - residentStart) * sliceSize,
+					buffer.begin());
+		} else {
+			residentEnd = start;
+		}
+		for (int z = residentEnd; z < end; z++) {
+			getSlice(z, &buffer[(z - start) * sliceSize]);
+		}
+		residentStart = start;
+		residentEnd = end;
+		IsoSlab slab(buffer.data(), rows, cols, slices, start, end);
+		triangulateSlab(slab, zBegin, zEnd, mesh);
+	}
+	mesh.updateBoundingBox();
+}
 void IsoSurface::solve(const Volume1f& data, const std::vector<int3>& indexList,
 		Mesh& mesh, const MeshType& type, bool regularizeTest,
 		const float& isoLevel) {
@@ -446,7 +547,8 @@ void IsoSurface::solve(const Volume1f& data, const std::vector<int3>& indexList,
 	mesh.updateBoundingBox();
 }
 void IsoSurface::solve(const EndlessGridFloat& grid, Mesh& mesh,
-		const MeshType& type, bool regularizeTest, const float& isoLevel) {
+		const MeshType& type, bool regularizeTest, const float& isoLevel,
+		bool sharpFeatures) {
 	mesh.clear();
 	float oldBg = backgroundValue;
 	backgroundValue = grid.getBackgroundValue();
@@ -454,7 +556,7 @@ void IsoSurface::solve(const EndlessGridFloat& grid, Mesh& mesh,
 		solveTri(grid, mesh, isoLevel);
 
 	} else {
-		solveQuad(grid, mesh, isoLevel);
+		solveQuad(grid, mesh, isoLevel, sharpFeatures);
 	}
 	if (regularizeTest) {
 		regularize(grid, mesh);
@@ -467,16 +569,16 @@ void IsoSurface::regularize(const EndlessGridFloat& grid, Mesh& mesh) {
 	const int REGULARIZE_ITERATIONS = 3;
 	const float TRACE_THRESHOLD = 1E-5f;
 	std::vector<float3> tmpPoints(mesh.vertexLocations.size());
-	std::vector<std::unordered_set<uint32_t>> vertNbrs;
-	CreateVertexNeighborTable(mesh, vertNbrs);
+	std::vector<uint32_t> nbrOffsets, vertNbrs;
+	buildVertexNeighborTable(mesh, nbrOffsets, vertNbrs);
 	for (int c = 0; c < REGULARIZE_ITERATIONS; c++) {
 #pragma omp parallel for
-		for (int i = 0; i < (int) vertNbrs.size(); i++) {
+		for (int i = 0; i < (int) mesh.vertexLocations.size(); i++) {
 			float3 pt(0.0f);
-			int K = (int) vertNbrs[i].size();
+			int K = (int) (nbrOffsets[i + 1] - nbrOffsets[i]);
 			if (K > 3) {
-				for (uint32_t nbr : vertNbrs[i]) {
-					pt += mesh.vertexLocations[nbr];
+				for (uint32_t n = nbrOffsets[i]; n < nbrOffsets[i + 1]; n++) {
+					pt += mesh.vertexLocations[vertNbrs[n]];
 				}
 				pt /= (float) K;
 			} else {
@@ -513,16 +615,16 @@ void IsoSurface::regularize(const float* data, Mesh& mesh) {
 	const int REGULARIZE_ITERATIONS = 3;
 	const float TRACE_THRESHOLD = 1E-5f;
 	std::vector<float3> tmpPoints(mesh.vertexLocations.size());
-	std::vector<std::unordered_set<uint32_t>> vertNbrs;
-	CreateVertexNeighborTable(mesh, vertNbrs);
+	std::vector<uint32_t> nbrOffsets, vertNbrs;
+	buildVertexNeighborTable(mesh, nbrOffsets, vertNbrs);
 	for (int c = 0; c < REGULARIZE_ITERATIONS; c++) {
 #pragma omp parallel for
-		for (int i = 0; i < (int) vertNbrs.size(); i++) {
+		for (int i = 0; i < (int) mesh.vertexLocations.size(); i++) {
 			float3 pt(0.0f);
-			int K = (int) vertNbrs[i].size();
+			int K = (int) (nbrOffsets[i + 1] - nbrOffsets[i]);
 			if (K > 3) {
-				for (uint32_t nbr : vertNbrs[i]) {
-					pt += mesh.vertexLocations[nbr];
+				for (uint32_t n = nbrOffsets[i]; n < nbrOffsets[i + 1]; n++) {
+					pt += mesh.vertexLocations[vertNbrs[n]];
 				}
 				pt /= (float) K;
 			} else {
@@ -603,22 +705,511 @@ void IsoSurface::solveTri(const float* vol, const int& rows, const int& cols,
 		points[index] = pt;
 	}
 }
+bool IsoSurface::isActiveCell(const IsoSlab& slab, int x, int y, int z) const {
+	if (x < 1 || y < 1 || z < 1 || x >= rows - 1 || y >= cols - 1 || z >= slices - 1)
+		return false;
+	if (!slab.background)
+		return true;
+	for (int iVertex = 0; iVertex < 8; ++iVertex) {
+		if (slab(x + vertexOffset[iVertex][0], y + vertexOffset[iVertex][1],
+				z + vertexOffset[iVertex][2]) == backgroundValue)
+			return false;
+	}
+	return true;
+}
+bool IsoSurface::isActiveEdge(const IsoSlab& slab, int x, int y, int z, int axis) const {
+	const int3 nbr = int3(x, y, z) + AXIS_OFFSET[axis];
+	float fValue1 = slab(x, y, z);
+	float fValue2 = slab(nbr.x, nbr.y, nbr.z);
+	if ((fValue1 < isoLevel) == (fValue2 < isoLevel))
+		return false;
+	if (fValue1 == backgroundValue || fValue2 == backgroundValue)
+		return false;
+	//An edge gets a vertex only if a cell that marching cubes visits uses it.
+	for (int i = 0; i < 4; i++) {
+		int3 cell = int3(x, y, z) - EDGE_NODE_OFFSETS[axis][i];
+		if (isActiveCell(slab, cell.x, cell.y, cell.z))
+			return true;
+	}
+	return false;
+}
+/*
+ * Numbers the active edges owned by grid slice z in (y,x,axis) order and returns the count. If keys is given,
+ * key 3*x+axis of each active edge is written to keys[0..count) and rowStarts[y] (cols+1 entries) is set to the
+ * number of edges before row y, so an edge's rank is found by searching its row. If points is given, the edge
+ * vertices and normals are written to points[0..count) and normals[0..count). When only counting, activeRows[y]
+ * records whether row y has active edges; otherwise rows it marks as empty are skipped.
+ */
+size_t IsoSurface::rankEdges(const IsoSlab& slab, int z, uint32_t* keys, uint32_t* rowStarts,
+		float3* points, float3* normals, uint8_t* activeRows) const {
+	const bool counting = (keys == nullptr && points == nullptr);
+	const float* s0 = slab.slice(z);
+	const float* s1 = (z + 1 < slices) ? slab.slice(z + 1) : s0;
+	uint32_t count = 0;
+	if (rowStarts)
+		rowStarts[0] = 0;
+	for (int y = 1; y < cols; y++) {
+		if (rowStarts)
+			rowStarts[y] = count;
+		if (activeRows && !counting && activeRows[y] == 0)
+			continue;
+		const uint32_t rowStart = count;
+		const float* r0 = s0 + y * (size_t) rows;
+		//Missing neighbors alias the row itself, so they never show a crossing.
+		const float* rows2[3] = { r0 + 1, (y + 1 < cols) ? r0 + rows : r0, (s1 != s0) ? s1 + y * (size_t) rows : r0 };
+		for (int x = 1; x < rows; x++) {
+			const float fValue1 = r0[x];
+			const bool inside = fValue1 < isoLevel;
+			int crossings = (((x + 1 < rows) && (rows2[0][x] < isoLevel) != inside) ? 1 : 0)
+					| (((rows2[1][x] < isoLevel) != inside) ? 2 : 0)
+					| (((rows2[2][x] < isoLevel) != inside) ? 4 : 0);
+			if (crossings == 0)
+				continue;
+			for (int a = 0; a < 3; a++) {
+				if ((crossings & (1 << a)) == 0 || !isActiveEdge(slab, x, y, z, a))
+					continue;
+				if (keys)
+					keys[count] = (uint32_t) (3 * x + a);
+				if (points) {
+					double fDelta = rows2[a][x] - fValue1;
+					float fOffset = (std::abs(fDelta) < 1E-3f) ? 0.5f : (float) ((isoLevel - fValue1) / fDelta);
+					float3 pt = float3((float) x, (float) y, (float) z) + float3(AXIS_OFFSET[a]) * fOffset;
+					float3 norm = slab.interpolateNormal(pt.x, pt.y, pt.z);
+					points[count] = pt;
+					normals[count] = norm / length(norm);
+				}
+				count++;
+			}
+		}
+		if (activeRows && counting)
+			activeRows[y] = (count > rowStart) ? 1 : 0;
+	}
+	if (rowStarts)
+		rowStarts[cols] = count;
+	return count;
+}
+/*
+ * Marching cubes over cell slices [zBegin,zEnd) in parallel passes. The first counts vertices per grid slice
+ * and triangles per cell slice; prefix sums of the counts give every slice a fixed range of the mesh buffers.
+ * The second ranks each grid slice once, writing its vertices and the sorted keys of its edges, and the third
+ * emits triangles. Each vertex belongs to the grid edge it lies on and edges belong to their lower grid point,
+ * so shared vertices are found by rank instead of a hash table. Grid slice zEnd is ranked so the last cell slice
+ * can refer to it; its vertices are numbered as if the next call will emit them first. The last slab emits them.
+ */
+void IsoSurface::triangulateSlab(const IsoSlab& resident, int zBegin, int zEnd, Mesh& mesh) {
+	static const std::vector<int> cellTriangles = []() {
+		std::vector<int> counts(256);
+		for (int flag = 0; flag < 256; flag++) {
+			int n = 0;
+			while (n < 5 && triangleConnectionTable[16 * flag + 3 * n] >= 0)
+				n++;
+			counts[flag] = n;
+		}
+		return counts;
+	}();
+	IsoSlab slab = resident;
+	const size_t sliceSize = (size_t) rows * cols;
+	slab.background = ParallelReduce(0, (size_t) (slab.zEnd - slab.zStart), false, [&](size_t b, size_t e, bool found) {
+		const float* first = slab.slice(slab.zStart + (int) b);
+		return found || std::find(first, first + (e - b) * sliceSize, backgroundValue) != first + (e - b) * sliceSize;
+	}, [](bool a, bool b) {return a || b;}, 1);
+	const float iso = isoLevel;
+	//Marching cubes case of the cell at (x,y,z) from the four rows of grid values around it.
+	auto cellFlag = [iso](const float* a0, const float* a1, const float* b0, const float* b1, int x) {
+		return ((a0[x] < iso) ? 1 : 0) | ((a0[x + 1] < iso) ? 2 : 0) | ((a1[x + 1] < iso) ? 4 : 0)
+				| ((a1[x] < iso) ? 8 : 0) | ((b0[x] < iso) ? 16 : 0) | ((b0[x + 1] < iso) ? 32 : 0)
+				| ((b1[x + 1] < iso) ? 64 : 0) | ((b1[x] < iso) ? 128 : 0);
+	};
+	const bool last = (zEnd >= slices - 1);
+	const int cellSlices = zEnd - zBegin;
+	const int rankSlices = cellSlices + 1;
+	const int gridSlices = last ? rankSlices : cellSlices;
+	std::vector<size_t> vertexOffsets(rankSlices + 1, 0);
+	std::vector<size_t> triangleOffsets(cellSlices + 1, 0);
+	//Rows without vertices or triangles in the first pass are skipped in the others.
+	std::vector<uint8_t> edgeRows(rankSlices * (size_t) cols, 0);
+	std::vector<uint8_t> cellRows(cellSlices * (size_t) cols, 0);
+	ParallelFor(0, (size_t) rankSlices, [&](size_t s) {
+		int z = zBegin + (int) s;
+		vertexOffsets[s + 1] = rankEdges(slab, z, nullptr, nullptr, nullptr, nullptr, &edgeRows[s * cols]);
+		if ((int) s >= cellSlices)
+			return;
+		size_t count = 0;
+		for (int y = 1; y < cols - 1; y++) {
+			const float* a0 = slab.slice(z) + y * (size_t) rows;
+			const float* b0 = slab.slice(z + 1) + y * (size_t) rows;
+			const size_t rowStart = count;
+			for (int x = 1; x < rows - 1; x++) {
+				int iFlagIndex = cellFlag(a0, a0 + rows, b0, b0 + rows, x);
+				if (cubeEdgeFlagsCC626[iFlagIndex] != 0 && isActiveCell(slab, x, y, z))
+					count += cellTriangles[iFlagIndex];
+			}
+			cellRows[s * cols + y] = (count > rowStart) ? 1 : 0;
+		}
+		triangleOffsets[s + 1] = count;
+	}, 1);
+	vertexOffsets[0] = mesh.vertexLocations.size();
+	triangleOffsets[0] = mesh.triIndexes.size();
+	for (int s = 0; s < rankSlices; s++)
+		vertexOffsets[s + 1] += vertexOffsets[s];
+	for (int s = 0; s < cellSlices; s++)
+		triangleOffsets[s + 1] += triangleOffsets[s];
+	std::vector<float3>& points = mesh.vertexLocations.data;
+	std::vector<float3>& normals = mesh.vertexNormals.data;
+	std::vector<uint3>& indexes = mesh.triIndexes.data;
+	points.resize(vertexOffsets[gridSlices]);
+	normals.resize(vertexOffsets[gridSlices]);
+	indexes.resize(triangleOffsets[cellSlices]);
+	triangleCount = indexes.size();
+	std::vector<uint32_t> keys(vertexOffsets[rankSlices] - vertexOffsets[0]);
+	std::vector<uint32_t> rowStarts(rankSlices * (size_t) (cols + 1));
+	ParallelFor(0, (size_t) rankSlices, [&](size_t s) {
+		const bool emit = ((int) s < gridSlices);
+		rankEdges(slab, zBegin + (int) s, &keys[vertexOffsets[s] - vertexOffsets[0]], &rowStarts[s * (cols + 1)],
+				emit ? &points[vertexOffsets[s]] : nullptr, emit ? &normals[vertexOffsets[s]] : nullptr, &edgeRows[s * cols]);
+	}, 1);
+	//Vertex id of the edge owned by grid point (x,y) of ranked slice s along an axis.
+	auto vertexId = [&](size_t s, int x, int y, int axis) {
+		const uint32_t* sliceKeys = keys.data() + (vertexOffsets[s] - vertexOffsets[0]);
+		const uint32_t* starts = &rowStarts[s * (cols + 1)];
+		const uint32_t* key = std::lower_bound(sliceKeys + starts[y], sliceKeys + starts[y + 1], (uint32_t) (3 * x + axis));
+		return (uint32_t) (vertexOffsets[s] + (key - sliceKeys));
+	};
+	ParallelFor(0, (size_t) cellSlices, [&](size_t s) {
+		int z = zBegin + (int) s;
+		size_t tri = triangleOffsets[s];
+		for (int y = 1; y < cols - 1; y++) {
+			if (cellRows[s * cols + y] == 0)
+				continue;
+			const float* a0 = slab.slice(z) + y * (size_t) rows;
+			const float* b0 = slab.slice(z + 1) + y * (size_t) rows;
+			for (int x = 1; x < rows - 1; x++) {
+				int iFlagIndex = cellFlag(a0, a0 + rows, b0, b0 + rows, x);
+				if (cubeEdgeFlagsCC626[iFlagIndex] == 0 || !isActiveCell(slab, x, y, z))
+					continue;
+				for (int iTriangle = 0; iTriangle < cellTriangles[iFlagIndex]; iTriangle++) {
+					uint3 face;
+					for (int iCorner = 0; iCorner < 3; ++iCorner) {
+						const int* owner = EDGE_OWNER[triangleConnectionTable[16 * iFlagIndex + 3 * iTriangle + iCorner]];
+						face[iCorner] = vertexId(s + owner[2], x + owner[0], y + owner[1], owner[3]);
+					}
+					indexes[tri++] = face;
+				}
+			}
+		}
+	}, 1);
+}
+void IsoSurface::solveTri(const float* vol, const int& rows, const int& cols,
+		const int& slices, Mesh& mesh, const float& isoLevel) {
+	this->rows = rows;
+	this->cols = cols;
+	this->slices = slices;
+	this->isoLevel = isoLevel;
+	triangleCount = 0;
+	if (slices < 3 || rows < 3 || cols < 3)
+		return;
+	IsoSlab slab(vol, rows, cols, slices, 0, slices);
+	triangulateSlab(slab, 1, slices - 1, mesh);
+}
+/* Active cells and edges of one leaf of a sparse grid, gathered before vertex ids are known. */
+struct IsoLeaf {
+	/* Active cells whose lower corner lies in the leaf, as x+y*dim+z*dim*dim in increasing order. */
+	std::vector<uint32_t> cells;
+	std::vector<float3> points;
+	std::vector<float3> normals;
+	/* Active edges whose pivot lies in the leaf, as (pivot index << 3) | (axis << 1) | winding. */
+	std::vector<uint32_t> edges;
+	/* Active cells next to the leaf whose lower corner lies in no leaf. */
+	std::vector<int3> orphans;
+};
+static const float QEF_TRUNCATION = 0.1f;
+static inline int RoundDownToMultiple(int v, int dim) {
+	return (v >= 0) ? (v / dim) * dim : -((dim - 1 - v) / dim) * dim;
+}
+static inline bool GetEdgeCrossing(float fValue1, float fValue2,
+		float backgroundValue, float isoLevel, float& t) {
+	if (fValue1 == backgroundValue || fValue2 == backgroundValue
+			|| !(fValue1 * fValue2 < 0)) {
+		return false;
+	}
+	double fDelta = fValue2 - fValue1;
+	if (std::abs(fDelta) < 1E-3f) {
+		t = 0.5f;
+	} else {
+		t = (float) ((isoLevel - fValue1) / fDelta);
+	}
+	return true;
+}
+template<class F> static int GetCellCrossings(const F& value, const int3& cell,
+		float backgroundValue, float isoLevel, float3* points) {
+	int count = 0;
+	float t;
+	for (int a = 0; a < 3; a++) {
+		for (int i = 0; i < 4; i++) {
+			int3 pivot = cell + IsoSurface::EDGE_NODE_OFFSETS[a][i];
+			if (GetEdgeCrossing(value(pivot),
+					value(pivot + IsoSurface::AXIS_OFFSET[a]), backgroundValue,
+					isoLevel, t)) {
+				points[count++] = float3((float) pivot.x, (float) pivot.y,
+						(float) pivot.z) + float3(IsoSurface::AXIS_OFFSET[a]) * t;
+			}
+		}
+	}
+	return count;
+}
+/*
+ * Mean of the edge crossings, or with sharpFeatures the point that minimizes sum((n.(x-p))^2) over the crossings.
+ * The QEF is solved about the mean with a truncated pseudo-inverse, so directions the normals leave free stay at
+ * the mean, and the result is clamped to the cell.
+ */
+static float3 PlaceCellVertex(const float3* points, int count, const int3& cell,
+		bool sharpFeatures,
+		const std::function<float3(float x, float y, float z)>& normal) {
+	float3 massPoint(0.0f);
+	for (int i = 0; i < count; i++) {
+		massPoint += points[i];
+	}
+	massPoint /= (float) count;
+	if (!sharpFeatures || count < 2) {
+		return massPoint;
+	}
+	float3x3 A(0.0f);
+	float3 b(0.0f);
+	for (int i = 0; i < count; i++) {
+		float3 n = normal(points[i].x, points[i].y, points[i].z);
+		float len = length(n);
+		if (len < 1E-6f)
+			continue;
+		n /= len;
+		A += outerProd(n, n);
+		b += n * dot(n, points[i] - massPoint);
+	}
+	float3x3 U, D, Vt;
+	SVD(A, U, D, Vt);
+	float maxSingular = std::max(std::max(std::abs(D(0, 0)), std::abs(D(1, 1))),
+			std::abs(D(2, 2)));
+	if (maxSingular <= 0.0f) {
+		return massPoint;
+	}
+	float3 x = transpose(U) * b;
+	for (int k = 0; k < 3; k++) {
+		float d = D(k, k);
+		x[k] = (std::abs(d) > QEF_TRUNCATION * maxSingular) ? x[k] / d : 0.0f;
+	}
+	float3 lower((float) cell.x, (float) cell.y, (float) cell.z);
+	return clamp(massPoint + transpose(Vt) * x, lower, lower + float3(1.0f));
+}
+void IsoSurface::contourLeaves(const std::vector<int3>& leafLocations, int dim,
+		const std::function<void(size_t leaf, float* block)>& fillLeaf,
+		const std::function<float(int i, int j, int k)>& sample,
+		const std::function<float3(float x, float y, float z)>& normal,
+		Mesh& mesh, float isoLevel, float backgroundValue, Winding winding,
+		bool sharpFeatures) {
+	const size_t leafCount = leafLocations.size();
+	const int bdim = dim + 1;
+	const int bstride[3] = { 1, bdim, bdim * bdim };
+	std::unordered_map<int3, uint32_t> leafIndexes;
+	for (size_t n = 0; n < leafCount; n++) {
+		leafIndexes[leafLocations[n]] = (uint32_t) n;
+	}
+	auto findLeaf = [&](const int3& pt) -> int {
+		auto iter = leafIndexes.find(int3(RoundDownToMultiple(pt.x, dim),
+				RoundDownToMultiple(pt.y, dim), RoundDownToMultiple(pt.z, dim)));
+		return (iter != leafIndexes.end()) ? (int) iter->second : -1;
+	};
+	std::vector<IsoLeaf> leaves(leafCount);
+	ParallelFor(0, leafCount, [&](size_t n) {
+		IsoLeaf& leaf = leaves[n];
+		const int3 loc = leafLocations[n];
+		std::vector<float> block(bdim * bdim * bdim);
+		std::vector<uint8_t> crossings(block.size(), 0);
+		fillLeaf(n, block.data());
+		//Sign changes on the edges leaving each point: a bit per axis, then a winding bit per axis.
+		for (int z = 0; z < bdim; z++) {
+			for (int y = 0; y < bdim; y++) {
+				for (int x = 0; x < bdim; x++) {
+					const int3 pos(x, y, z);
+					int idx = x + y * bdim + z * bdim * bdim;
+					float fValue1 = block[idx];
+					if (fValue1 == backgroundValue)
+						continue;
+					uint8_t mask = 0;
+					float t;
+					for (int a = 0; a < 3; a++) {
+						if (pos[a] + 1 < bdim
+								&& GetEdgeCrossing(fValue1, block[idx + bstride[a]],
+										backgroundValue, isoLevel, t)) {
+							mask |= (1 << a);
+							if ((winding == Winding::Clockwise) ?
+									(fValue1 < 0.f) : (fValue1 > 0.f)) {
+								mask |= (8 << a);
+							}
+						}
+					}
+					crossings[idx] = mask;
+				}
+			}
+		}
+		auto blockValue = [&](const int3& pt) {
+			return block[(pt.x - loc.x) + (pt.y - loc.y) * bdim
+					+ (pt.z - loc.z) * bdim * bdim];
+		};
+		float3 points[12];
+		for (int z = 0; z < dim; z++) {
+			for (int y = 0; y < dim; y++) {
+				for (int x = 0; x < dim; x++) {
+					const int3 pos(x, y, z);
+					uint8_t mask = crossings[x + y * bdim + z * bdim * bdim];
+					for (int a = 0; a < 3; a++) {
+						if ((mask & (1 << a)) == 0)
+							continue;
+						leaf.edges.push_back(
+								((uint32_t) (x + y * dim + z * dim * dim) << 3)
+										| (a << 1) | ((mask >> (3 + a)) & 1));
+						for (int i = 0; i < 4; i++) {
+							int3 cell = pos - EDGE_NODE_OFFSETS[a][i];
+							if (cell.x < 0 || cell.y < 0 || cell.z < 0) {
+								cell += loc;
+								if (findLeaf(cell) < 0) {
+									leaf.orphans.push_back(cell);
+								}
+							}
+						}
+					}
+					bool active = false;
+					for (int a = 0; a < 3 && !active; a++) {
+						for (int i = 0; i < 4; i++) {
+							int3 pivot = pos + EDGE_NODE_OFFSETS[a][i];
+							if (crossings[pivot.x + pivot.y * bdim
+									+ pivot.z * bdim * bdim] & (1 << a)) {
+								active = true;
+								break;
+							}
+						}
+					}
+					if (!active)
+						continue;
+					int3 cell = pos + loc;
+					int count = GetCellCrossings(blockValue, cell,
+							backgroundValue, isoLevel, points);
+					float3 pt = PlaceCellVertex(points, count, cell,
+							sharpFeatures, normal);
+					leaf.cells.push_back(
+							(uint32_t) (x + y * dim + z * dim * dim));
+					leaf.points.push_back(pt);
+					leaf.normals.push_back(normal(pt.x, pt.y, pt.z));
+				}
+			}
+		}
+		std::sort(leaf.orphans.begin(), leaf.orphans.end());
+		leaf.orphans.erase(std::unique(leaf.orphans.begin(), leaf.orphans.end()),
+				leaf.orphans.end());
+	});
+	std::vector<uint32_t> vertexOffsets(leafCount + 1, 0);
+	std::vector<size_t> quadOffsets(leafCount + 1, 0);
+	std::vector<int3> orphans;
+	for (size_t n = 0; n < leafCount; n++) {
+		const IsoLeaf& leaf = leaves[n];
+		vertexOffsets[n + 1] = vertexOffsets[n] + (uint32_t) leaf.cells.size();
+		quadOffsets[n + 1] = quadOffsets[n] + leaf.edges.size();
+		orphans.insert(orphans.end(), leaf.orphans.begin(), leaf.orphans.end());
+	}
+	std::sort(orphans.begin(), orphans.end());
+	orphans.erase(std::unique(orphans.begin(), orphans.end()), orphans.end());
+	const uint32_t orphanOffset = vertexOffsets[leafCount];
+	mesh.vertexLocations.resize(orphanOffset + orphans.size());
+	mesh.vertexNormals.resize(orphanOffset + orphans.size());
+	mesh.quadIndexes.resize(quadOffsets[leafCount]);
+	auto getVertexId = [&](int n, const int3& cell) -> uint32_t {
+		int3 pos = cell - leafLocations[n];
+		if (pos.x < 0 || pos.y < 0 || pos.z < 0) {
+			n = findLeaf(cell);
+			if (n < 0) {
+				return orphanOffset
+						+ (uint32_t) (std::lower_bound(orphans.begin(),
+								orphans.end(), cell) - orphans.begin());
+			}
+			pos = cell - leafLocations[n];
+		}
+		const std::vector<uint32_t>& cells = leaves[n].cells;
+		uint32_t key = (uint32_t) (pos.x + pos.y * dim + pos.z * dim * dim);
+		return vertexOffsets[n]
+				+ (uint32_t) (std::lower_bound(cells.begin(), cells.end(), key)
+						- cells.begin());
+	};
+	ParallelFor(0, leafCount, [&](size_t n) {
+		IsoLeaf& leaf = leaves[n];
+		const int3 loc = leafLocations[n];
+		std::copy(leaf.points.begin(), leaf.points.end(),
+				mesh.vertexLocations.data.begin() + vertexOffsets[n]);
+		std::copy(leaf.normals.begin(), leaf.normals.end(),
+				mesh.vertexNormals.data.begin() + vertexOffsets[n]);
+		std::vector<float3>().swap(leaf.points);
+		std::vector<float3>().swap(leaf.normals);
+		for (size_t k = 0; k < leaf.edges.size(); k++) {
+			uint32_t edge = leaf.edges[k];
+			uint32_t idx = edge >> 3;
+			int axis = (edge >> 1) & 3;
+			int3 pivot = loc
+					+ int3(idx % dim, (idx / dim) % dim, idx / (dim * dim));
+			uint32_t ids[4];
+			for (int i = 0; i < 4; i++) {
+				ids[i] = getVertexId((int) n, pivot - EDGE_NODE_OFFSETS[axis][i]);
+			}
+			if (edge & 1) {
+				mesh.quadIndexes[quadOffsets[n] + k] = uint4(ids[0], ids[2], ids[3], ids[1]);
+			} else {
+				mesh.quadIndexes[quadOffsets[n] + k] = uint4(ids[0], ids[1], ids[3], ids[2]);
+			}
+		}
+	});
+	auto sampleValue = [&](const int3& pt) {
+		return sample(pt.x, pt.y, pt.z);
+	};
+	ParallelFor(0, orphans.size(), [&](size_t m) {
+		float3 points[12];
+		int count = GetCellCrossings(sampleValue, orphans[m], backgroundValue,
+				isoLevel, points);
+		float3 pt = PlaceCellVertex(points, count, orphans[m], sharpFeatures,
+				normal);
+		mesh.vertexLocations[orphanOffset + m] = pt;
+		mesh.vertexNormals[orphanOffset + m] = normal(pt.x, pt.y, pt.z);
+	});
+}
 void IsoSurface::solveQuad(const EndlessGridFloat& grid, Mesh& mesh,
-		const float& isoLevel) {
+		const float& isoLevel, bool sharpFeatures) {
 	auto leafs = grid.getLeafNodes();
-	int dim = leafs.front()->dim;
-	int bdim = dim + 1;
-	this->rows = bdim;
-	this->cols = bdim;
-	this->slices = bdim;
+	if (leafs.empty())
+		return;
+	std::vector<const EndlessNodeFloat*> leaves(leafs.begin(), leafs.end());
+	std::vector<int3> locations(leaves.size());
+	for (size_t n = 0; n < leaves.size(); n++) {
+		locations[n] = leaves[n]->location;
+	}
+	const int dim = leaves.front()->dim;
+	const int bdim = dim + 1;
 	this->isoLevel = isoLevel;
-
-	std::unordered_set<int3> activeVoxels;
-	std::unordered_map<int4, EdgeInfo> activeEdges;
-	std::unordered_map<int3, uint32_t> vertexIndices;
-	findActiveVoxels(grid, leafs, activeVoxels, activeEdges);
-	generateVertexData(grid, activeVoxels, activeEdges, vertexIndices, mesh);
-	generateTriangles(activeEdges, vertexIndices, mesh);
+	contourLeaves(locations, dim, [&](size_t n, float* block) {
+		const EndlessNodeFloat* leaf = leaves[n];
+		const int3 loc = leaf->location;
+		for (int z = 0; z < bdim; z++) {
+			for (int y = 0; y < bdim; y++) {
+				for (int x = 0; x < bdim; x++) {
+					float val;
+					if (x >= dim || y >= dim || z >= dim) {
+						val = grid.getLeafValue(loc.x + x, loc.y + y, loc.z + z);
+					} else {
+						val = leaf->data[x + y * dim + z * dim * dim];
+					}
+					block[x + y * bdim + z * bdim * bdim] = val;
+				}
+			}
+		}
+	}, [&](int i, int j, int k) {
+		return grid.getLeafValue(i, j, k);
+	}, [&](float x, float y, float z) {
+		return GetInterpolatedNormal(grid, x, y, z);
+	}, mesh, isoLevel, backgroundValue, winding, sharpFeatures);
 }
 void IsoSurface::solveTri(const EndlessGridFloat& grid, Mesh& mesh,
 		const float& isoLevel) {
@@ -867,38 +1458,64 @@ vector<vector<int>> IsoSurface::buildVertexNeighborTable(const int vertexCount,
 	}
 	return neighborTable;
 }
-void IsoSurface::generateVertexData(const float*data,
-		const std::unordered_set<int3>& voxels,
-		const std::unordered_map<int4, EdgeInfo>& edges,
-		std::unordered_map<int3, uint32_t>& vertexIndices, Mesh& buffer) {
-	Vector3f& vert = buffer.vertexLocations;
-	Vector3f& norm = buffer.vertexNormals;
-	float3 p[12];
-	uint32_t idxCounter = 0;
-	for (const auto& voxelID : voxels) {
-		int idx = 0;
-		for (int a = 0; a < 3; a++) {
-			for (int i = 0; i < 4; i++) {
-				int4 edgeID = int4(voxelID + EDGE_NODE_OFFSETS[a][i], a);
-				const auto iter = edges.find(edgeID);
-				if (iter != end(edges)) {
-					const auto& info = iter->second;
-					p[idx++] = info.point;
-				}
-			}
-		}
-		float3 nodePos(0.0f);
-		for (int i = 0; i < idx; i++) {
-			nodePos += p[i];
-		}
-		nodePos /= (float) idx;
-		vertexIndices[voxelID] = idxCounter++;
-		vert.push_back(nodePos);
-		norm.push_back(
-				interpolateNormal(data, nodePos.x, nodePos.y, nodePos.z));
+void IsoSurface::buildVertexNeighborTable(const Mesh& mesh,
+		std::vector<uint32_t>& offsets, std::vector<uint32_t>& neighbors) {
+	const size_t vertexCount = mesh.vertexLocations.size();
+	const std::vector<uint3>& tris = mesh.triIndexes.data;
+	const std::vector<uint4>& quads = mesh.quadIndexes.data;
+	//Each face adds both of its edges at a vertex. Slots are claimed atomically; rows are sorted afterwards.
+	std::vector<std::atomic<uint32_t>> fill(vertexCount);
+	ParallelFor(0, tris.size(), [&](size_t f) {
+		const uint3& face = tris[f];
+		for (int k = 0; k < 3; k++)
+			fill[face[k]].fetch_add(2, std::memory_order_relaxed);
+	}, 4096);
+	ParallelFor(0, quads.size(), [&](size_t f) {
+		const uint4& face = quads[f];
+		for (int k = 0; k < 4; k++)
+			fill[face[k]].fetch_add(2, std::memory_order_relaxed);
+	}, 4096);
+	std::vector<uint32_t> starts(vertexCount + 1, 0);
+	for (size_t i = 0; i < vertexCount; i++) {
+		starts[i + 1] = starts[i] + fill[i].load(std::memory_order_relaxed);
+		fill[i].store(starts[i], std::memory_order_relaxed);
+	}
+	std::vector<uint32_t> all(starts[vertexCount]);
+	auto link = [&](uint32_t a, uint32_t b) {
+		all[fill[a].fetch_add(1, std::memory_order_relaxed)] = b;
+		all[fill[b].fetch_add(1, std::memory_order_relaxed)] = a;
+	};
+	ParallelFor(0, tris.size(), [&](size_t f) {
+		const uint3& face = tris[f];
+		link(face.x, face.y);
+		link(face.y, face.z);
+		link(face.z, face.x);
+	}, 4096);
+	ParallelFor(0, quads.size(), [&](size_t f) {
+		const uint4& face = quads[f];
+		link(face.x, face.y);
+		link(face.y, face.z);
+		link(face.z, face.w);
+		link(face.w, face.x);
+	}, 4096);
+	std::vector<uint32_t> counts(vertexCount);
+	ParallelFor(0, vertexCount, [&](size_t i) {
+		auto first = all.begin() + starts[i];
+		auto last = all.begin() + starts[i + 1];
+		std::sort(first, last);
+		counts[i] = (uint32_t) (std::unique(first, last) - first);
+	}, 4096);
+	offsets.resize(vertexCount + 1);
+	offsets[0] = 0;
+	for (size_t i = 0; i < vertexCount; i++) {
+		offsets[i + 1] = offsets[i] + counts[i];
 	}
+	neighbors.resize(offsets[vertexCount]);
+	ParallelFor(0, vertexCount, [&](size_t i) {
+		std::copy(all.begin() + starts[i], all.begin() + starts[i] + counts[i], neighbors.begin() + offsets[i]);
+	}, 4096);
 }
-void IsoSurface::generateVertexData(const EndlessGridFloat& grid,
+void IsoSurface::generateVertexData(const float*data,
 		const std::unordered_set<int3>& voxels,
 		const std::unordered_map<int4, EdgeInfo>& edges,
 		std::unordered_map<int3, uint32_t>& vertexIndices, Mesh& buffer) {
@@ -926,7 +1543,7 @@ void IsoSurface::generateVertexData(const EndlessGridFloat& grid,
 		vertexIndices[voxelID] = idxCounter++;
 		vert.push_back(nodePos);
 		norm.push_back(
-				GetInterpolatedNormal(grid, nodePos.x, nodePos.y, nodePos.z));
+				interpolateNormal(data, nodePos.x, nodePos.y, nodePos.z));
 	}
 }
 void IsoSurface::generateTriangles(
@@ -973,78 +1590,6 @@ void IsoSurface::generateTriangles(
 		quads.push_back(quad);
 	}
 }
-void IsoSurface::findActiveVoxels(const EndlessGridFloat& grid,
-		const std::list<EndlessNodeFloat*>& leafs,
-		std::unordered_set<int3>& activeVoxels,
-		std::unordered_map<int4, EdgeInfo>& activeEdges) {
-	int bdim = rows;
-	std::vector<float> data(rows * cols * slices);
-	for (EndlessNodeFloat* leaf : leafs) {
-		int dim = leaf->dim;
-		int3 loc = leaf->location;
-		for (int z = 0; z < bdim; z++) {
-			for (int y = 0; y < bdim; y++) {
-				for (int x = 0; x < bdim; x++) {
-					float val;
-					if (x >= dim || y >= dim || z >= dim) {
-						val = grid.getLeafValue(loc.x + x, loc.y + y,
-								loc.z + z);
-					} else {
-						val = leaf->data[x + y * dim + z * dim * dim];
-					}
-					data[x + y * bdim + z * bdim * bdim] = val;
-				}
-			}
-		}
-		for (int z = 0; z < dim; z++) {
-			for (int y = 0; y < dim; y++) {
-				for (int x = 0; x < dim; x++) {
-					float fValue1 = getValue(data.data(), x, y, z);
-					if (fValue1 != backgroundValue) {
-						int3 pivot = int3(x + loc.x, y + loc.y, z + loc.z);
-						for (int a = 0; a < 3; a++) {
-							int3 axis = AXIS_OFFSET[a];
-							int3 nbr = int3(x, y, z) + axis;
-							if (nbr.x >= 0 && nbr.y >= 0 && nbr.z >= 0
-									&& nbr.x < rows && nbr.y < cols
-									&& nbr.z < slices) {
-								float fValue2 = getValue(data.data(), nbr.x,
-										nbr.y, nbr.z);
-								if (fValue2 != backgroundValue
-										&& fValue1 * fValue2 < 0) {
-									float3 crossing((float) pivot.x,
-											(float) pivot.y, (float) pivot.z);
-									double fDelta = fValue2 - fValue1;
-									if (std::abs(fDelta) < 1E-3f) {
-										crossing += float3(axis) * 0.5f;
-									} else {
-										crossing += float3(axis)
-												* (float) ((isoLevel - fValue1)
-														/ fDelta);
-									}
-									EdgeInfo info;
-									info.point = crossing;
-									if (winding == Winding::Clockwise) {
-										info.winding = (fValue1 < 0.f);
-									} else {
-										info.winding = (fValue1 > 0.f);
-									}
-									activeEdges[int4(pivot.x, pivot.y, pivot.z,
-											a)] = info;
-									auto edgeNodes = EDGE_NODE_OFFSETS[a];
-									for (int i = 0; i < 4; i++) {
-										int3 id = pivot - edgeNodes[i];
-										activeVoxels.insert(id);
-									}
-								}
-							}
-						}
-					}
-				}
-			}
-		}
-	}
-}
 void IsoSurface::findActiveVoxels(const float* vol,
 		const std::vector<int3>& indexList,
 		std::unordered_set<int3>& activeVoxels,
@@ -1495,4 +2040,290 @@ float IsoSurface::getImageValue(const float* image, int i, int j, int k) {
 	return image[getSafeIndex(i, j, k)];
 }
 
+/*
+ * Maps each vertex of mesh to the vertex of reference at the same position, or -1. Positions from different
+ * extraction paths only differ by rounding, so vertices are matched within a small tolerance.
+ */
+static std::vector<int> MatchVertices(const Mesh& mesh, const Mesh& reference, float tolerance) {
+	std::unordered_map<int3, std::vector<int>> cells;
+	for (size_t i = 0; i < reference.vertexLocations.size(); i++) {
+		cells[int3(floor(reference.vertexLocations[i] * 4.0f))].push_back((int) i);
+	}
+	std::vector<int> matches(mesh.vertexLocations.size(), -1);
+	for (size_t i = 0; i < mesh.vertexLocations.size(); i++) {
+		float3 pt = mesh.vertexLocations[i];
+		int3 cell = int3(floor(pt * 4.0f));
+		float best = tolerance;
+		for (int z = -1; z <= 1; z++) {
+			for (int y = -1; y <= 1; y++) {
+				for (int x = -1; x <= 1; x++) {
+					auto iter = cells.find(cell + int3(x, y, z));
+					if (iter == cells.end())
+						continue;
+					for (int j : iter->second) {
+						float d = distance(pt, reference.vertexLocations[j]);
+						if (d <= best) {
+							best = d;
+							matches[i] = j;
+						}
+					}
+				}
+			}
+		}
+	}
+	return matches;
+}
+//Triangles as sorted vertex triples, each rotated to start at its smallest id so winding is kept.
+static std::vector<uint3> CanonicalTriangles(const Mesh& mesh, const std::vector<int>& ids) {
+	std::vector<uint3> tris;
+	for (const uint3& tri : mesh.triIndexes) {
+		uint3 t((uint32_t) ids[tri.x], (uint32_t) ids[tri.y], (uint32_t) ids[tri.z]);
+		while (t.x > t.y || t.x > t.z) {
+			t = uint3(t.y, t.z, t.x);
+		}
+		tris.push_back(t);
+	}
+	std::sort(tris.begin(), tris.end(), [](const uint3& a, const uint3& b) {
+		return (a.x != b.x) ? a.x < b.x : ((a.y != b.y) ? a.y < b.y : a.z < b.z);
+	});
+	return tris;
+}
+bool SANITY_CHECK_ISOSURFACE() {
+	const int rows = 41, cols = 37, slices = 33;
+	const float isoLevel = 0.25f;
+	Volume1f volume(rows, cols, slices);
+	for (int k = 0; k < slices; k++) {
+		for (int j = 0; j < cols; j++) {
+			for (int i = 0; i < rows; i++) {
+				float3 pt((float) i, (float) j, (float) k);
+				float d1 = distance(pt, float3(15.3f, 17.1f, 14.7f)) - 9.3f;
+				float d2 = distance(pt, float3(25.6f, 19.2f, 17.4f)) - 7.9f;
+				volume(i, j, k).x = std::min(d1, d2) + 0.7f * std::sin(0.5f * pt.x) * std::cos(0.4f * pt.z);
+			}
+		}
+	}
+	//Background values cut a corner out of the surface.
+	for (int k = 0; k < 12; k++) {
+		for (int j = 0; j < 14; j++) {
+			for (int i = 0; i < 16; i++) {
+				volume(i, j, k).x = 1E30f;
+			}
+		}
+	}
+	bool ok = true;
+	IsoSurface isoSurface;
+	Mesh dense;
+	isoSurface.solve(volume, dense, MeshType::Triangle, false, isoLevel);
+	ok &= (dense.triIndexes.size() > 0);
+	//Slabs of any size read the same values and normals as the whole volume, so their output is bit-identical.
+	const size_t sliceSize = (size_t) rows * cols;
+	for (int slabSize : { 1, 4, 7, 64 }) {
+		Mesh slab;
+		int nextSlice = 0;
+		isoSurface.solve([&](int z, float* slice) {
+			ok &= (z == nextSlice++);
+			std::copy(volume.ptr() + z * sliceSize, volume.ptr() + (z + 1) * sliceSize, slice);
+		}, rows, cols, slices, slab, isoLevel, slabSize);
+		ok &= (nextSlice == slices);
+		ok &= (slab.vertexLocations.data == dense.vertexLocations.data);
+		ok &= (slab.vertexNormals.data == dense.vertexNormals.data);
+		ok &= (slab.triIndexes.size() == dense.triIndexes.size());
+		for (size_t i = 0; i < dense.triIndexes.size() && i < slab.triIndexes.size(); i++) {
+			ok &= (slab.triIndexes[i] == dense.triIndexes[i]);
+		}
+	}
+	//The hash map path numbers vertices in visiting order, so vertices are matched by position.
+	std::vector<int3> cells;
+	for (int k = 0; k < slices; k++) {
+		for (int j = 0; j < cols; j++) {
+			for (int i = 0; i < rows; i++) {
+				cells.push_back(int3(i, j, k));
+			}
+		}
+	}
+	Mesh hashed;
+	isoSurface.solve(volume, cells, hashed, MeshType::Triangle, false, isoLevel);
+	ok &= (hashed.vertexLocations.size() == dense.vertexLocations.size());
+	ok &= (hashed.triIndexes.size() == dense.triIndexes.size());
+	if (ok) {
+		std::vector<int> matches = MatchVertices(dense, hashed, 1E-4f);
+		std::vector<int> identity(hashed.vertexLocations.size());
+		std::vector<uint8_t> used(hashed.vertexLocations.size(), 0);
+		for (size_t i = 0; i < matches.size(); i++) {
+			identity[i] = (int) i;
+			ok &= (matches[i] >= 0 && used[matches[i]] == 0);
+			if (matches[i] >= 0)
+				used[matches[i]] = 1;
+		}
+		if (ok) {
+			ok &= (CanonicalTriangles(dense, matches) == CanonicalTriangles(hashed, identity));
+		}
+	}
+	//Regularization builds its neighbor table in parallel, which must not change the result.
+	Mesh regularized1, regularized2;
+	isoSurface.solve(volume, regularized1, MeshType::Triangle, true, isoLevel);
+	isoSurface.solve(volume, regularized2, MeshType::Triangle, true, isoLevel);
+	ok &= (regularized1.vertexLocations.data == regularized2.vertexLocations.data);
+	std::cout << "Iso-surface " << dense.vertexLocations.size() << " vertices " << dense.triIndexes.size() << " triangles "
+			<< (ok ? "passed" : "failed") << std::endl;
+	return ok;
+}
+//Quads rotated to start at their smallest id so winding is kept, then sorted.
+static std::vector<uint4> CanonicalQuads(const Mesh& mesh, const std::vector<int>& ids) {
+	std::vector<uint4> quads;
+	for (const uint4& quad : mesh.quadIndexes) {
+		uint4 q((uint32_t) ids[quad.x], (uint32_t) ids[quad.y], (uint32_t) ids[quad.z], (uint32_t) ids[quad.w]);
+		while (q.x > q.y || q.x > q.z || q.x > q.w) {
+			q = uint4(q.y, q.z, q.w, q.x);
+		}
+		quads.push_back(q);
+	}
+	std::sort(quads.begin(), quads.end(), [](const uint4& a, const uint4& b) {
+		return (a.x != b.x) ? a.x < b.x : ((a.y != b.y) ? a.y < b.y : ((a.z != b.z) ? a.z < b.z : a.w < b.w));
+	});
+	return quads;
+}
+//Allocates the leaves in [lower,upper) that come within band of the level set and fills them from the distance function.
+static void FillGrid(EndlessGridFloat& grid, int dim, const int3& lower, const int3& upper, float band,
+		const std::function<float(const float3&)>& distanceFunc) {
+	for (int z = lower.z; z < upper.z; z += dim) {
+		for (int y = lower.y; y < upper.y; y += dim) {
+			for (int x = lower.x; x < upper.x; x += dim) {
+				float minDistance = std::numeric_limits<float>::max();
+				for (int k = 0; k < dim; k++) {
+					for (int j = 0; j < dim; j++) {
+						for (int i = 0; i < dim; i++) {
+							minDistance = std::min(minDistance, std::abs(distanceFunc(float3((float) (x + i), (float) (y + j), (float) (z + k)))));
+						}
+					}
+				}
+				if (minDistance >= band)
+					continue;
+				for (int k = 0; k < dim; k++) {
+					for (int j = 0; j < dim; j++) {
+						for (int i = 0; i < dim; i++) {
+							grid.getLeafValue(x + i, y + j, z + k) = distanceFunc(float3((float) (x + i), (float) (y + j), (float) (z + k)));
+						}
+					}
+				}
+			}
+		}
+	}
+}
+bool SANITY_CHECK_ISOSURFACE_GRID() {
+	const int dim = 8;
+	bool ok = true;
+	IsoSurface isoSurface;
+	//Leaves are only allocated near the surface, so some cells at leaf borders belong to no leaf.
+	{
+		const int3 lower(-24), upper(24);
+		EndlessGridFloat grid( { 4, dim }, 1E30f);
+		FillGrid(grid, dim, lower, upper, 0.5f, [](const float3& pt) {
+			return distance(pt, float3(-1.3f, 2.6f, 0.4f)) - 15.2f + 1.5f * std::sin(0.4f * pt.x) * std::cos(0.3f * pt.y);
+		});
+		Mesh leafMesh;
+		isoSurface.solve(grid, leafMesh, MeshType::Quad, false, 0.0f, false);
+		//The serial hash map path over a dense copy of the grid with a background border is the reference.
+		const int3 origin = lower - int3(1);
+		const int3 dims = upper - lower + int3(2);
+		Volume1f volume(dims.x, dims.y, dims.z);
+		for (int k = 0; k < dims.z; k++) {
+			for (int j = 0; j < dims.y; j++) {
+				for (int i = 0; i < dims.x; i++) {
+					volume(i, j, k).x = grid.getLeafValue(origin.x + i, origin.y + j, origin.z + k);
+				}
+			}
+		}
+		Mesh serialMesh;
+		isoSurface.solve(volume, serialMesh, MeshType::Quad, false, 0.0f);
+		for (float3& pt : serialMesh.vertexLocations) {
+			pt += float3(origin);
+		}
+		ok &= (leafMesh.quadIndexes.size() > 0);
+		ok &= (leafMesh.vertexLocations.size() == serialMesh.vertexLocations.size());
+		ok &= (leafMesh.quadIndexes.size() == serialMesh.quadIndexes.size());
+		if (ok) {
+			std::vector<int> matches = MatchVertices(leafMesh, serialMesh, 1E-4f);
+			std::vector<int> identity(serialMesh.vertexLocations.size());
+			std::vector<uint8_t> used(serialMesh.vertexLocations.size(), 0);
+			for (size_t i = 0; i < matches.size(); i++) {
+				identity[i] = (int) i;
+				ok &= (matches[i] >= 0 && used[matches[i]] == 0);
+				if (matches[i] >= 0)
+					used[matches[i]] = 1;
+			}
+			if (ok) {
+				ok &= (CanonicalQuads(leafMesh, matches) == CanonicalQuads(serialMesh, identity));
+			}
+		}
+		std::cout << "Grid contour " << leafMesh.vertexLocations.size() << " vertices " << leafMesh.quadIndexes.size()
+				<< " quads, serial " << serialMesh.vertexLocations.size() << " vertices " << serialMesh.quadIndexes.size()
+				<< " quads" << std::endl;
+	}
+	//Dual contouring moves the vertices of cells that hold a cube corner onto the corner.
+	{
+		const float3 center(0.37f, -0.42f, 0.21f);
+		const float halfWidth = 6.3f;
+		auto distanceFunc = [&](const float3& pt) {
+			float3 q = abs(pt - center) - float3(halfWidth);
+			return length(max(q, float3(0.0f))) + std::min(std::max(std::max(q.x, q.y), q.z), 0.0f);
+		};
+		auto cornerError = [&](const Mesh& mesh) {
+			float error = 0.0f;
+			for (int c = 0; c < 8; c++) {
+				float3 corner = center + float3((c & 1) ? halfWidth : -halfWidth, (c & 2) ? halfWidth : -halfWidth,
+						(c & 4) ? halfWidth : -halfWidth);
+				float closest = std::numeric_limits<float>::max();
+				for (const float3& pt : mesh.vertexLocations) {
+					closest = std::min(closest, distance(pt, corner));
+				}
+				error = std::max(error, closest);
+			}
+			return error;
+		};
+		//With exact tangent planes the QEF recovers each corner up to clamping the vertex to its cell.
+		std::vector<int3> leafLocations;
+		for (int z = -16; z < 16; z += dim) {
+			for (int y = -16; y < 16; y += dim) {
+				for (int x = -16; x < 16; x += dim) {
+					leafLocations.push_back(int3(x, y, z));
+				}
+			}
+		}
+		Mesh exactMesh;
+		IsoSurface::contourLeaves(leafLocations, dim, [&](size_t n, float* block) {
+			const int3 loc = leafLocations[n];
+			for (int k = 0; k <= dim; k++) {
+				for (int j = 0; j <= dim; j++) {
+					for (int i = 0; i <= dim; i++) {
+						block[i + j * (dim + 1) + k * (dim + 1) * (dim + 1)] = distanceFunc(float3(loc + int3(i, j, k)));
+					}
+				}
+			}
+		}, [&](int i, int j, int k) {
+			return distanceFunc(float3((float) i, (float) j, (float) k));
+		}, [&](float x, float y, float z) {
+			const float h = 1E-3f;
+			float3 pt(x, y, z);
+			return float3(distanceFunc(pt + float3(h, 0.0f, 0.0f)) - distanceFunc(pt - float3(h, 0.0f, 0.0f)),
+					distanceFunc(pt + float3(0.0f, h, 0.0f)) - distanceFunc(pt - float3(0.0f, h, 0.0f)),
+					distanceFunc(pt + float3(0.0f, 0.0f, h)) - distanceFunc(pt - float3(0.0f, 0.0f, h)));
+		}, exactMesh, 0.0f, 1E30f, Winding::Clockwise, true);
+		float exactError = cornerError(exactMesh);
+		ok &= (exactError < 0.15f);
+		//Grid normals are central differences blurred over a voxel, so corners are only pulled part of the way.
+		EndlessGridFloat grid( { 4, dim }, 1E30f);
+		FillGrid(grid, dim, int3(-16), int3(16), 2.0f, distanceFunc);
+		Mesh smoothMesh, sharpMesh;
+		isoSurface.solve(grid, smoothMesh, MeshType::Quad, false, 0.0f, false);
+		isoSurface.solve(grid, sharpMesh, MeshType::Quad, false, 0.0f, true);
+		float smoothError = cornerError(smoothMesh);
+		float sharpError = cornerError(sharpMesh);
+		ok &= (sharpError < 0.6f * smoothError);
+		std::cout << "Cube corner error exact normals " << exactError << " grid smooth " << smoothError << " grid sharp "
+				<< sharpError << std::endl;
+	}
+	std::cout << "Iso-surface grid contour " << (ok ? "passed" : "failed") << std::endl;
+	return ok;
+}
 }
@@ -19,6 +19,7 @@
 * THE SOFTWARE.
 */
 #include "AlloyMeshTextureMap.h"
+#include "AlloyConnectedComponents.h"
 #include "AlloyUnits.h"
 #include "AlloySparseMatrix.h"
 #include "AlloySparseSolve.h"
@@ -27,184 +28,13 @@
 #include <random>
 namespace aly {
 	int GetConnectedTextureComponents(const std::vector<size_t>& indexes, int N, std::vector<int>& cclist, std::vector<int>& labels) {
-		std::vector<std::list<int>> vertNbrs(N);
-		int indexCount = (int)indexes.size();
-		for (int i = 0; i < indexCount; i += 3) {
-			int v1 = (int)indexes[i];
-			int v2 = (int)indexes[i + 1];
-			int v3 = (int)indexes[i + 2];
-			vertNbrs[v1].push_back(v2);
-			vertNbrs[v1].push_back(v3);
-			vertNbrs[v2].push_back(v3);
-			vertNbrs[v2].push_back(v1);
-			vertNbrs[v3].push_back(v1);
-			vertNbrs[v3].push_back(v2);
-		}
-		labels.resize(N, -1);
-		int pivot = 0;
-		int cc = 0;
-		std::list<int> queue;
-
-		cclist.clear();
-		int masked = 0;
-		int ccCount = 0;
-		std::vector<int> nbrs;
-		cclist.clear();
-		do {
-			ccCount = 0;
-			queue.clear();
-			labels[pivot] = cc;
-			ccCount++;
-			queue.push_back(pivot);
-			masked++;
-			int iter = 0;
-			while (queue.size() > 0) {
-				int v = queue.front();
-				queue.pop_front();
-				nbrs.clear();
-				iter++;
-				for (int nbr : vertNbrs[v]) {
-					if (labels[nbr] < 0) {
-						labels[nbr] = cc;
-						ccCount++;
-						masked++;
-						queue.push_back(nbr);
-					}
-				}
-			}
-			cclist.push_back(ccCount);
-			int lastPivot = pivot;
-			pivot = -1;
-			for (int i = lastPivot + 1; i < N; i++) {
-				if (labels[i] < 0) {
-					pivot = i;
-					break;
-				}
-			}
-			cc++;
-		} while (pivot >= 0);
-		return (int)cclist.size();
+		return LabelTriangleComponents(indexes, N, cclist, labels);
 	}
 	int GetConnectedTextureComponents(const std::vector<int>& indexes, int N, std::vector<int>& cclist, std::vector<int>& labels) {
-			std::vector<std::list<int>> vertNbrs(N);
-			int indexCount = (int)indexes.size();
-			for (int i = 0; i < indexCount; i += 3) {
-				int v1 = (int)indexes[i];
-				int v2 = (int)indexes[i + 1];
-				int v3 = (int)indexes[i + 2];
-				vertNbrs[v1].push_back(v2);
-				vertNbrs[v1].push_back(v3);
-				vertNbrs[v2].push_back(v3);
-				vertNbrs[v2].push_back(v1);
-				vertNbrs[v3].push_back(v1);
-				vertNbrs[v3].push_back(v2);
-			}
-			labels.resize(N, -1);
-			int pivot = 0;
-			int cc = 0;
-			std::list<int> queue;
-
-			cclist.clear();
-			int masked = 0;
-			int ccCount = 0;
-			std::vector<int> nbrs;
-			cclist.clear();
-			do {
-				ccCount = 0;
-				queue.clear();
-				labels[pivot] = cc;
-				ccCount++;
-				queue.push_back(pivot);
-				masked++;
-				int iter = 0;
-				while (queue.size() > 0) {
-					int v = queue.front();
-					queue.pop_front();
-					nbrs.clear();
-					iter++;
-					for (int nbr : vertNbrs[v]) {
-						if (labels[nbr] < 0) {
-							labels[nbr] = cc;
-							ccCount++;
-							masked++;
-							queue.push_back(nbr);
-						}
-					}
-				}
-				cclist.push_back(ccCount);
-				int lastPivot = pivot;
-				pivot = -1;
-				for (int i = lastPivot + 1; i < N; i++) {
-					if (labels[i] < 0) {
-						pivot = i;
-						break;
-					}
-				}
-				cc++;
-			} while (pivot >= 0);
-			return (int)cclist.size();
-		}
+		return LabelTriangleComponents(indexes, N, cclist, labels);
+	}
 	int GetConnectedVertexComponents(const aly::Mesh& mesh, std::vector<int>& cclist, std::vector<int>& labels) {
-		int vertexCount = (int)mesh.vertexLocations.size();
-		int faceCount = (int)mesh.triIndexes.size();
-		std::vector<std::list<int>> vertNbrs(vertexCount);
-
-		for (int i = 0; i < faceCount; i++) {
-			uint3 face = mesh.triIndexes[i];
-			int v1 = face.x;
-			int v2 = face.y;
-			int v3 = face.z;
-			vertNbrs[v1].push_back(v2);
-			vertNbrs[v1].push_back(v3);
-			vertNbrs[v2].push_back(v3);
-			vertNbrs[v2].push_back(v1);
-			vertNbrs[v3].push_back(v1);
-			vertNbrs[v3].push_back(v2);
-		}
-		labels.resize(vertexCount, -1);
-		int pivot = 0;
-		int cc = 0;
-		std::list<int> queue;
-
-		cclist.clear();
-		int masked = 0;
-		int ccCount = 0;
-		std::vector<int> nbrs;
-		cclist.clear();
-		do {
-			ccCount = 0;
-			queue.clear();
-			labels[pivot] = cc;
-			ccCount++;
-			queue.push_back(pivot);
-			masked++;
-			int iter = 0;
-			while (queue.size() > 0) {
-				int v = queue.front();
-				queue.pop_front();
-				nbrs.clear();
-				iter++;
-				for (int nbr : vertNbrs[v]) {
-					if (labels[nbr] < 0) {
-						labels[nbr] = cc;
-						ccCount++;
-						masked++;
-						queue.push_back(nbr);
-					}
-				}
-			}
-			cclist.push_back(ccCount);
-			int lastPivot = pivot;
-			pivot = -1;
-			for (int i = lastPivot + 1; i < vertexCount; i++) {
-				if (labels[i] < 0) {
-					pivot = i;
-					break;
-				}
-			}
-			cc++;
-		} while (pivot >= 0);
-		return (int)cclist.size();
+		return LabelTriangleComponents(mesh.triIndexes.data, (int)mesh.vertexLocations.size(), cclist, labels);
 	}
 	int ColorizeMeshTextureRegions(Mesh& mesh){
 		std::vector<int> indexes;
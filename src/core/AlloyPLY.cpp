@@ -28,6 +28,7 @@
 #include <iostream>
 #include <stddef.h>
 #include <memory>
+#include <cstdlib>
 using namespace std;
 namespace aly {
 namespace ply {
@@ -112,7 +113,7 @@ void PLYReaderWriter::addElement(const std::vector<std::string>& words) {
 	/* create the new element */
 	elem = new PlyElement();
 	elem->name = words[1];
-	elem->num = atoi(words[2].c_str());
+	elem->num = (size_t) std::strtoull(words[2].c_str(), nullptr, 10);
 	plyFile->elems.push_back(std::shared_ptr<PlyElement>(elem));
 }
 
@@ -286,7 +287,7 @@ void PLYReaderWriter::describeProperty(const std::string& elem_name,
 
 /******************************************************************************/
 
-void PLYReaderWriter::elementCount(const std::string& elem_name, int nelems)
+void PLYReaderWriter::elementCount(const std::string& elem_name, size_t nelems)
 /******************************************************************************/
 /*
  State how many of a given element will be written.
@@ -590,6 +591,11 @@ void PLYReaderWriter::openForReading(const std::string& fileName,
 
 }
 
+size_t PLYReaderWriter::getElementCount(const std::string& elem_name) {
+	PlyElement* elem = findElement(elem_name);
+	return (elem != nullptr) ? elem->num : 0;
+}
+
 /******************************************************************************
  Get information about a particular element.
 
@@ -610,7 +616,7 @@ std::vector<std::shared_ptr<PlyProperty>> PLYReaderWriter::getElementDescription
 	std::vector<std::shared_ptr<PlyProperty>> prop_list;
 	/* find information about the element */
 	elem = findElement(elem_name);
-	*nelems = elem->num;
+	*nelems = (int)elem->num;
 	*nprops = (int)elem->props.size();
 	if (elem == nullptr)
 		return prop_list;
@@ -1552,7 +1558,7 @@ std::string PLYReaderWriter::setupElementRead(int index, int *elem_count) {
 	plyFile->which_elem = elem;
 
 	/* return the number of such elements in the file and the element's name */
-	*elem_count = elem->num;
+	*elem_count = (int)elem->num;
 	return (elem->name);
 }
 
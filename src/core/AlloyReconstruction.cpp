@@ -38,6 +38,13 @@
 #include "poisson/MemoryUsage.h"
 #include "poisson/Trimmer.h"
 #include <map>
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <chrono>
+#include <iostream>
+#include "AlloyPLY.h"
+#include "AlloyFileUtil.h"
 #ifdef _OPENMP
 #include "omp.h"
 #endif
@@ -46,24 +53,23 @@
 #define DEFAULT_FULL_DEPTH 5
 int echoStdout = 0;
 using namespace aly;
-template<class Real, int Degree, class Vertex, BoundaryType BType> bool ExecuteInternal(const ReconstructionParameters& params, const aly::Mesh& input, aly::Mesh& output,
+template<class Real, int Degree, class Vertex, BoundaryType BType> bool ExecuteInternal(const ReconstructionParameters& params, OrientedPointStreamWithData<float, Point3D<float> >& pointStream, const float4x4& Minv, int coarsen, aly::Mesh& output,
 	const std::function<bool(const std::string& status, float progress)>& monitor)
 {
 	Reset<Real>();
 	Octree<Real> tree;
 	const Real targetValue = (Real)0.5;
 	Real isoValue = 0;
-	const box3f bbox(float3(0.01f, 0.01f, 0.01f), float3(0.99f, 0.99f, 0.99f));
-	float4x4 M = MakeTransform(input.getBoundingBox(), bbox);
-	float4x4 Minv = inverse(M);	
-	int solveDepth = params.MaxSolveDepth.value;
+	int depth = std::max(1, params.Depth.value - coarsen);
+	int solveDepth = std::max(1, params.MaxSolveDepth.value - coarsen);
+	int fullDepth = std::min(params.FullDepth.value, depth);
 	tree.threads = params.Threads.value;
 	if (monitor)monitor("Initializing", 0.01f);
 	OctNode<TreeNodeData>::SetAllocator(MEMORY_ALLOCATOR_BLOCK_SIZE);
-	int kernelDepth = params.KernelDepth.set ? params.KernelDepth.value : params.Depth.value - 2;
-	if (kernelDepth > params.Depth.value)
+	int kernelDepth = params.KernelDepth.set ? std::max(1, params.KernelDepth.value - coarsen) : depth - 2;
+	if (kernelDepth > depth)
 	{
-		kernelDepth = params.Depth.value;
+		kernelDepth = depth;
 	}
 	typedef ProjectiveData<Point3D<Real>,Real > ProjectiveColor;
 	typedef typename Octree< Real >::template DensityEstimator< WEIGHT_DEGREE > DensityEstimator;
@@ -80,9 +86,14 @@ template<class Real, int Degree, class Vertex, BoundaryType BType> bool ExecuteI
 		int pointCount = 0;
 		{
 			if (monitor)monitor("Building Oct-Tree", 0.1f);
-			AlloyPointStream pointStream(M,input);
-			pointCount = tree.template init< Point3D< Real > >(pointStream, params.Depth.value, params.Confidence.set, samples, &sampleData);
-
+			pointStream.reset();
+			pointCount = tree.template init< Point3D< Real > >(pointStream, depth, params.Confidence.set, samples, &sampleData);
+		}
+		if (pointCount == 0)
+		{
+			output.clear();
+			OctNode<TreeNodeData>::ResetAllocator();
+			return false;
 		}
 		Real pointWeightSum;
 		density.reset(tree.template setDensityEstimator< WEIGHT_DEGREE >(samples, kernelDepth, params.SamplesPerNode.value));
@@ -91,7 +102,7 @@ template<class Real, int Degree, class Vertex, BoundaryType BType> bool ExecuteI
 			if (monitor)monitor("Initializing Multi-grid", 0.2f);
 			std::vector< int > indexMap;
 			constexpr int MAX_DEGREE = NORMAL_DEGREE > Degree ? NORMAL_DEGREE : Degree;
-			tree.template inalizeForBroodedMultigrid< MAX_DEGREE, Degree, BType >(params.FullDepth.value, typename Octree< Real >::template HasNormalDataFunctor< NORMAL_DEGREE >(normalInfo), &indexMap);
+			tree.template inalizeForBroodedMultigrid< MAX_DEGREE, Degree, BType >(fullDepth, typename Octree< Real >::template HasNormalDataFunctor< NORMAL_DEGREE >(normalInfo), &indexMap);
 			normalInfo.remapIndices(indexMap);
 			if (density.get()) density->remapIndices(indexMap);
 		}
@@ -175,6 +186,12 @@ template<class Real, int Degree, class Vertex, BoundaryType BType> bool ExecuteI
 		}
 	}
 
+	if (vertices.size() == 0)
+	{
+		output.clear();
+		OctNode<TreeNodeData>::ResetAllocator();
+		return false;
+	}
 	for (int i = 0; i < params.Smooth.value; i++)
 	{
 		SmoothValues<float, Vertex>(vertices, polygons);
@@ -342,45 +359,558 @@ bool AlloyPointStream::nextPoint(OrientedPoint3D<float>& p, Point3D<float>& d)
 	counter++;
 	return true;
 }
-template<class Real, int Degree, class Vertex> bool ExecuteInternal(const ReconstructionParameters& params, const aly::Mesh& input, aly::Mesh& output, const BoundaryType& BType, const std::function<bool(const std::string& status, float progress)>& monitor)
+PlyPointStream::PlyPointStream(const std::string& file, const float4x4& M) :file(file), M(M), counter(0), count(0), hasNormals(false), hasColors(false) {
+	open();
+}
+PlyPointStream::~PlyPointStream() {
+}
+void PlyPointStream::open() {
+	using namespace aly::ply;
+	ply.reset(new PLYReaderWriter());
+	ply->openForReading(file);
+	PlyElement *elem;
+	int index;
+	if ((elem = ply->findElement("vertex")) == nullptr
+		|| ply->findProperty(elem, "x", &index) == nullptr
+		|| ply->findProperty(elem, "y", &index) == nullptr
+		|| ply->findProperty(elem, "z", &index) == nullptr) {
+		throw std::runtime_error(MakeString() << "Could not read points [" << file << "]");
+	}
+	hasNormals = (ply->findProperty(elem, "nx", &index) != nullptr
+		&& ply->findProperty(elem, "ny", &index) != nullptr
+		&& ply->findProperty(elem, "nz", &index) != nullptr);
+	hasColors = (ply->findProperty(elem, "red", &index) != nullptr
+		&& ply->findProperty(elem, "green", &index) != nullptr
+		&& ply->findProperty(elem, "blue", &index) != nullptr);
+	if (!hasNormals) {
+		throw std::runtime_error(MakeString() << "Points must have normals for reconstruction [" << file << "]");
+	}
+	std::vector<std::string> elist = ply->getElementNames();
+	if (elist.size() == 0 || elist[0] != "vertex") {
+		throw std::runtime_error(MakeString() << "Vertex element must be first to stream points [" << file << "]");
+	}
+	ply->getProperty("vertex", &MeshVertProps[0]);
+	ply->getProperty("vertex", &MeshVertProps[1]);
+	ply->getProperty("vertex", &MeshVertProps[2]);
+	ply->getProperty("vertex", &MeshVertProps[3]);
+	ply->getProperty("vertex", &MeshVertProps[4]);
+	ply->getProperty("vertex", &MeshVertProps[5]);
+	if (hasColors) {
+		ply->getProperty("vertex", &MeshVertProps[9]);
+		ply->getProperty("vertex", &MeshVertProps[10]);
+		ply->getProperty("vertex", &MeshVertProps[11]);
+	}
+	count = ply->getElementCount("vertex");
+	counter = 0;
+}
+void PlyPointStream::reset(void) {
+	open();
+}
+bool PlyPointStream::nextPoint(OrientedPoint3D<float>& p, Point3D<float>& d)
+{
+	if (counter >= count)
+		return false;
+	aly::ply::plyVertex vertex;
+	ply->getElement(&vertex);
+	float3 v = Transform(M, float3(vertex.x[0], vertex.x[1], vertex.x[2]));
+	p.p = Point3D<float>(v.x, v.y, v.z);
+	p.n = Point3D<float>(vertex.n[0], vertex.n[1], vertex.n[2]);
+	if (hasColors) {
+		d = Point3D<float>(vertex.red, vertex.green, vertex.blue);
+	}
+	else {
+		d = Point3D<float>(255.0f, 255.0f, 255.0f);
+	}
+	counter++;
+	return true;
+}
+BinaryPointStream::BinaryPointStream(const std::string& file, const float4x4& M) :file(file), fp(nullptr), M(M), buffer(9 * POINT_BUFFER_SIZE), index(0), loaded(0) {
+	fp = fopen(file.c_str(), "rb");
+	if (fp == nullptr) {
+		throw std::runtime_error(MakeString() << "Could not open " << file << " for reading.");
+	}
+}
+BinaryPointStream::~BinaryPointStream() {
+	if (fp != nullptr) {
+		fclose(fp);
+		fp = nullptr;
+	}
+}
+void BinaryPointStream::reset(void) {
+	fseek(fp, 0, SEEK_SET);
+	index = loaded = 0;
+}
+bool BinaryPointStream::nextPoint(OrientedPoint3D<float>& p, Point3D<float>& d)
+{
+	if (index >= loaded) {
+		index = 0;
+		loaded = fread(buffer.data(), 9 * sizeof(float), POINT_BUFFER_SIZE, fp);
+		if (loaded == 0)
+			return false;
+	}
+	const float* rec = &buffer[9 * index++];
+	float3 v = Transform(M, float3(rec[0], rec[1], rec[2]));
+	p.p = Point3D<float>(v.x, v.y, v.z);
+	p.n = Point3D<float>(rec[3], rec[4], rec[5]);
+	d = Point3D<float>(255.0f * rec[6], 255.0f * rec[7], 255.0f * rec[8]);
+	return true;
+}
+//Applies a similarity transform to points from another stream, used to map streamed input into the unit cube.
+class TransformedPointStream : public OrientedPointStreamWithData<float, Point3D< float> >
+{
+protected:
+	OrientedPointStreamWithData<float, Point3D< float> >& stream;
+	float4x4 M;
+public:
+	TransformedPointStream(OrientedPointStreamWithData<float, Point3D< float> >& stream, const float4x4& M) :stream(stream), M(M) {
+	}
+	void reset(void) override {
+		stream.reset();
+	}
+	virtual bool nextPoint(OrientedPoint3D< float >& p, Point3D< float >& d) override {
+		if (!stream.nextPoint(p, d))
+			return false;
+		float3 v = Transform(M, float3(p.p[0], p.p[1], p.p[2]));
+		p.p = Point3D<float>(v.x, v.y, v.z);
+		return true;
+	}
+};
+template<class Real, int Degree, class Vertex> bool ExecuteInternal(const ReconstructionParameters& params, OrientedPointStreamWithData<float, Point3D<float> >& pointStream, const float4x4& Minv, int coarsen, aly::Mesh& output, const BoundaryType& BType, const std::function<bool(const std::string& status, float progress)>& monitor)
 {
 	switch (params.BType.value)
 	{
 	case BoundaryType::BOUNDARY_FREE:
-		return ExecuteInternal<float, 1, PlyColorAndValueVertex<float>, BoundaryType::BOUNDARY_FREE>(params, input, output, monitor);
+		return ExecuteInternal<float, 1, PlyColorAndValueVertex<float>, BoundaryType::BOUNDARY_FREE>(params, pointStream, Minv, coarsen, output, monitor);
 		break;
 	case BoundaryType::BOUNDARY_DIRICHLET:
-		return ExecuteInternal<float, 2, PlyColorAndValueVertex<float>, BoundaryType::BOUNDARY_DIRICHLET>(params, input, output, monitor);
+		return ExecuteInternal<float, 2, PlyColorAndValueVertex<float>, BoundaryType::BOUNDARY_DIRICHLET>(params, pointStream, Minv, coarsen, output, monitor);
 		break;
 	case BoundaryType::BOUNDARY_NEUMANN:
-		return ExecuteInternal<float, 3, PlyColorAndValueVertex<float>, BoundaryType::BOUNDARY_NEUMANN>(params, input, output, monitor);
+		return ExecuteInternal<float, 3, PlyColorAndValueVertex<float>, BoundaryType::BOUNDARY_NEUMANN>(params, pointStream, Minv, coarsen, output, monitor);
 		break;
 	case BoundaryType::BOUNDARY_COUNT:
-		return ExecuteInternal<float, 4, PlyColorAndValueVertex<float>, BoundaryType::BOUNDARY_COUNT>(params, input, output, monitor);
+		return ExecuteInternal<float, 4, PlyColorAndValueVertex<float>, BoundaryType::BOUNDARY_COUNT>(params, pointStream, Minv, coarsen, output, monitor);
 		break;
 	default:
 		throw std::runtime_error("Boundary type not supported.");
 	}
 	return false;
 }
-void SurfaceReconstruct(const ReconstructionParameters& params, const aly::Mesh& input, aly::Mesh& output, const std::function<bool(const std::string& status, float progress)>& monitor)
+static bool Reconstruct(const ReconstructionParameters& params, OrientedPointStreamWithData<float, Point3D<float> >& pointStream, const float4x4& Minv, int coarsen, aly::Mesh& output, const std::function<bool(const std::string& status, float progress)>& monitor)
 {
 	BoundaryType BType = static_cast<BoundaryType>(params.BType.value);
 	switch (params.Degree.value)
 	{
 	case 1:
-		ExecuteInternal<float, 1,PlyColorAndValueVertex<float> >(params, input, output, BType, monitor);
-		break;
+		return ExecuteInternal<float, 1, PlyColorAndValueVertex<float> >(params, pointStream, Minv, coarsen, output, BType, monitor);
 	case 2:
-		ExecuteInternal<float, 2, PlyColorAndValueVertex<float> >(params, input, output, BType, monitor);
-		break;
+		return ExecuteInternal<float, 2, PlyColorAndValueVertex<float> >(params, pointStream, Minv, coarsen, output, BType, monitor);
 	case 3:
-		ExecuteInternal<float, 3, PlyColorAndValueVertex<float> >(params, input, output, BType, monitor);
-		break;
+		return ExecuteInternal<float, 3, PlyColorAndValueVertex<float> >(params, pointStream, Minv, coarsen, output, BType, monitor);
 	case 4:
-		ExecuteInternal<float, 4, PlyColorAndValueVertex<float> >(params, input, output, BType, monitor);
-		break;
+		return ExecuteInternal<float, 4, PlyColorAndValueVertex<float> >(params, pointStream, Minv, coarsen, output, BType, monitor);
 	default:
 		throw std::runtime_error("Degree not supported.");
 	}
-}
\ No newline at end of file
+	return false;
+}
+void SurfaceReconstruct(const ReconstructionParameters& params, const aly::Mesh& input, aly::Mesh& output, const std::function<bool(const std::string& status, float progress)>& monitor)
+{
+	const box3f bbox(float3(0.01f, 0.01f, 0.01f), float3(0.99f, 0.99f, 0.99f));
+	float4x4 M = MakeTransform(input.getBoundingBox(), bbox);
+	AlloyPointStream pointStream(M, input);
+	Reconstruct(params, pointStream, inverse(M), 0, output, monitor);
+}
+//Peak octree, sample and solver footprint per input point at default settings, used to turn MemoryBudget into a point count.
+static const size_t RECONSTRUCTION_BYTES_PER_POINT = 2048;
+//Resolution of the occupancy histogram used to choose the block size.
+static const int RECONSTRUCTION_GRID = 64;
+//Block files live in a directory next to the output that is removed with its contents however reconstruction ends.
+struct BlockDirectory {
+	std::string path;
+	BlockDirectory(const std::string& path) :path(path) {
+		MakeDirectory(path);
+	}
+	~BlockDirectory() {
+		RemoveDirectoryRecursive(path);
+	}
+};
+typedef std::unique_ptr<FILE, int(*)(FILE*)> BlockFilePtr;
+static BlockFilePtr OpenBlockFile(const std::string& file, const char* mode) {
+	BlockFilePtr f(fopen(file.c_str(), mode), &fclose);
+	if (f.get() == nullptr) {
+		throw std::runtime_error(MakeString() << "Could not open " << file << ".");
+	}
+	return f;
+}
+//Largest number of points that fall into any padded block when the grid is split into n blocks per axis.
+static size_t MaxBlockPoints(const std::vector<uint64_t>& table, int G, int n, float padding) {
+	int cells = G / n;
+	int pad = (int)std::ceil(padding * cells);
+	int G1 = G + 1;
+	size_t maxCount = 0;
+	for (int k = 0; k < n; k++) {
+		int z0 = std::max(k * cells - pad, 0), z1 = std::min((k + 1) * cells + pad, G);
+		for (int j = 0; j < n; j++) {
+			int y0 = std::max(j * cells - pad, 0), y1 = std::min((j + 1) * cells + pad, G);
+			for (int i = 0; i < n; i++) {
+				int x0 = std::max(i * cells - pad, 0), x1 = std::min((i + 1) * cells + pad, G);
+				auto T = [&](int x, int y, int z) {return (int64_t)table[x + G1 * (y + G1 * z)]; };
+				int64_t count = T(x1, y1, z1) - T(x0, y1, z1) - T(x1, y0, z1) - T(x1, y1, z0)
+					+ T(x0, y0, z1) + T(x0, y1, z0) + T(x1, y0, z0) - T(x0, y0, z0);
+				maxCount = std::max(maxCount, (size_t)count);
+			}
+		}
+	}
+	return maxCount;
+}
+void SurfaceReconstruct(const ReconstructionParameters& params, OrientedPointStreamWithData<float, Point3D< float> >& input, const std::string& outputFile,
+	const std::function<bool(const std::string& status, float progress)>& monitor)
+{
+	using namespace aly::ply;
+	const box3f bbox(float3(0.01f, 0.01f, 0.01f), float3(0.99f, 0.99f, 0.99f));
+	OrientedPoint3D<float> p;
+	Point3D<float> d;
+	if (monitor)monitor("Scanning Points", 0.0f);
+	float3 minPt(std::numeric_limits<float>::max());
+	float3 maxPt(-std::numeric_limits<float>::max());
+	size_t pointCount = 0;
+	input.reset();
+	while (input.nextPoint(p, d)) {
+		float3 v(p.p[0], p.p[1], p.p[2]);
+		minPt = aly::min(minPt, v);
+		maxPt = aly::max(maxPt, v);
+		pointCount++;
+	}
+	if (pointCount == 0) {
+		throw std::runtime_error("No points to reconstruct.");
+	}
+	size_t budget = (size_t)std::max(params.MemoryBudget.value, 0) * 1024 * 1024;
+	size_t budgetPoints = std::max(budget / RECONSTRUCTION_BYTES_PER_POINT, (size_t)1);
+	if (budget == 0 || pointCount <= budgetPoints) {
+		float4x4 M = MakeTransform(box3f(minPt, maxPt - minPt), bbox);
+		TransformedPointStream pointStream(input, M);
+		Mesh mesh;
+		Reconstruct(params, pointStream, inverse(M), 0, mesh, monitor);
+		WritePlyMeshToFile(outputFile, mesh, true);
+		return;
+	}
+	const int G = RECONSTRUCTION_GRID;
+	const int G1 = G + 1;
+	const float padding = std::max(params.BlockPadding.value, 0.0f);
+	const float side = std::max(aly::max(maxPt - minPt), 1E-6f);
+	auto cellOf = [&](const float3& v, int k) {
+		return aly::clamp((int)((v[k] - minPt[k]) * G / side), 0, G - 1);
+	};
+	//Summed area table of the point occupancy, so block populations can be estimated without another pass per candidate size.
+	if (monitor)monitor("Estimating Blocks", 0.05f);
+	std::vector<uint64_t> table(G1 * G1 * G1, 0);
+	input.reset();
+	while (input.nextPoint(p, d)) {
+		float3 v(p.p[0], p.p[1], p.p[2]);
+		table[cellOf(v, 0) + 1 + G1 * (cellOf(v, 1) + 1 + G1 * (cellOf(v, 2) + 1))]++;
+	}
+	for (int z = 1; z < G1; z++) {
+		for (int y = 1; y < G1; y++) {
+			for (int x = 1; x < G1; x++) {
+				table[x + G1 * (y + G1 * z)] += table[x - 1 + G1 * (y + G1 * z)];
+			}
+			for (int x = 1; x < G1; x++) {
+				table[x + G1 * (y + G1 * z)] += table[x + G1 * (y - 1 + G1 * z)];
+			}
+		}
+		for (int y = 1; y < G1; y++) {
+			for (int x = 1; x < G1; x++) {
+				table[x + G1 * (y + G1 * z)] += table[x + G1 * (y + G1 * (z - 1))];
+			}
+		}
+	}
+	int n = 2;
+	int levels = 1;
+	while (n < G && MaxBlockPoints(table, G, n, padding) > budgetPoints) {
+		n *= 2;
+		levels++;
+	}
+	table.clear();
+	table.shrink_to_fit();
+	const float blockWidth = side / n;
+	const float padWidth = padding * blockWidth;
+	int3 dims;
+	for (int k = 0; k < 3; k++) {
+		dims[k] = aly::clamp((int)std::ceil((maxPt[k] - minPt[k]) / blockWidth), 1, n);
+	}
+	const int blockCount = dims.x * dims.y * dims.z;
+	BlockDirectory blockDir(GetFileWithoutExtension(outputFile) + "_blocks");
+	const std::string& tempDir = blockDir.path;
+	auto blockFile = [&](int b) {
+		return ConcatPath(tempDir, MakeString() << "block" << b << ".bin");
+	};
+	//Bucket points into padded blocks on disk. Buffers are flushed together so memory stays within a fraction of the budget.
+	if (monitor)monitor("Partitioning Points", 0.1f);
+	{
+		const size_t bufferLimit = aly::clamp(budget / 4, (size_t)(1 << 20), (size_t)(256 << 20)) / sizeof(float);
+		std::vector<std::vector<float>> buffers(blockCount);
+		std::vector<char> created(blockCount, 0);
+		size_t buffered = 0;
+		auto flush = [&]() {
+			for (int b = 0; b < blockCount; b++) {
+				std::vector<float>& buffer = buffers[b];
+				if (buffer.size() == 0)
+					continue;
+				BlockFilePtr f = OpenBlockFile(blockFile(b), created[b] ? "ab" : "wb");
+				fwrite(buffer.data(), sizeof(float), buffer.size(), f.get());
+				created[b] = 1;
+				std::vector<float>().swap(buffer);
+			}
+			buffered = 0;
+		};
+		input.reset();
+		while (input.nextPoint(p, d)) {
+			float3 v(p.p[0], p.p[1], p.p[2]);
+			int3 lo, hi;
+			for (int k = 0; k < 3; k++) {
+				lo[k] = aly::clamp((int)std::floor((v[k] - minPt[k] - padWidth) / blockWidth), 0, dims[k] - 1);
+				hi[k] = aly::clamp((int)std::floor((v[k] - minPt[k] + padWidth) / blockWidth), 0, dims[k] - 1);
+			}
+			const float rec[9] = { v.x, v.y, v.z, p.n[0], p.n[1], p.n[2], d[0] / 255.0f, d[1] / 255.0f, d[2] / 255.0f };
+			for (int z = lo.z; z <= hi.z; z++) {
+				for (int y = lo.y; y <= hi.y; y++) {
+					for (int x = lo.x; x <= hi.x; x++) {
+						std::vector<float>& buffer = buffers[x + dims.x * (y + dims.y * z)];
+						buffer.insert(buffer.end(), rec, rec + 9);
+						buffered += 9;
+					}
+				}
+			}
+			if (buffered >= bufferLimit) {
+				flush();
+			}
+		}
+		flush();
+		for (int b = 0; b < blockCount; b++) {
+			if (!created[b])
+				RemoveFile(blockFile(b));
+		}
+	}
+	//Reconstruct each block and append the triangles centered in its core to the output element files.
+	std::string vertexFile = ConcatPath(tempDir, "vertexes.bin");
+	std::string faceFile = ConcatPath(tempDir, "faces.bin");
+	BlockFilePtr vertexOut = OpenBlockFile(vertexFile, "wb");
+	BlockFilePtr faceOut = OpenBlockFile(faceFile, "wb");
+	size_t vertexCount = 0, faceCount = 0;
+	for (int b = 0; b < blockCount; b++) {
+		std::string file = blockFile(b);
+		if (!FileExists(file))
+			continue;
+		int3 bi(b % dims.x, (b / dims.x) % dims.y, b / (dims.x * dims.y));
+		float3 coreMin = minPt + float3(bi) * blockWidth;
+		float3 coreMax = coreMin + float3(blockWidth);
+		for (int k = 0; k < 3; k++) {
+			if (bi[k] == 0)coreMin[k] = -std::numeric_limits<float>::max();
+			if (bi[k] == dims[k] - 1)coreMax[k] = std::numeric_limits<float>::max();
+		}
+		box3f padded(minPt + float3(bi) * blockWidth - float3(padWidth), float3(blockWidth + 2 * padWidth));
+		float4x4 M = MakeTransform(padded, bbox);
+		Mesh mesh;
+		{
+			BinaryPointStream pointStream(file, M);
+			float start = 0.2f + 0.75f * b / (float)blockCount;
+			float range = 0.75f / (float)blockCount;
+			Reconstruct(params, pointStream, inverse(M), levels, mesh, [&](const std::string& status, float progress) {
+				return (monitor) ? monitor(MakeString() << "Block " << (b + 1) << "/" << blockCount << " " << status, start + range * progress) : true;
+			});
+		}
+		RemoveFile(file);
+		std::vector<int> remap(mesh.vertexLocations.size(), -1);
+		auto inside = [&](const float3& c) {
+			return (c.x >= coreMin.x && c.y >= coreMin.y && c.z >= coreMin.z && c.x < coreMax.x && c.y < coreMax.y && c.z < coreMax.z);
+		};
+		auto emit = [&](const uint32_t* face, int N) {
+			int rec[5] = { N, 0, 0, 0, 0 };
+			for (int n = 0; n < N; n++) {
+				int& v = remap[face[n]];
+				if (v < 0) {
+					plyVertex vert;
+					float3 pt = mesh.vertexLocations[face[n]];
+					float3 nm = mesh.vertexNormals[face[n]];
+					float4 c = mesh.vertexColors[face[n]];
+					vert.x[0] = pt.x; vert.x[1] = pt.y; vert.x[2] = pt.z;
+					vert.n[0] = nm.x; vert.n[1] = nm.y; vert.n[2] = nm.z;
+					vert.red = (unsigned char)aly::clamp(c.x * 255.0f, 0.0f, 255.0f);
+					vert.green = (unsigned char)aly::clamp(c.y * 255.0f, 0.0f, 255.0f);
+					vert.blue = (unsigned char)aly::clamp(c.z * 255.0f, 0.0f, 255.0f);
+					fwrite(&vert, sizeof(plyVertex), 1, vertexOut.get());
+					v = (int)(vertexCount++);
+				}
+				rec[n + 1] = v;
+			}
+			fwrite(rec, sizeof(rec), 1, faceOut.get());
+			faceCount++;
+		};
+		for (const uint3& tri : mesh.triIndexes) {
+			if (inside((mesh.vertexLocations[tri.x] + mesh.vertexLocations[tri.y] + mesh.vertexLocations[tri.z]) / 3.0f)) {
+				emit(&tri.x, 3);
+			}
+		}
+		for (const uint4& quad : mesh.quadIndexes) {
+			if (inside(0.25f * (mesh.vertexLocations[quad.x] + mesh.vertexLocations[quad.y] + mesh.vertexLocations[quad.z] + mesh.vertexLocations[quad.w]))) {
+				emit(&quad.x, 4);
+			}
+		}
+	}
+	vertexOut.reset();
+	faceOut.reset();
+	if (monitor)monitor("Writing Mesh", 0.95f);
+	{
+		std::vector<std::string> elemNames = { "vertex", "face" };
+		PLYReaderWriter ply;
+		ply.openForWriting(outputFile, elemNames, FileFormat::BINARY_LE);
+		ply.elementCount("vertex", vertexCount);
+		for (int i : {0, 1, 2, 3, 4, 5, 9, 10, 11}) {
+			ply.describeProperty("vertex", &MeshVertProps[i]);
+		}
+		ply.elementCount("face", faceCount);
+		ply.describeProperty("face", &MeshFaceProps[0]);
+		ply.appendComment("PLY File");
+		ply.appendObjInfo("ImageSci");
+		ply.headerComplete();
+		ply.putElementSetup("vertex");
+		BlockFilePtr f = OpenBlockFile(vertexFile, "rb");
+		plyVertex vert;
+		for (size_t i = 0; i < vertexCount && fread(&vert, sizeof(plyVertex), 1, f.get()) == 1; i++) {
+			ply.putElement(&vert);
+		}
+		ply.putElementSetup("face");
+		f = OpenBlockFile(faceFile, "rb");
+		plyFace face;
+		int rec[5];
+		face.verts = rec + 1;
+		for (size_t i = 0; i < faceCount && fread(rec, sizeof(rec), 1, f.get()) == 1; i++) {
+			face.nverts = (unsigned char)rec[0];
+			ply.putElement(&face);
+		}
+	}
+	if (monitor)monitor("Done", 1.0f);
+}
+void SurfaceReconstruct(const ReconstructionParameters& params, const std::string& inputFile, const std::string& outputFile,
+	const std::function<bool(const std::string& status, float progress)>& monitor)
+{
+	std::string ext = GetFileExtension(inputFile);
+	std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+	if (ext == "ply") {
+		PlyPointStream pointStream(inputFile);
+		SurfaceReconstruct(params, pointStream, outputFile, monitor);
+	}
+	else {
+		BinaryPointStream pointStream(inputFile);
+		SurfaceReconstruct(params, pointStream, outputFile, monitor);
+	}
+}
+static float SurfaceArea(const Mesh& mesh) {
+	float area = 0.0f;
+	for (const uint3& tri : mesh.triIndexes) {
+		area += 0.5f * length(cross(mesh.vertexLocations[tri.y] - mesh.vertexLocations[tri.x], mesh.vertexLocations[tri.z] - mesh.vertexLocations[tri.x]));
+	}
+	for (const uint4& quad : mesh.quadIndexes) {
+		area += 0.5f * length(cross(mesh.vertexLocations[quad.z] - mesh.vertexLocations[quad.x], mesh.vertexLocations[quad.w] - mesh.vertexLocations[quad.y]));
+	}
+	return area;
+}
+bool aly::SANITY_CHECK_RECONSTRUCTION() {
+	const float3 center(0.5f, 0.2f, -0.3f);
+	const float radius = 1.0f;
+	const int N = 1500;
+	std::string dir = ConcatPath(GetCurrentWorkingDirectory(), MakeString() << "reconstruction_"
+		<< std::chrono::steady_clock::now().time_since_epoch().count() << "_" << std::random_device()());
+	MakeDirectory(dir);
+	//Oriented samples of a sphere. Colors are multiples of 1/255 so the PLY and binary inputs hold the same values.
+	Mesh points;
+	std::mt19937 rng(1217);
+	std::normal_distribution<float> gaussian(0.0f, 1.0f);
+	for (int i = 0; i < N; i++) {
+		float3 n = normalize(float3(gaussian(rng), gaussian(rng), gaussian(rng)));
+		points.vertexLocations.push_back(center + radius * n);
+		points.vertexNormals.push_back(n);
+		points.vertexColors.push_back(float4(std::floor(127.5f * (n.x + 1.0f)) / 255.0f, std::floor(127.5f * (n.y + 1.0f)) / 255.0f, 1.0f, 1.0f));
+	}
+	std::string plyFile = ConcatPath(dir, "points.ply");
+	std::string binFile = ConcatPath(dir, "points.bin");
+	WritePlyMeshToFile(plyFile, points, true);
+	{
+		BlockFilePtr f = OpenBlockFile(binFile, "wb");
+		for (int i = 0; i < N; i++) {
+			float3 v = points.vertexLocations[i], n = points.vertexNormals[i];
+			float4 c = points.vertexColors[i];
+			const float rec[9] = { v.x, v.y, v.z, n.x, n.y, n.z, c.x, c.y, c.z };
+			fwrite(rec, sizeof(rec), 1, f.get());
+		}
+	}
+	bool ok = true;
+	Mesh inCore, blockedPly, blockedBin;
+	try {
+		ReconstructionParameters params;
+		params.Depth.value = 6;
+		params.FullDepth.value = 3;
+		params.MemoryBudget.value = 0;
+		SurfaceReconstruct(params, plyFile, ConcatPath(dir, "in_core.ply"));
+		//One megabyte holds a few hundred points, so both inputs take the blocked path.
+		params.MemoryBudget.value = 1;
+		int blocks = 0;
+		auto monitor = [&blocks](const std::string& status, float) {
+			if (status.find("Block") == 0)
+				blocks++;
+			return true;
+		};
+		SurfaceReconstruct(params, plyFile, ConcatPath(dir, "blocked_ply.ply"), monitor);
+		ok &= (blocks > 0);
+		blocks = 0;
+		SurfaceReconstruct(params, binFile, ConcatPath(dir, "blocked_bin.ply"), monitor);
+		ok &= (blocks > 0);
+		ok &= !FileExists(ConcatPath(dir, "blocked_ply_blocks")) && !FileExists(ConcatPath(dir, "blocked_bin_blocks"));
+		ReadPlyMeshFromFile(ConcatPath(dir, "in_core.ply"), inCore);
+		ReadPlyMeshFromFile(ConcatPath(dir, "blocked_ply.ply"), blockedPly);
+		ReadPlyMeshFromFile(ConcatPath(dir, "blocked_bin.ply"), blockedBin);
+	}
+	catch (std::exception& e) {
+		std::cerr << "Reconstruction failed: " << e.what() << std::endl;
+		ok = false;
+	}
+	RemoveDirectoryRecursive(dir);
+	if (!ok)
+		return false;
+	//Both inputs carry the same points, so the blocked surfaces match and their colors agree up to rounding.
+	ok &= (blockedPly.vertexLocations.size() == blockedBin.vertexLocations.size() && blockedPly.vertexLocations.size() > 0);
+	float colorError = 0.0f;
+	for (size_t i = 0; ok && i < blockedPly.vertexLocations.size(); i++) {
+		ok &= (blockedPly.vertexLocations[i] == blockedBin.vertexLocations[i]);
+		colorError = std::max(colorError, aly::max(aly::abs(blockedPly.vertexColors[i] - blockedBin.vertexColors[i])));
+	}
+	ok &= (colorError <= 1.5f / 255.0f);
+	auto radialError = [&](const Mesh& mesh) {
+		double sum = 0.0;
+		for (const float3& v : mesh.vertexLocations) {
+			sum += std::abs(distance(v, center) - radius);
+		}
+		return (float)(sum / std::max(mesh.vertexLocations.size(), (size_t)1));
+	};
+	auto meanColor = [&](const Mesh& mesh) {
+		float4 sum(0.0f);
+		for (const float4& c : mesh.vertexColors) {
+			sum += c;
+		}
+		return sum / (float)std::max(mesh.vertexColors.size(), (size_t)1);
+	};
+	float inCoreError = radialError(inCore);
+	float blockedError = radialError(blockedPly);
+	const float sphereArea = 4.0f * ALY_PI * radius * radius;
+	float inCoreArea = SurfaceArea(inCore) / sphereArea;
+	float blockedArea = SurfaceArea(blockedPly) / sphereArea;
+	float colorDifference = aly::max(aly::abs(meanColor(blockedPly) - meanColor(inCore)));
+	ok &= (inCoreError < 0.02f && blockedError < 0.02f);
+	//Blocks are solved at about the same voxel size, but are faceted differently from the single solve.
+	ok &= (std::abs(inCoreArea - 1.0f) < 0.1f && std::abs(blockedArea - 1.0f) < 0.1f && std::abs(blockedArea / inCoreArea - 1.0f) < 0.1f);
+	ok &= (colorDifference < 0.02f);
+	std::cout << "Reconstruction radial error in core " << inCoreError << " blocked " << blockedError << " relative area in core " << inCoreArea << " blocked " << blockedArea
+		<< " color difference " << colorDifference << " " << (ok ? "passed" : "failed") << std::endl;
+	return ok;
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright(C) 2018, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "AlloyResample.h"
+#include <emmintrin.h>
+#include <cstring>
+namespace aly {
+namespace detail {
+//Pixels are loaded into the first lanes of a register, the remaining lanes are ignored.
+inline __m128 LoadRGB(const ubyte3* pix) {
+	int32_t v;
+	std::memcpy(&v, pix, 4);
+	const __m128i zero = _mm_setzero_si128();
+	return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(v), zero), zero));
+}
+//Reads the byte before the pixel instead of after it, so the last pixel of an image is never read past.
+inline __m128 LoadRGBRight(const ubyte3* pix) {
+	uint32_t v;
+	std::memcpy(&v, reinterpret_cast<const uint8_t*>(pix) - 1, 4);
+	const __m128i zero = _mm_setzero_si128();
+	return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128((int32_t) (v >> 8)), zero), zero));
+}
+inline __m128 LoadRGBA(const ubyte4* pix) {
+	int32_t v;
+	std::memcpy(&v, pix, 4);
+	const __m128i zero = _mm_setzero_si128();
+	return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(v), zero), zero));
+}
+inline int32_t PackBytes(__m128 v) {
+	v = _mm_add_ps(_mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f));
+	__m128i q = _mm_cvttps_epi32(v);
+	q = _mm_packs_epi32(q, q);
+	return _mm_cvtsi128_si32(_mm_packus_epi16(q, q));
+}
+/*
+ * Same expression and order of operations as Image::operator()(float,float),
+ * so results match the scalar path exactly.
+ */
+inline __m128 Bilinear(__m128 rgb00, __m128 rgb10, __m128 rgb01, __m128 rgb11, float dx, float dy) {
+	const __m128 one = _mm_set1_ps(1.0f);
+	__m128 wx = _mm_set1_ps(dx), wy = _mm_set1_ps(dy);
+	__m128 ix = _mm_sub_ps(one, wx), iy = _mm_sub_ps(one, wy);
+	return _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(rgb00, ix), _mm_mul_ps(rgb10, wx)), iy),
+			_mm_mul_ps(_mm_add_ps(_mm_mul_ps(rgb01, ix), _mm_mul_ps(rgb11, wx)), wy));
+}
+template<class T, class Func> inline void SampleBilinearSpan(const T* data, int width, const float2* coords, int count, const Func& func) {
+	for (int n = 0; n < count; n++) {
+		//Interior coordinates are non-negative, so truncation is floor.
+		int i = (int) coords[n].x;
+		int j = (int) coords[n].y;
+		const T* pix = data + i + j * (size_t) width;
+		func(n, pix, pix + width, coords[n].x - i, coords[n].y - j);
+	}
+}
+}
+bool SampleBilinearInterior(const ubyte3* data, int width, const float2* coords, int count, ubyte3* out) {
+	detail::SampleBilinearSpan(data, width, coords, count, [out](int n, const ubyte3* top, const ubyte3* bottom, float dx, float dy) {
+		int32_t v = detail::PackBytes(detail::Bilinear(detail::LoadRGB(top), detail::LoadRGBRight(top + 1), detail::LoadRGB(bottom), detail::LoadRGBRight(bottom + 1), dx, dy));
+		out[n] = ubyte3((uint8_t) v, (uint8_t) (v >> 8), (uint8_t) (v >> 16));
+	});
+	return true;
+}
+bool SampleBilinearInterior(const ubyte4* data, int width, const float2* coords, int count, ubyte4* out) {
+	detail::SampleBilinearSpan(data, width, coords, count, [out](int n, const ubyte4* top, const ubyte4* bottom, float dx, float dy) {
+		int32_t v = detail::PackBytes(detail::Bilinear(detail::LoadRGBA(top), detail::LoadRGBA(top + 1), detail::LoadRGBA(bottom), detail::LoadRGBA(bottom + 1), dx, dy));
+		out[n] = ubyte4((uint8_t) v, (uint8_t) (v >> 8), (uint8_t) (v >> 16), (uint8_t) (v >> 24));
+	});
+	return true;
+}
+bool SampleBilinearInterior(const float3* data, int width, const float2* coords, int count, float3* out) {
+	detail::SampleBilinearSpan(data, width, coords, count, [out](int n, const float3* top, const float3* bottom, float dx, float dy) {
+		//Unaligned loads of the left pixels pick up the first channel of their right neighbor, which always exists.
+		__m128 rgb10 = _mm_setr_ps(top[1].x, top[1].y, top[1].z, 0.0f);
+		__m128 rgb11 = _mm_setr_ps(bottom[1].x, bottom[1].y, bottom[1].z, 0.0f);
+		__m128 v = detail::Bilinear(_mm_loadu_ps(&top->x), rgb10, _mm_loadu_ps(&bottom->x), rgb11, dx, dy);
+		float tmp[4];
+		_mm_storeu_ps(tmp, v);
+		out[n] = float3(tmp[0], tmp[1], tmp[2]);
+	});
+	return true;
+}
+bool SampleBilinearInterior(const float4* data, int width, const float2* coords, int count, float4* out) {
+	detail::SampleBilinearSpan(data, width, coords, count, [out](int n, const float4* top, const float4* bottom, float dx, float dy) {
+		_mm_storeu_ps(&out[n].x, detail::Bilinear(_mm_loadu_ps(&top->x), _mm_loadu_ps(&top[1].x), _mm_loadu_ps(&bottom->x), _mm_loadu_ps(&bottom[1].x), dx, dy));
+	});
+	return true;
+}
+void MakeRemap(const LensDistortion& lens, int width, int height, Image2f& coords) {
+	coords.resize(width, height);
+	LensMap map(lens);
+	ParallelFor(0, (size_t) height, [&](size_t j) {
+		for (int i = 0; i < width; i += RESAMPLE_SPAN) {
+			map.fill((int) j, i, std::min(RESAMPLE_SPAN, width - i), &coords.data[i + j * (size_t) width]);
+		}
+	}, 4);
+}
+}
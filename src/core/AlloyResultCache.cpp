@@ -0,0 +1,84 @@
+/*
+ * Copyright(C) 2018, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "AlloyResultCache.h"
+namespace aly {
+	ResultCache::ResultCache(size_t byteBudget, const std::string& diskDirectory) :
+			byteBudget(byteBudget), bytesUsed(0), memoryHits(0), diskHits(0), misses(0) {
+		setDiskDirectory(diskDirectory);
+	}
+	void ResultCache::setByteBudget(size_t bytes) {
+		std::lock_guard<std::mutex> guard(lock);
+		byteBudget = bytes;
+		evict();
+	}
+	void ResultCache::setDiskDirectory(const std::string& dir) {
+		diskDirectory = dir;
+		if (diskDirectory.size() > 0 && !IsDirectory(diskDirectory)) {
+			if (!MakeDirectory(diskDirectory)) {
+				throw std::runtime_error(MakeString() << "Could not create cache directory " << diskDirectory);
+			}
+		}
+	}
+	void ResultCache::clear() {
+		std::lock_guard<std::mutex> guard(lock);
+		entries.clear();
+		index.clear();
+		bytesUsed = 0;
+	}
+	std::string ResultCache::getDiskFile(const std::string& key) const {
+		if (diskDirectory.size() == 0)
+			return std::string();
+		return RemoveTrailingSlash(diskDirectory) + ALY_PATH_SEPARATOR + key + ".bin";
+	}
+	std::shared_ptr<void> ResultCache::find(const std::string& key, const std::string& type) {
+		auto pos = index.find(key);
+		if (pos == index.end() || pos->second->type != type) {
+			return std::shared_ptr<void>();
+		}
+		entries.splice(entries.begin(), entries, pos->second);
+		memoryHits++;
+		return entries.front().value;
+	}
+	void ResultCache::insert(const std::string& key, const std::string& type,
+			const std::shared_ptr<void>& value, size_t bytes) {
+		auto pos = index.find(key);
+		if (pos != index.end()) {
+			bytesUsed -= pos->second->bytes;
+			entries.erase(pos->second);
+			index.erase(pos);
+		}
+		//Results larger than the whole budget only go to disk.
+		if (bytes > byteBudget)
+			return;
+		entries.push_front( { key, type, value, bytes });
+		index[key] = entries.begin();
+		bytesUsed += bytes;
+		evict();
+	}
+	void ResultCache::evict() {
+		while (bytesUsed > byteBudget && entries.size() > 0) {
+			Entry& last = entries.back();
+			bytesUsed -= last.bytes;
+			index.erase(last.key);
+			entries.pop_back();
+		}
+	}
+}
@@ -0,0 +1,330 @@
+/*
+ * Copyright(C) 2018, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "AlloyScheduler.h"
+namespace aly {
+static thread_local const TaskScheduler* workerScheduler = nullptr;
+static thread_local int workerIndex = -1;
+TaskScheduler& AlloyDefaultScheduler() {
+	//Never destroyed, tasks owned by static objects may still cancel or wait on it during exit.
+	static TaskScheduler* scheduler = new TaskScheduler();
+	return *scheduler;
+}
+TaskScheduler::TaskScheduler(int threadCount) :
+		queued(0), running(true) {
+	if (threadCount <= 0) {
+		threadCount = std::max(4, (int) std::thread::hardware_concurrency());
+	}
+	for (int i = 0; i < threadCount; i++) {
+		workers.push_back(std::unique_ptr<Worker>(new Worker()));
+	}
+	for (int i = 0; i < threadCount; i++) {
+		threads.push_back(std::thread(&TaskScheduler::run, this, i));
+	}
+	timerThread = std::thread(&TaskScheduler::runTimers, this);
+}
+TaskScheduler::~TaskScheduler() {
+	{
+		std::lock_guard<std::mutex> lockGuard(waitLock);
+		running = false;
+	}
+	workAvailable.notify_all();
+	{
+		std::lock_guard<std::mutex> lockGuard(timerLock);
+	}
+	timerChanged.notify_all();
+	for (std::thread& thread : threads) {
+		if (thread.joinable()) {
+			thread.join();
+		}
+	}
+	if (timerThread.joinable()) {
+		timerThread.join();
+	}
+}
+int TaskScheduler::getWorkerIndex() const {
+	return (workerScheduler == this) ? workerIndex : -1;
+}
+void TaskScheduler::submit(const Job& job, TaskPriority priority) {
+	int worker = getWorkerIndex();
+	Worker& target = (worker >= 0) ? *workers[worker] : shared;
+	{
+		std::lock_guard<std::mutex> lockGuard(target.lock);
+		target.queue[(int) priority].push_back(job);
+	}
+	{
+		std::lock_guard<std::mutex> lockGuard(waitLock);
+		queued++;
+	}
+	workAvailable.notify_one();
+}
+uint64_t TaskScheduler::schedule(const Job& job, long milliseconds, TaskPriority priority) {
+	if (milliseconds <= 0) {
+		submit(job, priority);
+		return 0;
+	}
+	uint64_t id;
+	{
+		std::lock_guard<std::mutex> lockGuard(timerLock);
+		id = ++timerCounter;
+		Clock::time_point time = Clock::now() + std::chrono::milliseconds(milliseconds);
+		timers[std::make_pair(time, id)] = std::make_pair(job, priority);
+		timerTimes[id] = time;
+	}
+	timerChanged.notify_all();
+	return id;
+}
+bool TaskScheduler::unschedule(uint64_t id) {
+	std::lock_guard<std::mutex> lockGuard(timerLock);
+	auto iter = timerTimes.find(id);
+	if (iter == timerTimes.end()) {
+		return false;
+	}
+	timers.erase(std::make_pair(iter->second, id));
+	timerTimes.erase(iter);
+	return true;
+}
+bool TaskScheduler::pop(int worker, Job& job) {
+	for (int p = PRIORITIES - 1; p >= 0; p--) {
+		{
+			Worker& own = *workers[worker];
+			std::lock_guard<std::mutex> lockGuard(own.lock);
+			if (own.queue[p].size() > 0) {
+				job = std::move(own.queue[p].back());
+				own.queue[p].pop_back();
+				queued--;
+				return true;
+			}
+		}
+		{
+			std::lock_guard<std::mutex> lockGuard(shared.lock);
+			if (shared.queue[p].size() > 0) {
+				job = std::move(shared.queue[p].front());
+				shared.queue[p].pop_front();
+				queued--;
+				return true;
+			}
+		}
+		for (int n = 1; n < (int) workers.size(); n++) {
+			Worker& victim = *workers[(worker + n) % workers.size()];
+			std::lock_guard<std::mutex> lockGuard(victim.lock);
+			if (victim.queue[p].size() > 0) {
+				job = std::move(victim.queue[p].front());
+				victim.queue[p].pop_front();
+				queued--;
+				return true;
+			}
+		}
+	}
+	return false;
+}
+bool TaskScheduler::runPending() {
+	int worker = getWorkerIndex();
+	Job job;
+	if (worker < 0 || queued == 0 || !pop(worker, job)) {
+		return false;
+	}
+	try {
+		job();
+	} catch (...) {
+	}
+	return true;
+}
+void TaskScheduler::run(int worker) {
+	workerScheduler = this;
+	workerIndex = worker;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lockGuard(waitLock);
+			workAvailable.wait(lockGuard, [this] {
+				return (queued > 0 || !running);
+			});
+			if (!running) {
+				return;
+			}
+		}
+		Job job;
+		while (pop(worker, job)) {
+			//Jobs report their own errors, an exception escaping here must not take down the worker.
+			try {
+				job();
+			} catch (...) {
+			}
+			job = nullptr;
+		}
+	}
+}
+void TaskScheduler::runTimers() {
+	std::unique_lock<std::mutex> lockGuard(timerLock);
+	while (running) {
+		if (timers.size() == 0) {
+			timerChanged.wait(lockGuard);
+			continue;
+		}
+		auto first = timers.begin();
+		Clock::time_point time = first->first.first;
+		if (time <= Clock::now()) {
+			std::pair<Job, TaskPriority> item = std::move(first->second);
+			timerTimes.erase(first->first.second);
+			timers.erase(first);
+			lockGuard.unlock();
+			submit(item.first, item.second);
+			lockGuard.lock();
+		} else {
+			timerChanged.wait_until(lockGuard, time);
+		}
+	}
+}
+void WaitForCondition(const std::function<bool()>& ready, std::mutex& lock, std::condition_variable& changed, TaskScheduler& scheduler) {
+	std::unique_lock<std::mutex> lockGuard(lock);
+	if (!scheduler.isWorkerThread()) {
+		changed.wait(lockGuard, ready);
+		return;
+	}
+	//A blocked worker would shrink the pool, so run other jobs until the condition holds.
+	while (!ready()) {
+		lockGuard.unlock();
+		bool ran = scheduler.runPending();
+		lockGuard.lock();
+		if (!ran && !ready()) {
+			changed.wait_for(lockGuard, std::chrono::milliseconds(1));
+		}
+	}
+}
+TaskGroup::TaskGroup(TaskPriority priority, TaskScheduler& scheduler) :
+		scheduler(scheduler), priority(priority), state(std::make_shared<State>()) {
+}
+TaskGroup::TaskGroup(const CancelToken& token, TaskPriority priority, TaskScheduler& scheduler) :
+		scheduler(scheduler), priority(priority), token(token), state(std::make_shared<State>()) {
+}
+void TaskGroup::run(const std::function<void()>& func) {
+	{
+		std::lock_guard<std::mutex> lockGuard(state->lock);
+		state->pending++;
+	}
+	std::shared_ptr<State> s = state;
+	CancelToken t = token;
+	scheduler.submit([s, t, func]() {
+		if (!t.isCanceled()) {
+			try {
+				func();
+			} catch (...) {
+				std::lock_guard<std::mutex> lockGuard(s->lock);
+				if (!s->error) {
+					s->error = std::current_exception();
+				}
+			}
+		}
+		std::lock_guard<std::mutex> lockGuard(s->lock);
+		if (--s->pending == 0) {
+			s->finished.notify_all();
+		}
+	}, priority);
+}
+void TaskGroup::wait() {
+	std::shared_ptr<State> s = state;
+	WaitForCondition([s] {return s->pending == 0;}, s->lock, s->finished, scheduler);
+	std::exception_ptr error;
+	{
+		std::lock_guard<std::mutex> lockGuard(s->lock);
+		std::swap(error, s->error);
+	}
+	if (error) {
+		std::rethrow_exception(error);
+	}
+}
+TaskGroup::~TaskGroup() {
+	try {
+		wait();
+	} catch (...) {
+	}
+}
+void ParallelForRange(size_t begin, size_t end, const std::function<void(size_t begin, size_t end)>& func, size_t grainSize,
+		TaskPriority priority) {
+	if (end <= begin) {
+		return;
+	}
+	TaskScheduler& scheduler = AlloyDefaultScheduler();
+	size_t threads = (size_t) scheduler.getThreadCount();
+	if (grainSize == 0) {
+		grainSize = std::max((size_t) 1, (end - begin) / (8 * threads));
+	}
+	size_t chunks = (end - begin + grainSize - 1) / grainSize;
+	if (chunks == 1) {
+		func(begin, end);
+		return;
+	}
+	//Helpers that start after the loop is closed return without touching func, so the caller never waits on queued helpers.
+	struct Loop {
+		std::atomic<size_t> next;
+		std::mutex lock;
+		std::condition_variable finished;
+		int active = 0;
+		bool closed = false;
+		std::exception_ptr error;
+		Loop() :
+				next(0) {
+		}
+	};
+	std::shared_ptr<Loop> loop = std::make_shared<Loop>();
+	const std::function<void(size_t, size_t)>* body = &func;
+	auto work = [loop, body, begin, end, grainSize, chunks]() {
+		size_t c;
+		try {
+			while ((c = loop->next++) < chunks) {
+				size_t first = begin + c * grainSize;
+				(*body)(first, std::min(end, first + grainSize));
+			}
+		} catch (...) {
+			loop->next = chunks;
+			std::lock_guard<std::mutex> lockGuard(loop->lock);
+			if (!loop->error) {
+				loop->error = std::current_exception();
+			}
+		}
+	};
+	size_t helpers = std::min(chunks, threads) - 1;
+	for (size_t i = 0; i < helpers; i++) {
+		scheduler.submit([loop, work]() {
+			{
+				std::lock_guard<std::mutex> lockGuard(loop->lock);
+				if (loop->closed) {
+					return;
+				}
+				loop->active++;
+			}
+			work();
+			std::lock_guard<std::mutex> lockGuard(loop->lock);
+			if (--loop->active == 0) {
+				loop->finished.notify_all();
+			}
+		}, priority);
+	}
+	work();
+	{
+		std::lock_guard<std::mutex> lockGuard(loop->lock);
+		loop->closed = true;
+	}
+	WaitForCondition([loop] {return loop->active == 0;}, loop->lock, loop->finished, scheduler);
+	if (loop->error) {
+		std::rethrow_exception(loop->error);
+	}
+}
+}
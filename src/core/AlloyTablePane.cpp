@@ -24,12 +24,37 @@
 namespace aly {
 LazyTableComposite::LazyTableComposite(const std::string& name, const AUnit2D& pos,
 		const AUnit2D& dims, float entryHeight) :
-		Composite(name, pos, dims), entryHeight(entryHeight) {
+		Composite(name, pos, dims), entryHeight(entryHeight), virtualized(
+				false), rebind(false), virtualCount(0) {
 
 }
+void LazyTableComposite::setVirtualCount(size_t count) {
+	if (!virtualized) {
+		Composite::clear();
+		boundIndices.clear();
+		virtualized = true;
+	}
+	virtualCount = count;
+	rebind = true;
+}
+void LazyTableComposite::clear() {
+	Composite::clear();
+	boundIndices.clear();
+}
+int64_t LazyTableComposite::getEntryIndex(const pixel2& cursor,
+		bool clamp) const {
+	int64_t count = (int64_t) getEntryCount();
+	float y = cursor.y - getBounds().position.y - extents.position.y
+			- cellPadding.y;
+	int64_t index = (int64_t) std::floor(y / (entryHeight + cellSpacing.y));
+	if (clamp) {
+		return (count > 0) ? aly::clamp(index, (int64_t) 0, count - 1) : -1;
+	}
+	return (index >= 0 && index < count) ? index : -1;
+}
 TableRow::TableRow(TablePane* tablePane, const std::string& name) :
 		Composite(name, CoordPX(0.0f, 0.0f),
-				CoordPerPX(1.0f, 0.0f, 0.0f, tablePane->entryHeight)), tablePane(
+				CoordPerPX(1.0f, 0.0f, 0.0f, tablePane->entryHeight)), index(-1), tablePane(
 				tablePane) {
 	this->backgroundColor = MakeColor(AlloyApplicationContext()->theme.DARK);
 	this->borderColor = MakeColor(COLOR_NONE);
@@ -111,13 +136,20 @@ void TablePane::sortSelectedColumn() {
 }
 void TablePane::sortColumn(int c) {
 	int dir = sortDirections[c];
-	if (dir != 0) {
+	if (dir != 0 && isVirtual()) {
+		if (onSortRows) {
+			onSortRows(c, dir);
+			selectedRows.clear();
+			lastSelectedRow = -1;
+			refreshRows();
+		}
+	} else if (dir != 0) {
 		std::sort(rows.begin(), rows.end(),
 				[this,c,dir](const TableRowPtr& a, const TableRowPtr& b) {
 					return (a->compare(b, c)*dir>0);
 				});
 		update();
-		AlloyApplicationContext()->requestPack();
+		AlloyApplicationContext()->requestPack(this);
 	}
 }
 void TableRow::setColumn(int c, const std::shared_ptr<TableEntry>& region) {
@@ -175,6 +207,37 @@ std::shared_ptr<TableRow> TablePane::addRow(const std::string& name) {
 }
 bool TablePane::onMouseDown(TableRow* entry, AlloyContext* context,
 		const InputEvent& e) {
+	if (isVirtual()) {
+		if (!e.isDown() || entry->index < 0)
+			return false;
+		size_t index = (size_t) entry->index;
+		if (e.button == GLFW_MOUSE_BUTTON_LEFT) {
+			if (enableMultiSelection) {
+				if (selectedRows.contains(index) && e.clicks == 1) {
+					selectedRows.erase(index);
+				} else {
+					selectedRows.insert(index);
+					lastSelectedRow = entry->index;
+				}
+			} else {
+				selectedRows.clear();
+				selectedRows.insert(index);
+				lastSelectedRow = entry->index;
+			}
+			syncSelection();
+			if (onSelect)
+				onSelect(entry, e);
+			return true;
+		} else if (e.button == GLFW_MOUSE_BUTTON_RIGHT) {
+			selectedRows.clear();
+			lastSelectedRow = -1;
+			syncSelection();
+			if (onSelect)
+				onSelect(nullptr, e);
+			return true;
+		}
+		return false;
+	}
 	if (e.isDown()) {
 		if (e.button == GLFW_MOUSE_BUTTON_LEFT) {
 			if (enableMultiSelection) {
@@ -217,9 +280,14 @@ bool TablePane::onMouseDown(TableRow* entry, AlloyContext* context,
 }
 
 void TablePane::update() {
+	AlloyContext* context = AlloyApplicationContext().get();
+	if (isVirtual()) {
+		dirty = false;
+		context->requestPack(this);
+		return;
+	}
 	contentRegion->clear();
 	lastSelected.clear();
-	AlloyContext* context = AlloyApplicationContext().get();
 	for (std::shared_ptr<TableRow> entry : rows) {
 		if (entry->parent == nullptr) {
 			contentRegion->add(entry);
@@ -230,16 +298,85 @@ void TablePane::update() {
 	}
 
 	dirty = false;
-	context->requestPack();
+	context->requestPack(this);
+}
+void TablePane::setRowProvider(size_t rowCount,
+		const std::function<void(TableRow* row, size_t index)>& provider) {
+	rows.clear();
+	lastSelected.clear();
+	selectedRows.clear();
+	lastSelectedRow = -1;
+	dirty = false;
+	rowProvider = provider;
+	contentRegion->onCreateEntry = [this]() {
+		return RegionPtr(new TableRow(this, "Row"));
+	};
+	contentRegion->onBindEntry = [this](Region* region, size_t index) {
+		TableRow* row = static_cast<TableRow*>(region);
+		row->index = (int64_t) index;
+		row->selected = selectedRows.contains(index);
+		rowProvider(row, index);
+	};
+	contentRegion->setVirtualCount(rowCount);
+	AlloyApplicationContext()->requestPack(this);
+}
+void TablePane::setRowCount(size_t rowCount) {
+	if (!isVirtual()) {
+		throw std::runtime_error(
+				"Row count can only be set on a table with a row provider.");
+	}
+	selectedRows.truncate(rowCount);
+	if (lastSelectedRow >= (int64_t) rowCount) {
+		lastSelectedRow = -1;
+	}
+	contentRegion->setVirtualCount(rowCount);
+	AlloyApplicationContext()->requestPack(this);
+}
+size_t TablePane::getRowCount() const {
+	return (isVirtual()) ? contentRegion->getVirtualCount() : rows.size();
+}
+void TablePane::refreshRows() {
+	contentRegion->invalidate();
+	AlloyApplicationContext()->requestPack(this);
+}
+void TablePane::setRowSelected(size_t index, bool selected) {
+	if (selected) {
+		selectedRows.insert(index);
+		lastSelectedRow = (int64_t) index;
+	} else {
+		selectedRows.erase(index);
+	}
+	syncSelection();
+}
+void TablePane::syncSelection() {
+	for (RegionPtr region : contentRegion->getChildren()) {
+		TableRow* row = static_cast<TableRow*>(region.get());
+		if (row->index >= 0) {
+			row->selected = selectedRows.contains((size_t) row->index);
+		}
+	}
+	//Row colors are assigned when packed.
+	AlloyApplicationContext()->requestPack(contentRegion.get());
 }
 bool TablePane::onEventHandler(AlloyContext* context, const InputEvent& e) {
 	if (!context->isMouseOver(this, true))
 		return false;
 	if (e.type == InputType::MouseButton) {
-		for (TableRowPtr row : rows) {
-			if (context->isMouseDown(row.get(), true)) {
-				onMouseDown(row.get(), context, e);
-				break;
+		if (isVirtual()) {
+			for (RegionPtr region : contentRegion->getChildren()) {
+				if (region->isVisible()
+						&& context->isMouseDown(region.get(), true)) {
+					onMouseDown(static_cast<TableRow*>(region.get()), context,
+							e);
+					break;
+				}
+			}
+		} else {
+			for (TableRowPtr row : rows) {
+				if (context->isMouseDown(row.get(), true)) {
+					onMouseDown(row.get(), context, e);
+					break;
+				}
 			}
 		}
 	}
@@ -258,7 +395,26 @@ bool TablePane::onEventHandler(AlloyContext* context, const InputEvent& e) {
 			}
 		} else if (!context->isMouseDown()
 				&& e.type == InputType::MouseButton) {
-			if (enableMultiSelection) {
+			if (enableMultiSelection && isVirtual()) {
+				if (dragBox.dimensions.x * dragBox.dimensions.y > 0) {
+					int64_t st = contentRegion->getEntryIndex(dragBox.position);
+					int64_t ed = contentRegion->getEntryIndex(
+							dragBox.position + dragBox.dimensions, true);
+					if (st >= 0) {
+						selectedRows.insert((size_t) st, (size_t) ed + 1);
+						lastSelectedRow = ed;
+						syncSelection();
+						for (RegionPtr region : contentRegion->getChildren()) {
+							TableRow* row = static_cast<TableRow*>(region.get());
+							if (row->index == ed && row->isVisible()) {
+								if (onSelect)
+									onSelect(row, e);
+								break;
+							}
+						}
+					}
+				}
+			} else if (enableMultiSelection) {
 				TableRow* lastEntry = nullptr;
 				for (std::shared_ptr<TableRow> entry : rows) {
 					if (!entry->isSelected()) {
@@ -309,7 +465,7 @@ void LazyTableComposite::pack(const pixel2& pos, const pixel2& dims,
 							this->scrollPosition.y = (this->verticalScrollHandle->getBoundsPositionY() - this->verticalScrollTrack->getBoundsPositionY()) /
 							std::max(1.0f, (float)this->verticalScrollTrack->getBoundsDimensionsY() - (float)this->verticalScrollHandle->getBoundsDimensionsY());
 							updateExtents();
-							context->requestPack();
+							context->requestPack(this);
 							return false;
 						}
 						else {
@@ -325,6 +481,8 @@ void LazyTableComposite::pack(const pixel2& pos, const pixel2& dims,
 						this->scrollPosition.y = (this->verticalScrollHandle->getBoundsPositionY() - this->verticalScrollTrack->getBoundsPositionY()) /
 						std::max(1.0f, (float)this->verticalScrollTrack->getBoundsDimensionsY() - (float)this->verticalScrollHandle->getBoundsDimensionsY());
 						updateExtents();
+						//The visible rows change with the scroll position.
+						context->requestPack(this);
 					}
 					return false;
 				};
@@ -351,7 +509,7 @@ void LazyTableComposite::pack(const pixel2& pos, const pixel2& dims,
 							this->scrollPosition.x = (this->horizontalScrollHandle->getBoundsPositionX() - this->horizontalScrollTrack->getBoundsPositionX()) /
 							std::max(1.0f, (float)this->horizontalScrollTrack->getBoundsDimensionsX() - (float)this->horizontalScrollHandle->getBoundsDimensionsX());
 							updateExtents();
-							context->requestPack();
+							context->requestPack(this);
 							return false;
 						}
 						else {
@@ -374,11 +532,12 @@ void LazyTableComposite::pack(const pixel2& pos, const pixel2& dims,
 	}
 	pixel2 offset = cellPadding;
 
+	size_t entryCount = getEntryCount();
 	extents.dimensions = pixel2(bounds.dimensions.x,
 			std::max(bounds.dimensions.y,
 					cellPadding.y
 							+ (entryHeight + cellSpacing.y)
-									* (int) children.size() - cellSpacing.y));
+									* (float) entryCount - cellSpacing.y));
 	extents.position.y = scrollPosition.y
 			* std::max(0.0f, extents.dimensions.y - bounds.dimensions.y);
 
@@ -386,21 +545,46 @@ void LazyTableComposite::pack(const pixel2& pos, const pixel2& dims,
 			(int) std::floor(
 					(extents.position.y - cellPadding.y)
 							/ (entryHeight + cellSpacing.y)));
-	size_t edIndex = std::max(0,std::min((int) children.size(),
-			(int) std::floor(
-					(extents.position.y + bounds.dimensions.y - cellPadding.y)
-							/ (entryHeight + cellSpacing.y)) + 1));
-
-	for (size_t i = 0; i < stIndex; i++) {
-		std::shared_ptr<Region>& region = children[i];
-		region->setVisible(false);
-	}
-	for (size_t i = edIndex; i < children.size(); i++) {
-		std::shared_ptr<Region>& region = children[i];
-		region->setVisible(false);
+	size_t edIndex = (size_t) std::max((int64_t) 0,
+			std::min((int64_t) entryCount,
+					(int64_t) std::floor(
+							(extents.position.y + bounds.dimensions.y
+									- cellPadding.y)
+									/ (entryHeight + cellSpacing.y)) + 1));
+	stIndex = std::min(stIndex, edIndex);
+	if (virtualized) {
+		//Grow the pool to cover the window. Row i is always bound to slot i modulo the
+		//pool size, so a row keeps its region while it stays visible.
+		if (children.size() < edIndex - stIndex && onCreateEntry) {
+			while (children.size() < edIndex - stIndex) {
+				Composite::add(onCreateEntry());
+			}
+			boundIndices.assign(children.size(), entryCount);
+		}
+		for (std::shared_ptr<Region>& region : children) {
+			region->setVisible(false);
+		}
+		if (children.size() < edIndex - stIndex) {
+			edIndex = stIndex + children.size();
+		}
+	} else {
+		for (size_t i = 0; i < stIndex; i++) {
+			std::shared_ptr<Region>& region = children[i];
+			region->setVisible(false);
+		}
+		for (size_t i = edIndex; i < children.size(); i++) {
+			std::shared_ptr<Region>& region = children[i];
+			region->setVisible(false);
+		}
 	}
 	for (size_t i = stIndex; i < edIndex; i++) {
-		std::shared_ptr<Region>& region = children[i];
+		size_t slot = (virtualized) ? i % children.size() : i;
+		std::shared_ptr<Region>& region = children[slot];
+		if (virtualized && (rebind || boundIndices[slot] != i)) {
+			boundIndices[slot] = i;
+			if (onBindEntry)
+				onBindEntry(region.get(), i);
+		}
 		region->setVisible(true);
 		offset.y = i * (cellSpacing.y + entryHeight) + cellPadding.y;
 		if (orientation == Orientation::Vertical) {
@@ -512,6 +696,7 @@ void LazyTableComposite::pack(const pixel2& pos, const pixel2& dims,
 			verticalScrollTrack->setVisible(alwaysShowVerticalScrollBar);
 		}
 	}
+	rebind = false;
 	for (std::shared_ptr<Region>& region : children) {
 		if (region->onPack)
 			region->onPack();
@@ -530,6 +715,7 @@ TablePane::TablePane(const std::string& name, const AUnit2D& pos,
 	enableMultiSelection = false;
 	scrollingDown = false;
 	scrollingUp = false;
+	lastSelectedRow = -1;
 	setRoundCorners(false);
 	backgroundColor = MakeColor(AlloyApplicationContext()->theme.LIGHTER);
 	borderColor = MakeColor(AlloyApplicationContext()->theme.DARK);
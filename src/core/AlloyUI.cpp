@@ -78,6 +78,14 @@ void Region::pack(AlloyContext* context) {
 void Region::pack() {
 	pack(AlloyApplicationContext().get());
 }
+bool Region::repack() {
+	if (!packed)
+		return true;
+	box2px lastBounds = bounds;
+	box2px lastExtents = extents;
+	pack(packPosition, packDimensions, packDpmm, packPixelRatio, packClamp);
+	return (bounds != lastBounds || extents != lastExtents);
+}
 void Region::draw(AlloyContext* context) {
 	NVGcontext* nvg = context->nvgContext;
 	box2px bounds = getBounds();
@@ -233,6 +241,7 @@ Region::Region(const std::string& name, const AUnit2D& pos, const AUnit2D& dims)
 }
 Region::~Region() {
 	Application::clearEvents(this);
+	Application::removeRegion(this);
 }
 void Region::drawDebug(AlloyContext* context) {
 	drawBoundsLabel(context, name, context->getFontHandle(FontType::Bold));
@@ -480,7 +489,7 @@ bool Composite::addVerticalScrollPosition(float t) {
 								(float) this->verticalScrollTrack->getBoundsDimensionsY()
 										- (float) this->verticalScrollHandle->getBoundsDimensionsY());
 		updateExtents();
-		AlloyApplicationContext()->requestPack();
+		AlloyApplicationContext()->requestPack(this);
 		return true;
 	}
 	return false;
@@ -499,7 +508,7 @@ void Composite::scrollToBottom() {
 							(float) this->verticalScrollTrack->getBoundsDimensionsY()
 									- (float) this->verticalScrollHandle->getBoundsDimensionsY());
 	updateExtents();
-	AlloyApplicationContext()->requestPack();
+	AlloyApplicationContext()->requestPack(this);
 }
 void Composite::scrollToTop() {
 	verticalScrollHandle->setDragOffset(pixel2(0.0f, 0.0f));
@@ -510,7 +519,7 @@ void Composite::scrollToTop() {
 							(float) this->verticalScrollTrack->getBoundsDimensionsY()
 									- (float) this->verticalScrollHandle->getBoundsDimensionsY());
 	updateExtents();
-	AlloyApplicationContext()->requestPack();
+	AlloyApplicationContext()->requestPack(this);
 }
 bool Composite::addHorizontalScrollPosition(float t) {
 	if (horizontalScrollHandle->addDragOffset(pixel2(t, 0.0f))) {
@@ -521,7 +530,7 @@ bool Composite::addHorizontalScrollPosition(float t) {
 								(float) this->horizontalScrollTrack->getBoundsDimensionsX()
 										- (float) this->horizontalScrollHandle->getBoundsDimensionsX());
 		updateExtents();
-		AlloyApplicationContext()->requestPack();
+		AlloyApplicationContext()->requestPack(this);
 		return true;
 	}
 	return false;
@@ -569,7 +578,7 @@ void Composite::pack(const pixel2& pos, const pixel2& dims, const double2& dpmm,
 							this->scrollPosition.y = (this->verticalScrollHandle->getBoundsPositionY() - this->verticalScrollTrack->getBoundsPositionY()) /
 							std::max(1.0f, (float)this->verticalScrollTrack->getBoundsDimensionsY() - (float)this->verticalScrollHandle->getBoundsDimensionsY());
 							updateExtents();
-							context->requestPack();
+							context->requestPack(this);
 							return false;
 						}
 						else {
@@ -611,7 +620,7 @@ void Composite::pack(const pixel2& pos, const pixel2& dims, const double2& dpmm,
 							this->scrollPosition.x = (this->horizontalScrollHandle->getBoundsPositionX() - this->horizontalScrollTrack->getBoundsPositionX()) /
 							std::max(1.0f, (float)this->horizontalScrollTrack->getBoundsDimensionsX() - (float)this->horizontalScrollHandle->getBoundsDimensionsX());
 							updateExtents();
-							context->requestPack();
+							context->requestPack(this);
 							return false;
 						}
 						else {
@@ -1066,7 +1075,7 @@ bool BorderComposite::onEventHandler(AlloyContext* context,
 				break;
 			}
 			//Create adjustable region component.
-			context->requestPack();
+			context->requestPack(this);
 		}
 		return false;
 	} else {
@@ -1092,13 +1101,14 @@ BorderComposite::BorderComposite(const std::string& name, const AUnit2D& pos,
 	}
 }
 void BorderComposite::updateCursor(CursorLocator* cursorLocator) {
-	if (!ignoreCursorEvents)
-		cursorLocator->add(this);
+	cursorLocator->add(this, !ignoreCursorEvents);
+	cursorLocator->push();
 	for (std::shared_ptr<Region>& region : children) {
 		if (region.get() == nullptr)
 			continue;
 		region->updateCursor(cursorLocator);
 	}
+	cursorLocator->pop();
 }
 
 void BorderComposite::drawDebug(AlloyContext* context) {
@@ -1264,7 +1274,7 @@ bool Composite::onEventHandler(AlloyContext* context, const InputEvent& event) {
 										(float) this->verticalScrollTrack->getBoundsDimensionsY()
 												- (float) this->verticalScrollHandle->getBoundsDimensionsY());
 				updateExtents();
-				context->requestPack();
+				context->requestPack(this);
 				return true;
 			}
 			if (event.scroll.x != 0 && horizontalScrollHandle.get() != nullptr
@@ -1278,7 +1288,7 @@ bool Composite::onEventHandler(AlloyContext* context, const InputEvent& event) {
 										(float) this->horizontalScrollTrack->getBoundsDimensionsX()
 												- (float) this->horizontalScrollHandle->getBoundsDimensionsX());
 				updateExtents();
-				context->requestPack();
+				context->requestPack(this);
 				return true;
 			}
 		}
@@ -1292,8 +1302,8 @@ pixel2 Composite::getDrawOffset() const {
 	return offset;
 }
 void Composite::updateCursor(CursorLocator* cursorLocator) {
-	if (!ignoreCursorEvents)
-		cursorLocator->add(this);
+	cursorLocator->add(this, !ignoreCursorEvents);
+	cursorLocator->push();
 	for (std::shared_ptr<Region>& region : children) {
 		region->updateCursor(cursorLocator);
 	}
@@ -1309,6 +1319,7 @@ void Composite::updateCursor(CursorLocator* cursorLocator) {
 	if (horizontalScrollHandle.get() != nullptr) {
 		horizontalScrollHandle->updateCursor(cursorLocator);
 	}
+	cursorLocator->pop();
 }
 
 void Region::updateCursor(CursorLocator* cursorLocator) {
@@ -1326,6 +1337,12 @@ void Composite::removeListener() const {
 }
 void Region::pack(const pixel2& pos, const pixel2& dims, const double2& dpmm,
 		double pixelRatio, bool clamp) {
+	packPosition = pos;
+	packDimensions = dims;
+	packDpmm = dpmm;
+	packPixelRatio = pixelRatio;
+	packClamp = clamp;
+	packed = true;
 
 	pixel2 computedPos = position.toPixels(dims, dpmm, pixelRatio);
 //pixel2 xy = pos + dragOffset + computedPos;
@@ -4436,7 +4453,7 @@ void MenuHeader::draw(AlloyContext* context) {
 	double old = this->aspectRatio;
 	this->aspectRatio = (tw + 10.0f) / (th + 10.0f);
 	if (old != aspectRatio) {
-		context->requestPack();
+		context->requestPack(this);
 	}
 	nvgTextAlign(nvg, NVG_ALIGN_MIDDLE | NVG_ALIGN_CENTER);
 	pixel2 offset(0, 0);
@@ -4644,7 +4661,7 @@ bool AdjustableComposite::onEventHandler(AlloyContext* context,
 			if (onResize) {
 				onResize(this, newBounds);
 			}
-			context->requestPack();
+			context->requestPack(this);
 		}
 		return false;
 	} else {
@@ -21,11 +21,14 @@
 
 #include "AlloyApplication.h"
 #include "AlloyWidget.h"
+#include "AlloyTablePane.h"
 #include "AlloyDrawUtil.h"
 #include "AlloyContext.h"
 #include <future>
 #include <cstdlib>
 #include <cctype>
+#include <limits>
+#include <iterator>
 
 using namespace std;
 namespace aly {
@@ -1543,12 +1546,67 @@ void FileButton::openFileDialog(AlloyContext* context,
 bool ListEntry::onEventHandler(AlloyContext* context, const InputEvent& event) {
 	return Composite::onEventHandler(context, event);
 }
+void IndexSelection::insert(size_t begin, size_t end) {
+	if (begin >= end)
+		return;
+	//Merge with every interval that overlaps or touches [begin, end).
+	auto iter = intervals.upper_bound(begin);
+	if (iter != intervals.begin()) {
+		auto prev = std::prev(iter);
+		if (prev->second >= begin) {
+			iter = prev;
+		}
+	}
+	while (iter != intervals.end() && iter->first <= end) {
+		begin = std::min(begin, iter->first);
+		end = std::max(end, iter->second);
+		count -= iter->second - iter->first;
+		iter = intervals.erase(iter);
+	}
+	intervals[begin] = end;
+	count += end - begin;
+}
+void IndexSelection::erase(size_t begin, size_t end) {
+	if (begin >= end)
+		return;
+	auto iter = intervals.upper_bound(begin);
+	if (iter != intervals.begin()) {
+		auto prev = std::prev(iter);
+		if (prev->second > begin) {
+			iter = prev;
+		}
+	}
+	while (iter != intervals.end() && iter->first < end) {
+		size_t first = iter->first;
+		size_t last = iter->second;
+		count -= last - first;
+		iter = intervals.erase(iter);
+		if (first < begin) {
+			intervals[first] = begin;
+			count += begin - first;
+		}
+		if (last > end) {
+			intervals[end] = last;
+			count += last - end;
+		}
+	}
+}
+void IndexSelection::truncate(size_t end) {
+	erase(end, std::numeric_limits<size_t>::max());
+}
+bool IndexSelection::contains(size_t index) const {
+	auto iter = intervals.upper_bound(index);
+	if (iter == intervals.begin())
+		return false;
+	return (index < std::prev(iter)->second);
+}
 ListEntry::ListEntry(ListBox* listBox, const std::string& name,
 		float entryHeight) :
 		Composite(name), dialog(listBox), entryHeight(entryHeight) {
 	this->backgroundColor = MakeColor(AlloyApplicationContext()->theme.NEUTRAL);
 	this->borderColor = MakeColor(COLOR_NONE);
 	this->selected = false;
+	this->index = -1;
 	iconCodeString = "";
 	setLabel(name);
 	this->onMouseDown = [this](AlloyContext* context, const InputEvent& e) {
@@ -1596,8 +1654,47 @@ void ListEntry::setIcon(int icon) {
 	position = CoordPX(0.0f, 0.0f);
 	dimensions = CoordPX(tw, entryHeight);
 }
+bool ListBox::onVirtualMouseDown(ListEntry* entry, const InputEvent& e) {
+	if (!e.isDown() || entry->index < 0)
+		return false;
+	size_t index = (size_t) entry->index;
+	if (e.button == GLFW_MOUSE_BUTTON_LEFT) {
+		if (enableMultiSelection) {
+			if (selectedIndices.contains(index) && e.clicks == 1) {
+				selectedIndices.erase(index);
+			} else if (e.isShiftDown() && lastSelectedIndex >= 0) {
+				size_t st = std::min(index, (size_t) lastSelectedIndex);
+				size_t ed = std::max(index, (size_t) lastSelectedIndex);
+				selectedIndices.insert(st, ed + 1);
+				lastSelectedIndex = entry->index;
+			} else {
+				selectedIndices.insert(index);
+				lastSelectedIndex = entry->index;
+			}
+		} else {
+			selectedIndices.clear();
+			selectedIndices.insert(index);
+			lastSelectedIndex = entry->index;
+		}
+		syncSelection();
+		if (onSelect)
+			onSelect(entry, e);
+		return true;
+	} else if (e.button == GLFW_MOUSE_BUTTON_RIGHT) {
+		selectedIndices.clear();
+		lastSelectedIndex = -1;
+		syncSelection();
+		if (onSelect)
+			onSelect(nullptr, e);
+		return true;
+	}
+	return false;
+}
 bool ListBox::onMouseDown(ListEntry* entry, AlloyContext* context,
 		const InputEvent& e) {
+	if (isVirtual()) {
+		return onVirtualMouseDown(entry, e);
+	}
 	if (e.isDown()) {
 		if (e.button == GLFW_MOUSE_BUTTON_LEFT) {
 			if (enableMultiSelection) {
@@ -1975,6 +2072,11 @@ void ListBox::pack(const pixel2& pos, const pixel2& dims, const double2& dpmm,
 	Composite::pack(pos, dims, dpmm, pixelRatio, clamp);
 }
 void ListBox::update() {
+	if (isVirtual()) {
+		//Entries are owned by the content region.
+		dirty = false;
+		return;
+	}
 	clear();
 	lastSelected.clear();
 	AlloyContext* context = AlloyApplicationContext().get();
@@ -1989,6 +2091,71 @@ void ListBox::update() {
 	dirty = false;
 	context->requestPack();
 }
+void ListBox::setEntryProvider(size_t count,
+		const std::function<void(ListEntry* entry, size_t index)>& provider,
+		float entryHeight) {
+	clearEntries();
+	Composite::clear();
+	selectedIndices.clear();
+	lastSelectedIndex = -1;
+	dirty = false;
+	entryProvider = provider;
+	//The content region scrolls instead of the list.
+	setScrollEnabled(false);
+	setOrientation(Orientation::Unspecified, pixel2(0, 0), pixel2(0, 0));
+	virtualRegion = std::shared_ptr<LazyTableComposite>(
+			new LazyTableComposite(getName() + " Entries", CoordPX(0.0f, 0.0f),
+					CoordPercent(1.0f, 1.0f), entryHeight));
+	virtualRegion->setOrientation(Orientation::Vertical, pixel2(0, 2),
+			pixel2(0, 2));
+	virtualRegion->setScrollEnabled(true);
+	virtualRegion->backgroundColor = MakeColor(COLOR_NONE);
+	virtualRegion->borderColor = MakeColor(COLOR_NONE);
+	virtualRegion->onCreateEntry = [this, entryHeight]() {
+		return RegionPtr(new ListEntry(this, "", entryHeight));
+	};
+	virtualRegion->onBindEntry = [this](Region* region, size_t index) {
+		ListEntry* entry = static_cast<ListEntry*>(region);
+		entry->index = (int64_t) index;
+		entry->selected = selectedIndices.contains(index);
+		entryProvider(entry, index);
+		//Entries span the list instead of being sized to their label.
+		entry->dimensions = CoordPerPX(1.0f, 0.0f, 0.0f, entry->entryHeight);
+	};
+	virtualRegion->setVirtualCount(count);
+	Composite::add(virtualRegion);
+	AlloyApplicationContext()->requestPack(this);
+}
+void ListBox::setEntryCount(size_t count) {
+	if (!isVirtual()) {
+		throw std::runtime_error(
+				"Entry count can only be set on a list with an entry provider.");
+	}
+	selectedIndices.truncate(count);
+	if (lastSelectedIndex >= (int64_t) count) {
+		lastSelectedIndex = -1;
+	}
+	virtualRegion->setVirtualCount(count);
+	AlloyApplicationContext()->requestPack(this);
+}
+size_t ListBox::getEntryCount() const {
+	return (isVirtual()) ?
+			virtualRegion->getVirtualCount() : listEntries.size();
+}
+void ListBox::refreshEntries() {
+	if (isVirtual()) {
+		virtualRegion->invalidate();
+		AlloyApplicationContext()->requestPack(virtualRegion.get());
+	}
+}
+void ListBox::syncSelection() {
+	for (RegionPtr region : virtualRegion->getChildren()) {
+		ListEntry* entry = static_cast<ListEntry*>(region.get());
+		if (entry->index >= 0) {
+			entry->selected = selectedIndices.contains((size_t) entry->index);
+		}
+	}
+}
 void ListBox::clearEntries() {
 	for (ListEntryPtr entry : listEntries) {
 		entry->parent = nullptr;
@@ -2007,6 +2174,7 @@ ListBox::ListBox(const std::string& name, const AUnit2D& pos,
 	scrollingUp = false;
 	startItem = -1;
 	endItem = -1;
+	lastSelectedIndex = -1;
 	downOffsetPosition = 0;
 	backgroundColor = MakeColor(AlloyApplicationContext()->theme.LIGHTER);
 	borderColor = MakeColor(AlloyApplicationContext()->theme.DARK);
@@ -2097,6 +2265,10 @@ bool ListBox::onEventHandler(AlloyContext* context, const InputEvent& e) {
 	}
 	if (e.type == InputType::Key) {
 		if (e.isDown() && e.isControlDown() && e.key == GLFW_KEY_A
+				&& enableMultiSelection && isVirtual()) {
+			selectedIndices.insert(0, virtualRegion->getVirtualCount());
+			syncSelection();
+		} else if (e.isDown() && e.isControlDown() && e.key == GLFW_KEY_A
 				&& enableMultiSelection) {
 			for (auto entry : listEntries) {
 				if (!entry->isSelected()) {
@@ -2117,7 +2289,14 @@ bool ListBox::onEventHandler(AlloyContext* context, const InputEvent& e) {
 	}
 	if (e.type == InputType::Cursor || e.type == InputType::MouseButton) {
 		if (context->isMouseDrag() && e.button == GLFW_MOUSE_BUTTON_LEFT) {
-			if (enableMultiSelection) {
+			if (enableMultiSelection && isVirtual()) {
+				if (startItem < 0) {
+					downOffsetPosition = virtualRegion->getExtents().position.y;
+					startItem = (int) virtualRegion->getEntryIndex(
+							context->getCursorDownPosition());
+				}
+				endItem = (int) virtualRegion->getEntryIndex(e.cursor);
+			} else if (enableMultiSelection) {
 				if (startItem < 0) {
 					downOffsetPosition = extents.position.y;
 				}
@@ -2144,7 +2323,17 @@ bool ListBox::onEventHandler(AlloyContext* context, const InputEvent& e) {
 			}
 		} else if (!context->isMouseDown()
 				&& e.type == InputType::MouseButton) {
-			if (enableMultiSelection) {
+			if (enableMultiSelection && isVirtual()) {
+				endItem = (int) virtualRegion->getEntryIndex(e.cursor);
+				if (endItem < startItem) {
+					std::swap(startItem, endItem);
+				}
+				if (startItem >= 0 && e.button == GLFW_MOUSE_BUTTON_LEFT) {
+					selectedIndices.insert((size_t) startItem, (size_t) endItem + 1);
+					lastSelectedIndex = endItem;
+					syncSelection();
+				}
+			} else if (enableMultiSelection) {
 				int index = 0;
 				for (std::shared_ptr<ListEntry> entry : listEntries) {
 					if (entry->getBounds().contains(e.cursor)) {
@@ -2173,6 +2362,11 @@ bool ListBox::onEventHandler(AlloyContext* context, const InputEvent& e) {
 					entry->setSelected(false);
 				}
 				lastSelected.clear();
+				if (isVirtual()) {
+					selectedIndices.clear();
+					lastSelectedIndex = -1;
+					syncSelection();
+				}
 				if (onSelect) {
 					onSelect(nullptr, e);
 				}
@@ -2206,7 +2400,8 @@ bool ListBox::onEventHandler(AlloyContext* context, const InputEvent& e) {
 											double deltaT = 200;
 											scrollingDown = true;
 											while (scrollingDown) {
-												if (!addVerticalScrollPosition(10.0f))break;
+												Composite* scroller = (isVirtual()) ? (Composite*) virtualRegion.get() : this;
+												if (!scroller->addVerticalScrollPosition(10.0f))break;
 												std::this_thread::sleep_for(std::chrono::milliseconds((long)deltaT));
 												deltaT = std::max(30.0, 0.75*deltaT);
 											}
@@ -2230,7 +2425,8 @@ bool ListBox::onEventHandler(AlloyContext* context, const InputEvent& e) {
 											double deltaT = 200;
 											scrollingUp = true;
 											while (scrollingUp) {
-												if (!addVerticalScrollPosition(-10.0f))break;
+												Composite* scroller = (isVirtual()) ? (Composite*) virtualRegion.get() : this;
+												if (!scroller->addVerticalScrollPosition(-10.0f))break;
 												std::this_thread::sleep_for(std::chrono::milliseconds((long)deltaT));
 												deltaT = std::max(30.0, 0.75*deltaT);
 											}
@@ -2260,7 +2456,11 @@ void ListBox::draw(AlloyContext* context) {
 	if (startItem >= 0) {
 		float2 cursorDown = context->getCursorDownPosition();
 		float2 cursorPos = context->getCursorPosition();
-		cursorDown.y += extents.position.y - downOffsetPosition;
+		float scrollOffset =
+				(isVirtual()) ?
+						virtualRegion->getExtents().position.y :
+						extents.position.y;
+		cursorDown.y += scrollOffset - downOffsetPosition;
 		float2 stPt = aly::min(cursorDown, cursorPos);
 		float2 endPt = aly::max(cursorDown, cursorPos);
 		dragBox.position = stPt;
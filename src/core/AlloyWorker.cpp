@@ -23,27 +23,25 @@
 #include "AlloyWorker.h"
 namespace aly {
 WorkerTask::WorkerTask(const std::function<void()>& func) :
-		executionTask(func), endTask() {
+		executionTask(func), endTask(), running(false), complete(false) {
 
 }
 WorkerTask::WorkerTask(const std::function<void()>& func,
 		const std::function<void()>& end) :
-		executionTask(func), endTask(end) {
+		executionTask(func), endTask(end), running(false), complete(false) {
 
 }
 bool WorkerTask::isRunning() const {
 	return running;
 }
 bool WorkerTask::isCanceled() const {
-	return requestCancel;
+	return cancelToken.isCanceled();
 }
 
 bool WorkerTask::isComplete() const {
 	return complete;
 }
 void WorkerTask::task() {
-	running = true;
-	requestCancel = false;
 	if (executionTask) {
 		try {
 			executionTask();
@@ -51,57 +49,74 @@ void WorkerTask::task() {
 
 		}
 	}
-	if (!requestCancel) {
+	if (!cancelToken.isCanceled()) {
 		done();
 	}
-	running = false;
-	requestCancel = false;
 	complete = true;
 }
+void WorkerTask::start() {
+	AlloyDefaultScheduler().submit([this] {
+		{
+			std::lock_guard<std::mutex> lockGuard(stateChange);
+			runner = std::this_thread::get_id();
+		}
+		task();
+		finish();
+	}, priority);
+}
+void WorkerTask::interrupted() {
+}
+void WorkerTask::finish() {
+	//Notify while holding the lock, the task may be destroyed as soon as a waiting cancel() sees it stopped.
+	std::lock_guard<std::mutex> lockGuard(stateChange);
+	running = false;
+	runner = std::thread::id();
+	stateChanged.notify_all();
+}
 void WorkerTask::done() {
 	if (endTask)
 		endTask();
 }
 bool WorkerTask::execute(bool block) {
-	if (stateChange.try_lock()) {
-		if (block) {
-			task();
-		} else {
-			if (workerThread.joinable()) {
-				stateChange.unlock();
-				return false;
-			}
-			workerThread = std::thread(&WorkerTask::task, this);
+	{
+		std::lock_guard<std::mutex> lockGuard(stateChange);
+		if (running) {
+			return false;
 		}
-		stateChange.unlock();
-		return true;
-	} else {
-		return false;
+		running = true;
+		complete = false;
+		cancelToken.reset();
+		if (!block) {
+			start();
+			return true;
+		}
+		runner = std::this_thread::get_id();
 	}
+	task();
+	finish();
+	return true;
 }
 WorkerTask::~WorkerTask() {
 	cancel();
 }
 bool WorkerTask::cancel(bool block) {
-	if (stateChange.try_lock()) {
-		if (block) {
-			if (workerThread.joinable()) {
-				if (!requestCancel) {
-					requestCancel = true;
-					workerThread.join();
-				}
-			} else {
-				stateChange.unlock();
-				return true;
-			}
-		} else {
-			requestCancel = true;
-		}
-		stateChange.unlock();
-		return true;
-	} else {
-		return false;
+	std::unique_lock<std::mutex> lockGuard(stateChange);
+	cancelToken.cancel();
+	if (running && timerId != 0 && AlloyDefaultScheduler().unschedule(timerId)) {
+		timerId = 0;
+		lockGuard.unlock();
+		interrupted();
+		lockGuard.lock();
+		running = false;
+		stateChanged.notify_all();
+	}
+	//A task that cancels itself cannot wait for itself to stop.
+	if (block && runner != std::this_thread::get_id()) {
+		stateChanged.wait(lockGuard, [this] {
+			return !running;
+		});
 	}
+	return true;
 }
 RecurrentTask::RecurrentTask(const std::function<bool(uint64_t)>& func,
 		long timeout) :
@@ -115,10 +130,12 @@ RecurrentTask::RecurrentTask(const std::function<bool(uint64_t)>& func,
 				timeout) {
 
 }
-
+RecurrentTask::~RecurrentTask() {
+	cancel();
+}
 void RecurrentTask::step() {
 	uint64_t iter = 0;
-	while (!requestCancel) {
+	while (!cancelToken.isCanceled()) {
 		auto currentTime = std::chrono::steady_clock::now();
 		if (recurrentTask) {
 			try {
@@ -128,7 +145,7 @@ void RecurrentTask::step() {
 				break;
 			}
 		}
-		if (requestCancel)
+		if (cancelToken.isCanceled())
 			break;
 		auto nextTime = std::chrono::steady_clock::now();
 		//sleep_until has different behavior on Linux and Windows. Use sleep_for instead.
@@ -138,7 +155,44 @@ void RecurrentTask::step() {
 				std::chrono::milliseconds(aly::max(0, (int) (timeout - ms))));
 	}
 }
-
+void RecurrentTask::start() {
+	iteration = 0;
+	AlloyDefaultScheduler().submit([this] {iterate();}, priority);
+}
+void RecurrentTask::iterate() {
+	{
+		std::lock_guard<std::mutex> lockGuard(stateChange);
+		timerId = 0;
+		runner = std::this_thread::get_id();
+	}
+	auto currentTime = std::chrono::steady_clock::now();
+	bool more = !cancelToken.isCanceled();
+	if (more && recurrentTask) {
+		try {
+			more = recurrentTask(iteration++);
+		} catch (std::exception&) {
+			more = false;
+		}
+	}
+	{
+		std::lock_guard<std::mutex> lockGuard(stateChange);
+		runner = std::thread::id();
+		if (more && !cancelToken.isCanceled()) {
+			long long ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+					std::chrono::steady_clock::now() - currentTime).count();
+			timerId = AlloyDefaultScheduler().schedule([this] {iterate();}, aly::max(0, (int) (timeout - ms)), priority);
+			return;
+		}
+	}
+	if (!cancelToken.isCanceled()) {
+		done();
+	}
+	complete = true;
+	finish();
+}
+void RecurrentTask::interrupted() {
+	complete = true;
+}
 TimerTask::TimerTask(const std::function<void()>& successFunc,
 		const std::function<void()>& failureFunc, long timeout,
 		long samplingTime) :
@@ -146,13 +200,12 @@ TimerTask::TimerTask(const std::function<void()>& successFunc,
 				samplingTime) {
 
 }
-
+TimerTask::~TimerTask() {
+	cancel();
+}
 void TimerTask::task() {
-	running = true;
-	requestCancel = false;
-	complete = false;
 	auto currentTime = std::chrono::steady_clock::now();
-	while (!requestCancel) {
+	while (!cancelToken.isCanceled()) {
 		std::this_thread::sleep_for(std::chrono::milliseconds(samplingTime));
 		auto nextTime = std::chrono::steady_clock::now();
 		long long ms = std::chrono::duration_cast<std::chrono::milliseconds>(
@@ -160,7 +213,7 @@ void TimerTask::task() {
 		if (ms >= timeout)
 			break;
 	}
-	if (requestCancel) {
+	if (cancelToken.isCanceled()) {
 		if (endTask)
 			endTask();
 		complete = false;
@@ -173,8 +226,32 @@ void TimerTask::task() {
 
 		}
 	}
-	running = false;
-	requestCancel = false;
 }
+void TimerTask::start() {
+	timerId = AlloyDefaultScheduler().schedule([this] {fire();}, timeout, priority);
 }
+void TimerTask::fire() {
+	{
+		std::lock_guard<std::mutex> lockGuard(stateChange);
+		timerId = 0;
+		runner = std::this_thread::get_id();
+	}
+	if (cancelToken.isCanceled()) {
+		interrupted();
+	} else {
+		try {
+			if (executionTask)
+				executionTask();
+			complete = true;
+		} catch (std::exception&) {
 
+		}
+	}
+	finish();
+}
+void TimerTask::interrupted() {
+	if (endTask)
+		endTask();
+	complete = false;
+}
+}
@@ -22,7 +22,7 @@
 namespace aly {
 	namespace dataflow {
 		//Define operator backwards because priority queue creates a MAX heap.
-		bool ComparePaths::operator()(const std::shared_ptr<AvoidancePath>& b, const std::shared_ptr<AvoidancePath>& a) {
+		bool ComparePaths::operator()(const AvoidancePath* b, const AvoidancePath* a) const {
 			if (a->distToDest == b->distToDest) {
 				if (a->pathLength == b->pathLength) {
 					if(a->depth==b->depth){
@@ -43,14 +43,137 @@ namespace aly {
 				return (a->distToDest < b->distToDest);
 			}
 		}
-		AvoidancePath::AvoidancePath(std::vector<box2px>& obstacles, const float2& from, const float2& to, Direction direction, AvoidancePath* parent) :direction(direction),obstacles(obstacles), parent(parent), path(from, to) {
+		//Pad queries so that touching and round-off intersections are never missed.
+		static const float QUERY_PADDING = 0.5f;
+		static box2f GetSegmentBounds(const lineseg2f& seg) {
+			float2 minPt = aly::min(seg.start, seg.end) - float2(QUERY_PADDING);
+			float2 maxPt = aly::max(seg.start, seg.end) + float2(QUERY_PADDING);
+			return box2f(minPt, maxPt - minPt);
+		}
+		//Inclusive overlap test, box::intersects() ignores boxes that only share an edge.
+		static bool Overlaps(const box2f& a, const box2f& b) {
+			return (a.position.x <= b.position.x + b.dimensions.x && b.position.x <= a.position.x + a.dimensions.x &&
+				a.position.y <= b.position.y + b.dimensions.y && b.position.y <= a.position.y + a.dimensions.y);
+		}
+		static bool Contains(const box2f& outer, const box2f& inner) {
+			return (inner.position.x >= outer.position.x && inner.position.y >= outer.position.y &&
+				inner.position.x + inner.dimensions.x <= outer.position.x + outer.dimensions.x &&
+				inner.position.y + inner.dimensions.y <= outer.position.y + outer.dimensions.y);
+		}
+		int2 ObstacleGrid::getCell(const float2& pt) const {
+			float2 c = (pt - origin) / cellSize;
+			//Also catches NaN, which compares false against both bounds.
+			int x = (c.x >= 0.0f) ? ((c.x < (float)dims.x) ? (int)c.x : dims.x - 1) : 0;
+			int y = (c.y >= 0.0f) ? ((c.y < (float)dims.y) ? (int)c.y : dims.y - 1) : 0;
+			return int2(x, y);
+		}
+		void ObstacleGrid::build(const std::vector<box2px>& b) {
+			boxes = &b;
+			cellStart.clear();
+			cellItems.clear();
+			dims = int2(0, 0);
+			if (b.size() == 0)return;
+			float2 minPt(std::numeric_limits<float>::max());
+			float2 maxPt(-std::numeric_limits<float>::max());
+			float2 avgSize(0.0f);
+			for (const box2px& box : b) {
+				minPt = aly::min(minPt, box.position);
+				maxPt = aly::max(maxPt, box.position + box.dimensions);
+				avgSize += box.dimensions;
+			}
+			avgSize /= (float)b.size();
+			origin = minPt;
+			float2 extent = aly::max(maxPt - minPt, float2(1.0f));
+			//Cells about the size of an average obstacle, so each cell holds a handful of boxes.
+			cellSize = aly::max(aly::max(avgSize, float2(1.0f)), extent / (float)MAX_CELLS);
+			dims = aly::clamp(int2((int)std::ceil(extent.x / cellSize.x), (int)std::ceil(extent.y / cellSize.y)), int2(1), int2(MAX_CELLS));
+			cellStart.assign(dims.x * dims.y + 1, 0);
+			for (const box2px& box : b) {
+				int2 mn = getCell(box.position);
+				int2 mx = getCell(box.position + box.dimensions);
+				for (int j = mn.y; j <= mx.y; j++) {
+					for (int i = mn.x; i <= mx.x; i++) {
+						cellStart[i + j * dims.x + 1]++;
+					}
+				}
+			}
+			for (size_t i = 1; i < cellStart.size(); i++) {
+				cellStart[i] += cellStart[i - 1];
+			}
+			cellItems.resize(cellStart.back());
+			std::vector<int> offsets(cellStart.begin(), cellStart.end() - 1);
+			for (int n = 0; n < (int)b.size(); n++) {
+				const box2px& box = b[n];
+				int2 mn = getCell(box.position);
+				int2 mx = getCell(box.position + box.dimensions);
+				for (int j = mn.y; j <= mx.y; j++) {
+					for (int i = mn.x; i <= mx.x; i++) {
+						cellItems[offsets[i + j * dims.x]++] = n;
+					}
+				}
+			}
+		}
+		void ObstacleGrid::query(const box2f& region, std::vector<int>& indices) const {
+			indices.clear();
+			if (dims.x == 0 || dims.y == 0)return;
+			int2 mn = getCell(region.position);
+			int2 mx = getCell(region.position + region.dimensions);
+			for (int j = mn.y; j <= mx.y; j++) {
+				for (int i = mn.x; i <= mx.x; i++) {
+					int cell = i + j * dims.x;
+					indices.insert(indices.end(), cellItems.begin() + cellStart[cell], cellItems.begin() + cellStart[cell + 1]);
+				}
+			}
+			if (mn != mx) {
+				std::sort(indices.begin(), indices.end());
+				indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+			}
+		}
+		AvoidancePath* AvoidanceSearch::allocate() {
+			if (used == pool.size()) {
+				pool.push_back(std::unique_ptr<AvoidancePath>(new AvoidancePath()));
+			}
+			return pool[used++].get();
+		}
+		void AvoidanceSearch::reset(const ObstacleGrid* g) {
+			grid = g;
+			used = 0;
+			hasExplored = false;
+		}
+		void AvoidanceSearch::explore(const box2f& region) {
+			if (hasExplored) {
+				explored.merge(region);
+			}
+			else {
+				explored = region;
+				hasExplored = true;
+			}
+		}
+		bool AvoidanceSearch::intersects(const lineseg2f& seg, const box2f& region) {
+			explore(region);
+			grid->query(region, candidates);
+			for (int idx : candidates) {
+				if (seg.intersects((*grid)[idx])) {
+					return true;
+				}
+			}
+			return false;
+		}
+		void AvoidancePath::set(AvoidanceSearch* s, const float2& from, const float2& to, Direction dir, AvoidancePath* p) {
+			search = s;
+			direction = dir;
+			parent = p;
+			path = lineseg2f(from, to);
+			obstacle = box2f();
+			borderSpace = 10.0f;
+			children.clear();
 			distToDest = std::numeric_limits<float>::max();
 			depth = 0;
 			pathLength = std::numeric_limits<float>::max();
 			updatePath(to);
 			updateDistToDestination(to);
 		}
-		void AvoidancePath::addChild(const std::shared_ptr<AvoidancePath>& child) {
+		void AvoidancePath::addChild(AvoidancePath* child) {
 			children.push_back(child);
 			child->depth = this->depth + 1;
 		}
@@ -74,8 +197,10 @@ namespace aly {
 		}
 		bool AvoidancePath::createChildren(const float2& to) {
 			if ((direction == Direction::North) || (direction == Direction::South)) {
-				std::shared_ptr<AvoidancePath> east = std::shared_ptr<AvoidancePath>(new AvoidancePath(obstacles, path.end, to, Direction::East, this));
-				std::shared_ptr<AvoidancePath> west = std::shared_ptr<AvoidancePath>(new AvoidancePath(obstacles, path.end, to, Direction::West, this));
+				AvoidancePath* east = search->allocate();
+				east->set(search, path.end, to, Direction::East, this);
+				AvoidancePath* west = search->allocate();
+				west->set(search, path.end, to, Direction::West, this);
 				if ((east->distToDest == 0) || (west->distToDest == 0)) {
 					if (east->distToDest == 0) {
 						addChild(east);
@@ -92,8 +217,10 @@ namespace aly {
 				}
 			}
 			else {
-				std::shared_ptr<AvoidancePath> south = std::shared_ptr<AvoidancePath>(new AvoidancePath(obstacles, path.end, to, Direction::South, this));
-				std::shared_ptr<AvoidancePath> north = std::shared_ptr<AvoidancePath>(new AvoidancePath(obstacles, path.end, to, Direction::North, this));
+				AvoidancePath* south = search->allocate();
+				south->set(search, path.end, to, Direction::South, this);
+				AvoidancePath* north = search->allocate();
+				north->set(search, path.end, to, Direction::North, this);
 				if ((north->distToDest == 0) || (south->distToDest == 0)) {
 					if (north->distToDest == 0) {
 						addChild(north);
@@ -110,10 +237,10 @@ namespace aly {
 				}
 			}
 		}
-		void AvoidancePath::createDescendants(std::vector<std::shared_ptr<AvoidancePath>>& ret, const float2& to, int depth) {
+		void AvoidancePath::createDescendants(std::vector<AvoidancePath*>& ret, const float2& to, int depth) {
 			if (!createChildren(to)) {
 				if (depth != 0) {
-					for (std::shared_ptr<AvoidancePath> child : children) {
+					for (AvoidancePath* child : children) {
 						child->createDescendants(ret, to, depth - 1);
 					}
 				}
@@ -152,12 +279,12 @@ namespace aly {
 				return point;
 			}
 		}
-		void AvoidancePath::getDescendants(std::vector<std::shared_ptr<AvoidancePath>>& ret, int depth) {
+		void AvoidancePath::getDescendants(std::vector<AvoidancePath*>& ret, int depth) {
 			if (depth == 0) {
 				return;
 			}
 			ret.insert(ret.end(), children.begin(), children.end());
-			for (std::shared_ptr<AvoidancePath> child : children) {
+			for (AvoidancePath* child : children) {
 				child->getDescendants(ret, depth - 1);
 			}
 		}
@@ -219,7 +346,14 @@ namespace aly {
 				default:
 					break;
 			}
-			for (box2px obstacle : obstacles) {
+			//Obstacles are visited in list order, so shortening against the last intersecting obstacle matches a linear scan.
+			//Shortening can move the end point outside the queried region, in which case the query is widened and resumed after the current obstacle.
+			std::vector<int>& candidates = search->candidates;
+			box2f region = GetSegmentBounds(path);
+			search->grid->query(region, candidates);
+			for (size_t k = 0; k < candidates.size(); k++) {
+				int idx = candidates[k];
+				const box2px& obstacle = (*search->grid)[idx];
 				if (path.intersects(obstacle)) {
 					switch (direction) {
 					case Direction::South:
@@ -242,16 +376,77 @@ namespace aly {
 						break;
 					}
 					this->obstacle = obstacle;
+					box2f bounds = GetSegmentBounds(path);
+					if (!Contains(region, bounds)) {
+						region.merge(bounds);
+						search->grid->query(region, candidates);
+						k = std::upper_bound(candidates.begin(), candidates.end(), idx) - candidates.begin() - 1;
+					}
 				}
 			}
+			search->explore(region);
 			updatePathLength();
 			return path;
 		}
+		void AvoidanceRouting::invalidate() {
+			version++;
+			invalidVersion = version;
+			dirtyRegions.clear();
+		}
 		void AvoidanceRouting::update() {
 			obstacles.clear();
 			for (AvoidanceNodePtr node : nodes) {
 				obstacles.push_back(node->getObstacleBounds());
 			}
+			grid.build(obstacles);
+			//Record bounds of obstacles that were added, moved, or removed since the last update.
+			std::vector<box2f> changes;
+			std::unordered_map<const AvoidanceNode*, std::pair<int, box2px>> current;
+			current.reserve(nodes.size());
+			bool reordered = false;
+			int lastIndex = -1;
+			for (int n = 0; n < (int)nodes.size(); n++) {
+				const AvoidanceNode* node = nodes[n].get();
+				const box2px& box = obstacles[n];
+				auto iter = lastObstacles.find(node);
+				if (iter == lastObstacles.end()) {
+					changes.push_back(box);
+				}
+				else {
+					if (iter->second.first < lastIndex) {
+						reordered = true;
+					}
+					lastIndex = iter->second.first;
+					if (iter->second.second != box) {
+						changes.push_back(iter->second.second);
+						changes.push_back(box);
+					}
+				}
+				current[node] = std::pair<int, box2px>(n, box);
+			}
+			if (current.size() != nodes.size()) {
+				reordered = true;
+			}
+			for (auto pr : lastObstacles) {
+				if (current.find(pr.first) == current.end()) {
+					changes.push_back(pr.second.second);
+				}
+			}
+			lastObstacles.swap(current);
+			if (reordered) {
+				//Search results depend on obstacle order, so every route must be recomputed.
+				invalidate();
+			}
+			else if (changes.size() > 0) {
+				version++;
+				for (const box2f& box : changes) {
+					dirtyRegions.push_back(std::pair<uint64_t, box2f>(version, box));
+				}
+				while (dirtyRegions.size() > MAX_DIRTY_REGIONS) {
+					invalidVersion = std::max(invalidVersion, dirtyRegions.front().first);
+					dirtyRegions.pop_front();
+				}
+			}
 		}
 		void AvoidanceRouting::erase(const AvoidanceNodePtr& node) {
 			for (auto iter = nodes.begin(); iter != nodes.end(); iter++) {
@@ -280,7 +475,12 @@ namespace aly {
 			update();
 		}
 		void AvoidanceRouting::evaluate(std::vector<float2>& path, float2 from, float2 to, Direction direction) {
+			static thread_local AvoidanceSearch search;
+			evaluate(search, path, from, to, direction);
+		}
+		void AvoidanceRouting::evaluate(AvoidanceSearch& search, std::vector<float2>& path, float2 from, float2 to, Direction direction) {
 			path.clear();
+			search.reset(&grid);
 			float2 origFrom = from;
 			float2 origTo = to;
 			switch (direction) {
@@ -303,13 +503,15 @@ namespace aly {
 			default:
 				break;
 			}
-			std::priority_queue<std::shared_ptr<AvoidancePath>,std::vector<std::shared_ptr<AvoidancePath>>,ComparePaths> queue;
-			std::shared_ptr<AvoidancePath> root = std::shared_ptr<AvoidancePath>(new AvoidancePath(obstacles, from, to, direction));
+			std::priority_queue<AvoidancePath*,std::vector<AvoidancePath*>,ComparePaths> queue;
+			AvoidancePath* root = search.allocate();
+			root->set(&search, from, to, direction);
 			queue.push(root);
-			std::shared_ptr<AvoidancePath> optNode = root;
+			AvoidancePath* optNode = root;
 			int count = 0;
-			std::map<int4,std::shared_ptr<AvoidancePath>> history;
-			std::shared_ptr<AvoidancePath> head;
+			std::unordered_set<int4, HashPathCode> history;
+			AvoidancePath* head;
+			std::vector<AvoidancePath*> children;
 			while ((queue.size() > 0) && (count < MAX_PATHS)) {
 				head = queue.top();
 				queue.pop();
@@ -318,15 +520,14 @@ namespace aly {
 					break;
 				}
 				count++;
-				std::vector<std::shared_ptr<AvoidancePath>> children;
+				children.clear();
 				head->createDescendants(children, to, DEPTH_LIMIT);
-				for (std::shared_ptr<AvoidancePath> child : children) {
+				for (AvoidancePath* child : children) {
 					float2 st = child->path.start;
 					float2 ed = child->path.end;
-					int4 code((int)st.x,(int) st.y,(int) ed.x,(int) ed.y);					
-					if(history.find(code)==history.end()){
+					int4 code((int)st.x,(int) st.y,(int) ed.x,(int) ed.y);
+					if(history.insert(code).second){
 						queue.push(child);
-						history[code]=child;
 					}
 				}
 			}
@@ -340,7 +541,7 @@ namespace aly {
 				else {
 					path.push_back(origTo);
 				}
-				simplifyPath(path, 0);
+				simplifyPath(search, path, 0);
 			}
 			else {
 				if ((optNode->direction == Direction::East) || (optNode->direction == Direction::West)) {
@@ -349,7 +550,7 @@ namespace aly {
 				else {
 					path.push_back(origTo);
 				}
-				simplifyPath(path, 1);
+				simplifyPath(search, path, 1);
 			}
 			if (path.size() == 2) {
 				float x2 = origFrom.x + ((origTo.x - origFrom.x) *0.5f);
@@ -372,15 +573,37 @@ namespace aly {
 			float2 maxPt = aly::max(from, to);
 			return box2px(minPt, maxPt - minPt);
 		}
+		bool AvoidanceRouting::isRouteValid(const AvoidanceConnection& edge, const float2& from, const float2& to, Direction direction) const {
+			if (!edge.routed || edge.routedVersion < invalidVersion || edge.routedBorder != borderSpace || edge.routedDirection != direction || edge.routedFrom != from || edge.routedTo != to) {
+				return false;
+			}
+			for (auto iter = dirtyRegions.rbegin(); iter != dirtyRegions.rend() && iter->first > edge.routedVersion; iter++) {
+				if (Overlaps(iter->second, edge.routedBounds)) {
+					return false;
+				}
+			}
+			return true;
+		}
 		void AvoidanceRouting::evaluate(const std::shared_ptr<AvoidanceConnection>& edge) {
 			std::vector<float2>& path = edge->path;
 			float2 to = edge->getDestinationLocation();
 			float2 from = edge->getSourceLocation();
 			Direction direction = Direction::Unkown;
 			direction = edge->getDirection();
-			evaluate(path, from, to, direction);
+			if (isRouteValid(*edge, from, to, direction)) {
+				return;
+			}
+			static thread_local AvoidanceSearch search;
+			evaluate(search, path, from, to, direction);
+			edge->routed = search.hasExplored;
+			edge->routedVersion = version;
+			edge->routedBorder = borderSpace;
+			edge->routedDirection = direction;
+			edge->routedFrom = from;
+			edge->routedTo = to;
+			edge->routedBounds = search.explored;
 		}
-		void AvoidanceRouting::simplifyPath(std::vector<float2>& path, int parity) {
+		void AvoidanceRouting::simplifyPath(AvoidanceSearch& search, std::vector<float2>& path, int parity) {
 			float2 st, end, stNext, endNext;
 			bool reduce = false;
 			lineseg2f l1, l2;
@@ -395,13 +618,7 @@ namespace aly {
 				}
 				l1 = lineseg2f(path[i + 1], stNext);
 				l2 = lineseg2f(stNext, end);
-				reduce = true;
-				for (box2px obstacle : obstacles) {
-					if (l1.intersects(obstacle) || l2.intersects(obstacle)) {
-						reduce = false;
-						break;
-					}
-				}
+				reduce = !(search.intersects(l1, GetSegmentBounds(l1)) || search.intersects(l2, GetSegmentBounds(l2)));
 				if (reduce) {
 					path[i + 1] = stNext;
 					path.erase(path.begin() + i + 2);
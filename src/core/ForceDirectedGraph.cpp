@@ -842,142 +842,222 @@ void BuoyancyForce::getForce(const ForceItemPtr& item) {
 	float coeff = params[GRAVITATIONAL_CONST] * item->mass * item->buoyancy;
 	item->force += gDirection * coeff;
 }
-void QuadTreeNode::reset() {
-	com = float2(0.0f);
-	mass = 0;
-	hasChildren = false;
-	values.clear();
-	for (QuadTreeNodePtr& child : children) {
-		child.reset();
+static const int MORTON_SORT_CHUNK = 8192;
+static inline uint32_t SpreadMortonBits(uint32_t v) {
+	v &= 0x0000FFFF;
+	v = (v | (v << 8)) & 0x00FF00FF;
+	v = (v | (v << 4)) & 0x0F0F0F0F;
+	v = (v | (v << 2)) & 0x33333333;
+	v = (v | (v << 1)) & 0x55555555;
+	return v;
+}
+void QuadTree::clear() {
+	nodes.clear();
+	codes.clear();
+	sortedCodes.clear();
+	order.clear();
+	locations.clear();
+	masses.clear();
+	items.clear();
+}
+void QuadTree::build(const std::vector<ForceItemPtr>& forceItems,
+		const box2f& bounds) {
+	const int N = (int) forceItems.size();
+	//Keep capacity from previous step so the arena is only grown, never freed.
+	nodes.clear();
+	codes.resize(N);
+	order.resize(N);
+	locations.resize(N);
+	masses.resize(N);
+	items.resize(N);
+	if (N == 0)
+		return;
+	const float cells = (float) (1 << MORTON_BITS);
+	const float2 scale = float2(cells)
+			/ aly::max(bounds.dimensions, float2(1E-6f));
+#pragma omp parallel for
+	for (int i = 0; i < N; i++) {
+		float2 pt = (forceItems[i]->location - bounds.position) * scale;
+		uint32_t x = (uint32_t) aly::clamp((int) pt.x, 0, (1 << MORTON_BITS) - 1);
+		uint32_t y = (uint32_t) aly::clamp((int) pt.y, 0, (1 << MORTON_BITS) - 1);
+		codes[i] = SpreadMortonBits(x) | (SpreadMortonBits(y) << 1);
+		order[i] = i;
+	}
+	//Sort fixed-size chunks in parallel, then merge neighboring runs pairwise in parallel rounds.
+	//Ties are broken by index, so the order does not depend on the thread count.
+	auto mortonLess = [this](int a, int b) {
+		return (codes[a] < codes[b]) || (codes[a] == codes[b] && a < b);
+	};
+	const int chunkCount = (N + MORTON_SORT_CHUNK - 1) / MORTON_SORT_CHUNK;
+#pragma omp parallel for
+	for (int c = 0; c < chunkCount; c++) {
+		std::sort(order.begin() + c * MORTON_SORT_CHUNK,
+				order.begin() + std::min(N, (c + 1) * MORTON_SORT_CHUNK),
+				mortonLess);
+	}
+	for (int width = MORTON_SORT_CHUNK; width < N; width *= 2) {
+		const int pairs = (N + 2 * width - 1) / (2 * width);
+#pragma omp parallel for
+		for (int p = 0; p < pairs; p++) {
+			int begin = p * 2 * width;
+			int mid = std::min(N, begin + width);
+			int end = std::min(N, begin + 2 * width);
+			std::inplace_merge(order.begin() + begin, order.begin() + mid,
+					order.begin() + end, mortonLess);
+		}
+	}
+	sortedCodes.resize(N);
+#pragma omp parallel for
+	for (int i = 0; i < N; i++) {
+		const ForceItem* item = forceItems[order[i]].get();
+		sortedCodes[i] = codes[order[i]];
+		locations[i] = item->location;
+		masses[i] = item->mass;
+		items[i] = item;
+	}
+	codes.swap(sortedCodes);
+	nodes.reserve(2 * N / MAX_LEAFS + 1);
+	build(bounds, 0, 0, N);
+	update(0);
+}
+int QuadTree::build(const box2f& bounds, int depth, int begin, int end) {
+	int index = (int) nodes.size();
+	nodes.push_back(QuadTreeNode(bounds, depth, begin, end));
+	if (end - begin <= MAX_LEAFS || depth >= MAX_DEPTH) {
+		return index;
+	}
+	//Items are sorted by Morton code, so each quadrant is a contiguous sub-range.
+	const int shift = 2 * (MORTON_BITS - 1 - depth);
+	float2 split = bounds.center();
+	int start = begin;
+	for (int i = 0; i < 4; i++) {
+		int stop = (int) (std::upper_bound(codes.begin() + start,
+				codes.begin() + end, i, [shift](int q, uint32_t code) {
+					return q < (int)((code >> shift) & 3);
+				}) - codes.begin());
+		if (stop > start) {
+			float2 pt1 = bounds.position;
+			float2 pt2 = bounds.position + bounds.dimensions;
+			if (i == 1 || i == 3)
+				pt1.x = split.x;
+			else
+				pt2.x = split.x;
+			if (i > 1)
+				pt1.y = split.y;
+			else
+				pt2.y = split.y;
+			int child = build(box2f(pt1, pt2 - pt1), depth + 1, start, stop);
+			nodes[index].children[i] = child;
+		}
+		start = stop;
 	}
+	return index;
 }
-void QuadTreeNode::insert(const ForceItemPtr& p) {
-	if (values.size() < MAX_LEAFS && !hasChildren) {
-		values.push_back(p);
+void QuadTree::update(int index) {
+	QuadTreeNode& node = nodes[index];
+	float mass = 0.0f;
+	float2 com(0.0f);
+	if (node.hasChildren()) {
+		for (int c : node.children) {
+			if (c >= 0) {
+				update(c);
+				mass += nodes[c].mass;
+				com += nodes[c].mass * nodes[c].com;
+			}
+		}
 	} else {
-		if (depth >= MAX_DEPTH) {
-			values.push_back(p);
-		} else {
-			if (!hasChildren) {
-				//move items from leafs into one of the children.
-				values.push_back(p);
-				for (ForceItemPtr& item : values) {
-					float2 pt = item->location;
-					float2 split = bounds.center();
-					int i = (pt.x >= split.x ? 1 : 0)
-							+ (pt.y >= split.y ? 2 : 0);
-					if (children[i].get() == nullptr) {
-						children[i] = QuadTreeNodePtr(new QuadTreeNode());
-						float2 pt1 = bounds.position;
-						float2 pt2 = bounds.position + bounds.dimensions;
-						if (i == 1 || i == 3)
-							pt1.x = split.x;
-						else
-							pt2.x = split.x;
-						if (i > 1)
-							pt1.y = split.y;
-						else
-							pt2.y = split.y;
-						children[i]->bounds = box2f(pt1, pt2 - pt1);
-						children[i]->depth = depth + 1;
-					}
-					children[i]->insert(item);
-				}
-				values.clear();
-				hasChildren = true;
-			} else {
-				float2 pt = p->location;
-				float2 split = bounds.center();
-				int i = (pt.x >= split.x ? 1 : 0) + (pt.y >= split.y ? 2 : 0);
-				if (children[i].get() == nullptr) {
-					children[i] = QuadTreeNodePtr(new QuadTreeNode());
-					float2 pt1 = bounds.position;
-					float2 pt2 = bounds.position + bounds.dimensions;
-					if (i == 1 || i == 3)
-						pt1.x = split.x;
-					else
-						pt2.x = split.x;
-					if (i > 1)
-						pt1.y = split.y;
-					else
-						pt2.y = split.y;
-					children[i]->bounds = box2f(pt1, pt2 - pt1);
-					children[i]->depth = depth + 1;
-				}
-				children[i]->insert(p);
+		for (int i = node.begin; i < node.end; i++) {
+			mass += masses[i];
+			com += masses[i] * locations[i];
+		}
+	}
+	if (mass > 0) {
+		com /= mass;
+	}
+	float3 quad(0.0f);
+	if (node.hasChildren()) {
+		for (int c : node.children) {
+			if (c >= 0) {
+				const QuadTreeNode& child = nodes[c];
+				float2 d = child.com - com;
+				quad += child.quadrupole
+						+ child.mass * float3(d.x * d.x, d.x * d.y, d.y * d.y);
 			}
 		}
+	} else {
+		for (int i = node.begin; i < node.end; i++) {
+			float2 d = locations[i] - com;
+			quad += masses[i] * float3(d.x * d.x, d.x * d.y, d.y * d.y);
+		}
 	}
+	node.mass = mass;
+	node.com = com;
+	node.quadrupole = quad;
 }
 void NBodyForce::clear() {
-	root = QuadTreeNodePtr(new QuadTreeNode());
+	tree.clear();
 }
 void NBodyForce::init(ForceSimulator& fsim) {
-	root.reset(new QuadTreeNode());
 	box2f bounds = fsim.getForceItemBounds();
 	float2 dxy = bounds.dimensions;
 	float2 center = bounds.center();
 	float maxDim = std::max(dxy.x, dxy.y);
-	root->bounds = box2f(center - float2(maxDim * 0.5f), float2(maxDim));
-	root->depth = 0;
-	for (ForceItemPtr item : fsim.getForceItems()) {
-		root->insert(item);
-	}
-	root->update();
-}
-void QuadTreeNode::update() {
-	com = float2(0.0f);
-	mass = 0;
-	for (QuadTreeNodePtr child : children) {
-		if (child.get() != nullptr) {
-			child->update();
-			mass += child->mass;
-			com += child->mass * child->com;
-		}
-	}
-	for (ForceItemPtr item : values) {
-		mass += item->mass;
-		com += item->mass * item->location;
-	}
-	if (mass > 0) {
-		com = com / mass;
-	}
+	tree.build(fsim.getForceItems(),
+			box2f(center - float2(maxDim * 0.5f), float2(maxDim)));
 }
 void NBodyForce::getForce(const ForceItemPtr& item) {
-	std::queue<QuadTreeNode*> q;
-	q.push(root.get());
+	if (tree.empty())
+		return;
+	//Depth first traversal with a fixed stack, since every visited node pushes at most 4 children.
+	int stack[4 * QuadTree::MAX_DEPTH + 4];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
 	double2 forceTotal = double2(0.0f);
 	const float ZERO_TOL = 1E-6f;
-	//if (item->group != nullptr)return;
-	while (q.size() > 0) {
-		QuadTreeNode* n = q.front();
-		q.pop();
-		box2f box = n->bounds;
+	const float2 location = item->location;
+	const float theta = params[BARNES_HUT_THETA];
+	const float minDistance = params[MIN_DISTANCE];
+	while (stackSize > 0) {
+		const QuadTreeNode& n = tree[stack[--stackSize]];
+		const box2f& box = n.bounds;
 		float d = std::max(box.dimensions.x, box.dimensions.y);
-		float2 dxy = n->com - item->location;
+		float2 dxy = n.com - location;
 		double r = length(dxy);
 		//True if distance to center of mass is grater than threshold and thresholding enabled
-		bool minDist = params[MIN_DISTANCE] > 0.0f && r > params[MIN_DISTANCE];
-		if (r > ZERO_TOL && d < params[BARNES_HUT_THETA] * r
-				&& !box.contains(item->location)) {
+		bool minDist = minDistance > 0.0f && r > minDistance;
+		if (r > ZERO_TOL && d < theta * r && !box.contains(location)) {
 			//Make sure box does not contain location or else we'll accumulate force twice
 			if (!minDist) {
-				forceTotal += double2(dxy * n->mass * item->mass) / (r * r * r);
+				double r2 = r * r;
+				double ir3 = 1.0 / (r2 * r);
+				double2 f = double2(dxy) * (double) n.mass * ir3;
+				if (multipole) {
+					double2 dd = double2(dxy);
+					const float3& Q = n.quadrupole;
+					double2 Qd(Q.x * dd.x + Q.y * dd.y, Q.y * dd.x + Q.z * dd.y);
+					double dQd = dot(dd, Qd);
+					double trQ = Q.x + Q.z;
+					double ir5 = ir3 / r2;
+					f += dd * (7.5 * dQd * ir5 / r2 - 1.5 * trQ * ir5)
+							- 3.0 * Qd * ir5;
+				}
+				forceTotal += f * (double) item->mass;
 			}
 		} else {
-			for (QuadTreeNodePtr child : n->children) {
-				if (child.get() != nullptr) {
-					q.push(child.get());
+			if (n.hasChildren()) {
+				for (int c : n.children) {
+					if (c >= 0) {
+						stack[stackSize++] = c;
+					}
 				}
-			}
-			if (!minDist) {
+			} else if (!minDist) {
 				//Add up forces from leaf nodes.
-				for (ForceItemPtr& leaf : n->values) {
-					if (leaf.get() != item.get()) {
-						dxy = leaf->location - item->location;
+				for (int i = n.begin; i < n.end; i++) {
+					if (tree.getItem(i) != item.get()) {
+						dxy = tree.getLocation(i) - location;
 						r = length(dxy);
 						if (r > ZERO_TOL) {
-							forceTotal += double2(dxy * leaf->mass * item->mass)
+							forceTotal += double2(dxy * tree.getMass(i) * item->mass)
 									/ (r * r * r);
 						}
 					}
@@ -988,49 +1068,48 @@ void NBodyForce::getForce(const ForceItemPtr& item) {
 	//apply update to item force
 	item->force += float2(forceTotal * (double) params[GRAVITATIONAL_CONST]);
 }
-void QuadTreeNode::draw(AlloyContext* context, const pixel2& offset,
-		float scale) {
+void QuadTree::draw(AlloyContext* context, const pixel2& offset,
+		float scale) const {
 	static std::vector<Color> colors;
 	if (colors.size() == 0) {
-		colors.resize(QuadTreeNode::MAX_DEPTH);
+		colors.resize(MAX_DEPTH + 1);
 		std::srand(123181);
-		for (int i = 0; i < MAX_DEPTH; i++) {
+		for (int i = 0; i <= MAX_DEPTH; i++) {
 			colors[i] = HSVAtoColor(
 					HSVA((std::rand() % 256) / 255.0f, 0.8f, 0.7f, 1.0f));
 		}
 	}
-	Color c = colors[depth];
 	NVGcontext* nvg = context->nvgContext;
-	nvgFillColor(nvg, c);
-	nvgStrokeColor(nvg, Color(255, 255, 255));
-	nvgStrokeWidth(nvg, scale * 2.0f);
-	nvgBeginPath(nvg);
-	nvgRect(nvg, scale * (bounds.position.x + offset.x),
-			scale * (bounds.position.y + offset.y), scale * bounds.dimensions.x,
-			scale * bounds.dimensions.y);
-	nvgFill(nvg);
-	nvgStroke(nvg);
-	for (QuadTreeNodePtr& child : children) {
-		if (child.get() != nullptr) {
-			child->draw(context, offset, scale);
-		}
-	}
-	nvgFillColor(nvg, c);
-	nvgStrokeColor(nvg, Color(255, 255, 255));
-	if (hasChildren) {
+	//Parents precede children in the node array, so drawing in order layers children on top.
+	for (const QuadTreeNode& node : nodes) {
+		const box2f& bounds = node.bounds;
+		nvgFillColor(nvg, colors[node.depth]);
+		nvgStrokeColor(nvg, Color(255, 255, 255));
+		nvgStrokeWidth(nvg, scale * 2.0f);
 		nvgBeginPath(nvg);
-		nvgCircle(nvg, scale * (com.x + offset.x), scale * (com.y + offset.y),
-				scale * 6.0f);
+		nvgRect(nvg, scale * (bounds.position.x + offset.x),
+				scale * (bounds.position.y + offset.y),
+				scale * bounds.dimensions.x, scale * bounds.dimensions.y);
 		nvgFill(nvg);
 		nvgStroke(nvg);
 	}
+	for (const QuadTreeNode& node : nodes) {
+		if (node.hasChildren()) {
+			nvgFillColor(nvg, colors[node.depth]);
+			nvgStrokeColor(nvg, Color(255, 255, 255));
+			nvgBeginPath(nvg);
+			nvgCircle(nvg, scale * (node.com.x + offset.x),
+					scale * (node.com.y + offset.y), scale * 6.0f);
+			nvgFill(nvg);
+			nvgStroke(nvg);
+		}
+	}
 }
 void NBodyForce::draw(AlloyContext* context, const pixel2& offset,
 		float scale) {
 	if (!enabled || !visible)
 		return;
-	if (root.get() != nullptr)
-		root->draw(context, offset, scale);
+	tree.draw(context, offset, scale);
 }
 
 void CircularWallForce::draw(AlloyContext* context, const pixel2& offset,
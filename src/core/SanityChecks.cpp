@@ -25,6 +25,13 @@
 #include "AlloyLocator.h"
 #include "AlloyDistanceField.h"
 #include "AlloySparseSolve.h"
+#include "AlloyStencilSolve.h"
+#include "TiffVolume.h"
+#include "AlloyEXR.h"
+#include "AlloyScheduler.h"
+#include "AlloyWorker.h"
+#include "AlloyResample.h"
+#include "AlloyPyramid.h"
 #include "AlloyMath.h"
 #include "AlloyImage.h"
 #include "AlloyVector.h"
@@ -33,14 +40,19 @@
 #include "AlloyMesh.h"
 #include "AlloyDenseSolve.h"
 #include "AlloyImageProcessing.h"
+#include "AlloyResultCache.h"
+#include "AlloyDataFlowExecutor.h"
+#include "AvoidanceRouting.h"
 #include "AlloySparseMatrix.h"
 #include "AlloyDenseMatrix.h"
 #include "AlloyArray.h"
 #include "AlloySpline.h"
+#include "AlloyConnectedComponents.h"
 #include "cereal/archives/json.hpp"
 #include <iostream>
 #include <fstream>
 #include <random>
+#include <chrono>
 #ifndef ALY_WINDOWS
 #pragma GCC diagnostic ignored "-Wunused-variable"
 #pragma GCC diagnostic ignored "-Wunused-but-set-variable"
@@ -1020,6 +1032,8 @@ namespace aly {
 		std::cout << im1.updateHashCode(0, HashMethod::SHA256) << std::endl;
 		std::cout << im1.updateHashCode(0, HashMethod::SHA384) << std::endl;
 		std::cout << im1.updateHashCode(0, HashMethod::SHA512) << std::endl;
+		std::cout << im1.updateHashCode(0, HashMethod::FAST64) << std::endl;
+		std::cout << im1.updateHashCode(0, HashMethod::FAST128) << std::endl;
 
 		Integer value1(4);
 		Double value2(3.14159);
@@ -1205,6 +1219,70 @@ namespace aly {
 			return false;
 		}
 	}
+	bool SANITY_CHECK_CONNECTED_COMPONENTS() {
+		//Compare union-find labeling against a breadth first flood fill on random labels.
+		auto floodFill = [](const Image1i& labels, int conn) {
+			const int xShift[8] = { -1, 1, 0, 0, 1, -1, -1, 1 };
+			const int yShift[8] = { 0, 0, -1, 1, -1, 1, -1, 1 };
+			Image1i visited(labels.width, labels.height);
+			visited.set(int1(0));
+			std::vector<int> counts;
+			std::list<int2> queue;
+			for (int j = 0; j < labels.height; j++) {
+				for (int i = 0; i < labels.width; i++) {
+					if (visited(i, j).x)continue;
+					int l = labels(i, j).x;
+					int count = 1;
+					visited(i, j).x = 1;
+					queue.push_back(int2(i, j));
+					while (queue.size() > 0) {
+						int2 v = queue.front();
+						queue.pop_front();
+						for (int s = 0; s < conn; s++) {
+							int2 nbr(v.x + xShift[s], v.y + yShift[s]);
+							if (nbr.x >= 0 && nbr.y >= 0 && nbr.x < labels.width&&nbr.y < labels.height&&!visited(nbr).x&&labels(nbr).x == l) {
+								visited(nbr).x = 1;
+								count++;
+								queue.push_back(nbr);
+							}
+						}
+					}
+					counts.push_back(count);
+				}
+			}
+			return counts;
+		};
+		Image1i labels(311, 257);
+		for (int1& l : labels.data) {
+			l.x = RandomUniform(0, 3);
+		}
+		Image1i outLabels;
+		std::vector<ConnectedComponent2D> comps;
+		bool ret = true;
+		for (Connectivity conn : {Connectivity::Four, Connectivity::Eight}) {
+			std::vector<int> expected = floodFill(labels, (int)conn);
+			LabelConnectedComponents(labels, outLabels, comps, conn);
+			std::cout << "Connected components " << (int)conn << "-connected: " << comps.size() << " / " << expected.size() << std::endl;
+			if (comps.size() != expected.size())ret = false;
+			for (size_t n = 0; n < std::min(comps.size(), expected.size()); n++) {
+				if (comps[n].count != expected[n])ret = false;
+			}
+		}
+		Volume1i vol(48, 40, 32);
+		for (int1& l : vol.data) {
+			l.x = RandomUniform(0, 1);
+		}
+		Volume1i volLabels;
+		std::vector<int> counts;
+		for (Connectivity conn : {Connectivity::Six, Connectivity::TwentySix}) {
+			int N = LabelConnectedComponents(vol, volLabels, counts, conn);
+			size_t total = 0;
+			for (int c : counts)total += c;
+			std::cout << "Connected components " << (int)conn << "-connected: " << N << std::endl;
+			if (total != vol.size())ret = false;
+		}
+		return ret;
+	}
 	bool SANITY_CHECK_UI() {
 		CoordPercent rel(0.5f, 0.75f);
 		CoordDP abs(40, 30);
@@ -1222,6 +1300,555 @@ namespace aly {
 		return true;
 	}
 
+	bool SANITY_CHECK_HASH() {
+		std::string abc = "abc";
+		bool ok = true;
+		ok &= (XXH64(nullptr, 0) == 0xEF46DB3751D8E999ULL);
+		ok &= (XXH64(abc.data(), abc.size()) == 0x44BC2CF5AD770999ULL);
+		ok &= (HashCode(abc.data(), abc.size(), HashMethod::SHA1)
+				== "a9993e364706816aba3e25717850c26c9cd0d89d");
+		std::vector<uint8_t> data(3000);
+		for (size_t i = 0; i < data.size(); i++) {
+			data[i] = (uint8_t) (i * 7 + 3);
+		}
+		for (HashMethod method : { HashMethod::SHA1, HashMethod::FAST64, HashMethod::FAST128,
+				HashMethod::SHA224, HashMethod::SHA256, HashMethod::SHA384, HashMethod::SHA512 }) {
+			//Uneven pieces must match a single update.
+			HashStream stream(method);
+			size_t offset = 0;
+			for (size_t len = 1; offset < data.size(); len = (len * 3) % 97 + 1) {
+				size_t n = std::min(len, data.size() - offset);
+				stream.update(&data[offset], n);
+				offset += n;
+			}
+			std::string streamed = stream.finish();
+			std::string flat = HashCode(data, method, 0);
+			std::string tree = HashCode(data, method, 256);
+			std::cout << streamed << " " << flat << " " << tree << std::endl;
+			ok &= (streamed == flat && tree != flat && tree == HashCode(data, method, 256));
+		}
+		return ok;
+	}
+	bool SANITY_CHECK_RESULT_CACHE() {
+		Image1f img(64, 48);
+		for (int j = 0; j < img.height; j++) {
+			for (int i = 0; i < img.width; i++) {
+				img(i, j) = float1((float) ((i * 17 + j * 31) % 23));
+			}
+		}
+		Image1f expected, result;
+		Smooth(img, expected, 2.0, 2.0);
+		//Unique directory so files from another run cannot turn misses into disk hits.
+		std::string dir = ConcatPath(GetCurrentWorkingDirectory(), MakeString() << "result_cache_"
+				<< std::chrono::steady_clock::now().time_since_epoch().count() << "_" << std::random_device()());
+		bool ok = true;
+		{
+			ResultCache cache(2 * CacheByteSize(expected), dir);
+			Smooth(cache, img, result, 2.0, 2.0);
+			ok &= (cache.getMisses() == 1 && cache.getDiskHits() == 0);
+			result.set(0.0f);
+			Smooth(cache, img, result, 2.0, 2.0);
+			ok &= (cache.getMemoryHits() == 1 && result.data == expected.data);
+			//Different parameters miss; a third result evicts the least recently used.
+			Smooth(cache, img, result, 3.0, 3.0);
+			Smooth(cache, img, result, 4.0, 4.0);
+			ok &= (cache.size() == 2 && cache.getBytesUsed() <= cache.getByteBudget());
+			cache.clear();
+			//The archive on disk holds an Image1f and must not load as another type.
+			Image2f wrongType;
+			ok &= !cache.get(MakeCacheKey("Smooth", ContentKey(img), 2.0, 2.0), wrongType);
+			result.set(0.0f);
+			Smooth(cache, img, result, 2.0, 2.0);
+			ok &= (cache.getDiskHits() == 1 && result.data == expected.data);
+			std::cout << "Result cache memory hits " << cache.getMemoryHits() << " disk hits "
+					<< cache.getDiskHits() << " misses " << cache.getMisses() << std::endl;
+		}
+		ok &= RemoveDirectoryRecursive(dir);
+		return ok;
+	}
+	bool SANITY_CHECK_STENCIL_SOLVE() {
+		const int W = 13, H = 9, D = 7;
+		const int nbrX[] = { 0, 0, -1, 1, 0, 0 };
+		const int nbrY[] = { 0, -1, 0, 0, 1, 0 };
+		const int nbrZ[] = { -1, 0, 0, 0, 0, 1 };
+		StencilSystem<float, 3> A;
+		A.resize(W, H, D);
+		A.weight = float3(0.1f);
+		SparseMatrix3f S(A.size(), A.size());
+		std::vector<float3> b(A.size());
+		for (int k = 0; k < D; k++) {
+			for (int j = 0; j < H; j++) {
+				for (int i = 0; i < W; i++) {
+					size_t idx = i + j * W + k * W * H;
+					A.diagonal[idx] = float3(-1.0f - 0.05f * ((i * 7 + j * 3 + k) % 5));
+					b[idx] = float3((float) ((i + 2 * j) % 3), (float) (j % 4), (float) ((k + i) % 2));
+					S(idx, idx) = A.diagonal[idx];
+					for (int nn = 0; nn < 6; nn++) {
+						int ii = i + nbrX[nn];
+						int jj = j + nbrY[nn];
+						int kk = k + nbrZ[nn];
+						if (ii >= 0 && ii < W && jj >= 0 && jj < H && kk >= 0 && kk < D) {
+							S(idx, ii + jj * W + kk * W * H) = A.weight;
+						}
+					}
+				}
+			}
+		}
+		Vector3f bv(A.size()), xv(A.size());
+		bv.data = b;
+		xv.set(float3(0.0f));
+		std::vector<float3> x(A.size(), float3(0.0f));
+		SolveVecCG(bv, S, xv, 20, 0.0f);
+		SolveStencilCG(A, b, x, 20, 0.0f);
+		float err = 0.0f;
+		for (size_t n = 0; n < x.size(); n++) {
+			err = std::max(err, max(aly::abs(x[n] - xv[n])));
+		}
+		std::vector<float3> y;
+		A.multiply(y, x);
+		float res = 0.0f;
+		for (size_t n = 0; n < x.size(); n++) {
+			res = std::max(res, max(aly::abs(y[n] - b[n])));
+		}
+		std::cout << "Stencil CG difference " << err << " residual " << res << std::endl;
+		return (err < 1E-4f && res < 1E-4f);
+	}
+	bool SANITY_CHECK_TIFF_VOLUME() {
+		Volume1us gray(67, 301, 5);
+		Volume3f color(31, 17, 4);
+		for (size_t i = 0; i < gray.size(); i++) {
+			gray[i] = ushort1((uint16_t) ((i * 37) % 1031 + (i % 67) * 11));
+		}
+		for (size_t i = 0; i < color.size(); i++) {
+			color[i] = float3(0.25f * (i % 31), -0.5f * (i % 13), 1.0f / (1 + i));
+		}
+		std::string file = ConcatPath(GetCurrentWorkingDirectory(), "volume.tif");
+		bool ok = true;
+		for (int level : { -1, 0, 6 }) {
+			Volume1us grayOut;
+			Volume3f colorOut;
+			TiffVolumeHeader header;
+			WriteTiffVolume(file, gray, level);
+			ok &= ReadTiffVolumeHeader(file, header) && header.slices == gray.slices;
+			ok &= ReadTiffVolume(file, grayOut) && grayOut.data == gray.data;
+			ok &= !ReadTiffVolume(file, colorOut);
+			WriteTiffVolume(file, color, level);
+			ok &= ReadTiffVolume(file, colorOut) && colorOut.data == color.data;
+			std::cout << "TIFF volume compression " << level << " " << (ok ? "passed" : "failed") << std::endl;
+		}
+		RemoveFile(file);
+		return ok;
+	}
+	bool SANITY_CHECK_SCHEDULER() {
+		bool ok = true;
+		std::vector<double> values(100003);
+		ParallelFor(0, values.size(), [&values](size_t i) {
+			values[i] = std::sqrt((double) i);
+		}, 1000);
+		double serial = 0.0;
+		for (double v : values) {
+			serial += v;
+		}
+		double sum = ParallelReduce(0, values.size(), 0.0, [&values](size_t b, size_t e, double init) {
+			for (size_t i = b; i < e; i++) {
+				init += values[i];
+			}
+			return init;
+		}, [](double a, double b) {return a + b;});
+		ok &= std::abs(sum - serial) < 1E-6 * serial;
+		//Nested loops must not deadlock when every worker waits on an inner loop.
+		std::atomic<int> nested(0);
+		ParallelFor(0, 64, [&nested](size_t) {
+			ParallelFor(0, 64, [&nested](size_t) {
+				nested++;
+			}, 1);
+		}, 1);
+		ok &= (nested == 64 * 64);
+		Future<int> future = Async([] {return 20;}).then([](const Future<int>& f) {return f.get() + 1;}).then([](const Future<int>& f) {return 2 * f.get();});
+		ok &= (future.get() == 42);
+		Future<void> failed = Async([] {throw std::runtime_error("expected");});
+		try {
+			failed.get();
+			ok = false;
+		} catch (std::runtime_error&) {
+		}
+		TaskGroup group;
+		std::atomic<int> jobs(0);
+		group.cancel();
+		for (int i = 0; i < 100; i++) {
+			group.run([&jobs] {jobs++;});
+		}
+		group.wait();
+		ok &= (jobs == 0);
+		std::vector<WorkerTaskPtr> workers;
+		for (int i = 0; i < 300; i++) {
+			workers.push_back(WorkerTaskPtr(new WorkerTask([&jobs] {jobs++;})));
+			workers.back()->execute();
+		}
+		workers.clear();
+		ok &= (jobs == 300);
+		std::atomic<int> fired(0);
+		TimerTaskPtr timer(new TimerTask([&fired] {fired++;}, nullptr, 10000, 30));
+		timer->execute();
+		auto start = std::chrono::steady_clock::now();
+		timer->cancel();
+		ok &= (fired == 0 && std::chrono::steady_clock::now() - start < std::chrono::seconds(1));
+		RecurrentTaskPtr recurrent(new RecurrentTask([](uint64_t iteration) {return iteration < 4;}, [&fired] {fired++;}, 5));
+		recurrent->execute();
+		while (recurrent->isRunning()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		}
+		ok &= (fired == 1 && recurrent->isComplete());
+		std::cout << "Scheduler with " << AlloyDefaultScheduler().getThreadCount() << " workers " << (ok ? "passed" : "failed") << std::endl;
+		return ok;
+	}
+	bool SANITY_CHECK_RESAMPLE() {
+		bool ok = true;
+		std::mt19937 rng(1234);
+		std::uniform_real_distribution<float> random(0.0f, 1.0f);
+		ImageRGBf image(97, 61);
+		for (float3& c : image.data) {
+			c = float3(random(rng), random(rng), random(rng));
+		}
+		//Bilinear warps must agree with per-pixel interpolation everywhere, including the clamped border.
+		float3x3 H(0.9f, 0.1f, -6.5f, -0.2f, 1.1f, 3.25f, 0.0f, 0.0f, 1.0f);
+		ImageRGBf warped;
+		Warp(image, warped, H, 120, 80);
+		float err = 0.0f;
+		for (int j = 0; j < warped.height; j++) {
+			for (int i = 0; i < warped.width; i++) {
+				float3 pt = H * float3((float) i, (float) j, 1.0f);
+				err = std::max(err, max(abs(warped(i, j) - image(pt.x, pt.y))));
+			}
+		}
+		ok &= (err < 1E-5f);
+		std::cout << "Bilinear warp error " << err << std::endl;
+		std::vector<float2> points;
+		for (int n = 0; n < 1000; n++) {
+			points.push_back(float2(130.0f * random(rng) - 15.0f, 90.0f * random(rng) - 15.0f));
+		}
+		std::vector<float3> colors;
+		Sample(image, points, colors);
+		for (size_t n = 0; n < points.size(); n++) {
+			ok &= (colors[n] == image(points[n].x, points[n].y));
+		}
+		//Higher order filters reproduce a linear ramp away from the border.
+		Image1f ramp(64, 64);
+		for (int j = 0; j < ramp.height; j++) {
+			for (int i = 0; i < ramp.width; i++) {
+				ramp(i, j).x = 0.5f * i - 0.25f * j;
+			}
+		}
+		points.clear();
+		for (int n = 0; n < 500; n++) {
+			points.push_back(float2(4.0f + 55.0f * random(rng), 4.0f + 55.0f * random(rng)));
+		}
+		for (SampleFilter filter : { SampleFilter::Bilinear, SampleFilter::Bicubic, SampleFilter::Lanczos }) {
+			std::vector<float1> values;
+			Sample(ramp, points, values, filter);
+			err = 0.0f;
+			for (size_t n = 0; n < points.size(); n++) {
+				err = std::max(err, std::abs(values[n].x - (0.5f * points[n].x - 0.25f * points[n].y)));
+			}
+			float tol = (filter == SampleFilter::Lanczos) ? 0.05f : 1E-4f;
+			ok &= (err < tol);
+			std::cout << "Filter " << (int) filter << " ramp error " << err << std::endl;
+		}
+		ImageRGB rgb;
+		ConvertImage(image, rgb);
+		ImageRGB nearest;
+		Warp(rgb, nearest, float3x3::identity(), rgb.width, rgb.height, SampleFilter::Nearest);
+		ok &= (nearest.data == rgb.data);
+		//Lens warp matches a precomputed remap.
+		LensDistortion lens(image.width, image.height, 80.0, 82.0, 1.5, -2.0, -0.2, 0.05, 0.0, 0.001, -0.002);
+		Image2f coords;
+		ImageRGBf undistorted, remapped;
+		MakeRemap(lens, image.width, image.height, coords);
+		Warp(image, undistorted, lens);
+		Remap(image, remapped, coords);
+		ok &= (undistorted.data == remapped.data);
+		Volume3f volume(23, 19, 17);
+		for (float3& c : volume.data) {
+			c = float3(random(rng), random(rng), random(rng));
+		}
+		float4x4 M = MakeTranslation(float3(-2.5f, 1.25f, 0.5f)) * MakeRotation(float3(0.0f, 0.0f, 1.0f), 0.1f);
+		Volume3f resampled;
+		Warp(volume, resampled, M, 25, 21, 15);
+		err = 0.0f;
+		for (int k = 0; k < resampled.slices; k++) {
+			for (int j = 0; j < resampled.cols; j++) {
+				for (int i = 0; i < resampled.rows; i++) {
+					float4 pt = M * float4((float) i, (float) j, (float) k, 1.0f);
+					err = std::max(err, max(abs(resampled(i, j, k) - volume(pt.x, pt.y, pt.z))));
+				}
+			}
+		}
+		ok &= (err < 1E-5f);
+		std::cout << "Trilinear warp error " << err << std::endl;
+		std::cout << "Resample " << (ok ? "passed" : "failed") << std::endl;
+		return ok;
+	}
+	bool SANITY_CHECK_IMAGE_PYRAMID() {
+		bool ok = true;
+		std::mt19937 rng(4321);
+		std::uniform_real_distribution<float> random(0.0f, 1.0f);
+		Image4f image(203, 157);
+		for (float4& c : image.data) {
+			c = float4(random(rng), random(rng), random(rng), random(rng));
+		}
+		ImagePyramid4f lazy(image, 5);
+		ImagePyramid4f eager(image, 5, false);
+		Image4f level = image, next, expanded;
+		float err = 0.0f;
+		for (int l = 1; l < lazy.getLevelCount(); l++) {
+			level.downSample(next);
+			level = next;
+			ok &= (lazy.dimensions(l) == level.dimensions());
+			for (int j = 0; j < level.height; j++) {
+				for (int i = 0; i < level.width; i++) {
+					err = std::max(err, max(abs(lazy(l, i, j) - level(i, j))));
+				}
+			}
+			ok &= (lazy.getLevel(l).data == eager.getLevel(l).data);
+			expanded.clear();
+			level.upSample(expanded);
+			next.clear();
+			PyramidUpSample(level, next);
+			for (size_t n = 0; n < next.size(); n++) {
+				err = std::max(err, max(abs(next[n] - expanded[n])));
+			}
+		}
+		ok &= (err < 1E-5f);
+		std::cout << "Pyramid level error " << err << std::endl;
+		//Incremental rebuild of a region must match a full rebuild.
+		box2i region(int2(37, 101), int2(21, 9));
+		for (int j = region.position.y; j < region.max().y; j++) {
+			for (int i = region.position.x; i < region.max().x; i++) {
+				image(i, j) = float4(2.0f);
+			}
+		}
+		eager.update(image, region);
+		eager.refresh();
+		ImagePyramid4f rebuilt(image, 5, false);
+		for (int l = 0; l < eager.getLevelCount(); l++) {
+			ok &= (eager.getLevel(l).data == rebuilt.getLevel(l).data);
+		}
+		LaplacianPyramid<float, 4, ImageType::FLOAT> laplacian(rebuilt);
+		Image4f collapsed;
+		laplacian.collapse(collapsed);
+		err = 0.0f;
+		for (size_t n = 0; n < image.size(); n++) {
+			err = std::max(err, max(abs(collapsed[n] - image[n])));
+		}
+		ok &= (err < 1E-5f);
+		std::cout << "Laplacian reconstruction error " << err << std::endl;
+		//Levels of a shared pyramid can be requested from several threads at once, including from tasks that wait on nested loops.
+		ImageRGB rgb;
+		ConvertImage(image, rgb);
+		ImagePyramidRGB shared(rgb);
+		std::atomic<int> sizes(0);
+		ParallelFor(0, 64, [&](size_t n) {
+			int l = (int) (n % shared.getLevelCount());
+			ParallelFor(0, 4, [&](size_t) {
+				shared.getData(shared.getLevelCount() - 1 - l);
+			}, 1);
+			sizes += (int) shared.getLevel(l).size();
+		}, 1);
+		int expected = 0;
+		for (int n = 0; n < 64; n++) {
+			int2 d = shared.dimensions(n % shared.getLevelCount());
+			expected += d.x * d.y;
+		}
+		ok &= (sizes == expected);
+		std::cout << "Pyramid " << (ok ? "passed" : "failed") << std::endl;
+		return ok;
+	}
+	namespace {
+		//Node with two inputs and one output that needs no UI context.
+		class ExecutorCheckNode: public dataflow::Node {
+		public:
+			ExecutorCheckNode(const std::string& name) :
+					Node(name, pixel2(0.0f, 0.0f)) {
+				inputPortComposite = MakeComposite("Input Ports", CoordPX(0.0f, 0.0f), CoordPX(1.0f, 1.0f));
+				outputPortComposite = MakeComposite("Output Ports", CoordPX(0.0f, 0.0f), CoordPX(1.0f, 1.0f));
+				add(dataflow::MakeInputPort("Input 0"));
+				add(dataflow::MakeInputPort("Input 1"));
+				add(dataflow::MakeOutputPort("Output"));
+			}
+			virtual std::shared_ptr<dataflow::Node> clone() const override {
+				return std::shared_ptr<dataflow::Node>(new ExecutorCheckNode(name));
+			}
+		};
+	}
+	bool SANITY_CHECK_DATAFLOW_EXECUTOR() {
+		using namespace dataflow;
+		bool ok = true;
+		std::shared_ptr<Node> source(new ExecutorCheckNode("Source"));
+		std::shared_ptr<Node> forward(new ExecutorCheckNode("Forward"));
+		std::shared_ptr<Node> modify(new ExecutorCheckNode("Modify"));
+		std::shared_ptr<Node> sink(new ExecutorCheckNode("Sink"));
+		//Source fans out to two consumers, one forwards its input and the other modifies it.
+		MakeConnection(source->getOutputPort(0), forward->getInputPort(0));
+		MakeConnection(source->getOutputPort(0), modify->getInputPort(0));
+		MakeConnection(forward->getOutputPort(0), sink->getInputPort(0));
+		MakeConnection(modify->getOutputPort(0), sink->getInputPort(1));
+		const Image1f* forwarded = nullptr;
+		forward->onExecute = [&forwarded](Node* node) {
+			std::shared_ptr<const PacketImpl<Image1f>> in = node->getInputPort(0)->getPacket<Image1f>();
+			forwarded = &in->get();
+			node->getOutputPort(0)->setValue(MakeSharedPacket("Forward", in->share()));
+		};
+		modify->onExecute = [](Node* node) {
+			std::shared_ptr<PacketImpl<Image1f>> out = MakeSharedPacket("Modify", node->getInputPort(0)->getPacket<Image1f>()->share());
+			out->edit()(0, 0) = float1(5.0f);
+			node->getOutputPort(0)->setValue(out);
+		};
+		float sum = 0.0f;
+		std::atomic<int> sinkRuns(0);
+		sink->onExecute = [&sum, &sinkRuns](Node* node) {
+			sum = node->getInputPort(0)->get<Image1f>()(0, 0).x + node->getInputPort(1)->get<Image1f>()(0, 0).x;
+			sinkRuns++;
+		};
+		std::vector<std::shared_ptr<Node>> graph = { source, forward, modify, sink };
+		Executor executor;
+		executor.setGraph(graph);
+		Image1f image(64, 64);
+		image.set(float1(1.0f));
+		std::shared_ptr<PacketImpl<Image1f>> packet = MakePacket("Image", std::move(image));
+		executor.setValue(source->getOutputPort(0), packet);
+		ok &= (executor.execute() == 4);
+		//Fan-out shares the payload and the modified copy does not leak back to the source or its other consumer.
+		ok &= (forwarded == &packet->get());
+		ok &= (packet->get()(0, 0).x == 1.0f && sum == 6.0f);
+		ok &= (executor.execute() == 0);
+		executor.setDirty(modify.get());
+		ok &= (executor.execute() == 2 && sinkRuns == 2 && sum == 6.0f);
+		//A cycle is rejected and the previous schedule keeps working.
+		std::shared_ptr<Connection> back = MakeConnection(sink->getOutputPort(0), source->getInputPort(0));
+		try {
+			executor.setGraph(graph);
+			ok = false;
+		} catch (std::runtime_error&) {
+		}
+		ok &= (executor.getExecutionOrder().size() == graph.size());
+		executor.setDirty(source.get());
+		ok &= (executor.execute() == 4 && sinkRuns == 3);
+		std::cout << "DataFlow executor " << (ok ? "passed" : "failed") << std::endl;
+		return ok;
+	}
+	namespace {
+		struct RoutingCheckNode: public dataflow::AvoidanceNode {
+			box2px bounds;
+			virtual box2px getObstacleBounds() const override {
+				return bounds;
+			}
+		};
+		struct RoutingCheckConnection: public dataflow::AvoidanceConnection {
+			std::shared_ptr<RoutingCheckNode> source;
+			std::shared_ptr<RoutingCheckNode> destination;
+			dataflow::Direction direction;
+			virtual dataflow::Direction getDirection() const override {
+				return direction;
+			}
+			virtual float2 getSourceLocation() const override {
+				return source->bounds.position + float2(40.0f, 60.0f);
+			}
+			virtual float2 getDestinationLocation() const override {
+				return destination->bounds.position + float2(40.0f, 0.0f);
+			}
+		};
+	}
+	bool SANITY_CHECK_AVOIDANCE_ROUTING() {
+		using namespace dataflow;
+		std::mt19937 rng(11);
+		std::uniform_real_distribution<float> uniform(0.0f, 3000.0f);
+		std::uniform_int_distribution<int> step(-10, 10);
+		const int N = 300;
+		AvoidanceRouting router;
+		std::vector<std::shared_ptr<RoutingCheckNode>> nodes;
+		for (int i = 0; i < N; i++) {
+			std::shared_ptr<RoutingCheckNode> node(new RoutingCheckNode());
+			node->bounds = box2px(float2(uniform(rng), uniform(rng)), float2(80.0f, 60.0f));
+			nodes.push_back(node);
+			router.add(node);
+		}
+		std::vector<std::shared_ptr<RoutingCheckConnection>> connections;
+		for (int i = 0; i < 400; i++) {
+			std::shared_ptr<RoutingCheckConnection> connection(new RoutingCheckConnection());
+			connection->source = nodes[rng() % N];
+			connection->destination = nodes[rng() % N];
+			connection->direction = (i % 5 == 0) ? Direction::East : Direction::South;
+			connections.push_back(connection);
+		}
+		//Incremental re-routing must produce the same routes as routing every connection from scratch.
+		int mismatches = 0;
+		for (int frame = 0; frame < 60; frame++) {
+			int moves = rng() % 4;
+			for (int j = 0; j < moves; j++) {
+				nodes[rng() % N]->bounds.position += float2((float) step(rng), (float) step(rng));
+			}
+			if (frame == 20) {
+				router.erase(std::static_pointer_cast<AvoidanceNode>(nodes[5]));
+			}
+			if (frame == 30) {
+				router.add(nodes[5]);
+			}
+			if (frame == 40) {
+				std::swap(router.nodes[1], router.nodes[2]);
+			}
+			if (frame == 50) {
+				router.setBorderSpacing(15.0f);
+			}
+			router.update();
+			router.evaluate(connections);
+			for (const std::shared_ptr<RoutingCheckConnection>& connection : connections) {
+				std::vector<float2> path;
+				router.evaluate(path, connection->getSourceLocation(), connection->getDestinationLocation(), connection->getDirection());
+				if (path != connection->path) {
+					mismatches++;
+				}
+			}
+		}
+		bool ok = (mismatches == 0);
+		std::cout << "Avoidance routing mismatches " << mismatches << " " << (ok ? "passed" : "failed") << std::endl;
+		return ok;
+	}
+	bool SANITY_CHECK_EXR() {
+		ImageRGBAf color(83, 71);
+		Image4h colorHalf;
+		for (size_t i = 0; i < color.size(); i++) {
+			color[i] = float4(0.25f * (i % 83), -0.5f * (i % 13), 1.0f / (1 + i), (i % 7) * 0.125f);
+		}
+		ConvertImage(color, colorHalf);
+		std::string file = ConcatPath(GetCurrentWorkingDirectory(), "image.exr");
+		box2i region(int2(17, 29), int2(40, 33));
+		bool ok = true;
+		for (EXRCompression compression : { EXRCompression::Uncompressed, EXRCompression::RLE, EXRCompression::ZIPS,
+				EXRCompression::ZIP }) {
+			for (int tileSize : { 0, 16 }) {
+				ImageRGBAf colorOut;
+				Image4h halfOut;
+				Image1h alpha;
+				ImageRGBf crop;
+				WriteEXRImage(file, color, compression, tileSize);
+				ReadEXRImage(file, colorOut);
+				ok &= (colorOut.data == color.data);
+				ReadEXRImage(file, crop, { }, region);
+				ok &= (crop.width == region.dimensions.x && crop.height == region.dimensions.y);
+				ok &= (crop(0, 0) == color(region.position.x, region.position.y).xyz());
+				ok &= (crop(39, 32) == color(region.position.x + 39, region.position.y + 32).xyz());
+				WriteEXRImage(file, colorHalf, compression, tileSize);
+				ReadEXRImage(file, halfOut);
+				ok &= (halfOut.data == colorHalf.data);
+				ReadEXRImage(file, alpha, { "A" });
+				ok &= (alpha(5, 7).x == colorHalf(5, 7).w);
+				std::cout << "EXR compression " << (int) compression << " tile " << tileSize << " "
+						<< (ok ? "passed" : "failed") << std::endl;
+			}
+		}
+		RemoveFile(file);
+		return ok;
+	}
 #ifndef WIN32
 	bool SANITY_CHECK_FILE_IO() {
 		try {
@@ -0,0 +1,1120 @@
+/*
+ * Copyright(C) 2018, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "TiffVolume.h"
+#include "AlloyCommon.h"
+#include "AlloyMemMappedFile.h"
+#include "stb_image.h"
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <algorithm>
+#include <stdexcept>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+//Deflate encoder provided by the stb_image_write implementation in AlloyImage.cpp
+unsigned char * stbi_zlib_compress(unsigned char *data, int data_len, int *out_len, int quality);
+namespace aly {
+namespace detail {
+enum TiffConstants {
+	TIFF_TAG_SUBFILE_TYPE = 254,
+	TIFF_TAG_WIDTH = 256,
+	TIFF_TAG_HEIGHT = 257,
+	TIFF_TAG_BITS_PER_SAMPLE = 258,
+	TIFF_TAG_COMPRESSION = 259,
+	TIFF_TAG_PHOTOMETRIC = 262,
+	TIFF_TAG_STRIP_OFFSETS = 273,
+	TIFF_TAG_SAMPLES_PER_PIXEL = 277,
+	TIFF_TAG_ROWS_PER_STRIP = 278,
+	TIFF_TAG_STRIP_BYTE_COUNTS = 279,
+	TIFF_TAG_PLANAR_CONFIG = 284,
+	TIFF_TAG_PAGE_NUMBER = 297,
+	TIFF_TAG_PREDICTOR = 317,
+	TIFF_TAG_TILE_WIDTH = 322,
+	TIFF_TAG_TILE_OFFSETS = 324,
+	TIFF_TAG_EXTRA_SAMPLES = 338,
+	TIFF_TAG_SAMPLE_FORMAT = 339,
+	TIFF_TYPE_BYTE = 1,
+	TIFF_TYPE_SHORT = 3,
+	TIFF_TYPE_LONG = 4,
+	TIFF_TYPE_LONG8 = 16,
+	TIFF_COMPRESSION_NONE = 1,
+	TIFF_COMPRESSION_LZW = 5,
+	TIFF_COMPRESSION_DEFLATE = 8,
+	TIFF_COMPRESSION_ADOBE_DEFLATE = 32946,
+	TIFF_COMPRESSION_PACKBITS = 32773,
+	TIFF_PREDICTOR_NONE = 1,
+	TIFF_PREDICTOR_HORIZONTAL = 2,
+	TIFF_PREDICTOR_FLOAT = 3,
+	TIFF_SAMPLE_UINT = 1,
+	TIFF_SAMPLE_INT = 2,
+	TIFF_SAMPLE_FLOAT = 3,
+	TIFF_SAMPLE_VOID = 4
+};
+static const int LZW_CLEAR = 256;
+static const int LZW_EOI = 257;
+static const int LZW_FIRST = 258;
+static const int LZW_MAX_CODES = 4096;
+static const size_t TIFF_STRIP_BYTES = 1 << 16;
+static bool IsHostLittleEndian() {
+	const uint16_t one = 1;
+	return *((const uint8_t*) &one) == 1;
+}
+static void SwapSampleBytes(uint8_t* data, size_t samples, int bytesPerSample) {
+	if (bytesPerSample <= 1)
+		return;
+	for (size_t i = 0; i < samples; i++) {
+		std::reverse(data, data + bytesPerSample);
+		data += bytesPerSample;
+	}
+}
+struct TiffPage {
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t bitsPerSample = 1;
+	uint32_t samplesPerPixel = 1;
+	uint32_t compression = TIFF_COMPRESSION_NONE;
+	uint32_t predictor = TIFF_PREDICTOR_NONE;
+	uint32_t sampleFormat = TIFF_SAMPLE_UINT;
+	uint32_t planarConfig = 1;
+	uint32_t rowsPerStrip = 0xFFFFFFFF;
+	bool tiled = false;
+	bool reduced = false;
+	std::vector<uint64_t> stripOffsets;
+	std::vector<uint64_t> stripByteCounts;
+	int getBytesPerSample() const {
+		return (int) (bitsPerSample / 8);
+	}
+	int getStripsPerPlane() const {
+		return (int) ((height + rowsPerStrip - 1) / rowsPerStrip);
+	}
+	ImageType getType() const {
+		switch (bitsPerSample) {
+		case 8:
+			return (sampleFormat == TIFF_SAMPLE_INT) ? ImageType::BYTE : ImageType::UBYTE;
+		case 16:
+			return (sampleFormat == TIFF_SAMPLE_INT) ? ImageType::SHORT : ImageType::USHORT;
+		case 32:
+			if (sampleFormat == TIFF_SAMPLE_FLOAT)
+				return ImageType::FLOAT;
+			return (sampleFormat == TIFF_SAMPLE_INT) ? ImageType::INT : ImageType::UINT;
+		case 64:
+			return (sampleFormat == TIFF_SAMPLE_FLOAT) ? ImageType::DOUBLE : ImageType::UNKNOWN;
+		default:
+			return ImageType::UNKNOWN;
+		}
+	}
+};
+/*
+ * Read-only view of a memory mapped TIFF. Every access is bounds checked so
+ * truncated or malformed files throw instead of reading past the mapping.
+ */
+struct TiffFileView {
+	const uint8_t* data = nullptr;
+	size_t size = 0;
+	bool swap = false;
+	bool bigTiff = false;
+	void check(uint64_t offset, uint64_t length) const {
+		if (offset > size || length > size - offset) {
+			throw std::runtime_error("TIFF offset out of range.");
+		}
+	}
+	template<class V> V read(uint64_t offset) const {
+		check(offset, sizeof(V));
+		V v;
+		std::memcpy(&v, data + offset, sizeof(V));
+		if (swap)
+			SwapSampleBytes((uint8_t*) &v, 1, sizeof(V));
+		return v;
+	}
+	uint64_t readValue(uint64_t offset, int type) const {
+		switch (type) {
+		case 1:
+		case 2:
+		case 6:
+		case 7:
+			return read<uint8_t>(offset);
+		case 3:
+		case 8:
+			return read<uint16_t>(offset);
+		case 4:
+		case 9:
+		case 13:
+			return read<uint32_t>(offset);
+		case 16:
+		case 17:
+		case 18:
+			return read<uint64_t>(offset);
+		default:
+			return 0;
+		}
+	}
+	static int typeSize(int type) {
+		switch (type) {
+		case 1:
+		case 2:
+		case 6:
+		case 7:
+			return 1;
+		case 3:
+		case 8:
+			return 2;
+		case 4:
+		case 9:
+		case 11:
+		case 13:
+			return 4;
+		case 5:
+		case 10:
+		case 12:
+		case 16:
+		case 17:
+		case 18:
+			return 8;
+		default:
+			return 0;
+		}
+	}
+};
+static bool OpenTiffFileView(const ReadableMemMapFile& mmf, TiffFileView& view, uint64_t& firstIFD) {
+	if (!mmf.isOpen() || mmf.data() == nullptr || mmf.getFileSize() < 8) {
+		return false;
+	}
+	view.data = (const uint8_t*) mmf.data();
+	view.size = mmf.getFileSize();
+	bool little;
+	if (view.data[0] == 'I' && view.data[1] == 'I') {
+		little = true;
+	} else if (view.data[0] == 'M' && view.data[1] == 'M') {
+		little = false;
+	} else {
+		return false;
+	}
+	view.swap = (little != IsHostLittleEndian());
+	uint16_t magic = view.read<uint16_t>(2);
+	if (magic == 42) {
+		view.bigTiff = false;
+		firstIFD = view.read<uint32_t>(4);
+	} else if (magic == 43) {
+		if (view.size < 16 || view.read<uint16_t>(4) != 8 || view.read<uint16_t>(6) != 0) {
+			return false;
+		}
+		view.bigTiff = true;
+		firstIFD = view.read<uint64_t>(8);
+	} else {
+		return false;
+	}
+	return true;
+}
+/*
+ * Walks the IFD chain once and records the strip layout of every full
+ * resolution page. Reduced resolution subfiles such as thumbnails are skipped.
+ */
+static void IndexTiffPages(const TiffFileView& view, uint64_t offset, std::vector<TiffPage>& pages) {
+	std::set<uint64_t> visited;
+	const uint64_t entrySize = view.bigTiff ? 20 : 12;
+	const uint64_t inlineSize = view.bigTiff ? 8 : 4;
+	pages.clear();
+	while (offset != 0) {
+		if (!visited.insert(offset).second) {
+			throw std::runtime_error("TIFF directory chain is cyclic.");
+		}
+		uint64_t entries = view.bigTiff ? view.read<uint64_t>(offset) : view.read<uint16_t>(offset);
+		uint64_t entryStart = offset + (view.bigTiff ? 8 : 2);
+		if (entries > view.size / entrySize) {
+			throw std::runtime_error("TIFF directory is truncated.");
+		}
+		view.check(entryStart, entries * entrySize + inlineSize);
+		TiffPage page;
+		std::vector<uint64_t> values;
+		for (uint64_t e = 0; e < entries; e++) {
+			uint64_t pos = entryStart + e * entrySize;
+			uint16_t tag = view.read<uint16_t>(pos);
+			uint16_t type = view.read<uint16_t>(pos + 2);
+			uint64_t count = view.bigTiff ? view.read<uint64_t>(pos + 4) : view.read<uint32_t>(pos + 4);
+			uint64_t valuePos = pos + (view.bigTiff ? 12 : 8);
+			int tsize = TiffFileView::typeSize(type);
+			if (tsize == 0 || count == 0 || count > view.size / tsize) {
+				continue;
+			}
+			uint64_t dataPos = valuePos;
+			if (count * tsize > inlineSize) {
+				dataPos = view.bigTiff ? view.read<uint64_t>(valuePos) : view.read<uint32_t>(valuePos);
+			}
+			switch (tag) {
+			case TIFF_TAG_STRIP_OFFSETS:
+			case TIFF_TAG_STRIP_BYTE_COUNTS:
+			case TIFF_TAG_BITS_PER_SAMPLE:
+			case TIFF_TAG_SAMPLE_FORMAT:
+				view.check(dataPos, count * tsize);
+				values.resize(count);
+				for (uint64_t n = 0; n < count; n++) {
+					values[n] = view.readValue(dataPos + n * tsize, type);
+				}
+				break;
+			default:
+				values.assign(1, view.readValue(dataPos, type));
+				break;
+			}
+			switch (tag) {
+			case TIFF_TAG_SUBFILE_TYPE:
+				page.reduced = (values[0] & 1) != 0;
+				break;
+			case TIFF_TAG_WIDTH:
+				page.width = (uint32_t) values[0];
+				break;
+			case TIFF_TAG_HEIGHT:
+				page.height = (uint32_t) values[0];
+				break;
+			case TIFF_TAG_BITS_PER_SAMPLE:
+				page.bitsPerSample = (uint32_t) values[0];
+				for (uint64_t v : values) {
+					if (v != values[0])
+						throw std::runtime_error("TIFF samples with mixed bit depths are unsupported.");
+				}
+				break;
+			case TIFF_TAG_COMPRESSION:
+				page.compression = (uint32_t) values[0];
+				break;
+			case TIFF_TAG_SAMPLES_PER_PIXEL:
+				page.samplesPerPixel = (uint32_t) values[0];
+				break;
+			case TIFF_TAG_ROWS_PER_STRIP:
+				page.rowsPerStrip = (uint32_t) values[0];
+				break;
+			case TIFF_TAG_PLANAR_CONFIG:
+				page.planarConfig = (uint32_t) values[0];
+				break;
+			case TIFF_TAG_PREDICTOR:
+				page.predictor = (uint32_t) values[0];
+				break;
+			case TIFF_TAG_SAMPLE_FORMAT:
+				page.sampleFormat = (uint32_t) values[0];
+				if (page.sampleFormat == TIFF_SAMPLE_VOID)
+					page.sampleFormat = TIFF_SAMPLE_UINT;
+				break;
+			case TIFF_TAG_STRIP_OFFSETS:
+				page.stripOffsets = values;
+				break;
+			case TIFF_TAG_STRIP_BYTE_COUNTS:
+				page.stripByteCounts = values;
+				break;
+			case TIFF_TAG_TILE_WIDTH:
+			case TIFF_TAG_TILE_OFFSETS:
+				page.tiled = true;
+				break;
+			default:
+				break;
+			}
+		}
+		offset = view.bigTiff ?
+				view.read<uint64_t>(entryStart + entries * entrySize) :
+				view.read<uint32_t>(entryStart + entries * entrySize);
+		if (page.reduced) {
+			continue;
+		}
+		if (page.tiled) {
+			throw std::runtime_error("Tiled TIFF pages are unsupported.");
+		}
+		if (page.width == 0 || page.height == 0 || page.samplesPerPixel == 0) {
+			throw std::runtime_error("TIFF page has no image data.");
+		}
+		if (page.rowsPerStrip == 0 || page.rowsPerStrip > page.height) {
+			page.rowsPerStrip = page.height;
+		}
+		size_t strips = (size_t) page.getStripsPerPlane() * (page.planarConfig == 2 ? page.samplesPerPixel : 1);
+		if (page.stripOffsets.size() < strips || page.stripByteCounts.size() < strips) {
+			throw std::runtime_error("TIFF page is missing strips.");
+		}
+		pages.push_back(page);
+	}
+	if (pages.size() == 0) {
+		throw std::runtime_error("TIFF file contains no pages.");
+	}
+	const TiffPage& first = pages.front();
+	for (const TiffPage& page : pages) {
+		if (page.width != first.width || page.height != first.height
+				|| page.samplesPerPixel != first.samplesPerPixel
+				|| page.bitsPerSample != first.bitsPerSample
+				|| page.sampleFormat != first.sampleFormat) {
+			throw std::runtime_error("TIFF pages differ in size or format.");
+		}
+	}
+}
+static void PackBitsDecode(const uint8_t* src, size_t srcLen, uint8_t* dst, size_t dstLen) {
+	const uint8_t* end = src + srcLen;
+	size_t pos = 0;
+	while (src < end && pos < dstLen) {
+		int n = (int8_t) *src++;
+		if (n >= 0) {
+			size_t len = std::min((size_t) n + 1, std::min((size_t) (end - src), dstLen - pos));
+			std::memcpy(dst + pos, src, len);
+			src += n + 1;
+			pos += len;
+		} else if (n != -128) {
+			if (src >= end)
+				break;
+			size_t len = std::min((size_t) (1 - n), dstLen - pos);
+			std::memset(dst + pos, *src++, len);
+			pos += len;
+		}
+	}
+	if (pos < dstLen) {
+		std::memset(dst + pos, 0, dstLen - pos);
+	}
+}
+/*
+ * TIFF flavor of LZW: codes are packed most significant bit first and the code
+ * width grows one code early. Dictionary strings are kept as (start, length)
+ * references into the already decoded output, since every new string is the
+ * previous string extended by one byte that immediately follows it.
+ */
+static void LzwDecode(const uint8_t* src, size_t srcLen, uint8_t* dst, size_t dstLen) {
+	if (srcLen >= 2 && src[0] == 0 && (src[1] & 0x1) != 0) {
+		throw std::runtime_error("Old-style TIFF LZW is unsupported.");
+	}
+	std::vector<uint32_t> start(LZW_MAX_CODES);
+	std::vector<uint32_t> length(LZW_MAX_CODES);
+	size_t srcPos = 0;
+	uint32_t bitBuffer = 0;
+	int bitCount = 0;
+	int width = 9;
+	int next = LZW_FIRST;
+	bool started = false;
+	size_t pos = 0, prevPos = 0, prevLen = 0;
+	auto readCode = [&]() {
+		while (bitCount < width) {
+			if (srcPos >= srcLen)
+				return LZW_EOI;
+			bitBuffer = (bitBuffer << 8) | src[srcPos++];
+			bitCount += 8;
+		}
+		bitCount -= width;
+		return (int) ((bitBuffer >> bitCount) & ((1u << width) - 1));
+	};
+	while (pos < dstLen) {
+		int code = readCode();
+		if (code == LZW_EOI) {
+			break;
+		}
+		if (code == LZW_CLEAR) {
+			width = 9;
+			next = LZW_FIRST;
+			started = false;
+			continue;
+		}
+		size_t curPos = pos, curLen;
+		if (code < 256) {
+			dst[pos++] = (uint8_t) code;
+			curLen = 1;
+		} else if (started && code < next) {
+			curLen = length[code];
+			size_t len = std::min(curLen, dstLen - pos);
+			const uint8_t* str = dst + start[code];
+			for (size_t n = 0; n < len; n++) {
+				dst[pos++] = str[n];
+			}
+		} else if (started && code == next) {
+			curLen = prevLen + 1;
+			size_t len = std::min(prevLen, dstLen - pos);
+			for (size_t n = 0; n < len; n++) {
+				dst[pos++] = dst[prevPos + n];
+			}
+			if (pos < dstLen) {
+				dst[pos++] = dst[prevPos];
+			}
+		} else {
+			throw std::runtime_error("Corrupt TIFF LZW strip.");
+		}
+		if (started && next < LZW_MAX_CODES) {
+			start[next] = (uint32_t) prevPos;
+			length[next] = (uint32_t) (prevLen + 1);
+			next++;
+			if (next >= (1 << width) - 1 && width < 12) {
+				width++;
+			}
+		}
+		started = true;
+		prevPos = curPos;
+		prevLen = curLen;
+	}
+	if (pos < dstLen) {
+		std::memset(dst + pos, 0, dstLen - pos);
+	}
+}
+/*
+ * Encoder matching libtiff's code width schedule, including the table reset
+ * at 4094 entries and the final width bump before the end of information code.
+ */
+static void LzwEncode(const uint8_t* src, size_t srcLen, std::vector<uint8_t>& out) {
+	const int HASH_BITS = 13;
+	const uint32_t HASH_MASK = (1u << HASH_BITS) - 1;
+	std::vector<int32_t> keys(1 << HASH_BITS, -1);
+	std::vector<uint16_t> codes(1 << HASH_BITS);
+	uint32_t bitBuffer = 0;
+	int bitCount = 0;
+	int width = 9;
+	int next = LZW_FIRST;
+	out.clear();
+	out.reserve(srcLen / 2 + 16);
+	auto writeCode = [&](int code) {
+		bitBuffer = (bitBuffer << width) | (uint32_t) code;
+		bitCount += width;
+		while (bitCount >= 8) {
+			bitCount -= 8;
+			out.push_back((uint8_t) (bitBuffer >> bitCount));
+		}
+	};
+	if (srcLen > 0) {
+		writeCode(LZW_CLEAR);
+		int ent = src[0];
+		for (size_t i = 1; i < srcLen; i++) {
+			int c = src[i];
+			int32_t key = (c << 12) | ent;
+			uint32_t h = ((uint32_t) key * 2654435761u) >> (32 - HASH_BITS);
+			bool found = false;
+			while (keys[h] != -1) {
+				if (keys[h] == key) {
+					found = true;
+					break;
+				}
+				h = (h + 1) & HASH_MASK;
+			}
+			if (found) {
+				ent = codes[h];
+				continue;
+			}
+			writeCode(ent);
+			ent = c;
+			keys[h] = key;
+			codes[h] = (uint16_t) next;
+			next++;
+			if (next == LZW_MAX_CODES - 2) {
+				std::fill(keys.begin(), keys.end(), -1);
+				writeCode(LZW_CLEAR);
+				width = 9;
+				next = LZW_FIRST;
+			} else if (next > (1 << width) - 1) {
+				width++;
+			}
+		}
+		writeCode(ent);
+		next++;
+		if (next == LZW_MAX_CODES - 2) {
+			writeCode(LZW_CLEAR);
+			width = 9;
+		} else if (next > (1 << width) - 1) {
+			width++;
+		}
+	}
+	writeCode(LZW_EOI);
+	if (bitCount > 0) {
+		out.push_back((uint8_t) (bitBuffer << (8 - bitCount)));
+	}
+}
+template<class U> void HorizontalAccumulate(uint8_t* row, size_t samples, int stride) {
+	U* ptr = (U*) row;
+	for (size_t i = stride; i < samples; i++) {
+		ptr[i] = (U) (ptr[i] + ptr[i - stride]);
+	}
+}
+template<class U> void HorizontalDifference(uint8_t* row, size_t samples, int stride) {
+	U* ptr = (U*) row;
+	for (size_t i = samples - 1; i >= (size_t) stride; i--) {
+		ptr[i] = (U) (ptr[i] - ptr[i - stride]);
+	}
+}
+/*
+ * Floating point predictor: samples are split into byte planes, most
+ * significant first, and differenced bytewise across the whole row.
+ */
+static void FloatAccumulate(uint8_t* row, size_t samples, int stride, int bytesPerSample,
+		std::vector<uint8_t>& tmp) {
+	size_t bytes = samples * bytesPerSample;
+	for (size_t i = stride; i < bytes; i++) {
+		row[i] = (uint8_t) (row[i] + row[i - stride]);
+	}
+	tmp.assign(row, row + bytes);
+	bool little = IsHostLittleEndian();
+	for (size_t i = 0; i < samples; i++) {
+		for (int b = 0; b < bytesPerSample; b++) {
+			row[bytesPerSample * i + b] = tmp[(little ? (bytesPerSample - b - 1) : b) * samples + i];
+		}
+	}
+}
+static void FloatDifference(uint8_t* row, size_t samples, int stride, int bytesPerSample,
+		std::vector<uint8_t>& tmp) {
+	size_t bytes = samples * bytesPerSample;
+	tmp.resize(bytes);
+	bool little = IsHostLittleEndian();
+	for (size_t i = 0; i < samples; i++) {
+		for (int b = 0; b < bytesPerSample; b++) {
+			tmp[(little ? (bytesPerSample - b - 1) : b) * samples + i] = row[bytesPerSample * i + b];
+		}
+	}
+	std::memcpy(row, tmp.data(), bytes);
+	for (size_t i = bytes - 1; i >= (size_t) stride; i--) {
+		row[i] = (uint8_t) (row[i] - row[i - stride]);
+	}
+}
+static void UndoPredictor(uint8_t* data, int rows, size_t rowSamples, int stride, int bytesPerSample,
+		int predictor, bool swap, std::vector<uint8_t>& tmp) {
+	size_t rowBytes = rowSamples * bytesPerSample;
+	if (predictor == TIFF_PREDICTOR_FLOAT) {
+		//Byte planes are big endian regardless of file byte order.
+		for (int r = 0; r < rows; r++) {
+			FloatAccumulate(data + r * rowBytes, rowSamples, stride, bytesPerSample, tmp);
+		}
+		return;
+	}
+	if (swap) {
+		SwapSampleBytes(data, rowSamples * rows, bytesPerSample);
+	}
+	if (predictor == TIFF_PREDICTOR_HORIZONTAL) {
+		for (int r = 0; r < rows; r++) {
+			uint8_t* row = data + r * rowBytes;
+			switch (bytesPerSample) {
+			case 1:
+				HorizontalAccumulate<uint8_t>(row, rowSamples, stride);
+				break;
+			case 2:
+				HorizontalAccumulate<uint16_t>(row, rowSamples, stride);
+				break;
+			case 4:
+				HorizontalAccumulate<uint32_t>(row, rowSamples, stride);
+				break;
+			case 8:
+				HorizontalAccumulate<uint64_t>(row, rowSamples, stride);
+				break;
+			}
+		}
+	} else if (predictor != TIFF_PREDICTOR_NONE) {
+		throw std::runtime_error(MakeString() << "TIFF predictor " << predictor << " unsupported.");
+	}
+}
+static void DecodeStrip(const TiffFileView& view, const TiffPage& page, size_t strip, uint8_t* dst,
+		int rows, size_t rowSamples, int stride, std::vector<uint8_t>& tmp) {
+	const int bytesPerSample = page.getBytesPerSample();
+	const size_t dstLen = rows * rowSamples * bytesPerSample;
+	uint64_t offset = page.stripOffsets[strip];
+	uint64_t count = page.stripByteCounts[strip];
+	view.check(offset, count);
+	const uint8_t* src = view.data + offset;
+	switch (page.compression) {
+	case TIFF_COMPRESSION_NONE:
+		std::memcpy(dst, src, std::min((size_t) count, dstLen));
+		if (count < dstLen) {
+			std::memset(dst + count, 0, dstLen - count);
+		}
+		break;
+	case TIFF_COMPRESSION_PACKBITS:
+		PackBitsDecode(src, count, dst, dstLen);
+		break;
+	case TIFF_COMPRESSION_LZW:
+		LzwDecode(src, count, dst, dstLen);
+		break;
+	case TIFF_COMPRESSION_DEFLATE:
+	case TIFF_COMPRESSION_ADOBE_DEFLATE: {
+		int len = stbi_zlib_decode_buffer((char*) dst, (int) dstLen, (const char*) src, (int) count);
+		if (len < 0) {
+			throw std::runtime_error(MakeString() << "Corrupt TIFF deflate strip " << strip << ".");
+		}
+		if ((size_t) len < dstLen) {
+			std::memset(dst + len, 0, dstLen - len);
+		}
+	}
+		break;
+	default:
+		throw std::runtime_error(MakeString() << "TIFF compression " << page.compression << " unsupported.");
+	}
+	UndoPredictor(dst, rows, rowSamples, stride, bytesPerSample, page.predictor, view.swap, tmp);
+}
+static bool ReadTiffIndex(const ReadableMemMapFile& mmf, TiffFileView& view, std::vector<TiffPage>& pages) {
+	uint64_t firstIFD = 0;
+	if (!OpenTiffFileView(mmf, view, firstIFD)) {
+		return false;
+	}
+	IndexTiffPages(view, firstIFD, pages);
+	return true;
+}
+template<class T, int C, ImageType I> bool ReadTiffVolumeInternal(const std::string& file,
+		Volume<T, C, I>& vol) {
+	ReadableMemMapFile mmf(file);
+	TiffFileView view;
+	std::vector<TiffPage> pages;
+	if (!ReadTiffIndex(mmf, view, pages)) {
+		return false;
+	}
+	const TiffPage& first = pages.front();
+	if (first.samplesPerPixel != C || first.getType() != I || first.bitsPerSample != sizeof(T) * 8) {
+		return false;
+	}
+	const int width = (int) first.width;
+	const int height = (int) first.height;
+	vol.resize(width, height, (int) pages.size());
+	const size_t sliceSamples = (size_t) width * height * C;
+	//Flatten (page, strip) pairs so small stacks of large pages and large stacks of small pages both load balance.
+	std::vector<std::pair<int, int>> jobs;
+	for (int k = 0; k < (int) pages.size(); k++) {
+		const TiffPage& page = pages[k];
+		int strips = page.getStripsPerPlane() * (page.planarConfig == 2 ? C : 1);
+		for (int s = 0; s < strips; s++) {
+			jobs.push_back(std::pair<int, int>(k, s));
+		}
+	}
+	std::string error;
+#pragma omp parallel
+	{
+		std::vector<uint8_t> tmp;
+		std::vector<T> plane;
+#pragma omp for schedule(dynamic)
+		for (int n = 0; n < (int) jobs.size(); n++) {
+			try {
+				const TiffPage& page = pages[jobs[n].first];
+				T* slice = vol.ptr() + jobs[n].first * sliceSamples;
+				int stripsPerPlane = page.getStripsPerPlane();
+				int s = jobs[n].second % stripsPerPlane;
+				int channel = jobs[n].second / stripsPerPlane;
+				int y0 = s * (int) page.rowsPerStrip;
+				int rows = std::min((int) page.rowsPerStrip, height - y0);
+				if (page.planarConfig == 2) {
+					plane.resize((size_t) rows * width);
+					DecodeStrip(view, page, jobs[n].second, (uint8_t*) plane.data(), rows, width, 1, tmp);
+					T* out = slice + (size_t) y0 * width * C + channel;
+					for (size_t i = 0; i < plane.size(); i++) {
+						out[i * C] = plane[i];
+					}
+				} else {
+					DecodeStrip(view, page, jobs[n].second, (uint8_t*) (slice + (size_t) y0 * width * C), rows,
+							(size_t) width * C, C, tmp);
+				}
+			} catch (std::exception& e) {
+#pragma omp critical(TiffVolumeError)
+				{
+					if (error.size() == 0)
+						error = e.what();
+				}
+			}
+		}
+	}
+	if (error.size() > 0) {
+		throw std::runtime_error(MakeString() << "Could not read " << file << ": " << error);
+	}
+	return true;
+}
+struct TiffEntry {
+	uint16_t tag;
+	uint16_t type;
+	uint64_t count;
+	std::vector<uint8_t> payload;
+	TiffEntry(uint16_t tag, uint16_t type, const std::vector<uint64_t>& values) :
+			tag(tag), type(type), count(values.size()) {
+		int tsize = TiffFileView::typeSize(type);
+		payload.resize(count * tsize);
+		set(values);
+	}
+	void set(const std::vector<uint64_t>& values) {
+		int tsize = TiffFileView::typeSize(type);
+		for (size_t i = 0; i < values.size(); i++) {
+			uint8_t* ptr = &payload[i * tsize];
+			if (tsize == 2) {
+				uint16_t v = (uint16_t) values[i];
+				std::memcpy(ptr, &v, 2);
+			} else if (tsize == 4) {
+				uint32_t v = (uint32_t) values[i];
+				std::memcpy(ptr, &v, 4);
+			} else {
+				std::memcpy(ptr, &values[i], 8);
+			}
+		}
+	}
+};
+template<class V> void AppendValue(std::vector<uint8_t>& buffer, V v) {
+	size_t sz = buffer.size();
+	buffer.resize(sz + sizeof(V));
+	std::memcpy(&buffer[sz], &v, sizeof(V));
+}
+static void EncodeStrip(const uint8_t* src, int rows, size_t rowSamples, int stride, int bytesPerSample,
+		int compression, int predictor, int level, std::vector<uint8_t>& out, std::vector<uint8_t>& tmp) {
+	size_t rowBytes = rowSamples * bytesPerSample;
+	size_t bytes = rows * rowBytes;
+	if (compression == TIFF_COMPRESSION_NONE) {
+		out.assign(src, src + bytes);
+		return;
+	}
+	std::vector<uint8_t> data(src, src + bytes);
+	for (int r = 0; r < rows; r++) {
+		uint8_t* row = data.data() + r * rowBytes;
+		if (predictor == TIFF_PREDICTOR_FLOAT) {
+			FloatDifference(row, rowSamples, stride, bytesPerSample, tmp);
+		} else if (predictor == TIFF_PREDICTOR_HORIZONTAL) {
+			switch (bytesPerSample) {
+			case 1:
+				HorizontalDifference<uint8_t>(row, rowSamples, stride);
+				break;
+			case 2:
+				HorizontalDifference<uint16_t>(row, rowSamples, stride);
+				break;
+			case 4:
+				HorizontalDifference<uint32_t>(row, rowSamples, stride);
+				break;
+			case 8:
+				HorizontalDifference<uint64_t>(row, rowSamples, stride);
+				break;
+			}
+		}
+	}
+	if (compression == TIFF_COMPRESSION_LZW) {
+		LzwEncode(data.data(), data.size(), out);
+	} else {
+		int len = 0;
+		unsigned char* zdata = stbi_zlib_compress(data.data(), (int) data.size(), &len, level);
+		if (zdata == nullptr) {
+			throw std::runtime_error("Could not deflate TIFF strip.");
+		}
+		out.assign(zdata, zdata + len);
+		free(zdata);
+	}
+}
+template<class T, int C, ImageType I> bool WriteTiffVolumeInternal(const std::string& file,
+		const Volume<T, C, I>& vol, int compressionLevel) {
+	const int width = vol.rows;
+	const int height = vol.cols;
+	const int depth = vol.slices;
+	if (width <= 0 || height <= 0 || depth <= 0) {
+		throw std::runtime_error(MakeString() << "Can't write empty volume to " << file);
+	}
+	int sampleFormat;
+	switch (I) {
+	case ImageType::BYTE:
+	case ImageType::SHORT:
+	case ImageType::INT:
+		sampleFormat = TIFF_SAMPLE_INT;
+		break;
+	case ImageType::HALF:
+	case ImageType::FLOAT:
+	case ImageType::DOUBLE:
+		sampleFormat = TIFF_SAMPLE_FLOAT;
+		break;
+	default:
+		sampleFormat = TIFF_SAMPLE_UINT;
+		break;
+	}
+	const int bytesPerSample = sizeof(T);
+	const int compression = (compressionLevel < 0) ? TIFF_COMPRESSION_LZW :
+							(compressionLevel == 0) ? TIFF_COMPRESSION_NONE : TIFF_COMPRESSION_ADOBE_DEFLATE;
+	const int predictor = (compression == TIFF_COMPRESSION_NONE) ? TIFF_PREDICTOR_NONE :
+							(sampleFormat == TIFF_SAMPLE_FLOAT) ? TIFF_PREDICTOR_FLOAT : TIFF_PREDICTOR_HORIZONTAL;
+	const int level = std::min(std::max(compressionLevel, 1), 9);
+	const size_t rowSamples = (size_t) width * C;
+	const size_t rowBytes = rowSamples * bytesPerSample;
+	const size_t pageBytes = rowBytes * height;
+	const int rowsPerStrip = (int) std::min((size_t) height, std::max((size_t) 1, TIFF_STRIP_BYTES / rowBytes));
+	const int stripsPerPage = (height + rowsPerStrip - 1) / rowsPerStrip;
+	//LZW can expand incompressible data by up to 50%.
+	const uint64_t worstCase = (uint64_t) pageBytes * depth * 3 / 2 + (uint64_t) depth * (1024 + 16 * stripsPerPage);
+	const bool bigTiff = worstCase >= 0xFFFFFFFFULL;
+	const uint64_t inlineSize = bigTiff ? 8 : 4;
+	const uint16_t offsetType = bigTiff ? TIFF_TYPE_LONG8 : TIFF_TYPE_LONG;
+	std::ofstream os(file, std::ios::out | std::ios::binary);
+	if (!os.is_open()) {
+		throw std::runtime_error(MakeString() << "Can't open " << file);
+	}
+	std::vector<uint8_t> buffer;
+	bool little = IsHostLittleEndian();
+	buffer.push_back(little ? 'I' : 'M');
+	buffer.push_back(little ? 'I' : 'M');
+	if (bigTiff) {
+		AppendValue<uint16_t>(buffer, 43);
+		AppendValue<uint16_t>(buffer, 8);
+		AppendValue<uint16_t>(buffer, 0);
+		AppendValue<uint64_t>(buffer, 16);
+	} else {
+		AppendValue<uint16_t>(buffer, 42);
+		AppendValue<uint32_t>(buffer, 8);
+	}
+	os.write((const char*) buffer.data(), buffer.size());
+	uint64_t position = buffer.size();
+#ifdef _OPENMP
+	int threads = omp_get_max_threads();
+#else
+	int threads = 1;
+#endif
+	//Compress a batch of pages at a time to bound memory for large stacks.
+	const int batch = (int) std::max((size_t) 1, std::min((size_t) (2 * threads), ((size_t) 256 << 20) / pageBytes));
+	std::vector<std::vector<uint8_t>> strips((size_t) batch * stripsPerPage);
+	std::string error;
+	for (int k0 = 0; k0 < depth; k0 += batch) {
+		const int k1 = std::min(depth, k0 + batch);
+		const int jobs = (k1 - k0) * stripsPerPage;
+#pragma omp parallel
+		{
+			std::vector<uint8_t> tmp;
+#pragma omp for schedule(dynamic)
+			for (int n = 0; n < jobs; n++) {
+				try {
+					int k = k0 + n / stripsPerPage;
+					int y0 = (n % stripsPerPage) * rowsPerStrip;
+					int rows = std::min(rowsPerStrip, height - y0);
+					const uint8_t* src = (const uint8_t*) (vol.ptr() + (size_t) k * pageBytes / bytesPerSample
+							+ (size_t) y0 * rowSamples);
+					EncodeStrip(src, rows, rowSamples, C, bytesPerSample, compression, predictor, level, strips[n],
+							tmp);
+				} catch (std::exception& e) {
+#pragma omp critical(TiffVolumeError)
+					{
+						if (error.size() == 0)
+							error = e.what();
+					}
+				}
+			}
+		}
+		if (error.size() > 0) {
+			throw std::runtime_error(MakeString() << "Could not write " << file << ": " << error);
+		}
+		for (int k = k0; k < k1; k++) {
+			std::vector<uint64_t> offsets(stripsPerPage), counts(stripsPerPage);
+			for (int s = 0; s < stripsPerPage; s++) {
+				counts[s] = strips[(k - k0) * stripsPerPage + s].size();
+			}
+			std::vector<TiffEntry> entries;
+			entries.push_back(TiffEntry(TIFF_TAG_WIDTH, TIFF_TYPE_LONG, { (uint64_t) width }));
+			entries.push_back(TiffEntry(TIFF_TAG_HEIGHT, TIFF_TYPE_LONG, { (uint64_t) height }));
+			entries.push_back(TiffEntry(TIFF_TAG_BITS_PER_SAMPLE, TIFF_TYPE_SHORT,
+					std::vector<uint64_t>(C, bytesPerSample * 8)));
+			entries.push_back(TiffEntry(TIFF_TAG_COMPRESSION, TIFF_TYPE_SHORT, { (uint64_t) compression }));
+			entries.push_back(TiffEntry(TIFF_TAG_PHOTOMETRIC, TIFF_TYPE_SHORT, { (uint64_t) (C >= 3 ? 2 : 1) }));
+			entries.push_back(TiffEntry(TIFF_TAG_STRIP_OFFSETS, offsetType, offsets));
+			entries.push_back(TiffEntry(TIFF_TAG_SAMPLES_PER_PIXEL, TIFF_TYPE_SHORT, { (uint64_t) C }));
+			entries.push_back(TiffEntry(TIFF_TAG_ROWS_PER_STRIP, TIFF_TYPE_LONG, { (uint64_t) rowsPerStrip }));
+			entries.push_back(TiffEntry(TIFF_TAG_STRIP_BYTE_COUNTS, offsetType, counts));
+			entries.push_back(TiffEntry(TIFF_TAG_PLANAR_CONFIG, TIFF_TYPE_SHORT, { 1 }));
+			entries.push_back(TiffEntry(TIFF_TAG_PAGE_NUMBER, TIFF_TYPE_SHORT, { (uint64_t) k, (uint64_t) depth }));
+			if (predictor != TIFF_PREDICTOR_NONE) {
+				entries.push_back(TiffEntry(TIFF_TAG_PREDICTOR, TIFF_TYPE_SHORT, { (uint64_t) predictor }));
+			}
+			if (C == 2 || C == 4) {
+				entries.push_back(TiffEntry(TIFF_TAG_EXTRA_SAMPLES, TIFF_TYPE_SHORT, { 0 }));
+			}
+			entries.push_back(TiffEntry(TIFF_TAG_SAMPLE_FORMAT, TIFF_TYPE_SHORT,
+					std::vector<uint64_t>(C, sampleFormat)));
+			//Lay out the directory, then out-of-line values, then strip data.
+			uint64_t ifdSize = bigTiff ? (8 + entries.size() * 20 + 8) : (2 + entries.size() * 12 + 4);
+			uint64_t end = position + ifdSize;
+			std::vector<uint64_t> valueOffsets(entries.size(), 0);
+			for (size_t e = 0; e < entries.size(); e++) {
+				if (entries[e].payload.size() > inlineSize) {
+					valueOffsets[e] = end;
+					end += (entries[e].payload.size() + 1) & ~((uint64_t) 1);
+				}
+			}
+			for (int s = 0; s < stripsPerPage; s++) {
+				offsets[s] = end;
+				end += counts[s];
+			}
+			const bool pad = (end & 1) != 0;
+			end += (pad ? 1 : 0);
+			for (TiffEntry& entry : entries) {
+				if (entry.tag == TIFF_TAG_STRIP_OFFSETS) {
+					entry.set(offsets);
+				}
+			}
+			uint64_t nextIFD = (k + 1 < depth) ? end : 0;
+			buffer.clear();
+			if (bigTiff) {
+				AppendValue<uint64_t>(buffer, entries.size());
+			} else {
+				AppendValue<uint16_t>(buffer, (uint16_t) entries.size());
+			}
+			for (size_t e = 0; e < entries.size(); e++) {
+				const TiffEntry& entry = entries[e];
+				AppendValue<uint16_t>(buffer, entry.tag);
+				AppendValue<uint16_t>(buffer, entry.type);
+				if (bigTiff) {
+					AppendValue<uint64_t>(buffer, entry.count);
+				} else {
+					AppendValue<uint32_t>(buffer, (uint32_t) entry.count);
+				}
+				if (entry.payload.size() > inlineSize) {
+					if (bigTiff) {
+						AppendValue<uint64_t>(buffer, valueOffsets[e]);
+					} else {
+						AppendValue<uint32_t>(buffer, (uint32_t) valueOffsets[e]);
+					}
+				} else {
+					size_t sz = buffer.size();
+					buffer.resize(sz + inlineSize, 0);
+					std::memcpy(&buffer[sz], entry.payload.data(), entry.payload.size());
+				}
+			}
+			if (bigTiff) {
+				AppendValue<uint64_t>(buffer, nextIFD);
+			} else {
+				AppendValue<uint32_t>(buffer, (uint32_t) nextIFD);
+			}
+			for (const TiffEntry& entry : entries) {
+				if (entry.payload.size() > inlineSize) {
+					buffer.insert(buffer.end(), entry.payload.begin(), entry.payload.end());
+					if (entry.payload.size() & 1)
+						buffer.push_back(0);
+				}
+			}
+			os.write((const char*) buffer.data(), buffer.size());
+			for (int s = 0; s < stripsPerPage; s++) {
+				std::vector<uint8_t>& strip = strips[(k - k0) * stripsPerPage + s];
+				os.write((const char*) strip.data(), strip.size());
+				std::vector<uint8_t>().swap(strip);
+			}
+			if (pad) {
+				os.put(0);
+			}
+			position = end;
+		}
+	}
+	if (!os.good()) {
+		throw std::runtime_error(MakeString() << "Could not write " << file);
+	}
+	os.close();
+	return true;
+}
+}
+using namespace detail;
+bool ReadTiffVolumeHeader(const std::string& file, TiffVolumeHeader& header) {
+	ReadableMemMapFile mmf(file);
+	TiffFileView view;
+	std::vector<TiffPage> pages;
+	if (!ReadTiffIndex(mmf, view, pages)) {
+		return false;
+	}
+	const TiffPage& first = pages.front();
+	header.width = (int) first.width;
+	header.height = (int) first.height;
+	header.slices = (int) pages.size();
+	header.channels = (int) first.samplesPerPixel;
+	header.bitsPerSample = (int) first.bitsPerSample;
+	header.compression = (int) first.compression;
+	header.type = first.getType();
+	header.bigTiff = view.bigTiff;
+	return true;
+}
+bool ReadTiffVolume(const std::string& file, Volume1ub& vol) {
+	return ReadTiffVolumeInternal(file, vol);
+}
+bool ReadTiffVolume(const std::string& file, Volume2ub& vol) {
+	return ReadTiffVolumeInternal(file, vol);
+}
+bool ReadTiffVolume(const std::string& file, Volume3ub& vol) {
+	return ReadTiffVolumeInternal(file, vol);
+}
+bool ReadTiffVolume(const std::string& file, Volume4ub& vol) {
+	return ReadTiffVolumeInternal(file, vol);
+}
+bool ReadTiffVolume(const std::string& file, Volume1b& vol) {
+	return ReadTiffVolumeInternal(file, vol);
+}
+bool ReadTiffVolume(const std::string& file, Volume1us& vol) {
+	return ReadTiffVolumeInternal(file, vol);
+}
+bool ReadTiffVolume(const std::string& file, Volume2us& vol) {
+	return ReadTiffVolumeInternal(file, vol);
+}
+bool ReadTiffVolume(const std::string& file, Volume3us& vol) {
+	return ReadTiffVolumeInternal(file, vol);
+}
+bool ReadTiffVolume(const std::string& file, Volume4us& vol) {
+	return ReadTiffVolumeInternal(file, vol);
+}
+bool ReadTiffVolume(const std::string& file, Volume1s& vol) {
+	return ReadTiffVolumeInternal(file, vol);
+}
+bool ReadTiffVolume(const std::string& file, Volume1i& vol) {
+	return ReadTiffVolumeInternal(file, vol);
+}
+bool ReadTiffVolume(const std::string& file, Volume1ui& vol) {
+	return ReadTiffVolumeInternal(file, vol);
+}
+bool ReadTiffVolume(const std::string& file, Volume1f& vol) {
+	return ReadTiffVolumeInternal(file, vol);
+}
+bool ReadTiffVolume(const std::string& file, Volume2f& vol) {
+	return ReadTiffVolumeInternal(file, vol);
+}
+bool ReadTiffVolume(const std::string& file, Volume3f& vol) {
+	return ReadTiffVolumeInternal(file, vol);
+}
+bool ReadTiffVolume(const std::string& file, Volume4f& vol) {
+	return ReadTiffVolumeInternal(file, vol);
+}
+bool ReadTiffVolume(const std::string& file, Volume1d& vol) {
+	return ReadTiffVolumeInternal(file, vol);
+}
+bool WriteTiffVolume(const std::string& file, const Volume1ub& vol, int compressionLevel) {
+	return WriteTiffVolumeInternal(file, vol, compressionLevel);
+}
+bool WriteTiffVolume(const std::string& file, const Volume2ub& vol, int compressionLevel) {
+	return WriteTiffVolumeInternal(file, vol, compressionLevel);
+}
+bool WriteTiffVolume(const std::string& file, const Volume3ub& vol, int compressionLevel) {
+	return WriteTiffVolumeInternal(file, vol, compressionLevel);
+}
+bool WriteTiffVolume(const std::string& file, const Volume4ub& vol, int compressionLevel) {
+	return WriteTiffVolumeInternal(file, vol, compressionLevel);
+}
+bool WriteTiffVolume(const std::string& file, const Volume1b& vol, int compressionLevel) {
+	return WriteTiffVolumeInternal(file, vol, compressionLevel);
+}
+bool WriteTiffVolume(const std::string& file, const Volume1us& vol, int compressionLevel) {
+	return WriteTiffVolumeInternal(file, vol, compressionLevel);
+}
+bool WriteTiffVolume(const std::string& file, const Volume2us& vol, int compressionLevel) {
+	return WriteTiffVolumeInternal(file, vol, compressionLevel);
+}
+bool WriteTiffVolume(const std::string& file, const Volume3us& vol, int compressionLevel) {
+	return WriteTiffVolumeInternal(file, vol, compressionLevel);
+}
+bool WriteTiffVolume(const std::string& file, const Volume4us& vol, int compressionLevel) {
+	return WriteTiffVolumeInternal(file, vol, compressionLevel);
+}
+bool WriteTiffVolume(const std::string& file, const Volume1s& vol, int compressionLevel) {
+	return WriteTiffVolumeInternal(file, vol, compressionLevel);
+}
+bool WriteTiffVolume(const std::string& file, const Volume1i& vol, int compressionLevel) {
+	return WriteTiffVolumeInternal(file, vol, compressionLevel);
+}
+bool WriteTiffVolume(const std::string& file, const Volume1ui& vol, int compressionLevel) {
+	return WriteTiffVolumeInternal(file, vol, compressionLevel);
+}
+bool WriteTiffVolume(const std::string& file, const Volume1f& vol, int compressionLevel) {
+	return WriteTiffVolumeInternal(file, vol, compressionLevel);
+}
+bool WriteTiffVolume(const std::string& file, const Volume2f& vol, int compressionLevel) {
+	return WriteTiffVolumeInternal(file, vol, compressionLevel);
+}
+bool WriteTiffVolume(const std::string& file, const Volume3f& vol, int compressionLevel) {
+	return WriteTiffVolumeInternal(file, vol, compressionLevel);
+}
+bool WriteTiffVolume(const std::string& file, const Volume4f& vol, int compressionLevel) {
+	return WriteTiffVolumeInternal(file, vol, compressionLevel);
+}
+bool WriteTiffVolume(const std::string& file, const Volume1d& vol, int compressionLevel) {
+	return WriteTiffVolumeInternal(file, vol, compressionLevel);
+}
+}
@@ -70,6 +70,10 @@ template<class T, int C, ImageType I> bool WriteTiffImageInternal(const std::str
 		m_bitspersample = 64;
 		sampformat = SAMPLEFORMAT_IEEEFP;
 		break;
+	case ImageType::HALF:
+		m_bitspersample = 16;
+		sampformat = SAMPLEFORMAT_IEEEFP;
+		break;
 	default:
 		throw std::runtime_error("Image type unsupported.");
 		break;
@@ -20,6 +20,7 @@
 #include <iomanip>
 #include <fstream>
 #include <vector>
+#include <algorithm>
 
 /* Help macros */
 #define SHA1_ROL(value, bits) (((value) << (bits)) | (((value) & 0xffffffff) >> (32 - (bits))))
@@ -37,8 +38,33 @@ SHA1::SHA1() {
 }
 
 void SHA1::update(const std::string &s) {
-	std::istringstream is(s);
-	update(is);
+	update((const unsigned char*) s.data(), s.size());
+}
+
+void SHA1::update(const unsigned char* data, size_t len) {
+	/* Top up a partially filled buffer first */
+	if (buffer.size() > 0) {
+		size_t fill = std::min(len, (size_t) BLOCK_BYTES - buffer.size());
+		buffer.append((const char*) data, fill);
+		data += fill;
+		len -= fill;
+		if (buffer.size() < BLOCK_BYTES) {
+			return;
+		}
+		uint32_t block[BLOCK_INTS];
+		buffer_to_block(buffer, block);
+		transform(block);
+		buffer.clear();
+	}
+	/* Hash whole blocks straight from the caller's memory */
+	while (len >= BLOCK_BYTES) {
+		uint32_t block[BLOCK_INTS];
+		bytes_to_block(data, block);
+		transform(block);
+		data += BLOCK_BYTES;
+		len -= BLOCK_BYTES;
+	}
+	buffer.assign((const char*) data, len);
 }
 
 void SHA1::update(std::istream &is) {
@@ -58,7 +84,7 @@ void SHA1::update(std::istream &is) {
  * Add padding and return the message digest.
  */
 
-std::string SHA1::final() {
+void SHA1::pad() {
 	/* Total number of hashed bits */
 	uint64_t total_bits = (transforms * BLOCK_BYTES + buffer.size()) * 8;
 
@@ -83,6 +109,10 @@ std::string SHA1::final() {
 	block[BLOCK_INTS - 1] =(uint32_t) total_bits;
 	block[BLOCK_INTS - 2] = (uint32_t)(total_bits >> 32);
 	transform(block);
+}
+
+std::string SHA1::final() {
+	pad();
 
 	/* Hex std::string */
 	std::ostringstream result;
@@ -97,6 +127,17 @@ std::string SHA1::final() {
 	return result.str();
 }
 
+void SHA1::final(unsigned char out[DIGEST_BYTES]) {
+	pad();
+	for (unsigned int i = 0; i < DIGEST_INTS; i++) {
+		out[4 * i + 0] = (unsigned char) (digest[i] >> 24);
+		out[4 * i + 1] = (unsigned char) (digest[i] >> 16);
+		out[4 * i + 2] = (unsigned char) (digest[i] >> 8);
+		out[4 * i + 3] = (unsigned char) (digest[i]);
+	}
+	reset();
+}
+
 std::string SHA1::from_file(const std::string &filename) {
 	std::ifstream stream(filename.c_str(), std::ios::binary);
 	SHA1 checksum;
@@ -232,6 +273,15 @@ void SHA1::buffer_to_block(const std::string &buffer,
 	}
 }
 
+void SHA1::bytes_to_block(const unsigned char* bytes,
+		uint32_t block[BLOCK_BYTES]) {
+	for (unsigned int i = 0; i < BLOCK_INTS; i++) {
+		block[i] = (uint32_t) bytes[4 * i + 3] | (uint32_t) bytes[4 * i + 2] << 8
+				| (uint32_t) bytes[4 * i + 1] << 16
+				| (uint32_t) bytes[4 * i + 0] << 24;
+	}
+}
+
 void SHA1::read(std::istream &is, std::string &s, int max) {
 	std::vector<char> sbuf(max);
 	is.read(sbuf.data(), max);
@@ -6751,23 +6751,16 @@ for (size_t c = 0; c < channels.size(); c++) {
 (*p) = '\0';
 }
 
-void CompressZip(unsigned char *dst, unsigned long long &compressedSize,
-	const unsigned char *src, unsigned long srcSize) {
-
-std::vector<unsigned char> tmpBuf(srcSize);
-
-//
-// Apply EXR-specific? postprocess. Grabbed from OpenEXR's
-// ImfZipCompressor.cpp
 //
-
+// Byte reordering and delta predictor shared by ZIP and RLE. Grabbed from
+// OpenEXR's ImfZipCompressor.cpp and ImfRleCompressor.cpp
 //
+void InterleaveAndPredict(unsigned char *tmp, const unsigned char *src,
+	size_t srcSize) {
 // Reorder the pixel data.
-//
-
 {
-	char *t1 = (char *) &tmpBuf.at(0);
-	char *t2 = (char *) &tmpBuf.at(0) + (srcSize + 1) / 2;
+	char *t1 = (char *) tmp;
+	char *t2 = (char *) tmp + (srcSize + 1) / 2;
 	const char *stop = (const char *) src + srcSize;
 
 	while (true) {
@@ -6783,13 +6776,10 @@ std::vector<unsigned char> tmpBuf(srcSize);
 	}
 }
 
-//
 // Predictor.
-//
-
-{
-	unsigned char *t = &tmpBuf.at(0) + 1;
-	unsigned char *stop = &tmpBuf.at(0) + srcSize;
+if (srcSize > 0) {
+	unsigned char *t = tmp + 1;
+	unsigned char *stop = tmp + srcSize;
 	int p = t[-1];
 
 	while (t < stop) {
@@ -6799,37 +6789,14 @@ std::vector<unsigned char> tmpBuf(srcSize);
 		++t;
 	}
 }
-
-//
-// Compress the data using miniz
-//
-
-miniz::mz_ulong outSize = miniz::mz_compressBound(srcSize);
-int ret = miniz::mz_compress(dst, &outSize,
-		(const unsigned char *) &tmpBuf.at(0), srcSize);
-assert(ret == miniz::MZ_OK);
-(void) ret;
-
-compressedSize = outSize;
 }
 
-void DecompressZip(unsigned char *dst, unsigned long &uncompressedSize,
-	const unsigned char *src, unsigned long srcSize) {
-std::vector<unsigned char> tmpBuf(uncompressedSize);
-
-int ret = miniz::mz_uncompress(&tmpBuf.at(0), &uncompressedSize, src, srcSize);
-assert(ret == miniz::MZ_OK);
-(void) ret;
-
-//
-// Apply EXR-specific? postprocess. Grabbed from OpenEXR's
-// ImfZipCompressor.cpp
-//
-
+void UnpredictAndDeinterleave(unsigned char *dst, unsigned char *tmp,
+	size_t size) {
 // Predictor.
-{
-	unsigned char *t = &tmpBuf.at(0) + 1;
-	unsigned char *stop = &tmpBuf.at(0) + uncompressedSize;
+if (size > 0) {
+	unsigned char *t = tmp + 1;
+	unsigned char *stop = tmp + size;
 
 	while (t < stop) {
 		int d = int(t[-1]) + int(t[0]) - 128;
@@ -6840,11 +6807,10 @@ assert(ret == miniz::MZ_OK);
 
 // Reorder the pixel data.
 {
-	const char *t1 = reinterpret_cast<const char *>(&tmpBuf.at(0));
-	const char *t2 = reinterpret_cast<const char *>(&tmpBuf.at(0))
-			+ (uncompressedSize + 1) / 2;
+	const char *t1 = reinterpret_cast<const char *>(tmp);
+	const char *t2 = reinterpret_cast<const char *>(tmp) + (size + 1) / 2;
 	char *s = reinterpret_cast<char *>(dst);
-	char *stop = s + uncompressedSize;
+	char *stop = s + size;
 
 	while (true) {
 		if (s < stop)
@@ -6860,6 +6826,111 @@ assert(ret == miniz::MZ_OK);
 }
 }
 
+void CompressZip(unsigned char *dst, unsigned long long &compressedSize,
+	const unsigned char *src, unsigned long srcSize) {
+
+std::vector<unsigned char> tmpBuf(srcSize);
+
+InterleaveAndPredict(&tmpBuf.at(0), src, srcSize);
+
+//
+// Compress the data using miniz
+//
+
+miniz::mz_ulong outSize = miniz::mz_compressBound(srcSize);
+int ret = miniz::mz_compress(dst, &outSize,
+		(const unsigned char *) &tmpBuf.at(0), srcSize);
+assert(ret == miniz::MZ_OK);
+(void) ret;
+
+compressedSize = outSize;
+}
+
+bool DecompressZip(unsigned char *dst, unsigned long &uncompressedSize,
+	const unsigned char *src, unsigned long srcSize) {
+std::vector<unsigned char> tmpBuf(uncompressedSize);
+
+int ret = miniz::mz_uncompress(&tmpBuf.at(0), &uncompressedSize, src, srcSize);
+if (ret != miniz::MZ_OK) {
+	return false;
+}
+
+UnpredictAndDeinterleave(dst, &tmpBuf.at(0), uncompressedSize);
+return true;
+}
+
+//
+// RLE compress/uncompress, based on OpenEXR's ImfRle.cpp
+//
+size_t RleCompress(signed char *out, size_t outSize, const unsigned char *in,
+	size_t inSize) {
+const int MIN_RUN_LENGTH = 3;
+const int MAX_RUN_LENGTH = 127;
+const signed char *inEnd = reinterpret_cast<const signed char *>(in) + inSize;
+const signed char *runStart = reinterpret_cast<const signed char *>(in);
+const signed char *runEnd = runStart + 1;
+signed char *outWrite = out;
+signed char *outEnd = out + outSize;
+
+while (runStart < inEnd) {
+	while (runEnd < inEnd && *runStart == *runEnd
+			&& runEnd - runStart - 1 < MAX_RUN_LENGTH) {
+		++runEnd;
+	}
+	if (runEnd - runStart >= MIN_RUN_LENGTH) {
+		if (outEnd - outWrite < 2) {
+			return 0;
+		}
+		*outWrite++ = static_cast<signed char>((runEnd - runStart) - 1);
+		*outWrite++ = *runStart;
+		runStart = runEnd;
+	} else {
+		while (runEnd < inEnd
+				&& ((runEnd + 1 >= inEnd || *runEnd != *(runEnd + 1))
+						|| (runEnd + 2 >= inEnd || *(runEnd + 1) != *(runEnd + 2)))
+				&& runEnd - runStart < MAX_RUN_LENGTH) {
+			++runEnd;
+		}
+		if (outEnd - outWrite < 1 + (runEnd - runStart)) {
+			return 0;
+		}
+		*outWrite++ = static_cast<signed char>(runStart - runEnd);
+		while (runStart < runEnd) {
+			*outWrite++ = *(runStart++);
+		}
+	}
+	++runEnd;
+}
+return outWrite - out;
+}
+
+bool RleUncompress(unsigned char *out, size_t outSize, const signed char *in,
+	size_t inSize) {
+const signed char *inEnd = in + inSize;
+unsigned char *outEnd = out + outSize;
+while (in < inEnd) {
+	if (*in < 0) {
+		size_t count = -static_cast<int>(*in++);
+		if (static_cast<size_t>(inEnd - in) < count
+				|| static_cast<size_t>(outEnd - out) < count) {
+			return false;
+		}
+		memcpy(out, in, count);
+		out += count;
+		in += count;
+	} else {
+		size_t count = static_cast<size_t>(*in++) + 1;
+		if (in >= inEnd || static_cast<size_t>(outEnd - out) < count) {
+			return false;
+		}
+		memset(out, *reinterpret_cast<const unsigned char *>(in), count);
+		out += count;
+		in++;
+	}
+}
+return (out == outEnd);
+}
+
 //
 // PIZ compress/uncompress, based on OpenEXR's ImfPizCompressor.cpp
 //
@@ -8279,8 +8350,10 @@ length = *(reinterpret_cast<const int *>(ptr));
 ptr += sizeof(int);
 
 std::vector<unsigned short> tmpBuffer(tmpBufSize);
-hufUncompress(reinterpret_cast<const char *>(ptr), length, &tmpBuffer.at(0),
-		(int)tmpBufSize);
+if (!hufUncompress(reinterpret_cast<const char *>(ptr), length,
+		&tmpBuffer.at(0), (int)tmpBufSize)) {
+	return false;
+}
 
 //
 // Wavelet decoding
@@ -8347,6 +8420,75 @@ return true;
 
 }// namespace
 
+int DecompressEXRBlock(unsigned char *dst, size_t dst_size,
+	const unsigned char *src, size_t src_size, int compression,
+	const int *pixel_types, int num_channels, int width, int num_lines) {
+if (src_size == dst_size || compression == 0) {
+	// Blocks that do not shrink are always stored uncompressed.
+	if (src_size != dst_size) {
+		return -1;
+	}
+	memcpy(dst, src, dst_size);
+	return 0;
+}
+if (compression == 1) { // RLE
+	std::vector<unsigned char> tmpBuf(dst_size);
+	if (!RleUncompress(&tmpBuf.at(0), dst_size,
+			reinterpret_cast<const signed char *>(src), src_size)) {
+		return -1;
+	}
+	UnpredictAndDeinterleave(dst, &tmpBuf.at(0), dst_size);
+	return 0;
+}
+if (compression == 2 || compression == 3) { // ZIPS, ZIP
+	unsigned long dstLen = static_cast<unsigned long>(dst_size);
+	if (!DecompressZip(dst, dstLen, src, static_cast<unsigned long>(src_size))
+			|| dstLen != dst_size) {
+		return -1;
+	}
+	return 0;
+}
+if (compression == 4) { // PIZ
+	std::vector<ChannelInfo> channels(num_channels);
+	for (int c = 0; c < num_channels; c++) {
+		channels[c].pixelType = pixel_types[c];
+		channels[c].pLinear = 0;
+		channels[c].xSampling = 1;
+		channels[c].ySampling = 1;
+	}
+	unsigned int dstLen = static_cast<unsigned int>(dst_size);
+	if (!DecompressPiz(dst, dstLen, src, dst_size / sizeof(unsigned short),
+			channels, width, num_lines)) {
+		return -1;
+	}
+	return 0;
+}
+return -2;
+}
+
+size_t CompressEXRBlock(unsigned char *dst, size_t dst_size,
+	const unsigned char *src, size_t src_size, int compression) {
+if (compression == 1) { // RLE
+	std::vector<unsigned char> tmpBuf(src_size);
+	InterleaveAndPredict(&tmpBuf.at(0), src, src_size);
+	size_t outSize = RleCompress(reinterpret_cast<signed char *>(dst), dst_size,
+			&tmpBuf.at(0), src_size);
+	return (outSize < src_size) ? outSize : 0;
+}
+if (compression == 2 || compression == 3) { // ZIPS, ZIP
+	std::vector<unsigned char> tmpBuf(src_size);
+	InterleaveAndPredict(&tmpBuf.at(0), src, src_size);
+	miniz::mz_ulong outSize = static_cast<miniz::mz_ulong>(dst_size);
+	int ret = miniz::mz_compress(dst, &outSize, &tmpBuf.at(0),
+			static_cast<miniz::mz_ulong>(src_size));
+	if (ret != miniz::MZ_OK || outSize >= src_size) {
+		return 0;
+	}
+	return outSize;
+}
+return 0;
+}
+
 int LoadEXR(float **out_rgba, int *width, int *height, const char *filename,
 	const char **err) {
 
@@ -8931,7 +9073,8 @@ for (int y = 0; y < numBlocks; y++) {
 		// Allocate original data size.
 		std::vector<unsigned char> outBuf(dataWidth * numLines * pixelDataSize);
 		unsigned int dstLen;
-		size_t tmpBufLen = dataWidth * numLines * pixelDataSize;
+		size_t tmpBufLen = dataWidth * numLines * pixelDataSize
+				/ sizeof(unsigned short);
 
 		DecompressPiz(reinterpret_cast<unsigned char *>(&outBuf.at(0)), dstLen,
 				dataPtr + 8, tmpBufLen, channels, dataWidth, numLines);
@@ -97,7 +97,7 @@ bool ImageFeaturesEx::init(Composite& rootNode) {
 				double bestScore = 0.0;
 				int bestOffset = 0;
 				for (int ii = std::max(i - shiftBound,0); ii <= i; ii++) {
-					double score = dot(leftDescriptors(i, j), rightDescriptors(ii, j));
+					double score = leftDescriptors.dot(i, j, rightDescriptors, ii, j);
 					if (score > bestScore) {
 						bestOffset = i - ii;
 						bestScore = score;
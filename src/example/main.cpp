@@ -158,6 +158,7 @@ bool SANITY_CHECK() {
 	//SANITY_CHECK_GMM();
 	//SANITY_CHECK_SVD();
 	//SANITY_CHECK_VIDEOENCODER();
+	//SANITY_CHECK_CONNECTED_COMPONENTS();
 	SANITY_CHECK_STRINGS();
 	return ret;
 }
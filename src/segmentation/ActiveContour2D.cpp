@@ -23,21 +23,26 @@
 namespace aly {
 
 void ActiveManifold2D::rebuildNarrowBand() {
-	activeList.clear();
-	for (int band = 1; band <= maxLayers; band++) {
-#pragma omp parallel for
-		for (int i = 0; i < (int) activeList.size(); i++) {
-			int2 pos = activeList[i];
-			updateDistanceField(pos.x, pos.y, band, i);
+	const int width = swapLevelSet.width;
+	const float* data = swapLevelSet.ptr();
+	ParallelCompact(activeList, swapLevelSet.height, [=](int j) {
+		const float* row = data + (size_t) j * width;
+		int count = 0;
+		for (int i = 0; i < width; i++) {
+			if (std::abs(row[i]) <= MAX_DISTANCE)
+				count++;
 		}
-	}
-	for (int j = 0; j < swapLevelSet.height; j++) {
-		for (int i = 0; i < swapLevelSet.width; i++) {
-			if (std::abs(swapLevelSet(i, j)) <= MAX_DISTANCE) {
-				activeList.push_back(int2(i, j));
+		return count;
+	}, [=](int j, int2* dst) {
+		const float* row = data + (size_t) j * width;
+		int count = 0;
+		for (int i = 0; i < width; i++) {
+			if (std::abs(row[i]) <= MAX_DISTANCE) {
+				dst[count++] = int2(i, j);
 			}
 		}
-	}
+		return count;
+	}, compactOffsets);
 	deltaLevelSet.clear();
 	deltaLevelSet.resize(activeList.size(), 0.0f);
 }
@@ -558,10 +563,7 @@ float ActiveManifold2D::evolve(float maxStep) {
 	}
 	float timeStep = (float) maxStep;
 	if (!clampSpeed) {
-		float maxDelta = 0.0f;
-		for (float delta : deltaLevelSet) {
-			maxDelta = std::max(std::abs(delta), maxDelta);
-		}
+		float maxDelta = ParallelMaxAbs(deltaLevelSet);
 		const float maxSpeed = 0.999f;
 		timeStep = (float) (maxStep
 				* ((maxDelta > maxSpeed) ? (maxSpeed / maxDelta) : maxSpeed));
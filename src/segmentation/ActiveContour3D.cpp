@@ -22,26 +22,69 @@
 
 namespace aly {
 
+static const int3 STENCIL_OFFSETS[19] = { int3(0, 0, 0), int3(-1, 0, 0), int3(
+		1, 0, 0), int3(0, -1, 0), int3(0, 1, 0), int3(0, 0, -1), int3(0, 0, 1),
+		int3(-1, 0, -1), int3(1, 0, -1), int3(0, -1, -1), int3(0, 1, -1), int3(-1,
+				-1, 0), int3(1, -1, 0), int3(-1, 1, 0), int3(1, 1, 0), int3(-1, 0,
+				1), int3(1, 0, 1), int3(0, -1, 1), int3(0, 1, 1) };
 void ActiveContour3D::rebuildNarrowBand() {
-	activeList.clear();
-	for (int band = 1; band <= maxLayers; band++) {
+	const int rows = swapLevelSet.rows;
+	const int cols = swapLevelSet.cols;
+	const float* data = swapLevelSet.ptr();
+	//Each item is one row of the volume so the scan stays cache friendly.
+	ParallelCompact(activeList, cols * swapLevelSet.slices,
+			[=](int line) {
+				const float* row = data + (size_t) line * rows;
+				int count = 0;
+				for (int i = 0; i < rows; i++) {
+					if (std::abs(row[i]) <= MAX_DISTANCE)
+						count++;
+				}
+				return count;
+			}, [=](int line, int3* dst) {
+				const float* row = data + (size_t) line * rows;
+				int j = line % cols;
+				int k = line / cols;
+				int count = 0;
+				for (int i = 0; i < rows; i++) {
+					if (std::abs(row[i]) <= MAX_DISTANCE) {
+						dst[count++] = int3(i, j, k);
+					}
+				}
+				return count;
+			}, compactOffsets);
+	updateFront();
+}
+void ActiveContour3D::updateFront() {
+	int sz = (int) activeList.size();
+	compactFlags.resize(sz);
 #pragma omp parallel for
-		for (int i = 0; i < (int) activeList.size(); i++) {
-			int3 pos = activeList[i];
-			updateDistanceField(pos.x, pos.y, pos.z, band);
+	for (int n = 0; n < sz; n++) {
+		int3 pos = activeList[n];
+		compactFlags[n] = (std::abs(swapLevelSet(pos.x, pos.y, pos.z).x) <= 0.5f);
+	}
+	ParallelCompact(frontList, sz, [this](int n) {
+		return (int) compactFlags[n];
+	}, [this](int n, int* dst) {
+		if (compactFlags[n]) {
+			*dst = n;
+			return 1;
 		}
-	}
-	for (int k = 0; k < swapLevelSet.slices; k++) {
-		for (int j = 0; j < swapLevelSet.cols; j++) {
-			for (int i = 0; i < swapLevelSet.rows; i++) {
-				if (std::abs(swapLevelSet(i, j, k).x) <= MAX_DISTANCE) {
-					activeList.push_back(int3(i, j, k));
-				}
-			}
+		return 0;
+	}, compactOffsets);
+	size_t M = frontList.size();
+	frontStencil.resize(STENCIL_SIZE * M);
+#pragma omp parallel for
+	for (int n = 0; n < (int) M; n++) {
+		int3 pos = activeList[frontList[n]];
+		for (int s = 0; s < STENCIL_SIZE; s++) {
+			int3 off = STENCIL_OFFSETS[s];
+			frontStencil[s * M + n] = swapLevelSet(pos.x + off.x, pos.y + off.y,
+					pos.z + off.z).x;
 		}
 	}
 	deltaLevelSet.clear();
-	deltaLevelSet.resize(activeList.size(), 0.0f);
+	deltaLevelSet.resize(M, 0.0f);
 }
 void ActiveContour3D::plugLevelSet(int i, int j, int k, size_t index) {
 	float v111;
@@ -162,32 +205,27 @@ bool ActiveContour3D::init() {
 	}
 	return true;
 }
-void ActiveContour3D::pressureAndAdvectionMotion(int i, int j, int k,
-		size_t gid) {
-	float v111 = swapLevelSet(i, j, k).x;
-	float2 grad;
-	if (v111 > 0.5f || v111 < -0.5f) {
-		deltaLevelSet[gid] = 0;
-		return;
-	}
-	float v010 = swapLevelSet(i - 1, j, k - 1);
-	float v120 = swapLevelSet(i, j + 1, k - 1);
-	float v110 = swapLevelSet(i, j, k - 1);
-	float v100 = swapLevelSet(i, j - 1, k - 1);
-	float v210 = swapLevelSet(i + 1, j, k - 1);
-	float v001 = swapLevelSet(i - 1, j - 1, k);
-	float v011 = swapLevelSet(i - 1, j, k);
-	float v101 = swapLevelSet(i, j - 1, k);
-	float v211 = swapLevelSet(i + 1, j, k);
-	float v201 = swapLevelSet(i + 1, j - 1, k);
-	float v221 = swapLevelSet(i + 1, j + 1, k);
-	float v021 = swapLevelSet(i - 1, j + 1, k);
-	float v121 = swapLevelSet(i, j + 1, k);
-	float v012 = swapLevelSet(i - 1, j, k + 1);
-	float v122 = swapLevelSet(i, j + 1, k + 1);
-	float v112 = swapLevelSet(i, j, k + 1);
-	float v102 = swapLevelSet(i, j - 1, k + 1);
-	float v212 = swapLevelSet(i + 1, j, k + 1);
+void ActiveContour3D::pressureAndAdvectionMotion(size_t gid) {
+	float v111 = getStencilValue(0, gid);
+	float v011 = getStencilValue(1, gid);
+	float v211 = getStencilValue(2, gid);
+	float v101 = getStencilValue(3, gid);
+	float v121 = getStencilValue(4, gid);
+	float v110 = getStencilValue(5, gid);
+	float v112 = getStencilValue(6, gid);
+	float v010 = getStencilValue(7, gid);
+	float v210 = getStencilValue(8, gid);
+	float v100 = getStencilValue(9, gid);
+	float v120 = getStencilValue(10, gid);
+	float v001 = getStencilValue(11, gid);
+	float v201 = getStencilValue(12, gid);
+	float v021 = getStencilValue(13, gid);
+	float v221 = getStencilValue(14, gid);
+	float v012 = getStencilValue(15, gid);
+	float v212 = getStencilValue(16, gid);
+	float v102 = getStencilValue(17, gid);
+	float v122 = getStencilValue(18, gid);
+	int3 pos = activeList[frontList[gid]];
 
 	float DxNeg = v111 - v011;
 	float DxPos = v211 - v111;
@@ -248,7 +286,7 @@ void ActiveContour3D::pressureAndAdvectionMotion(int i, int j, int k,
 	// Level set force should be the opposite sign of advection force so it
 	// moves in the direction of the force.
 
-	float3 vec = vecFieldImage(i, j, k);
+	float3 vec = vecFieldImage(pos.x, pos.y, pos.z);
 	float forceX = advectionParam.toFloat() * vec.x;
 	float forceY = advectionParam.toFloat() * vec.y;
 	float forceZ = advectionParam.toFloat() * vec.z;
@@ -270,7 +308,7 @@ void ActiveContour3D::pressureAndAdvectionMotion(int i, int j, int k,
 	} else if (forceZ < 0) {
 		advection += forceZ * DzPos;
 	}
-	float force = pressureParam.toFloat() * pressureImage(i, j, k).x;
+	float force = pressureParam.toFloat() * pressureImage(pos.x, pos.y, pos.z).x;
 	if (force > 0) {
 		pressure = -force * std::sqrt(GradientSqrPos);
 	} else if (force < 0) {
@@ -278,32 +316,27 @@ void ActiveContour3D::pressureAndAdvectionMotion(int i, int j, int k,
 	}
 	deltaLevelSet[gid] = -advection + kappa + pressure;
 }
-void ActiveContour3D::advectionMotion(int i, int j, int k, size_t gid) {
-	float v111 = swapLevelSet(i, j, k).x;
-	float2 grad;
-	if (v111 > 0.5f || v111 < -0.5f) {
-		deltaLevelSet[gid] = 0;
-		return;
-	}
-
-	float v010 = swapLevelSet(i - 1, j, k - 1);
-	float v120 = swapLevelSet(i, j + 1, k - 1);
-	float v110 = swapLevelSet(i, j, k - 1);
-	float v100 = swapLevelSet(i, j - 1, k - 1);
-	float v210 = swapLevelSet(i + 1, j, k - 1);
-	float v001 = swapLevelSet(i - 1, j - 1, k);
-	float v011 = swapLevelSet(i - 1, j, k);
-	float v101 = swapLevelSet(i, j - 1, k);
-	float v211 = swapLevelSet(i + 1, j, k);
-	float v201 = swapLevelSet(i + 1, j - 1, k);
-	float v221 = swapLevelSet(i + 1, j + 1, k);
-	float v021 = swapLevelSet(i - 1, j + 1, k);
-	float v121 = swapLevelSet(i, j + 1, k);
-	float v012 = swapLevelSet(i - 1, j, k + 1);
-	float v122 = swapLevelSet(i, j + 1, k + 1);
-	float v112 = swapLevelSet(i, j, k + 1);
-	float v102 = swapLevelSet(i, j - 1, k + 1);
-	float v212 = swapLevelSet(i + 1, j, k + 1);
+void ActiveContour3D::advectionMotion(size_t gid) {
+	float v111 = getStencilValue(0, gid);
+	float v011 = getStencilValue(1, gid);
+	float v211 = getStencilValue(2, gid);
+	float v101 = getStencilValue(3, gid);
+	float v121 = getStencilValue(4, gid);
+	float v110 = getStencilValue(5, gid);
+	float v112 = getStencilValue(6, gid);
+	float v010 = getStencilValue(7, gid);
+	float v210 = getStencilValue(8, gid);
+	float v100 = getStencilValue(9, gid);
+	float v120 = getStencilValue(10, gid);
+	float v001 = getStencilValue(11, gid);
+	float v201 = getStencilValue(12, gid);
+	float v021 = getStencilValue(13, gid);
+	float v221 = getStencilValue(14, gid);
+	float v012 = getStencilValue(15, gid);
+	float v212 = getStencilValue(16, gid);
+	float v102 = getStencilValue(17, gid);
+	float v122 = getStencilValue(18, gid);
+	int3 pos = activeList[frontList[gid]];
 
 	float DxNeg = v111 - v011;
 	float DxPos = v211 - v111;
@@ -347,7 +380,7 @@ void ActiveContour3D::advectionMotion(int i, int j, int k, size_t gid) {
 	// Level set force should be the opposite sign of advection force so it
 	// moves in the direction of the force.
 
-	float3 vec = vecFieldImage(i, j, k);
+	float3 vec = vecFieldImage(pos.x, pos.y, pos.z);
 	float forceX = advectionParam.toFloat() * vec.x;
 	float forceY = advectionParam.toFloat() * vec.y;
 	float forceZ = advectionParam.toFloat() * vec.z;
@@ -374,9 +407,7 @@ void ActiveContour3D::advectionMotion(int i, int j, int k, size_t gid) {
 void ActiveContour3D::applyForces(int i, int j, int k, size_t index,
 		float timeStep) {
 	float delta;
-	float old = swapLevelSet(i, j, k);
-	if (std::abs(old) > 0.5f)
-		return;
+	float old = getStencilValue(0, index);
 	if (clampSpeed) {
 		delta = timeStep * clamp(deltaLevelSet[index], -1.0f, 1.0f);
 	} else {
@@ -387,91 +418,115 @@ void ActiveContour3D::applyForces(int i, int j, int k, size_t index,
 }
 
 int ActiveContour3D::deleteElements() {
-	std::vector<int3> newList;
-	for (int i = 0; i < (int) activeList.size(); i++) {
-		int3 pos = activeList[i];
+	int sz = (int) activeList.size();
+	compactFlags.resize(sz);
+#pragma omp parallel for
+	for (int n = 0; n < sz; n++) {
+		int3 pos = activeList[n];
 		float val = swapLevelSet(pos.x, pos.y, pos.z);
 		if (std::abs(val) <= MAX_DISTANCE) {
-			newList.push_back(pos);
+			compactFlags[n] = 1;
 		} else {
+			compactFlags[n] = 0;
 			val = sign(val) * (MAX_DISTANCE + 0.5f);
 			levelSet(pos.x, pos.y, pos.z) = val;
 			swapLevelSet(pos.x, pos.y, pos.z) = val;
 		}
 	}
-	int diff = (int) (activeList.size() - newList.size());
-	activeList = newList;
+	ParallelCompact(swapActiveList, sz, [this](int n) {
+		return (int) compactFlags[n];
+	}, [this](int n, int3* dst) {
+		if (compactFlags[n]) {
+			*dst = activeList[n];
+			return 1;
+		}
+		return 0;
+	}, compactOffsets);
+	int diff = (int) (activeList.size() - swapActiveList.size());
+	activeList.swap(swapActiveList);
 	return diff;
 }
 int ActiveContour3D::addElements() {
-	const int xNeighborhood[6] = { -1, 1, 0, 0, 0, 0 };
-	const int yNeighborhood[6] = { 0, 0, -1, 1, 0, 0 };
-	const int zNeighborhood[6] = { 0, 0, 0, 0, -1, 1 };
-	std::vector<int2> newList;
+	static const int3 neighborhood[6] = { int3(-1, 0, 0), int3(1, 0, 0), int3(0,
+			-1, 0), int3(0, 1, 0), int3(0, 0, -1), int3(0, 0, 1) };
 	int sz = (int) activeList.size();
 	float INDICATOR = (float) std::max(std::max(levelSet.rows, levelSet.cols),
 			levelSet.slices);
+	//Tag new neighbors with the first offset that reaches them. Neighbors reached through
+	//the same offset are distinct, so each offset is flagged and then written in parallel.
+	compactFlags.resize(6 * (size_t) sz);
 	for (int offset = 0; offset < 6; offset++) {
-		int xOff = xNeighborhood[offset];
-		int yOff = yNeighborhood[offset];
-		int zOff = zNeighborhood[offset];
+		int3 off = neighborhood[offset];
+#pragma omp parallel for
 		for (int n = 0; n < sz; n++) {
 			int3 pos = activeList[n];
-			int3 pos2 = int3(pos.x + xOff, pos.y + yOff, pos.z + zOff);
 			float val1 = std::abs(levelSet(pos.x, pos.y, pos.z));
-			float val2 = std::abs(levelSet(pos2.x, pos2.y, pos2.z));
-			if (val1 <= MAX_DISTANCE - 1.0f && val2 >= MAX_DISTANCE
-					&& val2 < INDICATOR) {
-				levelSet(pos2.x, pos2.y, pos2.z) = INDICATOR + offset;
-			}
+			float val2 = std::abs(
+					levelSet(pos.x + off.x, pos.y + off.y, pos.z + off.z));
+			compactFlags[n] = (val1 <= MAX_DISTANCE - 1.0f && val2 >= MAX_DISTANCE
+					&& val2 < INDICATOR);
 		}
-	}
-	for (int offset = 0; offset < 6; offset++) {
-		int xOff = xNeighborhood[offset];
-		int yOff = yNeighborhood[offset];
-		int zOff = zNeighborhood[offset];
+#pragma omp parallel for
 		for (int n = 0; n < sz; n++) {
-			int3 pos = activeList[n];
-			int3 pos2 = int3(pos.x + xOff, pos.y + yOff, pos.z + zOff);
-			float val1 = levelSet(pos.x, pos.y, pos.z);
-			float val2 = levelSet(pos2.x, pos2.y, pos2.z);
-			if (std::abs(val1) <= MAX_DISTANCE - 1.0f
-					&& val2 == INDICATOR + offset) {
-				activeList.push_back(pos2);
-				val2 = swapLevelSet(pos2.x, pos2.y, pos2.z);
-				val2 = aly::sign(val2) * MAX_DISTANCE;
-				swapLevelSet(pos2.x, pos2.y, pos2.z) = val2;
-				levelSet(pos2.x, pos2.y, pos2.z) = val2;
+			if (compactFlags[n]) {
+				int3 pos = activeList[n];
+				levelSet(pos.x + off.x, pos.y + off.y, pos.z + off.z) = INDICATOR
+						+ offset;
 			}
 		}
 	}
+	//Append tagged neighbors in (offset, element) order.
+#pragma omp parallel for
+	for (int t = 0; t < 6 * sz; t++) {
+		int offset = t / sz;
+		int3 off = neighborhood[offset];
+		int3 pos = activeList[t - offset * sz];
+		float val1 = levelSet(pos.x, pos.y, pos.z);
+		float val2 = levelSet(pos.x + off.x, pos.y + off.y, pos.z + off.z);
+		compactFlags[t] = (std::abs(val1) <= MAX_DISTANCE - 1.0f
+				&& val2 == INDICATOR + offset);
+	}
+	ParallelCompact(activeList, 6 * sz, [this](int t) {
+		return (int) compactFlags[t];
+	}, [=](int t, int3* dst) {
+		if (compactFlags[t]) {
+			int offset = t / sz;
+			*dst = activeList[t - offset * sz] + neighborhood[offset];
+			return 1;
+		}
+		return 0;
+	}, compactOffsets, sz);
+#pragma omp parallel for
+	for (int n = sz; n < (int) activeList.size(); n++) {
+		int3 pos2 = activeList[n];
+		float val2 = swapLevelSet(pos2.x, pos2.y, pos2.z);
+		val2 = aly::sign(val2) * MAX_DISTANCE;
+		swapLevelSet(pos2.x, pos2.y, pos2.z) = val2;
+		levelSet(pos2.x, pos2.y, pos2.z) = val2;
+	}
 	return (int) (activeList.size() - sz);
 }
-void ActiveContour3D::pressureMotion(int i, int j, int k, size_t gid) {
-	float v111 = swapLevelSet(i, j, k).x;
-	float3 grad;
-	if (std::abs(v111) > 0.5f) {
-		deltaLevelSet[gid] = 0;
-		return;
-	}
-	float v010 = swapLevelSet(i - 1, j, k - 1).x;
-	float v120 = swapLevelSet(i, j + 1, k - 1).x;
-	float v110 = swapLevelSet(i, j, k - 1).x;
-	float v100 = swapLevelSet(i, j - 1, k - 1).x;
-	float v210 = swapLevelSet(i + 1, j, k - 1).x;
-	float v001 = swapLevelSet(i - 1, j - 1, k).x;
-	float v011 = swapLevelSet(i - 1, j, k).x;
-	float v101 = swapLevelSet(i, j - 1, k).x;
-	float v211 = swapLevelSet(i + 1, j, k).x;
-	float v201 = swapLevelSet(i + 1, j - 1, k).x;
-	float v221 = swapLevelSet(i + 1, j + 1, k).x;
-	float v021 = swapLevelSet(i - 1, j + 1, k).x;
-	float v121 = swapLevelSet(i, j + 1, k).x;
-	float v012 = swapLevelSet(i - 1, j, k + 1).x;
-	float v122 = swapLevelSet(i, j + 1, k + 1).x;
-	float v112 = swapLevelSet(i, j, k + 1).x;
-	float v102 = swapLevelSet(i, j - 1, k + 1).x;
-	float v212 = swapLevelSet(i + 1, j, k + 1).x;
+void ActiveContour3D::pressureMotion(size_t gid) {
+	float v111 = getStencilValue(0, gid);
+	float v011 = getStencilValue(1, gid);
+	float v211 = getStencilValue(2, gid);
+	float v101 = getStencilValue(3, gid);
+	float v121 = getStencilValue(4, gid);
+	float v110 = getStencilValue(5, gid);
+	float v112 = getStencilValue(6, gid);
+	float v010 = getStencilValue(7, gid);
+	float v210 = getStencilValue(8, gid);
+	float v100 = getStencilValue(9, gid);
+	float v120 = getStencilValue(10, gid);
+	float v001 = getStencilValue(11, gid);
+	float v201 = getStencilValue(12, gid);
+	float v021 = getStencilValue(13, gid);
+	float v221 = getStencilValue(14, gid);
+	float v012 = getStencilValue(15, gid);
+	float v212 = getStencilValue(16, gid);
+	float v102 = getStencilValue(17, gid);
+	float v122 = getStencilValue(18, gid);
+	int3 pos = activeList[frontList[gid]];
 
 	float DxNeg = v111 - v011;
 	float DxPos = v211 - v111;
@@ -523,7 +578,7 @@ void ActiveContour3D::pressureMotion(int i, int j, int k, size_t gid) {
 	} else if (kappa > maxCurvatureForce) {
 		kappa = maxCurvatureForce;
 	}
-	float force = pressureParam.toFloat() * pressureImage(i, j, k).x;
+	float force = pressureParam.toFloat() * pressureImage(pos.x, pos.y, pos.z).x;
 	float pressure = 0;
 	if (force > 0) {
 		float GradientSqrPos = DxNegMax * DxNegMax + DxPosMin * DxPosMin
@@ -587,41 +642,36 @@ void ActiveContour3D::updateDistanceField(int i, int j, int k, int band) {
 }
 
 float ActiveContour3D::evolve(float maxStep) {
+	int M = (int) frontList.size();
 	if (pressureImage.size() > 0) {
 		if (vecFieldImage.size() > 0) {
 #pragma omp parallel for
-			for (int i = 0; i < (int) activeList.size(); i++) {
-				int3 pos = activeList[i];
-				pressureAndAdvectionMotion(pos.x, pos.y, pos.z, i);
+			for (int i = 0; i < M; i++) {
+				pressureAndAdvectionMotion(i);
 			}
 		} else {
 #pragma omp parallel for
-			for (int i = 0; i < (int) activeList.size(); i++) {
-				int3 pos = activeList[i];
-				pressureMotion(pos.x, pos.y, pos.z, i);
+			for (int i = 0; i < M; i++) {
+				pressureMotion(i);
 			}
 		}
 	} else if (vecFieldImage.size() > 0) {
 #pragma omp parallel for
-		for (int i = 0; i < (int) activeList.size(); i++) {
-			int3 pos = activeList[i];
-			advectionMotion(pos.x, pos.y, pos.z, i);
+		for (int i = 0; i < M; i++) {
+			advectionMotion(i);
 		}
 	}
 	float timeStep = (float) maxStep;
 	if (!clampSpeed) {
-		float maxDelta = 0.0f;
-		for (float delta : deltaLevelSet) {
-			maxDelta = std::max(std::abs(delta), maxDelta);
-		}
+		float maxDelta = ParallelMaxAbs(deltaLevelSet);
 		const float maxSpeed = 0.999f;
 		timeStep = (float) (maxStep
 				* ((maxDelta > maxSpeed) ? (maxSpeed / maxDelta) : maxSpeed));
 	}
 	contourLock.lock();
 #pragma omp parallel for
-	for (int i = 0; i < (int) activeList.size(); i++) {
-		int3 pos = activeList[i];
+	for (int i = 0; i < M; i++) {
+		int3 pos = activeList[frontList[i]];
 		applyForces(pos.x, pos.y, pos.z, i, timeStep);
 	}
 	for (int band = 1; band <= maxLayers; band++) {
@@ -646,8 +696,7 @@ float ActiveContour3D::evolve(float maxStep) {
 	}
 	deleteElements();
 	addElements();
-	deltaLevelSet.clear();
-	deltaLevelSet.resize(activeList.size(), 0.0f);
+	updateFront();
 	return timeStep;
 }
 bool ActiveContour3D::stepInternal() {
@@ -9,6 +9,7 @@
 #include <AlloySparseSolve.h>
 #include <AlloyLocator.h>
 #include <AlloyDelaunay.h>
+#include <AlloyConnectedComponents.h>
 #include "segmentation/MagicPixels.h"
 #include <queue>
 #include <set>
@@ -239,68 +240,8 @@ void MagicPixels::clusterCenterRefinement(Vector2f& pts, int offset,
 }
 int MagicPixels::computeConnectedComponents(const Image1i& labels,
 		Image1i& outLabels, std::vector<int> &compCounts) {
-	const int xShift[8] = { -1, 1, 0, 0, 1, -1, -1, 1 };
-	const int yShift[8] = { 0, 0, -1, 1, -1, 1, -1, 1 };
-	outLabels.resize(labels.width, labels.height);
-	outLabels.set(int1(-1));
-	std::list<int2> queue;
-	int2 pivot(0, 0);
-	int cc = 0;
-	int ccCount = 0;
-	int pivotLabel = 0;
-	compCounts.clear();
-	for (int j = 1; j < labels.height - 1; j++) {
-		for (int i = 1; i < labels.width - 1; i++) {
-			if (labels(i, j).x >= 0) {
-				pivot = int2(i, j);
-				break;
-			}
-		}
-	}
-	do {
-		queue.clear();
-		outLabels(pivot) = int1(cc);
-		pivotLabel = labels(pivot).x;
-		ccCount = 1;
-		queue.push_back(pivot);
-		while (queue.size() > 0) {
-			int2 v = queue.front();
-			queue.pop_front();
-			for (int s = 0; s < 8; s++) {
-				int2 nbr = int2(v.x + xShift[s], v.y + yShift[s]);
-				if (nbr.x >= 0 && nbr.y >= 0 && nbr.x < outLabels.width
-						&& nbr.y < outLabels.height) {
-					if (outLabels(nbr).x < 0 && labels(nbr).x == pivotLabel) {
-						outLabels(nbr).x = cc;
-						ccCount++;
-						queue.push_back(nbr);
-					}
-				}
-			}
-		}
-		compCounts.push_back(ccCount);
-		pivot = int2(-1, -1);
-		for (int t = 0; t < 16; t++) {
-			int i = RandomUniform(0, labels.width - 1);
-			int j = RandomUniform(0, labels.height - 1);
-			if (outLabels(i, j).x < 0 && labels(i, j).x >= 0) {
-				pivot = int2(i, j);
-				break;
-			}
-		}
-		if (pivot.x < 0) {
-			for (int j = 1; j < labels.height - 1; j++) {
-				for (int i = 1; i < labels.width - 1; i++) {
-					if (outLabels(i, j).x < 0 && labels(i, j).x >= 0) {
-						pivot = int2(i, j);
-						break;
-					}
-				}
-			}
-		}
-		cc++;
-	} while (pivot.x >= 0);
-	return (int) compCounts.size();
+	return LabelConnectedComponents(labels, outLabels, compCounts,
+			Connectivity::Eight, true);
 }
 int MagicPixels::makeLabelsUnique(Image1i& outImage) {
 	std::map<int, int> lookup;
@@ -325,24 +266,8 @@ int MagicPixels::makeLabelsUnique(Image1i& outImage) {
 }
 int MagicPixels::removeSmallConnectedComponents(const Image1i& labelImage,
 		Image1i& outImage, int minSize) {
-	std::vector<int> compCounts;
-	std::vector<int> labels;
-	std::set<int> removeList;
-	computeConnectedComponents(labelImage, outImage, compCounts);
-	for (int l = 0; l < (int) compCounts.size(); l++) {
-		if (compCounts[l] < minSize) {
-			removeList.insert(l);
-		}
-	}
-	for (int j = 0; j < outImage.height; j++) {
-		for (int i = 0; i < outImage.width; i++) {
-			int l = outImage(i, j).x;
-			if (removeList.find(l) != removeList.end()) {
-				outImage(i, j).x = -1;
-			}
-		}
-	}
-	return (int) removeList.size();
+	return RemoveSmallConnectedComponents(labelImage, outImage, minSize,
+			Connectivity::Eight, true);
 }
 int MagicPixels::fill(Image1i& labelImage, float spacing, float Tile,
 		float colorThreshold) {
@@ -19,59 +19,444 @@
  * THE SOFTWARE.
  */
 #include "segmentation/MultiActiveContour3D.h"
+#include "AlloyDistanceField.h"
 namespace aly {
 void MultiActiveContour3D::rebuildNarrowBand() {
-	activeList.clear();
-	for (int band = 1; band <= maxLayers; band++) {
+	if (sparse) {
+		std::list<EndlessNodeFloatInt*> leafList =
+				swapSparseLevelSet.getLeafNodes();
+		std::vector<EndlessNodeFloatInt*> leafs(leafList.begin(),
+				leafList.end());
+		const int3 dims = dimensions;
+		auto inside = [=](const EndlessNodeFloatInt* leaf, int ii, int jj, int kk) {
+			int3 pos = leaf->location + int3(ii, jj, kk);
+			return (pos.x < dims.x && pos.y < dims.y && pos.z < dims.z
+					&& leaf->data[ii + (jj + kk * leaf->dim) * leaf->dim].first
+							<= MAX_DISTANCE);
+		};
+		ParallelCompact(activeList, (int) leafs.size(), [&](int n) {
+			const EndlessNodeFloatInt* leaf = leafs[n];
+			int dim = leaf->dim;
+			int count = 0;
+			for (int kk = 0; kk < dim; kk++) {
+				for (int jj = 0; jj < dim; jj++) {
+					for (int ii = 0; ii < dim; ii++) {
+						if (inside(leaf, ii, jj, kk))
+							count++;
+					}
+				}
+			}
+			return count;
+		}, [&](int n, int3* dst) {
+			const EndlessNodeFloatInt* leaf = leafs[n];
+			int dim = leaf->dim;
+			int count = 0;
+			for (int kk = 0; kk < dim; kk++) {
+				for (int jj = 0; jj < dim; jj++) {
+					for (int ii = 0; ii < dim; ii++) {
+						if (inside(leaf, ii, jj, kk)) {
+							dst[count++] = leaf->location + int3(ii, jj, kk);
+						}
+					}
+				}
+			}
+			return count;
+		}, compactOffsets);
+		//Leaves are visited in allocation order. Sort so in-place band updates run in the same raster order as the dense backend.
+		std::sort(activeList.begin(), activeList.end(),
+				[](const int3& a, const int3& b) {
+					return std::make_tuple(a.z, a.y, a.x) < std::make_tuple(b.z, b.y, b.x);
+				});
+		allocateSparseLeaves();
+		deltaLevelSet.resize(7 * activeList.size(), 0.0f);
+		objectIds.resize(7 * activeList.size(), -1);
+		return;
+	}
+	const int rows = swapLevelSet.rows;
+	const int cols = swapLevelSet.cols;
+	const float* data = swapLevelSet.ptr();
+	//Each item is one row of the volume so the scan stays cache friendly.
+	ParallelCompact(activeList, cols * swapLevelSet.slices,
+			[=](int line) {
+				const float* row = data + (size_t) line * rows;
+				int count = 0;
+				for (int i = 0; i < rows; i++) {
+					if (std::abs(row[i]) <= MAX_DISTANCE)
+						count++;
+				}
+				return count;
+			}, [=](int line, int3* dst) {
+				const float* row = data + (size_t) line * rows;
+				int j = line % cols;
+				int k = line / cols;
+				int count = 0;
+				for (int i = 0; i < rows; i++) {
+					if (std::abs(row[i]) <= MAX_DISTANCE) {
+						dst[count++] = int3(i, j, k);
+					}
+				}
+				return count;
+			}, compactOffsets);
+	deltaLevelSet.resize(7 * activeList.size(), 0.0f);
+	objectIds.resize(7 * activeList.size(), -1);
+}
+void MultiActiveContour3D::allocateSparseLeaves() {
+	//Active voxels already live in allocated leaves. Voxels on a leaf face can write into the
+	//adjacent leaf through addElements(), so those leaves are created up front.
+	const int L = SPARSE_LEAF_SIZE;
+	const int3 dims = dimensions;
+	auto neighborLeaves = [=](const int3& pos, int3* dst) {
+		int3 leaf = pos / L;
+		int3 local = pos - leaf * L;
+		int count = 0;
+		for (int d = 0; d < 3; d++) {
+			if (local[d] == 0 && pos[d] > 0) {
+				int3 nbr = leaf;
+				nbr[d]--;
+				if (dst != nullptr)
+					dst[count] = nbr;
+				count++;
+			}
+			if (local[d] == L - 1 && pos[d] + 1 < dims[d]) {
+				int3 nbr = leaf;
+				nbr[d]++;
+				if (dst != nullptr)
+					dst[count] = nbr;
+				count++;
+			}
+		}
+		return count;
+	};
+	std::vector<int3> leafIds;
+	ParallelCompact(leafIds, (int) activeList.size(), [&](int n) {
+		return neighborLeaves(activeList[n], nullptr);
+	}, [&](int n, int3* dst) {
+		return neighborLeaves(activeList[n], dst);
+	}, compactOffsets);
+	std::sort(leafIds.begin(), leafIds.end(), [](const int3& a, const int3& b) {
+		return std::make_tuple(a.z, a.y, a.x) < std::make_tuple(b.z, b.y, b.x);
+	});
+	leafIds.erase(std::unique(leafIds.begin(), leafIds.end()), leafIds.end());
+	for (int3 id : leafIds) {
+		allocateSparseLeaf(id);
+	}
+}
+FloatInt* MultiActiveContour3D::getSparseValuePtr(
+		const std::vector<EndlessNodeFloatInt*>& leafs, int i, int j,
+		int k) const {
+	const int L = SPARSE_LEAF_SIZE;
+	i = clamp(i, 0, dimensions.x - 1);
+	j = clamp(j, 0, dimensions.y - 1);
+	k = clamp(k, 0, dimensions.z - 1);
+	EndlessNodeFloatInt* leaf = leafs[getLeafIndex(int3(i, j, k) / L)];
+	return (leaf != nullptr) ?
+			&leaf->data[i % L + (j % L + (k % L) * L) * L] : nullptr;
+}
+FloatInt MultiActiveContour3D::getSparseValue(
+		const std::vector<EndlessNodeFloatInt*>& leafs, int i, int j,
+		int k) const {
+	const int L = SPARSE_LEAF_SIZE;
+	i = clamp(i, 0, dimensions.x - 1);
+	j = clamp(j, 0, dimensions.y - 1);
+	k = clamp(k, 0, dimensions.z - 1);
+	size_t index = getLeafIndex(int3(i, j, k) / L);
+	EndlessNodeFloatInt* leaf = leafs[index];
+	return (leaf != nullptr) ?
+			leaf->data[i % L + (j % L + (k % L) * L) * L] :
+			FloatInt(sparseBackground.first, sparseLeafLabels[index]);
+}
+void MultiActiveContour3D::allocateSparseLeaf(const int3& leafId) {
+	size_t index = getLeafIndex(leafId);
+	if (sparseLeafs[index] != nullptr)
+		return;
+	int3 pos = leafId * (int) SPARSE_LEAF_SIZE;
+	FloatInt val;
+	sparseLevelSet.getLeafValue(pos.x, pos.y, pos.z);
+	sparseLevelSet.getLeafValue(pos.x, pos.y, pos.z, sparseLeafs[index], val);
+	swapSparseLevelSet.getLeafValue(pos.x, pos.y, pos.z);
+	swapSparseLevelSet.getLeafValue(pos.x, pos.y, pos.z, swapSparseLeafs[index],
+			val);
+	//A new leaf takes over the label the table kept for it.
+	val = FloatInt(sparseBackground.first, sparseLeafLabels[index]);
+	std::fill(sparseLeafs[index]->data.begin(), sparseLeafs[index]->data.end(), val);
+	std::fill(swapSparseLeafs[index]->data.begin(),
+			swapSparseLeafs[index]->data.end(), val);
+}
+void MultiActiveContour3D::freeSparseLeaves() {
+	//A leaf whose voxels all hold the background distance and one label is replaced by that label in
+	//sparseLeafLabels. Leaves next to active voxels are kept because addElements() may write into them.
+	const int L = SPARSE_LEAF_SIZE;
+	const int3 dims = dimensions;
+	const float bgDist = sparseBackground.first;
+	std::list<EndlessNodeFloatInt*> leafList = sparseLevelSet.getLeafNodes();
+	std::vector<EndlessNodeFloatInt*> leafs(leafList.begin(), leafList.end());
+	compactFlags.resize(leafs.size());
 #pragma omp parallel for
-		for (int i = 0; i < (int) activeList.size(); i++) {
-			int3 pos = activeList[i];
-			updateDistanceField(pos.x, pos.y, pos.z, band);
+	for (int n = 0; n < (int) leafs.size(); n++) {
+		const EndlessNodeFloatInt* leaf = leafs[n];
+		const EndlessNodeFloatInt* swapLeaf = swapSparseLeafs[getLeafIndex(
+				leaf->location / L)];
+		int3 pos = leaf->location;
+		int3 end = aly::min(pos + int3(L), dims);
+		int label = leaf->data[0].second;
+		bool empty = true;
+		for (int k = pos.z; k < end.z && empty; k++) {
+			for (int j = pos.y; j < end.y && empty; j++) {
+				for (int i = pos.x; i < end.x && empty; i++) {
+					int idx = (i - pos.x) + ((j - pos.y) + (k - pos.z) * L) * L;
+					const FloatInt& val = leaf->data[idx];
+					const FloatInt& swapVal = swapLeaf->data[idx];
+					empty = (val.first == bgDist && val.second == label
+							&& swapVal.first == bgDist && swapVal.second == label);
+				}
+			}
+		}
+		for (int d = 0; d < 6 && empty; d++) {
+			int3 lo = pos;
+			int3 hi = end;
+			int c = (d % 2 == 0) ? pos[d / 2] - 1 : end[d / 2];
+			if (c < 0 || c >= dims[d / 2])
+				continue;
+			lo[d / 2] = c;
+			hi[d / 2] = c + 1;
+			for (int k = lo.z; k < hi.z && empty; k++) {
+				for (int j = lo.y; j < hi.y && empty; j++) {
+					for (int i = lo.x; i < hi.x && empty; i++) {
+						empty = (std::abs(getDistance(i, j, k)) > MAX_DISTANCE);
+					}
+				}
+			}
 		}
+		compactFlags[n] = empty;
 	}
-	for (int k = 0; k < swapLevelSet.slices; k++) {
-		for (int j = 0; j < swapLevelSet.cols; j++) {
-			for (int i = 0; i < swapLevelSet.rows; i++) {
-				if (std::abs(swapLevelSet(i, j, k).x) <= MAX_DISTANCE) {
-					activeList.push_back(int3(i, j, k));
+	for (int n = 0; n < (int) leafs.size(); n++) {
+		if (compactFlags[n]) {
+			size_t index = getLeafIndex(leafs[n]->location / L);
+			sparseLeafLabels[index] = leafs[n]->data[0].second;
+			sparseLevelSet.removeLeaf(sparseLeafs[index]);
+			swapSparseLevelSet.removeLeaf(swapSparseLeafs[index]);
+			sparseLeafs[index] = nullptr;
+			swapSparseLeafs[index] = nullptr;
+		}
+	}
+}
+void MultiActiveContour3D::initSparseLevelSet() {
+	const int L = SPARSE_LEAF_SIZE;
+	const int3 dims = dimensions;
+	const int3 leafDims = (dims + int3(L - 1)) / L;
+	const float maxValue = maxLayers + 1.0f;
+	sparseLevelSet.reset( { 4, L }, sparseBackground);
+	swapSparseLevelSet.reset( { 4, L }, sparseBackground);
+	leafDimensions = leafDims;
+	sparseLeafs.assign((size_t) leafDims.x * leafDims.y * leafDims.z, nullptr);
+	swapSparseLeafs.assign(sparseLeafs.size(), nullptr);
+	if (initialLeafLabels.size() > 0) {
+		sparseLeafLabels = initialLeafLabels;
+		std::list<EndlessNodeFloatInt*> leafList =
+				initialSparseLevelSet.getLeafNodes();
+		std::vector<EndlessNodeFloatInt*> leafs(leafList.begin(),
+				leafList.end());
+		for (const EndlessNodeFloatInt* leaf : leafs) {
+			allocateSparseLeaf(leaf->location / L);
+		}
+#pragma omp parallel for
+		for (int n = 0; n < (int) leafs.size(); n++) {
+			size_t index = getLeafIndex(leafs[n]->location / L);
+			sparseLeafs[index]->data = leafs[n]->data;
+			swapSparseLeafs[index]->data = leafs[n]->data;
+		}
+		return;
+	}
+	//Leaves that only hold the background distance and a single label are not allocated.
+	sparseLeafLabels.assign(sparseLeafs.size(), sparseBackground.second);
+	std::vector<char> occupied(sparseLeafs.size(), 0);
+#pragma omp parallel for
+	for (int n = 0; n < (int) occupied.size(); n++) {
+		int3 pos = int3(n % leafDims.x, (n / leafDims.x) % leafDims.y,
+				n / (leafDims.x * leafDims.y)) * L;
+		int label = initialLabels(pos.x, pos.y, pos.z).x;
+		bool found = false;
+		for (int k = pos.z; k < std::min(pos.z + L, dims.z) && !found; k++) {
+			for (int j = pos.y; j < std::min(pos.y + L, dims.y) && !found; j++) {
+				for (int i = pos.x; i < std::min(pos.x + L, dims.x) && !found;
+						i++) {
+					found = (aly::clamp(initialLevelSet(i, j, k).x, 0.0f,
+							maxValue) != sparseBackground.first
+							|| initialLabels(i, j, k).x != label);
+				}
+			}
+		}
+		sparseLeafLabels[n] = label;
+		occupied[n] = found;
+	}
+	std::vector<int3> leafs;
+	for (int n = 0; n < (int) occupied.size(); n++) {
+		if (occupied[n]) {
+			int3 id = int3(n % leafDims.x, (n / leafDims.x) % leafDims.y,
+					n / (leafDims.x * leafDims.y));
+			allocateSparseLeaf(id);
+			leafs.push_back(id * L);
+		}
+	}
+#pragma omp parallel for
+	for (int n = 0; n < (int) leafs.size(); n++) {
+		int3 pos = leafs[n];
+		for (int k = pos.z; k < std::min(pos.z + L, dims.z); k++) {
+			for (int j = pos.y; j < std::min(pos.y + L, dims.y); j++) {
+				for (int i = pos.x; i < std::min(pos.x + L, dims.x); i++) {
+					FloatInt val(
+							aly::clamp(initialLevelSet(i, j, k).x, 0.0f,
+									maxValue), initialLabels(i, j, k).x);
+					*getSparseValuePtr(sparseLeafs, i, j, k) = val;
+					*getSparseValuePtr(swapSparseLeafs, i, j, k) = val;
+				}
+			}
+		}
+	}
+}
+void MultiActiveContour3D::seedSparseLevelSet(const Volume1i& labels) {
+	//Same surface voxels as the dense initialization, but distances to them come from a fast march over
+	//the leaves around the surface, so no dense volume is allocated.
+	const int L = SPARSE_LEAF_SIZE;
+	const int3 dims = labels.dimensions();
+	const int3 leafDims = (dims + int3(L - 1)) / L;
+	const int leafCount = leafDims.x * leafDims.y * leafDims.z;
+	const float bgDist = sparseBackground.first;
+	const float maxValue = maxLayers + 1.0f;
+	auto isSurface = [&labels](int i, int j, int k) {
+		int l = labels(i, j, k).x;
+		return (l < labels(i + 1, j, k).x || l < labels(i - 1, j, k).x
+				|| l < labels(i, j + 1, k).x || l < labels(i, j - 1, k).x
+				|| l < labels(i, j, k - 1).x || l < labels(i, j, k + 1).x);
+	};
+	initialDimensions = dims;
+	initialLeafLabels.assign(leafCount, sparseBackground.second);
+	std::vector<char> surfaceLeafs(leafCount, 0);
+#pragma omp parallel for
+	for (int n = 0; n < leafCount; n++) {
+		int3 pos = int3(n % leafDims.x, (n / leafDims.x) % leafDims.y,
+				n / (leafDims.x * leafDims.y)) * L;
+		int3 end = aly::min(pos + int3(L), dims);
+		bool found = false;
+		for (int k = pos.z; k < end.z && !found; k++) {
+			for (int j = pos.y; j < end.y && !found; j++) {
+				for (int i = pos.x; i < end.x && !found; i++) {
+					found = isSurface(i, j, k);
+				}
+			}
+		}
+		initialLeafLabels[n] = labels(pos.x, pos.y, pos.z).x;
+		surfaceLeafs[n] = found;
+	}
+	//Surface voxels are the zero set. Every leaf the march can reach is filled so the sign is known everywhere.
+	EndlessGridFloat field( { 4, L }, MAX_DISTANCE + 0.5f);
+	std::vector<EndlessNodeFloat*> fieldLeafs;
+	for (int n = 0; n < leafCount; n++) {
+		if (!surfaceLeafs[n])
+			continue;
+		int3 id = int3(n % leafDims.x, (n / leafDims.x) % leafDims.y,
+				n / (leafDims.x * leafDims.y));
+		for (int dz = -1; dz <= 1; dz++) {
+			for (int dy = -1; dy <= 1; dy++) {
+				for (int dx = -1; dx <= 1; dx++) {
+					int3 pos = (id + int3(dx, dy, dz)) * L;
+					EndlessNodeFloat* leaf = nullptr;
+					float val;
+					if (!field.getLeafValue(pos.x, pos.y, pos.z, leaf, val)) {
+						field.getLeafValue(pos.x, pos.y, pos.z);
+						field.getLeafValue(pos.x, pos.y, pos.z, leaf, val);
+						fieldLeafs.push_back(leaf);
+					}
+				}
+			}
+		}
+	}
+#pragma omp parallel for
+	for (int n = 0; n < (int) fieldLeafs.size(); n++) {
+		EndlessNodeFloat* leaf = fieldLeafs[n];
+		for (int kk = 0; kk < L; kk++) {
+			for (int jj = 0; jj < L; jj++) {
+				for (int ii = 0; ii < L; ii++) {
+					int3 pos = leaf->location + int3(ii, jj, kk);
+					bool inside = (pos.x >= 0 && pos.y >= 0 && pos.z >= 0
+							&& pos.x < dims.x && pos.y < dims.y && pos.z < dims.z);
+					(*leaf)(ii, jj, kk) =
+							(inside && isSurface(pos.x, pos.y, pos.z)) ? 0.0f : 1.0f;
+				}
+			}
+		}
+	}
+	DistanceField3f().solve(field, MAX_DISTANCE);
+	//Leaves the march reached hold the narrow band, everything else keeps the background distance.
+	initialSparseLevelSet.reset( { 4, L }, sparseBackground);
+	std::vector<std::pair<const EndlessNodeFloat*, EndlessNodeFloatInt*>> leafs;
+	for (const EndlessNodeFloat* leaf : field.getLeafNodes()) {
+		int3 pos = leaf->location;
+		if (pos.x < 0 || pos.y < 0 || pos.z < 0 || pos.x >= dims.x
+				|| pos.y >= dims.y || pos.z >= dims.z)
+			continue;
+		EndlessNodeFloatInt* node = nullptr;
+		FloatInt val;
+		initialSparseLevelSet.getLeafValue(pos.x, pos.y, pos.z);
+		initialSparseLevelSet.getLeafValue(pos.x, pos.y, pos.z, node, val);
+		leafs.push_back( { leaf, node });
+	}
+#pragma omp parallel for
+	for (int n = 0; n < (int) leafs.size(); n++) {
+		const EndlessNodeFloat* leaf = leafs[n].first;
+		EndlessNodeFloatInt* node = leafs[n].second;
+		int3 pos = leaf->location;
+		int3 end = aly::min(pos + int3(L), dims);
+		for (int k = pos.z; k < end.z; k++) {
+			for (int j = pos.y; j < end.y; j++) {
+				for (int i = pos.x; i < end.x; i++) {
+					float d = (*leaf)(i - pos.x, j - pos.y, k - pos.z);
+					if (isSurface(i, j, k)) {
+						d = 0.01f;
+					} else if (d < MAX_DISTANCE + 0.5f) {
+						//Grid distances to the surface voxels, offset like the dense initialization.
+						d = std::min(std::max(std::abs(d), 1.0f) + 0.01f, maxValue);
+					} else {
+						d = bgDist;
+					}
+					(*node)(i - pos.x, j - pos.y, k - pos.z) = FloatInt(d,
+							labels(i, j, k).x);
 				}
 			}
 		}
 	}
-	deltaLevelSet.resize(7 * activeList.size(), 0.0f);
-	objectIds.resize(7 * activeList.size(), -1);
 }
 void MultiActiveContour3D::plugLevelSet(int i, int j, int k, size_t index) {
-	int label = labelImage(i, j, k);
+	int label = getLabel(i, j, k);
 	int activeLabels[26];
-	activeLabels[0] = labelImage(i + 1, j, k - 1);
-	activeLabels[1] = labelImage(i - 1, j, k - 1);
-	activeLabels[2] = labelImage(i, j + 1, k - 1);
-	activeLabels[3] = labelImage(i, j - 1, k - 1);
-	activeLabels[4] = labelImage(i - 1, j - 1, k - 1);
-	activeLabels[5] = labelImage(i + 1, j - 1, k - 1);
-	activeLabels[6] = labelImage(i - 1, j + 1, k - 1);
-	activeLabels[7] = labelImage(i + 1, j + 1, k - 1);
-	activeLabels[8] = labelImage(i, j, k - 1);
+	activeLabels[0] = getLabel(i + 1, j, k - 1);
+	activeLabels[1] = getLabel(i - 1, j, k - 1);
+	activeLabels[2] = getLabel(i, j + 1, k - 1);
+	activeLabels[3] = getLabel(i, j - 1, k - 1);
+	activeLabels[4] = getLabel(i - 1, j - 1, k - 1);
+	activeLabels[5] = getLabel(i + 1, j - 1, k - 1);
+	activeLabels[6] = getLabel(i - 1, j + 1, k - 1);
+	activeLabels[7] = getLabel(i + 1, j + 1, k - 1);
+	activeLabels[8] = getLabel(i, j, k - 1);
 
-	activeLabels[9] = labelImage(i + 1, j, k);
-	activeLabels[10] = labelImage(i - 1, j, k);
-	activeLabels[11] = labelImage(i, j + 1, k);
-	activeLabels[12] = labelImage(i, j - 1, k);
-	activeLabels[13] = labelImage(i - 1, j - 1, k);
-	activeLabels[14] = labelImage(i + 1, j - 1, k);
-	activeLabels[15] = labelImage(i - 1, j + 1, k);
-	activeLabels[16] = labelImage(i + 1, j + 1, k);
+	activeLabels[9] = getLabel(i + 1, j, k);
+	activeLabels[10] = getLabel(i - 1, j, k);
+	activeLabels[11] = getLabel(i, j + 1, k);
+	activeLabels[12] = getLabel(i, j - 1, k);
+	activeLabels[13] = getLabel(i - 1, j - 1, k);
+	activeLabels[14] = getLabel(i + 1, j - 1, k);
+	activeLabels[15] = getLabel(i - 1, j + 1, k);
+	activeLabels[16] = getLabel(i + 1, j + 1, k);
 
-	activeLabels[17] = labelImage(i + 1, j, k + 1);
-	activeLabels[18] = labelImage(i - 1, j, k + 1);
-	activeLabels[19] = labelImage(i, j + 1, k + 1);
-	activeLabels[20] = labelImage(i, j - 1, k + 1);
-	activeLabels[21] = labelImage(i - 1, j - 1, k + 1);
-	activeLabels[22] = labelImage(i + 1, j - 1, k + 1);
-	activeLabels[23] = labelImage(i - 1, j + 1, k + 1);
-	activeLabels[24] = labelImage(i + 1, j + 1, k + 1);
-	activeLabels[25] = labelImage(i, j, k + 1);
+	activeLabels[17] = getLabel(i + 1, j, k + 1);
+	activeLabels[18] = getLabel(i - 1, j, k + 1);
+	activeLabels[19] = getLabel(i, j + 1, k + 1);
+	activeLabels[20] = getLabel(i, j - 1, k + 1);
+	activeLabels[21] = getLabel(i - 1, j - 1, k + 1);
+	activeLabels[22] = getLabel(i + 1, j - 1, k + 1);
+	activeLabels[23] = getLabel(i - 1, j + 1, k + 1);
+	activeLabels[24] = getLabel(i + 1, j + 1, k + 1);
+	activeLabels[25] = getLabel(i, j, k + 1);
 
 	int count = 0;
 	for (int index = 0; index < 26; index++) {
@@ -80,8 +465,8 @@ void MultiActiveContour3D::plugLevelSet(int i, int j, int k, size_t index) {
 	}
 	//Pick any label other than this to fill the hole
 	if (count == 0) {
-		labelImage(i, j, k) = (i > 0) ? activeLabels[1] : activeLabels[0];
-		levelSet(i, j, k) = 3.0f;
+		setLabel(i, j, k, (i > 0) ? activeLabels[1] : activeLabels[0]);
+		setDistance(i, j, k, 3.0f);
 	}
 }
 void MultiActiveContour3D::cleanup() {
@@ -93,7 +478,11 @@ bool MultiActiveContour3D::updateSurface() {
 		std::lock_guard<std::mutex> lockMe(contourLock);
 		Mesh mesh;
 		std::map<int,std::pair<size_t,size_t>> regions;
-		isoSurface.solve(levelSet, labelImage, mesh, MeshType::Triangle, regions, true);
+		if (sparse) {
+			solveSparseSurface(mesh, regions);
+		} else {
+			isoSurface.solve(levelSet, labelImage, mesh, MeshType::Triangle, regions, true);
+		}
 		mesh.updateVertexNormals(false, 4);
 		contour.vertexColors.resize(mesh.vertexLocations.size());
 		contour.vertexLabels.resize(mesh.vertexLocations.size());
@@ -114,6 +503,104 @@ bool MultiActiveContour3D::updateSurface() {
 	}
 	return false;
 }
+void MultiActiveContour3D::solveSparseSurface(Mesh& mesh,
+		std::map<int, std::pair<size_t, size_t>>& regions) {
+	//Each label is meshed by IsoSurface on a signed distance grid that only holds the leaves around it.
+	const int L = SPARSE_LEAF_SIZE;
+	const int3 dims = dimensions;
+	mesh.clear();
+	regions.clear();
+	std::list<EndlessNodeFloatInt*> leafList = sparseLevelSet.getLeafNodes();
+	std::vector<EndlessNodeFloatInt*> leafs(leafList.begin(), leafList.end());
+	std::vector<std::vector<int>> leafLabels(leafs.size());
+#pragma omp parallel for
+	for (int n = 0; n < (int) leafs.size(); n++) {
+		const EndlessNodeFloatInt* leaf = leafs[n];
+		int3 pos = leaf->location;
+		int3 end = aly::min(pos + int3(L), dims);
+		std::vector<int>& labels = leafLabels[n];
+		for (int k = pos.z; k < end.z; k++) {
+			for (int j = pos.y; j < end.y; j++) {
+				for (int i = pos.x; i < end.x; i++) {
+					int l = (*leaf)(i - pos.x, j - pos.y, k - pos.z).second;
+					if (l != 0 && std::find(labels.begin(), labels.end(), l) == labels.end())
+						labels.push_back(l);
+				}
+			}
+		}
+	}
+	std::map<int, std::vector<int>> labelLeafs;
+	for (int n = 0; n < (int) leafs.size(); n++) {
+		for (int l : leafLabels[n]) {
+			labelLeafs[l].push_back(n);
+		}
+	}
+	IsoSurface labelSurface;
+	Mesh labelMesh;
+	std::vector<char> copied(sparseLeafs.size(), 0);
+	for (const auto& pr : labelLeafs) {
+		int label = pr.first;
+		//Neighboring leaves are needed for the cells that straddle a leaf boundary.
+		std::vector<size_t> copyList;
+		for (int n : pr.second) {
+			int3 id = leafs[n]->location / L;
+			for (int dz = -1; dz <= 1; dz++) {
+				for (int dy = -1; dy <= 1; dy++) {
+					for (int dx = -1; dx <= 1; dx++) {
+						int3 nbr = id + int3(dx, dy, dz);
+						if (nbr.x < 0 || nbr.y < 0 || nbr.z < 0
+								|| nbr.x >= leafDimensions.x
+								|| nbr.y >= leafDimensions.y
+								|| nbr.z >= leafDimensions.z)
+							continue;
+						size_t index = getLeafIndex(nbr);
+						if (sparseLeafs[index] != nullptr && !copied[index]) {
+							copied[index] = 1;
+							copyList.push_back(index);
+						}
+					}
+				}
+			}
+		}
+		EndlessGridFloat grid( { 4, L }, sparseBackground.first);
+		std::vector<std::pair<const EndlessNodeFloatInt*, EndlessNodeFloat*>> copies;
+		for (size_t index : copyList) {
+			copied[index] = 0;
+			int3 pos = sparseLeafs[index]->location;
+			EndlessNodeFloat* node = nullptr;
+			float val;
+			grid.getLeafValue(pos.x, pos.y, pos.z);
+			grid.getLeafValue(pos.x, pos.y, pos.z, node, val);
+			copies.push_back( { sparseLeafs[index], node });
+		}
+#pragma omp parallel for
+		for (int n = 0; n < (int) copies.size(); n++) {
+			const EndlessNodeFloatInt* leaf = copies[n].first;
+			EndlessNodeFloat* node = copies[n].second;
+			int3 pos = leaf->location;
+			int3 end = aly::min(pos + int3(L), dims);
+			for (int k = pos.z; k < end.z; k++) {
+				for (int j = pos.y; j < end.y; j++) {
+					for (int i = pos.x; i < end.x; i++) {
+						const FloatInt& val = (*leaf)(i - pos.x, j - pos.y, k - pos.z);
+						(*node)(i - pos.x, j - pos.y, k - pos.z) =
+								(val.second == label) ? -val.first : val.first;
+					}
+				}
+			}
+		}
+		labelSurface.solve(grid, labelMesh, MeshType::Triangle, true, 0.0f);
+		size_t st = mesh.vertexLocations.size();
+		uint32_t offset = (uint32_t) st;
+		mesh.vertexLocations.append(labelMesh.vertexLocations);
+		mesh.vertexNormals.append(labelMesh.vertexNormals);
+		for (uint3 tri : labelMesh.triIndexes.data) {
+			mesh.triIndexes.push_back(tri + uint3(offset));
+		}
+		regions[label] = {st,mesh.vertexLocations.size()};
+	}
+	mesh.updateBoundingBox();
+}
 Manifold3D* MultiActiveContour3D::getSurface() {
 	return &contour;
 }
@@ -126,7 +613,10 @@ const Volume1f& MultiActiveContour3D::getLevelSet() const {
 MultiActiveContour3D::MultiActiveContour3D(
 		const std::shared_ptr<ManifoldCache3D>& cache) :
 		Simulation("Active Contour 3D"), cache(cache), clampSpeed(false), requestUpdateSurface(
-				false) {
+				false), sparse(false), sparseBackground(MAX_DISTANCE + 0.5f, 0), sparseLevelSet(
+				{ 4, SPARSE_LEAF_SIZE }, sparseBackground), swapSparseLevelSet( {
+				4, SPARSE_LEAF_SIZE }, sparseBackground), initialDimensions(0), initialSparseLevelSet(
+				{ 4, SPARSE_LEAF_SIZE }, sparseBackground) {
 	advectionParam = Float(1.0f);
 	pressureParam = Float(0.0f);
 	targetPressureParam = Float(0.5f);
@@ -136,7 +626,10 @@ MultiActiveContour3D::MultiActiveContour3D(
 MultiActiveContour3D::MultiActiveContour3D(const std::string& name,
 		const std::shared_ptr<ManifoldCache3D>& cache) :
 		Simulation(name), cache(cache), clampSpeed(false), requestUpdateSurface(
-				false) {
+				false), sparse(false), sparseBackground(MAX_DISTANCE + 0.5f, 0), sparseLevelSet(
+				{ 4, SPARSE_LEAF_SIZE }, sparseBackground), swapSparseLevelSet( {
+				4, SPARSE_LEAF_SIZE }, sparseBackground), initialDimensions(0), initialSparseLevelSet(
+				{ 4, SPARSE_LEAF_SIZE }, sparseBackground) {
 	advectionParam = Float(1.0f);
 	pressureParam = Float(0.0f);
 	targetPressureParam = Float(0.5f);
@@ -164,6 +657,14 @@ void MultiActiveContour3D::setup(const aly::ParameterPanePtr& pane) {
 	pane->addCheckBox("Clamp Speed", clampSpeed);
 }
 void MultiActiveContour3D::setInitialLabels(const Volume1i& labels) {
+	if (sparse) {
+		initialLevelSet.clear();
+		initialLabels.clear();
+		seedSparseLevelSet(labels);
+		return;
+	}
+	initialSparseLevelSet.clear();
+	initialLeafLabels.clear();
 	this->initialLabels = labels;
 	this->swapLabelImage = labels;
 	this->labelImage = labels;
@@ -207,31 +708,85 @@ void MultiActiveContour3D::setInitialLabels(const Volume1i& labels) {
 }
 
 bool MultiActiveContour3D::init() {
-	int3 dims = initialLevelSet.dimensions();
+	int3 dims = (initialLeafLabels.size() > 0) ?
+			initialDimensions : initialLevelSet.dimensions();
 	if (dims.x == 0 || dims.y == 0 || dims.z == 0)
 		return false;
 	simulationDuration = std::max(std::max(dims.x, dims.y), dims.z) * 1.75f;
 	simulationIteration = 0;
 	simulationTime = 0;
 	timeStep = 1.0f;
-	levelSet.resize(dims.x, dims.y, dims.z);
-	swapLevelSet.resize(dims.x, dims.y, dims.z);
-	labelImage.resize(dims.x, dims.y, dims.z);
-	swapLabelImage.resize(dims.x, dims.y, dims.z);
+	dimensions = dims;
+	if (sparse) {
+		levelSet.clear();
+		swapLevelSet.clear();
+		labelImage.clear();
+		swapLabelImage.clear();
+		initSparseLevelSet();
+	} else {
+		sparseLevelSet.clear();
+		swapSparseLevelSet.clear();
+		sparseLeafs.clear();
+		swapSparseLeafs.clear();
+		sparseLeafLabels.clear();
+		levelSet.resize(dims.x, dims.y, dims.z);
+		swapLevelSet.resize(dims.x, dims.y, dims.z);
+		labelImage.resize(dims.x, dims.y, dims.z);
+		swapLabelImage.resize(dims.x, dims.y, dims.z);
+		if (initialLeafLabels.size() > 0) {
+			//Initial state was seeded sparse, expand it.
+			const int LS = SPARSE_LEAF_SIZE;
+			const EndlessGridFloatInt& initialGrid = initialSparseLevelSet;
+			const int3 leafDims = (dims + int3(LS - 1)) / LS;
+#pragma omp parallel for
+			for (int k = 0; k < dims.z; k++) {
+				for (int j = 0; j < dims.y; j++) {
+					for (int i = 0; i < dims.x; i++) {
+						EndlessNodeFloatInt* leaf = nullptr;
+						FloatInt val;
+						if (!initialGrid.getLeafValue(i, j, k, leaf, val)) {
+							int3 id = int3(i, j, k) / LS;
+							val = FloatInt(sparseBackground.first,
+									initialLeafLabels[id.x + (id.y + id.z * (size_t) leafDims.y) * leafDims.x]);
+						}
+						levelSet(i, j, k).x = val.first;
+						labelImage(i, j, k).x = val.second;
+					}
+				}
+			}
+			swapLevelSet = levelSet;
+			swapLabelImage = labelImage;
+		} else {
 #pragma omp parallel for
-	for (int i = 0; i < (int) initialLevelSet.size(); i++) {
-		float val = aly::clamp(initialLevelSet[i], 0.0f, (maxLayers + 1.0f));
-		levelSet[i] = val;
-		swapLevelSet[i] = val;
+			for (int i = 0; i < (int) initialLevelSet.size(); i++) {
+				float val = aly::clamp(initialLevelSet[i], 0.0f, (maxLayers + 1.0f));
+				levelSet[i] = val;
+				swapLevelSet[i] = val;
+			}
+			labelImage = initialLabels;
+			swapLabelImage = initialLabels;
+		}
 	}
-	labelImage = initialLabels;
-	swapLabelImage = initialLabels;
 	std::set<int> labelSet;
 	int L = 1;
-	for (int1 l : initialLabels.data) {
-		if (l.x != 0) {
-			labelSet.insert(l.x);
-			L = std::max(L, l.x + 1);
+	auto addLabel = [&](int l) {
+		if (l != 0) {
+			labelSet.insert(l);
+			L = std::max(L, l + 1);
+		}
+	};
+	if (initialLeafLabels.size() > 0) {
+		for (int l : initialLeafLabels) {
+			addLabel(l);
+		}
+		for (const EndlessNodeFloatInt* leaf : initialSparseLevelSet.getLeafNodes()) {
+			for (const FloatInt& val : leaf->data) {
+				addLabel(val.second);
+			}
+		}
+	} else {
+		for (int1 l : initialLabels.data) {
+			addLabel(l.x);
 		}
 	}
 	forceIndexes.resize(L, -1);
@@ -273,26 +828,26 @@ bool MultiActiveContour3D::init() {
 }
 float MultiActiveContour3D::getSwapLevelSetValue(int i, int j, int k,
 		int l) const {
-	if (swapLabelImage(i, j, k).x == l) {
-		return -swapLevelSet(i, j, k);
+	if (getSwapLabel(i, j, k) == l) {
+		return -getSwapDistance(i, j, k);
 	} else {
-		return swapLevelSet(i, j, k);
+		return getSwapDistance(i, j, k);
 	}
 }
 float MultiActiveContour3D::getLevelSetValue(int i, int j, int k, int l) const {
-	if (labelImage(i, j, k).x == l) {
-		return -levelSet(i, j, k);
+	if (getLabel(i, j, k) == l) {
+		return -getDistance(i, j, k);
 	} else {
-		return levelSet(i, j, k);
+		return getDistance(i, j, k);
 	}
 }
 float MultiActiveContour3D::getUnionLevelSetValue(int i, int j, int k,
 		int l) const {
-	int c = labelImage(i, j, k).x;
+	int c = getLabel(i, j, k);
 	if (c == l || c == 0) {
-		return -levelSet(i, j, k);
+		return -getDistance(i, j, k);
 	} else {
-		return levelSet(i, j, k);
+		return getDistance(i, j, k);
 	}
 }
 float MultiActiveContour3D::getLevelSetValue(float x, float y, float z,
@@ -342,7 +897,7 @@ float MultiActiveContour3D::getUnionLevelSetValue(float x, float y, float z,
 }
 void MultiActiveContour3D::pressureAndAdvectionMotion(int i, int j, int k,
 		size_t gid) {
-	float v111 = swapLevelSet(i, j, k).x;
+	float v111 = getSwapDistance(i, j, k);
 	float2 grad;
 	if (v111 > 0.5f) {
 		for (int index = 0; index < 7; index++) {
@@ -351,13 +906,13 @@ void MultiActiveContour3D::pressureAndAdvectionMotion(int i, int j, int k,
 		return;
 	}
 	int activeLabels[7];
-	activeLabels[0] = swapLabelImage(i, j, k).x;
-	activeLabels[1] = swapLabelImage(i + 1, j, k).x;
-	activeLabels[2] = swapLabelImage(i - 1, j, k).x;
-	activeLabels[3] = swapLabelImage(i, j + 1, k).x;
-	activeLabels[4] = swapLabelImage(i, j - 1, k).x;
-	activeLabels[5] = swapLabelImage(i, j, k + 1).x;
-	activeLabels[6] = swapLabelImage(i, j, k - 1).x;
+	activeLabels[0] = getSwapLabel(i, j, k);
+	activeLabels[1] = getSwapLabel(i + 1, j, k);
+	activeLabels[2] = getSwapLabel(i - 1, j, k);
+	activeLabels[3] = getSwapLabel(i, j + 1, k);
+	activeLabels[4] = getSwapLabel(i, j - 1, k);
+	activeLabels[5] = getSwapLabel(i, j, k + 1);
+	activeLabels[6] = getSwapLabel(i, j, k - 1);
 	int label;
 	float3 vec = vecFieldImage(i, j, k);
 	float forceX = advectionParam.toFloat() * vec.x;
@@ -481,7 +1036,7 @@ void MultiActiveContour3D::pressureAndAdvectionMotion(int i, int j, int k,
 	}
 }
 void MultiActiveContour3D::advectionMotion(int i, int j, int k, size_t gid) {
-	float v111 = swapLevelSet(i, j, k).x;
+	float v111 = getSwapDistance(i, j, k);
 	float2 grad;
 	if (v111 > 0.5f) {
 		for (int index = 0; index < 7; index++) {
@@ -490,13 +1045,13 @@ void MultiActiveContour3D::advectionMotion(int i, int j, int k, size_t gid) {
 		return;
 	}
 	int activeLabels[7];
-	activeLabels[0] = swapLabelImage(i, j, k).x;
-	activeLabels[1] = swapLabelImage(i + 1, j, k).x;
-	activeLabels[2] = swapLabelImage(i - 1, j, k).x;
-	activeLabels[3] = swapLabelImage(i, j + 1, k).x;
-	activeLabels[4] = swapLabelImage(i, j - 1, k).x;
-	activeLabels[5] = swapLabelImage(i, j, k + 1).x;
-	activeLabels[6] = swapLabelImage(i, j, k - 1).x;
+	activeLabels[0] = getSwapLabel(i, j, k);
+	activeLabels[1] = getSwapLabel(i + 1, j, k);
+	activeLabels[2] = getSwapLabel(i - 1, j, k);
+	activeLabels[3] = getSwapLabel(i, j + 1, k);
+	activeLabels[4] = getSwapLabel(i, j - 1, k);
+	activeLabels[5] = getSwapLabel(i, j, k + 1);
+	activeLabels[6] = getSwapLabel(i, j, k - 1);
 	int label;
 	float3 vec = vecFieldImage(i, j, k);
 	float forceX = advectionParam.toFloat() * vec.x;
@@ -594,7 +1149,7 @@ void MultiActiveContour3D::advectionMotion(int i, int j, int k, size_t gid) {
 }
 void MultiActiveContour3D::applyForces(int i, int j, int k, size_t gid,
 		float timeStep) {
-	if (swapLevelSet(i, j, k).x > 0.5f)
+	if (getSwapDistance(i, j, k) > 0.5f)
 		return;
 	float minValue1 = 1E10f;
 	float minValue2 = 1E10f;
@@ -627,80 +1182,108 @@ void MultiActiveContour3D::applyForces(int i, int j, int k, size_t gid,
 	}
 	if (minLabel2 >= 0) {
 		if (minValue1 == minValue2) {
-			labelImage(i, j, k).x = min(minLabel1, minLabel2);
+			setLabel(i, j, k, min(minLabel1, minLabel2));
 		} else {
-			labelImage(i, j, k).x = minLabel1;
+			setLabel(i, j, k, minLabel1);
 		}
-		levelSet(i, j, k).x = std::abs(0.5f * (float) (minValue1 - minValue2));
+		setDistance(i, j, k, std::abs(0.5f * (float) (minValue1 - minValue2)));
 	} else if (minValue1 < 1E10f) {
-		labelImage(i, j, k) = minLabel1;
-		levelSet(i, j, k) = std::abs(minValue1);
+		setLabel(i, j, k, minLabel1);
+		setDistance(i, j, k, std::abs(minValue1));
 	}
 }
 
 int MultiActiveContour3D::deleteElements() {
-	std::vector<int3> newList;
-	for (int i = 0; i < (int) activeList.size(); i++) {
-		int3 pos = activeList[i];
-		float val = swapLevelSet(pos.x, pos.y, pos.z);
+	int sz = (int) activeList.size();
+	compactFlags.resize(sz);
+#pragma omp parallel for
+	for (int n = 0; n < sz; n++) {
+		int3 pos = activeList[n];
+		float val = getSwapDistance(pos.x, pos.y, pos.z);
 		if (std::abs(val) <= MAX_DISTANCE) {
-			newList.push_back(pos);
+			compactFlags[n] = 1;
 		} else {
+			compactFlags[n] = 0;
 			val = sign(val) * (MAX_DISTANCE + 0.5f);
-			levelSet(pos.x, pos.y, pos.z) = val;
-			swapLevelSet(pos.x, pos.y, pos.z) = val;
+			setDistance(pos.x, pos.y, pos.z, val);
+			setSwapDistance(pos.x, pos.y, pos.z, val);
 		}
 	}
-	int diff = (int) (activeList.size() - newList.size());
-	activeList = newList;
+	ParallelCompact(swapActiveList, sz, [this](int n) {
+		return (int) compactFlags[n];
+	}, [this](int n, int3* dst) {
+		if (compactFlags[n]) {
+			*dst = activeList[n];
+			return 1;
+		}
+		return 0;
+	}, compactOffsets);
+	int diff = (int) (activeList.size() - swapActiveList.size());
+	activeList.swap(swapActiveList);
 	return diff;
 }
 int MultiActiveContour3D::addElements() {
-	const int xNeighborhood[6] = { -1, 1, 0, 0, 0, 0 };
-	const int yNeighborhood[6] = { 0, 0, -1, 1, 0, 0 };
-	const int zNeighborhood[6] = { 0, 0, 0, 0, -1, 1 };
-	std::vector<int2> newList;
+	static const int3 neighborhood[6] = { int3(-1, 0, 0), int3(1, 0, 0), int3(0,
+			-1, 0), int3(0, 1, 0), int3(0, 0, -1), int3(0, 0, 1) };
 	int sz = (int) activeList.size();
-	float INDICATOR = (float) std::max(std::max(levelSet.rows, levelSet.cols),
-			levelSet.slices);
+	float INDICATOR = (float) std::max(std::max(dimensions.x, dimensions.y),
+			dimensions.z);
+	//Tag new neighbors with the first offset that reaches them. Neighbors reached through
+	//the same offset are distinct, so each offset is flagged and then written in parallel.
+	compactFlags.resize(6 * (size_t) sz);
 	for (int offset = 0; offset < 6; offset++) {
-		int xOff = xNeighborhood[offset];
-		int yOff = yNeighborhood[offset];
-		int zOff = zNeighborhood[offset];
+		int3 off = neighborhood[offset];
+#pragma omp parallel for
 		for (int n = 0; n < sz; n++) {
 			int3 pos = activeList[n];
-			int3 pos2 = int3(pos.x + xOff, pos.y + yOff, pos.z + zOff);
-			float val1 = std::abs(levelSet(pos.x, pos.y, pos.z));
-			float val2 = std::abs(levelSet(pos2.x, pos2.y, pos2.z));
-			if (val1 <= MAX_DISTANCE - 1.0f && val2 >= MAX_DISTANCE
-					&& val2 < INDICATOR) {
-				levelSet(pos2.x, pos2.y, pos2.z) = INDICATOR + offset;
-			}
+			float val1 = std::abs(getDistance(pos.x, pos.y, pos.z));
+			float val2 = std::abs(
+					getDistance(pos.x + off.x, pos.y + off.y, pos.z + off.z));
+			compactFlags[n] = (val1 <= MAX_DISTANCE - 1.0f && val2 >= MAX_DISTANCE
+					&& val2 < INDICATOR);
 		}
-	}
-	for (int offset = 0; offset < 6; offset++) {
-		int xOff = xNeighborhood[offset];
-		int yOff = yNeighborhood[offset];
-		int zOff = zNeighborhood[offset];
+#pragma omp parallel for
 		for (int n = 0; n < sz; n++) {
-			int3 pos = activeList[n];
-			int3 pos2 = int3(pos.x + xOff, pos.y + yOff, pos.z + zOff);
-			float val1 = levelSet(pos.x, pos.y, pos.z);
-			float val2 = levelSet(pos2.x, pos2.y, pos2.z);
-			if (std::abs(val1) <= MAX_DISTANCE - 1.0f
-					&& val2 == INDICATOR + offset) {
-				activeList.push_back(pos2);
-				val2 = swapLevelSet(pos2.x, pos2.y, pos2.z);
-				val2 = aly::sign(val2) * MAX_DISTANCE;
-				swapLevelSet(pos2.x, pos2.y, pos2.z) = val2;
-				levelSet(pos2.x, pos2.y, pos2.z) = val2;
+			if (compactFlags[n]) {
+				int3 pos = activeList[n];
+				setDistance(pos.x + off.x, pos.y + off.y, pos.z + off.z,
+						INDICATOR + offset);
 			}
 		}
 	}
+	//Append tagged neighbors in (offset, element) order.
+#pragma omp parallel for
+	for (int t = 0; t < 6 * sz; t++) {
+		int offset = t / sz;
+		int3 off = neighborhood[offset];
+		int3 pos = activeList[t - offset * sz];
+		float val1 = getDistance(pos.x, pos.y, pos.z);
+		float val2 = getDistance(pos.x + off.x, pos.y + off.y, pos.z + off.z);
+		compactFlags[t] = (std::abs(val1) <= MAX_DISTANCE - 1.0f
+				&& val2 == INDICATOR + offset);
+	}
+	ParallelCompact(activeList, 6 * sz, [this](int t) {
+		return (int) compactFlags[t];
+	}, [=](int t, int3* dst) {
+		if (compactFlags[t]) {
+			int offset = t / sz;
+			*dst = activeList[t - offset * sz] + neighborhood[offset];
+			return 1;
+		}
+		return 0;
+	}, compactOffsets, sz);
+#pragma omp parallel for
+	for (int n = sz; n < (int) activeList.size(); n++) {
+		int3 pos2 = activeList[n];
+		float val2 = getSwapDistance(pos2.x, pos2.y, pos2.z);
+		val2 = aly::sign(val2) * MAX_DISTANCE;
+		setSwapDistance(pos2.x, pos2.y, pos2.z, val2);
+		setDistance(pos2.x, pos2.y, pos2.z, val2);
+	}
 	return (int) (activeList.size() - sz);
 }
 void MultiActiveContour3D::pressureMotion(int i, int j, int k, size_t gid) {
-	float v111 = swapLevelSet(i, j, k).x;
+	float v111 = getSwapDistance(i, j, k);
 	float2 grad;
 	if (v111 > 0.5f) {
 		for (int index = 0; index < 7; index++) {
@@ -709,13 +1292,13 @@ void MultiActiveContour3D::pressureMotion(int i, int j, int k, size_t gid) {
 		return;
 	}
 	int activeLabels[7];
-	activeLabels[0] = swapLabelImage(i,     j, k).x;
-	activeLabels[1] = swapLabelImage(i + 1, j, k).x;
-	activeLabels[2] = swapLabelImage(i - 1, j, k).x;
-	activeLabels[3] = swapLabelImage(i, j + 1, k).x;
-	activeLabels[4] = swapLabelImage(i, j - 1, k).x;
-	activeLabels[5] = swapLabelImage(i, j, k + 1).x;
-	activeLabels[6] = swapLabelImage(i, j, k - 1).x;
+	activeLabels[0] = getSwapLabel(i,     j, k);
+	activeLabels[1] = getSwapLabel(i + 1, j, k);
+	activeLabels[2] = getSwapLabel(i - 1, j, k);
+	activeLabels[3] = getSwapLabel(i, j + 1, k);
+	activeLabels[4] = getSwapLabel(i, j - 1, k);
+	activeLabels[5] = getSwapLabel(i, j, k + 1);
+	activeLabels[6] = getSwapLabel(i, j, k - 1);
 	int label;
 	float pressureValue =
 			(pressureImage.size() > 0) ? pressureImage(i, j, k).x : 0.0f;
@@ -826,18 +1409,18 @@ void MultiActiveContour3D::updateDistanceField(int i, int j, int k, int band) {
 	float v211;
 	float v110;
 	float v112;
-	float activeLevelSet = swapLevelSet(i, j, k).x;
+	float activeLevelSet = getSwapDistance(i, j, k);
 	if (std::abs(activeLevelSet) <= 0.5f) {
 		return;
 	}
-	int label = labelImage(i, j, k);
+	int label = getLabel(i, j, k);
 	v011 = getLevelSetValue(i - 1, j, k, label);
 	v121 = getLevelSetValue(i, j + 1, k, label);
 	v101 = getLevelSetValue(i, j - 1, k, label);
 	v211 = getLevelSetValue(i + 1, j, k, label);
 	v110 = getLevelSetValue(i, j, k - 1, label);
 	v112 = getLevelSetValue(i, j, k + 1, label);
-	if (levelSet(i, j, k).x > band - 0.5f) {
+	if (getDistance(i, j, k) > band - 0.5f) {
 		v111 = (MAX_DISTANCE + 0.5f);
 		v111 = min(std::abs(v011 - 1), v111);
 		v111 = min(std::abs(v121 - 1), v111);
@@ -845,7 +1428,7 @@ void MultiActiveContour3D::updateDistanceField(int i, int j, int k, int band) {
 		v111 = min(std::abs(v211 - 1), v111);
 		v111 = min(std::abs(v110 - 1), v111);
 		v111 = min(std::abs(v112 - 1), v111);
-		levelSet(i, j, k) = v111;
+		setDistance(i, j, k, v111);
 	}
 }
 
@@ -873,10 +1456,7 @@ float MultiActiveContour3D::evolve(float maxStep) {
 	}
 	float timeStep = (float) maxStep;
 	if (!clampSpeed) {
-		float maxDelta = 0.0f;
-		for (float delta : deltaLevelSet) {
-			maxDelta = std::max(std::abs(delta), maxDelta);
-		}
+		float maxDelta = ParallelMaxAbs(deltaLevelSet);
 		const float maxSpeed = 0.999f;
 		timeStep = (float) (maxStep
 				* ((maxDelta > maxSpeed) ? (maxSpeed / maxDelta) : maxSpeed));
@@ -905,11 +1485,15 @@ float MultiActiveContour3D::evolve(float maxStep) {
 #pragma omp parallel for
 	for (int i = 0; i < (int) activeList.size(); i++) {
 		int3 pos = activeList[i];
-		swapLevelSet(pos.x, pos.y, pos.z) = levelSet(pos.x, pos.y, pos.z);
-		swapLabelImage(pos.x, pos.y, pos.z) = labelImage(pos.x, pos.y, pos.z);
+		setSwapDistance(pos.x, pos.y, pos.z, getDistance(pos.x, pos.y, pos.z));
+		setSwapLabel(pos.x, pos.y, pos.z, getLabel(pos.x, pos.y, pos.z));
 	}
 	deleteElements();
 	addElements();
+	if (sparse) {
+		allocateSparseLeaves();
+		freeSparseLeaves();
+	}
 	deltaLevelSet.resize(7 * activeList.size(), 0.0f);
 	objectIds.resize(7 * activeList.size(), -1);
 	return timeStep;
@@ -458,7 +458,8 @@ void MultiIsoSurface::solve(const Volume1f& data, const Volume1i& labels,
 	mesh.updateBoundingBox();
 }
 void MultiIsoSurface::solve(const EndlessGridFloatInt& grid, Mesh& mesh,
-		const MeshType& type, bool regularizeTest, int label) {
+		const MeshType& type, bool regularizeTest, int label,
+		bool sharpFeatures) {
 	mesh.clear();
 	float oldBg = backgroundValue;
 	backgroundValue = grid.getBackgroundValue().value(label);
@@ -466,7 +467,7 @@ void MultiIsoSurface::solve(const EndlessGridFloatInt& grid, Mesh& mesh,
 		solveTri(grid, mesh, label);
 
 	} else {
-		solveQuad(grid, mesh, label);
+		solveQuad(grid, mesh, label, sharpFeatures);
 	}
 	if (regularizeTest) {
 		regularize(grid, mesh, label);
@@ -622,20 +623,38 @@ void MultiIsoSurface::solveTri(const float* vol, const int* labels,
 	}
 }
 void MultiIsoSurface::solveQuad(const EndlessGridFloatInt& grid, Mesh& mesh,
-		int label) {
+		int label, bool sharpFeatures) {
 	auto leafs = grid.getLeafNodes();
-	int dim = leafs.front()->dim;
-	int bdim = dim + 1;
-	this->rows = bdim;
-	this->cols = bdim;
-	this->slices = bdim;
-	std::unordered_set<int3> activeVoxels;
-	std::unordered_map<int4, EdgeInfo> activeEdges;
-	std::unordered_map<int3, uint32_t> vertexIndices;
-	findActiveVoxels(grid, leafs, activeVoxels, activeEdges, label);
-	generateVertexData(grid, activeVoxels, activeEdges, vertexIndices, mesh,
-			label);
-	generateTriangles(activeEdges, vertexIndices, mesh);
+	if (leafs.empty())
+		return;
+	std::vector<const EndlessNodeFloatInt*> leaves(leafs.begin(), leafs.end());
+	std::vector<int3> locations(leaves.size());
+	for (size_t n = 0; n < leaves.size(); n++) {
+		locations[n] = leaves[n]->location;
+	}
+	const int dim = leaves.front()->dim;
+	const int bdim = dim + 1;
+	IsoSurface::contourLeaves(locations, dim, [&](size_t n, float* block) {
+		const EndlessNodeFloatInt* leaf = leaves[n];
+		const int3 loc = leaf->location;
+		for (int z = 0; z < bdim; z++) {
+			for (int y = 0; y < bdim; y++) {
+				for (int x = 0; x < bdim; x++) {
+					FloatInt val;
+					if (x >= dim || y >= dim || z >= dim) {
+						val = grid.getLeafValue(loc.x + x, loc.y + y, loc.z + z);
+					} else {
+						val = leaf->data[x + y * dim + z * dim * dim];
+					}
+					block[x + y * bdim + z * bdim * bdim] = val.value(label);
+				}
+			}
+		}
+	}, [&](int i, int j, int k) {
+		return grid.getLeafValue(i, j, k).value(label);
+	}, [&](float x, float y, float z) {
+		return GetInterpolatedNormal(grid, x, y, z, label);
+	}, mesh, 0.0f, backgroundValue, winding, sharpFeatures);
 }
 void MultiIsoSurface::solveTri(const EndlessGridFloatInt& grid, Mesh& mesh,
 		int label) {
@@ -924,39 +943,6 @@ void MultiIsoSurface::generateVertexData(const float*data, const int* labels,
 				interpolateNormal(data, nodePos.x, nodePos.y, nodePos.z));
 	}
 }
-void MultiIsoSurface::generateVertexData(const EndlessGridFloatInt& grid,
-		const std::unordered_set<int3>& voxels,
-		const std::unordered_map<int4, EdgeInfo>& edges,
-		std::unordered_map<int3, uint32_t>& vertexIndices, Mesh& buffer,
-		int label) {
-	Vector3f& vert = buffer.vertexLocations;
-	Vector3f& norm = buffer.vertexNormals;
-	float3 p[12];
-	uint32_t idxCounter = vert.size();
-	for (const auto& voxelID : voxels) {
-		int idx = 0;
-		for (int a = 0; a < 3; a++) {
-			for (int i = 0; i < 4; i++) {
-				int4 edgeID = int4(voxelID + EDGE_NODE_OFFSETS[a][i], a);
-				const auto iter = edges.find(edgeID);
-				if (iter != end(edges)) {
-					const auto& info = iter->second;
-					p[idx++] = info.point;
-				}
-			}
-		}
-		float3 nodePos(0.0f);
-		for (int i = 0; i < idx; i++) {
-			nodePos += p[i];
-		}
-		nodePos /= (float) idx;
-		vertexIndices[voxelID] = idxCounter++;
-		vert.push_back(nodePos);
-		norm.push_back(
-				GetInterpolatedNormal(grid, nodePos.x, nodePos.y, nodePos.z,
-						label));
-	}
-}
 void MultiIsoSurface::generateTriangles(
 		const std::unordered_map<int4, EdgeInfo>& edges,
 		const std::unordered_map<int3, uint32_t>& vertexIndices, Mesh& mesh) {
@@ -1001,81 +987,6 @@ void MultiIsoSurface::generateTriangles(
 		quads.push_back(quad);
 	}
 }
-void MultiIsoSurface::findActiveVoxels(const EndlessGridFloatInt& grid,
-		const std::list<EndlessNodeFloatInt*>& leafs,
-		std::unordered_set<int3>& activeVoxels,
-		std::unordered_map<int4, EdgeInfo>& activeEdges, int label) {
-	int bdim = rows;
-	std::vector<float> data(rows * cols * slices);
-	std::vector<int> labels(rows * cols * slices);
-	for (EndlessNodeFloatInt* leaf : leafs) {
-		int dim = leaf->dim;
-		int3 loc = leaf->location;
-		for (int z = 0; z < bdim; z++) {
-			for (int y = 0; y < bdim; y++) {
-				for (int x = 0; x < bdim; x++) {
-					std::pair<float, int> val;
-					if (x >= dim || y >= dim || z >= dim) {
-						val = grid.getLeafValue(loc.x + x, loc.y + y,
-								loc.z + z);
-					} else {
-						val = leaf->data[x + y * dim + z * dim * dim];
-					}
-					data[x + y * bdim + z * bdim * bdim] = val.first;
-					labels[x + y * bdim + z * bdim * bdim] = val.second;
-				}
-			}
-		}
-		for (int z = 0; z < dim; z++) {
-			for (int y = 0; y < dim; y++) {
-				for (int x = 0; x < dim; x++) {
-					float fValue1 = getValue(data.data(), labels.data(), x, y,
-							z, label);
-					if (fValue1 != backgroundValue) {
-						int3 pivot = int3(x + loc.x, y + loc.y, z + loc.z);
-						for (int a = 0; a < 3; a++) {
-							int3 axis = AXIS_OFFSET[a];
-							int3 nbr = int3(x, y, z) + axis;
-							if (nbr.x >= 0 && nbr.y >= 0 && nbr.z >= 0
-									&& nbr.x < rows && nbr.y < cols
-									&& nbr.z < slices) {
-								float fValue2 = getValue(data.data(),
-										labels.data(), nbr.x, nbr.y, nbr.z,
-										label);
-								if (fValue2 != backgroundValue
-										&& fValue1 * fValue2 < 0) {
-									float3 crossing((float) pivot.x,
-											(float) pivot.y, (float) pivot.z);
-									double fDelta = fValue2 - fValue1;
-									if (std::abs(fDelta) < 1E-3f) {
-										crossing += float3(axis) * 0.5f;
-									} else {
-										crossing += float3(axis)
-												* (float) ((-fValue1) / fDelta);
-									}
-									EdgeInfo info;
-									info.point = crossing;
-									if (winding == Winding::Clockwise) {
-										info.winding = (fValue1 < 0.f);
-									} else {
-										info.winding = (fValue1 > 0.f);
-									}
-									activeEdges[int4(pivot.x, pivot.y, pivot.z,
-											a)] = info;
-									auto edgeNodes = EDGE_NODE_OFFSETS[a];
-									for (int i = 0; i < 4; i++) {
-										int3 id = pivot - edgeNodes[i];
-										activeVoxels.insert(id);
-									}
-								}
-							}
-						}
-					}
-				}
-			}
-		}
-	}
-}
 void MultiIsoSurface::findActiveVoxels(const float* vol, const int* labels,
 		const std::vector<int3>& indexList,
 		std::unordered_set<int3>& activeVoxels,
@@ -20,69 +20,17 @@
 */
 #include "segmentation/SLIC.h"
 #include <AlloyImageProcessing.h>
+#include <AlloyConnectedComponents.h>
 #include <set>
+#include <emmintrin.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 namespace aly {
 	SuperPixels::SuperPixels() :perturbSeeds(true), numLabels(0), bonusThreshold(10.0f), bonus(1.5f), errorThreshold(0.01f){
 	}
 	int SuperPixels::computeConnectedComponents(const Image1i& labels, Image1i& outLabels, std::vector<int> &compCounts) {
-		const int xShift[4] = { -1, 1, 0, 0 };
-		const int yShift[4] = { 0, 0,-1, 1 };
-		outLabels.resize(labels.width, labels.height);
-		outLabels.set(int1(-1));
-		std::list<int2> queue;
-		int2 pivot(0, 0);
-		int cc = 0;
-		int ccCount = 0;
-		int pivotLabel = 0;
-		compCounts.clear();
-		do
-		{
-			queue.clear();
-			outLabels(pivot) = int1(cc);
-			pivotLabel = labels(pivot).x;
-			ccCount = 1;
-			queue.push_back(pivot);
-			while (queue.size() > 0)
-			{
-				int2 v = queue.front();
-				queue.pop_front();
-				for (int s = 0; s < 4; s++)
-				{
-					int2 nbr = int2(v.x + xShift[s], v.y + yShift[s]);
-					if (nbr.x >= 0 && nbr.y >= 0 && nbr.x < outLabels.width&&nbr.y < outLabels.height) {
-						if (outLabels(nbr).x < 0 && labels(nbr).x == pivotLabel) {
-							outLabels(nbr).x = cc;
-							ccCount++;
-							queue.push_back(nbr);
-						}
-					}
-				}
-			}
-			compCounts.push_back(ccCount);
-
-			pivot = int2(-1, -1);
-			for (int t = 0;t < 16;t++) {
-				int i = RandomUniform(0, labels.width - 1);
-				int j = RandomUniform(0, labels.height - 1);
-				if (outLabels(i, j).x < 0)
-				{
-					pivot = int2(i, j);
-					break;
-				}
-			}
-			if (pivot.x < 0) {
-				for (int j = 1; j < labels.height-1; j++) {
-					for (int i = 1; i < labels.width-1; i++) {
-						if (outLabels(i, j).x < 0) {
-							pivot = int2(i, j);
-							break;
-						}
-					}
-				}
-			}
-			cc++;
-		} while (pivot.x >= 0);
-		return (int)compCounts.size();
+		return LabelConnectedComponents(labels, outLabels, compCounts, Connectivity::Four, false);
 	}
 	int SuperPixels::makeLabelsUnique(Image1i& outImage) {
 		std::map<int, int> lookup;
@@ -106,23 +54,7 @@ namespace aly {
 	{
 		const int xShift[4] = { -1, 1, 0, 0 };
 		const int yShift[4] = { 0, 0,-1, 1 };
-		std::vector<int> compCounts;
-		std::vector<int> labels;
-		std::set<int> removeList;
-		computeConnectedComponents(labelImage,outImage, compCounts);
-		for (int l = 0;l < (int)compCounts.size();l++) {
-			if (compCounts[l] < minSize) {
-				removeList.insert(l);
-			}
-		}
-		for (int j = 0;j < outImage.height;j++) {
-			for (int i = 0;i < outImage.width;i++) {
-				int l = outImage(i, j).x;
-				if (removeList.find(l) != removeList.end()) {
-					outImage(i, j).x = -1;
-				}
-			}
-		}
+		int removeCount = RemoveSmallConnectedComponents(labelImage, outImage, minSize, Connectivity::Four, false);
 		bool change = false;
 		do {
 			change = false;
@@ -143,7 +75,7 @@ namespace aly {
 				}
 			}
 		}while (change);
-		return (int)removeList.size();
+		return removeCount;
 	}
 
 	void SuperPixels::initializeSeeds(int K) {
@@ -288,6 +220,113 @@ namespace aly {
 			}
 		}
 	}
+	void SuperPixels::updateColorPlanes() {
+		const size_t N = labImage.size();
+		planeL.resize(N);
+		planeA.resize(N);
+		planeB.resize(N);
+#pragma omp parallel for
+		for (int i = 0;i < (int)N;i++) {
+			const float3& c = labImage[i];
+			planeL[i] = c.x;
+			planeA[i] = c.y;
+			planeB[i] = c.z;
+		}
+	}
+	void SuperPixels::assignLabels(Image1f& scoreImage, float offset, float invxywt) {
+		const int width = labImage.width;
+		const int height = labImage.height;
+		const int tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+		const int tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+		const int numk = (int)colorCenters.size();
+		//Bin cluster search windows by tile. Clusters are added in label order, which preserves the tie breaker.
+		std::vector<std::vector<int>> tileClusters(tilesX*tilesY);
+		std::vector<int4> windows(numk);
+		for (int n = 0; n < numk; n++) {
+			float2 pixelCenter = pixelCenters[n];
+			int4 win;
+			win.x = std::max(0, (int)std::floor(pixelCenter.x - offset));
+			win.y = std::max(0, (int)std::floor(pixelCenter.y - offset));
+			win.z = std::min(width - 1, (int)std::ceil(pixelCenter.x + offset));
+			win.w = std::min(height - 1, (int)std::ceil(pixelCenter.y + offset));
+			windows[n] = win;
+			if (win.x > win.z || win.y > win.w)continue;
+			for (int ty = win.y / TILE_SIZE;ty <= win.w / TILE_SIZE;ty++) {
+				for (int tx = win.x / TILE_SIZE;tx <= win.z / TILE_SIZE;tx++) {
+					tileClusters[tx + ty*tilesX].push_back(n);
+				}
+			}
+		}
+		float* scores = scoreImage.ptr();
+		int* labels = labelImage.ptr();
+		const float* L = planeL.data();
+		const float* A = planeA.data();
+		const float* B = planeB.data();
+#pragma omp parallel for schedule(dynamic)
+		for (int t = 0;t < tilesX*tilesY;t++) {
+			const int tx0 = (t % tilesX)*TILE_SIZE;
+			const int ty0 = (t / tilesX)*TILE_SIZE;
+			const int tx1 = std::min(width - 1, tx0 + TILE_SIZE - 1);
+			const int ty1 = std::min(height - 1, ty0 + TILE_SIZE - 1);
+			for (int n : tileClusters[t]) {
+				const int4& win = windows[n];
+				const int xMin = std::max(win.x, tx0);
+				const int xMax = std::min(win.z, tx1);
+				const int yMin = std::max(win.y, ty0);
+				const int yMax = std::min(win.w, ty1);
+				const float2 pixelCenter = pixelCenters[n];
+				const float3 colorCenter = colorCenters[n];
+				const float ml = (maxlab[n] > 0.0f) ? 1.0f / maxlab[n] : 0.0f;
+				const __m128 cL = _mm_set1_ps(colorCenter.x);
+				const __m128 cA = _mm_set1_ps(colorCenter.y);
+				const __m128 cB = _mm_set1_ps(colorCenter.z);
+				const __m128 vml = _mm_set1_ps(ml);
+				const __m128 vxywt = _mm_set1_ps(invxywt);
+				const __m128 vstep = _mm_set1_ps(4.0f);
+				const __m128i vn = _mm_set1_epi32(n);
+				for (int y = yMin; y <= yMax; y++) {
+					const size_t row = (size_t)y*width;
+					const float dy = (float)y - pixelCenter.y;
+					const __m128 vdy2 = _mm_set1_ps(dy*dy);
+					int x = xMin;
+					__m128 vdx = _mm_sub_ps(_mm_setr_ps((float)x, (float)(x + 1), (float)(x + 2), (float)(x + 3)), _mm_set1_ps(pixelCenter.x));
+					for (; x + 3 <= xMax; x += 4) {
+						const size_t idx = row + x;
+						__m128 dL = _mm_sub_ps(_mm_loadu_ps(L + idx), cL);
+						__m128 dA = _mm_sub_ps(_mm_loadu_ps(A + idx), cA);
+						__m128 dB = _mm_sub_ps(_mm_loadu_ps(B + idx), cB);
+						__m128 distLab = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dL, dL), _mm_mul_ps(dA, dA)), _mm_mul_ps(dB, dB));
+						__m128 distPixel = _mm_add_ps(_mm_mul_ps(vdx, vdx), vdy2);
+						__m128 dist = _mm_add_ps(_mm_mul_ps(distLab, vml), _mm_mul_ps(distPixel, vxywt));
+						__m128 last = _mm_loadu_ps(scores + idx);
+						__m128i lastLabel = _mm_loadu_si128((const __m128i*)(labels + idx));
+						//Tie breaker, use smaller label id
+						__m128i mask = _mm_or_si128(_mm_castps_si128(_mm_cmplt_ps(dist, last)),
+							_mm_and_si128(_mm_castps_si128(_mm_cmpeq_ps(dist, last)), _mm_cmplt_epi32(vn, lastLabel)));
+						__m128 fmask = _mm_castsi128_ps(mask);
+						_mm_storeu_ps(scores + idx, _mm_or_ps(_mm_and_ps(fmask, dist), _mm_andnot_ps(fmask, last)));
+						_mm_storeu_si128((__m128i*)(labels + idx), _mm_or_si128(_mm_and_si128(mask, vn), _mm_andnot_si128(mask, lastLabel)));
+						vdx = _mm_add_ps(vdx, vstep);
+					}
+					for (; x <= xMax; x++) {
+						const size_t idx = row + x;
+						float dL = L[idx] - colorCenter.x;
+						float dA = A[idx] - colorCenter.y;
+						float dB = B[idx] - colorCenter.z;
+						float distLab = dL*dL + dA*dA + dB*dB;
+						float dx = (float)x - pixelCenter.x;
+						float distPixel = dx*dx + dy*dy;
+						float dist = distLab*ml + distPixel * invxywt;
+						float last = scores[idx];
+						if (dist < last || (dist == last&&n < labels[idx])) {
+							scores[idx] = dist;
+							labels[idx] = n;
+						}
+					}
+				}
+			}
+		}
+	}
 	void SuperPixels::optimize(int iterations) {
 		S = std::sqrt((labImage.width*labImage.height) / (float)(colorCenters.size())) + 2.0f;//adding a small value in the even the S size is too small.
 		int numk = (int)colorCenters.size();
@@ -297,12 +336,10 @@ namespace aly {
 		colorMean.resize(numk);
 		pixelMean.resize(numk);
 		clustersize.resize(numk, 0);
-		Image2f distImage(labImage.width, labImage.height);
 		Image1f scoreImage(labImage.width, labImage.height);
 		labelImage.set(int1(-1));
-		distImage.set(float2(1E10f));
-		scoreImage.set(float1(1E10f));
 		maxlab.resize(numk, 0.0f);
+		updateColorPlanes();
 		float invxywt = 1.0f / (S*S);//NOTE: this is different from how usual SLIC/LKM works, but in original code implementation
 		for (int iter = 0;iter < iterations;iter++)
 		{
@@ -310,35 +347,7 @@ namespace aly {
 			if (iter > 0) {
 				updateMaxColor(labelImage);
 			}
-			for (int n = 0; n < numk; n++)
-			{
-				float2 pixelCenter = pixelCenters[n];
-				float3 colorCenter = colorCenters[n];
-				int xMin = std::max(0, (int)std::floor(pixelCenter.x - offset));
-				int xMax = std::min(labImage.width - 1, (int)std::ceil(pixelCenter.x + offset));
-				int yMin = std::max(0, (int)std::floor(pixelCenter.y - offset));
-				int yMax = std::min(labImage.height - 1, (int)std::ceil(pixelCenter.y + offset));
-				float ml = (maxlab[n] > 0.0f) ? 1.0f / maxlab[n] : 0.0f;
-				for (int y = yMin; y <= yMax; y++) {
-					for (int x = xMin; x <= xMax; x++) {
-						float3 c = labImage(x, y);
-						float distLab = lengthSqr(c - colorCenter);
-						float distPixel = lengthSqr(float2((float)x, (float)y) - pixelCenter);
-						float dist = distLab*ml + distPixel * invxywt;
-						float last = scoreImage(x, y).x;
-						distImage(x, y) = float2(distLab, distPixel);
-						if (dist < last)
-						{
-							scoreImage(x, y).x = dist;
-							labelImage(x, y).x = n;
-						}
-						else if (dist == last&&n < labelImage(x, y).x) {//Tie breaker, use smaller label id
-							scoreImage(x, y).x = dist;
-							labelImage(x, y).x = n;
-						}
-					}
-				}
-			}
+			assignLabels(scoreImage, offset, invxywt);
 			float E = updateClusters(labelImage);
 			if (E < errorThreshold)break;
 		}
@@ -347,22 +356,41 @@ namespace aly {
 		maxlab.resize(numLabels);
 		maxlab.assign(numLabels, 1.0f);
 		float maxx = 0.0f;
-		for (int j = 0;j < labImage.height;j++) {
-			for (int i = 0; i < labImage.width; i++) {
-				int idx = labelImage(i, j).x+labelOffset;
-				if (idx >= 0) {
-					if (idx >= numLabels) {
-						std::cout << "Index exceeds max" << idx << std::endl;
-					}
-					float3 c = labImage(i, j);
-					float3 colorCenter = colorCenters[idx];
-					float distLab = lengthSqr(c - colorCenter);
-					maxx = std::max(distLab, maxx);
-					if (distLab > maxlab[idx]) {
-						maxlab[idx] = distLab;
+		bool invalid = false;
+#pragma omp parallel
+		{
+			//Per-thread maxima merged at the end avoid contention on shared clusters.
+			std::vector<float> localMax(numLabels, 1.0f);
+			float localMaxx = 0.0f;
+#pragma omp for nowait
+			for (int j = 0;j < labImage.height;j++) {
+				for (int i = 0; i < labImage.width; i++) {
+					int idx = labelImage(i, j).x + labelOffset;
+					if (idx >= 0) {
+						if (idx >= numLabels) {
+							invalid = true;
+							continue;
+						}
+						float3 c = labImage(i, j);
+						float3 colorCenter = colorCenters[idx];
+						float distLab = lengthSqr(c - colorCenter);
+						localMaxx = std::max(distLab, localMaxx);
+						if (distLab > localMax[idx]) {
+							localMax[idx] = distLab;
+						}
 					}
 				}
 			}
+#pragma omp critical
+			{
+				maxx = std::max(maxx, localMaxx);
+				for (int l = 0;l < numLabels;l++) {
+					maxlab[l] = std::max(maxlab[l], localMax[l]);
+				}
+			}
+		}
+		if (invalid) {
+			std::cout << "Index exceeds max" << std::endl;
 		}
 		maxx=std::sqrt(maxx);
 		return maxx;
@@ -376,18 +404,39 @@ namespace aly {
 		colorMean.set(float3(0.0f));
 		pixelMean.set(float2(0.0f));
 		clustersize.assign(clustersize.size(), 0);
-		for (int j = 0;j < labImage.height;j++) {
-			for (int i = 0; i < labImage.width; i++) {
-				int idx = labelImage(i, j).x+ labelOffset;
-				if (idx >= 0) {
-					if (idx >= numLabels) {
-						throw std::runtime_error(MakeString()<<"Invalid cluster id. "<<idx<<"/"<<numLabels);
+		int invalidLabel = -1;
+#pragma omp parallel
+		{
+			//Per-thread cluster accumulators merged at the end avoid contention on shared clusters.
+			std::vector<float3> localColor(numLabels, float3(0.0f));
+			std::vector<float2> localPixel(numLabels, float2(0.0f));
+			std::vector<int> localSize(numLabels, 0);
+#pragma omp for nowait
+			for (int j = 0;j < labImage.height;j++) {
+				for (int i = 0; i < labImage.width; i++) {
+					int idx = labelImage(i, j).x + labelOffset;
+					if (idx >= 0) {
+						if (idx >= numLabels) {
+							invalidLabel = idx;
+							continue;
+						}
+						localColor[idx] += labImage(i, j);
+						localPixel[idx] += float2((float)i, (float)j);
+						localSize[idx]++;
 					}
-					colorMean[idx] += labImage(i, j);
-					pixelMean[idx] += float2((float)i, (float)j);
-					clustersize[idx]++;
 				}
 			}
+#pragma omp critical
+			{
+				for (int l = 0;l < numLabels;l++) {
+					colorMean[l] += localColor[l];
+					pixelMean[l] += localPixel[l];
+					clustersize[l] += localSize[l];
+				}
+			}
+		}
+		if (invalidLabel >= 0) {
+			throw std::runtime_error(MakeString() << "Invalid cluster id. " << invalidLabel << "/" << numLabels);
 		}
 		//Recalculate centers
 		float E = 0.0f;
@@ -0,0 +1,451 @@
+/*
+ * Copyright(C) 2018, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "vision/DescriptorMatcher.h"
+#include <emmintrin.h>
+#include <random>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+namespace aly {
+	static std::atomic<uint64_t> DescriptorMatrixVersion(0);
+	void DescriptorMatrix::resize(int r, int c) {
+		version = ++DescriptorMatrixVersion;
+		rows = r;
+		cols = c;
+		stride = (c + 3) & ~3;
+		data.assign((size_t) rows * stride, 0.0f);
+		norms.assign(rows, 0.0f);
+	}
+	void DescriptorMatrix::set(const std::vector<SiftDescriptor>& descriptors) {
+		resize((int) descriptors.size(), 128);
+#pragma omp parallel for
+		for (int r = 0; r < rows; r++) {
+			std::copy(descriptors[r].data.begin(), descriptors[r].data.end(), ptr(r));
+		}
+		updateNorms();
+	}
+	void DescriptorMatrix::set(const std::vector<DaisyDescriptor>& descriptors) {
+		size_t length = (descriptors.size() > 0) ? descriptors[0].size() : 0;
+		for (const DaisyDescriptor& desc : descriptors) {
+			if (desc.size() != length) {
+				throw std::runtime_error("Daisy descriptors must all have the same length.");
+			}
+		}
+		resize((int) descriptors.size(), (int) length);
+#pragma omp parallel for
+		for (int r = 0; r < rows; r++) {
+			std::copy(descriptors[r].begin(), descriptors[r].end(), ptr(r));
+		}
+		updateNorms();
+	}
+	void DescriptorMatrix::updateNorms() {
+		version = ++DescriptorMatrixVersion;
+#pragma omp parallel for
+		for (int r = 0; r < rows; r++) {
+			const float* row = ptr(r);
+			double sum = 0.0;
+			for (int c = 0; c < cols; c++) {
+				sum += row[c] * row[c];
+			}
+			norms[r] = (float) std::sqrt(sum);
+		}
+	}
+	static inline float HorizontalSum(__m128 v) {
+		__m128 shuf = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+		__m128 sums = _mm_add_ps(v, shuf);
+		shuf = _mm_movehl_ps(shuf, sums);
+		return _mm_cvtss_f32(_mm_add_ss(sums, shuf));
+	}
+	//Inserts into a list of k matches kept sorted by distance.
+	static inline void InsertMatch(DescriptorMatch* best, int k, int query, int train, float distance) {
+		if (distance >= best[k - 1].distance)
+			return;
+		int pos = k - 1;
+		while (pos > 0 && best[pos - 1].distance > distance) {
+			best[pos] = best[pos - 1];
+			pos--;
+		}
+		best[pos] = DescriptorMatch(query, train, distance);
+	}
+	static inline float MatchDistance(DescriptorMetric metric, float dot, float qn, float tn) {
+		if (metric == DescriptorMetric::L2) {
+			return std::max(qn * qn + tn * tn - 2.0f * dot, 0.0f);
+		} else {
+			float denom = qn * tn;
+			return (denom > 0.0f) ? 1.0f - dot / denom : 1.0f;
+		}
+	}
+	void DescriptorMatcher::bruteForce(const DescriptorMatrix& query, const DescriptorMatrix& train, int k,
+			std::vector<DescriptorMatch>& out) const {
+		//Blocks of queries are matched against tiles of train rows that both stay in cache.
+		const int QUERY_BLOCK = 128;
+		const int TRAIN_TILE = 128;
+		const int Q = query.getRows();
+		const int T = train.getRows();
+		const int stride = query.getStride();
+		const int blocks = (Q + QUERY_BLOCK - 1) / QUERY_BLOCK;
+#pragma omp parallel for schedule(dynamic)
+		for (int b = 0; b < blocks; b++) {
+			const int qStart = b * QUERY_BLOCK;
+			const int qEnd = std::min(Q, qStart + QUERY_BLOCK);
+			for (int tStart = 0; tStart < T; tStart += TRAIN_TILE) {
+				const int tEnd = std::min(T, tStart + TRAIN_TILE);
+				for (int q = qStart; q < qEnd; q += 4) {
+					//Four query rows share each train row load; short groups repeat the last row.
+					const float* q0 = query[q];
+					const float* q1 = query[std::min(q + 1, qEnd - 1)];
+					const float* q2 = query[std::min(q + 2, qEnd - 1)];
+					const float* q3 = query[std::min(q + 3, qEnd - 1)];
+					const int count = std::min(4, qEnd - q);
+					for (int t = tStart; t < tEnd; t++) {
+						const float* row = train[t];
+						__m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+						__m128 acc2 = _mm_setzero_ps(), acc3 = _mm_setzero_ps();
+						for (int d = 0; d < stride; d += 4) {
+							__m128 tv = _mm_load_ps(row + d);
+							acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_load_ps(q0 + d), tv));
+							acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_load_ps(q1 + d), tv));
+							acc2 = _mm_add_ps(acc2, _mm_mul_ps(_mm_load_ps(q2 + d), tv));
+							acc3 = _mm_add_ps(acc3, _mm_mul_ps(_mm_load_ps(q3 + d), tv));
+						}
+						float dots[4] = { HorizontalSum(acc0), HorizontalSum(acc1), HorizontalSum(acc2),
+								HorizontalSum(acc3) };
+						const float tn = train.norm(t);
+						for (int n = 0; n < count; n++) {
+							float dist = MatchDistance(metric, dots[n], query.norm(q + n), tn);
+							InsertMatch(&out[(size_t) (q + n) * k], k, q + n, t, dist);
+						}
+					}
+				}
+			}
+		}
+		if (metric == DescriptorMetric::L2) {
+#pragma omp parallel for
+			for (int i = 0; i < (int) out.size(); i++) {
+				if (out[i].train >= 0)
+					out[i].distance = std::sqrt(out[i].distance);
+			}
+		}
+	}
+	namespace detail {
+		/*
+		 * Randomized kd-tree: each node splits at the mean of a dimension drawn at
+		 * random from the few with highest variance, so trees in a forest differ.
+		 */
+		struct DescriptorTree {
+			struct Node {
+				int dim; //-1 for leaves
+				float split;
+				int child[2]; //Children for inner nodes, [begin,end) of indexes for leaves
+			};
+			static const int LEAF_SIZE = 4;
+			static const int TOP_DIMENSIONS = 5;
+			static const int VARIANCE_SAMPLES = 100;
+			std::vector<Node> nodes;
+			std::vector<int> indexes;
+			DescriptorTree(const DescriptorMatrix& mat, uint32_t seed) {
+				std::mt19937 rng(seed);
+				indexes.resize(mat.getRows());
+				for (int i = 0; i < (int) indexes.size(); i++)
+					indexes[i] = i;
+				nodes.reserve(2 * indexes.size() / LEAF_SIZE + 1);
+				build(mat, 0, (int) indexes.size(), rng);
+			}
+			int build(const DescriptorMatrix& mat, int begin, int end, std::mt19937& rng) {
+				int id = (int) nodes.size();
+				nodes.push_back(Node());
+				if (end - begin <= LEAF_SIZE) {
+					nodes[id].dim = -1;
+					nodes[id].child[0] = begin;
+					nodes[id].child[1] = end;
+					return id;
+				}
+				const int cols = mat.getCols();
+				const int samples = std::min(end - begin, VARIANCE_SAMPLES);
+				std::vector<double> mean(cols, 0.0), var(cols, 0.0);
+				for (int n = 0; n < samples; n++) {
+					const float* row = mat[indexes[begin + n]];
+					for (int c = 0; c < cols; c++)
+						mean[c] += row[c];
+				}
+				for (int c = 0; c < cols; c++)
+					mean[c] /= samples;
+				for (int n = 0; n < samples; n++) {
+					const float* row = mat[indexes[begin + n]];
+					for (int c = 0; c < cols; c++) {
+						double d = row[c] - mean[c];
+						var[c] += d * d;
+					}
+				}
+				std::vector<int> order(cols);
+				for (int c = 0; c < cols; c++)
+					order[c] = c;
+				const int top = std::min(TOP_DIMENSIONS, cols);
+				std::partial_sort(order.begin(), order.begin() + top, order.end(),
+						[&](int a, int b) {return var[a] > var[b];});
+				const int dim = order[std::uniform_int_distribution<int>(0, top - 1)(rng)];
+				const float split = (float) mean[dim];
+				int* first = &indexes[begin];
+				int* mid = std::partition(first, &indexes[0] + end,
+						[&](int i) {return mat[i][dim] < split;});
+				int middle = begin + (int) (mid - first);
+				if (middle == begin || middle == end) {//Degenerate split, cut in half
+					middle = (begin + end) / 2;
+				}
+				nodes[id].dim = dim;
+				nodes[id].split = split;
+				int left = build(mat, begin, middle, rng);
+				int right = build(mat, middle, end, rng);
+				nodes[id].child[0] = left;
+				nodes[id].child[1] = right;
+				return id;
+			}
+		};
+		struct DescriptorForest {
+			std::vector<std::unique_ptr<DescriptorTree>> trees;
+			DescriptorForest(const DescriptorMatrix& mat, int count) :
+					trees(count) {
+#pragma omp parallel for
+				for (int t = 0; t < count; t++) {
+					trees[t].reset(new DescriptorTree(mat, 1723 + 7919 * t));
+				}
+			}
+		};
+		struct ForestBranch {
+			float bound;
+			int tree;
+			int node;
+			bool operator<(const ForestBranch& other) const {
+				return (bound > other.bound); //Min heap
+			}
+		};
+	}
+	std::shared_ptr<detail::DescriptorForest> DescriptorMatcher::getForest(const DescriptorMatrix& train) const {
+		//Two entries cover the train set and, with cross checking, the query set searched in reverse.
+		const size_t MAX_FORESTS = 2;
+		std::lock_guard<std::mutex> guard(forestLock);
+		for (auto pos = forests.begin(); pos != forests.end(); pos++) {
+			if (pos->first == train.getVersion()) {
+				forests.splice(forests.begin(), forests, pos);
+				return forests.front().second;
+			}
+		}
+		std::shared_ptr<detail::DescriptorForest> forest(new detail::DescriptorForest(train, std::max(trees, 1)));
+		forests.push_front( { train.getVersion(), forest });
+		if (forests.size() > MAX_FORESTS)
+			forests.pop_back();
+		return forest;
+	}
+	void DescriptorMatcher::forest(const DescriptorMatrix& query, const DescriptorMatrix& train, int k,
+			std::vector<DescriptorMatch>& out) const {
+		std::shared_ptr<detail::DescriptorForest> trainForest = getForest(train);
+		const std::vector<std::unique_ptr<detail::DescriptorTree>>& forest = trainForest->trees;
+		const int Q = query.getRows();
+		const int stride = query.getStride();
+#pragma omp parallel
+		{
+			//Train rows already compared for the current query are stamped with it.
+			std::vector<int> visited(train.getRows(), -1);
+			std::vector<detail::ForestBranch> heap;
+#pragma omp for schedule(dynamic,64)
+			for (int q = 0; q < Q; q++) {
+				const float* qrow = query[q];
+				const float qn = query.norm(q);
+				DescriptorMatch* best = &out[(size_t) q * k];
+				heap.clear();
+				for (int t = 0; t < (int) forest.size(); t++) {
+					heap.push_back( { 0.0f, t, 0 });
+				}
+				std::make_heap(heap.begin(), heap.end());
+				int compared = 0;
+				while (heap.size() > 0 && (compared < checks || best[k - 1].train < 0)) {
+					std::pop_heap(heap.begin(), heap.end());
+					detail::ForestBranch branch = heap.back();
+					heap.pop_back();
+					const detail::DescriptorTree& tree = *forest[branch.tree];
+					int node = branch.node;
+					//Descend to a leaf, deferring the far side of each split.
+					while (tree.nodes[node].dim >= 0) {
+						const detail::DescriptorTree::Node& n = tree.nodes[node];
+						float diff = qrow[n.dim] - n.split;
+						int near = (diff < 0.0f) ? 0 : 1;
+						heap.push_back( { branch.bound + diff * diff, branch.tree, n.child[1 - near] });
+						std::push_heap(heap.begin(), heap.end());
+						node = n.child[near];
+					}
+					const detail::DescriptorTree::Node& leaf = tree.nodes[node];
+					for (int i = leaf.child[0]; i < leaf.child[1]; i++) {
+						int t = tree.indexes[i];
+						if (visited[t] == q)
+							continue;
+						visited[t] = q;
+						const float* trow = train[t];
+						__m128 acc = _mm_setzero_ps();
+						for (int d = 0; d < stride; d += 4) {
+							acc = _mm_add_ps(acc, _mm_mul_ps(_mm_load_ps(qrow + d), _mm_load_ps(trow + d)));
+						}
+						InsertMatch(best, k, q, t, MatchDistance(metric, HorizontalSum(acc), qn, train.norm(t)));
+						compared++;
+					}
+				}
+				if (metric == DescriptorMetric::L2) {
+					for (int n = 0; n < k; n++) {
+						if (best[n].train >= 0)
+							best[n].distance = std::sqrt(best[n].distance);
+					}
+				}
+			}
+		}
+	}
+	void DescriptorMatcher::knn(const DescriptorMatrix& query, const DescriptorMatrix& train, int k,
+			std::vector<DescriptorMatch>& out) const {
+		if (query.getCols() != train.getCols()) {
+			throw std::runtime_error(
+					MakeString() << "Descriptor length mismatch " << query.getCols() << "!=" << train.getCols());
+		}
+		out.assign((size_t) query.getRows() * k, DescriptorMatch());
+		for (int q = 0; q < query.getRows(); q++) {
+			for (int n = 0; n < k; n++) {
+				out[(size_t) q * k + n].query = q;
+			}
+		}
+		if (k <= 0 || train.getRows() == 0)
+			return;
+		if (approximate) {
+			forest(query, train, k, out);
+		} else {
+			bruteForce(query, train, k, out);
+		}
+	}
+	void DescriptorMatcher::match(const DescriptorMatrix& query, const DescriptorMatrix& train,
+			std::vector<DescriptorMatch>& matches) const {
+		const int Q = query.getRows();
+		const bool ratioTest = (ratio < 1.0f);
+		const int k = ratioTest ? 2 : 1;
+		std::vector<DescriptorMatch> forward;
+		knn(query, train, k, forward);
+		std::vector<char> keep(Q, 0);
+#pragma omp parallel for
+		for (int q = 0; q < Q; q++) {
+			const DescriptorMatch& best = forward[(size_t) q * k];
+			if (best.train < 0)
+				continue;
+			if (ratioTest) {
+				const DescriptorMatch& second = forward[(size_t) q * k + 1];
+				if (second.train >= 0 && best.distance >= ratio * second.distance)
+					continue;
+			}
+			keep[q] = 1;
+		}
+		if (crossCheck) {
+			//Only train rows picked by some query need their nearest query.
+			std::vector<int> candidates;
+			std::vector<int> slots(train.getRows(), -1);
+			for (int q = 0; q < Q; q++) {
+				int t = forward[(size_t) q * k].train;
+				if (keep[q] && slots[t] < 0) {
+					slots[t] = (int) candidates.size();
+					candidates.push_back(t);
+				}
+			}
+			DescriptorMatrix reverse((int) candidates.size(), train.getCols());
+#pragma omp parallel for
+			for (int n = 0; n < (int) candidates.size(); n++) {
+				std::copy(train[candidates[n]], train[candidates[n]] + train.getStride(), reverse.ptr(n));
+			}
+			reverse.updateNorms();
+			std::vector<DescriptorMatch> backward;
+			knn(reverse, query, 1, backward);
+#pragma omp parallel for
+			for (int q = 0; q < Q; q++) {
+				if (keep[q] && backward[slots[forward[(size_t) q * k].train]].train != q)
+					keep[q] = 0;
+			}
+		}
+		matches.clear();
+		for (int q = 0; q < Q; q++) {
+			if (keep[q])
+				matches.push_back(forward[(size_t) q * k]);
+		}
+	}
+	bool SANITY_CHECK_DESCRIPTOR_MATCHER() {
+		const int T = 3000, Q = 600, D = 128;
+		std::mt19937 rng(91);
+		std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+		std::normal_distribution<float> noise(0.0f, 0.05f);
+		DescriptorMatrix train(T, D), query(Q, D);
+		for (int t = 0; t < T; t++) {
+			for (int d = 0; d < D; d++)
+				train[t][d] = uniform(rng);
+		}
+		//Most queries are noisy copies of train rows, the rest have no true match.
+		for (int q = 0; q < Q; q++) {
+			int src = (q * 7) % T;
+			for (int d = 0; d < D; d++)
+				query[q][d] = (q % 5 == 0) ? uniform(rng) : train[src][d] + noise(rng);
+		}
+		train.updateNorms();
+		query.updateNorms();
+		bool ok = true;
+		std::vector<DescriptorMatch> exact, approx;
+		DescriptorMatcher matcher;
+		matcher.knn(query, train, 2, exact);
+		//A forest allowed to compare every row is an exact search.
+		matcher.setApproximate(true, 4, T);
+		matcher.knn(query, train, 2, approx);
+		for (size_t n = 0; n < exact.size(); n++) {
+			ok &= (exact[n].train == approx[n].train
+					&& std::abs(exact[n].distance - approx[n].distance) <= 1E-4f * (1.0f + exact[n].distance));
+		}
+		matcher.setApproximate(true, 4, 256);
+		matcher.knn(query, train, 1, approx);
+		int found = 0, total = 0;
+		for (int q = 0; q < Q; q++) {
+			if (q % 5 == 0)
+				continue;
+			total++;
+			if (approx[q].train == exact[(size_t) q * 2].train)
+				found++;
+		}
+		float recall = found / (float) total;
+		ok &= (recall > 0.9f);
+		//Cross check against the reverse search over every train row.
+		matcher.setApproximate(false);
+		std::vector<DescriptorMatch> matches, backward;
+		matcher.match(query, train, matches);
+		matcher.knn(train, query, 1, backward);
+		std::vector<int> expected;
+		for (int q = 0; q < Q; q++) {
+			const DescriptorMatch& best = exact[(size_t) q * 2];
+			const DescriptorMatch& second = exact[(size_t) q * 2 + 1];
+			if (best.distance < 0.8f * second.distance && backward[best.train].train == q)
+				expected.push_back(q);
+		}
+		ok &= (matches.size() == expected.size());
+		for (size_t n = 0; n < matches.size() && n < expected.size(); n++) {
+			ok &= (matches[n].query == expected[n]);
+		}
+		std::cout << "Descriptor matcher forest recall " << recall << " cross checked matches " << matches.size()
+				<< " " << (ok ? "passed" : "failed") << std::endl;
+		return ok;
+	}
+}
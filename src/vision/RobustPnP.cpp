@@ -0,0 +1,387 @@
+/*
+ * Copyright(C) 2018, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "vision/RobustPnP.h"
+#include "vision/Epnp.h"
+#include <emmintrin.h>
+#include <random>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <stdexcept>
+#include <iostream>
+namespace aly {
+	namespace {
+		/*
+		 * PROSAC sampler (Chum and Matas, 2005). Samples are drawn from the top n
+		 * correspondences, and n grows on the schedule that makes the first
+		 * maxIterations draws equivalent to RANSAC on the whole set.
+		 */
+		class ProgressiveSampler {
+		protected:
+			int N;
+			int m;
+			int n;
+			int t;
+			double Tn;
+			int Tnp;
+			bool progressive;
+			std::mt19937 rng;
+			void draw(int range, int* sample, int count) {
+				for (int k = 0; k < count; k++) {
+					int idx;
+					bool unique;
+					do {
+						idx = std::uniform_int_distribution<int>(0, range - 1)(rng);
+						unique = true;
+						for (int l = 0; l < k; l++) {
+							if (sample[l] == idx) {
+								unique = false;
+								break;
+							}
+						}
+					} while (!unique);
+					sample[k] = idx;
+				}
+			}
+		public:
+			ProgressiveSampler(int N, int m, int maxIterations, bool progressive, uint32_t seed) :
+					N(N), m(m), n(m), t(0), Tn(maxIterations), Tnp(1), progressive(progressive), rng(seed) {
+				for (int i = 0; i < m; i++) {
+					Tn *= double(m - i) / double(N - i);
+				}
+			}
+			void next(int* sample) {
+				if (!progressive) {
+					draw(N, sample, m);
+					return;
+				}
+				t++;
+				while (t >= Tnp && n < N) {
+					double Tn1 = Tn * double(n + 1) / double(n + 1 - m);
+					Tnp += (int) std::ceil(Tn1 - Tn);
+					Tn = Tn1;
+					n++;
+				}
+				if (Tnp < t || n == m) {
+					draw(n, sample, m);
+				} else {
+					draw(n - 1, sample, m - 1);
+					sample[m - 1] = n - 1;
+				}
+			}
+		};
+		struct PoseHypothesis {
+			float R[3][3];
+			float t[3];
+			float cost;
+			int inliers;
+			PoseHypothesis() :
+					cost(std::numeric_limits<float>::max()), inliers(0) {
+			}
+		};
+		//Number of samples needed to draw one outlier free sample with the given confidence.
+		double RequiredIterations(int inliers, int total, int m, double confidence) {
+			double pm = std::pow(inliers / (double) total, m);
+			if (pm >= 1.0)
+				return 0.0;
+			if (pm <= 0.0)
+				return std::numeric_limits<double>::max();
+			return std::log(1.0 - confidence) / std::log(1.0 - pm);
+		}
+		bool EstimatePose(Epnp& pnp, const float* X, const float* Y, const float* Z, const float* U,
+				const float* V, const int* indexes, int count, float R[3][3], float t[3]) {
+			pnp.reset_correspondences();
+			for (int i = 0; i < count; i++) {
+				int idx = indexes[i];
+				pnp.add_correspondence(X[idx], Y[idx], Z[idx], U[idx], V[idx], 1.0);
+			}
+			double Rd[3][3];
+			double td[3] = { 0, 0, 0 };
+			pnp.compute_pose(Rd, td);
+			for (int i = 0; i < 3; i++) {
+				for (int j = 0; j < 3; j++) {
+					R[i][j] = (float) Rd[i][j];
+					if (!std::isfinite(R[i][j]))
+						return false;
+				}
+				t[i] = (float) td[i];
+				if (!std::isfinite(t[i]))
+					return false;
+			}
+			return true;
+		}
+	}
+	float RobustPnP::score(const float R[3][3], const float t[3], int* inlierCount) const {
+		static const int BitCount[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+		const float thresh2 = threshold * threshold;
+		const __m128 thr2 = _mm_set1_ps(thresh2);
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 r00 = _mm_set1_ps(R[0][0]), r01 = _mm_set1_ps(R[0][1]), r02 = _mm_set1_ps(R[0][2]);
+		const __m128 r10 = _mm_set1_ps(R[1][0]), r11 = _mm_set1_ps(R[1][1]), r12 = _mm_set1_ps(R[1][2]);
+		const __m128 r20 = _mm_set1_ps(R[2][0]), r21 = _mm_set1_ps(R[2][1]), r22 = _mm_set1_ps(R[2][2]);
+		const __m128 tx = _mm_set1_ps(t[0]), ty = _mm_set1_ps(t[1]), tz = _mm_set1_ps(t[2]);
+		const __m128 mfu = _mm_set1_ps(fu), mfv = _mm_set1_ps(fv);
+		const __m128 muc = _mm_set1_ps(uc), mvc = _mm_set1_ps(vc);
+		__m128 sum = _mm_setzero_ps();
+		int total = 0;
+		const int padded = (int) X.size();
+		for (int i = 0; i < padded; i += 4) {
+			__m128 x = _mm_load_ps(&X[i]);
+			__m128 y = _mm_load_ps(&Y[i]);
+			__m128 z = _mm_load_ps(&Z[i]);
+			__m128 xc = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r00, x), _mm_mul_ps(r01, y)),
+					_mm_add_ps(_mm_mul_ps(r02, z), tx));
+			__m128 yc = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r10, x), _mm_mul_ps(r11, y)),
+					_mm_add_ps(_mm_mul_ps(r12, z), ty));
+			__m128 zc = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r20, x), _mm_mul_ps(r21, y)),
+					_mm_add_ps(_mm_mul_ps(r22, z), tz));
+			__m128 iz = _mm_div_ps(one, zc);
+			__m128 du = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(mfu, xc), iz), muc), _mm_load_ps(&U[i]));
+			__m128 dv = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(mfv, yc), iz), mvc), _mm_load_ps(&V[i]));
+			__m128 e2 = _mm_add_ps(_mm_mul_ps(du, du), _mm_mul_ps(dv, dv));
+			//Padding has NaN pixel coordinates and is never an inlier.
+			__m128 ok = _mm_and_ps(_mm_cmpgt_ps(zc, zero), _mm_cmplt_ps(e2, thr2));
+			sum = _mm_add_ps(sum, _mm_or_ps(_mm_and_ps(ok, e2), _mm_andnot_ps(ok, thr2)));
+			total += BitCount[_mm_movemask_ps(ok)];
+		}
+		float lanes[4];
+		_mm_storeu_ps(lanes, sum);
+		if (inlierCount)
+			*inlierCount = total;
+		return (lanes[0] + lanes[1] + lanes[2] + lanes[3] - (padded - count) * thresh2) / count;
+	}
+	void RobustPnP::findInliers(const float R[3][3], const float t[3], std::vector<int>& result) const {
+		const float thresh2 = threshold * threshold;
+		result.clear();
+		for (int i = 0; i < count; i++) {
+			float xc = R[0][0] * X[i] + R[0][1] * Y[i] + R[0][2] * Z[i] + t[0];
+			float yc = R[1][0] * X[i] + R[1][1] * Y[i] + R[1][2] * Z[i] + t[1];
+			float zc = R[2][0] * X[i] + R[2][1] * Y[i] + R[2][2] * Z[i] + t[2];
+			if (zc <= 0.0f)
+				continue;
+			float iz = 1.0f / zc;
+			float du = fu * xc * iz + uc - U[i];
+			float dv = fv * yc * iz + vc - V[i];
+			if (du * du + dv * dv < thresh2)
+				result.push_back(i);
+		}
+	}
+	bool RobustPnP::solve(const Vector3f& pts, const Vector2f& pxs, const CameraProjector& view) {
+		if (pts.size() != pxs.size())
+			throw std::runtime_error("Number of points and pixels must match.");
+		const int m = std::max(4, sampleSize);
+		count = (int) pts.size();
+		pose = float4x4::identity();
+		inliers.clear();
+		iterations = 0;
+		cost = threshold * threshold;
+		if (count < m)
+			return false;
+		fu = view.K(0, 0);
+		fv = view.K(1, 1);
+		uc = view.K(0, 2);
+		vc = view.K(1, 2);
+		const int padded = (count + 3) & ~3;
+		const float nan = std::numeric_limits<float>::quiet_NaN();
+		X.assign(padded, 0.0f);
+		Y.assign(padded, 0.0f);
+		Z.assign(padded, 0.0f);
+		U.assign(padded, nan);
+		V.assign(padded, nan);
+		for (int i = 0; i < count; i++) {
+			float3 pt = pts[i];
+			float2 px = pxs[i];
+			X[i] = pt.x;
+			Y[i] = pt.y;
+			Z[i] = pt.z;
+			U[i] = px.x;
+			V[i] = px.y;
+		}
+		const int batch = std::max(1, batchSize);
+		ProgressiveSampler sampler(count, m, maxIterations, prosac, seed);
+		std::vector<int> samples;
+		std::vector<PoseHypothesis> hypotheses;
+		std::vector<int> consensus;
+		PoseHypothesis best;
+		int required = maxIterations;
+		while (iterations < required) {
+			int nb = std::min(batch, required - iterations);
+			samples.resize(nb * m);
+			for (int b = 0; b < nb; b++) {
+				sampler.next(&samples[b * m]);
+			}
+			hypotheses.assign(nb, PoseHypothesis());
+#pragma omp parallel
+			{
+				Epnp pnp;
+				pnp.set_internal_parameters(uc, vc, fu, fv);
+				pnp.set_maximum_number_of_correspondences(m);
+#pragma omp for schedule(dynamic)
+				for (int b = 0; b < nb; b++) {
+					PoseHypothesis& h = hypotheses[b];
+					if (EstimatePose(pnp, X.data(), Y.data(), Z.data(), U.data(), V.data(), &samples[b * m], m,
+							h.R, h.t)) {
+						h.cost = score(h.R, h.t, &h.inliers);
+					}
+				}
+			}
+			iterations += nb;
+			//Visit hypotheses in sample order so the result does not depend on the thread count.
+			for (const PoseHypothesis& h : hypotheses) {
+				if (h.inliers >= m && h.cost < best.cost) {
+					best = h;
+				}
+			}
+			if (best.inliers >= m) {
+				double k = RequiredIterations(best.inliers, count, m, confidence);
+				if (prosac) {
+					/*
+					 * PROSAC stops early when some prefix of the sorted correspondences
+					 * has a high inlier ratio. Prefixes whose inlier count could be
+					 * explained by a random pose (5% false inlier rate, one-sided 95%)
+					 * are ignored.
+					 */
+					findInliers(best.R, best.t, consensus);
+					int prefixInliers = 0;
+					size_t c = 0;
+					for (int n = 1; n <= count; n++) {
+						while (c < consensus.size() && consensus[c] < n) {
+							c++;
+							prefixInliers++;
+						}
+						const double beta = 0.05;
+						double minimum = m + n * beta + 1.645 * std::sqrt(n * beta * (1.0 - beta));
+						if (n > m && prefixInliers > minimum) {
+							k = std::min(k, RequiredIterations(prefixInliers, n, m, confidence));
+						}
+					}
+				}
+				if (k < required)
+					required = std::max(iterations, (int) std::ceil(k));
+			}
+		}
+		if (best.inliers < m)
+			return false;
+		/*
+		 * Refine on the consensus set. EPnP on all inliers runs its Gauss-Newton
+		 * step on the control point coefficients. Stop when the cost no longer
+		 * improves.
+		 */
+		if (refineIterations > 0) {
+			Epnp pnp;
+			pnp.set_internal_parameters(uc, vc, fu, fv);
+			for (int r = 0; r < refineIterations; r++) {
+				findInliers(best.R, best.t, consensus);
+				if ((int) consensus.size() < m)
+					break;
+				pnp.set_maximum_number_of_correspondences((int) consensus.size());
+				PoseHypothesis h;
+				if (!EstimatePose(pnp, X.data(), Y.data(), Z.data(), U.data(), V.data(), consensus.data(),
+						(int) consensus.size(), h.R, h.t))
+					break;
+				h.cost = score(h.R, h.t, &h.inliers);
+				if (h.cost >= best.cost)
+					break;
+				best = h;
+			}
+		}
+		findInliers(best.R, best.t, inliers);
+		cost = best.cost;
+		for (int i = 0; i < 3; i++) {
+			for (int j = 0; j < 3; j++) {
+				pose(i, j) = best.R[i][j];
+			}
+			pose(i, 3) = best.t[i];
+		}
+		return true;
+	}
+	float4x4 SolvePnPRansac(const Vector3f& pts, const Vector2f& pxs, const CameraProjector& view,
+			std::vector<int>& inliers, float threshold, bool prosac) {
+		RobustPnP pnp(threshold);
+		pnp.setProgressiveSampling(prosac);
+		pnp.solve(pts, pxs, view);
+		inliers = pnp.getInliers();
+		return pnp.getPose();
+	}
+	bool SANITY_CHECK_ROBUST_PNP() {
+		const int N = 400;
+		std::mt19937 rng(2018);
+		std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+		std::normal_distribution<float> noise(0.0f, 0.5f);
+		CameraProjector view;
+		view.setIntrinsics(float3x3(float3(600.0f, 0.0f, 0.0f), float3(0.0f, 600.0f, 0.0f), float3(320.0f, 240.0f, 1.0f)));
+		float4x4 truth = MakeRotationZ(0.3f) * MakeRotationY(-0.5f) * MakeRotationX(0.2f);
+		truth(0, 3) = 0.3f;
+		truth(1, 3) = -0.2f;
+		truth(2, 3) = 6.0f;
+		Vector3f pts;
+		Vector2f pxs;
+		std::vector<bool> outlier(N);
+		for (int i = 0; i < N; i++) {
+			float3 pt(2.0f * uniform(rng), 2.0f * uniform(rng), 2.0f * uniform(rng));
+			float4 pc = truth * float4(pt, 1.0f);
+			float2 px(600.0f * pc.x / pc.z + 320.0f, 600.0f * pc.y / pc.z + 240.0f);
+			//Outliers become more frequent toward the end of the list, as with matches sorted by quality.
+			outlier[i] = (i >= N / 3 && uniform(rng) < (i / (float) N));
+			if (outlier[i]) {
+				px = float2(320.0f + 320.0f * uniform(rng), 240.0f + 240.0f * uniform(rng));
+			} else {
+				px += float2(noise(rng), noise(rng));
+			}
+			pts.push_back(pt);
+			pxs.push_back(px);
+		}
+		bool ok = true;
+		for (int prosac = 0; prosac < 2; prosac++) {
+			RobustPnP pnp(2.0f);
+			pnp.setProgressiveSampling(prosac != 0);
+			pnp.setSeed(7);
+			ok &= pnp.solve(pts, pxs, view);
+			const float4x4& pose = pnp.getPose();
+			float rotationError = 0.0f, translationError = 0.0f;
+			for (int i = 0; i < 3; i++) {
+				for (int j = 0; j < 3; j++) {
+					rotationError = std::max(rotationError, std::abs(pose(i, j) - truth(i, j)));
+				}
+				translationError = std::max(translationError, std::abs(pose(i, 3) - truth(i, 3)));
+			}
+			int falseInliers = 0, missedInliers = 0;
+			std::vector<bool> found(N, false);
+			for (int idx : pnp.getInliers()) {
+				found[idx] = true;
+			}
+			for (int i = 0; i < N; i++) {
+				if (found[i] && outlier[i])
+					falseInliers++;
+				if (!found[i] && !outlier[i])
+					missedInliers++;
+			}
+			ok &= (rotationError < 0.01f && translationError < 0.05f && falseInliers < N / 50 && missedInliers < N / 50);
+			std::cout << "Robust PnP " << (prosac ? "PROSAC" : "RANSAC") << " iterations " << pnp.getIterations()
+					<< " rotation error " << rotationError << " translation error " << translationError
+					<< " false inliers " << falseInliers << " missed inliers " << missedInliers << std::endl;
+		}
+		std::cout << "Robust PnP " << (ok ? "passed" : "failed") << std::endl;
+		return ok;
+	}
+}
@@ -10,6 +10,7 @@
 #include <iostream>
 #include <fstream>
 #include <stdexcept>
+#include <limits>
 #include <AlloyImageProcessing.h>
 #include <omp.h>
 #include "vision/Sift.h"
@@ -32,6 +33,60 @@
 inline double gaussian_xx(double const& xx, double const& sigma) {
 	return std::exp(-(xx / (2 * sigma * sigma)));
 }
+/*
+ * Separable Gaussian blur with clamped borders. The kernel is truncated at
+ * three standard deviations. The vertical pass accumulates whole rows so
+ * that both passes stream through memory.
+ */
+static void GaussianBlur(const aly::Image1f& in, aly::Image1f& out, float sigma) {
+	int const w = in.width;
+	int const h = in.height;
+	int const r = std::max(1, static_cast<int>(std::ceil(3.0f * sigma)));
+	std::vector<float> kernel(2 * r + 1);
+	float sum = 0.0f;
+	for (int k = -r; k <= r; ++k) {
+		kernel[k + r] = (float)gaussian_xx(k * k, sigma);
+		sum += kernel[k + r];
+	}
+	for (float& val : kernel)
+		val /= sum;
+	aly::Image1f tmp(w, h);
+	const float* src = in.ptr();
+	float* hdst = tmp.ptr();
+#pragma omp parallel for
+	for (int y = 0; y < h; ++y) {
+		const float* row = src + (size_t)y * w;
+		float* dst = hdst + (size_t)y * w;
+		for (int x = 0; x < w; ++x) {
+			float val = 0.0f;
+			if (x >= r && x < w - r) {
+				const float* px = row + x - r;
+				for (int k = 0; k <= 2 * r; ++k)
+					val += kernel[k] * px[k];
+			} else {
+				for (int k = -r; k <= r; ++k)
+					val += kernel[k + r] * row[aly::clamp(x + k, 0, w - 1)];
+			}
+			dst[x] = val;
+		}
+	}
+	out.resize(w, h);
+	float* vdst = out.ptr();
+#pragma omp parallel for
+	for (int y = 0; y < h; ++y) {
+		float* dst = vdst + (size_t)y * w;
+		std::fill(dst, dst + w, 0.0f);
+		for (int k = -r; k <= r; ++k) {
+			const float* row = hdst + (size_t)aly::clamp(y + k, 0, h - 1) * w;
+			float const wk = kernel[k + r];
+			for (int x = 0; x < w; ++x)
+				dst[x] += wk * row[x];
+		}
+	}
+}
+
+/* ---------------------------------------------------------------- */
+
 namespace aly{
 Sift::Sift(	SiftOptions options):options(options) {
 }
@@ -45,46 +100,109 @@ void Sift::solve(bool generateDescriptors) {
 	if (this->options.contrastThreshold < 0.0f)
 		this->options.contrastThreshold = 0.02f
 				/ static_cast<float>(this->options.samplesPerOctave);
-	this->create();
-	this->extremaDetection();
-	this->keypointLocalization();
-	if(generateDescriptors)this->descriptorGeneration();
+	this->keypoints.clear();
+	this->descriptors.clear();
+	this->octaves.clear();
+	if (this->options.tileSize > 0
+			&& (orig.width > this->options.tileSize
+					|| orig.height > this->options.tileSize)) {
+		this->solveTiled(generateDescriptors);
+	} else {
+		int2 coreMin(std::numeric_limits<int>::min());
+		int2 coreMax(std::numeric_limits<int>::max());
+		this->processImage(orig, int2(0, 0), coreMin, coreMax,
+				generateDescriptors, this->options.retainOctaves);
+	}
 }
 
 /* ---------------------------------------------------------------- */
 
-void Sift::create(void) {
-	this->octaves.clear();
-	this->octaves.reserve(options.maxOctave-options.minOctave);
+void Sift::solveTiled(bool generateDescriptors) {
 	/*
-	 * Create octave -1. The original image is assumed to have blur
-	 * sigma = 0.5. The double size image therefore has sigma = 1.
+	 * Tile origins are aligned to the subsampling factor of the coarsest
+	 * octave so that every octave of a tile lies on the same pixel grid as
+	 * the octave of the full image.
 	 */
-	if (this->options.minOctave < 0) {
-		aly::Image1f img;
-		aly::UpSample(orig, img);
-		this->add(img, this->options.inherentBlurSigma * 2.0f,
-				this->options.baseBlurSigma);
+	int const align = 1 << std::max(0, this->options.maxOctave);
+	int overlap = this->options.tileOverlap;
+	if (overlap < 0) {
+		/*
+		 * Descriptor window of the coarsest sample plus the blur support of
+		 * the last level, measured in pixels of the coarsest octave.
+		 */
+		float const S = static_cast<float>(this->options.samplesPerOctave);
+		float const maxScale = this->options.baseBlurSigma
+				* std::pow(2.0f, (S + 1.0f) / S);
+		float const maxBlur = this->options.baseBlurSigma
+				* std::pow(2.0f, (S + 2.0f) / S);
+		overlap = (static_cast<int>(std::ceil(
+				MATH_SQRT2 * 3.0f * maxScale * 2.5f + 3.0f * maxBlur)) + 2)
+				* align;
 	}
+	overlap = ((overlap + align - 1) / align) * align;
+	int const tile = ((this->options.tileSize + align - 1) / align) * align;
+	int const width = orig.width;
+	int const height = orig.height;
+	aly::Image1f crop;
+	for (int ty = 0; ty < height; ty += tile) {
+		for (int tx = 0; tx < width; tx += tile) {
+			/* Features are owned by the tile whose core contains them. */
+			int2 coreMin(tx, ty);
+			int2 coreMax(tx + tile, ty + tile);
+			if (tx == 0)
+				coreMin.x = std::numeric_limits<int>::min();
+			if (ty == 0)
+				coreMin.y = std::numeric_limits<int>::min();
+			if (tx + tile >= width)
+				coreMax.x = std::numeric_limits<int>::max();
+			if (ty + tile >= height)
+				coreMax.y = std::numeric_limits<int>::max();
+			int2 pos(std::max(0, tx - overlap), std::max(0, ty - overlap));
+			int2 end(std::min(width, tx + tile + overlap),
+					std::min(height, ty + tile + overlap));
+			aly::Crop(orig, crop, pos, end - pos);
+			this->processImage(crop, pos, coreMin, coreMax,
+					generateDescriptors, false);
+		}
+	}
+}
 
+/* ---------------------------------------------------------------- */
+
+void Sift::processImage(const Image1f& image, const int2& offset,
+		const int2& coreMin, const int2& coreMax, bool generateDescriptors,
+		bool retain) {
 	/*
-	 * Prepare image for the first positive octave by downsampling.
-	 * This code is executed only if min_octave > 0.
+	 * Create octave -1. The original image is assumed to have blur
+	 * sigma = 0.5. The double size image therefore has sigma = 1.
 	 */
-	aly::Image1f img = this->orig;
+	aly::Image1f img;
 	aly::Image1f tmp;
-	for (int i = 0; i < this->options.minOctave; ++i) {
-		aly::DownSample3x3(img, tmp);
-		img = tmp;
+	float img_sigma = this->options.inherentBlurSigma;
+	if (this->options.minOctave < 0) {
+		aly::UpSample(image, img);
+		img_sigma = this->options.inherentBlurSigma * 2.0f;
+	} else {
+		/*
+		 * Prepare image for the first positive octave by downsampling.
+		 * This code is executed only if min_octave > 0.
+		 */
+		img = image;
+		for (int i = 0; i < this->options.minOctave; ++i) {
+			aly::DownSample3x3(img, tmp);
+			img = tmp;
+		}
 	}
 	/*
-	 * Create new octave from 'img', then subsample octave image where
-	 * sigma is doubled to get a new base image for the next octave.
+	 * Process one octave at a time. Each octave produces the base image of
+	 * the next one, so only a single octave is resident at any time.
 	 */
-	float img_sigma = this->options.inherentBlurSigma;
-	for (int i = std::max(0, this->options.minOctave);i <= this->options.maxOctave; ++i) {
-		this->add(img, img_sigma, this->options.baseBlurSigma);
-		aly::DownSample3x3(img, tmp);
+	for (int oi = this->options.minOctave; oi <= this->options.maxOctave;
+			++oi) {
+		if (img.width < 3 || img.height < 3)
+			break;
+		this->processOctave(img, img_sigma, oi, offset, coreMin, coreMax,
+				generateDescriptors, retain, tmp);
 		img = tmp;
 		img_sigma = this->options.baseBlurSigma;
 	}
@@ -92,107 +210,194 @@ void Sift::create(void) {
 
 /* ---------------------------------------------------------------- */
 
-void Sift::add(const Image1f& image, float has_sigma, float target_sigma) {
-	aly::Image1f base;
-	float sigma = std::sqrt(MATH_POW2(target_sigma) - MATH_POW2(has_sigma));
-	this->octaves.push_back(std::shared_ptr<Octave>(new Octave()));
-	OctavePtr oct = this->octaves.back();
-	oct->gray.resize(this->options.samplesPerOctave + 3);
-	oct->dog.resize(this->options.samplesPerOctave + 2);
-	if (target_sigma > has_sigma) {
-		aly::Smooth(image, base, target_sigma);
+void Sift::processOctave(const Image1f& image, float has_sigma, int oi,
+		const int2& offset, const int2& coreMin, const int2& coreMax,
+		bool generateDescriptors, bool retain, Image1f& next) {
+	int const S = this->options.samplesPerOctave;
+	OctavePtr oct = OctavePtr(new Octave());
+	std::vector<aly::Image1f>& gray = oct->gray;
+	std::vector<aly::Image1f>& dog = oct->dog;
+	gray.resize(S + 3);
+	dog.resize(S + 2);
+	float sigma = this->options.baseBlurSigma;
+	if (sigma > has_sigma) {
+		GaussianBlur(image, gray[0],
+				std::sqrt(MATH_POW2(sigma) - MATH_POW2(has_sigma)));
 	} else {
-		base = image;
+		gray[0] = image;
 	}
-	oct->gray[0]=base;
-	float const k = std::pow(2.0f, 1.0f / this->options.samplesPerOctave);
-	sigma = target_sigma;
-	for (int i = 1; i < this->options.samplesPerOctave + 3; ++i) {
+	float const k = std::pow(2.0f, 1.0f / S);
+	Keypoints kps;
+	for (int i = 1; i < S + 3; ++i) {
 		/* Calculate the blur sigma the image will get. */
 		float sigmak = sigma * k;
 		float blur_sigma = std::sqrt(MATH_POW2(sigmak) - MATH_POW2(sigma));
-		aly::Smooth(base, oct->gray[i], blur_sigma);
-		oct->dog[i-1]=oct->gray[i] - base;
-		base = oct->gray[i];
+		GaussianBlur(gray[i - 1], gray[i], blur_sigma);
 		sigma = sigmak;
-		//WriteImageToFile(MakeString()<<GetDesktopDirectory()<<ALY_PATH_SEPARATOR<<"sift_dog"<<this->octaves.size()<<"_"<<i-1<<".xml",oct->dog[i-1]);
+		const aly::Image1f& g0 = gray[i - 1];
+		const aly::Image1f& g1 = gray[i];
+		aly::Image1f& d = dog[i - 1];
+		d.resize(g1.width, g1.height);
+#pragma omp parallel for
+		for (int n = 0; n < (int) d.size(); ++n) {
+			d[n].x = g1[n].x - g0[n].x;
+		}
+		/*
+		 * As soon as three DoG images are available, detect and localize
+		 * extrema in the middle one. Localization never changes the
+		 * sample, so the oldest DoG image is not needed afterwards.
+		 */
+		if (i >= 3) {
+			int const s = i - 3;
+			const aly::Image1f* samples[3] = { &dog[s + 0], &dog[s + 1],
+					&dog[s + 2] };
+			Keypoints found;
+			this->extremaDetection(samples, oi, s, found);
+			this->keypointLocalization(samples, found);
+			kps.insert(kps.end(), found.begin(), found.end());
+			if (!retain)
+				dog[s].clear();
+		}
 	}
-}
-
-/* ---------------------------------------------------------------- */
-
-void Sift::extremaDetection(void) {
-	/* Delete previous keypoints. */
-	this->keypoints.clear();
-	/* Detect keypoints in each octave... */
-	for (std::size_t i = 0; i < this->octaves.size(); ++i) {
-		OctavePtr oct=this->octaves[i];
-		/* In each octave, take three subsequent DoG images and detect. */
-		for (int s = 0; s < (int) oct->dog.size() - 2; ++s) {
-			const aly::Image1f* samples[3] = { &oct->dog[s + 0], &oct->dog[s + 1],&oct->dog[s + 2] };
-			this->extremaDetection(samples,static_cast<int>(i) + this->options.minOctave, s);
+	/*
+	 * The base of the next octave is the image with twice the initial
+	 * sigma, resampled by taking every second pixel (Lowe, Section 3).
+	 */
+	const aly::Image1f& src = gray[S];
+	next.resize(src.width / 2, src.height / 2);
+#pragma omp parallel for
+	for (int y = 0; y < next.height; ++y) {
+		for (int x = 0; x < next.width; ++x) {
+			next[y * next.width + x] = src[2 * y * src.width + 2 * x];
 		}
 	}
+	if (!retain) {
+		gray[S + 2].clear();
+		dog.clear();
+	}
+	/* Discard keypoints that belong to a neighboring tile. */
+	float const scale = std::pow(2.0f, (float) oi);
+	float2 const shift(offset.x / scale, offset.y / scale);
+	int count = 0;
+	for (std::size_t i = 0; i < kps.size(); ++i) {
+		SiftKeypoint const& kp = kps[i];
+		float const x = scale * (kp.x + shift.x + 0.5f) - 0.5f;
+		float const y = scale * (kp.y + shift.y + 0.5f) - 0.5f;
+		if (x < (float) coreMin.x || x >= (float) coreMax.x
+				|| y < (float) coreMin.y || y >= (float) coreMax.y)
+			continue;
+		kps[count++] = kp;
+	}
+	kps.erase(kps.begin() + count, kps.end());
+	/*
+	 * Gradient and orientation images are only needed for the scale levels
+	 * closest to the keypoints. Generate them one level at a time and
+	 * release each gray image once it has been consumed.
+	 */
+	if (generateDescriptors || retain) {
+		if (retain) {
+			oct->gradient.resize(gray.size());
+			oct->orientation.resize(gray.size());
+		}
+		aly::Image1f grad, ori;
+		for (int l = 0; l < (int) gray.size(); ++l) {
+			Keypoints level;
+			if (generateDescriptors) {
+				for (SiftKeypoint const& kp : kps) {
+					if (static_cast<int>(aly::round(kp.sample)) + 1 == l)
+						level.push_back(kp);
+				}
+			}
+			if (level.empty() && !retain) {
+				gray[l].clear();
+				continue;
+			}
+			this->generateFeatureImages(gray[l], grad, ori);
+			if (!level.empty())
+				this->descriptorGeneration(level, grad, ori, offset,
+						this->descriptors);
+			if (retain) {
+				oct->gradient[l] = grad;
+				oct->orientation[l] = ori;
+			} else {
+				gray[l].clear();
+			}
+		}
+	}
+	for (SiftKeypoint& kp : kps) {
+		kp.x += shift.x;
+		kp.y += shift.y;
+	}
+	this->keypoints.insert(this->keypoints.end(), kps.begin(), kps.end());
+	if (retain)
+		this->octaves.push_back(oct);
 }
 
 /* ---------------------------------------------------------------- */
 
-std::size_t Sift::extremaDetection(const aly::Image1f* s[3], int oi, int si) {
+void Sift::extremaDetection(const aly::Image1f* s[3], int oi, int si,
+		Keypoints& result) {
 	int const w = s[1]->width;
 	int const h = s[1]->height;
 	const int noff[9] = { -1 - w, 0 - w, 1 - w, -1, 0, 1, -1 + w, 0 + w, 1 + w };
-	int detected = 0;
-	int off = w;
-	for (int y = 1; y < h - 1; ++y, off += w){
-		for (int x = 1; x < w - 1; ++x) {
-			int idx = off + x;
-			bool largest = true;
-			bool smallest = true;
-			float center_value = (*s[1])[idx].x;
-			for (int l = 0; (largest || smallest) && l < 3; ++l)
-				for (int i = 0; (largest || smallest) && i < 9; ++i) {
-					if (l == 1 && i == 4) // Skip center pixel
-						continue;
-					if ((*s[l])[idx + noff[i]].x >= center_value)
-						largest = false;
-					if ((*s[l])[idx + noff[i]].x <= center_value)
-						smallest = false;
-				}
+	/*
+	 * Rows are split into one contiguous block per thread, so appending the
+	 * per-thread buffers in thread order preserves the scan order.
+	 */
+	std::vector<Keypoints> buffers(omp_get_max_threads());
+#pragma omp parallel
+	{
+		Keypoints& local = buffers[omp_get_thread_num()];
+#pragma omp for schedule(static)
+		for (int y = 1; y < h - 1; ++y) {
+			int const off = y * w;
+			for (int x = 1; x < w - 1; ++x) {
+				int idx = off + x;
+				bool largest = true;
+				bool smallest = true;
+				float center_value = (*s[1])[idx].x;
+				for (int l = 0; (largest || smallest) && l < 3; ++l)
+					for (int i = 0; (largest || smallest) && i < 9; ++i) {
+						if (l == 1 && i == 4) // Skip center pixel
+							continue;
+						if ((*s[l])[idx + noff[i]].x >= center_value)
+							largest = false;
+						if ((*s[l])[idx + noff[i]].x <= center_value)
+							smallest = false;
+					}
 
-			/* Skip non-maximum values. */
-			if (!smallest && !largest)
-				continue;
-			/* Yummy. Add detected scale space extremum. */
-			SiftKeypoint kp;
-			kp.octave = oi;
-			kp.x = static_cast<float>(x);
-			kp.y = static_cast<float>(y);
-			kp.sample = static_cast<float>(si);
-			this->keypoints.push_back(kp);
-			detected += 1;
+				/* Skip non-maximum values. */
+				if (!smallest && !largest)
+					continue;
+				/* Yummy. Add detected scale space extremum. */
+				SiftKeypoint kp;
+				kp.octave = oi;
+				kp.x = static_cast<float>(x);
+				kp.y = static_cast<float>(y);
+				kp.sample = static_cast<float>(si);
+				local.push_back(kp);
+			}
 		}
 	}
-	return detected;
+	for (Keypoints const& local : buffers)
+		result.insert(result.end(), local.begin(), local.end());
 }
 
 /* ---------------------------------------------------------------- */
 
-void Sift::keypointLocalization(void) {
+void Sift::keypointLocalization(const aly::Image1f* dogs[3], Keypoints& kps) {
 	/*
 	 * Iterate over all keypoints, accurately localize minima and maxima
 	 * in the DoG function by fitting a quadratic Taylor polynomial
 	 * around the keypoint.
 	 */
-
-	int num_singular = 0;
-	int num_keypoints = 0; // Write iterator
-	for (std::size_t i = 0; i < this->keypoints.size(); ++i) {
-		SiftKeypoint kp=this->keypoints[i];
-		OctavePtr oct=this->octaves[kp.octave - this->options.minOctave];
-		int sample = static_cast<int>(kp.sample);
-		const aly::Image1f* dogs[3] = { &oct->dog[sample + 0], &oct->dog[sample+ 1], &oct->dog[sample + 2] };
-		int const w = dogs[0]->width;
-		int const h = dogs[0]->height;
+	int const w = dogs[0]->width;
+	int const h = dogs[0]->height;
+	float const score_thres = MATH_POW2(this->options.edgeRatioThreshold + 1.0f)/ this->options.edgeRatioThreshold;
+	std::vector<char> accepted(kps.size(), 0);
+#pragma omp parallel for schedule(dynamic, 64)
+	for (int i = 0; i < (int) kps.size(); ++i) {
+		SiftKeypoint kp = kps[i];
 		int ix = static_cast<int>(kp.x);
 		int iy = static_cast<int>(kp.y);
 		int is = static_cast<int>(kp.sample);
@@ -205,7 +410,6 @@ void Sift::keypointLocalization(void) {
 		 * The procedure might get iterated around a neighboring pixel if
 		 * the accurate keypoint is off by >0.6 from the center pixel.
 		 */
-		float score_thres = MATH_POW2(this->options.edgeRatioThreshold + 1.0f)/ this->options.edgeRatioThreshold;
 #       define AT(S,OFF) ((*dogs[S])[px + OFF].x)
 		for (int j = 0; j < 5; ++j) {
 			std::size_t px = iy * w + ix;
@@ -234,7 +438,6 @@ void Sift::keypointLocalization(void) {
 				fy = b[1];
 				fs = b[2];
 			} catch (...) {
-				num_singular += 1;
 				fx = fy = fs = 0.0f; // FIXME: Handle this case?
 				break;
 			}
@@ -255,6 +458,7 @@ void Sift::keypointLocalization(void) {
 			/* Accurate location looks good. */
 			break;
 		}
+#       undef AT
 
 		/* Calcualte function value D(x) at accurate keypoint x. */
 		float val = (*dogs[1])(ix, iy).x + 0.5f * (Dx * fx + Dy * fy + Ds * fs);
@@ -288,93 +492,92 @@ void Sift::keypointLocalization(void) {
 				|| kp.y > (float) (h - 1)) {
 			continue;
 		}
-		/* Keypoint is accepted, copy to write iter and advance. */
-		this->keypoints[num_keypoints] = kp;
-		num_keypoints += 1;
+		/* Keypoint is accepted. */
+		kps[i] = kp;
+		accepted[i] = 1;
+	}
+	int num_keypoints = 0; // Write iterator
+	for (std::size_t i = 0; i < kps.size(); ++i) {
+		if (accepted[i])
+			kps[num_keypoints++] = kps[i];
 	}
-	this->keypoints.erase(this->keypoints.begin()+num_keypoints,this->keypoints.end());//resize(num_keypoints);
+	kps.erase(kps.begin() + num_keypoints, kps.end());
 }
 
 /* ---------------------------------------------------------------- */
 const SiftDescriptors& Sift::getDescriptors() const {
 	return descriptors;
 }
-void Sift::descriptorGeneration(void) {
-	if (this->octaves.empty())
-		throw std::runtime_error("Octaves not available!");
-	if (this->keypoints.empty())
-		return;
-	this->descriptors.clear();
-	this->descriptors.reserve(this->keypoints.size() * 3 / 2);
+void Sift::descriptorGeneration(const Keypoints& kps, const aly::Image1f& grad,
+		const aly::Image1f& ori, const int2& offset, SiftDescriptors& result) {
 	/*
-	 * Keep a buffer of S+3 gradient and orientation images for the current
-	 * octave. Once the octave is changed, these images are recomputed.
-	 * To ensure efficiency, the octave index must always increase, never
-	 * decrease, which is enforced during the algorithm.
+	 * Keypoints are processed in parallel. Each thread appends to its own
+	 * buffer, and the buffers are concatenated in thread order, which keeps
+	 * the output in keypoint order.
 	 */
-	//int octave_index = this->keypoints[0].octave;
-	for(int n=0;n<(int)octaves.size();n++){
-		this->generateFeatureImages(octaves[n].get());
-	}
-	/* Walk over all keypoints and compute descriptors. */
-#pragma omp parallel for
-	for (int i = 0; i < this->keypoints.size(); ++i) {
-		const SiftKeypoint& kp=this->keypoints[i];
-		Octave* octave = this->octaves[kp.octave - this->options.minOctave].get();
+	std::vector<SiftDescriptors> buffers(omp_get_max_threads());
+#pragma omp parallel
+	{
+		SiftDescriptors& local = buffers[omp_get_thread_num()];
 		std::vector<float> orientations;
 		orientations.reserve(8);
-		this->orientationAssignment(kp, octave, orientations);
-		/* Feature vector extraction. */
-		for (std::size_t j = 0; j < orientations.size(); ++j) {
-			SiftDescriptor desc;
+#pragma omp for schedule(static)
+		for (int i = 0; i < (int) kps.size(); ++i) {
+			const SiftKeypoint& kp = kps[i];
+			orientations.clear();
+			this->orientationAssignment(kp, grad, ori, orientations);
+			/* Feature vector extraction. */
 			float const scale_factor = std::pow(2.0f, kp.octave);
-			desc.x = scale_factor * (kp.x + 0.5f) - 0.5f;
-			desc.y = scale_factor * (kp.y + 0.5f) - 0.5f;
-			desc.scale = this->keypointAbsoluteScale(kp);
-			desc.orientation = orientations[j];
-			//std::cout<<"Descriptor "<<desc.x<<" "<<desc.y<<" "<<desc.scale<<" "<<desc.orientation<<std::endl;
-			if (this->descriptorAssignment(kp, desc, octave)){
-#pragma omp critical
-				{
-					this->descriptors.push_back(desc);
-				}
+			for (std::size_t j = 0; j < orientations.size(); ++j) {
+				SiftDescriptor desc;
+				desc.x = scale_factor * (kp.x + 0.5f) - 0.5f + offset.x;
+				desc.y = scale_factor * (kp.y + 0.5f) - 0.5f + offset.y;
+				desc.scale = this->keypointAbsoluteScale(kp);
+				desc.orientation = orientations[j];
+				if (this->descriptorAssignment(kp, desc, grad, ori))
+					local.push_back(desc);
 			}
 		}
 	}
+	std::size_t total = result.size();
+	for (SiftDescriptors const& local : buffers)
+		total += local.size();
+	result.reserve(total);
+	for (SiftDescriptors const& local : buffers)
+		result.insert(result.end(), local.begin(), local.end());
 }
 
 /* ---------------------------------------------------------------- */
 
-void Sift::generateFeatureImages(Octave* octave) {
-	int const width = octave->gray[0].width;
-	int const height = octave->gray[0].height;
-	octave->gradient.resize(octave->gray.size(),Image1f(width,height));
-	octave->orientation.resize(octave->gray.size(),Image1f(width,height));
-	//std::cout << "Generating gradient and orientation images..." << std::endl;
-	for (std::size_t i = 0; i < octave->gray.size(); ++i) {
-		aly::Image1f& img = octave->gray[i];
-		aly::Image1f& grad=octave->gradient[i];
-		aly::Image1f& ori=octave->orientation[i];
-		int image_iter = width + 1;
-		for (int y = 1; y < height - 1; ++y, image_iter += 2){
-			for (int x = 1; x < width - 1; ++x, ++image_iter) {
-				float m1x = img[image_iter - 1];
-				float p1x = img[image_iter + 1];
-				float m1y = img[image_iter - width];
-				float p1y = img[image_iter + width];
-				float dx = 0.5f * (p1x - m1x);
-				float dy = 0.5f * (p1y - m1y);
-				float atan2f = std::atan2(dy, dx);
-				grad[image_iter].x = std::sqrt(dx * dx + dy * dy);
-				ori[image_iter].x =atan2f < 0.0f ? atan2f + ALY_PI * 2.0f : atan2f;
-			}
+void Sift::generateFeatureImages(const aly::Image1f& img, aly::Image1f& grad,
+		aly::Image1f& ori) {
+	int const width = img.width;
+	int const height = img.height;
+	grad.resize(width, height);
+	ori.resize(width, height);
+	grad.set(0.0f);
+	ori.set(0.0f);
+#pragma omp parallel for
+	for (int y = 1; y < height - 1; ++y) {
+		int image_iter = y * width + 1;
+		for (int x = 1; x < width - 1; ++x, ++image_iter) {
+			float m1x = img[image_iter - 1];
+			float p1x = img[image_iter + 1];
+			float m1y = img[image_iter - width];
+			float p1y = img[image_iter + width];
+			float dx = 0.5f * (p1x - m1x);
+			float dy = 0.5f * (p1y - m1y);
+			float atan2f = std::atan2(dy, dx);
+			grad[image_iter].x = std::sqrt(dx * dx + dy * dy);
+			ori[image_iter].x =atan2f < 0.0f ? atan2f + ALY_PI * 2.0f : atan2f;
 		}
 	}
 }
 
 /* ---------------------------------------------------------------- */
 
-void Sift::orientationAssignment(SiftKeypoint const& kp, Octave const* octave,
+void Sift::orientationAssignment(SiftKeypoint const& kp,
+		const aly::Image1f& grad, const aly::Image1f& ori,
 		std::vector<float>& orientations) {
 	int const nbins = 36;
 	float const nbinsf = static_cast<float>(nbins);
@@ -383,15 +586,12 @@ void Sift::orientationAssignment(SiftKeypoint const& kp, Octave const* octave,
 	float hist[nbins];
 	std::fill(hist, hist + nbins, 0.0f);
 
-	/* Integral x and y coordinates and closest scale sample. */
+	/* Integral x and y coordinates. */
 	int const ix = static_cast<int>(kp.x + 0.5f);
 	int const iy = static_cast<int>(kp.y + 0.5f);
-	int const is = static_cast<int>(aly::round(kp.sample));
 	float const sigma = this->keypointRelativeScale(kp);
 
 	/* Images with its dimension for the keypoint. */
-	const aly::Image1f& grad = octave->gradient[is + 1];
-	const aly::Image1f& ori = octave->orientation[is + 1];
 	int const width = grad.width;
 	int const height = grad.height;
 
@@ -471,7 +671,7 @@ void Sift::orientationAssignment(SiftKeypoint const& kp, Octave const* octave,
 /* ---------------------------------------------------------------- */
 
 bool Sift::descriptorAssignment(SiftKeypoint const& kp, SiftDescriptor& desc,
-		Octave const* octave) {
+		const aly::Image1f& grad, const aly::Image1f& ori) {
 	/*
 	 * The final feature vector has size PXB * PXB * OHB.
 	 * The following constants should not be changed yet, as the
@@ -481,16 +681,13 @@ bool Sift::descriptorAssignment(SiftKeypoint const& kp, SiftDescriptor& desc,
 	int const PXB = 4; // Pixel bins with 4x4 bins
 	int const OHB = 8; // Orientation histogram with 8 bins
 
-	/* Integral x and y coordinates and closest scale sample. */
+	/* Integral x and y coordinates. */
 	int const ix = static_cast<int>(kp.x + 0.5f);
 	int const iy = static_cast<int>(kp.y + 0.5f);
-	int const is = static_cast<int>(aly::round(kp.sample));
 	float const dxf = kp.x - static_cast<float>(ix);
 	float const dyf = kp.y - static_cast<float>(iy);
 	float const sigma = this->keypointRelativeScale(kp);
 	/* Images with its dimension for the keypoint. */
-	const aly::Image1f& grad = octave->gradient[is + 1];
-	const aly::Image1f& ori = octave->orientation[is + 1];
 	int const width = grad.width;
 	int const height = grad.height;
 	/* Clear feature vector. */